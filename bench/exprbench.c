@@ -0,0 +1,446 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Benchmarking filters: row-at-a-time vs. vectorised evaluation
+ * ========================================================================
+ */
+#include <nowdb/types/types.h>
+#include <nowdb/fun/expr.h>
+#include <nowdb/fun/vexpr.h>
+#include <nowdb/fun/simd.h>
+#include <common/cmd.h>
+#include <common/bench.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/* ------------------------------------------------------------------------
+ * HELP!
+ * ------------------------------------------------------------------------
+ */
+void helptxt(char *progname) {
+	fprintf(stderr, "%s [options]\n", progname);
+	fprintf(stderr, "all options are in the format -opt value\n");
+	fprintf(stderr, "-count n: number of edges to filter (default: 1000000)\n");
+	fprintf(stderr, "-iter  n: number of iterations (default: 10)\n");
+	fprintf(stderr, "-simd  n: kernels: 0: scalar, 1: sse4.2, 2: avx2 (default: best)\n");
+}
+
+/* ------------------------------------------------------------------------
+ * options
+ * -------
+ * global_count: number of edges in memory
+ * global_iter: repeat n times
+ * global_simd: kernel implementation
+ * ------------------------------------------------------------------------
+ */
+uint32_t global_count = 1000000;
+uint32_t global_iter = 10;
+uint32_t global_simd = NOWDB_SIMD_AVX2;
+
+/* ------------------------------------------------------------------------
+ * get options
+ * ------------------------------------------------------------------------
+ */
+int parsecmd(int argc, char **argv) {
+	int err = 0;
+
+	global_count = (uint32_t)ts_algo_args_findUint(
+	            argc, argv, 1, "count", 1000000, &err);
+	if (err != 0) {
+		fprintf(stderr, "command line error: %d\n", err);
+		return -1;
+	}
+	global_iter = (uint32_t)ts_algo_args_findUint(
+	            argc, argv, 1, "iter", 10, &err);
+	if (err != 0) {
+		fprintf(stderr, "command line error: %d\n", err);
+		return -1;
+	}
+	if (global_iter == 0) global_iter = 1;
+	global_simd = (uint32_t)ts_algo_args_findUint(
+	            argc, argv, 1, "simd", NOWDB_SIMD_AVX2, &err);
+	if (err != 0) {
+		fprintf(stderr, "command line error: %d\n", err);
+		return -1;
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Edges: origin, destin, stamp, weight (uint), value (float)
+ * ------------------------------------------------------------------------
+ */
+#define NATTS 5
+
+#define WEIGHT_OFF 24
+#define VALUE_OFF  32
+
+uint32_t recsz;
+uint32_t npages;
+char *pages = NULL;
+
+nowdb_eval_t _hlp;
+
+/* ------------------------------------------------------------------------
+ * Create pages
+ * ------------------------------------------------------------------------
+ */
+int mkPages() {
+	uint32_t perpage = NOWDB_IDX_PAGE/recsz;
+	uint32_t k = 0;
+
+	npages = global_count/perpage;
+	if (npages*perpage < global_count) npages++;
+
+	pages = calloc(npages, NOWDB_IDX_PAGE);
+	if (pages == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		return -1;
+	}
+	for(uint32_t i=0; i<npages; i++) {
+		char *page = pages+i*NOWDB_IDX_PAGE;
+		for(uint32_t j=0; j<perpage && k<global_count; j++,k++) {
+			char *rec = page+j*recsz;
+			uint64_t u; int64_t t; double d;
+
+			u = rand()%1000+1; memcpy(rec, &u, 8);
+			u = rand()%1000+1; memcpy(rec+8, &u, 8);
+			t = k; memcpy(rec+16, &t, 8);
+			u = rand()%100; memcpy(rec+WEIGHT_OFF, &u, 8);
+			d = (double)(rand()%1000)/10.0;
+			memcpy(rec+VALUE_OFF, &d, 8);
+
+			// weight is NULL for 5%
+			rec[nowdb_ctrlStart(NATTS)] = 0x17;
+			if (rand()%20 != 0) rec[nowdb_ctrlStart(NATTS)] |= 0x08;
+		}
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Expression helpers (errors are just reported)
+ * ------------------------------------------------------------------------
+ */
+nowdb_expr_t field(char *name, uint32_t off, nowdb_type_t t) {
+	nowdb_err_t err;
+	nowdb_expr_t f;
+
+	err = nowdb_expr_newEdgeField(&f, name, off, t, NATTS);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err); nowdb_err_release(err);
+		return NULL;
+	}
+	return f;
+}
+
+nowdb_expr_t constant(void *v, nowdb_type_t t) {
+	nowdb_err_t err;
+	nowdb_expr_t c;
+
+	err = nowdb_expr_newConstant(&c, v, t);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err); nowdb_err_release(err);
+		return NULL;
+	}
+	return c;
+}
+
+nowdb_expr_t op(uint32_t fun, nowdb_expr_t a, nowdb_expr_t b) {
+	nowdb_err_t err;
+	nowdb_expr_t o;
+
+	if (a == NULL || (b == NULL && fun != NOWDB_EXPR_OP_NOT &&
+	                               fun != NOWDB_EXPR_OP_IS)) {
+		if (a != NULL) { nowdb_expr_destroy(a); free(a); }
+		if (b != NULL) { nowdb_expr_destroy(b); free(b); }
+		return NULL;
+	}
+	if (b == NULL) {
+		err = nowdb_expr_newOp(&o, fun, a);
+	} else {
+		err = nowdb_expr_newOp(&o, fun, a, b);
+	}
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err); nowdb_err_release(err);
+		nowdb_expr_destroy(a); free(a);
+		if (b != NULL) { nowdb_expr_destroy(b); free(b); }
+		return NULL;
+	}
+	return o;
+}
+
+nowdb_expr_t uconst(uint64_t u) {
+	return constant(&u, NOWDB_TYP_UINT);
+}
+
+nowdb_expr_t tconst(int64_t t) {
+	return constant(&t, NOWDB_TYP_TIME);
+}
+
+nowdb_expr_t fconst(double d) {
+	return constant(&d, NOWDB_TYP_FLOAT);
+}
+
+nowdb_expr_t inconst(int n, const uint64_t *u) {
+	nowdb_err_t err;
+	nowdb_expr_t c;
+	ts_algo_list_t vals;
+	uint64_t *v;
+
+	ts_algo_list_init(&vals);
+	for(int i=0; i<n; i++) {
+		v = malloc(8);
+		if (v == NULL) break;
+		*v = u[i];
+		if (ts_algo_list_append(&vals, v) != TS_ALGO_OK) {
+			free(v); break;
+		}
+	}
+	if (vals.len != n) {
+		fprintf(stderr, "out-of-mem\n");
+		ts_algo_list_destroyAll(&vals);
+		return NULL;
+	}
+	err = nowdb_expr_constFromList(&c, &vals, NOWDB_TYP_UINT);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err); nowdb_err_release(err);
+		ts_algo_list_destroyAll(&vals);
+		return NULL;
+	}
+	ts_algo_list_destroy(&vals);
+	return c;
+}
+
+uint64_t someWeights[] = {1, 5, 7, 42};
+
+/* ------------------------------------------------------------------------
+ * The filters
+ * ------------------------------------------------------------------------
+ */
+#define NFILTERS 6
+
+char *filterName(int i) {
+	switch(i) {
+	case 0: return "stamp >= a and stamp < b";
+	case 1: return "origin = k";
+	case 2: return "origin > x or value < y";
+	case 3: return "not weight is null and weight < x";
+	case 4: return "weight * 2 > x and stamp >= a";
+	case 5: return "weight in (a, b, c, d)";
+	default: return "?";
+	}
+}
+
+nowdb_expr_t mkFilter(int i) {
+	uint64_t s = global_count/4;
+	uint64_t e = global_count/2;
+
+	switch(i) {
+	case 0: return op(NOWDB_EXPR_OP_AND,
+	            op(NOWDB_EXPR_OP_GE,
+	               field(NULL, NOWDB_OFF_STAMP, NOWDB_TYP_TIME),
+	               tconst(s)),
+	            op(NOWDB_EXPR_OP_LT,
+	               field(NULL, NOWDB_OFF_STAMP, NOWDB_TYP_TIME),
+	               tconst(e)));
+	case 1: return op(NOWDB_EXPR_OP_EQ,
+	            field(NULL, NOWDB_OFF_ORIGIN, NOWDB_TYP_UINT),
+	            uconst(42));
+	case 2: return op(NOWDB_EXPR_OP_OR,
+	            op(NOWDB_EXPR_OP_GT,
+	               field(NULL, NOWDB_OFF_ORIGIN, NOWDB_TYP_UINT),
+	               uconst(990)),
+	            op(NOWDB_EXPR_OP_LT,
+	               field("value", VALUE_OFF, NOWDB_TYP_FLOAT),
+	               fconst(10.0)));
+	case 3: return op(NOWDB_EXPR_OP_AND,
+	            op(NOWDB_EXPR_OP_NOT,
+	               op(NOWDB_EXPR_OP_IS,
+	                  field("weight", WEIGHT_OFF, NOWDB_TYP_UINT),
+	                  NULL), NULL),
+	            op(NOWDB_EXPR_OP_LT,
+	               field("weight", WEIGHT_OFF, NOWDB_TYP_UINT),
+	               uconst(50)));
+	case 4: return op(NOWDB_EXPR_OP_AND,
+	            op(NOWDB_EXPR_OP_GT,
+	               op(NOWDB_EXPR_OP_MUL,
+	                  field("weight", WEIGHT_OFF, NOWDB_TYP_UINT),
+	                  uconst(2)),
+	               uconst(100)),
+	            op(NOWDB_EXPR_OP_GE,
+	               field(NULL, NOWDB_OFF_STAMP, NOWDB_TYP_TIME),
+	               tconst(s)));
+	case 5: return op(NOWDB_EXPR_OP_IN,
+	            field("weight", WEIGHT_OFF, NOWDB_TYP_UINT),
+	            inconst(4, someWeights));
+	default: return NULL;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Row at a time (like the cursor used to do)
+ * ------------------------------------------------------------------------
+ */
+int rowFilter(nowdb_expr_t filter, uint64_t *count) {
+	nowdb_err_t err;
+	nowdb_type_t t;
+	void *v;
+	uint64_t c = 0;
+
+	for(uint32_t i=0; i<npages; i++) {
+		char *page = pages+i*NOWDB_IDX_PAGE;
+		for(uint32_t off=0; off+recsz<=NOWDB_IDX_PAGE; off+=recsz) {
+			if (memcmp(page+off, nowdb_nullrec, recsz) == 0) break;
+			err = nowdb_expr_eval(filter, &_hlp, page+off, &t, &v);
+			if (err != NOWDB_OK) {
+				nowdb_err_print(err); nowdb_err_release(err);
+				return -1;
+			}
+			if (t == NOWDB_TYP_NOTHING) continue;
+			if (!(*(nowdb_value_t*)v)) continue;
+			c++;
+		}
+	}
+	*count = c;
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Page at a time
+ * ------------------------------------------------------------------------
+ */
+int vecFilter(nowdb_vexpr_t *vx, nowdb_sel_t *sel, uint64_t *count) {
+	nowdb_err_t err;
+	uint64_t c = 0;
+
+	for(uint32_t i=0; i<npages; i++) {
+		char *page = pages+i*NOWDB_IDX_PAGE;
+		nowdb_sel_fromPage(sel, page, NOWDB_IDX_PAGE, recsz, NULL);
+		err = nowdb_vexpr_select(vx, page, recsz, sel);
+		if (err != NOWDB_OK) {
+			nowdb_err_print(err); nowdb_err_release(err);
+			return -1;
+		}
+		c += sel->count;
+	}
+	*count = c;
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Run one filter both ways
+ * ------------------------------------------------------------------------
+ */
+int benchFilter(int i, nowdb_sel_t *sel) {
+	struct timespec t1, t2;
+	nowdb_err_t err;
+	nowdb_expr_t filter;
+	nowdb_vexpr_t *vx;
+	uint64_t *rt, *vt;
+	uint64_t rc=0, vc=0;
+	uint64_t rm, vm;
+	int rc2 = 0;
+
+	filter = mkFilter(i);
+	if (filter == NULL) {
+		fprintf(stderr, "cannot create filter %d\n", i);
+		return -1;
+	}
+	err = nowdb_vexpr_new(&vx, filter, &_hlp);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err); nowdb_err_release(err);
+		nowdb_expr_destroy(filter); free(filter);
+		return -1;
+	}
+	rt = calloc(global_iter, sizeof(uint64_t));
+	vt = calloc(global_iter, sizeof(uint64_t));
+	if (rt == NULL || vt == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		rc2 = -1; goto cleanup;
+	}
+	for(uint32_t k=0; k<global_iter; k++) {
+		timestamp(&t1);
+		if (rowFilter(filter, &rc) != 0) {
+			rc2 = -1; goto cleanup;
+		}
+		timestamp(&t2);
+		rt[k] = minus(&t2, &t1)/1000;
+
+		timestamp(&t1);
+		if (vecFilter(vx, sel, &vc) != 0) {
+			rc2 = -1; goto cleanup;
+		}
+		timestamp(&t2);
+		vt[k] = minus(&t2, &t1)/1000;
+	}
+	if (rc != vc) {
+		fprintf(stderr, "%s: results differ: %lu / %lu\n",
+		                       filterName(i), rc, vc);
+		rc2 = -1; goto cleanup;
+	}
+	rm = median(rt, global_iter);
+	vm = median(vt, global_iter);
+	fprintf(stdout, "%-36s | %9lu | %9luus | %9luus | %5.2fx | %u\n",
+	        filterName(i), rc, rm, vm,
+	        vm == 0 ? 0.0 : (double)rm/(double)vm, vx->fallbacks);
+
+cleanup:
+	if (rt != NULL) free(rt);
+	if (vt != NULL) free(vt);
+	nowdb_vexpr_destroy(vx); free(vx);
+	nowdb_expr_destroy(filter); free(filter);
+	return rc2;
+}
+
+int main(int argc, char **argv) {
+	int rc = EXIT_SUCCESS;
+	nowdb_sel_t *sel = NULL;
+
+	if (argc > 1 && strcmp(argv[1], "-?") == 0) {
+		helptxt(argv[0]);
+		return EXIT_SUCCESS;
+	}
+	if (parsecmd(argc, argv) != 0) {
+		helptxt(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (!nowdb_err_init()) {
+		fprintf(stderr, "cannot init error manager\n");
+		return EXIT_FAILURE;
+	}
+
+	recsz = nowdb_recSize(NATTS);
+	if (mkPages() != 0) {
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	sel = calloc(1, sizeof(nowdb_sel_t));
+	if (sel == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+
+	nowdb_simd_setLevel(global_simd);
+
+	fprintf(stdout, "%u edges in %u pages, median of %u iterations, "
+	                "kernels: %s\n", global_count, npages, global_iter,
+	                nowdb_simd_level() == NOWDB_SIMD_AVX2?"avx2":
+	                nowdb_simd_level() == NOWDB_SIMD_SSE42?"sse4.2":
+	                                                      "scalar");
+	fprintf(stdout, "%-36s | %9s | %11s | %11s | %6s | %s\n",
+	        "filter", "selected", "row", "vector", "gain", "fallbacks");
+
+	for(int i=0; i<NFILTERS; i++) {
+		if (benchFilter(i, sel) != 0) {
+			rc = EXIT_FAILURE; break;
+		}
+	}
+
+cleanup:
+	if (sel != NULL) free(sel);
+	if (pages != NULL) free(pages);
+	nowdb_err_destroy();
+	return rc;
+}
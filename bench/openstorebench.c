@@ -0,0 +1,267 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Benchmarking store open with many readers
+ * (catalog checkpoint plus journal tail)
+ * ========================================================================
+ */
+#include <nowdb/store/store.h>
+#include <common/cmd.h>
+#include <common/bench.h>
+#include <common/stores.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/* ------------------------------------------------------------------------
+ * HELP!
+ * ------------------------------------------------------------------------
+ */
+void helptxt(char *progname) {
+	fprintf(stderr, "%s <path-to-store> [options]\n", progname);
+	fprintf(stderr, "all options are in the format -opt value\n");
+	fprintf(stderr, "-files n: number of readers (default: 10000)\n");
+	fprintf(stderr, "-tail  n: readers added before each open\n");
+	fprintf(stderr, "          without closing the store (default: 0)\n");
+	fprintf(stderr, "-iter  n: number of iterations (default: 5)\n");
+}
+
+/* ------------------------------------------------------------------------
+ * options
+ * -------
+ * global_files: readers in the catalog
+ * global_tail: events in the journal when opening
+ * global_iter: repeat n times
+ * ------------------------------------------------------------------------
+ */
+uint32_t global_files = 10000;
+uint32_t global_tail = 0;
+uint32_t global_iter = 5;
+
+/* ------------------------------------------------------------------------
+ * get options
+ * ------------------------------------------------------------------------
+ */
+int parsecmd(int argc, char **argv) {
+	int err = 0;
+
+	global_files = (uint32_t)ts_algo_args_findUint(
+	            argc, argv, 2, "files", 10000, &err);
+	if (err != 0) {
+		fprintf(stderr, "command line error: %d\n", err);
+		return -1;
+	}
+	global_tail = (uint32_t)ts_algo_args_findUint(
+	            argc, argv, 2, "tail", 0, &err);
+	if (err != 0) {
+		fprintf(stderr, "command line error: %d\n", err);
+		return -1;
+	}
+	global_iter = (uint32_t)ts_algo_args_findUint(
+	            argc, argv, 2, "iter", 5, &err);
+	if (err != 0) {
+		fprintf(stderr, "command line error: %d\n", err);
+		return -1;
+	}
+	if (global_iter == 0) global_iter = 1;
+	return 0;
+}
+
+#define RECSZ 64
+
+/* ------------------------------------------------------------------------
+ * New store object (flat, the storage is not started)
+ * ------------------------------------------------------------------------
+ */
+nowdb_store_t *getStore(nowdb_path_t path) {
+	nowdb_storage_t *storage;
+	nowdb_storage_config_t cfg;
+	nowdb_store_t *store;
+	nowdb_err_t err;
+
+	memset(&cfg, 0, sizeof(nowdb_storage_config_t));
+
+	cfg.filesize = NOWDB_MEGA;
+	cfg.largesize = NOWDB_MEGA;
+	cfg.sorters = 1;
+	cfg.sort = 1;
+	cfg.comp = NOWDB_COMP_FLAT;
+
+	err = nowdb_storage_new(&storage, "default", &cfg);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return NULL;
+	}
+	err = nowdb_store_new(&store, path, NULL, 1,
+	                      NOWDB_CONT_EDGE, storage, RECSZ, 1);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_storage_destroy(storage); free(storage);
+		return NULL;
+	}
+	return store;
+}
+
+/* ------------------------------------------------------------------------
+ * Free store object (without closing it)
+ * ------------------------------------------------------------------------
+ */
+void freeStore(nowdb_store_t *store) {
+	destroyStore(store); free(store);
+}
+
+/* ------------------------------------------------------------------------
+ * Add n readers (only the descriptors; open does not touch the files)
+ * 'batch' readers are added at a time.
+ * ------------------------------------------------------------------------
+ */
+int addReaders(nowdb_store_t *store, uint32_t n, uint32_t batch) {
+	ts_algo_list_t old, readers;
+	nowdb_file_t *file;
+	nowdb_err_t err;
+
+	ts_algo_list_init(&old);
+	ts_algo_list_init(&readers);
+
+	for(uint32_t i=0; i<n; i++) {
+		err = nowdb_store_createReader(store, &file);
+		if (err != NOWDB_OK) {
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			return -1;
+		}
+		file->ctrl |= NOWDB_FILE_SORT;
+		file->size = file->capacity;
+		file->oldest = rand()%1000000;
+		file->newest = file->oldest + rand()%1000;
+
+		if (ts_algo_list_append(&readers, file) != TS_ALGO_OK) {
+			fprintf(stderr, "out-of-mem\n");
+			nowdb_file_destroy(file); free(file);
+			nowdb_store_destroyFiles(store, &readers);
+			return -1;
+		}
+		if (readers.len < batch && i+1 < n) continue;
+
+		err = nowdb_store_swapReaders(store, &old, &readers);
+		if (err != NOWDB_OK) {
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			nowdb_store_destroyFiles(store, &readers);
+			return -1;
+		}
+		ts_algo_list_destroy(&readers);
+		ts_algo_list_init(&readers);
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Create store with global_files readers
+ * ------------------------------------------------------------------------
+ */
+int mkReaders(nowdb_path_t path) {
+	nowdb_store_t *store;
+	int rc = 0;
+
+	store = getStore(path);
+	if (store == NULL) return -1;
+
+	if (!createStore(store) || !openStore(store)) {
+		freeStore(store); return -1;
+	}
+	rc = addReaders(store, global_files, global_files);
+	if (!closeStore(store)) rc = -1;
+	freeStore(store);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * Open the store (after leaving a journal tail)
+ * ------------------------------------------------------------------------
+ */
+int openReaders(nowdb_path_t path, uint64_t *tm) {
+	struct timespec t1, t2;
+	nowdb_store_t *store;
+	int rc = 0;
+
+	if (global_tail > 0) {
+		store = getStore(path);
+		if (store == NULL) return -1;
+		if (!openStore(store)) {
+			freeStore(store); return -1;
+		}
+		rc = addReaders(store, global_tail, 1);
+		freeStore(store); /* not closed! */
+		if (rc != 0) return -1;
+	}
+	store = getStore(path);
+	if (store == NULL) return -1;
+
+	timestamp(&t1);
+	if (!openStore(store)) {
+		freeStore(store); return -1;
+	}
+	timestamp(&t2);
+	*tm = minus(&t2, &t1)/1000;
+
+	if (!closeStore(store)) rc = -1;
+	freeStore(store);
+	return rc;
+}
+
+int main(int argc, char **argv) {
+	int rc = EXIT_SUCCESS;
+	nowdb_store_t *store;
+	nowdb_path_t path;
+	uint64_t *tm=NULL;
+
+	if (argc < 2) {
+		helptxt(argv[0]);
+		return EXIT_FAILURE;
+	}
+	path = argv[1];
+	if (path[0] == '-') {
+		fprintf(stderr, "invalid path\n");
+		helptxt(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (parsecmd(argc, argv) != 0) {
+		helptxt(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (!nowdb_err_init()) {
+		fprintf(stderr, "cannot init error manager\n");
+		return EXIT_FAILURE;
+	}
+	tm = calloc(global_iter, sizeof(uint64_t));
+	if (tm == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (mkReaders(path) != 0) {
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	for(uint32_t k=0; k<global_iter; k++) {
+		if (openReaders(path, tm+k) != 0) {
+			rc = EXIT_FAILURE; goto cleanup;
+		}
+	}
+	fprintf(stdout, "%u readers, journal tail of %u readers, "
+	                "median of %u iterations\n",
+	                global_files, global_tail, global_iter);
+	fprintf(stdout, "open: %luus\n", median(tm, global_iter));
+
+cleanup:
+	store = getStore(path);
+	if (store != NULL) {
+		NOWDB_IGNORE(nowdb_store_drop(store));
+		freeStore(store);
+	}
+	if (tm != NULL) free(tm);
+	nowdb_err_destroy();
+	return rc;
+}
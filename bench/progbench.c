@@ -0,0 +1,378 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Benchmarking expressions: tree walk vs. compiled program
+ * ========================================================================
+ */
+#include <nowdb/types/types.h>
+#include <nowdb/fun/expr.h>
+#include <common/cmd.h>
+#include <common/bench.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/* ------------------------------------------------------------------------
+ * HELP!
+ * ------------------------------------------------------------------------
+ */
+void helptxt(char *progname) {
+	fprintf(stderr, "%s [options]\n", progname);
+	fprintf(stderr, "all options are in the format -opt value\n");
+	fprintf(stderr, "-count n: number of edges (default: 1000000)\n");
+	fprintf(stderr, "-iter  n: number of iterations (default: 10)\n");
+}
+
+/* ------------------------------------------------------------------------
+ * options
+ * -------
+ * global_count: number of edges in memory
+ * global_iter: repeat n times
+ * ------------------------------------------------------------------------
+ */
+uint32_t global_count = 1000000;
+uint32_t global_iter = 10;
+
+/* ------------------------------------------------------------------------
+ * get options
+ * ------------------------------------------------------------------------
+ */
+int parsecmd(int argc, char **argv) {
+	int err = 0;
+
+	global_count = (uint32_t)ts_algo_args_findUint(
+	            argc, argv, 1, "count", 1000000, &err);
+	if (err != 0) {
+		fprintf(stderr, "command line error: %d\n", err);
+		return -1;
+	}
+	global_iter = (uint32_t)ts_algo_args_findUint(
+	            argc, argv, 1, "iter", 10, &err);
+	if (err != 0) {
+		fprintf(stderr, "command line error: %d\n", err);
+		return -1;
+	}
+	if (global_iter == 0) global_iter = 1;
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Edges: origin, destin, stamp, weight (uint), value (int), ratio (float)
+ * ------------------------------------------------------------------------
+ */
+#define NATTS 6
+
+#define WEIGHT_OFF 24
+#define VALUE_OFF  32
+#define RATIO_OFF  40
+
+uint32_t recsz;
+char *edges = NULL;
+
+nowdb_eval_t _hlp;
+
+/* ------------------------------------------------------------------------
+ * Create edges
+ * ------------------------------------------------------------------------
+ */
+int mkEdges() {
+	edges = calloc(global_count, recsz);
+	if (edges == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		return -1;
+	}
+	for(uint32_t k=0; k<global_count; k++) {
+		char *rec = edges+k*recsz;
+		uint64_t u; int64_t l; double d;
+
+		u = rand()%1000+1; memcpy(rec, &u, 8);
+		u = rand()%1000+1; memcpy(rec+8, &u, 8);
+		l = k; memcpy(rec+16, &l, 8);
+		u = rand()%100; memcpy(rec+WEIGHT_OFF, &u, 8);
+		l = rand()%200-100; memcpy(rec+VALUE_OFF, &l, 8);
+		d = (double)(rand()%1000)/10.0; memcpy(rec+RATIO_OFF, &d, 8);
+
+		// weight is NULL for 5%
+		rec[nowdb_ctrlStart(NATTS)] = 0x37;
+		if (rand()%20 != 0) rec[nowdb_ctrlStart(NATTS)] |= 0x08;
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Expression helpers (errors are just reported)
+ * ------------------------------------------------------------------------
+ */
+nowdb_expr_t field(char *name, uint32_t off, nowdb_type_t t) {
+	nowdb_err_t err;
+	nowdb_expr_t f;
+
+	err = nowdb_expr_newEdgeField(&f, name, off, t, NATTS);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err); nowdb_err_release(err);
+		return NULL;
+	}
+	return f;
+}
+
+nowdb_expr_t constant(void *v, nowdb_type_t t) {
+	nowdb_err_t err;
+	nowdb_expr_t c;
+
+	err = nowdb_expr_newConstant(&c, v, t);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err); nowdb_err_release(err);
+		return NULL;
+	}
+	return c;
+}
+
+nowdb_expr_t opv(uint32_t fun, uint32_t n, nowdb_expr_t *ops) {
+	nowdb_err_t err;
+	nowdb_expr_t o;
+
+	for(int i=0; i<n; i++) {
+		if (ops[i] == NULL) {
+			for(int k=0; k<n; k++) {
+				if (ops[k] == NULL) continue;
+				nowdb_expr_destroy(ops[k]); free(ops[k]);
+			}
+			return NULL;
+		}
+	}
+	err = nowdb_expr_newOpV(&o, fun, n, ops);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err); nowdb_err_release(err);
+		for(int k=0; k<n; k++) {
+			nowdb_expr_destroy(ops[k]); free(ops[k]);
+		}
+		return NULL;
+	}
+	return o;
+}
+
+nowdb_expr_t op0(uint32_t fun) {
+	return opv(fun, 0, NULL);
+}
+
+nowdb_expr_t op1(uint32_t fun, nowdb_expr_t a) {
+	return opv(fun, 1, &a);
+}
+
+nowdb_expr_t op2(uint32_t fun, nowdb_expr_t a, nowdb_expr_t b) {
+	nowdb_expr_t ops[2];
+	ops[0] = a; ops[1] = b;
+	return opv(fun, 2, ops);
+}
+
+nowdb_expr_t op3(uint32_t fun, nowdb_expr_t a,
+                 nowdb_expr_t b, nowdb_expr_t c) {
+	nowdb_expr_t ops[3];
+	ops[0] = a; ops[1] = b; ops[2] = c;
+	return opv(fun, 3, ops);
+}
+
+nowdb_expr_t uconst(uint64_t u) {
+	return constant(&u, NOWDB_TYP_UINT);
+}
+
+nowdb_expr_t iconst(int64_t i) {
+	return constant(&i, NOWDB_TYP_INT);
+}
+
+nowdb_expr_t fconst(double d) {
+	return constant(&d, NOWDB_TYP_FLOAT);
+}
+
+nowdb_expr_t weight() {
+	return field("weight", WEIGHT_OFF, NOWDB_TYP_UINT);
+}
+
+nowdb_expr_t value() {
+	return field("value", VALUE_OFF, NOWDB_TYP_INT);
+}
+
+nowdb_expr_t ratio() {
+	return field("ratio", RATIO_OFF, NOWDB_TYP_FLOAT);
+}
+
+/* ------------------------------------------------------------------------
+ * The expressions
+ * (fields are never converted: the tree would convert them in place)
+ * ------------------------------------------------------------------------
+ */
+#define NEXPRS 8
+
+char *exprName(int i) {
+	switch(i) {
+	case 0: return "weight + 1";
+	case 1: return "ratio * 2 + 0.5";
+	case 2: return "value * 3 - 7";
+	case 3: return "case when value > 50 then ratio else 0";
+	case 4: return "coalesce(weight, 0) * 2";
+	case 5: return "abs(value) + floor(ratio)";
+	case 6: return "(2 + 3) * pi() * ratio";
+	case 7: return "weight >= 10 and ratio < 50 and value < 0";
+	default: return "?";
+	}
+}
+
+nowdb_expr_t mkExpr(int i) {
+	switch(i) {
+	case 0: return op2(NOWDB_EXPR_OP_ADD, weight(), uconst(1));
+	case 1: return op2(NOWDB_EXPR_OP_ADD,
+	               op2(NOWDB_EXPR_OP_MUL, ratio(), uconst(2)),
+	               fconst(0.5));
+	case 2: return op2(NOWDB_EXPR_OP_SUB,
+	               op2(NOWDB_EXPR_OP_MUL, value(), iconst(3)),
+	               iconst(7));
+	case 3: return op3(NOWDB_EXPR_OP_WHEN,
+	               op2(NOWDB_EXPR_OP_GT, value(), iconst(50)),
+	               ratio(), fconst(0.0));
+	case 4: return op2(NOWDB_EXPR_OP_MUL,
+	               op2(NOWDB_EXPR_OP_COAL, weight(), uconst(0)),
+	               uconst(2));
+	case 5: return op2(NOWDB_EXPR_OP_ADD,
+	               op1(NOWDB_EXPR_OP_ABS, value()),
+	               op1(NOWDB_EXPR_OP_FLOOR, ratio()));
+	case 6: return op2(NOWDB_EXPR_OP_MUL,
+	               op2(NOWDB_EXPR_OP_MUL,
+	                   op2(NOWDB_EXPR_OP_ADD, uconst(2), uconst(3)),
+	                   op0(NOWDB_EXPR_OP_PI)),
+	               ratio());
+	case 7: return op2(NOWDB_EXPR_OP_AND,
+	               op2(NOWDB_EXPR_OP_AND,
+	                   op2(NOWDB_EXPR_OP_GE, weight(), uconst(10)),
+	                   op2(NOWDB_EXPR_OP_LT, ratio(), fconst(50.0))),
+	               op2(NOWDB_EXPR_OP_LT, value(), iconst(0)));
+	default: return NULL;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Evaluate on all edges, the checksum is the sum of all results
+ * ------------------------------------------------------------------------
+ */
+int evalAll(nowdb_expr_t expr, uint64_t *sum) {
+	nowdb_err_t err;
+	nowdb_type_t t;
+	void *v;
+	uint64_t s = 0;
+
+	for(uint32_t k=0; k<global_count; k++) {
+		err = nowdb_expr_eval(expr, &_hlp, edges+k*recsz, &t, &v);
+		if (err != NOWDB_OK) {
+			nowdb_err_print(err); nowdb_err_release(err);
+			return -1;
+		}
+		if (t == NOWDB_TYP_NOTHING) continue;
+		s += *(uint64_t*)v;
+	}
+	*sum = s;
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Run one expression both ways
+ * ------------------------------------------------------------------------
+ */
+int benchExpr(int i) {
+	struct timespec t1, t2;
+	nowdb_err_t err;
+	nowdb_expr_t tree, prog=NULL;
+	uint64_t *tt=NULL, *pt=NULL;
+	uint64_t ts=0, ps=0;
+	uint64_t tm, pm;
+	int rc = 0;
+
+	tree = mkExpr(i);
+	if (tree == NULL) {
+		fprintf(stderr, "cannot create expression %d\n", i);
+		return -1;
+	}
+	err = nowdb_expr_copy(tree, &prog);
+	if (err == NOWDB_OK) err = nowdb_expr_compile(prog);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err); nowdb_err_release(err);
+		rc = -1; goto cleanup;
+	}
+	tt = calloc(global_iter, sizeof(uint64_t));
+	pt = calloc(global_iter, sizeof(uint64_t));
+	if (tt == NULL || pt == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		rc = -1; goto cleanup;
+	}
+	for(uint32_t k=0; k<global_iter; k++) {
+		timestamp(&t1);
+		if (evalAll(tree, &ts) != 0) {
+			rc = -1; goto cleanup;
+		}
+		timestamp(&t2);
+		tt[k] = minus(&t2, &t1)/1000;
+
+		timestamp(&t1);
+		if (evalAll(prog, &ps) != 0) {
+			rc = -1; goto cleanup;
+		}
+		timestamp(&t2);
+		pt[k] = minus(&t2, &t1)/1000;
+	}
+	if (ts != ps) {
+		fprintf(stderr, "%s: results differ: %lu / %lu\n",
+		                       exprName(i), ts, ps);
+		rc = -1; goto cleanup;
+	}
+	tm = median(tt, global_iter);
+	pm = median(pt, global_iter);
+	fprintf(stdout, "%-42s | %9luus | %9luus | %5.2fx\n",
+	        exprName(i), tm, pm,
+	        pm == 0 ? 0.0 : (double)tm/(double)pm);
+
+cleanup:
+	if (tt != NULL) free(tt);
+	if (pt != NULL) free(pt);
+	if (prog != NULL) {
+		nowdb_expr_destroy(prog); free(prog);
+	}
+	nowdb_expr_destroy(tree); free(tree);
+	return rc;
+}
+
+int main(int argc, char **argv) {
+	int rc = EXIT_SUCCESS;
+
+	if (argc > 1 && strcmp(argv[1], "-?") == 0) {
+		helptxt(argv[0]);
+		return EXIT_SUCCESS;
+	}
+	if (parsecmd(argc, argv) != 0) {
+		helptxt(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (!nowdb_err_init()) {
+		fprintf(stderr, "cannot init error manager\n");
+		return EXIT_FAILURE;
+	}
+
+	recsz = nowdb_recSize(NATTS);
+	if (mkEdges() != 0) {
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+
+	fprintf(stdout, "%u edges, median of %u iterations\n",
+	                global_count, global_iter);
+	fprintf(stdout, "%-42s | %11s | %11s | %6s\n",
+	        "expression", "tree", "program", "gain");
+
+	for(int i=0; i<NEXPRS; i++) {
+		if (benchExpr(i) != 0) {
+			rc = EXIT_FAILURE; break;
+		}
+	}
+
+cleanup:
+	if (edges != NULL) free(edges);
+	nowdb_err_destroy();
+	return rc;
+}
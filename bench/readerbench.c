@@ -23,6 +23,9 @@ void helptxt(char *progname) {
 	fprintf(stderr, "all options are in the format -opt value\n");
 	fprintf(stderr, "-count n: number of edges to read\n");
 	fprintf(stderr, "-context c: existing context within that scope\n");
+	fprintf(stderr, "            or a comma-separated list of contexts\n");
+	fprintf(stderr, "            (e.g. with different compression)\n");
+	fprintf(stderr, "            to be compared side by side\n");
 	fprintf(stderr, "-query t: query type; possible values:\n");
 	fprintf(stderr, "          'fullscan' : performs a simple fullscan\n");
 	fprintf(stderr, "          'fullscan+': performs a fullscan +\n");
@@ -36,6 +39,9 @@ void helptxt(char *progname) {
 	fprintf(stderr, "-iter   n: number of iterations (default: 1)\n");
 	fprintf(stderr, "-index  i: name of the index (default: none)\n");
 	fprintf(stderr, "-keys   k: comma-separated list of keys (default: none)\n");
+	fprintf(stderr, "-readahead n: read-ahead depth for fullscans;\n");
+	fprintf(stderr, "              each context is read without and\n");
+	fprintf(stderr, "              with read-ahead (default: 0)\n");
 }
 
 /* ------------------------------------------------------------------------
@@ -48,6 +54,7 @@ void helptxt(char *progname) {
  * global_context: the context from which we will read
  * global_index  : the index which we will search
  * global_keys   : the keys for which we will search
+ * global_ahead  : read-ahead depth for fullscans
  * ------------------------------------------------------------------------
  */
 uint32_t global_count = 1000000;
@@ -56,6 +63,7 @@ char *global_qry_type = NULL;
 char *global_context  = NULL;
 char *global_index    = NULL;
 char *global_keys     = NULL;
+uint32_t global_ahead = 0;
 
 #define FULLSCAN     10
 #define FULLSCANPLUS 11
@@ -107,6 +115,12 @@ int parsecmd(int argc, char **argv) {
 		fprintf(stderr, "command line error: %d\n", err);
 		return -1;
 	}
+	global_ahead = (uint32_t)ts_algo_args_findUint(
+	            argc, argv, 2, "readahead", 0, &err);
+	if (err != 0) {
+		fprintf(stderr, "command line error: %d\n", err);
+		return -1;
+	}
 	return 0;
 }
 
@@ -158,7 +172,8 @@ typedef struct {
  */
 nowdb_bool_t performRead(nowdb_scope_t  *scope,
                          nowdb_context_t  *ctx,
-                         int qt, result_t *res) {
+                         int qt, uint32_t ahead,
+                         result_t *res) {
 	struct timespec t1, t2, t3;
 
 	nowdb_err_t err = NOWDB_OK;
@@ -193,6 +208,7 @@ nowdb_bool_t performRead(nowdb_scope_t  *scope,
 	if (qt == FULLSCAN || qt == FULLSCANPLUS) {
 
 		err = nowdb_reader_fullscan(&reader, &files, NULL);
+		if (err == NOWDB_OK) nowdb_reader_setReadahead(reader, ahead);
 
 	} else if (qt == SEARCH || qt == SEARCHPLUS) {
 		if (global_index == NULL) {
@@ -267,16 +283,40 @@ nowdb_bool_t performRead(nowdb_scope_t  *scope,
 }
 
 /* ------------------------------------------------------------------------
- * do the benchmarks
+ * compression name
  * ------------------------------------------------------------------------
  */
-int main(int argc, char **argv) {
+const char *compname(nowdb_comp_t comp) {
+	switch(comp) {
+	case NOWDB_COMP_FLAT: return "flat";
+	case NOWDB_COMP_ZSTD: return "zstd";
+	case NOWDB_COMP_LZ4: return "lz4";
+	default: return "?";
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * summary per context
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	char        *name;
+	nowdb_comp_t comp;
+	uint32_t    ahead;
+	uint64_t    count;
+	uint64_t      avg;
+	uint64_t   median;
+	uint64_t      p95;
+} summary_t;
+
+/* ------------------------------------------------------------------------
+ * run the benchmark on one context
+ * ------------------------------------------------------------------------
+ */
+nowdb_bool_t benchContext(nowdb_scope_t *scope, int qt, summary_t *sum) {
 	nowdb_err_t err;
-	int rc = EXIT_SUCCESS;
-	int qt = FULLSCAN;
-	nowdb_scope_t *scope = NULL;
+	nowdb_bool_t rc = TRUE;
 	nowdb_context_t *ctx = NULL;
-	nowdb_path_t path;
 	progress_t p;
 	result_t res;
 	uint64_t *overall=NULL;
@@ -285,6 +325,95 @@ int main(int argc, char **argv) {
 	uint64_t amx = 0, amn = 0xffffffffffffffff;
 	uint64_t hmx = 0, hmn = 0xffffffffffffffff;
 
+	err = nowdb_scope_getContext(scope, sum->name, &ctx);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return FALSE;
+	}
+	sum->comp = ctx->store.comp;
+
+	overall = calloc(global_iter, sizeof(uint64_t));
+	if (overall == NULL) {
+		fprintf(stderr, "not enough memory\n");
+		return FALSE;
+	}
+
+	overhead = calloc(global_iter, sizeof(uint64_t));
+	if (overhead == NULL) {
+		fprintf(stderr, "not enough memory\n");
+		free(overall); return FALSE;
+	}
+	fprintf(stdout, "context %s (%s, read-ahead: %u)\n",
+	         sum->name, compname(sum->comp), sum->ahead);
+	init_progress(&p, stdout, global_iter);
+	for(int i=0; i<global_iter; i++) {
+		if (!performRead(scope, ctx, qt, sum->ahead, &res)) {
+			rc = FALSE; goto cleanup;
+		}
+		overall[i]  = res.overall;
+		overhead[i] = res.overhead;
+		as += res.overall;
+		hs += res.overhead;
+		if (amx < res.overall) amx = res.overall;
+		if (amn > res.overall) amn = res.overall;
+		if (hmx < res.overhead) hmx = res.overhead;
+		if (hmn > res.overhead) hmn = res.overhead;
+		update_progress(&p, i);
+	}
+	close_progress(&p);
+	fprintf(stdout, "\n");
+	sort(overall, global_iter);
+
+	fprintf(stdout, "effectively read: %lu\n", res.count);
+
+	fprintf(stdout, "average : %lu / %lu\n",
+	                       as/global_iter,
+	                       hs/global_iter);
+	fprintf(stdout, "median  : %lu / %lu\n",
+	          median(overall, global_iter),
+	          median(overhead, global_iter));
+	fprintf(stdout, "max     : %lu / %lu\n", amx, hmx);
+	fprintf(stdout, "min     : %lu / %lu\n", amn, hmn);
+	fprintf(stdout, "75%%     : %lu / %lu\n", 
+	                percentile(overall, global_iter, 75),
+	                percentile(overhead, global_iter, 75));
+	fprintf(stdout, "90%%     : %lu / %lu\n",
+	                percentile(overall, global_iter, 90),
+	                percentile(overhead, global_iter, 90));
+	fprintf(stdout, "95%%     : %lu / %lu\n",
+	                percentile(overall, global_iter, 95),
+	                percentile(overhead, global_iter, 95));
+	fprintf(stdout, "99%%     : %lu / %lu\n",
+	                percentile(overall, global_iter, 99),
+	                percentile(overhead, global_iter, 99));
+	fprintf(stdout, "run time: %luus / %luus\n", as, hs);
+
+	sum->count  = res.count;
+	sum->avg    = as/global_iter;
+	sum->median = median(overall, global_iter);
+	sum->p95    = percentile(overall, global_iter, 95);
+
+cleanup:
+	free(overall); free(overhead);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * do the benchmarks
+ * ------------------------------------------------------------------------
+ */
+int main(int argc, char **argv) {
+	nowdb_err_t err;
+	int rc = EXIT_SUCCESS;
+	int qt = FULLSCAN;
+	nowdb_scope_t *scope = NULL;
+	nowdb_path_t path;
+	summary_t *sums = NULL;
+	char *names = NULL;
+	char *tok;
+	int n = 0;
+
 	if (argc < 2) {
 		helptxt(argv[0]);
 		return EXIT_FAILURE;
@@ -323,8 +452,38 @@ int main(int argc, char **argv) {
 		return EXIT_FAILURE;
 	}
 
+	/* contexts to compare */
+	names = strdup(global_context);
+	if (names == NULL) {
+		fprintf(stderr, "not enough memory\n");
+		return EXIT_FAILURE;
+	}
+	for(int i=0; names[i] != 0; i++) if (names[i] == ',') n++;
+	n++;
+
+	/* read-ahead applies to fullscans only */
+	if (qt != FULLSCAN && qt != FULLSCANPLUS) global_ahead = 0;
+
+	/* without and with read-ahead */
+	if (global_ahead > 0) n *= 2;
+
+	sums = calloc(n, sizeof(summary_t));
+	if (sums == NULL) {
+		fprintf(stderr, "not enough memory\n");
+		free(names); return EXIT_FAILURE;
+	}
+	n = 0;
+	for(tok=strtok(names, ","); tok!=NULL; tok=strtok(NULL, ",")) {
+		sums[n].name = tok; n++;
+		if (global_ahead > 0) {
+			sums[n].name = tok;
+			sums[n].ahead = global_ahead; n++;
+		}
+	}
+
 	if (!nowdb_init()) {
 		fprintf(stderr, "cannot init library\n");
+		free(sums); free(names);
 		return EXIT_FAILURE;
 	}
 	err = nowdb_scope_new(&scope, path, 1);
@@ -339,75 +498,37 @@ int main(int argc, char **argv) {
 		nowdb_err_release(err);
 		rc = EXIT_FAILURE; goto cleanup;
 	}
-	err = nowdb_scope_getContext(scope, global_context, &ctx);
-	if (err != NOWDB_OK) {
-		nowdb_err_print(err);
-		nowdb_err_release(err);
-		rc = EXIT_FAILURE; goto cleanup;
-	}
-
-	overall = calloc(global_iter, sizeof(uint64_t));
-	if (overall == NULL) {
-		fprintf(stderr, "not enough memory\n");
-		rc = EXIT_FAILURE; goto cleanup;
-	}
-
-	overhead = calloc(global_iter, sizeof(uint64_t));
-	if (overhead == NULL) {
-		fprintf(stderr, "not enough memory\n");
-		rc = EXIT_FAILURE; goto cleanup;
-	}
-	init_progress(&p, stdout, global_iter);
-	for(int i=0; i<global_iter; i++) {
-		if (!performRead(scope, ctx, qt, &res)) {
+	for(int i=0; i<n; i++) {
+		if (!benchContext(scope, qt, sums+i)) {
 			rc = EXIT_FAILURE; goto cleanup;
 		}
-		overall[i]  = res.overall;
-		overhead[i] = res.overhead;
-		as += res.overall;
-		hs += res.overhead;
-		if (amx < res.overall) amx = res.overall;
-		if (amn > res.overall) amn = res.overall;
-		if (hmx < res.overhead) hmx = res.overhead;
-		if (hmn > res.overhead) hmn = res.overhead;
-		update_progress(&p, i);
 	}
-	close_progress(&p);
-	fprintf(stdout, "\n");
-	sort(overall, global_iter);
-
-	fprintf(stdout, "effectively read: %lu\n", res.count);
-
-	fprintf(stdout, "average : %lu / %lu\n",
-	                       as/global_iter,
-	                       hs/global_iter);
-	fprintf(stdout, "median  : %lu / %lu\n",
-	          median(overall, global_iter),
-	          median(overhead, global_iter));
-	fprintf(stdout, "max     : %lu / %lu\n", amx, hmx);
-	fprintf(stdout, "min     : %lu / %lu\n", amn, hmn);
-	fprintf(stdout, "75%%     : %lu / %lu\n", 
-	                percentile(overall, global_iter, 75),
-	                percentile(overhead, global_iter, 75));
-	fprintf(stdout, "90%%     : %lu / %lu\n",
-	                percentile(overall, global_iter, 90),
-	                percentile(overhead, global_iter, 90));
-	fprintf(stdout, "95%%     : %lu / %lu\n",
-	                percentile(overall, global_iter, 95),
-	                percentile(overhead, global_iter, 95));
-	fprintf(stdout, "99%%     : %lu / %lu\n",
-	                percentile(overall, global_iter, 99),
-	                percentile(overhead, global_iter, 99));
-	fprintf(stdout, "run time: %luus / %luus\n", as, hs);
+	if (n > 1) {
+		fprintf(stdout, "\n%-16s %-6s %5s %12s %12s %12s %12s %8s\n",
+		        "context", "comp", "ahead", "read", "average",
+		                        "median", "95%", "speedup");
+		for(int i=0; i<n; i++) {
+			fprintf(stdout,
+			  "%-16s %-6s %5u %12lu %10luus %10luus %10luus",
+			  sums[i].name, compname(sums[i].comp),
+			  sums[i].ahead, sums[i].count, sums[i].avg,
+			  sums[i].median, sums[i].p95);
+			/* compare with the same context without read-ahead */
+			if (sums[i].ahead > 0 && sums[i].median > 0) {
+				fprintf(stdout, " %7.2fx\n",
+				  (double)sums[i-1].median/sums[i].median);
+			} else {
+				fprintf(stdout, " %8s\n", "");
+			}
+		}
+	}
 
 cleanup:
-	if (overall != NULL) free(overall);
-	if (overhead!= NULL) free(overhead);
 	if (scope != NULL) {
 		NOWDB_IGNORE(nowdb_scope_close(scope));
 		nowdb_scope_destroy(scope); free(scope);
 	}
+	free(sums); free(names);
 	nowdb_close();
 	return rc;
 }
-
@@ -0,0 +1,249 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Benchmarking the sorting of waiting files: merge sort vs. radix sort
+ * ========================================================================
+ */
+#include <nowdb/types/types.h>
+#include <nowdb/sort/sort.h>
+#include <nowdb/sort/radix.h>
+#include <common/cmd.h>
+#include <common/bench.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/* ------------------------------------------------------------------------
+ * HELP!
+ * ------------------------------------------------------------------------
+ */
+void helptxt(char *progname) {
+	fprintf(stderr, "%s [options]\n", progname);
+	fprintf(stderr, "all options are in the format -opt value\n");
+	fprintf(stderr, "-count n: number of edges to sort (default: 1000000)\n");
+	fprintf(stderr, "-keys  n: number of distinct vertices (default: 100000)\n");
+	fprintf(stderr, "-tasks n: number of radix sort tasks (default: %d)\n",
+	                                                   NOWDB_RADIX_TASKS);
+	fprintf(stderr, "-iter  n: number of iterations (default: 5)\n");
+}
+
+/* ------------------------------------------------------------------------
+ * options
+ * -------
+ * global_count: number of edges in memory
+ * global_keys: origin and destin are in 1..keys
+ * global_tasks: tasks for the parallel radix sort
+ * global_iter: repeat n times
+ * ------------------------------------------------------------------------
+ */
+uint32_t global_count = 1000000;
+uint32_t global_keys = 100000;
+uint32_t global_tasks = NOWDB_RADIX_TASKS;
+uint32_t global_iter = 5;
+
+/* ------------------------------------------------------------------------
+ * get options
+ * ------------------------------------------------------------------------
+ */
+int parsecmd(int argc, char **argv) {
+	int err = 0;
+
+	global_count = (uint32_t)ts_algo_args_findUint(
+	            argc, argv, 1, "count", 1000000, &err);
+	if (err != 0) {
+		fprintf(stderr, "command line error: %d\n", err);
+		return -1;
+	}
+	global_keys = (uint32_t)ts_algo_args_findUint(
+	            argc, argv, 1, "keys", 100000, &err);
+	if (err != 0) {
+		fprintf(stderr, "command line error: %d\n", err);
+		return -1;
+	}
+	if (global_keys == 0) global_keys = 1;
+	global_tasks = (uint32_t)ts_algo_args_findUint(
+	            argc, argv, 1, "tasks", NOWDB_RADIX_TASKS, &err);
+	if (err != 0) {
+		fprintf(stderr, "command line error: %d\n", err);
+		return -1;
+	}
+	global_iter = (uint32_t)ts_algo_args_findUint(
+	            argc, argv, 1, "iter", 5, &err);
+	if (err != 0) {
+		fprintf(stderr, "command line error: %d\n", err);
+		return -1;
+	}
+	if (global_iter == 0) global_iter = 1;
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Edges: origin, destin, stamp, weight, value
+ * ------------------------------------------------------------------------
+ */
+#define NATTS 5
+
+uint32_t recsz;
+uint32_t size;
+char *pages = NULL;
+char *work = NULL;
+char *ref = NULL;
+
+/* ------------------------------------------------------------------------
+ * Create pages (like a waiting file)
+ * ------------------------------------------------------------------------
+ */
+int mkPages() {
+	uint32_t perpage = NOWDB_IDX_PAGE/recsz;
+	uint32_t npages;
+	uint32_t k = 0;
+
+	npages = global_count/perpage;
+	if (npages*perpage < global_count) npages++;
+	size = npages*NOWDB_IDX_PAGE;
+
+	pages = calloc(1, size);
+	work = malloc(size);
+	ref = malloc(size);
+	if (pages == NULL || work == NULL || ref == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		return -1;
+	}
+	for(uint32_t i=0; i<npages; i++) {
+		char *page = pages+i*NOWDB_IDX_PAGE;
+		for(uint32_t j=0; j<perpage && k<global_count; j++,k++) {
+			char *rec = page+j*recsz;
+			uint64_t u; int64_t t;
+
+			u = rand()%global_keys+1; memcpy(rec, &u, 8);
+			u = rand()%global_keys+1; memcpy(rec+8, &u, 8);
+			t = k; memcpy(rec+16, &t, 8);
+			u = rand()%100; memcpy(rec+24, &u, 8);
+			u = rand(); memcpy(rec+32, &u, 8);
+			rec[nowdb_ctrlStart(NATTS)] = 0x1f;
+		}
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * The keys in 'work' are in the same order as in 'ref'
+ * ------------------------------------------------------------------------
+ */
+int sameOrder() {
+	uint32_t perpage = NOWDB_IDX_PAGE/recsz;
+
+	for(uint32_t i=0; i<size; i+=NOWDB_IDX_PAGE) {
+		for(uint32_t j=0; j<perpage; j++) {
+			if (memcmp(work+i+j*recsz,
+			           ref+i+j*recsz, 16) != 0) return 0;
+		}
+	}
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * Sort with merge sort (into 'ref')
+ * ------------------------------------------------------------------------
+ */
+int mergesort(uint64_t *tm) {
+	struct timespec t1, t2;
+
+	memcpy(ref, pages, size);
+	timestamp(&t1);
+	if (nowdb_mem_merge(ref, size, NOWDB_IDX_PAGE, recsz,
+	                    &nowdb_sort_edge_compare, NULL) != 0) {
+		fprintf(stderr, "mergesort failed\n");
+		return -1;
+	}
+	timestamp(&t2);
+	*tm = minus(&t2, &t1)/1000;
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Sort with radix sort (into 'work')
+ * ------------------------------------------------------------------------
+ */
+int radixsort(uint32_t tasks, uint64_t *tm) {
+	struct timespec t1, t2;
+	uint32_t keys[2] = {NOWDB_OFF_ORIGIN, NOWDB_OFF_DESTIN};
+
+	memcpy(work, pages, size);
+	timestamp(&t1);
+	if (nowdb_radix_sort(work, size, NOWDB_IDX_PAGE, recsz,
+	                                     keys, 2, tasks) != 0) {
+		fprintf(stderr, "radixsort failed\n");
+		return -1;
+	}
+	timestamp(&t2);
+	*tm = minus(&t2, &t1)/1000;
+	if (!sameOrder()) {
+		fprintf(stderr, "radixsort (%u): wrong order\n", tasks);
+		return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	int rc = EXIT_SUCCESS;
+	uint64_t *mt=NULL, *r1=NULL, *rn=NULL;
+	uint64_t mm, m1, mn;
+
+	if (argc > 1 && strcmp(argv[1], "-?") == 0) {
+		helptxt(argv[0]);
+		return EXIT_SUCCESS;
+	}
+	if (parsecmd(argc, argv) != 0) {
+		helptxt(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (!nowdb_err_init()) {
+		fprintf(stderr, "cannot init error manager\n");
+		return EXIT_FAILURE;
+	}
+
+	recsz = nowdb_recSize(NATTS);
+	if (mkPages() != 0) {
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	mt = calloc(global_iter, sizeof(uint64_t));
+	r1 = calloc(global_iter, sizeof(uint64_t));
+	rn = calloc(global_iter, sizeof(uint64_t));
+	if (mt == NULL || r1 == NULL || rn == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	for(uint32_t k=0; k<global_iter; k++) {
+		if (mergesort(mt+k) != 0 ||
+		    radixsort(1, r1+k) != 0 ||
+		    radixsort(global_tasks, rn+k) != 0) {
+			rc = EXIT_FAILURE; goto cleanup;
+		}
+	}
+	mm = median(mt, global_iter);
+	m1 = median(r1, global_iter);
+	mn = median(rn, global_iter);
+
+	fprintf(stdout, "%u edges (%u bytes) on %u keys, "
+	                "median of %u iterations\n",
+	                global_count, size, global_keys, global_iter);
+	fprintf(stdout, "%-20s | %11s | %6s\n", "sort", "time", "gain");
+	fprintf(stdout, "%-20s | %9luus | %5.2fx\n", "merge", mm, 1.0);
+	fprintf(stdout, "%-20s | %9luus | %5.2fx\n", "radix (1 task)", m1,
+	                       m1 == 0 ? 0.0 : (double)mm/(double)m1);
+	fprintf(stdout, "radix (%2u tasks)     | %9luus | %5.2fx\n",
+	                global_tasks, mn,
+	                mn == 0 ? 0.0 : (double)mm/(double)mn);
+
+cleanup:
+	if (mt != NULL) free(mt);
+	if (r1 != NULL) free(r1);
+	if (rn != NULL) free(rn);
+	if (pages != NULL) free(pages);
+	if (work != NULL) free(work);
+	if (ref != NULL) free(ref);
+	nowdb_err_destroy();
+	return rc;
+}
@@ -1,7 +1,7 @@
 /* ========================================================================
  * (c) Tobias Schoofs, 2018
  * ========================================================================
- * Benchmarking plain file read
+ * Benchmarking store inserts
  * ========================================================================
  */
 #include <nowdb/io/file.h>
@@ -10,73 +10,71 @@
 #include <common/bench.h>
 #include <common/stores.h>
 
-/*
-void makeEdgePattern(nowdb_edge_t *e) {
-	e->origin   = 1;
-	e->destin   = 1;
-	e->edge     = 1;
-	e->label    = 0;
-	e->weight2  = 0;
-	e->wtype[0] = NOWDB_TYP_UINT;
-	e->wtype[1] = NOWDB_TYP_NOTHING;
-}
+#define WEIGHT_OFF 24
+#define ATTS 4
 
-nowdb_bool_t insertEdges(nowdb_store_t *store, uint32_t count) {
+/* ------------------------------------------------------------------------
+ * Insert count edges calling the store with 'batch' records at a time
+ * (batch == 1 uses nowdb_store_insert, batch > 1 nowdb_store_insertBulk)
+ * ------------------------------------------------------------------------
+ */
+nowdb_bool_t insertEdges(nowdb_store_t *store, uint32_t count,
+                                               uint32_t batch) {
 	nowdb_err_t err;
-	nowdb_edge_t e;
+	nowdb_time_t t=0;
+	uint32_t recsz = nowdb_recSize(ATTS);
+	uint64_t x;
+	uint32_t k=0;
+	char *buf, *e;
 
-	makeEdgePattern(&e);
-	err = nowdb_time_now(&e.timestamp);
-	if (err != NOWDB_OK) {
-		nowdb_err_print(err);
-		nowdb_err_release(err);
+	if (batch == 0) batch = 1;
+
+	buf = calloc(batch, recsz);
+	if (buf == NULL) {
+		fprintf(stderr, "out-of-mem\n");
 		return FALSE;
 	}
 	for(uint32_t i=0; i<count; i++) {
-		e.weight = (uint64_t)i;
-		err = nowdb_store_insert(store, &e);
-		if (err != NOWDB_OK) {
-			fprintf(stderr, "insert error\n");
-			nowdb_err_print(err);
-			nowdb_err_release(err);
-			return FALSE;
-		}
-	}
-	return TRUE;
-}
-*/
 
-nowdb_bool_t insertEdges(nowdb_store_t *store, uint32_t count) {
-	nowdb_err_t err;
-	nowdb_edge_t e;
-	int rc;
+		e = buf+k*recsz;
 
-	memset(&e,0,64);
-	e.wtype[0] = NOWDB_TYP_UINT;
+		do x = rand()%100; while(x == 0);
+		memcpy(e+NOWDB_OFF_ORIGIN, &x, 8);
 
-	for(uint32_t i=0; i<count; i++) {
+		do x = rand()%100; while(x == 0);
+		memcpy(e+NOWDB_OFF_DESTIN, &x, 8);
 
-		do e.origin = rand()%100; while(e.origin == 0);
-		do e.destin = rand()%100; while(e.destin == 0);
-		do e.edge   = rand()%10; while(e.edge == 0);
-		// do e.label  = rand()%10; while(e.label == 0);
 		if (i%10 == 0) {
-			rc = nowdb_time_now(&e.timestamp);
-			if (rc != 0) {
-				fprintf(stderr, "insert error: %d\n", rc);
-				return FALSE;
+			if (nowdb_time_now(&t) != 0) {
+				fprintf(stderr, "cannot get time\n");
+				free(buf); return FALSE;
 			}
 		}
-		e.weight = (uint64_t)i;
+		memcpy(e+NOWDB_OFF_STAMP, &t, 8);
+
+		x = (uint64_t)i;
+		memcpy(e+WEIGHT_OFF, &x, 8);
+
+		/* all attributes are set */
+		e[nowdb_ctrlStart(ATTS)] = 15;
+
+		k++;
+		if (k < batch && i+1 < count) continue;
 
-		err = nowdb_store_insert(store, &e);
+		if (k == 1) {
+			err = nowdb_store_insert(store, buf);
+		} else {
+			err = nowdb_store_insertBulk(store, buf, k);
+		}
 		if (err != NOWDB_OK) {
 			fprintf(stderr, "insert error\n");
 			nowdb_err_print(err);
 			nowdb_err_release(err);
-			return FALSE;
+			free(buf); return FALSE;
 		}
+		k=0;
 	}
+	free(buf);
 	return TRUE;
 }
 
@@ -87,6 +85,15 @@ uint32_t global_report = 1;
 uint32_t global_sorter = 1;
 int      global_sort  = 0;
 char    *global_comp  = NULL;
+uint32_t global_batch = 1;
+int      global_sweep = 0;
+
+/* ------------------------------------------------------------------------
+ * Batch sizes used by -sweep
+ * ------------------------------------------------------------------------
+ */
+static uint32_t sweep[] = {1, 64, 1024, 16384};
+#define SWEEPN 4
 
 int parsecmd(int argc, char **argv) {
 	int err = 0;
@@ -127,6 +134,18 @@ int parsecmd(int argc, char **argv) {
 		fprintf(stderr, "command line error: %d\n", err);
 		return -1;
 	}
+	global_batch = (uint32_t)ts_algo_args_findUint(
+	            argc, argv, 2, "batch", 1, &err);
+	if (err != 0) {
+		fprintf(stderr, "command line error: %d\n", err);
+		return -1;
+	}
+	global_sweep = ts_algo_args_findBool(
+	            argc, argv, 2, "sweep", 0, &err);
+	if (err != 0) {
+		fprintf(stderr, "command line error: %d\n", err);
+		return -1;
+	}
 	global_comp = ts_algo_args_findString(
 	            argc, argv, 2, "comp", "flat", &err);
 	if (err != 0) {
@@ -140,6 +159,7 @@ void helptxt(char *progname) {
 	fprintf(stderr, "%s <path-to-file> [options]\n", progname);
 	fprintf(stderr, "all options are in the format -opt value\n");
 	fprintf(stderr, "[-count n] [-sort b] [-comp x] [-block n]\n");
+	fprintf(stderr, "[-batch n] [-sweep b]\n");
 	fprintf(stderr, "-count n: number of edges to insert\n");
 	fprintf(stderr, "-sort  b: indicates whether or not to sort\n");
 	fprintf(stderr,
@@ -152,6 +172,40 @@ void helptxt(char *progname) {
 	fprintf(stderr, "-sorter n: number of threads for sorting\n");
 	fprintf(stderr, "           max: 32\n");
 	fprintf(stderr, "-report n: report every n inserts\n");
+	fprintf(stderr, "-batch  n: records per insert call\n");
+	fprintf(stderr, "-sweep  b: insert count records for each of\n");
+	fprintf(stderr, "           the batch sizes 1, 64, 1024, 16384\n");
+}
+
+/* ------------------------------------------------------------------------
+ * Insert global_count records with the given batch size
+ * ------------------------------------------------------------------------
+ */
+int runBatch(nowdb_store_t *store, uint32_t batch) {
+	struct timespec t1, t2;
+	uint32_t runs;
+	uint64_t d=0;
+
+	runs = global_count/global_report;
+	for(int i=0; i<runs; i++) {
+		timestamp(&t1);
+		if (!insertEdges(store, global_report, batch)) {
+			return -1;
+		}
+		timestamp(&t2);
+		d += minus(&t2, &t1)/1000;
+		if (global_report != global_count) {
+			fprintf(stdout, "%u: %luus\n", global_report,
+			                       minus(&t2, &t1)/1000);
+		}
+	}
+	fprintf(stdout, "batch %5u: running time: %luus", batch, d);
+	if (d > 0) {
+		fprintf(stdout, " (%.0f records/s)",
+		     (double)runs*global_report/((double)d/1000000));
+	}
+	fprintf(stdout, "\n");
+	return 0;
 }
 
 int main(int argc, char **argv) {
@@ -160,9 +214,6 @@ int main(int argc, char **argv) {
 	int rc = EXIT_SUCCESS;
 	nowdb_store_t *store = NULL;
 	nowdb_path_t path;
-	struct timespec t1, t2;
-	uint32_t runs;
-	uint64_t d=0;
 
 	if (argc < 2) {
 		helptxt(argv[0]);
@@ -205,26 +256,23 @@ int main(int argc, char **argv) {
 	if (global_sorter < 1 || global_sorter > 32) {
 		global_sorter = 1;
 	}
-	store = xBootstrap(path, compare, comp, global_sorter,
-	                              NOWDB_MEGA*global_block,
+	store = xBootstrap(path, NOWDB_CONT_EDGE,
+	                   compare, comp, global_sorter,
+	                   nowdb_recSize(ATTS),
+	                   NOWDB_MEGA*global_block,
 	                              NOWDB_MEGA*global_large);
 	if (store == NULL) {
 		rc = EXIT_FAILURE; goto cleanup;
 	}
-	runs = global_count/global_report;
-	for(int i=0; i<runs; i++) {
-		timestamp(&t1);
-		if (!insertEdges(store, global_report)) {
-			rc = EXIT_FAILURE; goto cleanup;
-		}
-		timestamp(&t2);
-		d += minus(&t2, &t1)/1000;
-		if (global_report != global_count) {
-			fprintf(stdout, "%u: %luus\n", global_report,
-			                       minus(&t2, &t1)/1000);
+	if (global_sweep) {
+		for(int i=0; i<SWEEPN; i++) {
+			if (runBatch(store, sweep[i]) != 0) {
+				rc = EXIT_FAILURE; goto cleanup;
+			}
 		}
+	} else if (runBatch(store, global_batch) != 0) {
+		rc = EXIT_FAILURE; goto cleanup;
 	}
-	fprintf(stdout, "Running time: %luus\n", d);
 	nowdb_task_sleep(1000000000);
 
 cleanup:
@@ -0,0 +1,229 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Random expressions on edges to be used in tests
+ * ========================================================================
+ */
+#include <common/rndexpr.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+static uint32_t _natts = 3;
+static rndexpr_field_t _rndField = NULL;
+
+/* ------------------------------------------------------------------------
+ * Init
+ * ------------------------------------------------------------------------
+ */
+void initRndExpr(uint32_t natts, rndexpr_field_t rndField) {
+	_natts = natts;
+	_rndField = rndField;
+}
+
+/* ------------------------------------------------------------------------
+ * Destroy expression
+ * ------------------------------------------------------------------------
+ */
+void destroyExpr(nowdb_expr_t e) {
+	if (e == NULL) return;
+	nowdb_expr_destroy(e); free(e);
+}
+
+/* ------------------------------------------------------------------------
+ * Expression constructors
+ * ------------------------------------------------------------------------
+ */
+nowdb_expr_t field(char *name, uint32_t off, nowdb_type_t t) {
+	nowdb_err_t err;
+	nowdb_expr_t f;
+
+	err = nowdb_expr_newEdgeField(&f, name, off, t, _natts);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return NULL;
+	}
+	return f;
+}
+
+nowdb_expr_t constant(void *v, nowdb_type_t t) {
+	nowdb_err_t err;
+	nowdb_expr_t c;
+
+	err = nowdb_expr_newConstant(&c, v, t);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return NULL;
+	}
+	return c;
+}
+
+nowdb_expr_t opv(uint32_t fun, uint32_t n, nowdb_expr_t *ops) {
+	nowdb_err_t err;
+	nowdb_expr_t o;
+
+	for(int i=0; i<n; i++) {
+		if (ops[i] == NULL) {
+			for(int k=0; k<n; k++) destroyExpr(ops[k]);
+			return NULL;
+		}
+	}
+	err = nowdb_expr_newOpV(&o, fun, n, ops);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		for(int k=0; k<n; k++) destroyExpr(ops[k]);
+		return NULL;
+	}
+	return o;
+}
+
+nowdb_expr_t op0(uint32_t fun) {
+	return opv(fun, 0, NULL);
+}
+
+nowdb_expr_t op1(uint32_t fun, nowdb_expr_t a) {
+	nowdb_expr_t ops[1];
+	ops[0] = a;
+	return opv(fun, 1, ops);
+}
+
+nowdb_expr_t op2(uint32_t fun, nowdb_expr_t a, nowdb_expr_t b) {
+	nowdb_expr_t ops[2];
+	ops[0] = a; ops[1] = b;
+	return opv(fun, 2, ops);
+}
+
+nowdb_expr_t op3(uint32_t fun, nowdb_expr_t a,
+                 nowdb_expr_t b, nowdb_expr_t c) {
+	nowdb_expr_t ops[3];
+	ops[0] = a; ops[1] = b; ops[2] = c;
+	return opv(fun, 3, ops);
+}
+
+nowdb_expr_t uconst(uint64_t u) {
+	return constant(&u, NOWDB_TYP_UINT);
+}
+
+nowdb_expr_t iconst(int64_t i) {
+	return constant(&i, NOWDB_TYP_INT);
+}
+
+nowdb_expr_t fconst(double d) {
+	return constant(&d, NOWDB_TYP_FLOAT);
+}
+
+/* ------------------------------------------------------------------------
+ * Random leaf: fields, constants and, rarely, NULL
+ * ------------------------------------------------------------------------
+ */
+nowdb_expr_t rndLeaf() {
+	switch(rand()%10) {
+	case 5: return uconst(rand()%100);
+	case 6: return iconst(rand()%200-100);
+	case 7: return fconst((double)(rand()%2000-1000)/10.0);
+	case 8: if (rand()%2) return constant(NULL, NOWDB_TYP_NOTHING);
+	default: return _rndField();
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Divisor: never zero
+ * ------------------------------------------------------------------------
+ */
+nowdb_expr_t rndDivisor() {
+	switch(rand()%3) {
+	case 0: return uconst(rand()%9+1);
+	case 1: return iconst(rand()%9+1);
+	default: return fconst((double)(rand()%9+1)/2.0);
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Random numeric expression
+ * (the constant addition is there for constant folding)
+ * ------------------------------------------------------------------------
+ */
+nowdb_expr_t rndNum(int depth) {
+	nowdb_expr_t ops[3];
+	int n;
+
+	if (depth == 0 || rand()%4 == 0) return rndLeaf();
+	depth--;
+
+	switch(rand()%18) {
+	case 0: return op2(NOWDB_EXPR_OP_ADD, rndNum(depth), rndNum(depth));
+	case 1: return op2(NOWDB_EXPR_OP_SUB, rndNum(depth), rndNum(depth));
+	case 2: return op2(NOWDB_EXPR_OP_MUL, rndNum(depth), rndNum(depth));
+	case 3: return op2(NOWDB_EXPR_OP_DIV, rndNum(depth), rndDivisor());
+	case 4: return op2(NOWDB_EXPR_OP_REM, rndNum(depth),
+	                                      uconst(rand()%9+1));
+	case 5: return op2(NOWDB_EXPR_OP_POW, rndNum(depth),
+	                                      uconst(rand()%3));
+	case 6: return op1(NOWDB_EXPR_OP_ABS, rndNum(depth));
+	case 7: return op1(NOWDB_EXPR_OP_FLOAT, rndNum(depth));
+	case 8: return op1(NOWDB_EXPR_OP_INT, rndNum(depth));
+	case 9: return op1(NOWDB_EXPR_OP_UINT, rndNum(depth));
+	case 10: return op1(NOWDB_EXPR_OP_FLOOR, rndNum(depth));
+	case 11: return op1(NOWDB_EXPR_OP_HOUR, _rndField());
+	case 12: return op1(NOWDB_EXPR_OP_YEAR, _rndField());
+	case 13:
+		n = rand()%3+1;
+		for(int i=0; i<n; i++) ops[i] = rndNum(depth);
+		return opv(NOWDB_EXPR_OP_COAL, n, ops);
+	case 14: return op3(NOWDB_EXPR_OP_WHEN, rndBool(depth),
+	                    rndNum(depth), rndNum(depth));
+	case 15: return op3(NOWDB_EXPR_OP_WHEN, rndBool(depth),
+	                    rndNum(depth),
+	                    op1(NOWDB_EXPR_OP_ELSE, rndNum(depth)));
+	case 16: return op2(NOWDB_EXPR_OP_ADD, uconst(rand()%10),
+	                                       uconst(rand()%10));
+	default: return op0(NOWDB_EXPR_OP_PI);
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Random boolean expression
+ * (the first operand of and/or is never a NULL constant,
+ *  the tree would dereference NULL)
+ * ------------------------------------------------------------------------
+ */
+nowdb_expr_t rndBool(int depth) {
+	static uint32_t cmps[] = {NOWDB_EXPR_OP_EQ, NOWDB_EXPR_OP_NE,
+	                          NOWDB_EXPR_OP_LT, NOWDB_EXPR_OP_GT,
+	                          NOWDB_EXPR_OP_LE, NOWDB_EXPR_OP_GE};
+
+	if (depth == 0) return op2(cmps[rand()%6], rndLeaf(), rndLeaf());
+	depth--;
+
+	switch(rand()%8) {
+	case 0: return op2(NOWDB_EXPR_OP_AND, rndBool(depth), rndBool(depth));
+	case 1: return op2(NOWDB_EXPR_OP_OR, rndBool(depth), rndBool(depth));
+	case 2: return op1(NOWDB_EXPR_OP_NOT, rndBool(depth));
+	case 3: return op1(NOWDB_EXPR_OP_IS, rndNum(depth));
+	case 4: return op1(NOWDB_EXPR_OP_ISN, rndNum(depth));
+	default: return op2(cmps[rand()%6], rndNum(depth), rndNum(depth));
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Same result?
+ * ------------------------------------------------------------------------
+ */
+int sameResult(nowdb_type_t t1, void *r1,
+               nowdb_type_t t2, void *r2) {
+	double d1, d2;
+
+	if (t1 != t2) return 0;
+	if (t1 == NOWDB_TYP_NOTHING) return 1;
+	if (t1 == NOWDB_TYP_FLOAT) {
+		memcpy(&d1, r1, 8); memcpy(&d2, r2, 8);
+		if (isnan(d1) && isnan(d2)) return 1;
+		return (d1 == d2);
+	}
+	return (memcmp(r1, r2, 8) == 0);
+}
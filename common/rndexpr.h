@@ -0,0 +1,83 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Random expressions on edges to be used in tests
+ * ========================================================================
+ */
+#ifndef COM_RNDEXPR_DECL
+#define COM_RNDEXPR_DECL
+
+#include <nowdb/types/types.h>
+#include <nowdb/fun/expr.h>
+
+#include <stdint.h>
+
+/* ------------------------------------------------------------------------
+ * Random field (or any other leaf the test wants to see)
+ * ------------------------------------------------------------------------
+ */
+typedef nowdb_expr_t (*rndexpr_field_t)();
+
+/* ------------------------------------------------------------------------
+ * Init: edges have 'natts' attributes,
+ *       'rndField' produces the fields of the random expressions
+ * ------------------------------------------------------------------------
+ */
+void initRndExpr(uint32_t natts, rndexpr_field_t rndField);
+
+/* ------------------------------------------------------------------------
+ * Destroy and free expression (NULL is ignored)
+ * ------------------------------------------------------------------------
+ */
+void destroyExpr(nowdb_expr_t e);
+
+/* ------------------------------------------------------------------------
+ * Expression constructors;
+ * they print the error and return NULL on failure.
+ * The operator constructors destroy their operands on failure
+ * and fail if one of the operands is NULL.
+ * ------------------------------------------------------------------------
+ */
+nowdb_expr_t field(char *name, uint32_t off, nowdb_type_t t);
+nowdb_expr_t constant(void *v, nowdb_type_t t);
+nowdb_expr_t opv(uint32_t fun, uint32_t n, nowdb_expr_t *ops);
+nowdb_expr_t op0(uint32_t fun);
+nowdb_expr_t op1(uint32_t fun, nowdb_expr_t a);
+nowdb_expr_t op2(uint32_t fun, nowdb_expr_t a, nowdb_expr_t b);
+nowdb_expr_t op3(uint32_t fun, nowdb_expr_t a,
+                 nowdb_expr_t b, nowdb_expr_t c);
+nowdb_expr_t uconst(uint64_t u);
+nowdb_expr_t iconst(int64_t i);
+nowdb_expr_t fconst(double d);
+
+/* ------------------------------------------------------------------------
+ * Random leaf: fields, constants and, rarely, NULL
+ * ------------------------------------------------------------------------
+ */
+nowdb_expr_t rndLeaf();
+
+/* ------------------------------------------------------------------------
+ * Random divisor (never zero)
+ * ------------------------------------------------------------------------
+ */
+nowdb_expr_t rndDivisor();
+
+/* ------------------------------------------------------------------------
+ * Random numeric expression of at most 'depth' levels
+ * ------------------------------------------------------------------------
+ */
+nowdb_expr_t rndNum(int depth);
+
+/* ------------------------------------------------------------------------
+ * Random boolean expression of at most 'depth' levels
+ * ------------------------------------------------------------------------
+ */
+nowdb_expr_t rndBool(int depth);
+
+/* ------------------------------------------------------------------------
+ * Same result (NaN equals NaN)?
+ * ------------------------------------------------------------------------
+ */
+int sameResult(nowdb_type_t t1, void *r1,
+               nowdb_type_t t2, void *r2);
+#endif
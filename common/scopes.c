@@ -203,6 +203,11 @@ int execStmt(nowdb_scope_t *scope,
 }
 
 nowdb_cursor_t *openCursor(nowdb_scope_t *scope, char *stmt) {
+	return openParallelCursor(scope, stmt, 1);
+}
+
+nowdb_cursor_t *openParallelCursor(nowdb_scope_t *scope, char *stmt,
+                                                      uint32_t dop) {
 	nowdb_qry_result_t res;
 	nowdb_err_t err;
 
@@ -212,6 +217,7 @@ nowdb_cursor_t *openCursor(nowdb_scope_t *scope, char *stmt) {
 
 	case NOWDB_QRY_RESULT_CURSOR: 
 		if (res.result == NULL) return NULL;
+		nowdb_cursor_setParallel(res.result, dop);
 		err = nowdb_cursor_open(res.result);
 		if (err != NOWDB_OK) {
 			fprintf(stderr, "cannot open cursor\n");
@@ -31,6 +31,9 @@ int execStmt(nowdb_scope_t *scope, char *stmt);
 
 nowdb_cursor_t *openCursor(nowdb_scope_t *scope, char *stmt);
 
+nowdb_cursor_t *openParallelCursor(nowdb_scope_t *scope, char *stmt,
+                                                      uint32_t dop);
+
 void closeCursor(nowdb_cursor_t *cur);
 
 int waitscope(nowdb_scope_t *scope, char *context);
@@ -95,13 +95,7 @@ nowdb_bool_t openStore(nowdb_store_t *store) {
 
 nowdb_bool_t closeStore(nowdb_store_t *store) {
 	nowdb_err_t     err;
-	err = nowdb_store_close(store);
-	if (err != NOWDB_OK) {
-		fprintf(stderr, "cannot close store\n");
-		nowdb_err_print(err);
-		nowdb_err_release(err);
-		return FALSE;
-	}
+	/* workers must not run on a closed store */
 	if (store->storage != NULL) {
 		err = nowdb_storage_stop(store->storage);
 		if (err != NOWDB_OK) {
@@ -110,6 +104,13 @@ nowdb_bool_t closeStore(nowdb_store_t *store) {
 			return FALSE;
 		}
 	}
+	err = nowdb_store_close(store);
+	if (err != NOWDB_OK) {
+		fprintf(stderr, "cannot close store\n");
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return FALSE;
+	}
 	return TRUE;
 }
 
@@ -291,6 +291,16 @@ void nowdb_expr_usekey(nowdb_expr_t expr) {
 	FIELD(expr)->type = NOWDB_TYP_UINT;
 }
 
+/* -----------------------------------------------------------------------
+ * Set the offset of the field's record within a joined record
+ * -----------------------------------------------------------------------
+ */
+void nowdb_expr_setBase(nowdb_expr_t expr, uint32_t base) {
+	if (expr == NULL) return;
+	if (EXPR(expr)->etype != NOWDB_EXPR_FIELD) return;
+	FIELD(expr)->base = base;
+}
+
 /* -----------------------------------------------------------------------
  * Helper: Create and init constant value expression
  * -----------------------------------------------------------------------
@@ -459,6 +469,7 @@ static inline nowdb_err_t initOp(nowdb_expr_t *expr,
 	OP(*expr)->types = NULL;
 	OP(*expr)->results = NULL;
 	OP(*expr)->text = NULL;
+	OP(*expr)->prog = NULL;
 
 	OP(*expr)->fun = fun;
 	OP(*expr)->args  = len;
@@ -618,11 +629,21 @@ static void destroyConst(nowdb_const_t *cst) {
 	}
 }
 
+/* -----------------------------------------------------------------------
+ * Destroy Program (predeclaration, implementation below)
+ * -----------------------------------------------------------------------
+ */
+static void destroyProg(nowdb_prog_t prog);
+
 /* -----------------------------------------------------------------------
  * Destroy Operator
  * -----------------------------------------------------------------------
  */
 static void destroyOp(nowdb_op_t *op) {
+	if (op->prog != NULL) {
+		destroyProg(op->prog);
+		free(op->prog); op->prog = NULL;
+	}
 	if (op->argv != NULL) {
 		for(int i=0;i<op->args;i++) {
 			nowdb_expr_destroy(op->argv[i]);
@@ -654,7 +675,12 @@ void nowdb_expr_destroy(nowdb_expr_t expr) {
 		destroyConst(CONST(expr)); break;
 	case NOWDB_EXPR_OP:
 		destroyOp(OP(expr)); break;
-	case NOWDB_EXPR_REF: return;
+	case NOWDB_EXPR_REF:
+		if (REF(expr)->shared && REF(expr)->ref != NULL) {
+			nowdb_expr_destroy(REF(expr)->ref);
+			free(REF(expr)->ref); REF(expr)->ref = NULL;
+		}
+		return;
 	case NOWDB_EXPR_AGG: return;
 	default: return;
 	}
@@ -694,6 +720,7 @@ static nowdb_err_t copyField(nowdb_field_t *src,
 	}
 	if (err != NOWDB_OK) return err;
 	FIELD(*trg)->usekey = src->usekey;
+	FIELD(*trg)->base = src->base;
 	return NOWDB_OK;
 }
 
@@ -807,6 +834,16 @@ static nowdb_err_t copyOp(nowdb_op_t   *src,
 		return err;
 	}
 	free(ops);
+
+	// the copy gets its own program
+	if (src->prog != NULL) {
+		err = nowdb_expr_compile(*trg);
+		if (err != NOWDB_OK) {
+			nowdb_expr_destroy(*trg);
+			free(*trg); *trg = NULL;
+			return err;
+		}
+	}
 	return NOWDB_OK;
 }
 
@@ -815,7 +852,21 @@ static nowdb_err_t copyOp(nowdb_op_t   *src,
  * -----------------------------------------------------------------------
  */
 static nowdb_err_t copyRef(nowdb_ref_t *src, nowdb_expr_t *trg) {
-	return nowdb_expr_newRef(trg, src->ref);
+	nowdb_err_t err;
+	nowdb_expr_t ref;
+
+	if (!src->shared) return nowdb_expr_newRef(trg, src->ref);
+
+	err = nowdb_expr_copy(src->ref, &ref);
+	if (err != NOWDB_OK) return err;
+
+	err = nowdb_expr_newRef(trg, ref);
+	if (err != NOWDB_OK) {
+		nowdb_expr_destroy(ref); free(ref);
+		return err;
+	}
+	REF(*trg)->shared = 1;
+	return NOWDB_OK;
 }
 
 /* -----------------------------------------------------------------------
@@ -855,6 +906,7 @@ static inline char fieldEqual(nowdb_field_t *one,
                               nowdb_field_t *two) 
 {
 	if (one->content != two->content) return 0;
+	if (one->base != two->base) return 0;
 
 	// different edges???
 	if (one->content == NOWDB_CONT_EDGE) {
@@ -1187,6 +1239,8 @@ static nowdb_err_t evalField(nowdb_field_t *field,
 
 	if (field->off < 0) INVALID("uninitialised expression");
 
+	row += field->base;
+
 	if (field->content == NOWDB_CONT_EDGE) {
 		err = getEdgeValue(field, hlp, row, typ, res);
 		if (err != NOWDB_OK) return err;
@@ -1215,6 +1269,16 @@ static nowdb_err_t evalFun(uint32_t     fun,
  */
 static inline int evalType(nowdb_op_t *op, char guess);
 
+/* -----------------------------------------------------------------------
+ * Run program (predeclaration, implementation below)
+ * -----------------------------------------------------------------------
+ */
+static nowdb_err_t runProg(nowdb_prog_t  prog,
+                           nowdb_eval_t *hlp,
+                           char         *row,
+                           nowdb_type_t *typ,
+                           void        **res);
+
 #define SETRESULT(t,x) \
 	*typ = t; op->res=x; *res=&op->res;
 
@@ -1232,6 +1296,9 @@ static nowdb_err_t evalOp(nowdb_op_t   *op,
                           void        **res) {
 	nowdb_err_t err;
 
+	// compiled
+	if (op->prog != NULL) return runProg(op->prog, hlp, row, typ, res);
+
 	// evaluate operands
 	if (op->argv != NULL) {
 		for(int i=0; i<op->args; i++) {
@@ -1339,6 +1406,44 @@ static inline nowdb_err_t evalConst(nowdb_const_t *cst,
 	return NOWDB_OK;
 }
 
+/* -----------------------------------------------------------------------
+ * Evaluate reference:
+ * the shared expression is evaluated only once per row;
+ * the referring expression receives a copy of the result,
+ * since operators may convert their operands in place.
+ * -----------------------------------------------------------------------
+ */
+static nowdb_err_t evalRef(nowdb_ref_t  *ref,
+                           nowdb_eval_t *hlp,
+                           char         *row,
+                           nowdb_type_t *typ,
+                           void        **res) {
+	nowdb_err_t err;
+	nowdb_ref_t *own = ref;
+
+	if (!ref->shared) {
+		if (EXPR(ref->ref)->etype != NOWDB_EXPR_REF ||
+		    !REF(ref->ref)->shared) {
+			return nowdb_expr_eval(ref->ref, hlp, row, typ, res);
+		}
+		own = REF(ref->ref);
+	}
+	if (!own->done) {
+		err = nowdb_expr_eval(own->ref, hlp, row,
+		                      &own->typ, &own->res);
+		if (err != NOWDB_OK) return err;
+		own->done = 1;
+	}
+	*typ = own->typ;
+	if (own->typ == NOWDB_TYP_TEXT ||
+	    own->typ == NOWDB_TYP_NOTHING || own->res == NULL) {
+		*res = own->res; return NOWDB_OK;
+	}
+	memcpy(&ref->val, own->res, own->typ == NOWDB_TYP_SHORT?4:8);
+	*res = &ref->val;
+	return NOWDB_OK;
+}
+
 /* -----------------------------------------------------------------------
  * Evaluate expression
  * -----------------------------------------------------------------------
@@ -1360,8 +1465,7 @@ nowdb_err_t nowdb_expr_eval(nowdb_expr_t expr,
 		return evalOp(OP(expr), hlp, row, typ, res);
 
 	case NOWDB_EXPR_REF:
-		return nowdb_expr_eval(REF(expr)->ref, hlp,
-		                       row, typ, res);
+		return evalRef(REF(expr), hlp, row, typ, res);
 
 	case NOWDB_EXPR_AGG:
 		return evalAgg(AGG(expr), typ, res);
@@ -1568,6 +1672,16 @@ void nowdb_expr_replace(nowdb_expr_t op,
 	}
 }
 
+/* -----------------------------------------------------------------------
+ * Get bin width (predeclaration, implementation below)
+ * -----------------------------------------------------------------------
+ */
+static inline nowdb_err_t getBinWidth(nowdb_type_t  t,
+                                      nowdb_type_t wt,
+                                      void         *w,
+                                      int64_t      *iw,
+                                      double       *fw);
+
 /* ------------------------------------------------------------------------
  * Extract period from expression
  * ------------------------------------------------------------------------
@@ -1625,6 +1739,203 @@ void nowdb_expr_period(nowdb_expr_t expr,
 	}
 }
 
+/* ------------------------------------------------------------------------
+ * Get timestamp offset and width of a time bin
+ * ------------------------------------------------------------------------
+ */
+char nowdb_expr_timeBin(nowdb_expr_t expr,
+                        uint16_t     *off,
+                        int64_t    *width) {
+	nowdb_err_t err;
+	nowdb_field_t *f;
+	nowdb_const_t *c;
+	double fw=0.0;
+
+	if (expr == NULL) return 0;
+	if (nowdb_expr_type(expr) != NOWDB_EXPR_OP) return 0;
+	if (OP(expr)->fun != NOWDB_EXPR_OP_BIN) return 0;
+
+	if (nowdb_expr_type(OP(expr)->argv[0]) != NOWDB_EXPR_FIELD) return 0;
+	if (nowdb_expr_type(OP(expr)->argv[1]) != NOWDB_EXPR_CONST) return 0;
+
+	f = FIELDOP(expr,0);
+	c = CONSTOP(expr,1);
+
+	if (f->off != (f->content == NOWDB_CONT_EDGE?NOWDB_OFF_STAMP:
+	                                             NOWDB_OFF_VSTAMP)) return 0;
+	if (c->type != NOWDB_TYP_FLOAT &&
+	    c->type != NOWDB_TYP_INT   &&
+	    c->type != NOWDB_TYP_UINT) return 0;
+
+	err = getBinWidth(NOWDB_TYP_TIME, c->type, c->value, width, &fw);
+	if (err != NOWDB_OK) {
+		nowdb_err_release(err); return 0;
+	}
+	*off = f->off;
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: get the zone map for a field (NULL if there is none)
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_zone_t *getZone(nowdb_field_t *f,
+                                    nowdb_zone_t  *zones,
+                                    uint32_t           n) {
+	if (f->off < 0 || f->off%8 != 0) return NULL;
+	if (f->off/8 >= n) return NULL;
+	return zones+f->off/8;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: get constant as value comparable to the zone map.
+ * Zone maps compare raw values as signed integers;
+ * this order is meaningful for int and time,
+ * for uint if all values are below 2^63 and
+ * for float if all values are positive.
+ * ------------------------------------------------------------------------
+ */
+static inline char zoneValue(nowdb_field_t *f,
+                             nowdb_const_t *c,
+                             nowdb_zone_t  *z,
+                             int64_t       *v) {
+	double d;
+
+	if (c->value == NULL) return 0;
+	switch(f->type) {
+	case NOWDB_TYP_INT:
+	case NOWDB_TYP_TIME:
+	case NOWDB_TYP_DATE:
+		if (c->type != NOWDB_TYP_INT  &&
+		    c->type != NOWDB_TYP_TIME &&
+		    c->type != NOWDB_TYP_DATE) return 0;
+		memcpy(v, c->value, 8); return 1;
+
+	case NOWDB_TYP_UINT:
+		if (c->type != NOWDB_TYP_UINT) return 0;
+		if (z->min < 0 || z->max < 0) return 0;
+		memcpy(v, c->value, 8);
+		return (*v >= 0);
+
+	case NOWDB_TYP_FLOAT:
+		if (c->type != NOWDB_TYP_FLOAT) return 0;
+		if (z->min < 0) return 0;
+		memcpy(&d, c->value, 8);
+		if (d != d || d < 0) return 0;
+		if (d == 0) *v = 0; else memcpy(v, &d, 8);
+		return 1;
+
+	default: return 0;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: check comparison against zone map
+ * ------------------------------------------------------------------------
+ */
+static inline char zoneCompare(nowdb_expr_t  expr,
+                               nowdb_zone_t *zones,
+                               uint32_t          n) {
+	nowdb_zone_t *z;
+	uint32_t fun;
+	int64_t v;
+	int f,c;
+
+	if (!getFieldAndConst(expr, &f, &c)) return 1;
+
+	z = getZone(FIELDOP(expr,f), zones, n);
+	if (z == NULL) return 1;
+
+	/* all values are null */
+	if (z->count == 0) return 1;
+
+	if (!zoneValue(FIELDOP(expr,f), CONSTOP(expr,c), z, &v)) return 1;
+
+	/* const op field: turn it around */
+	fun = OP(expr)->fun;
+	if (f == 1) {
+		switch(fun) {
+		case NOWDB_EXPR_OP_LT: fun = NOWDB_EXPR_OP_GT; break;
+		case NOWDB_EXPR_OP_GT: fun = NOWDB_EXPR_OP_LT; break;
+		case NOWDB_EXPR_OP_LE: fun = NOWDB_EXPR_OP_GE; break;
+		case NOWDB_EXPR_OP_GE: fun = NOWDB_EXPR_OP_LE; break;
+		default: break;
+		}
+	}
+	switch(fun) {
+	case NOWDB_EXPR_OP_EQ: return (v >= z->min && v <= z->max);
+	case NOWDB_EXPR_OP_LT: return (z->min <  v);
+	case NOWDB_EXPR_OP_LE: return (z->min <= v);
+	case NOWDB_EXPR_OP_GT: return (z->max >  v);
+	case NOWDB_EXPR_OP_GE: return (z->max >= v);
+	default: return 1;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: check null test against zone map
+ * ------------------------------------------------------------------------
+ */
+static inline char zoneNull(nowdb_expr_t  expr,
+                            nowdb_zone_t *zones,
+                            uint32_t          n) {
+	nowdb_zone_t *z;
+	nowdb_expr_t  f;
+
+	if (OP(expr)->args != 1) return 1;
+
+	f = OP(expr)->argv[0];
+	if (EXPR(f)->etype != NOWDB_EXPR_FIELD) return 1;
+
+	/* keys are never null in the zone map */
+	if (FIELD(f)->off <= (FIELD(f)->content == NOWDB_CONT_EDGE?
+	                      NOWDB_OFF_STAMP:NOWDB_OFF_VSTAMP)) return 1;
+
+	z = getZone(FIELD(f), zones, n);
+	if (z == NULL) return 1;
+
+	if (OP(expr)->fun == NOWDB_EXPR_OP_IS) return (z->nulls > 0);
+	return (z->count > 0);
+}
+
+/* ------------------------------------------------------------------------
+ * Check whether rows described by the zone maps may pass the filter
+ * ------------------------------------------------------------------------
+ */
+char nowdb_expr_zone(nowdb_expr_t  expr,
+                     nowdb_zone_t *zones,
+                     uint32_t          n) {
+
+	if (expr == NULL || zones == NULL) return 1;
+	if (nowdb_expr_type(expr) != NOWDB_EXPR_OP) return 1;
+
+	switch(OP(expr)->fun) {
+	case NOWDB_EXPR_OP_AND:
+		return (nowdb_expr_zone(OP(expr)->argv[0], zones, n) &&
+		        nowdb_expr_zone(OP(expr)->argv[1], zones, n));
+
+	case NOWDB_EXPR_OP_OR:
+		return (nowdb_expr_zone(OP(expr)->argv[0], zones, n) ||
+		        nowdb_expr_zone(OP(expr)->argv[1], zones, n));
+
+	case NOWDB_EXPR_OP_JUST:
+		return nowdb_expr_zone(OP(expr)->argv[0], zones, n);
+
+	case NOWDB_EXPR_OP_EQ:
+	case NOWDB_EXPR_OP_LT:
+	case NOWDB_EXPR_OP_LE:
+	case NOWDB_EXPR_OP_GT:
+	case NOWDB_EXPR_OP_GE:
+		return zoneCompare(expr, zones, n);
+
+	case NOWDB_EXPR_OP_IS:
+	case NOWDB_EXPR_OP_ISN:
+		return zoneNull(expr, zones, n);
+
+	default: return 1;
+	}
+}
+
 /* -----------------------------------------------------------------------
  * Guess type before evaluation
  * -----------------------------------------------------------------------
@@ -1768,6 +2079,7 @@ static void showOp(nowdb_op_t *op, FILE *stream) {
 	case NOWDB_EXPR_OP_DUSK: return showargs(op, "dusk", stream);
 	case NOWDB_EXPR_OP_EPOCH: return showargs(op, "epoch", stream);
 	case NOWDB_EXPR_OP_NOW: return showargs(op, "now", stream);
+	case NOWDB_EXPR_OP_BIN: return showargs(op, "bin", stream);
 
 	case NOWDB_EXPR_OP_EQ: return showargs(op, "=", stream);
 	case NOWDB_EXPR_OP_NE: return showargs(op, "!=", stream);
@@ -2182,6 +2494,74 @@ static inline nowdb_err_t getTimeSubComp(uint32_t fun, void *arg, void *res) {
 	return NOWDB_OK;
 }
 
+/* -----------------------------------------------------------------------
+ * Get bin width from the second argument of bin;
+ * for time values the width is given in seconds
+ * -----------------------------------------------------------------------
+ */
+static inline nowdb_err_t getBinWidth(nowdb_type_t  t,
+                                      nowdb_type_t wt,
+                                      void         *w,
+                                      int64_t      *iw,
+                                      double       *fw) {
+	uint64_t u;
+	int64_t  i;
+
+	switch(wt) {
+	case NOWDB_TYP_FLOAT: memcpy(fw, w, 8); break;
+	case NOWDB_TYP_UINT: memcpy(&u, w, 8); *fw = (double)u; break;
+	default: memcpy(&i, w, 8); *fw = (double)i;
+	}
+	if (t == NOWDB_TYP_TIME || t == NOWDB_TYP_DATE) {
+		*fw *= (double)nowdb_time_getPerSec();
+	}
+	if (t == NOWDB_TYP_FLOAT) {
+		if (!(*fw > 0.0)) INVALID("bin width must be positive");
+		return NOWDB_OK;
+	}
+	if (!(*fw >= 1.0)) INVALID("bin width must be positive");
+	if (*fw >= 9.2e18) INVALID("bin width too big");
+	*iw = (int64_t)*fw;
+	return NOWDB_OK;
+}
+
+/* -----------------------------------------------------------------------
+ * Get bin, i.e. the value rounded down to a multiple of the width
+ * -----------------------------------------------------------------------
+ */
+static inline nowdb_err_t getBin(nowdb_type_t *types,
+                                 void        **argv,
+                                 void         *res) {
+	nowdb_err_t err;
+	int64_t iw=0, i;
+	uint64_t u;
+	double fw=0.0, f;
+
+	err = getBinWidth(types[0], types[1], argv[1], &iw, &fw);
+	if (err != NOWDB_OK) return err;
+
+	switch(types[0]) {
+	case NOWDB_TYP_FLOAT:
+		memcpy(&f, argv[0], 8);
+		f = floor(f/fw)*fw;
+		memcpy(res, &f, 8); return NOWDB_OK;
+
+	case NOWDB_TYP_UINT:
+		memcpy(&u, argv[0], 8);
+		u = (u/(uint64_t)iw)*(uint64_t)iw;
+		memcpy(res, &u, 8); return NOWDB_OK;
+
+	case NOWDB_TYP_INT:
+	case NOWDB_TYP_TIME:
+	case NOWDB_TYP_DATE:
+		memcpy(&i, argv[0], 8);
+		i = (i/iw - (i%iw < 0))*iw;
+		memcpy(res, &i, 8); return NOWDB_OK;
+
+	default: INVALIDTYPE("not a numeric value");
+	}
+}
+
 /* -----------------------------------------------------------------------
  * Evaluate Fun
  * -----------------------------------------------------------------------
@@ -2370,6 +2750,8 @@ static nowdb_err_t evalFun(uint32_t       fun,
 		return NOWDB_OK;
 
 	case NOWDB_EXPR_OP_BIN:
+		return getBin(types, argv, res);
+
 	case NOWDB_EXPR_OP_FORMAT:
 		return nowdb_err_get(nowdb_err_not_supp, FALSE, OBJECT, NULL);
 
@@ -2498,6 +2880,8 @@ static inline int getArgs(int o) {
 	case NOWDB_EXPR_OP_EPOCH:
 	case NOWDB_EXPR_OP_NOW: return 0;
 
+	case NOWDB_EXPR_OP_BIN: return 2;
+
 	case NOWDB_EXPR_OP_EQ:
 	case NOWDB_EXPR_OP_NE:
 	case NOWDB_EXPR_OP_LT:
@@ -2578,66 +2962,72 @@ static inline void enforceType(nowdb_op_t *op,
 }
 
 /* -----------------------------------------------------------------------
- * Check and correct
+ * Check numeric types and find the conversion (if any)
  * -----------------------------------------------------------------------
  */
-static inline int correctNumTypes(nowdb_op_t *op) {
+static inline int numType(uint32_t args, nowdb_type_t *types, int *conv) {
 	char differ=0;
-	int t = op->types[0];
+	int t = types[0];
 
 	if (t == NOWDB_TYP_TEXT) return -1;
 	if (t == NOWDB_TYP_BOOL) return -1;
 
-	for(int i=1; i<op->args; i++) {
-		if (op->types[i] == NOWDB_TYP_TEXT) return -1;
-		if (op->types[i] == NOWDB_TYP_BOOL) return -1;
+	for(int i=1; i<args; i++) {
+		if (types[i] == NOWDB_TYP_TEXT) return -1;
+		if (types[i] == NOWDB_TYP_BOOL) return -1;
 
-		if (t != op->types[i]) {
+		if (t != types[i]) {
 			differ=1;
-			if (t            != NOWDB_TYP_FLOAT &&
-			    op->types[i] == NOWDB_TYP_FLOAT) {
+			if (t        != NOWDB_TYP_FLOAT &&
+			    types[i] == NOWDB_TYP_FLOAT) {
 				t = NOWDB_TYP_FLOAT; continue;
 			}
-			if (t            == NOWDB_TYP_UINT &&
-			   (op->types[i] == NOWDB_TYP_INT  ||
-			    op->types[i] == NOWDB_TYP_TIME ||
-			    op->types[i] == NOWDB_TYP_DATE)){ 
-				t = op->types[i]; continue;
+			if (t        == NOWDB_TYP_UINT &&
+			   (types[i] == NOWDB_TYP_INT  ||
+			    types[i] == NOWDB_TYP_TIME ||
+			    types[i] == NOWDB_TYP_DATE)){ 
+				t = types[i]; continue;
 			}
 		}
 	}
-	if (!differ) return t;
-	enforceType(op, t);
+	if (differ) *conv = t;
 	return t;
 }
 
 /* -----------------------------------------------------------------------
- * Evaluate Type
+ * Type of a function applied to arguments of the given types;
+ * if the arguments must be converted before the function
+ * is applied, the target type is passed back in conv.
  * -----------------------------------------------------------------------
  */
-static inline int evalType(nowdb_op_t *op, char guess) {
+static int typeOf(uint32_t     fun,
+                  uint32_t    args,
+                  nowdb_type_t *types,
+                  char        guess,
+                  int         *conv) {
 
+	*conv = -1;
 	if (!guess) {
-		for (int i=0; i<op->args; i++) {
-			if (op->types[i] == NOWDB_TYP_NOTHING) {
-				if (op->fun == NOWDB_EXPR_OP_WHEN ||
-				    op->fun == NOWDB_EXPR_OP_ELSE) {
+		for (int i=0; i<args; i++) {
+			if (types[i] == NOWDB_TYP_NOTHING) {
+				if (fun == NOWDB_EXPR_OP_WHEN ||
+				    fun == NOWDB_EXPR_OP_ELSE) {
 					continue;
 				}
-				if (op->fun == NOWDB_EXPR_OP_IS ||
-                                    op->fun == NOWDB_EXPR_OP_ISN) 
+				if (fun == NOWDB_EXPR_OP_IS ||
+                                    fun == NOWDB_EXPR_OP_ISN) 
 				{
 					return NOWDB_TYP_BOOL;
 				}
 				return NOWDB_TYP_NOTHING;
 			} else {
-				if (op->fun == NOWDB_EXPR_OP_COAL) {
-					return op->types[i];
+				if (fun == NOWDB_EXPR_OP_COAL) {
+					return types[i];
 				}
 			}
 		}
 	}
-	switch(op->fun) {
+	switch(fun) {
 
 	case NOWDB_EXPR_OP_FLOAT: return NOWDB_TYP_FLOAT;
 	case NOWDB_EXPR_OP_INT: return NOWDB_TYP_INT;
@@ -2649,27 +3039,27 @@ static inline int evalType(nowdb_op_t *op, char guess) {
 	case NOWDB_EXPR_OP_SUB: 
 	case NOWDB_EXPR_OP_MUL: 
 	case NOWDB_EXPR_OP_DIV:	if (guess) return NOWDB_TYP_INT;
-				return correctNumTypes(op);
+				return numType(args, types, conv);
 
 	case NOWDB_EXPR_OP_POW:
 		if (guess) return NOWDB_TYP_FLOAT; 
-		if (!isNumeric(op->types[0]) ||
-		    !isNumeric(op->types[1])) return -1;
-                enforceType(op,NOWDB_TYP_FLOAT);
+		if (!isNumeric(types[0]) ||
+		    !isNumeric(types[1])) return -1;
+		*conv = NOWDB_TYP_FLOAT;
 		return NOWDB_TYP_FLOAT;
 
 	case NOWDB_EXPR_OP_REM:
 		if (guess) return NOWDB_TYP_INT; 
-		if (!isNumeric(op->types[0]) ||
-		    !isNumeric(op->types[1])) return -1;
-		if (op->types[0] == NOWDB_TYP_FLOAT ||
-		    op->types[1] == NOWDB_TYP_FLOAT) return -1;
-		return correctNumTypes(op);
+		if (!isNumeric(types[0]) ||
+		    !isNumeric(types[1])) return -1;
+		if (types[0] == NOWDB_TYP_FLOAT ||
+		    types[1] == NOWDB_TYP_FLOAT) return -1;
+		return numType(args, types, conv);
 
 	case NOWDB_EXPR_OP_ABS:
 		if (guess) return NOWDB_TYP_INT; 
-		if (!isNumeric(op->types[0])) return -1;
-		return op->types[0];
+		if (!isNumeric(types[0])) return -1;
+		return types[0];
 
 	case NOWDB_EXPR_OP_LOG:
 	case NOWDB_EXPR_OP_CEIL:
@@ -2688,8 +3078,8 @@ static inline int evalType(nowdb_op_t *op, char guess) {
 	case NOWDB_EXPR_OP_ACOSH:
 	case NOWDB_EXPR_OP_ATANH:
 		if (guess) return NOWDB_TYP_FLOAT; 
-		if (op->types[0] != NOWDB_TYP_FLOAT) {
-			enforceType(op, NOWDB_TYP_FLOAT);
+		if (types[0] != NOWDB_TYP_FLOAT) {
+			*conv = NOWDB_TYP_FLOAT;
 		}
 		return NOWDB_TYP_FLOAT;
 
@@ -2715,6 +3105,13 @@ static inline int evalType(nowdb_op_t *op, char guess) {
 	case NOWDB_EXPR_OP_EPOCH:
 	case NOWDB_EXPR_OP_NOW: return NOWDB_TYP_TIME;
 
+	// the bin has the type of the binned value
+	case NOWDB_EXPR_OP_BIN:
+		if (guess) return NOWDB_TYP_TIME;
+		if (!isNumeric(types[0]) ||
+		    !isNumeric(types[1])) return -1;
+		return types[0];
+
 	// test that all types are equal 
 	case NOWDB_EXPR_OP_EQ:
 	case NOWDB_EXPR_OP_NE:
@@ -2722,7 +3119,7 @@ static inline int evalType(nowdb_op_t *op, char guess) {
 	case NOWDB_EXPR_OP_GT:
 	case NOWDB_EXPR_OP_LE:
 	case NOWDB_EXPR_OP_GE:
-		correctNumTypes(op); return NOWDB_TYP_BOOL;
+		numType(args, types, conv); return NOWDB_TYP_BOOL;
 
 	case NOWDB_EXPR_OP_IN:
 	case NOWDB_EXPR_OP_IS:
@@ -2735,17 +3132,17 @@ static inline int evalType(nowdb_op_t *op, char guess) {
 	case NOWDB_EXPR_OP_OR: return NOWDB_TYP_BOOL;
 
 	case NOWDB_EXPR_OP_WHEN:
-		if (op->types[1] != NOWDB_TYP_NOTHING) return op->types[1];
-		if (op->types[2] != NOWDB_TYP_NOTHING) return op->types[2];
+		if (types[1] != NOWDB_TYP_NOTHING) return types[1];
+		if (types[2] != NOWDB_TYP_NOTHING) return types[2];
 		if (guess) return NOWDB_TYP_BOOL;
 		return NOWDB_TYP_NOTHING;
 
-	case NOWDB_EXPR_OP_ELSE: return op->types[0];
+	case NOWDB_EXPR_OP_ELSE: return types[0];
 
 	case NOWDB_EXPR_OP_COAL:
-		for(int i=0;i<op->args;i++) {
-			if (op->types[i] != NOWDB_TYP_NOTHING)
-				return op->types[i];
+		for(int i=0;i<args;i++) {
+			if (types[i] != NOWDB_TYP_NOTHING)
+				return types[i];
 		}
 		return NOWDB_TYP_NOTHING;
 
@@ -2755,6 +3152,1005 @@ static inline int evalType(nowdb_op_t *op, char guess) {
 	}
 }
 
+/* -----------------------------------------------------------------------
+ * Evaluate Type
+ * -----------------------------------------------------------------------
+ */
+static inline int evalType(nowdb_op_t *op, char guess) {
+	int conv;
+	int t;
+
+	t = typeOf(op->fun, op->args, op->types, guess, &conv);
+	if (conv >= 0) enforceType(op, conv);
+	return t;
+}
+
+/* -----------------------------------------------------------------------
+ * Program
+ * -------
+ * The expression tree is compiled into a flat sequence of
+ * instructions. Each instruction computes one register;
+ * operands are computed before the operators using them,
+ * the result is found in the 'root' register.
+ * Registers keep a type that is predicted at compile time
+ * (stypes, -1: unknown). When the operands of a function
+ * have the predicted types at runtime, the function uses
+ * the result type and conversion found at compile time;
+ * otherwise they are determined from the runtime types
+ * (just like in evalOp).
+ * -----------------------------------------------------------------------
+ */
+#define PROG_FIELD     1 /* generic field (text, key, unknown)      */
+#define PROG_RAW       2 /* field that cannot be NULL               */
+#define PROG_NULLABLE  3 /* field with control bit                  */
+#define PROG_CONST     4 /* constant                                */
+#define PROG_VALUE     5 /* folded constant expression              */
+#define PROG_AGG       6 /* aggregate                               */
+#define PROG_ISNULL    7 /* is (not) null                           */
+#define PROG_SKIPZ     8 /* 'and' short circuit                     */
+#define PROG_SKIPNZ    9 /* 'or' short circuit                      */
+#define PROG_COAL     10 /* coalesce: take first non-NULL           */
+#define PROG_NOTHING  11 /* NULL                                    */
+#define PROG_FUN      12 /* any function                            */
+#define PROG_CMP      13 /* comparison of two numbers               */
+#define PROG_ARITH    14 /* +, -, * of two numbers                  */
+#define PROG_REF      15 /* reference (shared expression)          */
+
+/* -----------------------------------------------------------------------
+ * Register
+ * -----------------------------------------------------------------------
+ */
+typedef struct {
+	nowdb_type_t   t; /* type of the value                          */
+	void          *p; /* pointer to the value (or the string)       */
+	nowdb_value_t  v; /* computed values are stored here            */
+} progreg_t;
+
+/* -----------------------------------------------------------------------
+ * Instruction
+ * -----------------------------------------------------------------------
+ */
+typedef struct {
+	uint8_t       code; /* what to do                               */
+	uint8_t        neg; /* isnull: is not null                      */
+	uint16_t      args; /* function: number of operands             */
+	uint32_t       dst; /* result register                          */
+	uint32_t       src; /* function: first operand in the pool,     */
+	                    /* others: operand register                 */
+	uint32_t       fun; /* function                                 */
+	uint32_t       jmp; /* where to continue on short circuit       */
+	uint32_t       off; /* field: offset                            */
+	uint32_t      ctrl; /* field: control byte                      */
+	uint32_t      mask; /* field: control bit                       */
+	int             st; /* result type known at compile time        */
+	int           conv; /* conversion known at compile time         */
+	int             at; /* cmp and arith: type of both operands     */
+	nowdb_value_t  val; /* folded value                             */
+	void          *obj; /* field, const, agg, ref or folded string  */
+} proginst_t;
+
+/* -----------------------------------------------------------------------
+ * Program
+ * -----------------------------------------------------------------------
+ */
+struct nowdb_prog_t {
+	proginst_t     *code; /* instructions                           */
+	uint32_t       ninst; /* number of instructions                 */
+	progreg_t      *regs; /* registers                              */
+	int          *stypes; /* predicted register types               */
+	uint32_t       nregs; /* number of registers                    */
+	uint32_t       *pool; /* function operands                      */
+	uint32_t       npool; /* used operands                          */
+	void          **argv; /* scratch: operands                      */
+	nowdb_type_t  *types; /* scratch: operand types                 */
+	uint32_t        root; /* result register                        */
+};
+
+/* -----------------------------------------------------------------------
+ * Destroy program
+ * -----------------------------------------------------------------------
+ */
+static void destroyProg(nowdb_prog_t prog) {
+	if (prog == NULL) return;
+	if (prog->code != NULL) {
+		free(prog->code); prog->code = NULL;
+	}
+	if (prog->regs != NULL) {
+		free(prog->regs); prog->regs = NULL;
+	}
+	if (prog->stypes != NULL) {
+		free(prog->stypes); prog->stypes = NULL;
+	}
+	if (prog->pool != NULL) {
+		free(prog->pool); prog->pool = NULL;
+	}
+	if (prog->argv != NULL) {
+		free(prog->argv); prog->argv = NULL;
+	}
+	if (prog->types != NULL) {
+		free(prog->types); prog->types = NULL;
+	}
+}
+
+/* -----------------------------------------------------------------------
+ * Convert operand (as enforceType does,
+ * but without touching the row or the constant)
+ * -----------------------------------------------------------------------
+ */
+static inline void progConv(progreg_t    *a,
+                            int        conv,
+                            nowdb_type_t *t,
+                            void        **x) {
+	double  f;
+	int64_t l;
+
+	switch(conv) {
+	case NOWDB_TYP_FLOAT:
+		switch(*t) {
+		case NOWDB_TYP_UINT:
+			f = (double)(*(uint64_t*)*x);
+			memcpy(&a->v, &f, 8); *x = &a->v; break;
+		case NOWDB_TYP_DATE:
+		case NOWDB_TYP_TIME:
+		case NOWDB_TYP_INT:
+			f = (double)(*(int64_t*)*x);
+			memcpy(&a->v, &f, 8); *x = &a->v; break;
+		default: break;
+		}
+		*t = conv; return;
+
+	case NOWDB_TYP_INT:
+	case NOWDB_TYP_TIME:
+	case NOWDB_TYP_DATE:
+		switch(*t) {
+		case NOWDB_TYP_UINT:
+			l = (int64_t)(*(uint64_t*)*x);
+			memcpy(&a->v, &l, 8); *x = &a->v; break;
+		case NOWDB_TYP_FLOAT:
+			l = (int64_t)(*(double*)*x);
+			memcpy(&a->v, &l, 8); *x = &a->v; break;
+		default: break;
+		}
+		*t = conv; return;
+
+	default: return;
+	}
+}
+
+/* -----------------------------------------------------------------------
+ * Run function instruction
+ * -----------------------------------------------------------------------
+ */
+static inline nowdb_err_t runFun(nowdb_prog_t prog,
+                                 proginst_t  *ins,
+                                 progreg_t   *d) {
+	nowdb_err_t err;
+	progreg_t *a;
+	uint32_t r;
+	char fast = (ins->st >= 0);
+	int t, conv;
+
+	for(int i=0; i<ins->args; i++) {
+		r = prog->pool[ins->src+i];
+		a = prog->regs+r;
+		prog->types[i] = a->t;
+		prog->argv[i] = a->t == NOWDB_TYP_NOTHING?NULL:a->p;
+		if ((int)a->t != prog->stypes[r]) fast = 0;
+	}
+	if (fast) {
+		t = ins->st; conv = ins->conv;
+	} else {
+		t = typeOf(ins->fun, ins->args, prog->types, 0, &conv);
+		if (t < 0) INVALIDTYPE("wrong type in operation");
+	}
+	if (conv >= 0) {
+		for(int i=0; i<ins->args; i++) {
+			progConv(prog->regs+prog->pool[ins->src+i], conv,
+			         prog->types+i, prog->argv+i);
+		}
+	}
+	d->t = (nowdb_type_t)t;
+	err = evalFun(ins->fun, ins->args, prog->argv, prog->types,
+	                                              &d->t, &d->v);
+	if (err != NOWDB_OK) return err;
+
+	// pointer or value?
+	if (d->t == NOWDB_TYP_TEXT) {
+		memcpy(&d->p, &d->v, sizeof(char*));
+	} else {
+		d->p = &d->v;
+	}
+	return NOWDB_OK;
+}
+
+/* -----------------------------------------------------------------------
+ * Comparison and arithmetic on registers of the same type;
+ * the register value is a nowdb_value_t, so operands and
+ * results go through memcpy instead of type-punned pointers.
+ * -----------------------------------------------------------------------
+ */
+#define PROGCMP(T) \
+	do { \
+	T x, y; \
+	memcpy(&x, a->p, sizeof(T)); \
+	memcpy(&y, b->p, sizeof(T)); \
+	switch(ins->fun) { \
+	case NOWDB_EXPR_OP_EQ: d->v = (x == y); break; \
+	case NOWDB_EXPR_OP_NE: d->v = (x != y); break; \
+	case NOWDB_EXPR_OP_LT: d->v = (x <  y); break; \
+	case NOWDB_EXPR_OP_GT: d->v = (x >  y); break; \
+	case NOWDB_EXPR_OP_LE: d->v = (x <= y); break; \
+	case NOWDB_EXPR_OP_GE: d->v = (x >= y); break; \
+	} \
+	} while(0)
+
+#define PROGARITH(T) \
+	do { \
+	T x, y, z=0; \
+	memcpy(&x, a->p, sizeof(T)); \
+	memcpy(&y, b->p, sizeof(T)); \
+	switch(ins->fun) { \
+	case NOWDB_EXPR_OP_ADD: z = x + y; break; \
+	case NOWDB_EXPR_OP_SUB: z = x - y; break; \
+	case NOWDB_EXPR_OP_MUL: z = x * y; break; \
+	} \
+	memcpy(&d->v, &z, sizeof(T)); \
+	} while(0)
+
+/* -----------------------------------------------------------------------
+ * Run the instructions from pc to end
+ * -----------------------------------------------------------------------
+ */
+static nowdb_err_t runCode(nowdb_prog_t  prog,
+                           uint32_t        pc,
+                           uint32_t       end,
+                           nowdb_eval_t  *hlp,
+                           char          *row) {
+	nowdb_err_t err;
+	nowdb_const_t *cst;
+	proginst_t *ins;
+	progreg_t *d, *a, *b;
+
+	while(pc < end) {
+		ins = prog->code+pc; pc++;
+		d = prog->regs+ins->dst;
+
+		switch(ins->code) {
+		case PROG_RAW:
+			d->t = ins->st;
+			d->p = row+ins->off;
+			break;
+
+		case PROG_NULLABLE:
+			d->p = row+ins->off;
+			if (((uint8_t*)row)[ins->ctrl] & ins->mask) {
+				d->t = ins->st;
+			} else {
+				d->t = NOWDB_TYP_NOTHING;
+			}
+			break;
+
+		case PROG_FIELD:
+			err = evalField(ins->obj, hlp, row, &d->t, &d->p);
+			if (err != NOWDB_OK) return err;
+			break;
+
+		case PROG_CONST:
+			cst = ins->obj;
+			d->t = cst->type;
+			if (cst->type == NOWDB_TYP_NOTHING) {
+				d->v = 0; d->p = &d->v;
+			} else if (cst->value != NULL) {
+				d->p = cst->value;
+			} else {
+				d->p = cst->tree;
+			}
+			break;
+
+		case PROG_VALUE:
+			d->t = ins->st;
+			d->v = ins->val;
+			d->p = d->t == NOWDB_TYP_TEXT?ins->obj:&d->v;
+			break;
+
+		case PROG_AGG:
+			err = evalAgg(ins->obj, &d->t, &d->p);
+			if (err != NOWDB_OK) return err;
+			break;
+
+		case PROG_REF:
+			err = evalRef(ins->obj, hlp, row, &d->t, &d->p);
+			if (err != NOWDB_OK) return err;
+			break;
+
+		case PROG_ISNULL:
+			a = prog->regs+ins->src;
+			d->t = NOWDB_TYP_BOOL;
+			d->v = ((a->t == NOWDB_TYP_NOTHING) != ins->neg);
+			d->p = &d->v;
+			break;
+
+		case PROG_SKIPZ:
+			a = prog->regs+ins->src;
+			if (*(nowdb_value_t*)a->p == 0) {
+				d->t = NOWDB_TYP_BOOL;
+				d->v = 0; d->p = &d->v;
+				pc = ins->jmp;
+			}
+			break;
+
+		case PROG_SKIPNZ:
+			a = prog->regs+ins->src;
+			if (*(nowdb_value_t*)a->p != 0) {
+				d->t = NOWDB_TYP_BOOL;
+				d->v = 1; d->p = &d->v;
+				pc = ins->jmp;
+			}
+			break;
+
+		case PROG_COAL:
+			a = prog->regs+ins->src;
+			if (a->t != NOWDB_TYP_NOTHING) {
+				d->t = a->t;
+				if (a->t == NOWDB_TYP_TEXT) {
+					d->p = a->p;
+				} else {
+					d->v = *(nowdb_value_t*)a->p;
+					d->p = &d->v;
+				}
+				pc = ins->jmp;
+			}
+			break;
+
+		case PROG_NOTHING:
+			d->t = NOWDB_TYP_NOTHING;
+			d->p = &d->v;
+			break;
+
+		case PROG_CMP:
+			a = prog->regs+prog->pool[ins->src];
+			b = prog->regs+prog->pool[ins->src+1];
+			if ((int)a->t != ins->at || (int)b->t != ins->at) {
+				err = runFun(prog, ins, d);
+				if (err != NOWDB_OK) return err;
+				break;
+			}
+			d->t = NOWDB_TYP_BOOL; d->p = &d->v;
+			switch(ins->at) {
+			case NOWDB_TYP_UINT: PROGCMP(uint64_t); break;
+			case NOWDB_TYP_FLOAT: PROGCMP(double); break;
+			default: PROGCMP(int64_t);
+			}
+			break;
+
+		case PROG_ARITH:
+			a = prog->regs+prog->pool[ins->src];
+			b = prog->regs+prog->pool[ins->src+1];
+			if ((int)a->t != ins->at || (int)b->t != ins->at) {
+				err = runFun(prog, ins, d);
+				if (err != NOWDB_OK) return err;
+				break;
+			}
+			d->t = ins->at; d->p = &d->v;
+			switch(ins->at) {
+			case NOWDB_TYP_UINT: PROGARITH(uint64_t); break;
+			case NOWDB_TYP_FLOAT: PROGARITH(double); break;
+			default: PROGARITH(int64_t);
+			}
+			break;
+
+		case PROG_FUN:
+			err = runFun(prog, ins, d);
+			if (err != NOWDB_OK) return err;
+			break;
+
+		default: INVALID("unknown instruction");
+		}
+	}
+	return NOWDB_OK;
+}
+
+/* -----------------------------------------------------------------------
+ * Run program
+ * -----------------------------------------------------------------------
+ */
+static nowdb_err_t runProg(nowdb_prog_t  prog,
+                           nowdb_eval_t *hlp,
+                           char         *row,
+                           nowdb_type_t *typ,
+                           void        **res) {
+	nowdb_err_t err;
+
+	err = runCode(prog, 0, prog->ninst, hlp, row);
+	if (err != NOWDB_OK) return err;
+
+	*typ = prog->regs[prog->root].t;
+	*res = prog->regs[prog->root].p;
+
+	return NOWDB_OK;
+}
+
+/* -----------------------------------------------------------------------
+ * Helper: count registers, operands and instructions (upper bound);
+ *         returns -1 if the expression cannot be compiled.
+ * -----------------------------------------------------------------------
+ */
+static int countProg(nowdb_expr_t expr,
+                     uint32_t    *regs,
+                     uint32_t    *args,
+                     uint32_t    *inst,
+                     uint32_t    *maxargs) {
+	if (expr == NULL) return -1;
+	switch(EXPR(expr)->etype) {
+	case NOWDB_EXPR_FIELD:
+	case NOWDB_EXPR_CONST:
+	case NOWDB_EXPR_AGG:
+	case NOWDB_EXPR_REF:
+		(*regs)++; (*inst)++; return 0;
+
+	case NOWDB_EXPR_OP:
+		(*regs)++;
+		(*args) += OP(expr)->args;
+		(*inst) += 2 + OP(expr)->args;
+		if (OP(expr)->args > *maxargs) *maxargs = OP(expr)->args;
+		for(int i=0; i<OP(expr)->args; i++) {
+			if (countProg(OP(expr)->argv[i], regs, args,
+			                      inst, maxargs) != 0) return -1;
+		}
+		return 0;
+
+	default: return -1;
+	}
+}
+
+/* -----------------------------------------------------------------------
+ * Helper: new register
+ * -----------------------------------------------------------------------
+ */
+static inline uint32_t newReg(nowdb_prog_t prog, int st) {
+	prog->stypes[prog->nregs] = st;
+	return prog->nregs++;
+}
+
+/* -----------------------------------------------------------------------
+ * Helper: new instruction
+ * -----------------------------------------------------------------------
+ */
+static inline proginst_t *newInst(nowdb_prog_t prog,
+                                  uint8_t      code,
+                                  uint32_t      dst) {
+	proginst_t *ins = prog->code+prog->ninst;
+
+	prog->ninst++;
+	memset(ins, 0, sizeof(proginst_t));
+
+	ins->code = code;
+	ins->dst  = dst;
+	ins->st   = -1;
+	ins->conv = -1;
+	ins->at   = -1;
+
+	return ins;
+}
+
+/* -----------------------------------------------------------------------
+ * Helper: compile field
+ * -----------------------------------------------------------------------
+ */
+static void emitField(nowdb_prog_t   prog,
+                      nowdb_field_t *field,
+                      uint32_t        *dst) {
+	proginst_t *ins;
+	uint8_t code = PROG_NULLABLE;
+	int st = field->type;
+
+	// text may become key, the generic code knows how to handle that
+	if (field->off < 0 || field->type == NOWDB_TYP_TEXT ||
+	                      field->type == NOWDB_TYP_NOTHING) {
+		*dst = newReg(prog, -1);
+		ins = newInst(prog, PROG_FIELD, *dst);
+		ins->obj = field;
+		return;
+	}
+	if (field->content == NOWDB_CONT_EDGE) {
+		switch(field->off) {
+		case NOWDB_OFF_ORIGIN:
+		case NOWDB_OFF_DESTIN:
+			code = PROG_RAW; st = NOWDB_TYP_UINT; break;
+		case NOWDB_OFF_STAMP:
+			code = PROG_RAW; st = NOWDB_TYP_TIME; break;
+		default: break;
+		}
+	} else if (field->name == NULL) code = PROG_RAW;
+
+	*dst = newReg(prog, st);
+	ins = newInst(prog, code, *dst);
+	ins->obj = field;
+	ins->off = field->base+field->off;
+	ins->st  = st;
+	if (code == PROG_NULLABLE) {
+		ins->ctrl = field->base+
+		            nowdb_ctrlStart(field->num)+field->ctrlbyte;
+		ins->mask = 1 << field->ctrlbit;
+	}
+}
+
+/* -----------------------------------------------------------------------
+ * Helper: types known at compile time;
+ *         use cmp and arith where possible
+ * -----------------------------------------------------------------------
+ */
+static void staticType(nowdb_prog_t prog, proginst_t *ins) {
+	int t;
+
+	switch(ins->fun) {
+	case NOWDB_EXPR_OP_WHEN:
+	case NOWDB_EXPR_OP_ELSE: return;
+	default: break;
+	}
+	for(int i=0; i<ins->args; i++) {
+		t = prog->stypes[prog->pool[ins->src+i]];
+		if (t < 0) return;
+		prog->types[i] = t;
+	}
+	t = typeOf(ins->fun, ins->args, prog->types, 0, &ins->conv);
+	if (t < 0) {
+		ins->conv = -1; return;
+	}
+	ins->st = t;
+	prog->stypes[ins->dst] = t;
+
+	if (ins->conv >= 0 || ins->args != 2) return;
+	if (prog->types[0] != prog->types[1]) return;
+
+	switch(ins->fun) {
+	case NOWDB_EXPR_OP_EQ:
+	case NOWDB_EXPR_OP_NE:
+	case NOWDB_EXPR_OP_LT:
+	case NOWDB_EXPR_OP_GT:
+	case NOWDB_EXPR_OP_LE:
+	case NOWDB_EXPR_OP_GE:
+		switch(prog->types[0]) {
+		case NOWDB_TYP_UINT:
+		case NOWDB_TYP_INT:
+		case NOWDB_TYP_TIME:
+		case NOWDB_TYP_DATE:
+		case NOWDB_TYP_BOOL:
+		case NOWDB_TYP_FLOAT:
+			ins->code = PROG_CMP;
+			ins->at = prog->types[0]; return;
+		default: return;
+		}
+
+	case NOWDB_EXPR_OP_ADD:
+	case NOWDB_EXPR_OP_SUB:
+	case NOWDB_EXPR_OP_MUL:
+		switch(prog->types[0]) {
+		case NOWDB_TYP_UINT:
+		case NOWDB_TYP_INT:
+		case NOWDB_TYP_TIME:
+		case NOWDB_TYP_DATE:
+		case NOWDB_TYP_FLOAT:
+			ins->code = PROG_ARITH;
+			ins->at = prog->types[0]; return;
+		default: return;
+		}
+
+	default: return;
+	}
+}
+
+/* -----------------------------------------------------------------------
+ * Helper: fold constant expression starting at instruction 'start'
+ *         (if it cannot be evaluated now, it is left alone)
+ * -----------------------------------------------------------------------
+ */
+static void fold(nowdb_prog_t prog, uint32_t start, uint32_t dst) {
+	nowdb_err_t err;
+	progreg_t  *r = prog->regs+dst;
+	proginst_t *ins;
+
+	err = runCode(prog, start, prog->ninst, NULL, NULL);
+	if (err != NOWDB_OK) {
+		nowdb_err_release(err); return;
+	}
+	prog->ninst = start;
+
+	ins = newInst(prog, PROG_VALUE, dst);
+	ins->st = r->t;
+	ins->val = r->v;
+	if (r->t == NOWDB_TYP_TEXT) ins->obj = r->p;
+
+	prog->stypes[dst] = r->t;
+}
+
+/* -----------------------------------------------------------------------
+ * Helper: compile expression (0: ok, -1: cannot be compiled),
+ *         pure tells whether the expression is constant.
+ * -----------------------------------------------------------------------
+ */
+static int emit(nowdb_prog_t prog,
+                nowdb_expr_t expr,
+                uint32_t     *dst,
+                char        *pure);
+
+/* -----------------------------------------------------------------------
+ * Helper: compile operator
+ * -----------------------------------------------------------------------
+ */
+static int emitOp(nowdb_prog_t prog,
+                  nowdb_op_t   *op,
+                  uint32_t    *dst,
+                  char       *pure) {
+	proginst_t *ins, *skip=NULL;
+	uint32_t start = prog->ninst;
+	uint32_t src, d, r;
+	char p;
+
+	d = newReg(prog, -1);
+	*dst = d;
+	*pure = (op->fun != NOWDB_EXPR_OP_NOW);
+
+	// is (not) null is decided by the type of the first operand
+	if ((op->fun == NOWDB_EXPR_OP_IS ||
+	     op->fun == NOWDB_EXPR_OP_ISN) && op->args > 0) {
+		if (emit(prog, op->argv[0], &r, &p) != 0) return -1;
+		if (!p) *pure = 0;
+
+		ins = newInst(prog, PROG_ISNULL, d);
+		ins->src = r;
+		ins->neg = (op->fun == NOWDB_EXPR_OP_ISN);
+		prog->stypes[d] = NOWDB_TYP_BOOL;
+
+		if (*pure) fold(prog, start, d);
+		return 0;
+	}
+
+	src = prog->npool; prog->npool += op->args;
+	for(int i=0; i<op->args; i++) {
+		if (emit(prog, op->argv[i], &r, &p) != 0) return -1;
+		if (!p) *pure = 0;
+
+		prog->pool[src+i] = r;
+
+		// short circuit
+		if (i == 0 && op->fun == NOWDB_EXPR_OP_AND) {
+			skip = newInst(prog, PROG_SKIPZ, d);
+			skip->src = r;
+		} else if (i == 0 && op->fun == NOWDB_EXPR_OP_OR) {
+			skip = newInst(prog, PROG_SKIPNZ, d);
+			skip->src = r;
+		} else if (op->fun == NOWDB_EXPR_OP_COAL) {
+			ins = newInst(prog, PROG_COAL, d);
+			ins->src = r;
+		}
+	}
+	if (op->fun == NOWDB_EXPR_OP_COAL) {
+		newInst(prog, PROG_NOTHING, d);
+		for(uint32_t pc=start; pc<prog->ninst; pc++) {
+			if (prog->code[pc].code == PROG_COAL &&
+			    prog->code[pc].dst  == d) {
+				prog->code[pc].jmp = prog->ninst;
+			}
+		}
+	} else {
+		ins = newInst(prog, PROG_FUN, d);
+		ins->fun  = op->fun;
+		ins->args = op->args;
+		ins->src  = src;
+		staticType(prog, ins);
+		if (skip != NULL) skip->jmp = prog->ninst;
+	}
+	if (*pure) fold(prog, start, d);
+	return 0;
+}
+
+/* -----------------------------------------------------------------------
+ * Helper: compile expression
+ * -----------------------------------------------------------------------
+ */
+static int emit(nowdb_prog_t prog,
+                nowdb_expr_t expr,
+                uint32_t     *dst,
+                char        *pure) {
+	proginst_t *ins;
+
+	switch(EXPR(expr)->etype) {
+	case NOWDB_EXPR_FIELD:
+		*pure = 0;
+		emitField(prog, FIELD(expr), dst);
+		return 0;
+
+	case NOWDB_EXPR_CONST:
+		*pure = 1;
+		*dst = newReg(prog, CONST(expr)->type);
+		ins = newInst(prog, PROG_CONST, *dst);
+		ins->obj = expr;
+		return 0;
+
+	case NOWDB_EXPR_AGG:
+		*pure = 0;
+		*dst = newReg(prog, -1);
+		ins = newInst(prog, PROG_AGG, *dst);
+		ins->obj = expr;
+		return 0;
+
+	// the referenced expression is evaluated once per row
+	case NOWDB_EXPR_REF:
+		*pure = 0;
+		*dst = newReg(prog, -1);
+		ins = newInst(prog, PROG_REF, *dst);
+		ins->obj = expr;
+		return 0;
+
+	case NOWDB_EXPR_OP:
+		return emitOp(prog, OP(expr), dst, pure);
+
+	default: return -1;
+	}
+}
+
+/* -----------------------------------------------------------------------
+ * Compile expression
+ * -----------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_expr_compile(nowdb_expr_t expr) {
+	nowdb_err_t err;
+	nowdb_prog_t prog;
+	uint32_t regs=0, args=0, inst=0, maxargs=0;
+	char pure;
+
+	if (expr == NULL) return NOWDB_OK;
+	if (EXPR(expr)->etype != NOWDB_EXPR_OP) return NOWDB_OK;
+
+	if (OP(expr)->prog != NULL) {
+		destroyProg(OP(expr)->prog);
+		free(OP(expr)->prog); OP(expr)->prog = NULL;
+	}
+
+	// we leave it to the tree
+	if (countProg(expr, &regs, &args, &inst, &maxargs) != 0) {
+		return NOWDB_OK;
+	}
+
+	prog = calloc(1, sizeof(struct nowdb_prog_t));
+	if (prog == NULL) {
+		NOMEM("allocating program");
+		return err;
+	}
+	prog->code = calloc(inst, sizeof(proginst_t));
+	prog->regs = calloc(regs, sizeof(progreg_t));
+	prog->stypes = calloc(regs, sizeof(int));
+	prog->pool = calloc(args+1, sizeof(uint32_t));
+	prog->argv = calloc(maxargs+1, sizeof(void*));
+	prog->types = calloc(maxargs+1, sizeof(nowdb_type_t));
+
+	if (prog->code   == NULL || prog->regs == NULL ||
+	    prog->stypes == NULL || prog->pool == NULL ||
+	    prog->argv   == NULL || prog->types == NULL) {
+		NOMEM("allocating program");
+		destroyProg(prog); free(prog);
+		return err;
+	}
+	if (emit(prog, expr, &prog->root, &pure) != 0) {
+		destroyProg(prog); free(prog);
+		return NOWDB_OK;
+	}
+	OP(expr)->prog = prog;
+	return NOWDB_OK;
+}
+
+/* -----------------------------------------------------------------------
+ * Helper: fold constants, cst tells whether the result is constant
+ * -----------------------------------------------------------------------
+ */
+static nowdb_err_t foldExpr(nowdb_expr_t *expr,
+                            nowdb_time_t   now,
+                            char          *cst) {
+	nowdb_err_t err;
+	nowdb_expr_t c;
+	nowdb_type_t t;
+	void *v=NULL;
+	char all=1;
+
+	*cst = 0;
+	if (*expr == NULL) return NOWDB_OK;
+	switch(EXPR(*expr)->etype) {
+	case NOWDB_EXPR_CONST: *cst = 1; return NOWDB_OK;
+	case NOWDB_EXPR_OP: break;
+	default: return NOWDB_OK;
+	}
+	for(int i=0; i<OP(*expr)->args; i++) {
+		err = foldExpr(OP(*expr)->argv+i, now, cst);
+		if (err != NOWDB_OK) return err;
+		if (!(*cst)) all = 0;
+	}
+	*cst = 0;
+
+	if (OP(*expr)->fun == NOWDB_EXPR_OP_NOW) {
+		err = nowdb_expr_newConstant(&c, &now, NOWDB_TYP_TIME);
+	} else {
+		if (!all) return NOWDB_OK;
+		err = nowdb_expr_eval(*expr, NULL, NULL, &t, &v);
+		if (err != NOWDB_OK) {
+			nowdb_err_release(err); return NOWDB_OK;
+		}
+		if (t != NOWDB_TYP_NOTHING && v == NULL) return NOWDB_OK;
+		err = nowdb_expr_newConstant(&c, v, t);
+	}
+	if (err != NOWDB_OK) return err;
+
+	nowdb_expr_destroy(*expr); free(*expr);
+	*expr = c; *cst = 1;
+
+	return NOWDB_OK;
+}
+
+/* -----------------------------------------------------------------------
+ * Fold constants
+ * -----------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_expr_fold(nowdb_expr_t *expr, nowdb_time_t now) {
+	char cst;
+
+	if (expr == NULL || *expr == NULL) return NOWDB_OK;
+	return foldExpr(expr, now, &cst);
+}
+
+/* -----------------------------------------------------------------------
+ * Helper: collect the places of all operators (preorder)
+ *         that may be shared, i.e. that have no aggregates
+ * -----------------------------------------------------------------------
+ */
+static nowdb_err_t collectOps(nowdb_expr_t   *expr,
+                              ts_algo_list_t *ops) {
+	nowdb_err_t err;
+
+	if (*expr == NULL) return NOWDB_OK;
+	if (EXPR(*expr)->etype != NOWDB_EXPR_OP) return NOWDB_OK;
+
+	if (!nowdb_expr_has(*expr, NOWDB_EXPR_AGG)) {
+		if (ts_algo_list_append(ops, expr) != TS_ALGO_OK) {
+			NOMEM("list.append");
+			return err;
+		}
+	}
+	for(int i=0; i<OP(*expr)->args; i++) {
+		err = collectOps(OP(*expr)->argv+i, ops);
+		if (err != NOWDB_OK) return err;
+	}
+	return NOWDB_OK;
+}
+
+/* -----------------------------------------------------------------------
+ * Helper: find the first operator that occurs more than once
+ *         and collect all its places in 'same'
+ * -----------------------------------------------------------------------
+ */
+static nowdb_err_t findCommon(ts_algo_list_t *ops,
+                              ts_algo_list_t *same) {
+	ts_algo_list_node_t *one, *two;
+
+	for(one=ops->head; one!=NULL; one=one->nxt) {
+		for(two=one->nxt; two!=NULL; two=two->nxt) {
+			if (!nowdb_expr_equal(*(nowdb_expr_t*)one->cont,
+			                      *(nowdb_expr_t*)two->cont)) continue;
+			if (same->len == 0) {
+				if (ts_algo_list_append(same,
+				            one->cont) != TS_ALGO_OK) {
+					return nowdb_err_get(nowdb_err_no_mem,
+					          FALSE, OBJECT, "list.append");
+				}
+			}
+			if (ts_algo_list_append(same,
+			              two->cont) != TS_ALGO_OK) {
+				return nowdb_err_get(nowdb_err_no_mem,
+				          FALSE, OBJECT, "list.append");
+			}
+		}
+		if (same->len > 0) return NOWDB_OK;
+	}
+	return NOWDB_OK;
+}
+
+/* -----------------------------------------------------------------------
+ * Helper: move the first place to a new shared expression
+ *         and replace all places by references to it
+ * -----------------------------------------------------------------------
+ */
+static nowdb_err_t shareCommon(ts_algo_list_t *same,
+                               nowdb_expr_t   *own) {
+	nowdb_err_t err;
+	ts_algo_list_node_t *runner;
+	nowdb_expr_t *place, ref;
+
+	place = same->head->cont;
+
+	err = nowdb_expr_newRef(own, *place);
+	if (err != NOWDB_OK) return err;
+	REF(*own)->shared = 1;
+
+	err = nowdb_expr_newRef(&ref, *own);
+	if (err != NOWDB_OK) {
+		REF(*own)->shared = 0;
+		free(*own); *own = NULL;
+		return err;
+	}
+	*place = ref;
+
+	for(runner=same->head->nxt; runner!=NULL; runner=runner->nxt) {
+		place = runner->cont;
+		err = nowdb_expr_newRef(&ref, *own);
+		if (err != NOWDB_OK) return err;
+		nowdb_expr_destroy(*place); free(*place);
+		*place = ref;
+	}
+	return NOWDB_OK;
+}
+
+/* -----------------------------------------------------------------------
+ * Share common subexpressions
+ * -----------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_expr_share(nowdb_expr_t  *exprs,  uint32_t  n,
+                             nowdb_expr_t **shared, uint32_t *nshared) {
+	nowdb_err_t err=NOWDB_OK;
+	ts_algo_list_t ops, same;
+	nowdb_expr_t *tmp;
+
+	*shared = NULL;
+	*nshared = 0;
+
+	for(;;) {
+		ts_algo_list_init(&ops);
+		ts_algo_list_init(&same);
+
+		// the shared expressions themselves may contain
+		// subexpressions that occur elsewhere
+		for(uint32_t i=0; i<*nshared; i++) {
+			err = collectOps(&REF((*shared)[i])->ref, &ops);
+			if (err != NOWDB_OK) break;
+		}
+		for(uint32_t i=0; err == NOWDB_OK && i<n; i++) {
+			err = collectOps(exprs+i, &ops);
+		}
+		if (err == NOWDB_OK) err = findCommon(&ops, &same);
+		if (err != NOWDB_OK || same.len == 0) {
+			ts_algo_list_destroy(&ops);
+			ts_algo_list_destroy(&same);
+			break;
+		}
+		tmp = realloc(*shared, (*nshared+1)*sizeof(nowdb_expr_t));
+		if (tmp == NULL) {
+			NOMEM("allocating shared expressions");
+			ts_algo_list_destroy(&ops);
+			ts_algo_list_destroy(&same);
+			break;
+		}
+		*shared = tmp;
+		err = shareCommon(&same, (*shared)+(*nshared));
+		if ((*shared)[*nshared] != NULL) (*nshared)++;
+
+		ts_algo_list_destroy(&ops);
+		ts_algo_list_destroy(&same);
+		if (err != NOWDB_OK) break;
+	}
+	if (*nshared == 0) {
+		free(*shared); *shared = NULL;
+	}
+	return err;
+}
+
+/* -----------------------------------------------------------------------
+ * Start a new row for the shared expressions
+ * -----------------------------------------------------------------------
+ */
+void nowdb_expr_newRow(nowdb_expr_t *shared, uint32_t nshared) {
+	for(uint32_t i=0; i<nshared; i++) {
+		REF(shared[i])->done = 0;
+	}
+}
+
 /* -----------------------------------------------------------------------
  * Get operator, function or aggregate from name/symbol
  * -----------------------------------------------------------------------
@@ -2837,6 +4233,7 @@ int nowdb_op_fromName(char *op, char *agg) {
 	if (strcasecmp(op, "dawn") == 0) return NOWDB_EXPR_OP_DAWN;
 	if (strcasecmp(op, "dusk") == 0) return NOWDB_EXPR_OP_DUSK;
 	if (strcasecmp(op, "now") == 0) return NOWDB_EXPR_OP_NOW;
+	if (strcasecmp(op, "bin") == 0) return NOWDB_EXPR_OP_BIN;
 	if (strcasecmp(op, "epoch") == 0) return NOWDB_EXPR_OP_EPOCH;
 
 	if (strcasecmp(op, "true") == 0) return NOWDB_EXPR_OP_TRUE;
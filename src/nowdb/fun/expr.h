@@ -10,6 +10,7 @@
 #include <nowdb/types/types.h>
 #include <nowdb/types/error.h>
 #include <nowdb/types/time.h>
+#include <nowdb/io/file.h>
 #include <nowdb/model/types.h>
 #include <nowdb/model/model.h>
 #include <nowdb/text/text.h>
@@ -75,6 +76,7 @@ typedef struct {
 	uint16_t            num; /* number of props         */
 	char                 pk; /* primary key if vertex   */
 	char             usekey; /* use key instead of text */
+	uint32_t           base; /* record offset in a join */
 } nowdb_field_t;
 
 /* ------------------------------------------------------------------------
@@ -90,6 +92,12 @@ typedef struct {
  */
 void nowdb_expr_usekey(nowdb_expr_t expr);
 
+/* -----------------------------------------------------------------------
+ * Set the offset of the field's record within a joined record
+ * -----------------------------------------------------------------------
+ */
+void nowdb_expr_setBase(nowdb_expr_t expr, uint32_t base);
+
 /* ------------------------------------------------------------------------
  * Constant Expression
  * -------------------
@@ -114,6 +122,12 @@ typedef struct {
 #define NOWDB_EXPR_TOCONST(x) \
 	((nowdb_const_t*)x)
 
+/* ------------------------------------------------------------------------
+ * Compiled expression (program), see nowdb_expr_compile
+ * ------------------------------------------------------------------------
+ */
+typedef struct nowdb_prog_t* nowdb_prog_t;
+
 /* ------------------------------------------------------------------------
  * Operator Expression
  * ------------------------------------------------------------------------
@@ -127,6 +141,7 @@ typedef struct {
 	void       **results;  /* pointers to arg results               */
 	nowdb_value_t    res;  /* result holds a value or a pointer     */
 	char           *text;  /* when op result is a text manipulation */
+	nowdb_prog_t    prog;  /* compiled program or NULL              */
 } nowdb_op_t;
 
 /* ------------------------------------------------------------------------
@@ -137,12 +152,22 @@ typedef struct {
 	((nowdb_op_t*)x)
 
 /* ------------------------------------------------------------------------
- * Reference Expression (???)
+ * Reference Expression
+ * --------------------
+ * A shared reference owns the referenced expression
+ * and evaluates it at most once per row (see nowdb_expr_share);
+ * a plain reference refers to a shared reference
+ * and receives a private copy of its result.
  * ------------------------------------------------------------------------
  */
 typedef struct {
-	uint32_t    etype; /* expression type (ref) */
-	nowdb_expr_t  ref; /* from where it comes   */
+	uint32_t    etype; /* expression type (ref)          */
+	nowdb_expr_t  ref; /* from where it comes            */
+	char       shared; /* owns ref and caches its result */
+	char         done; /* result for the current row     */
+	nowdb_type_t  typ; /* type of the cached result      */
+	void         *res; /* the cached result              */
+	nowdb_value_t val; /* private copy of the result     */
 } nowdb_ref_t;
 
 /* ------------------------------------------------------------------------
@@ -376,6 +401,58 @@ nowdb_err_t nowdb_expr_eval(nowdb_expr_t expr,
                             nowdb_type_t *typ,
                             void        **res);
 
+/* ------------------------------------------------------------------------
+ * Compile expression
+ * ------------------
+ * Lowers the expression tree (only operators, other expressions
+ * are left alone) into a flat, register-based program:
+ * - operands are evaluated in postorder into registers,
+ *   there is no recursion at evaluation time;
+ * - field offsets and control bits are resolved once;
+ * - types are resolved at compile time whenever the types
+ *   of the operands are known, only operands that may change
+ *   their type (NULL, text, aggregates, etc.) are checked
+ *   on each evaluation;
+ * - constant subexpressions are evaluated once (except now()).
+ * nowdb_expr_eval runs the program instead of walking the tree.
+ * Expressions that cannot be compiled are evaluated as before.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_expr_compile(nowdb_expr_t expr);
+
+/* ------------------------------------------------------------------------
+ * Fold constants
+ * --------------
+ * Replaces operators with only constant operands by constants.
+ * now() is replaced by 'now', i.e. it is evaluated
+ * once per statement and not once per row.
+ * Operators that fail to evaluate are left alone
+ * (the error will show up when the expression is evaluated).
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_expr_fold(nowdb_expr_t *expr, nowdb_time_t now);
+
+/* ------------------------------------------------------------------------
+ * Share common subexpressions
+ * ---------------------------
+ * Operators occurring more than once in the 'n' expressions
+ * are moved to 'shared' and replaced by references to them.
+ * A shared expression is evaluated at most once per row;
+ * the rows are separated by nowdb_expr_newRow.
+ * The caller destroys the shared expressions
+ * after the expressions referring to them and frees the array.
+ * Expressions that contain aggregates are not shared.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_expr_share(nowdb_expr_t  *exprs,  uint32_t  n,
+                             nowdb_expr_t **shared, uint32_t *nshared);
+
+/* ------------------------------------------------------------------------
+ * Start a new row for the shared expressions
+ * ------------------------------------------------------------------------
+ */
+void nowdb_expr_newRow(nowdb_expr_t *shared, uint32_t nshared);
+
 /* ------------------------------------------------------------------------
  * Extract time period from expression
  * ------------------------------------------------------------------------
@@ -384,6 +461,18 @@ void nowdb_expr_period(nowdb_expr_t expr,
                        nowdb_time_t *start,
                        nowdb_time_t *end);
 
+/* ------------------------------------------------------------------------
+ * Time bin
+ * --------
+ * If expr is bin(stamp, width) with a constant width,
+ * the offset of the timestamp and the width in time units
+ * are passed back and 1 is returned; otherwise 0.
+ * ------------------------------------------------------------------------
+ */
+char nowdb_expr_timeBin(nowdb_expr_t expr,
+                        uint16_t     *off,
+                        int64_t    *width);
+
 /* ------------------------------------------------------------------------
  * Extract key range from expression
  * ------------------------------------------------------------------------
@@ -392,6 +481,15 @@ char nowdb_expr_range(nowdb_expr_t expr,
                       uint16_t sz, uint16_t *off,
                       char *rstart, char *rend);
 
+/* ------------------------------------------------------------------------
+ * Check whether any row described by the zone maps
+ * may pass the filter (0: no row can pass)
+ * ------------------------------------------------------------------------
+ */
+char nowdb_expr_zone(nowdb_expr_t  expr,
+                     nowdb_zone_t *zones,
+                     uint32_t          n);
+
 /* ------------------------------------------------------------------------
  * Fix expression result
  * (currently, for aggregates only!)
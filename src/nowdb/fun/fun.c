@@ -131,6 +131,14 @@ static inline int getFType(uint32_t fun) {
 	case NOWDB_FUN_MODE:
 		return NOWDB_FUN_TREE;
 
+	case NOWDB_FUN_PERCENTILE:
+	case NOWDB_FUN_APPROXMEDIAN:
+		return NOWDB_FUN_SKETCH;
+
+	case NOWDB_FUN_COUNTDISTINCT:
+	case NOWDB_FUN_APPROXDISTINCT:
+		return NOWDB_FUN_DISTINCT;
+
 	default: return -1;
 	}
 }
@@ -156,8 +164,14 @@ static inline nowdb_type_t getOType(nowdb_fun_t *fun) {
 	case NOWDB_FUN_MEDIAN:
 	case NOWDB_FUN_STDDEV:
 	case NOWDB_FUN_INTEGRAL:
+	case NOWDB_FUN_PERCENTILE:
+	case NOWDB_FUN_APPROXMEDIAN:
 		return NOWDB_TYP_FLOAT;
 
+	case NOWDB_FUN_COUNTDISTINCT:
+	case NOWDB_FUN_APPROXDISTINCT:
+		return NOWDB_TYP_UINT;
+
 	default: return fun->dtype;
 	}
 }
@@ -182,6 +196,35 @@ static nowdb_err_t initFlist(nowdb_fun_t *fun) {
 	return NOWDB_OK;
 }
 
+/* -----------------------------------------------------------------------
+ * Helper: Init sketch
+ * -----------------------------------------------------------------------
+ */
+static nowdb_err_t initSketch(nowdb_fun_t *fun) {
+	double p;
+
+	if (fun->fun == NOWDB_FUN_PERCENTILE) {
+		memcpy(&p, &fun->init, 8);
+		if (!(p >= 0 && p <= 100)) {
+			INVALID("percentile must be between 0 and 100");
+		}
+	}
+	return nowdb_tdigest_new(&fun->sketch, NOWDB_TDIGEST_COMPRESSION);
+}
+
+/* -----------------------------------------------------------------------
+ * Helper: Init distinct
+ * text is counted by its key (no need to get the string)
+ * -----------------------------------------------------------------------
+ */
+static nowdb_err_t initDistinct(nowdb_fun_t *fun) {
+	nowdb_expr_usekey(fun->expr);
+	if (fun->fun == NOWDB_FUN_COUNTDISTINCT) {
+		return nowdb_hset_new(&fun->hset, NOWDB_HSET_MEM);
+	}
+	return nowdb_hll_new(&fun->hll, NOWDB_HLL_PRECISION);
+}
+
 /* -----------------------------------------------------------------------
  * Helper: reset
  * -----------------------------------------------------------------------
@@ -196,6 +239,14 @@ static inline void reset(nowdb_fun_t *fun) {
 	fun->first = 1;
 	fun->otype = 0;
 
+	/* the initial value of a sketch is a parameter */
+	if (fun->ftype == NOWDB_FUN_SKETCH) {
+		if (fun->sketch != NULL) nowdb_tdigest_reset(fun->sketch);
+		return;
+	}
+	if (fun->hset != NULL) nowdb_hset_reset(fun->hset);
+	if (fun->hll != NULL) nowdb_hll_reset(fun->hll);
+
 	memcpy(&fun->r1, &fun->init, fun->fsize);
 }
 
@@ -251,6 +302,9 @@ nowdb_err_t nowdb_fun_init(nowdb_fun_t      *fun,
 	fun->fsize = 8;
 	fun->dtype = 0;
 	fun->flist = NULL;
+	fun->sketch = NULL;
+	fun->hset = NULL;
+	fun->hll = NULL;
 
 	if (init != NULL) {
 		memcpy(&fun->init, init, fun->fsize);
@@ -266,6 +320,14 @@ nowdb_err_t nowdb_fun_init(nowdb_fun_t      *fun,
 		err = initFlist(fun);
 		if (err != NOWDB_OK) return err;
 	}
+	if (fun->ftype == NOWDB_FUN_SKETCH) {
+		err = initSketch(fun);
+		if (err != NOWDB_OK) return err;
+	}
+	if (fun->ftype == NOWDB_FUN_DISTINCT) {
+		err = initDistinct(fun);
+		if (err != NOWDB_OK) return err;
+	}
 	return NOWDB_OK;
 }
 
@@ -299,6 +361,18 @@ void nowdb_fun_destroy(nowdb_fun_t *fun) {
 		nowdb_blist_destroy(fun->flist);
 		free(fun->flist); fun->flist = NULL;
 	}
+	if (fun->sketch != NULL) {
+		nowdb_tdigest_destroy(fun->sketch);
+		free(fun->sketch); fun->sketch = NULL;
+	}
+	if (fun->hset != NULL) {
+		nowdb_hset_destroy(fun->hset);
+		free(fun->hset); fun->hset = NULL;
+	}
+	if (fun->hll != NULL) {
+		nowdb_hll_destroy(fun->hll);
+		free(fun->hll); fun->hll = NULL;
+	}
 	if (fun->expr != NULL) {
 		nowdb_expr_destroy(fun->expr); free(fun->expr);
 	}
@@ -313,6 +387,202 @@ void nowdb_fun_reset(nowdb_fun_t *fun) {
 	reset(fun);
 }
 
+/* -----------------------------------------------------------------------
+ * Copy
+ * -----------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_fun_copy(nowdb_fun_t *src, nowdb_fun_t **trg) {
+	nowdb_err_t err;
+	nowdb_expr_t expr=NULL;
+
+	if (src == NULL) INVALID("source is NULL");
+	if (src->expr != NULL) {
+		err = nowdb_expr_copy(src->expr, &expr);
+		if (err != NOWDB_OK) return err;
+	}
+	err = nowdb_fun_new(trg, src->fun, src->ctype, expr, &src->init);
+	if (err != NOWDB_OK) {
+		if (expr != NULL) {
+			nowdb_expr_destroy(expr); free(expr);
+		}
+		return err;
+	}
+	return NOWDB_OK;
+}
+
+/* -----------------------------------------------------------------------
+ * Helper: append the values collected by src to trg
+ * we copy instead of moving the blocks,
+ * since only the head block may be partially filled
+ * -----------------------------------------------------------------------
+ */
+static inline nowdb_err_t mergeMany(nowdb_fun_t *trg,
+                                    nowdb_fun_t *src) {
+	nowdb_err_t err;
+	ts_algo_list_node_t *runner;
+	nowdb_block_t *b, *t;
+	uint32_t off, n;
+
+	for(runner=src->many.head; runner!=NULL; runner=runner->nxt) {
+		b = runner->cont;
+		off = 0;
+		while(off < b->sz) {
+			if (trg->many.len == 0 || trg->off >= BLOCKSIZE) {
+				err = nowdb_blist_give(trg->flist,
+				                       &trg->many);
+				if (err != NOWDB_OK) return err;
+				trg->off = 0;
+			}
+			t = trg->many.head->cont;
+			n = BLOCKSIZE - trg->off;
+			if (n > b->sz - off) n = b->sz - off;
+			memcpy(t->block+trg->off, b->block+off, n);
+			trg->off += n; off += n;
+			t->sz = trg->off;
+		}
+	}
+	return NOWDB_OK;
+}
+
+/* -----------------------------------------------------------------------
+ * A function that has not yet seen a value
+ * -----------------------------------------------------------------------
+ */
+#define EMPTY(f) \
+	((f)->first || ((f)->ftype != NOWDB_FUN_ZERO && \
+	               (f)->dtype == NOWDB_TYP_NOTHING))
+
+/* -----------------------------------------------------------------------
+ * Helper: merge distinct values
+ * -----------------------------------------------------------------------
+ */
+static inline nowdb_err_t mergeDistinct(nowdb_fun_t *trg, nowdb_fun_t *src) {
+	if (src->fun == NOWDB_FUN_COUNTDISTINCT) {
+		return nowdb_hset_merge(trg->hset, src->hset);
+	}
+	return nowdb_hll_merge(trg->hll, src->hll);
+}
+
+/* -----------------------------------------------------------------------
+ * Merge
+ * -----------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_fun_merge(nowdb_fun_t *trg, nowdb_fun_t *src) {
+	nowdb_err_t err;
+
+	if (trg == NULL) INVALID("target is NULL");
+	if (src == NULL) INVALID("source is NULL");
+	if (trg->fun != src->fun) INVALID("cannot merge different functions");
+
+	/* src has not seen anything */
+	if (EMPTY(src)) return NOWDB_OK;
+
+	/* trg has not seen anything */
+	if (EMPTY(trg)) {
+		trg->dtype = src->dtype;
+		trg->first = 0;
+		if (src->ftype == NOWDB_FUN_MANY) return mergeMany(trg, src);
+		if (src->ftype == NOWDB_FUN_SKETCH) {
+			nowdb_tdigest_merge(trg->sketch, src->sketch);
+			return NOWDB_OK;
+		}
+		if (src->ftype == NOWDB_FUN_DISTINCT) {
+			return mergeDistinct(trg, src);
+		}
+		trg->r1 = src->r1;
+		trg->r2 = src->r2;
+		trg->r3 = src->r3;
+		trg->r4 = src->r4;
+		return NOWDB_OK;
+	}
+
+	switch(src->fun) {
+	case NOWDB_FUN_COUNT:
+		trg->r1 += src->r1; return NOWDB_OK;
+
+	case NOWDB_FUN_SUM:
+		return nowadd(&trg->r1, &src->r1, trg->dtype);
+
+	case NOWDB_FUN_PROD:
+		return nowmul(&trg->r1, &src->r1, trg->dtype);
+
+	case NOWDB_FUN_MAX:
+		return nowmax(&trg->r1, &src->r1, trg->dtype);
+
+	case NOWDB_FUN_MIN:
+		return nowmin(&trg->r1, &src->r1, trg->dtype);
+
+	case NOWDB_FUN_SPREAD:
+		err = nowmax(&trg->r1, &src->r1, trg->dtype);
+		if (err != NOWDB_OK) return err;
+		return nowmin(&trg->r2, &src->r2, trg->dtype);
+
+	case NOWDB_FUN_AVG:
+		trg->r2 += src->r2;
+		return nowadd(&trg->r1, &src->r1, trg->dtype);
+
+	case NOWDB_FUN_MEDIAN:
+	case NOWDB_FUN_STDDEV:
+	case NOWDB_FUN_INTEGRAL:
+		return mergeMany(trg, src);
+
+	case NOWDB_FUN_PERCENTILE:
+	case NOWDB_FUN_APPROXMEDIAN:
+		nowdb_tdigest_merge(trg->sketch, src->sketch);
+		return NOWDB_OK;
+
+	case NOWDB_FUN_COUNTDISTINCT:
+	case NOWDB_FUN_APPROXDISTINCT:
+		return mergeDistinct(trg, src);
+
+	default:
+		return nowdb_err_get(nowdb_err_not_supp, FALSE, OBJECT,
+		                         "function cannot be merged");
+	}
+}
+
+/* -----------------------------------------------------------------------
+ * Function keeps its state in registers
+ * -----------------------------------------------------------------------
+ */
+char nowdb_fun_inline(nowdb_fun_t *fun) {
+	return (fun->ftype == NOWDB_FUN_ZERO ||
+	        fun->ftype == NOWDB_FUN_ONE);
+}
+
+/* -----------------------------------------------------------------------
+ * Set pool
+ * -----------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_fun_setPool(nowdb_fun_t *fun, nowdb_hset_pool_t *pool) {
+	if (fun->hset == NULL) return NOWDB_OK;
+	return nowdb_hset_setPool(fun->hset, pool);
+}
+
+/* -----------------------------------------------------------------------
+ * Save state
+ * -----------------------------------------------------------------------
+ */
+void nowdb_fun_save(nowdb_fun_t *fun, nowdb_fun_state_t *state) {
+	state->r1    = fun->r1;
+	state->r2    = fun->r2;
+	state->dtype = fun->dtype;
+	state->otype = fun->otype;
+	state->first = fun->first;
+}
+
+/* -----------------------------------------------------------------------
+ * Restore state
+ * -----------------------------------------------------------------------
+ */
+void nowdb_fun_restore(nowdb_fun_t *fun, nowdb_fun_state_t *state) {
+	fun->r1    = state->r1;
+	fun->r2    = state->r2;
+	fun->dtype = state->dtype;
+	fun->otype = state->otype;
+	fun->first = state->first;
+}
+
 /* -----------------------------------------------------------------------
  * Helper: collect values
  * -----------------------------------------------------------------------
@@ -342,6 +612,81 @@ static inline nowdb_err_t collect(nowdb_fun_t  *fun,
 	return NOWDB_OK;
 }
 
+/* -----------------------------------------------------------------------
+ * Helper: add value to sketch
+ * -----------------------------------------------------------------------
+ */
+static inline nowdb_err_t sketch(nowdb_fun_t  *fun,
+                                 nowdb_eval_t *hlp,
+                                 char      *record) {
+	nowdb_err_t  err;
+	void *value=NULL;
+	nowdb_type_t   t;
+	double x;
+
+	err = nowdb_expr_eval(fun->expr, hlp, record, &t, &value);
+	if (err != NOWDB_OK) return err;
+
+	switch(t) {
+	case NOWDB_TYP_NOTHING: return NOWDB_OK;
+	case NOWDB_TYP_UINT:
+	case NOWDB_TYP_INT:
+	case NOWDB_TYP_TIME:
+	case NOWDB_TYP_DATE:
+	case NOWDB_TYP_FLOAT: break;
+	default: INVALID("sketch needs numeric values");
+	}
+	fun->dtype = t;
+
+	now2float(&x, value, t);
+	nowdb_tdigest_add(fun->sketch, x);
+	return NOWDB_OK;
+}
+
+/* -----------------------------------------------------------------------
+ * Helper: add value to distinct values;
+ *         all values are 64 bits wide, but we want
+ *         -0.0 and 0.0 to be the same value
+ * -----------------------------------------------------------------------
+ */
+static inline nowdb_err_t distinct(nowdb_fun_t  *fun,
+                                   nowdb_eval_t *hlp,
+                                   char      *record) {
+	nowdb_err_t  err;
+	void *value=NULL;
+	nowdb_type_t   t;
+	uint64_t k=0;
+	double d;
+
+	err = nowdb_expr_eval(fun->expr, hlp, record, &t, &value);
+	if (err != NOWDB_OK) return err;
+
+	switch(t) {
+	case NOWDB_TYP_NOTHING: return NOWDB_OK;
+	case NOWDB_TYP_BOOL: k = *(char*)value != 0; break;
+	case NOWDB_TYP_FLOAT:
+		memcpy(&d, value, 8);
+		if (d == 0) d = 0;
+		memcpy(&k, &d, 8); break;
+	case NOWDB_TYP_UINT:
+	case NOWDB_TYP_INT:
+	case NOWDB_TYP_TIME:
+	case NOWDB_TYP_DATE:
+		memcpy(&k, value, 8); break;
+	case NOWDB_TYP_TEXT:
+	case NOWDB_TYP_LONGTEXT:
+		return nowdb_err_get(nowdb_err_not_supp, FALSE, OBJECT,
+		                         "distinct on computed text");
+	default: INVALID("unknown type in distinct");
+	}
+	fun->dtype = t;
+
+	if (fun->fun == NOWDB_FUN_COUNTDISTINCT) {
+		return nowdb_hset_add(fun->hset, k);
+	}
+	return nowdb_hll_add(fun->hll, k);
+}
+
 /* -----------------------------------------------------------------------
  * Helper: apply 0-function
  * -----------------------------------------------------------------------
@@ -438,6 +783,8 @@ nowdb_err_t nowdb_fun_map(nowdb_fun_t  *fun,
 		err = apply(fun, fun->fun, hlp, record); break;
 
 	case NOWDB_FUN_MANY: err = collect(fun, hlp, record); break;
+	case NOWDB_FUN_SKETCH: err = sketch(fun, hlp, record); break;
+	case NOWDB_FUN_DISTINCT: err = distinct(fun, hlp, record); break;
 	case NOWDB_FUN_TREE:
 		err = nowdb_err_get(nowdb_err_not_supp, FALSE, OBJECT,
 		                     "tree functions not implemented");
@@ -604,6 +951,24 @@ static nowdb_err_t reduce(nowdb_fun_t *fun, uint32_t ftype) {
 
 		return median(fun);
 
+	case NOWDB_FUN_PERCENTILE:
+		MOV(&x, &fun->init);
+		x = nowdb_tdigest_quantile(fun->sketch, x/100);
+		MOV(&fun->r1, &x);
+		return NOWDB_OK;
+
+	case NOWDB_FUN_APPROXMEDIAN:
+		x = nowdb_tdigest_quantile(fun->sketch, 0.5);
+		MOV(&fun->r1, &x);
+		return NOWDB_OK;
+
+	case NOWDB_FUN_COUNTDISTINCT:
+		return nowdb_hset_count(fun->hset, &fun->r1);
+
+	case NOWDB_FUN_APPROXDISTINCT:
+		fun->r1 = nowdb_hll_estimate(fun->hll);
+		return NOWDB_OK;
+
 	case NOWDB_FUN_STDDEV:
 		// fprintf(stderr, "computing stddev\n");
 
@@ -676,5 +1041,12 @@ int nowdb_fun_fromName(const char *name) {
 	if (strcasecmp(name, "MODE") == 0) return NOWDB_FUN_MODE;
 	if (strcasecmp(name, "STDDEV") == 0) return NOWDB_FUN_STDDEV;
 	if (strcasecmp(name, "INTEGRAL") == 0) return NOWDB_FUN_INTEGRAL;
+	if (strcasecmp(name, "PERCENTILE") == 0) return NOWDB_FUN_PERCENTILE;
+	if (strcasecmp(name, "APPROX_MEDIAN") == 0) {
+		return NOWDB_FUN_APPROXMEDIAN;
+	}
+	if (strcasecmp(name, "APPROX_COUNT_DISTINCT") == 0) {
+		return NOWDB_FUN_APPROXDISTINCT;
+	}
 	return -1;
 }
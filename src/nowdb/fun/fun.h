@@ -12,6 +12,9 @@
 #include <nowdb/index/index.h>
 #include <nowdb/mem/blist.h>
 #include <nowdb/fun/expr.h>
+#include <nowdb/fun/tdigest.h>
+#include <nowdb/fun/hset.h>
+#include <nowdb/fun/hll.h>
 
 #include <stdint.h>
 
@@ -21,6 +24,8 @@
 #define NOWDB_FUN_ONE   2
 #define NOWDB_FUN_MANY  3
 #define NOWDB_FUN_TREE  4
+#define NOWDB_FUN_SKETCH 5
+#define NOWDB_FUN_DISTINCT 6
 
 #define NOWDB_FUN_COUNT     10000000
 #define NOWDB_FUN_SUM       20000000
@@ -34,6 +39,24 @@
 #define NOWDB_FUN_STDDEV   100000000
 #define NOWDB_FUN_INTEGRAL 110000000
 
+/* -----------------------------------------------------------------------
+ * Approximate quantiles (constant memory per group);
+ * the rank of PERCENTILE (0 -- 100) is passed in as
+ * initial value (a double).
+ * -----------------------------------------------------------------------
+ */
+#define NOWDB_FUN_PERCENTILE  120000000
+#define NOWDB_FUN_APPROXMEDIAN 130000000
+
+/* -----------------------------------------------------------------------
+ * Distinct counting: exact (hash set, spills to disk)
+ * and approximate (HyperLogLog, constant memory per group);
+ * text is counted by its key.
+ * -----------------------------------------------------------------------
+ */
+#define NOWDB_FUN_COUNTDISTINCT  140000000
+#define NOWDB_FUN_APPROXDISTINCT 150000000
+
 typedef struct {
 	uint32_t              fun; /* the function code             */
 	int                 ftype; /* function type                 */
@@ -50,11 +73,28 @@ typedef struct {
 	nowdb_value_t          r3; /* third register                */
 	nowdb_value_t          r4; /* fourth register               */
 	nowdb_blist_t      *flist; /* free block list               */
+	nowdb_tdigest_t   *sketch; /* quantile sketch               */
+	nowdb_hset_t        *hset; /* distinct values               */
+	nowdb_hll_t          *hll; /* distinct sketch               */
 	uint32_t              off; /* current offset into block     */
 	char                first; /* first round                   */
 	/* key tree    */          /* tree to find values quickly   */
 } nowdb_fun_t;
 
+/* -----------------------------------------------------------------------
+ * State of a function that keeps everything in its registers
+ * (ZERO and ONE functions), stored outside of the function,
+ * e.g. one state per group in a hash table
+ * -----------------------------------------------------------------------
+ */
+typedef struct {
+	nowdb_value_t         r1; /* first register and result     */
+	nowdb_value_t         r2; /* second register               */
+	nowdb_type_t       dtype; /* type of the field             */
+	nowdb_type_t       otype; /* output type                   */
+	char               first; /* first round                   */
+} nowdb_fun_state_t;
+
 /* -----------------------------------------------------------------------
  * Allocate and init function
  * -----------------------------------------------------------------------
@@ -94,6 +134,50 @@ void nowdb_fun_destroy(nowdb_fun_t *fun);
  */
 void nowdb_fun_reset(nowdb_fun_t *fun);
 
+/* -----------------------------------------------------------------------
+ * Copy
+ * ----
+ * Creates a new function of the same type
+ * with a copy of the expression and a fresh state
+ * -----------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_fun_copy(nowdb_fun_t *src, nowdb_fun_t **trg);
+
+/* -----------------------------------------------------------------------
+ * Merge
+ * -----
+ * Adds the state of src (mapped, but not yet reduced)
+ * to the state of trg; used to combine partial aggregates.
+ * -----------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_fun_merge(nowdb_fun_t *trg, nowdb_fun_t *src);
+
+/* -----------------------------------------------------------------------
+ * The state of this function fits into nowdb_fun_state_t
+ * -----------------------------------------------------------------------
+ */
+char nowdb_fun_inline(nowdb_fun_t *fun);
+
+/* -----------------------------------------------------------------------
+ * Let distinct sets use a shared pool
+ * (before the first value is mapped)
+ * -----------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_fun_setPool(nowdb_fun_t *fun, nowdb_hset_pool_t *pool);
+
+/* -----------------------------------------------------------------------
+ * Save the current state of the function
+ * -----------------------------------------------------------------------
+ */
+void nowdb_fun_save(nowdb_fun_t *fun, nowdb_fun_state_t *state);
+
+/* -----------------------------------------------------------------------
+ * Restore a state previously saved
+ * (the state may come from another function of the same type)
+ * -----------------------------------------------------------------------
+ */
+void nowdb_fun_restore(nowdb_fun_t *fun, nowdb_fun_state_t *state);
+
 /* -----------------------------------------------------------------------
  * Collect
  * -----------------------------------------------------------------------
@@ -87,6 +87,39 @@ nowdb_err_t nowdb_group_fromList(nowdb_group_t  **group,
 	return NOWDB_OK;
 }
 
+/* -----------------------------------------------------------------------
+ * Copy group
+ * -----------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_group_copy(nowdb_group_t  *src,
+                             nowdb_group_t **trg) 
+{
+	nowdb_err_t err;
+	nowdb_fun_t *fun;
+
+	if (src == NULL) INVALID("source is NULL");
+
+	err = nowdb_group_new(trg, src->lst);
+	if (err != NOWDB_OK) return err;
+
+	for(int i=0; i<src->lst; i++) {
+		err = nowdb_fun_copy(src->fun[i], &fun);
+		if (err != NOWDB_OK) {
+			nowdb_group_destroy(*trg);
+			free(*trg); *trg = NULL;
+			return err;
+		}
+		err = nowdb_group_add(*trg, fun);
+		if (err != NOWDB_OK) {
+			nowdb_fun_destroy(fun); free(fun);
+			nowdb_group_destroy(*trg);
+			free(*trg); *trg = NULL;
+			return err;
+		}
+	}
+	return NOWDB_OK;
+}
+
 /* -----------------------------------------------------------------------
  * Add fun to group
  * -----------------------------------------------------------------------
@@ -111,6 +144,21 @@ void nowdb_group_setEval(nowdb_group_t *group, nowdb_eval_t *hlp) {
 	group->hlp = hlp;
 }
 
+/* -----------------------------------------------------------------------
+ * Set pool
+ * -----------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_group_setPool(nowdb_group_t     *group,
+                                nowdb_hset_pool_t *pool) {
+	nowdb_err_t err;
+
+	for(int i=0; i<group->lst; i++) {
+		err = nowdb_fun_setPool(group->fun[i], pool);
+		if (err != NOWDB_OK) return err;
+	}
+	return NOWDB_OK;
+}
+
 /* -----------------------------------------------------------------------
  * Destroy
  * -----------------------------------------------------------------------
@@ -164,6 +212,61 @@ nowdb_err_t nowdb_group_map(nowdb_group_t *group,
 	return NOWDB_OK;
 }
 
+/* -----------------------------------------------------------------------
+ * Merge
+ * -----------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_group_merge(nowdb_group_t *trg,
+                              nowdb_group_t *src) {
+	nowdb_err_t err;
+
+	if (trg == NULL) INVALID("target is NULL");
+	if (src == NULL) INVALID("source is NULL");
+	if (trg->lst != src->lst) INVALID("groups differ in size");
+	if (trg->reduced) INVALID("group already reduced");
+
+	if (!src->mapped) return NOWDB_OK;
+	for(int i=0; i<trg->lst; i++) {
+		err = nowdb_fun_merge(trg->fun[i], src->fun[i]);
+		if (err != NOWDB_OK) return err;
+	}
+	trg->mapped = 1;
+	return NOWDB_OK;
+}
+
+/* -----------------------------------------------------------------------
+ * Inline
+ * -----------------------------------------------------------------------
+ */
+char nowdb_group_inline(nowdb_group_t *group) {
+	for(int i=0; i<group->lst; i++) {
+		if (!nowdb_fun_inline(group->fun[i])) return 0;
+	}
+	return 1;
+}
+
+/* -----------------------------------------------------------------------
+ * Save
+ * -----------------------------------------------------------------------
+ */
+void nowdb_group_save(nowdb_group_t *group, nowdb_fun_state_t *states) {
+	for(int i=0; i<group->lst; i++) {
+		nowdb_fun_save(group->fun[i], states+i);
+	}
+}
+
+/* -----------------------------------------------------------------------
+ * Restore
+ * -----------------------------------------------------------------------
+ */
+void nowdb_group_restore(nowdb_group_t *group, nowdb_fun_state_t *states) {
+	for(int i=0; i<group->lst; i++) {
+		nowdb_fun_restore(group->fun[i], states+i);
+	}
+	group->mapped = 1;
+	group->reduced = 0;
+}
+
 /* -----------------------------------------------------------------------
  * Reduce
  * -----------------------------------------------------------------------
@@ -47,6 +47,14 @@ nowdb_err_t nowdb_group_new(nowdb_group_t **group,
 nowdb_err_t nowdb_group_fromList(nowdb_group_t  **group,
                                  ts_algo_list_t *fields);
 
+/* -----------------------------------------------------------------------
+ * Allocate and initialise a copy of a group
+ * (the functions are copied with a fresh state)
+ * -----------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_group_copy(nowdb_group_t  *src,
+                             nowdb_group_t **trg);
+
 /* -----------------------------------------------------------------------
  * Add fun to group
  * -----------------------------------------------------------------------
@@ -65,6 +73,13 @@ void nowdb_group_destroy(nowdb_group_t *group);
  */
 void nowdb_group_setEval(nowdb_group_t *group, nowdb_eval_t *hlp);
 
+/* -----------------------------------------------------------------------
+ * Let the distinct sets of all functions use a shared pool
+ * -----------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_group_setPool(nowdb_group_t     *group,
+                                nowdb_hset_pool_t *pool);
+
 /* -----------------------------------------------------------------------
  * Reset
  * -----------------------------------------------------------------------
@@ -79,6 +94,37 @@ nowdb_err_t nowdb_group_map(nowdb_group_t *group,
                             nowdb_content_t type,
                             char         *record);
 
+/* -----------------------------------------------------------------------
+ * Merge
+ * -----
+ * Adds the partial aggregates of src (mapped, not reduced)
+ * to those of trg. Both groups must have the same functions
+ * (e.g. src is a copy of trg).
+ * -----------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_group_merge(nowdb_group_t *trg,
+                              nowdb_group_t *src);
+
+/* -----------------------------------------------------------------------
+ * All functions in the group keep their state in registers
+ * -----------------------------------------------------------------------
+ */
+char nowdb_group_inline(nowdb_group_t *group);
+
+/* -----------------------------------------------------------------------
+ * Save the states of all functions into 'states'
+ * (an array of group->lst states)
+ * -----------------------------------------------------------------------
+ */
+void nowdb_group_save(nowdb_group_t *group, nowdb_fun_state_t *states);
+
+/* -----------------------------------------------------------------------
+ * Restore the states of all functions from 'states';
+ * the group is then mapped, but not reduced.
+ * -----------------------------------------------------------------------
+ */
+void nowdb_group_restore(nowdb_group_t *group, nowdb_fun_state_t *states);
+
 /* -----------------------------------------------------------------------
  * Reduce
  * -----------------------------------------------------------------------
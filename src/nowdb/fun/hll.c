@@ -0,0 +1,317 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * HyperLogLog: approximate distinct counting in constant memory
+ * ========================================================================
+ */
+#include <nowdb/fun/hll.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static char *OBJECT = "hll";
+
+#define INVALID(s) \
+	return nowdb_err_get(nowdb_err_invalid, FALSE, OBJECT, s);
+
+#define NOMEM(s) \
+	err = nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT, s);
+
+/* ------------------------------------------------------------------------
+ * Initial number of slots in the sparse table
+ * ------------------------------------------------------------------------
+ */
+#define INITCAP 16
+
+/* ------------------------------------------------------------------------
+ * 1/(2 ln 2)
+ * ------------------------------------------------------------------------
+ */
+#define ALPHAINF 0.7213475204444817
+
+/* ------------------------------------------------------------------------
+ * Helper: hash the value (never 0, 0 marks empty sparse slots)
+ * ------------------------------------------------------------------------
+ */
+static inline uint64_t hash(uint64_t v) {
+	uint64_t h = v ^ 0x9e3779b97f4a7c15ULL;
+
+	h ^= h >> 33; h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33; h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h==0?1:h;
+}
+
+/* ------------------------------------------------------------------------
+ * Allocate and initialise
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hll_new(nowdb_hll_t **hll, uint32_t p) {
+	nowdb_err_t err;
+
+	if (hll == NULL) INVALID("hll pointer is NULL");
+
+	*hll = calloc(1, sizeof(nowdb_hll_t));
+	if (*hll == NULL) {
+		NOMEM("allocating hll");
+		return err;
+	}
+	err = nowdb_hll_init(*hll, p);
+	if (err != NOWDB_OK) {
+		free(*hll); *hll = NULL;
+		return err;
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Initialise
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hll_init(nowdb_hll_t *hll, uint32_t p) {
+	nowdb_err_t err;
+
+	if (hll == NULL) INVALID("hll is NULL");
+	if (p < NOWDB_HLL_MINPREC || p > NOWDB_HLL_MAXPREC) {
+		INVALID("precision out of range");
+	}
+
+	memset(hll, 0, sizeof(nowdb_hll_t));
+
+	hll->p = p;
+	hll->m = 1 << p;
+	hll->scap = INITCAP;
+	hll->sparse = calloc(hll->scap, 8);
+	if (hll->sparse == NULL) {
+		NOMEM("allocating sparse table");
+		return err;
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Destroy
+ * ------------------------------------------------------------------------
+ */
+void nowdb_hll_destroy(nowdb_hll_t *hll) {
+	if (hll == NULL) return;
+	if (hll->regs != NULL) {
+		free(hll->regs); hll->regs = NULL;
+	}
+	if (hll->sparse != NULL) {
+		free(hll->sparse); hll->sparse = NULL;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Reset
+ * (if we cannot get a sparse table, we stay dense)
+ * ------------------------------------------------------------------------
+ */
+void nowdb_hll_reset(nowdb_hll_t *hll) {
+	uint64_t *sparse;
+
+	if (hll->regs != NULL) {
+		sparse = calloc(INITCAP, 8);
+		if (sparse == NULL) {
+			memset(hll->regs, 0, hll->m); return;
+		}
+		free(hll->regs); hll->regs = NULL;
+		if (hll->sparse != NULL) free(hll->sparse);
+		hll->sparse = sparse;
+		hll->scap = INITCAP;
+	} else {
+		memset(hll->sparse, 0, hll->scap*8);
+	}
+	hll->scount = 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: update register
+ * ------------------------------------------------------------------------
+ */
+static inline void setReg(nowdb_hll_t *hll, uint64_t h) {
+	uint32_t i = (uint32_t)(h >> (64 - hll->p));
+	uint64_t w = h << hll->p;
+	uint8_t  r;
+
+	r = w == 0 ? 64 - hll->p + 1 : __builtin_clzll(w) + 1;
+	if (r > hll->regs[i]) hll->regs[i] = r;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: switch to registers
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t toDense(nowdb_hll_t *hll) {
+	nowdb_err_t err;
+
+	hll->regs = calloc(hll->m, 1);
+	if (hll->regs == NULL) {
+		NOMEM("allocating registers");
+		return err;
+	}
+	for(uint32_t i=0; i<hll->scap; i++) {
+		if (hll->sparse[i] != 0) setReg(hll, hll->sparse[i]);
+	}
+	free(hll->sparse); hll->sparse = NULL;
+	hll->scap = 0;
+	hll->scount = 0;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: find hash or empty slot in sparse table
+ * ------------------------------------------------------------------------
+ */
+static inline uint64_t *find(uint64_t *tab, uint32_t cap, uint64_t h) {
+	uint32_t m = cap-1;
+	uint32_t i = (uint32_t)h&m;
+
+	for(;;) {
+		if (tab[i] == 0 || tab[i] == h) return tab+i;
+		i = (i+1)&m;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: double the sparse table
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t grow(nowdb_hll_t *hll) {
+	nowdb_err_t err;
+	uint32_t cap = hll->scap << 1;
+	uint64_t *tab;
+
+	tab = calloc(cap, 8);
+	if (tab == NULL) {
+		NOMEM("allocating sparse table");
+		return err;
+	}
+	for(uint32_t i=0; i<hll->scap; i++) {
+		if (hll->sparse[i] == 0) continue;
+		*find(tab, cap, hll->sparse[i]) = hll->sparse[i];
+	}
+	free(hll->sparse); hll->sparse = tab;
+	hll->scap = cap;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: add hash
+ * the sparse table may use as much memory as the registers
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t addHash(nowdb_hll_t *hll, uint64_t h) {
+	nowdb_err_t err;
+	uint64_t *s;
+
+	if (hll->regs != NULL) {
+		setReg(hll, h); return NOWDB_OK;
+	}
+
+	s = find(hll->sparse, hll->scap, h);
+	if (*s != 0) return NOWDB_OK;
+
+	if ((hll->scount+1)*4 > hll->scap*3) {
+		if (hll->scap*16 > hll->m) {
+			err = toDense(hll);
+			if (err != NOWDB_OK) return err;
+			setReg(hll, h);
+			return NOWDB_OK;
+		}
+		err = grow(hll);
+		if (err != NOWDB_OK) return err;
+		s = find(hll->sparse, hll->scap, h);
+	}
+	*s = h; hll->scount++;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Add
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hll_add(nowdb_hll_t *hll, uint64_t v) {
+	return addHash(hll, hash(v));
+}
+
+/* ------------------------------------------------------------------------
+ * Merge
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hll_merge(nowdb_hll_t *trg, nowdb_hll_t *src) {
+	nowdb_err_t err;
+
+	if (trg == NULL) INVALID("target is NULL");
+	if (src == NULL) INVALID("source is NULL");
+	if (trg->p != src->p) INVALID("cannot merge different precisions");
+
+	if (src->regs == NULL) {
+		for(uint32_t i=0; i<src->scap; i++) {
+			if (src->sparse[i] == 0) continue;
+			err = addHash(trg, src->sparse[i]);
+			if (err != NOWDB_OK) return err;
+		}
+		return NOWDB_OK;
+	}
+	if (trg->regs == NULL) {
+		err = toDense(trg);
+		if (err != NOWDB_OK) return err;
+	}
+	for(uint32_t i=0; i<trg->m; i++) {
+		if (src->regs[i] > trg->regs[i]) trg->regs[i] = src->regs[i];
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: sigma and tau from Ertl (2017)
+ * ------------------------------------------------------------------------
+ */
+static double sigma(double x) {
+	double y = 1, z = x, zp;
+
+	if (x == 1) return INFINITY;
+	do {
+		x *= x; zp = z;
+		z += x*y; y += y;
+	} while(z != zp);
+	return z;
+}
+
+static double tau(double x) {
+	double y = 1, z, zp;
+
+	if (x == 0 || x == 1) return 0;
+	z = 1-x;
+	do {
+		x = sqrt(x); zp = z;
+		y *= 0.5;
+		z -= (1-x)*(1-x)*y;
+	} while(z != zp);
+	return z/3;
+}
+
+/* ------------------------------------------------------------------------
+ * Estimate
+ * ------------------------------------------------------------------------
+ */
+uint64_t nowdb_hll_estimate(nowdb_hll_t *hll) {
+	uint32_t c[66];
+	uint32_t q = 64 - hll->p;
+	double m = (double)hll->m;
+	double z;
+
+	if (hll->regs == NULL) return hll->scount;
+
+	memset(c, 0, sizeof(c));
+	for(uint32_t i=0; i<hll->m; i++) c[hll->regs[i]]++;
+
+	z = m*tau(1 - c[q+1]/m);
+	for(uint32_t k=q; k>0; k--) z = 0.5*(z + c[k]);
+	z += m*sigma(c[0]/m);
+
+	return (uint64_t)llround(ALPHAINF*m*m/z);
+}
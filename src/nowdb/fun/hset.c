@@ -0,0 +1,443 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Hash set of 64-bit values for exact distinct counting
+ * ========================================================================
+ */
+#include <nowdb/fun/hset.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+static char *OBJECT = "hset";
+
+#define INVALID(s) \
+	return nowdb_err_get(nowdb_err_invalid, FALSE, OBJECT, s);
+
+#define NOMEM(s) \
+	err = nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT, s);
+
+/* ------------------------------------------------------------------------
+ * Initial number of slots
+ * and number of values read from a partition at once
+ * ------------------------------------------------------------------------
+ */
+#define INITCAP 64
+#define MINCAP  16
+#define CHUNK  512
+
+/* ------------------------------------------------------------------------
+ * Helper: hash the value
+ * ------------------------------------------------------------------------
+ */
+static inline uint64_t hash(uint64_t v) {
+	uint64_t h = v ^ 0x9e3779b97f4a7c15ULL;
+
+	h ^= h >> 33; h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33; h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/* ------------------------------------------------------------------------
+ * Allocate and initialise
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hset_new(nowdb_hset_t **hs, uint64_t budget) {
+	nowdb_err_t err;
+
+	if (hs == NULL) INVALID("hset pointer is NULL");
+
+	*hs = calloc(1, sizeof(nowdb_hset_t));
+	if (*hs == NULL) {
+		NOMEM("allocating hset");
+		return err;
+	}
+	err = nowdb_hset_init(*hs, budget);
+	if (err != NOWDB_OK) {
+		free(*hs); *hs = NULL;
+		return err;
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Initialise
+ * (the table is allocated with the first value)
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hset_init(nowdb_hset_t *hs, uint64_t budget) {
+	if (hs == NULL) INVALID("hset is NULL");
+
+	memset(hs, 0, sizeof(nowdb_hset_t));
+	hs->budget = budget;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: close partitions
+ * ------------------------------------------------------------------------
+ */
+static void closeParts(FILE **parts) {
+	for(int i=0; i<NOWDB_HSET_PARTS; i++) {
+		if (parts[i] != NULL) {
+			fclose(parts[i]); parts[i] = NULL;
+		}
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Set pool
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hset_setPool(nowdb_hset_t *hs, nowdb_hset_pool_t *pool) {
+	if (hs == NULL) INVALID("hset is NULL");
+	if (pool == NULL) INVALID("pool is NULL");
+	if (hs->pool != NULL) INVALID("hset already uses a pool");
+	if (hs->count > 0 || hs->spilled > 0) INVALID("hset is not empty");
+
+	hs->pool = pool;
+	hs->id = pool->next++;
+	hs->mask = 0;
+	pool->mem += sizeof(nowdb_hset_t) + hs->cap*8;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Init pool
+ * ------------------------------------------------------------------------
+ */
+void nowdb_hset_initPool(nowdb_hset_pool_t *pool, uint64_t budget) {
+	memset(pool, 0, sizeof(nowdb_hset_pool_t));
+	pool->budget = budget;
+}
+
+/* ------------------------------------------------------------------------
+ * Reset pool
+ * ------------------------------------------------------------------------
+ */
+void nowdb_hset_resetPool(nowdb_hset_pool_t *pool) {
+	closeParts(pool->parts);
+}
+
+/* ------------------------------------------------------------------------
+ * Destroy pool
+ * ------------------------------------------------------------------------
+ */
+void nowdb_hset_destroyPool(nowdb_hset_pool_t *pool) {
+	if (pool == NULL) return;
+	closeParts(pool->parts);
+}
+
+/* ------------------------------------------------------------------------
+ * Destroy
+ * ------------------------------------------------------------------------
+ */
+void nowdb_hset_destroy(nowdb_hset_t *hs) {
+	if (hs == NULL) return;
+	closeParts(hs->parts);
+	if (hs->pool != NULL) {
+		hs->pool->mem -= sizeof(nowdb_hset_t) + hs->cap*8;
+		hs->pool = NULL;
+	}
+	if (hs->tab != NULL) {
+		free(hs->tab); hs->tab = NULL;
+	}
+	hs->cap = 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Reset
+ * (we keep the table; values spilled to the pool
+ *  are left behind under the old id)
+ * ------------------------------------------------------------------------
+ */
+void nowdb_hset_reset(nowdb_hset_t *hs) {
+	closeParts(hs->parts);
+	if (hs->pool != NULL) {
+		hs->id = hs->pool->next++;
+		hs->mask = 0;
+	}
+	if (hs->tab != NULL) {
+		memset(hs->tab, 0, hs->cap*8);
+	}
+	hs->count = 0;
+	hs->spilled = 0;
+	hs->zero = 0;
+	hs->spill = 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: allocate the table
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t initTable(nowdb_hset_t *hs) {
+	nowdb_err_t err;
+
+	hs->cap = INITCAP;
+	while(hs->cap > MINCAP && (hs->cap*8 > hs->budget ||
+	      (hs->pool != NULL &&
+	       hs->pool->mem + hs->cap*8 > hs->pool->budget))) {
+		hs->cap >>= 1;
+	}
+	hs->tab = calloc(hs->cap, 8);
+	if (hs->tab == NULL) {
+		hs->cap = 0;
+		NOMEM("allocating hash table");
+		return err;
+	}
+	if (hs->pool != NULL) hs->pool->mem += hs->cap*8;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: we can afford 'more' bytes
+ * (on the last level, we cannot spill anymore)
+ * ------------------------------------------------------------------------
+ */
+static inline char fits(nowdb_hset_t *hs, uint64_t more) {
+	if (hs->level+1 >= NOWDB_HSET_MAXLEVEL) return 1;
+	if (hs->pool != NULL &&
+	    hs->pool->mem + more > hs->pool->budget) return 0;
+	return (hs->cap*8 + more <= hs->budget);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: find slot of the value or empty slot
+ * ------------------------------------------------------------------------
+ */
+static inline uint64_t *find(nowdb_hset_t *hs, uint64_t h, uint64_t v) {
+	uint64_t m = hs->cap-1;
+	uint64_t i = h&m;
+
+	for(;;) {
+		if (hs->tab[i] == 0 || hs->tab[i] == v) return hs->tab+i;
+		i = (i+1)&m;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: double the table
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t grow(nowdb_hset_t *hs) {
+	nowdb_err_t err;
+	uint64_t cap = hs->cap << 1;
+	uint64_t m = cap-1;
+	uint64_t *tab, j;
+
+	tab = calloc(cap, 8);
+	if (tab == NULL) {
+		NOMEM("allocating hash table");
+		return err;
+	}
+	for(uint64_t i=0; i<hs->cap; i++) {
+		if (hs->tab[i] == 0) continue;
+		j = hash(hs->tab[i])&m;
+		while(tab[j] != 0) j = (j+1)&m;
+		tab[j] = hs->tab[i];
+	}
+	free(hs->tab); hs->tab = tab;
+	if (hs->pool != NULL) hs->pool->mem += hs->cap*8;
+	hs->cap = cap;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: spill value to partition
+ *         (in the pool, the value is preceded by the id of the set)
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t spill(nowdb_hset_t *hs, uint64_t h, uint64_t v) {
+	int p = (h >> (60-4*hs->level)) & (NOWDB_HSET_PARTS-1);
+	FILE **parts = hs->pool == NULL ? hs->parts : hs->pool->parts;
+	uint64_t buf[2];
+	size_t n = 1;
+
+	if (parts[p] == NULL) {
+		parts[p] = tmpfile();
+		if (parts[p] == NULL) {
+			return nowdb_err_get(nowdb_err_open, TRUE, OBJECT,
+			                               "temporary file");
+		}
+	}
+	buf[0] = v;
+	if (hs->pool != NULL) {
+		buf[0] = hs->id; buf[1] = v; n = 2;
+		hs->mask |= 1 << p;
+	}
+	if (fwrite(buf, 8, n, parts[p]) != n) {
+		return nowdb_err_get(nowdb_err_write, TRUE, OBJECT,
+		                               "temporary file");
+	}
+	hs->spilled++;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: partition i of this set (or NULL)
+ * ------------------------------------------------------------------------
+ */
+static inline FILE *getPart(nowdb_hset_t *hs, int i) {
+	if (hs->pool == NULL) return hs->parts[i];
+	if (!(hs->mask & (1 << i))) return NULL;
+	return hs->pool->parts[i];
+}
+
+/* ------------------------------------------------------------------------
+ * Add
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hset_add(nowdb_hset_t *hs, uint64_t v) {
+	nowdb_err_t err;
+	uint64_t h, *s;
+
+	/* 0 marks empty slots */
+	if (v == 0) {
+		hs->zero = 1; return NOWDB_OK;
+	}
+	if (hs->tab == NULL) {
+		err = initTable(hs);
+		if (err != NOWDB_OK) return err;
+	}
+
+	h = hash(v);
+	s = find(hs, h, v);
+	if (*s != 0) return NOWDB_OK;
+
+	if (!hs->spill && (hs->count+1)*4 > hs->cap*3) {
+		if (fits(hs, hs->cap*8)) {
+			err = grow(hs);
+			if (err != NOWDB_OK) return err;
+			s = find(hs, h, v);
+		} else {
+			hs->spill = 1;
+		}
+	}
+	if (hs->spill) return spill(hs, h, v);
+
+	*s = v; hs->count++;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Contains
+ * ------------------------------------------------------------------------
+ */
+char nowdb_hset_contains(nowdb_hset_t *hs, uint64_t v) {
+	if (v == 0) return hs->zero;
+	if (hs->tab == NULL) return 0;
+	return (*find(hs, hash(v), v) != 0);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: seek error
+ * ------------------------------------------------------------------------
+ */
+#define SEEKERR() \
+	return nowdb_err_get(nowdb_err_seek, TRUE, OBJECT, "temporary file");
+
+/* ------------------------------------------------------------------------
+ * Helper: add all values of src in a partition to trg;
+ *         the file is positioned at its end before values are added,
+ *         since trg may append to the same file (in the pool).
+ *         In the pool, values of other sets are skipped
+ *         (CHUNK is even, so a chunk never splits an (id, value) pair).
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t addPart(nowdb_hset_t *trg,
+                           nowdb_hset_t *src,
+                           FILE        *part) {
+	nowdb_err_t err;
+	uint64_t buf[CHUNK];
+	long pos = 0;
+	size_t n;
+
+	do {
+		if (fseek(part, pos, SEEK_SET) != 0) SEEKERR();
+		n = fread(buf, 8, CHUNK, part);
+		if (ferror(part)) {
+			return nowdb_err_get(nowdb_err_read, TRUE, OBJECT,
+			                               "temporary file");
+		}
+		pos = ftell(part);
+		if (pos < 0) SEEKERR();
+		if (fseek(part, 0, SEEK_END) != 0) SEEKERR();
+
+		if (src->pool == NULL) {
+			for(size_t i=0; i<n; i++) {
+				err = nowdb_hset_add(trg, buf[i]);
+				if (err != NOWDB_OK) return err;
+			}
+			continue;
+		}
+		for(size_t i=0; i+1<n; i+=2) {
+			if (buf[i] != src->id) continue;
+			err = nowdb_hset_add(trg, buf[i+1]);
+			if (err != NOWDB_OK) return err;
+		}
+	} while(n == CHUNK);
+
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Merge
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hset_merge(nowdb_hset_t *trg, nowdb_hset_t *src) {
+	nowdb_err_t err;
+	FILE *part;
+
+	if (trg == NULL) INVALID("target is NULL");
+	if (src == NULL) INVALID("source is NULL");
+
+	if (src->zero) trg->zero = 1;
+	if (src->tab != NULL) {
+		for(uint64_t i=0; i<src->cap; i++) {
+			if (src->tab[i] == 0) continue;
+			err = nowdb_hset_add(trg, src->tab[i]);
+			if (err != NOWDB_OK) return err;
+		}
+	}
+	for(int i=0; i<NOWDB_HSET_PARTS; i++) {
+		part = getPart(src, i);
+		if (part == NULL) continue;
+		err = addPart(trg, src, part);
+		if (err != NOWDB_OK) return err;
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Count
+ * (the sets one level down are private to this call)
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hset_count(nowdb_hset_t *hs, uint64_t *count) {
+	nowdb_err_t err;
+	nowdb_hset_t sub;
+	FILE *part;
+	uint64_t c;
+
+	if (hs == NULL) INVALID("hset is NULL");
+
+	*count = hs->count + hs->zero;
+
+	for(int i=0; i<NOWDB_HSET_PARTS; i++) {
+		part = getPart(hs, i);
+		if (part == NULL) continue;
+
+		err = nowdb_hset_init(&sub, hs->budget);
+		if (err != NOWDB_OK) return err;
+		sub.level = hs->level+1;
+
+		err = addPart(&sub, hs, part);
+		if (err == NOWDB_OK) err = nowdb_hset_count(&sub, &c);
+		nowdb_hset_destroy(&sub);
+		if (err != NOWDB_OK) return err;
+
+		*count += c;
+	}
+	return NOWDB_OK;
+}
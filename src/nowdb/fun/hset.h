@@ -0,0 +1,162 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Hash set of 64-bit values for exact distinct counting
+ * ========================================================================
+ * The values (integers, floats, times or text keys) are kept
+ * in an open-addressing hash table (linear probing);
+ * 0 marks an empty slot and is remembered by a flag.
+ *
+ * When the table would exceed the memory budget, values not yet
+ * in the table are spilled to one of a number of partitions
+ * (temporary files) selected by the hash. Table and partitions
+ * are disjoint and so are the partitions among each other.
+ * The number of distinct values is therefore the number of values
+ * in the table plus the number of distinct values in each partition,
+ * which, in their turn, are counted by a set one level down.
+ *
+ * Many sets (e.g. one per group in a hash aggregation) may share
+ * a pool. The memory of their tables is then accounted in the pool
+ * and checked against the budget of the pool; values of all sets
+ * are spilled to the same partitions of the pool tagged with the id
+ * of the set, so the number of open files does not grow with the
+ * number of sets. Counting a set reads the partitions it spilled to
+ * and ignores the values of the other sets.
+ * ========================================================================
+ */
+#ifndef nowdb_hset_decl
+#define nowdb_hset_decl
+
+#include <nowdb/types/types.h>
+#include <nowdb/types/error.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* ------------------------------------------------------------------------
+ * Default memory budget
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_HSET_MEM 8388608
+
+/* ------------------------------------------------------------------------
+ * Number of partitions per spill level (4 bits of the hash)
+ * and max number of levels
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_HSET_PARTS    16
+#define NOWDB_HSET_MAXLEVEL  8
+
+/* ------------------------------------------------------------------------
+ * Pool shared by many sets
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	FILE *parts[NOWDB_HSET_PARTS]; /* spilled values (id, value)  */
+	uint64_t               budget; /* memory budget of all sets   */
+	uint64_t                  mem; /* memory in use by all sets   */
+	uint64_t                 next; /* next set id                 */
+} nowdb_hset_pool_t;
+
+/* ------------------------------------------------------------------------
+ * Hash set
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	uint64_t                 *tab; /* the hash table              */
+	FILE *parts[NOWDB_HSET_PARTS]; /* spilled values              */
+	nowdb_hset_pool_t       *pool; /* shared pool (may be NULL)   */
+	uint64_t                   id; /* id of the set in the pool   */
+	uint32_t                 mask; /* pool partitions spilled to  */
+	uint64_t               budget; /* memory budget               */
+	uint64_t                  cap; /* slots in table              */
+	uint64_t                count; /* values in table             */
+	uint64_t              spilled; /* values spilled              */
+	uint32_t                level; /* spill level                 */
+	char                     zero; /* 0 is in the set             */
+	char                    spill; /* table is full               */
+} nowdb_hset_t;
+
+/* ------------------------------------------------------------------------
+ * Allocate and initialise a new set
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hset_new(nowdb_hset_t **hs, uint64_t budget);
+
+/* ------------------------------------------------------------------------
+ * Initialise an already allocated set
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hset_init(nowdb_hset_t *hs, uint64_t budget);
+
+/* ------------------------------------------------------------------------
+ * Destroy set
+ * ------------------------------------------------------------------------
+ */
+void nowdb_hset_destroy(nowdb_hset_t *hs);
+
+/* ------------------------------------------------------------------------
+ * Let the set use the pool
+ * (before the first value is added)
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hset_setPool(nowdb_hset_t *hs, nowdb_hset_pool_t *pool);
+
+/* ------------------------------------------------------------------------
+ * Initialise pool
+ * ------------------------------------------------------------------------
+ */
+void nowdb_hset_initPool(nowdb_hset_pool_t *pool, uint64_t budget);
+
+/* ------------------------------------------------------------------------
+ * Reset pool
+ * ----------
+ * Closes the partitions of the pool;
+ * there must be no set with spilled values left in the pool.
+ * ------------------------------------------------------------------------
+ */
+void nowdb_hset_resetPool(nowdb_hset_pool_t *pool);
+
+/* ------------------------------------------------------------------------
+ * Destroy pool
+ * ------------------------------------------------------------------------
+ */
+void nowdb_hset_destroyPool(nowdb_hset_pool_t *pool);
+
+/* ------------------------------------------------------------------------
+ * Forget all values
+ * ------------------------------------------------------------------------
+ */
+void nowdb_hset_reset(nowdb_hset_t *hs);
+
+/* ------------------------------------------------------------------------
+ * Add one value
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hset_add(nowdb_hset_t *hs, uint64_t v);
+
+/* ------------------------------------------------------------------------
+ * Contains
+ * --------
+ * Tests whether the value is in the set;
+ * only the table is searched: spilled values are not seen.
+ * ------------------------------------------------------------------------
+ */
+char nowdb_hset_contains(nowdb_hset_t *hs, uint64_t v);
+
+/* ------------------------------------------------------------------------
+ * Merge
+ * -----
+ * Adds all values in src (including the spilled ones) to trg;
+ * src is left unchanged.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hset_merge(nowdb_hset_t *trg, nowdb_hset_t *src);
+
+/* ------------------------------------------------------------------------
+ * Number of distinct values
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hset_count(nowdb_hset_t *hs, uint64_t *count);
+
+#endif
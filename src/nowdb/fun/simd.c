@@ -0,0 +1,516 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * SIMD kernels: compare one field of all records in a page
+ * ========================================================================
+ */
+#include <nowdb/fun/simd.h>
+
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NOWDB_SIMD_X86
+#include <immintrin.h>
+#endif
+
+/* ------------------------------------------------------------------------
+ * Kernel signature
+ * ------------------------------------------------------------------------
+ */
+typedef void (*matchfun_t)(const nowdb_simd_pred_t*, char*,
+                           uint32_t, uint32_t, uint64_t*);
+
+static pthread_once_t _once = PTHREAD_ONCE_INIT;
+static int _supported = NOWDB_SIMD_SCALAR;
+static int _level = NOWDB_SIMD_SCALAR;
+static matchfun_t _match = NULL;
+
+/* ------------------------------------------------------------------------
+ * Helper: read 8-byte value at p
+ * ------------------------------------------------------------------------
+ */
+#define LOAD(T, p, v) \
+	memcpy(&v, p, 8)
+
+/* ------------------------------------------------------------------------
+ * Scalar comparison
+ * ------------------------------------------------------------------------
+ */
+#define SCMP(NAME, T) \
+	static inline int NAME(uint32_t fun, T v, T c) { \
+		switch(fun) { \
+		case NOWDB_EXPR_OP_EQ: return (v == c); \
+		case NOWDB_EXPR_OP_NE: return (v != c); \
+		case NOWDB_EXPR_OP_LT: return (v <  c); \
+		case NOWDB_EXPR_OP_GT: return (v >  c); \
+		case NOWDB_EXPR_OP_LE: return (v <= c); \
+		case NOWDB_EXPR_OP_GE: return (v >= c); \
+		default: return 0; \
+		} \
+	}
+
+SCMP(ucmp, uint64_t)
+SCMP(icmp, int64_t)
+SCMP(fcmp, double)
+
+/* ------------------------------------------------------------------------
+ * Scalar predicate
+ * ------------------------------------------------------------------------
+ */
+#define SPRED(NAME, T, CMP) \
+	static inline int NAME(const nowdb_simd_pred_t *pred, \
+	                       const T *c, T v) { \
+		int x=0; \
+		switch(pred->fun) { \
+		case NOWDB_SIMD_BETWEEN: \
+			return (CMP(pred->lofun, v, c[0]) & \
+			        CMP(pred->hifun, v, c[1])); \
+		case NOWDB_SIMD_IN: \
+			for(uint32_t k=0; k<pred->nvals; k++) { \
+				x |= (v == c[k]); \
+			} \
+			return (x ^ (pred->inv != 0)); \
+		default: \
+			return CMP(pred->fun, v, c[0]); \
+		} \
+	}
+
+SPRED(upred, uint64_t, ucmp)
+SPRED(ipred, int64_t,  icmp)
+SPRED(fpred, double,   fcmp)
+
+/* ------------------------------------------------------------------------
+ * Scalar loop over records [from, n)
+ * ------------------------------------------------------------------------
+ */
+#define SLOOP(T, PRED) { \
+	T c[NOWDB_SIMD_MAXIN], v; \
+	memcpy(c, pred->vals, NOWDB_SIMD_MAXIN*8); \
+	for(uint32_t p=from; p<n; p++) { \
+		LOAD(T, base+(size_t)p*recsz, v); \
+		map[p>>6] |= (uint64_t)PRED(pred, c, v) << (p&63); \
+	} \
+}
+
+static void matchScalarFrom(const nowdb_simd_pred_t *pred,
+                            char                    *page,
+                            uint32_t                recsz,
+                            uint32_t                 from,
+                            uint32_t                    n,
+                            uint64_t                 *map) {
+	char *base = page+pred->off;
+
+	switch(pred->type) {
+	case NOWDB_TYP_UINT: SLOOP(uint64_t, upred); break;
+	case NOWDB_TYP_INT: SLOOP(int64_t, ipred); break;
+	case NOWDB_TYP_FLOAT: SLOOP(double, fpred); break;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Scalar kernel
+ * ------------------------------------------------------------------------
+ */
+static void matchScalar(const nowdb_simd_pred_t *pred,
+                        char                    *page,
+                        uint32_t                recsz,
+                        uint32_t                    n,
+                        uint64_t                 *map) {
+	matchScalarFrom(pred, page, recsz, 0, n, map);
+}
+
+/* ------------------------------------------------------------------------
+ * Scalar loop over positions
+ * ------------------------------------------------------------------------
+ */
+#define SLOOPAT(T, PRED) { \
+	T c[NOWDB_SIMD_MAXIN], v; \
+	memcpy(c, pred->vals, NOWDB_SIMD_MAXIN*8); \
+	for(uint32_t i=0; i<count; i++) { \
+		uint32_t p = pos[i]; \
+		LOAD(T, base+(size_t)p*recsz, v); \
+		map[p>>6] |= (uint64_t)PRED(pred, c, v) << (p&63); \
+	} \
+}
+
+void nowdb_simd_matchAt(const nowdb_simd_pred_t *pred,
+                        char                    *page,
+                        uint32_t                recsz,
+                        const uint16_t           *pos,
+                        uint32_t                count,
+                        uint64_t                 *map) {
+	char *base = page+pred->off;
+
+	switch(pred->type) {
+	case NOWDB_TYP_UINT: SLOOPAT(uint64_t, upred); break;
+	case NOWDB_TYP_INT: SLOOPAT(int64_t, ipred); break;
+	case NOWDB_TYP_FLOAT: SLOOPAT(double, fpred); break;
+	}
+}
+
+#ifdef NOWDB_SIMD_X86
+
+/* ------------------------------------------------------------------------
+ * Sign bit: unsigned values are compared as signed values
+ *           after flipping the sign bit
+ * ------------------------------------------------------------------------
+ */
+#define SIGNBIT ((int64_t)0x8000000000000000ull)
+
+/* ------------------------------------------------------------------------
+ * AVX2: compare 4 integers
+ * ------------------------------------------------------------------------
+ */
+__attribute__((target("avx2")))
+static inline __m256i avx2icmp(uint32_t fun, __m256i x, __m256i c) {
+	__m256i ones = _mm256_set1_epi64x(-1);
+	switch(fun) {
+	case NOWDB_EXPR_OP_EQ: return _mm256_cmpeq_epi64(x, c);
+	case NOWDB_EXPR_OP_NE: return _mm256_xor_si256(
+	                              _mm256_cmpeq_epi64(x, c), ones);
+	case NOWDB_EXPR_OP_LT: return _mm256_cmpgt_epi64(c, x);
+	case NOWDB_EXPR_OP_GT: return _mm256_cmpgt_epi64(x, c);
+	case NOWDB_EXPR_OP_LE: return _mm256_xor_si256(
+	                              _mm256_cmpgt_epi64(x, c), ones);
+	case NOWDB_EXPR_OP_GE: return _mm256_xor_si256(
+	                              _mm256_cmpgt_epi64(c, x), ones);
+	default: return _mm256_setzero_si256();
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * AVX2: compare 4 doubles (NaN behaves like in C)
+ * ------------------------------------------------------------------------
+ */
+__attribute__((target("avx2")))
+static inline __m256d avx2fcmp(uint32_t fun, __m256d x, __m256d c) {
+	switch(fun) {
+	case NOWDB_EXPR_OP_EQ: return _mm256_cmp_pd(x, c, _CMP_EQ_OQ);
+	case NOWDB_EXPR_OP_NE: return _mm256_cmp_pd(x, c, _CMP_NEQ_UQ);
+	case NOWDB_EXPR_OP_LT: return _mm256_cmp_pd(x, c, _CMP_LT_OQ);
+	case NOWDB_EXPR_OP_GT: return _mm256_cmp_pd(x, c, _CMP_GT_OQ);
+	case NOWDB_EXPR_OP_LE: return _mm256_cmp_pd(x, c, _CMP_LE_OQ);
+	case NOWDB_EXPR_OP_GE: return _mm256_cmp_pd(x, c, _CMP_GE_OQ);
+	default: return _mm256_setzero_pd();
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * AVX2: integer predicate
+ * ------------------------------------------------------------------------
+ */
+__attribute__((target("avx2")))
+static inline __m256i avx2ipred(const nowdb_simd_pred_t *pred,
+                                const __m256i *c, __m256i x) {
+	__m256i m;
+	switch(pred->fun) {
+	case NOWDB_SIMD_BETWEEN:
+		return _mm256_and_si256(avx2icmp(pred->lofun, x, c[0]),
+		                        avx2icmp(pred->hifun, x, c[1]));
+	case NOWDB_SIMD_IN:
+		m = _mm256_setzero_si256();
+		for(uint32_t k=0; k<pred->nvals; k++) {
+			m = _mm256_or_si256(m, _mm256_cmpeq_epi64(x, c[k]));
+		}
+		if (pred->inv) m = _mm256_xor_si256(m,
+		                   _mm256_set1_epi64x(-1));
+		return m;
+	default:
+		return avx2icmp(pred->fun, x, c[0]);
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * AVX2: float predicate
+ * ------------------------------------------------------------------------
+ */
+__attribute__((target("avx2")))
+static inline __m256d avx2fpred(const nowdb_simd_pred_t *pred,
+                                const __m256d *c, __m256d x) {
+	__m256d m;
+	switch(pred->fun) {
+	case NOWDB_SIMD_BETWEEN:
+		return _mm256_and_pd(avx2fcmp(pred->lofun, x, c[0]),
+		                     avx2fcmp(pred->hifun, x, c[1]));
+	case NOWDB_SIMD_IN:
+		m = _mm256_setzero_pd();
+		for(uint32_t k=0; k<pred->nvals; k++) {
+			m = _mm256_or_pd(m, _mm256_cmp_pd(x, c[k],
+			                             _CMP_EQ_OQ));
+		}
+		if (pred->inv) m = _mm256_xor_pd(m, _mm256_castsi256_pd(
+		                            _mm256_set1_epi64x(-1)));
+		return m;
+	default:
+		return avx2fcmp(pred->fun, x, c[0]);
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * AVX2 kernel: gather the field from 4 records at once
+ * ------------------------------------------------------------------------
+ */
+__attribute__((target("avx2")))
+static void matchAVX2(const nowdb_simd_pred_t *pred,
+                      char                    *page,
+                      uint32_t                recsz,
+                      uint32_t                    n,
+                      uint64_t                 *map) {
+	char *base = page+pred->off;
+	int64_t r = (int64_t)recsz;
+	__m256i idx = _mm256_set_epi64x(3*r, 2*r, r, 0);
+	__m256i step = _mm256_set1_epi64x(4*r);
+	uint32_t p=0;
+
+	if (pred->type == NOWDB_TYP_FLOAT) {
+		__m256d c[NOWDB_SIMD_MAXIN];
+		double d;
+		for(int k=0; k<NOWDB_SIMD_MAXIN; k++) {
+			memcpy(&d, pred->vals+k, 8);
+			c[k] = _mm256_set1_pd(d);
+		}
+		for(; p+4<=n; p+=4) {
+			__m256d x = _mm256_i64gather_pd((const double*)base,
+			                                               idx, 1);
+			uint64_t m = _mm256_movemask_pd(avx2fpred(pred, c, x));
+			map[p>>6] |= m << (p&63);
+			idx = _mm256_add_epi64(idx, step);
+		}
+	} else {
+		__m256i c[NOWDB_SIMD_MAXIN];
+		__m256i bias = pred->type == NOWDB_TYP_UINT?
+		               _mm256_set1_epi64x(SIGNBIT):
+		               _mm256_setzero_si256();
+		for(int k=0; k<NOWDB_SIMD_MAXIN; k++) {
+			c[k] = _mm256_xor_si256(_mm256_set1_epi64x(
+			               (int64_t)pred->vals[k]), bias);
+		}
+		for(; p+4<=n; p+=4) {
+			__m256i x = _mm256_i64gather_epi64(
+			            (const long long*)base, idx, 1);
+			x = _mm256_xor_si256(x, bias);
+			uint64_t m = _mm256_movemask_pd(_mm256_castsi256_pd(
+			                               avx2ipred(pred, c, x)));
+			map[p>>6] |= m << (p&63);
+			idx = _mm256_add_epi64(idx, step);
+		}
+	}
+	matchScalarFrom(pred, page, recsz, p, n, map);
+}
+
+/* ------------------------------------------------------------------------
+ * SSE4.2: compare 2 integers
+ * ------------------------------------------------------------------------
+ */
+__attribute__((target("sse4.2")))
+static inline __m128i sseicmp(uint32_t fun, __m128i x, __m128i c) {
+	__m128i ones = _mm_set1_epi64x(-1);
+	switch(fun) {
+	case NOWDB_EXPR_OP_EQ: return _mm_cmpeq_epi64(x, c);
+	case NOWDB_EXPR_OP_NE: return _mm_xor_si128(
+	                              _mm_cmpeq_epi64(x, c), ones);
+	case NOWDB_EXPR_OP_LT: return _mm_cmpgt_epi64(c, x);
+	case NOWDB_EXPR_OP_GT: return _mm_cmpgt_epi64(x, c);
+	case NOWDB_EXPR_OP_LE: return _mm_xor_si128(
+	                              _mm_cmpgt_epi64(x, c), ones);
+	case NOWDB_EXPR_OP_GE: return _mm_xor_si128(
+	                              _mm_cmpgt_epi64(c, x), ones);
+	default: return _mm_setzero_si128();
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * SSE4.2: compare 2 doubles (NaN behaves like in C)
+ * ------------------------------------------------------------------------
+ */
+__attribute__((target("sse4.2")))
+static inline __m128d ssefcmp(uint32_t fun, __m128d x, __m128d c) {
+	switch(fun) {
+	case NOWDB_EXPR_OP_EQ: return _mm_cmpeq_pd(x, c);
+	case NOWDB_EXPR_OP_NE: return _mm_cmpneq_pd(x, c);
+	case NOWDB_EXPR_OP_LT: return _mm_cmplt_pd(x, c);
+	case NOWDB_EXPR_OP_GT: return _mm_cmpgt_pd(x, c);
+	case NOWDB_EXPR_OP_LE: return _mm_cmple_pd(x, c);
+	case NOWDB_EXPR_OP_GE: return _mm_cmpge_pd(x, c);
+	default: return _mm_setzero_pd();
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * SSE4.2: integer predicate
+ * ------------------------------------------------------------------------
+ */
+__attribute__((target("sse4.2")))
+static inline __m128i sseipred(const nowdb_simd_pred_t *pred,
+                               const __m128i *c, __m128i x) {
+	__m128i m;
+	switch(pred->fun) {
+	case NOWDB_SIMD_BETWEEN:
+		return _mm_and_si128(sseicmp(pred->lofun, x, c[0]),
+		                     sseicmp(pred->hifun, x, c[1]));
+	case NOWDB_SIMD_IN:
+		m = _mm_setzero_si128();
+		for(uint32_t k=0; k<pred->nvals; k++) {
+			m = _mm_or_si128(m, _mm_cmpeq_epi64(x, c[k]));
+		}
+		if (pred->inv) m = _mm_xor_si128(m, _mm_set1_epi64x(-1));
+		return m;
+	default:
+		return sseicmp(pred->fun, x, c[0]);
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * SSE4.2: float predicate
+ * ------------------------------------------------------------------------
+ */
+__attribute__((target("sse4.2")))
+static inline __m128d ssefpred(const nowdb_simd_pred_t *pred,
+                               const __m128d *c, __m128d x) {
+	__m128d m;
+	switch(pred->fun) {
+	case NOWDB_SIMD_BETWEEN:
+		return _mm_and_pd(ssefcmp(pred->lofun, x, c[0]),
+		                  ssefcmp(pred->hifun, x, c[1]));
+	case NOWDB_SIMD_IN:
+		m = _mm_setzero_pd();
+		for(uint32_t k=0; k<pred->nvals; k++) {
+			m = _mm_or_pd(m, _mm_cmpeq_pd(x, c[k]));
+		}
+		if (pred->inv) m = _mm_xor_pd(m, _mm_castsi128_pd(
+		                              _mm_set1_epi64x(-1)));
+		return m;
+	default:
+		return ssefcmp(pred->fun, x, c[0]);
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * SSE4.2 kernel: load the field from 2 records at once
+ * ------------------------------------------------------------------------
+ */
+__attribute__((target("sse4.2")))
+static void matchSSE42(const nowdb_simd_pred_t *pred,
+                       char                    *page,
+                       uint32_t                recsz,
+                       uint32_t                    n,
+                       uint64_t                 *map) {
+	char *base = page+pred->off;
+	uint32_t p=0;
+
+	if (pred->type == NOWDB_TYP_FLOAT) {
+		__m128d c[NOWDB_SIMD_MAXIN];
+		double d, v0, v1;
+		for(int k=0; k<NOWDB_SIMD_MAXIN; k++) {
+			memcpy(&d, pred->vals+k, 8);
+			c[k] = _mm_set1_pd(d);
+		}
+		for(; p+2<=n; p+=2) {
+			char *b = base+(size_t)p*recsz;
+			LOAD(double, b, v0);
+			LOAD(double, b+recsz, v1);
+			uint64_t m = _mm_movemask_pd(ssefpred(pred, c,
+			                           _mm_set_pd(v1, v0)));
+			map[p>>6] |= m << (p&63);
+		}
+	} else {
+		__m128i c[NOWDB_SIMD_MAXIN];
+		__m128i bias = pred->type == NOWDB_TYP_UINT?
+		               _mm_set1_epi64x(SIGNBIT):
+		               _mm_setzero_si128();
+		int64_t v0, v1;
+		for(int k=0; k<NOWDB_SIMD_MAXIN; k++) {
+			c[k] = _mm_xor_si128(_mm_set1_epi64x(
+			            (int64_t)pred->vals[k]), bias);
+		}
+		for(; p+2<=n; p+=2) {
+			char *b = base+(size_t)p*recsz;
+			LOAD(int64_t, b, v0);
+			LOAD(int64_t, b+recsz, v1);
+			__m128i x = _mm_xor_si128(_mm_set_epi64x(v1, v0),
+			                                            bias);
+			uint64_t m = _mm_movemask_pd(_mm_castsi128_pd(
+			                         sseipred(pred, c, x)));
+			map[p>>6] |= m << (p&63);
+		}
+	}
+	matchScalarFrom(pred, page, recsz, p, n, map);
+}
+
+#endif
+
+/* ------------------------------------------------------------------------
+ * Helper: kernel for level
+ * ------------------------------------------------------------------------
+ */
+static matchfun_t kernel(int level) {
+#ifdef NOWDB_SIMD_X86
+	switch(level) {
+	case NOWDB_SIMD_AVX2: return &matchAVX2;
+	case NOWDB_SIMD_SSE42: return &matchSSE42;
+	}
+#endif
+	return &matchScalar;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: detect what the CPU supports (cpuid)
+ * ------------------------------------------------------------------------
+ */
+static void detect() {
+#ifdef NOWDB_SIMD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		_supported = NOWDB_SIMD_AVX2;
+	} else if (__builtin_cpu_supports("sse4.2")) {
+		_supported = NOWDB_SIMD_SSE42;
+	}
+#endif
+	_level = _supported;
+	_match = kernel(_level);
+}
+
+/* ------------------------------------------------------------------------
+ * Best implementation supported by this CPU
+ * ------------------------------------------------------------------------
+ */
+int nowdb_simd_supported() {
+	pthread_once(&_once, &detect);
+	return _supported;
+}
+
+/* ------------------------------------------------------------------------
+ * Implementation currently in use
+ * ------------------------------------------------------------------------
+ */
+int nowdb_simd_level() {
+	pthread_once(&_once, &detect);
+	return _level;
+}
+
+/* ------------------------------------------------------------------------
+ * Use another implementation
+ * ------------------------------------------------------------------------
+ */
+void nowdb_simd_setLevel(int level) {
+	pthread_once(&_once, &detect);
+	if (level > _supported) level = _supported;
+	if (level < NOWDB_SIMD_SCALAR) level = NOWDB_SIMD_SCALAR;
+	_level = level;
+	_match = kernel(_level);
+}
+
+/* ------------------------------------------------------------------------
+ * Match the first n records in the page
+ * ------------------------------------------------------------------------
+ */
+void nowdb_simd_match(const nowdb_simd_pred_t *pred,
+                      char                    *page,
+                      uint32_t                recsz,
+                      uint32_t                    n,
+                      uint64_t                 *map) {
+	pthread_once(&_once, &detect);
+	_match(pred, page, recsz, n, map);
+}
@@ -0,0 +1,114 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * SIMD kernels: compare one field of all records in a page
+ * ========================================================================
+ * Records in a page have a fixed size and fixed-size fields
+ * are 8 bytes at a fixed offset. The kernels load that field
+ * from n consecutive records with strided loads (gathers in AVX2),
+ * compare it against one or more constants and produce a bitmap
+ * with one bit per record.
+ *
+ * The implementation (AVX2, SSE4.2 or plain C) is chosen
+ * at runtime according to what the CPU supports.
+ *
+ * The kernels know nothing about NULL.
+ * The caller has to mask out NULL values.
+ * ========================================================================
+ */
+#ifndef nowdb_simd_decl
+#define nowdb_simd_decl
+
+#include <nowdb/types/types.h>
+#include <nowdb/fun/expr.h>
+
+#include <stdint.h>
+
+/* ------------------------------------------------------------------------
+ * Implementations
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_SIMD_SCALAR 0
+#define NOWDB_SIMD_SSE42  1
+#define NOWDB_SIMD_AVX2   2
+
+/* ------------------------------------------------------------------------
+ * Kernel functions in addition to the comparison operators
+ * (NOWDB_EXPR_OP_EQ, _NE, _LT, _GT, _LE and _GE)
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_SIMD_BETWEEN 1001 /* lo <(=) x <(=) hi */
+#define NOWDB_SIMD_IN      1002 /* x in (v1, v2, ...) */
+
+/* ------------------------------------------------------------------------
+ * Max number of values in 'in'
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_SIMD_MAXIN 8
+
+/* ------------------------------------------------------------------------
+ * Predicate
+ * ---------
+ * - comparison: x fun vals[0]
+ * - between:    x lofun vals[0] and x hifun vals[1],
+ *               lofun is GT or GE, hifun is LT or LE,
+ *               e.g. GE/LT: vals[0] <= x < vals[1]
+ * - in:         x = vals[0] or ... or x = vals[nvals-1],
+ *               if inv is set: not in
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	uint32_t              fun; /* comparison, between or in        */
+	uint32_t             type; /* UINT, INT or FLOAT               */
+	uint32_t              off; /* offset of the field              */
+	uint32_t            lofun; /* between: lower bound             */
+	uint32_t            hifun; /* between: upper bound             */
+	uint32_t            nvals; /* in: number of values             */
+	char                  inv; /* in: not in                       */
+	nowdb_value_t vals[NOWDB_SIMD_MAXIN]; /* the constants         */
+} nowdb_simd_pred_t;
+
+/* ------------------------------------------------------------------------
+ * Best implementation supported by this CPU
+ * ------------------------------------------------------------------------
+ */
+int nowdb_simd_supported();
+
+/* ------------------------------------------------------------------------
+ * Implementation currently in use
+ * ------------------------------------------------------------------------
+ */
+int nowdb_simd_level();
+
+/* ------------------------------------------------------------------------
+ * Use another implementation (for tests and benchmarks);
+ * levels not supported by the CPU are reduced to the supported one.
+ * Not thread-safe: call before starting to evaluate anything.
+ * ------------------------------------------------------------------------
+ */
+void nowdb_simd_setLevel(int level);
+
+/* ------------------------------------------------------------------------
+ * Match the first n records in the page
+ * -------------------------------------
+ * The bit of each matching record is set in map;
+ * other bits are not touched.
+ * ------------------------------------------------------------------------
+ */
+void nowdb_simd_match(const nowdb_simd_pred_t *pred,
+                      char                    *page,
+                      uint32_t                recsz,
+                      uint32_t                    n,
+                      uint64_t                 *map);
+
+/* ------------------------------------------------------------------------
+ * Match the records at the given positions (scalar)
+ * ------------------------------------------------------------------------
+ */
+void nowdb_simd_matchAt(const nowdb_simd_pred_t *pred,
+                        char                    *page,
+                        uint32_t                recsz,
+                        const uint16_t           *pos,
+                        uint32_t                count,
+                        uint64_t                 *map);
+#endif
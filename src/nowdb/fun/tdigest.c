@@ -0,0 +1,237 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * T-Digest: approximate quantiles in constant memory
+ * ========================================================================
+ */
+#include <nowdb/fun/tdigest.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static char *OBJECT = "tdigest";
+
+#define INVALID(s) \
+	return nowdb_err_get(nowdb_err_invalid, FALSE, OBJECT, s);
+
+#define NOMEM(s) \
+	err = nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT, s);
+
+/* ------------------------------------------------------------------------
+ * The merged centroids never exceed compression+2,
+ * the rest is buffer
+ * ------------------------------------------------------------------------
+ */
+#define MINCOMP 10
+#define BUFFACT  5
+
+/* ------------------------------------------------------------------------
+ * Allocate and initialise
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_tdigest_new(nowdb_tdigest_t **td, uint32_t compression) {
+	nowdb_err_t err;
+
+	if (td == NULL) INVALID("tdigest pointer is NULL");
+
+	*td = calloc(1, sizeof(nowdb_tdigest_t));
+	if (*td == NULL) {
+		NOMEM("allocating tdigest");
+		return err;
+	}
+	err = nowdb_tdigest_init(*td, compression);
+	if (err != NOWDB_OK) {
+		free(*td); *td = NULL;
+		return err;
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Initialise
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_tdigest_init(nowdb_tdigest_t *td, uint32_t compression) {
+	nowdb_err_t err;
+
+	if (td == NULL) INVALID("tdigest is NULL");
+	if (compression < MINCOMP) compression = MINCOMP;
+
+	td->compression = (double)compression;
+	td->cap = BUFFACT*compression;
+	td->cents = calloc(td->cap, sizeof(nowdb_centroid_t));
+	if (td->cents == NULL) {
+		NOMEM("allocating centroids");
+		return err;
+	}
+	nowdb_tdigest_reset(td);
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Destroy
+ * ------------------------------------------------------------------------
+ */
+void nowdb_tdigest_destroy(nowdb_tdigest_t *td) {
+	if (td == NULL) return;
+	if (td->cents != NULL) {
+		free(td->cents); td->cents = NULL;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Reset
+ * ------------------------------------------------------------------------
+ */
+void nowdb_tdigest_reset(nowdb_tdigest_t *td) {
+	td->n = 0;
+	td->nb = 0;
+	td->total = 0;
+	td->min = INFINITY;
+	td->max = -INFINITY;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: compare centroids by mean
+ * ------------------------------------------------------------------------
+ */
+static int compare(const void *one, const void *two) {
+	double m1 = ((nowdb_centroid_t*)one)->mean;
+	double m2 = ((nowdb_centroid_t*)two)->mean;
+	if (m1 < m2) return -1;
+	if (m1 > m2) return 1;
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: greatest quantile a centroid starting at q0 may reach,
+ *         i.e. k^-1(k(q0)+1)
+ * ------------------------------------------------------------------------
+ */
+static inline double qlimit(nowdb_tdigest_t *td, double q0) {
+	double k = td->compression/(2*M_PI) * asin(2*q0-1) + 1;
+	double a = 2*M_PI*k/td->compression;
+
+	if (a >= M_PI/2) return 1;
+	return (sin(a)+1)/2;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: sort and merge buffer and centroids
+ * ------------------------------------------------------------------------
+ */
+static void compress(nowdb_tdigest_t *td) {
+	nowdb_centroid_t *o, *c;
+	uint32_t m = td->n + td->nb;
+	double wsofar = 0;
+	double wlimit;
+
+	if (td->nb == 0) return;
+
+	qsort(td->cents, m, sizeof(nowdb_centroid_t), &compare);
+
+	o = td->cents;
+	wlimit = td->total*qlimit(td, 0);
+
+	for(uint32_t i=1; i<m; i++) {
+		c = td->cents+i;
+		if (wsofar + o->weight + c->weight <= wlimit) {
+			o->weight += c->weight;
+			o->mean += (c->mean - o->mean)*c->weight/o->weight;
+			continue;
+		}
+		wsofar += o->weight;
+		wlimit = td->total*qlimit(td, wsofar/td->total);
+		o++; *o = *c;
+	}
+	td->n = o - td->cents + 1;
+	td->nb = 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: add centroid
+ * ------------------------------------------------------------------------
+ */
+static inline void add(nowdb_tdigest_t *td, double x, double w) {
+	if (td->n + td->nb >= td->cap) compress(td);
+
+	td->cents[td->n+td->nb].mean = x;
+	td->cents[td->n+td->nb].weight = w;
+	td->nb++;
+	td->total += w;
+	if (x < td->min) td->min = x;
+	if (x > td->max) td->max = x;
+}
+
+/* ------------------------------------------------------------------------
+ * Add value
+ * ------------------------------------------------------------------------
+ */
+void nowdb_tdigest_add(nowdb_tdigest_t *td, double x) {
+	if (isnan(x)) return;
+	add(td, x, 1);
+}
+
+/* ------------------------------------------------------------------------
+ * Merge
+ * ------------------------------------------------------------------------
+ */
+void nowdb_tdigest_merge(nowdb_tdigest_t *trg, nowdb_tdigest_t *src) {
+	uint32_t m = src->n + src->nb;
+
+	for(uint32_t i=0; i<m; i++) {
+		add(trg, src->cents[i].mean, src->cents[i].weight);
+	}
+	if (src->min < trg->min) trg->min = src->min;
+	if (src->max > trg->max) trg->max = src->max;
+}
+
+/* ------------------------------------------------------------------------
+ * Count
+ * ------------------------------------------------------------------------
+ */
+uint64_t nowdb_tdigest_count(nowdb_tdigest_t *td) {
+	return (uint64_t)td->total;
+}
+
+/* ------------------------------------------------------------------------
+ * Quantile:
+ * we interpolate linearly between the centres of the centroids;
+ * before the first and after the last centre,
+ * we interpolate with min and max, respectively.
+ * ------------------------------------------------------------------------
+ */
+double nowdb_tdigest_quantile(nowdb_tdigest_t *td, double q) {
+	nowdb_centroid_t *c;
+	double idx, cum, nxt, r;
+
+	if (td->total == 0) return 0;
+
+	compress(td);
+
+	if (q <= 0) return td->min;
+	if (q >= 1) return td->max;
+	if (td->n == 1) return td->cents[0].mean;
+
+	c = td->cents;
+	idx = q*td->total;
+	cum = c[0].weight/2;
+
+	if (idx < cum) {
+		r = td->min + (c[0].mean - td->min)*idx/cum;
+		return r;
+	}
+	for(uint32_t i=0; i+1<td->n; i++) {
+		nxt = cum + (c[i].weight + c[i+1].weight)/2;
+		if (idx < nxt) {
+			r = c[i].mean + (c[i+1].mean - c[i].mean)*
+			                (idx - cum)/(nxt - cum);
+			return r;
+		}
+		cum = nxt;
+	}
+	c += td->n-1;
+	r = c->mean + (td->max - c->mean)*(idx - cum)/(c->weight/2);
+	return r > td->max ? td->max : r;
+}
@@ -0,0 +1,113 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * T-Digest: approximate quantiles in constant memory
+ * ========================================================================
+ * The digest summarises a stream of values by a bounded number
+ * of centroids (mean and weight). Values are added to a buffer;
+ * when the buffer is full, buffer and centroids are sorted
+ * and neighbouring centroids are merged as long as the merged
+ * centroid stays small according to the scale function
+ *
+ *       k(q) = compression/(2*pi) * asin(2q-1),
+ *
+ * i.e. a centroid covers at most one unit of k. Centroids near
+ * the tails (q close to 0 or 1) are therefore small and quantiles
+ * in the tails are more accurate than in the middle.
+ *
+ * There are at most 'compression' centroids, memory is fixed
+ * when the digest is created. Digests of the same compression
+ * can be merged, so partial aggregates can be combined.
+ * ========================================================================
+ */
+#ifndef nowdb_tdigest_decl
+#define nowdb_tdigest_decl
+
+#include <nowdb/types/types.h>
+#include <nowdb/types/error.h>
+
+#include <stdint.h>
+
+/* ------------------------------------------------------------------------
+ * Default compression
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_TDIGEST_COMPRESSION 100
+
+/* ------------------------------------------------------------------------
+ * Centroid
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	double mean;
+	double weight;
+} nowdb_centroid_t;
+
+/* ------------------------------------------------------------------------
+ * T-Digest
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	nowdb_centroid_t *cents; /* centroids followed by the buffer  */
+	uint32_t            cap; /* centroids + buffer                */
+	uint32_t              n; /* merged centroids                  */
+	uint32_t             nb; /* values in buffer                  */
+	double      compression; /* compression                       */
+	double            total; /* total weight                      */
+	double              min; /* smallest value                    */
+	double              max; /* greatest value                    */
+} nowdb_tdigest_t;
+
+/* ------------------------------------------------------------------------
+ * Allocate and initialise a new digest
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_tdigest_new(nowdb_tdigest_t **td, uint32_t compression);
+
+/* ------------------------------------------------------------------------
+ * Initialise an already allocated digest
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_tdigest_init(nowdb_tdigest_t *td, uint32_t compression);
+
+/* ------------------------------------------------------------------------
+ * Destroy digest
+ * ------------------------------------------------------------------------
+ */
+void nowdb_tdigest_destroy(nowdb_tdigest_t *td);
+
+/* ------------------------------------------------------------------------
+ * Forget all values
+ * ------------------------------------------------------------------------
+ */
+void nowdb_tdigest_reset(nowdb_tdigest_t *td);
+
+/* ------------------------------------------------------------------------
+ * Add one value (NaN is ignored)
+ * ------------------------------------------------------------------------
+ */
+void nowdb_tdigest_add(nowdb_tdigest_t *td, double x);
+
+/* ------------------------------------------------------------------------
+ * Merge
+ * -----
+ * Adds all values summarised in src to trg;
+ * src is left unchanged.
+ * ------------------------------------------------------------------------
+ */
+void nowdb_tdigest_merge(nowdb_tdigest_t *trg, nowdb_tdigest_t *src);
+
+/* ------------------------------------------------------------------------
+ * Number of values
+ * ------------------------------------------------------------------------
+ */
+uint64_t nowdb_tdigest_count(nowdb_tdigest_t *td);
+
+/* ------------------------------------------------------------------------
+ * Estimate the q-quantile (0 <= q <= 1);
+ * an empty digest returns 0.
+ * ------------------------------------------------------------------------
+ */
+double nowdb_tdigest_quantile(nowdb_tdigest_t *td, double q);
+
+#endif
@@ -0,0 +1,981 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Vectorised expressions: evaluate filters page by page
+ * ========================================================================
+ */
+#include <nowdb/fun/vexpr.h>
+
+#include <string.h>
+#include <stdlib.h>
+
+static char *OBJECT = "vexpr";
+
+#define NOMEM(s) \
+	err = nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT, s);
+
+#define INVALID(s) \
+	return nowdb_err_get(nowdb_err_invalid, FALSE, OBJECT, s);
+
+/* ------------------------------------------------------------------------
+ * Node kinds
+ * ------------------------------------------------------------------------
+ */
+#define VAND   1
+#define VOR    2
+#define VCMP   3
+#define VNULL  4
+#define VCONST 5
+#define VROW   6
+
+#define FIELD(x) \
+	NOWDB_EXPR_TOFIELD(x)
+
+#define CONST(x) \
+	NOWDB_EXPR_TOCONST(x)
+
+#define OP(x) \
+	NOWDB_EXPR_TOOP(x)
+
+/* ------------------------------------------------------------------------
+ * Bit of position p in map
+ * ------------------------------------------------------------------------
+ */
+#define BIT(map,p) \
+	((map[(p)>>6] >> ((p)&63)) & 1)
+
+/* ------------------------------------------------------------------------
+ * Helper: follow references
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_expr_t deref(nowdb_expr_t expr) {
+	while(nowdb_expr_type(expr) == NOWDB_EXPR_REF) {
+		expr = NOWDB_EXPR_TOREF(expr)->ref;
+	}
+	return expr;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: field may be NULL
+ * (same rules as getEdgeValue and getVertexValue in expr.c)
+ * ------------------------------------------------------------------------
+ */
+static inline char nullable(nowdb_field_t *field) {
+	if (field->content == NOWDB_CONT_EDGE) {
+		switch(field->off) {
+		case NOWDB_OFF_ORIGIN:
+		case NOWDB_OFF_DESTIN:
+		case NOWDB_OFF_STAMP: return 0;
+		default: return 1;
+		}
+	}
+	return (field->name != NULL);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: set offset and control bit of field
+ * ------------------------------------------------------------------------
+ */
+static inline void setField(nowdb_field_t *field, nowdb_vnode_t *node) {
+	node->pred.off = field->base+(uint32_t)field->off;
+	node->mask = 0;
+	if (nullable(field)) {
+		node->ctrl = field->base+
+		             nowdb_ctrlStart(field->num)+field->ctrlbyte;
+		node->mask = (uint8_t)(1 << field->ctrlbit);
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: type of the value the row evaluator would get from the field;
+ *         -1 if the field cannot be read as a fixed 8-byte value.
+ * ------------------------------------------------------------------------
+ */
+static inline int fieldType(nowdb_field_t *field) {
+	if (field->content == NOWDB_CONT_EDGE) {
+		switch(field->off) {
+		case NOWDB_OFF_ORIGIN:
+		case NOWDB_OFF_DESTIN:
+			if (field->type == NOWDB_TYP_TEXT &&
+			   !field->usekey) return -1;
+			return NOWDB_TYP_UINT;
+		case NOWDB_OFF_STAMP: return NOWDB_TYP_TIME;
+		}
+	}
+	switch(field->type) {
+	case NOWDB_TYP_TEXT:
+		if (field->usekey && nullable(field)) return NOWDB_TYP_UINT;
+		return -1;
+	case NOWDB_TYP_DATE:
+	case NOWDB_TYP_TIME:
+	case NOWDB_TYP_FLOAT:
+	case NOWDB_TYP_INT:
+	case NOWDB_TYP_UINT: return field->type;
+	default: return -1;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: integer type
+ * ------------------------------------------------------------------------
+ */
+static inline char isInt(int t) {
+	return (t == NOWDB_TYP_INT  ||
+	        t == NOWDB_TYP_TIME ||
+	        t == NOWDB_TYP_DATE);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: type in which the row evaluator compares
+ * (see correctNumTypes in expr.c)
+ * ------------------------------------------------------------------------
+ */
+static inline int commonType(int t0, int t1) {
+	if (t0 == t1) return t0;
+	if (t0 != NOWDB_TYP_FLOAT && t1 == NOWDB_TYP_FLOAT) {
+		return NOWDB_TYP_FLOAT;
+	}
+	if (t0 == NOWDB_TYP_UINT && isInt(t1)) return t1;
+	return t0;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: mirror operator (a < b <=> b > a)
+ * ------------------------------------------------------------------------
+ */
+static inline uint32_t mirror(uint32_t fun) {
+	switch(fun) {
+	case NOWDB_EXPR_OP_LT: return NOWDB_EXPR_OP_GT;
+	case NOWDB_EXPR_OP_GT: return NOWDB_EXPR_OP_LT;
+	case NOWDB_EXPR_OP_LE: return NOWDB_EXPR_OP_GE;
+	case NOWDB_EXPR_OP_GE: return NOWDB_EXPR_OP_LE;
+	default: return fun;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: invert operator (not a < b <=> a >= b)
+ * ------------------------------------------------------------------------
+ */
+static inline uint32_t invert(uint32_t fun) {
+	switch(fun) {
+	case NOWDB_EXPR_OP_EQ: return NOWDB_EXPR_OP_NE;
+	case NOWDB_EXPR_OP_NE: return NOWDB_EXPR_OP_EQ;
+	case NOWDB_EXPR_OP_LT: return NOWDB_EXPR_OP_GE;
+	case NOWDB_EXPR_OP_GE: return NOWDB_EXPR_OP_LT;
+	case NOWDB_EXPR_OP_GT: return NOWDB_EXPR_OP_LE;
+	case NOWDB_EXPR_OP_LE: return NOWDB_EXPR_OP_GT;
+	default: return fun;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Try to compile comparison field/constant
+ * ------------------------------------------------------------------------
+ */
+static char compileCompare(nowdb_op_t    *op,
+                           char          neg,
+                           nowdb_vnode_t *node) {
+	nowdb_expr_t a0, a1;
+	nowdb_field_t *f;
+	nowdb_const_t *c;
+	char swap = 0;
+	int ft, t;
+
+	if (op->args != 2) return 0;
+
+	a0 = deref(op->argv[0]);
+	a1 = deref(op->argv[1]);
+
+	if (nowdb_expr_type(a0) == NOWDB_EXPR_FIELD &&
+	    nowdb_expr_type(a1) == NOWDB_EXPR_CONST) {
+		f = FIELD(a0); c = CONST(a1);
+	} else if (nowdb_expr_type(a0) == NOWDB_EXPR_CONST &&
+	           nowdb_expr_type(a1) == NOWDB_EXPR_FIELD) {
+		f = FIELD(a1); c = CONST(a0); swap = 1;
+	} else return 0;
+
+	if (f->off < 0) return 0;
+	if (c->value == NULL) return 0;
+
+	ft = fieldType(f);
+	if (ft < 0) return 0;
+
+	switch(c->type) {
+	case NOWDB_TYP_DATE:
+	case NOWDB_TYP_TIME:
+	case NOWDB_TYP_FLOAT:
+	case NOWDB_TYP_INT:
+	case NOWDB_TYP_UINT: break;
+	default: return 0;
+	}
+
+	t = swap?commonType(c->type, ft):commonType(ft, c->type);
+
+	if (t == NOWDB_TYP_FLOAT) {
+		double d;
+		if (ft != NOWDB_TYP_FLOAT) return 0;
+		if (c->type == NOWDB_TYP_FLOAT) {
+			memcpy(&d, c->value, 8);
+		} else if (c->type == NOWDB_TYP_UINT) {
+			d = (double)(*(uint64_t*)c->value);
+		} else {
+			d = (double)(*(int64_t*)c->value);
+		}
+		memcpy(node->pred.vals, &d, 8);
+		node->pred.type = NOWDB_TYP_FLOAT;
+
+	} else if (isInt(t)) {
+		if (ft == NOWDB_TYP_FLOAT) return 0;
+		if (c->type == NOWDB_TYP_FLOAT) return 0;
+		memcpy(node->pred.vals, c->value, 8);
+		node->pred.type = NOWDB_TYP_INT;
+
+	} else if (t == NOWDB_TYP_UINT) {
+		if (ft != NOWDB_TYP_UINT) return 0;
+		if (c->type != NOWDB_TYP_UINT) return 0;
+		memcpy(node->pred.vals, c->value, 8);
+		node->pred.type = NOWDB_TYP_UINT;
+
+	} else return 0;
+
+	node->kind = VCMP;
+	node->pred.fun = swap?mirror(op->fun):op->fun;
+	if (neg) node->pred.fun = invert(node->pred.fun);
+	setField(f, node);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * Try to compile 'in' with a small set of constants
+ * ------------------------------------------------------------------------
+ */
+static char compileIn(nowdb_op_t    *op,
+                      char          neg,
+                      nowdb_vnode_t *node) {
+	ts_algo_list_t *vals;
+	ts_algo_list_node_t *run;
+	nowdb_expr_t a0, a1;
+	nowdb_field_t *f;
+	nowdb_const_t *c;
+	uint32_t k=0;
+	int ft;
+
+	if (op->args != 2) return 0;
+
+	a0 = deref(op->argv[0]);
+	a1 = deref(op->argv[1]);
+
+	if (nowdb_expr_type(a0) != NOWDB_EXPR_FIELD ||
+	    nowdb_expr_type(a1) != NOWDB_EXPR_CONST) return 0;
+
+	f = FIELD(a0); c = CONST(a1);
+
+	if (f->off < 0) return 0;
+	if (c->tree == NULL) return 0;
+	if (c->tree->count > NOWDB_SIMD_MAXIN) return 0;
+
+	ft = fieldType(f);
+	if (ft < 0) return 0;
+
+	// the tree compares the raw value of the field,
+	// for integers that is the same as comparing bits
+	switch(c->type) {
+	case NOWDB_TYP_FLOAT:
+		if (ft != NOWDB_TYP_FLOAT) return 0;
+		node->pred.type = NOWDB_TYP_FLOAT; break;
+
+	case NOWDB_TYP_DATE:
+	case NOWDB_TYP_TIME:
+	case NOWDB_TYP_INT:
+	case NOWDB_TYP_UINT:
+		if (ft == NOWDB_TYP_FLOAT) return 0;
+		node->pred.type = NOWDB_TYP_UINT; break;
+
+	default: return 0;
+	}
+
+	vals = ts_algo_tree_toList(c->tree);
+	if (vals == NULL) return 0;
+	for(run=vals->head; run!=NULL && k<NOWDB_SIMD_MAXIN; run=run->nxt) {
+		memcpy(node->pred.vals+k, run->cont, 8); k++;
+	}
+	ts_algo_list_destroy(vals); free(vals);
+
+	node->kind = VCMP;
+	node->pred.fun = NOWDB_SIMD_IN;
+	node->pred.nvals = k;
+	node->pred.inv = neg;
+	setField(f, node);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * Try to compile null test on field
+ * ------------------------------------------------------------------------
+ */
+static char compileNull(nowdb_op_t    *op,
+                        char          neg,
+                        nowdb_vnode_t *node) {
+	nowdb_expr_t a0;
+	char isnull;
+
+	if (op->args != 1) return 0;
+
+	a0 = deref(op->argv[0]);
+	if (nowdb_expr_type(a0) != NOWDB_EXPR_FIELD) return 0;
+	if (FIELD(a0)->off < 0) return 0;
+
+	isnull = (op->fun == NOWDB_EXPR_OP_IS);
+	if (neg) isnull = !isnull;
+
+	// never NULL
+	if (!nullable(FIELD(a0))) {
+		node->kind = VCONST;
+		node->val = !isnull;
+		return 1;
+	}
+	node->kind = VNULL;
+	node->fun = isnull?NOWDB_EXPR_OP_IS:NOWDB_EXPR_OP_ISN;
+	setField(FIELD(a0), node);
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * Compile (predeclaration)
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t compile(nowdb_vexpr_t  *vx,
+                           nowdb_expr_t  expr,
+                           char           neg,
+                           nowdb_vnode_t **node);
+
+/* ------------------------------------------------------------------------
+ * Helper: allocate scratch bitmap
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t newMap(nowdb_vnode_t *node) {
+	nowdb_err_t err;
+
+	node->map = calloc(NOWDB_SEL_WORDS, sizeof(uint64_t));
+	if (node->map == NULL) {
+		NOMEM("allocating bitmap");
+		return err;
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Destroy node
+ * ------------------------------------------------------------------------
+ */
+static void destroyNode(nowdb_vnode_t *node) {
+	if (node == NULL) return;
+	if (node->argv != NULL) {
+		for(int i=0; i<node->args; i++) {
+			if (node->argv[i] != NULL) {
+				destroyNode(node->argv[i]);
+				free(node->argv[i]);
+			}
+		}
+		free(node->argv); node->argv = NULL;
+	}
+	if (node->sel != NULL) {
+		free(node->sel); node->sel = NULL;
+	}
+	if (node->map != NULL) {
+		free(node->map); node->map = NULL;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: kind of and/or after pushing down 'not'
+ * ------------------------------------------------------------------------
+ */
+static inline uint32_t logicKind(nowdb_op_t *op, char neg) {
+	return (op->fun == NOWDB_EXPR_OP_AND) != (neg != 0)?VAND:VOR;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: compile the operands of and/or;
+ *         operands of the same kind are flattened,
+ *         i.e. a and (b and c) becomes and(a, b, c)
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t collect(nowdb_vexpr_t  *vx,
+                           nowdb_op_t     *op,
+                           char           neg,
+                           uint32_t      kind,
+                           ts_algo_list_t *ops) {
+	nowdb_err_t err;
+	nowdb_vnode_t *node;
+	nowdb_expr_t arg;
+	char n;
+
+	for(int i=0; i<op->args; i++) {
+		arg = deref(op->argv[i]); n = neg;
+		while(nowdb_expr_type(arg) == NOWDB_EXPR_OP &&
+		      OP(arg)->fun == NOWDB_EXPR_OP_NOT &&
+		      OP(arg)->args == 1) {
+			arg = deref(OP(arg)->argv[0]); n = !n;
+		}
+		if (nowdb_expr_type(arg) == NOWDB_EXPR_OP &&
+		   (OP(arg)->fun == NOWDB_EXPR_OP_AND ||
+		    OP(arg)->fun == NOWDB_EXPR_OP_OR) &&
+		    logicKind(OP(arg), n) == kind) {
+			err = collect(vx, OP(arg), n, kind, ops);
+			if (err != NOWDB_OK) return err;
+			continue;
+		}
+		err = compile(vx, arg, n, &node);
+		if (err != NOWDB_OK) return err;
+		if (ts_algo_list_append(ops, node) != TS_ALGO_OK) {
+			destroyNode(node); free(node);
+			NOMEM("list.append");
+			return err;
+		}
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: evaluation order of operands (cheap ones first)
+ * ------------------------------------------------------------------------
+ */
+static inline int rank(nowdb_vnode_t *node) {
+	switch(node->kind) {
+	case VCONST: return 0;
+	case VNULL: return 1;
+	case VCMP: return 2;
+	case VAND:
+	case VOR: return 3;
+	default: return 4;
+	}
+}
+
+#define MAXRANK 4
+
+/* ------------------------------------------------------------------------
+ * Helper: comparison with lower or upper bound
+ * ------------------------------------------------------------------------
+ */
+static inline char isBound(nowdb_vnode_t *node) {
+	if (node->kind != VCMP) return 0;
+	switch(node->pred.fun) {
+	case NOWDB_EXPR_OP_LT:
+	case NOWDB_EXPR_OP_LE:
+	case NOWDB_EXPR_OP_GT:
+	case NOWDB_EXPR_OP_GE: return 1;
+	default: return 0;
+	}
+}
+
+static inline char isLower(nowdb_vnode_t *node) {
+	return (node->pred.fun == NOWDB_EXPR_OP_GT ||
+	        node->pred.fun == NOWDB_EXPR_OP_GE);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: fuse lower and upper bound on the same field
+ *         (f >= a and f < b) into one 'between'
+ * ------------------------------------------------------------------------
+ */
+static void fuse(nowdb_vnode_t *node) {
+	nowdb_vnode_t *a, *b, *lo, *hi;
+	uint32_t k=0;
+
+	for(int i=0; i<node->args; i++) {
+		a = node->argv[i];
+		if (a == NULL || !isBound(a)) continue;
+		for(int j=i+1; j<node->args; j++) {
+			b = node->argv[j];
+			if (b == NULL || !isBound(b)) continue;
+			if (a->pred.off  != b->pred.off  ||
+			    a->pred.type != b->pred.type ||
+			    a->mask      != b->mask      ||
+			    a->ctrl      != b->ctrl) continue;
+			if (isLower(a) == isLower(b)) continue;
+
+			lo = isLower(a)?a:b;
+			hi = isLower(a)?b:a;
+
+			a->pred.lofun = lo->pred.fun;
+			a->pred.hifun = hi->pred.fun;
+			a->pred.vals[0] = lo->pred.vals[0];
+			a->pred.vals[1] = hi->pred.vals[0];
+			a->pred.fun = NOWDB_SIMD_BETWEEN;
+
+			destroyNode(b); free(b);
+			node->argv[j] = NULL;
+			break;
+		}
+	}
+	for(int i=0; i<node->args; i++) {
+		if (node->argv[i] != NULL) node->argv[k++] = node->argv[i];
+	}
+	node->args = k;
+}
+
+/* ------------------------------------------------------------------------
+ * Compile and/or
+ * 'not' is pushed down (not (a and b) = not a or not b)
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t compileLogic(nowdb_vexpr_t *vx,
+                                nowdb_op_t    *op,
+                                char          neg,
+                                nowdb_vnode_t *node) {
+	nowdb_err_t err;
+	ts_algo_list_t ops;
+	ts_algo_list_node_t *run;
+	uint32_t k=0;
+
+	node->kind = logicKind(op, neg);
+
+	node->sel = calloc(1, sizeof(nowdb_sel_t));
+	if (node->sel == NULL) {
+		NOMEM("allocating selection");
+		return err;
+	}
+	if (node->kind == VOR) {
+		node->map = calloc(NOWDB_SEL_WORDS, sizeof(uint64_t));
+		if (node->map == NULL) {
+			NOMEM("allocating bitmap");
+			return err;
+		}
+	}
+
+	ts_algo_list_init(&ops);
+	err = collect(vx, op, neg, node->kind, &ops);
+	if (err != NOWDB_OK) goto cleanup;
+
+	node->argv = calloc(ops.len, sizeof(nowdb_vnode_t*));
+	if (node->argv == NULL) {
+		NOMEM("allocating operands");
+		goto cleanup;
+	}
+
+	// order by rank (stable)
+	for(int r=0; r<=MAXRANK; r++) {
+		for(run=ops.head; run!=NULL; run=run->nxt) {
+			if (rank(run->cont) == r) node->argv[k++] = run->cont;
+		}
+	}
+	node->args = k;
+	ts_algo_list_destroy(&ops);
+
+	if (node->kind == VAND) fuse(node);
+	return NOWDB_OK;
+
+cleanup:
+	for(run=ops.head; run!=NULL; run=run->nxt) {
+		destroyNode(run->cont); free(run->cont);
+	}
+	ts_algo_list_destroy(&ops);
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Compile
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t compile(nowdb_vexpr_t  *vx,
+                           nowdb_expr_t  expr,
+                           char           neg,
+                           nowdb_vnode_t **node) {
+	nowdb_err_t err;
+
+	expr = deref(expr);
+
+	// not: push down
+	if (nowdb_expr_type(expr) == NOWDB_EXPR_OP &&
+	    OP(expr)->fun == NOWDB_EXPR_OP_NOT &&
+	    OP(expr)->args == 1) {
+		return compile(vx, OP(expr)->argv[0], !neg, node);
+	}
+
+	*node = calloc(1, sizeof(nowdb_vnode_t));
+	if (*node == NULL) {
+		NOMEM("allocating vector node");
+		return err;
+	}
+
+	if (nowdb_expr_type(expr) == NOWDB_EXPR_OP) {
+		switch(OP(expr)->fun) {
+		case NOWDB_EXPR_OP_AND:
+		case NOWDB_EXPR_OP_OR:
+			return compileLogic(vx, OP(expr), neg, *node);
+
+		case NOWDB_EXPR_OP_EQ:
+		case NOWDB_EXPR_OP_NE:
+		case NOWDB_EXPR_OP_LT:
+		case NOWDB_EXPR_OP_GT:
+		case NOWDB_EXPR_OP_LE:
+		case NOWDB_EXPR_OP_GE:
+			if (compileCompare(OP(expr), neg, *node)) {
+				return newMap(*node);
+			}
+			break;
+
+		case NOWDB_EXPR_OP_IN:
+			if (compileIn(OP(expr), neg, *node)) {
+				return newMap(*node);
+			}
+			break;
+
+		case NOWDB_EXPR_OP_IS:
+		case NOWDB_EXPR_OP_ISN:
+			if (compileNull(OP(expr), neg, *node)) {
+				return NOWDB_OK;
+			}
+			break;
+
+		case NOWDB_EXPR_OP_TRUE:
+		case NOWDB_EXPR_OP_FALSE:
+			(*node)->kind = VCONST;
+			(*node)->val = (OP(expr)->fun ==
+			                NOWDB_EXPR_OP_TRUE) != (neg != 0);
+			return NOWDB_OK;
+
+		default: break;
+		}
+	}
+
+	// everything else is evaluated row by row
+	(*node)->kind = VROW;
+	(*node)->expr = expr;
+	(*node)->neg  = neg;
+	vx->fallbacks++;
+
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Allocate and compile
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_vexpr_new(nowdb_vexpr_t **vx,
+                            nowdb_expr_t  expr,
+                            nowdb_eval_t *eval) {
+	nowdb_err_t err;
+
+	if (vx == NULL) INVALID("vexpr pointer is NULL");
+	if (expr == NULL) INVALID("no expression");
+
+	*vx = calloc(1, sizeof(nowdb_vexpr_t));
+	if (*vx == NULL) {
+		NOMEM("allocating vexpr");
+		return err;
+	}
+
+	(*vx)->expr = expr;
+	(*vx)->eval = eval;
+
+	err = compile(*vx, expr, 0, &(*vx)->root);
+	if (err != NOWDB_OK) {
+		nowdb_vexpr_destroy(*vx);
+		free(*vx); *vx = NULL;
+		return err;
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Destroy
+ * ------------------------------------------------------------------------
+ */
+void nowdb_vexpr_destroy(nowdb_vexpr_t *vx) {
+	if (vx == NULL) return;
+	if (vx->root != NULL) {
+		destroyNode(vx->root);
+		free(vx->root); vx->root = NULL;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: number of records before the first null record.
+ * Pages are filled from the start, null records are found
+ * only at the end. For full pages, one comparison suffices;
+ * otherwise we search the boundary.
+ * ------------------------------------------------------------------------
+ */
+static inline uint32_t liveRecords(char    *page,
+                                   uint32_t    n,
+                                   uint32_t recsz) {
+	uint32_t lo=0, hi, m;
+
+	if (n == 0) return 0;
+	if (memcmp(page+(n-1)*recsz, nowdb_nullrec, recsz) != 0) return n;
+
+	hi = n-1;
+	while(lo < hi) {
+		m = lo+(hi-lo)/2;
+		if (memcmp(page+m*recsz, nowdb_nullrec, recsz) == 0) hi = m;
+		else lo = m+1;
+	}
+	return lo;
+}
+
+/* ------------------------------------------------------------------------
+ * Initialise selection from page
+ * ------------------------------------------------------------------------
+ */
+void nowdb_sel_fromPage(nowdb_sel_t     *sel,
+                        char            *page,
+                        uint32_t         size,
+                        uint32_t        recsz,
+                        nowdb_bitmap8_t *cont) {
+	uint32_t n = size/recsz;
+	uint32_t bytes, k=0;
+	uint64_t m;
+
+	if (n > NOWDB_SEL_MAX) n = NOWDB_SEL_MAX;
+
+	n = liveRecords(page, n, recsz);
+
+	if (cont == NULL) {
+		for(uint32_t p=0; p<n; p++) sel->pos[p] = (uint16_t)p;
+		sel->count = n;
+		return;
+	}
+
+	// visit the content bitmap word by word
+	// and jump directly to the marked records
+	// (bytes are read as little-endian words)
+	bytes = (n+7)/8;
+	for(uint32_t w=0; w*8<bytes; w++) {
+		m = 0;
+		memcpy(&m, cont+w*8, bytes-w*8 < 8 ? bytes-w*8 : 8);
+		if ((w+1)*64 > n) m &= (1lu << (n%64)) - 1;
+		while(m != 0) {
+			sel->pos[k++] = (uint16_t)(w*64 + __builtin_ctzll(m));
+			m &= m-1;
+		}
+	}
+	sel->count = k;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: bitmap to selection
+ * ------------------------------------------------------------------------
+ */
+static inline void toSel(uint64_t *map, nowdb_sel_t *sel) {
+	uint32_t k=0;
+	for(uint32_t w=0; w<NOWDB_SEL_WORDS; w++) {
+		uint64_t m = map[w];
+		while(m != 0) {
+			sel->pos[k++] = (uint16_t)(w*64 + __builtin_ctzll(m));
+			m &= m-1;
+		}
+	}
+	sel->count = k;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: selected records not in bitmap
+ * ------------------------------------------------------------------------
+ */
+static inline void minus(nowdb_sel_t *sel,
+                         uint64_t    *map,
+                         nowdb_sel_t *res) {
+	uint32_t k=0;
+	for(uint32_t i=0; i<sel->count; i++) {
+		uint32_t p = sel->pos[i];
+		if (!BIT(map,p)) res->pos[k++] = (uint16_t)p;
+	}
+	res->count = k;
+}
+
+/* ------------------------------------------------------------------------
+ * The kernel runs on all records up to the last selected one,
+ * if at least 1 in DENSE is selected; otherwise only on the selected ones
+ * ------------------------------------------------------------------------
+ */
+#define DENSE 4
+
+/* ------------------------------------------------------------------------
+ * Compare field and constant(s)
+ * ------------------------------------------------------------------------
+ */
+static inline void compare(nowdb_vnode_t *node,
+                           char          *page,
+                           uint32_t      recsz,
+                           nowdb_sel_t    *sel,
+                           uint64_t       *map) {
+	uint32_t n, w;
+
+	if (sel->count == 0) return;
+
+	n = sel->pos[sel->count-1]+1;
+	if (sel->count*DENSE < n) {
+		nowdb_simd_matchAt(&node->pred, page, recsz,
+		                   sel->pos, sel->count, map);
+		if (node->mask == 0) return;
+	} else {
+		nowdb_simd_match(&node->pred, page, recsz, n, map);
+	}
+
+	// keep only selected records that are not NULL
+	w = (n+63)/64;
+	memset(node->map, 0, w*sizeof(uint64_t));
+	if (node->mask == 0) {
+		for(uint32_t i=0; i<sel->count; i++) {
+			uint32_t p = sel->pos[i];
+			node->map[p>>6] |= 1ull << (p&63);
+		}
+	} else {
+		for(uint32_t i=0; i<sel->count; i++) {
+			uint32_t p = sel->pos[i];
+			uint64_t x = ((page[p*recsz+node->ctrl] &
+			                          node->mask) != 0);
+			node->map[p>>6] |= x << (p&63);
+		}
+	}
+	for(uint32_t i=0; i<w; i++) map[i] &= node->map[i];
+}
+
+/* ------------------------------------------------------------------------
+ * Null test
+ * ------------------------------------------------------------------------
+ */
+static inline void nulltest(nowdb_vnode_t *node,
+                            char          *page,
+                            uint32_t      recsz,
+                            nowdb_sel_t    *sel,
+                            uint64_t       *map) {
+	uint64_t isnull = (node->fun == NOWDB_EXPR_OP_IS);
+	for(uint32_t i=0; i<sel->count; i++) {
+		uint32_t p = sel->pos[i];
+		uint64_t x = ((page[p*recsz+node->ctrl] & node->mask) == 0);
+		map[p>>6] |= (uint64_t)(x == isnull) << (p&63);
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Constant
+ * ------------------------------------------------------------------------
+ */
+static inline void constant(nowdb_vnode_t *node,
+                            nowdb_sel_t    *sel,
+                            uint64_t       *map) {
+	if (!node->val) return;
+	for(uint32_t i=0; i<sel->count; i++) {
+		uint32_t p = sel->pos[i];
+		map[p>>6] |= 1ull << (p&63);
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Row-at-a-time fallback
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t roweval(nowdb_vexpr_t   *vx,
+                                  nowdb_vnode_t *node,
+                                  char          *page,
+                                  uint32_t      recsz,
+                                  nowdb_sel_t    *sel,
+                                  uint64_t       *map) {
+	nowdb_err_t err;
+	nowdb_type_t t;
+	void *v;
+	char x;
+
+	for(uint32_t i=0; i<sel->count; i++) {
+		uint32_t p = sel->pos[i];
+		v = NULL;
+		err = nowdb_expr_eval(node->expr, vx->eval,
+		                      page+p*recsz, &t, &v);
+		if (err != NOWDB_OK) return err;
+		if (t == NOWDB_TYP_NOTHING) continue;
+		if (t == NOWDB_TYP_TEXT) {
+			x = (v != NULL && *(char*)v != 0);
+		} else {
+			x = (*(nowdb_value_t*)v != 0);
+		}
+		if (x != node->neg) map[p>>6] |= 1ull << (p&63);
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Evaluate node on selection, result is written to map
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t run(nowdb_vexpr_t   *vx,
+                       nowdb_vnode_t *node,
+                       char          *page,
+                       uint32_t      recsz,
+                       nowdb_sel_t    *sel,
+                       uint64_t       *map) {
+	nowdb_err_t err;
+
+	memset(map, 0, NOWDB_SEL_WORDS*sizeof(uint64_t));
+
+	switch(node->kind) {
+	case VCMP:
+		compare(node, page, recsz, sel, map);
+		return NOWDB_OK;
+
+	case VNULL:
+		nulltest(node, page, recsz, sel, map);
+		return NOWDB_OK;
+
+	case VCONST:
+		constant(node, sel, map);
+		return NOWDB_OK;
+
+	case VROW:
+		return roweval(vx, node, page, recsz, sel, map);
+
+	// the next operand sees only what passed
+	case VAND:
+		err = run(vx, node->argv[0], page, recsz, sel, map);
+		if (err != NOWDB_OK) return err;
+		for(int i=1; i<node->args; i++) {
+			toSel(map, node->sel);
+			if (node->sel->count == 0) break;
+			err = run(vx, node->argv[i], page, recsz,
+			                          node->sel, map);
+			if (err != NOWDB_OK) return err;
+		}
+		return NOWDB_OK;
+
+	// the next operand sees only what did not pass
+	case VOR:
+		err = run(vx, node->argv[0], page, recsz, sel, map);
+		if (err != NOWDB_OK) return err;
+		for(int i=1; i<node->args; i++) {
+			minus(sel, map, node->sel);
+			if (node->sel->count == 0) break;
+			err = run(vx, node->argv[i], page, recsz,
+			                     node->sel, node->map);
+			if (err != NOWDB_OK) return err;
+			for(int w=0; w<NOWDB_SEL_WORDS; w++) {
+				map[w] |= node->map[w];
+			}
+		}
+		return NOWDB_OK;
+
+	default:
+		INVALID("unknown vector node");
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Apply vectorised expression to page
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_vexpr_select(nowdb_vexpr_t *vx,
+                               char        *page,
+                               uint32_t    recsz,
+                               nowdb_sel_t   *sel) {
+	nowdb_err_t err;
+
+	if (sel->count == 0) return NOWDB_OK;
+
+	err = run(vx, vx->root, page, recsz, sel, vx->map);
+	if (err != NOWDB_OK) return err;
+
+	toSel(vx->map, sel);
+	return NOWDB_OK;
+}
@@ -0,0 +1,137 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Vectorised expressions: evaluate filters page by page
+ * ========================================================================
+ * A filter is compiled once into a tree of vector nodes.
+ * The tree is then evaluated over all selected records of a page
+ * at once (instead of record by record):
+ *
+ * - comparisons between a fixed-size field and a constant
+ *   and 'in' with a small set of constants are evaluated
+ *   by SIMD kernels (see simd.h) producing a bitmap
+ *   of the records that pass;
+ * - and/or combine the bitmaps of their operands,
+ *   and evaluates the second operand only on the records
+ *   that passed (or did not pass) the first one;
+ * - nested and/or of the same kind are flattened,
+ *   lower and upper bound on the same field
+ *   are fused into one 'between' kernel and
+ *   kernels are evaluated before everything else;
+ * - 'not' is pushed down to the leaves at compile time;
+ * - everything else (text, functions, large 'in', etc.)
+ *   falls back to row-at-a-time evaluation (nowdb_expr_eval)
+ *   on the records selected so far.
+ *
+ * The semantics are those of the cursor:
+ * a record passes, if the filter evaluates to something
+ * that is neither NULL, nor false, nor the empty string.
+ * ========================================================================
+ */
+#ifndef nowdb_vexpr_decl
+#define nowdb_vexpr_decl
+
+#include <nowdb/types/types.h>
+#include <nowdb/types/error.h>
+#include <nowdb/fun/expr.h>
+#include <nowdb/fun/simd.h>
+
+#include <stdint.h>
+
+/* ------------------------------------------------------------------------
+ * Max number of records in a page (the smallest record has 8 bytes)
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_SEL_MAX (NOWDB_IDX_PAGE/8)
+
+/* ------------------------------------------------------------------------
+ * Number of words in a selection bitmap
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_SEL_WORDS (NOWDB_SEL_MAX/64)
+
+/* ------------------------------------------------------------------------
+ * Selection vector:
+ * the positions (not offsets!) of the selected records
+ * in ascending order
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	uint32_t             count; /* number of selected records  */
+	uint16_t pos[NOWDB_SEL_MAX]; /* positions in the page       */
+} nowdb_sel_t;
+
+/* ------------------------------------------------------------------------
+ * Vector node
+ * ------------------------------------------------------------------------
+ */
+typedef struct nowdb_vnode_s {
+	uint32_t             kind; /* and, or, compare, null or row    */
+	uint32_t              fun; /* null: is or is not null         */
+	uint32_t             ctrl; /* offset of the control byte       */
+	uint8_t              mask; /* control bit (0: not nullable)    */
+	char                  neg; /* row: select if false             */
+	nowdb_value_t         val; /* constant: true or false          */
+	nowdb_simd_pred_t    pred; /* compare: the kernel predicate    */
+	nowdb_expr_t         expr; /* row: the expression to evaluate  */
+	uint32_t             args; /* number of operands (and/or)      */
+	struct nowdb_vnode_s **argv; /* the operands (and/or)          */
+	nowdb_sel_t          *sel; /* scratch selection (and/or)       */
+	uint64_t            *map; /* scratch bitmap (compare/or)      */
+} nowdb_vnode_t;
+
+/* ------------------------------------------------------------------------
+ * Vectorised expression
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	nowdb_expr_t         expr; /* the source expression            */
+	nowdb_eval_t        *eval; /* evaluation helper (row fallback) */
+	nowdb_vnode_t       *root; /* the compiled tree                */
+	uint32_t        fallbacks; /* number of row nodes              */
+	uint64_t map[NOWDB_SEL_WORDS]; /* result bitmap                */
+} nowdb_vexpr_t;
+
+/* ------------------------------------------------------------------------
+ * Compile expression
+ * ------------------
+ * The expression is not copied and remains in the ownership
+ * of the caller. It must not be destroyed before the
+ * vectorised expression.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_vexpr_new(nowdb_vexpr_t **vx,
+                            nowdb_expr_t  expr,
+                            nowdb_eval_t *eval);
+
+/* ------------------------------------------------------------------------
+ * Destroy vectorised expression
+ * ------------------------------------------------------------------------
+ */
+void nowdb_vexpr_destroy(nowdb_vexpr_t *vx);
+
+/* ------------------------------------------------------------------------
+ * Initialise selection from page
+ * ------------------------------
+ * All records up to 'size' bytes or up to the first null record
+ * that are marked in 'cont' (if cont is not NULL) are selected.
+ * ------------------------------------------------------------------------
+ */
+void nowdb_sel_fromPage(nowdb_sel_t     *sel,
+                        char            *page,
+                        uint32_t         size,
+                        uint32_t        recsz,
+                        nowdb_bitmap8_t *cont);
+
+/* ------------------------------------------------------------------------
+ * Apply vectorised expression to page
+ * -----------------------------------
+ * The selection is reduced to the records for which
+ * the expression holds.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_vexpr_select(nowdb_vexpr_t *vx,
+                               char        *page,
+                               uint32_t    recsz,
+                               nowdb_sel_t   *sel);
+#endif
@@ -1212,6 +1212,7 @@ static int openCursor(nowdb_session_t *ses, nowdb_cursor_t *cur) {
 	nowdb_ses_cursor_t *scur;
 
 	// open nowdb cursor
+	nowdb_cursor_setParallel(cur, ses->opt.dop);
 	err = nowdb_cursor_open(cur);
 	if (err != NOWDB_OK) {
 		if (err->errcode == nowdb_err_eof) {
@@ -1334,6 +1335,41 @@ static int fetch(nowdb_session_t    *ses,
 	return 0;
 }
 
+/* -----------------------------------------------------------------------
+ * set session option
+ * -----------------------------------------------------------------------
+ */
+static int setOption(nowdb_session_t *ses, nowdb_ast_t *ast) {
+	nowdb_err_t err;
+	uint64_t n;
+	char *tmp;
+
+	n = strtoul(ast->value, &tmp, 10);
+	if (*tmp != 0) {
+		err = nowdb_err_get(nowdb_err_invalid,
+		  FALSE, OBJECT, "not a valid number");
+		if (sendErr(ses, err, NULL) != 0) return -1;
+		return 0;
+	}
+	switch(ast->stype) {
+	case NOWDB_AST_PARALLEL:
+		if (n == 0 || n > NOWDB_PSCAN_MAXDOP) {
+			err = nowdb_err_get(nowdb_err_invalid, FALSE,
+			            OBJECT, "parallel out of range");
+			if (sendErr(ses, err, NULL) != 0) return -1;
+			return 0;
+		}
+		ses->opt.dop = (uint32_t)n;
+		return sendOK(ses);
+
+	default:
+		err = nowdb_err_get(nowdb_err_invalid, FALSE, OBJECT,
+		                            "unknown session option");
+		if (sendErr(ses, err, NULL) != 0) return -1;
+		return 0;
+	}
+}
+
 /* -----------------------------------------------------------------------
  * Special cases fetch and close cursor
  * -----------------------------------------------------------------------
@@ -1344,6 +1380,9 @@ static int handleOp(nowdb_session_t *ses, nowdb_ast_t *ast) {
 	nowdb_ses_cursor_t pattern;
 	nowdb_ses_cursor_t *cur;
 
+	// session options
+	if (ast->ntype == NOWDB_AST_SET) return setOption(ses, ast);
+
 	// get curid
 	pattern.curid = strtoul(ast->value, &tmp, 10);
 	if (*tmp != 0) {
@@ -1446,6 +1485,7 @@ static nowdb_err_t negotiate(nowdb_session_t *ses) {
 
 	ses->opt.stype = NOWDB_SES_SQL;
 	ses->opt.opts = 0;
+	ses->opt.dop = 1;
 
 	if (buf[3] == 'L' && buf[4] == 'E') {
 		ses->opt.rtype = NOWDB_SES_LE;
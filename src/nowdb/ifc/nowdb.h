@@ -33,6 +33,7 @@ typedef struct {
 	char rtype; /* return type (txt, le, be) */ 
         char ctype; /* ack option or not (never) */
         int  opts;  /* detailed options          */
+        uint32_t dop; /* degree of parallelism   */
 } nowdb_ses_option_t;
 
 #define NOWDB_SES_SQL 0
@@ -665,6 +665,134 @@ nowdb_err_t nowdb_index_insert(nowdb_index_t    *idx,
 	return NOWDB_OK;
 }
 
+/* ------------------------------------------------------------------------
+ * Helper: page belongs to one of the files
+ * ------------------------------------------------------------------------
+ */
+static inline char inFiles(nowdb_fileid_t *fids, uint32_t n,
+                           nowdb_pageid_t pge) {
+	nowdb_fileid_t fid = (nowdb_fileid_t)(pge >> 32);
+	uint32_t lo=0, hi=n, mid;
+
+	while(lo < hi) {
+		mid = lo + (hi-lo)/2;
+		if (fids[mid] == fid) return 1;
+		if (fids[mid] < fid) lo = mid+1; else hi = mid;
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: remember key and page to be deleted
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t addStale(char **buf, uint64_t *cap,
+                                   uint64_t   *k, uint32_t  sz,
+                                   char *key, nowdb_pageid_t pge) {
+	char *tmp;
+
+	if (*k >= *cap) {
+		*cap = *cap == 0 ? 1024 : 2 * *cap;
+		tmp = realloc(*buf, (*cap)*(sz+EMBKSZ));
+		if (tmp == NULL) return nowdb_err_get(nowdb_err_no_mem,
+		                   FALSE, OBJECT, "allocating stale pages");
+		*buf = tmp;
+	}
+	memcpy(*buf+(*k)*(sz+EMBKSZ), key, sz);
+	memcpy(*buf+(*k)*(sz+EMBKSZ)+sz, &pge, EMBKSZ);
+	(*k)++;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: collect keys and pages of the files
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t findStale(nowdb_index_t  *idx,
+                                    nowdb_fileid_t *fids,
+                                    uint32_t          n,
+                                    uint32_t         sz,
+                                    char           **buf,
+                                    uint64_t          *k) {
+	nowdb_err_t err = NOWDB_OK;
+	beet_err_t  ber;
+	beet_iter_t iter;
+	nowdb_pageid_t *pge;
+	uint64_t cap = 0;
+	char *key;
+
+	ber = beet_iter_alloc(idx->idx, &iter);
+	if (ber != BEET_OK) return makeBeetError(ber);
+
+	ber = beet_index_range(idx->idx, NULL, BEET_DIR_ASC, iter);
+	if (ber == BEET_ERR_KEYNOF) {
+		beet_iter_destroy(iter); return NOWDB_OK;
+	}
+	if (ber != BEET_OK) {
+		beet_iter_destroy(iter); return makeBeetError(ber);
+	}
+	for(;;) {
+		ber = beet_iter_move(iter, (void**)&key, NULL);
+		if (ber == BEET_ERR_EOF) break;
+		if (ber != BEET_OK) break;
+
+		ber = beet_iter_enter(iter);
+		if (ber != BEET_OK) break;
+
+		for(;;) {
+			ber = beet_iter_move(iter, (void**)&pge, NULL);
+			if (ber != BEET_OK) break;
+			if (!inFiles(fids, n, *pge)) continue;
+			err = addStale(buf, &cap, k, sz, key, *pge);
+			if (err != NOWDB_OK) break;
+		}
+		if (err != NOWDB_OK) break;
+		if (ber != BEET_ERR_EOF) break;
+
+		ber = beet_iter_leave(iter);
+		if (ber != BEET_OK) break;
+	}
+	beet_iter_destroy(iter);
+	if (err != NOWDB_OK) return err;
+	if (ber != BEET_ERR_EOF) return makeBeetError(ber);
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Delete all pages of the files from the index
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_index_dropFiles(nowdb_index_t  *idx,
+                                  nowdb_fileid_t *fids,
+                                  uint32_t          n) {
+	nowdb_err_t err;
+	beet_err_t  ber;
+	char *buf = NULL;
+	uint64_t k = 0;
+	uint32_t sz;
+
+	IDXNULL();
+
+	if (n == 0) return NOWDB_OK;
+
+	sz = nowdb_index_keySize(beet_index_getResource(idx->idx));
+
+	err = findStale(idx, fids, n, sz, &buf, &k);
+	if (err != NOWDB_OK) {
+		if (buf != NULL) free(buf);
+		return err;
+	}
+	for(uint64_t i=0; i<k; i++) {
+		ber = beet_index_delete(idx->idx, buf+i*(sz+EMBKSZ),
+		                              buf+i*(sz+EMBKSZ)+sz);
+		if (ber != BEET_OK && ber != BEET_ERR_KEYNOF) {
+			err = makeBeetError(ber); break;
+		}
+	}
+	if (buf != NULL) free(buf);
+	return err;
+}
+
 /* ------------------------------------------------------------------------
  * Get index 'compare' method
  * ------------------------------------------------------------------------
@@ -203,6 +203,17 @@ nowdb_err_t nowdb_index_insert(nowdb_index_t   *idx,
                                nowdb_pageid_t   pge,
                                nowdb_bitmap8_t *map);
 
+/* ------------------------------------------------------------------------
+ * Delete all pages of the files 'fids' from the index
+ * -----------------
+ * 'fids' is sorted in ascending order and has n entries.
+ * The entries are collected first and deleted afterwards.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_index_dropFiles(nowdb_index_t  *idx,
+                                  nowdb_fileid_t *fids,
+                                  uint32_t          n);
+
 /* ------------------------------------------------------------------------
  * Get index 'compare' method
  * ------------------------------------------------------------------------
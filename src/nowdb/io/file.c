@@ -20,6 +20,33 @@ static char *OBJECT = "file";
 #define NOMEM(x) \
 	err = nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT, x);
 
+/* ------------------------------------------------------------------------
+ * Zone maps in the current header
+ * ------------------------------------------------------------------------
+ */
+#define ZONES(f) \
+	((nowdb_zone_t*)((char*)((f)->hdr)+NOWDB_HDR_BASE_SIZE))
+
+#define ZONESIZE(f) \
+	((f)->zones*sizeof(nowdb_zone_t))
+
+/* ------------------------------------------------------------------------
+ * Helper: number of attributes in a record of size recsize
+ * ------------------------------------------------------------------------
+ */
+static inline uint32_t zoneAtts(uint32_t recsize) {
+	uint32_t a;
+	for(a=1; nowdb_recSize(a) < recsize; a++);
+	return a;
+}
+
+/* ------------------------------------------------------------------------
+ * Encoded blocks may grow by one tag byte per attribute
+ * ------------------------------------------------------------------------
+ */
+#define XBUFSIZE(f) \
+	((f)->bufsize + zoneAtts((f)->recordsize))
+
 /* ------------------------------------------------------------------------
  * Allocate and initialise a new file descriptor
  * ------------------------------------------------------------------------
@@ -87,6 +114,7 @@ nowdb_err_t nowdb_file_init(nowdb_file_t   *file,
 	file->mptr     = NULL;
 	file->bptr     = NULL;
 	file->tmp      = NULL;
+	file->xbuf     = NULL;
 	file->cdict    = NULL;
 	file->ddict    = NULL;
 	file->cctx     = NULL;
@@ -100,12 +128,14 @@ nowdb_err_t nowdb_file_init(nowdb_file_t   *file,
 	file->pos      = 0;
 	file->dirty    = FALSE;
 	file->used     = FALSE;
+	file->refs     = 0;
 	file->fd       = -1;
 	file->state    = nowdb_file_state_closed;
 	file->order    = 0;
 
 	file->setsize = nowdb_pagectrlSize(recordsize);
 	file->hdrsize = NOWDB_HDR_BASE_SIZE + file->setsize;
+	file->zones   = 0;
 
 	/*
 	fprintf(stderr, "CONTENT: %u\n", file->cont);
@@ -125,6 +155,10 @@ nowdb_err_t nowdb_file_init(nowdb_file_t   *file,
 		return nowdb_err_get(nowdb_err_invalid, FALSE, OBJECT,
 		                                   "recordsize is 0");
 	}
+	if (ctrl & NOWDB_FILE_ZONE) {
+		file->zones = zoneAtts(recordsize);
+		file->hdrsize += ZONESIZE(file);
+	}
 	if (ctrl & NOWDB_FILE_READER) {
 		file->bufsize  = blocksize;
 	} else if (ctrl & NOWDB_FILE_WRITER) {
@@ -250,6 +284,9 @@ void nowdb_file_destroy(nowdb_file_t *file) {
 	if (file->tmp != NULL) {
 		free(file->tmp); file->tmp = NULL;
 	}
+	if (file->xbuf != NULL) {
+		free(file->xbuf); file->xbuf = NULL;
+	}
 	if (file->path != NULL) {
 		free(file->path); file->path = NULL;
 	}
@@ -450,33 +487,370 @@ static inline void deltas(char *buf,
 }
 
 /* ------------------------------------------------------------------------
- * Helper function to compress a block using ZSTD and write to the file
+ * Helper function to compute the zone maps of a block.
+ * Empty records are ignored; the keys (origin, destin and stamp
+ * for edges, vertex and stamp for vertices) are never null.
  * ------------------------------------------------------------------------
  */
-static inline nowdb_err_t zstdcomp(nowdb_file_t *file,
-                             char *buf, uint32_t size) {
-	ssize_t x;
-	size_t sz=0;
-	nowdb_time_t from=0;
-	nowdb_time_t to=0;
+static inline void zonemaps(nowdb_file_t *file,
+                            char *buf, uint32_t size) {
+	nowdb_zone_t *zone = ZONES(file);
+	uint32_t recsize = file->recordsize;
+	uint32_t mx = (size/recsize)*recsize;
+	uint32_t keys = file->cont == NOWDB_CONT_EDGE?3:2;
+	uint32_t cs = nowdb_ctrlStart(file->zones);
+	char *rec;
+	int64_t v;
+
+	for(uint32_t a=0; a<file->zones; a++) {
+		zone[a].min = INT64_MAX;
+		zone[a].max = INT64_MIN;
+		zone[a].nulls = 0;
+		zone[a].count = 0;
+	}
+	for(uint32_t i=0; i<mx; i+=recsize) {
+		rec = buf+i;
+		if (recsize <= sizeof(nowdb_nullrec) &&
+		    memcmp(rec, nowdb_nullrec, recsize) == 0) continue;
+		for(uint32_t a=0; a<file->zones; a++) {
+			if (a >= keys && !(rec[cs+a/8] & (1<<(a%8)))) {
+				zone[a].nulls++; continue;
+			}
+			memcpy(&v, rec+8*a, 8);
+			if (v < zone[a].min) zone[a].min = v;
+			if (v > zone[a].max) zone[a].max = v;
+			zone[a].count++;
+		}
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Block encoding
+ * --------------
+ * Blocks of files with the ENCODE flag are transformed
+ * before compression. Each attribute is stored as a column
+ * in the encoding that yields the fewest bytes for this block:
+ * - raw  : the 8-byte values as they are
+ * - delta: zig-zag varints of the difference to the predecessor
+ *          (keys and other integers)
+ * - dod  : zig-zag varints of the delta of deltas
+ *          (timestamps in regular intervals)
+ * - xor  : xor with the predecessor without leading and trailing
+ *          zero bytes (slowly changing floats)
+ * The attribute control bytes and the remainder of the page
+ * follow unchanged.
+ * ------------------------------------------------------------------------
+ */
+#define ENC_RAW   0
+#define ENC_DELTA 1
+#define ENC_DOD   2
+#define ENC_XOR   3
+
+#define ZIGZAG(v) \
+	(((uint64_t)(v) << 1) ^ (uint64_t)((int64_t)(v) >> 63))
+
+#define UNZIGZAG(u) \
+	((int64_t)(((u) >> 1) ^ (~((u) & 1) + 1)))
+
+#define VALUE(buf,i,recsize,a) \
+	(*(uint64_t*)((buf)+(i)*(recsize)+(a)*8))
+
+/* ------------------------------------------------------------------------
+ * Helper: size of a varint
+ * ------------------------------------------------------------------------
+ */
+static inline uint32_t varintSize(uint64_t u) {
+	uint32_t n=1;
+	while(u >= 128) {
+		u >>= 7; n++;
+	}
+	return n;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: write a varint
+ * ------------------------------------------------------------------------
+ */
+static inline uint32_t putVarint(char *buf, uint64_t u) {
+	uint32_t n=0;
+	while(u >= 128) {
+		buf[n] = (char)((u & 127) | 128);
+		u >>= 7; n++;
+	}
+	buf[n] = (char)u;
+	return n+1;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: read a varint (0 if the buffer ends too early)
+ * ------------------------------------------------------------------------
+ */
+static inline uint32_t getVarint(char *buf, uint32_t mx, uint64_t *u) {
+	uint32_t n=0;
+	*u = 0;
+	while(n < mx && n < 10) {
+		*u |= (uint64_t)(buf[n] & 127) << (7*n);
+		if (!(buf[n] & 128)) return n+1;
+		n++;
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: size of an xor-encoded value
+ * ------------------------------------------------------------------------
+ */
+static inline uint32_t xorSize(uint64_t x) {
+	if (x == 0) return 1;
+	return 1 + 8 - __builtin_clzll(x)/8 - __builtin_ctzll(x)/8;
+}
 
+/* ------------------------------------------------------------------------
+ * Helper: write an xor-encoded value:
+ *         (leading zero bytes << 4 | trailing zero bytes)
+ *         followed by the significant bytes
+ * ------------------------------------------------------------------------
+ */
+static inline uint32_t putXor(char *buf, uint64_t x) {
+	uint32_t lz, tz, n;
+
+	if (x == 0) {
+		buf[0] = (char)(8 << 4); return 1;
+	}
+	lz = __builtin_clzll(x)/8;
+	tz = __builtin_ctzll(x)/8;
+	buf[0] = (char)(lz << 4 | tz);
+	x >>= 8*tz;
+	n = 8 - lz - tz;
+	for(uint32_t i=0; i<n; i++) {
+		buf[1+i] = (char)(x & 255); x >>= 8;
+	}
+	return n+1;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: read an xor-encoded value (0 if the buffer ends too early)
+ * ------------------------------------------------------------------------
+ */
+static inline uint32_t getXor(char *buf, uint32_t mx, uint64_t *x) {
+	uint32_t lz, tz, n;
+
+	if (mx < 1) return 0;
+	lz = ((unsigned char)buf[0]) >> 4;
+	tz = buf[0] & 15;
+	if (lz + tz > 8) return 0;
+	n = 8 - lz - tz;
+	if (n+1 > mx) return 0;
+	*x = 0;
+	for(uint32_t i=0; i<n; i++) {
+		*x |= (uint64_t)(unsigned char)buf[1+i] << (8*i);
+	}
+	if (tz < 8) *x <<= 8*tz;
+	return n+1;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: choose the encoding for one attribute
+ * ------------------------------------------------------------------------
+ */
+static inline char chooseEnc(char *buf, uint32_t n,
+                             uint32_t recsize, uint32_t a) {
+	uint64_t v, prev=0;
+	int64_t  d, pd=0;
+	uint32_t s[4];
+	char best = ENC_RAW;
+
+	s[ENC_RAW] = 8*n; s[ENC_DELTA] = 0; s[ENC_DOD] = 0; s[ENC_XOR] = 0;
+
+	for(uint32_t i=0; i<n; i++) {
+		v = VALUE(buf, i, recsize, a);
+		d = (int64_t)(v - prev);
+		s[ENC_DELTA] += varintSize(ZIGZAG(d));
+		s[ENC_DOD] += varintSize(ZIGZAG(d - pd));
+		s[ENC_XOR] += xorSize(v ^ prev);
+		pd = d; prev = v;
+	}
+	for(char e=ENC_DELTA; e<=ENC_XOR; e++) {
+		if (s[(int)e] < s[(int)best]) best = e;
+	}
+	return best;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: encode block
+ * ------------------------------------------------------------------------
+ */
+static inline uint32_t encodeBlock(nowdb_file_t *file,
+                                   char *buf, uint32_t size) {
+	uint32_t recsize = file->recordsize;
+	uint32_t atts = zoneAtts(recsize);
+	uint32_t n = size/recsize;
+	uint32_t cs = nowdb_ctrlStart(atts);
+	char *out = file->xbuf;
+	uint64_t v, prev;
+	int64_t  d, pd;
+	uint32_t o=0;
+	char e;
+
+	for(uint32_t a=0; a<atts; a++) {
+		e = chooseEnc(buf, n, recsize, a);
+		out[o] = e; o++;
+		prev = 0; pd = 0;
+		for(uint32_t i=0; i<n; i++) {
+			v = VALUE(buf, i, recsize, a);
+			d = (int64_t)(v - prev);
+			switch(e) {
+			case ENC_RAW:
+				memcpy(out+o, &v, 8); o+=8; break;
+			case ENC_DELTA:
+				o += putVarint(out+o, ZIGZAG(d)); break;
+			case ENC_DOD:
+				o += putVarint(out+o, ZIGZAG(d - pd)); break;
+			default:
+				o += putXor(out+o, v ^ prev);
+			}
+			pd = d; prev = v;
+		}
+	}
+	/* control bytes */
+	for(uint32_t i=0; i<n; i++) {
+		memcpy(out+o, buf+i*recsize+cs, recsize-cs);
+		o += recsize-cs;
+	}
+	/* remainder */
+	memcpy(out+o, buf+n*recsize, size-n*recsize);
+	o += size-n*recsize;
+	return o;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: decode block from 'in' into 'buf'
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t decodeBlock(nowdb_file_t *file,
+                                      char *in, uint32_t sz,
+                                      char *buf) {
+	uint32_t recsize = file->recordsize;
+	uint32_t size = file->bufsize;
+	uint32_t atts = zoneAtts(recsize);
+	uint32_t n = size/recsize;
+	uint32_t cs = nowdb_ctrlStart(atts);
+	uint64_t v, u, prev;
+	int64_t  d, pd;
+	uint32_t o=0, k;
+	char e;
+
+	for(uint32_t a=0; a<atts; a++) {
+		if (o >= sz) goto corrupted;
+		e = in[o]; o++;
+		if (e < ENC_RAW || e > ENC_XOR) goto corrupted;
+		prev = 0; pd = 0;
+		for(uint32_t i=0; i<n; i++) {
+			switch(e) {
+			case ENC_RAW:
+				if (o+8 > sz) goto corrupted;
+				memcpy(&v, in+o, 8); k = 8; break;
+			case ENC_DELTA:
+				k = getVarint(in+o, sz-o, &u);
+				d = UNZIGZAG(u);
+				v = prev + (uint64_t)d; break;
+			case ENC_DOD:
+				k = getVarint(in+o, sz-o, &u);
+				d = pd + UNZIGZAG(u);
+				v = prev + (uint64_t)d; break;
+			default:
+				k = getXor(in+o, sz-o, &u);
+				v = prev ^ u;
+			}
+			if (k == 0) goto corrupted;
+			o += k;
+			memcpy(buf+i*recsize+a*8, &v, 8);
+			pd = (int64_t)(v - prev); prev = v;
+		}
+	}
+	if (o + n*(recsize-cs) + size-n*recsize != sz) goto corrupted;
+	for(uint32_t i=0; i<n; i++) {
+		memcpy(buf+i*recsize+cs, in+o, recsize-cs);
+		o += recsize-cs;
+	}
+	memcpy(buf+n*recsize, in+o, size-n*recsize);
+	return NOWDB_OK;
+
+corrupted:
+	return nowdb_err_get(nowdb_err_decomp, FALSE, OBJECT,
+	                           "corrupted encoded block");
+}
+
+/* ------------------------------------------------------------------------
+ * Helper function to compress a block using ZSTD
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t zstdcomp(nowdb_file_t *file,
+                                   char *buf, uint32_t size,
+                                   size_t                *sz) {
 	if (file->cdict != NULL) {
 		/*
 		fprintf(stderr, "[%lu] pointers: %p, %p, %p, %p\n", pthread_self(),
 				file->cctx, file->tmp, buf, file->cdict);
 		*/
-		sz = ZSTD_compress_usingCDict(file->cctx,
-		                              file->tmp, file->bufsize,
-		                              buf, size,
-		                              file->cdict);
+		*sz = ZSTD_compress_usingCDict(file->cctx,
+		                               file->tmp, file->bufsize,
+		                               buf, size,
+		                               file->cdict);
 	} else {
-		sz = ZSTD_compress(file->tmp, file->bufsize,
-		               buf, size, NOWDB_ZSTD_LEVEL);
+		*sz = ZSTD_compress(file->tmp, file->bufsize,
+		                buf, size, NOWDB_ZSTD_LEVEL);
 	}
-	if (ZSTD_isError(sz)) {
+	if (ZSTD_isError(*sz)) {
 		return nowdb_err_get(nowdb_err_comp, FALSE, OBJECT,
-			              (char*)ZSTD_getErrorName(sz));
+			             (char*)ZSTD_getErrorName(*sz));
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper function to compress a block using LZ4
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t lz4comp(nowdb_file_t *file,
+                                  char *buf, uint32_t size,
+                                  size_t                *sz) {
+	int x = LZ4_compress_default(buf, file->tmp,
+	                             (int)size, (int)file->bufsize);
+	if (x <= 0) {
+		return nowdb_err_get(nowdb_err_comp, FALSE, OBJECT,
+		                    "LZ4: block does not compress");
+	}
+	*sz = (size_t)x;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper function to compress a block and write it to the file
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t compwrite(nowdb_file_t *file,
+                              char *buf, uint32_t size) {
+	nowdb_err_t err;
+	ssize_t x;
+	size_t sz=0;
+	nowdb_time_t from=0;
+	nowdb_time_t to=0;
+
+	/* transform before compression */
+	if (file->ctrl & NOWDB_FILE_ENCODE) {
+		uint32_t xs = encodeBlock(file, buf, size);
+		if (file->comp == NOWDB_COMP_ZSTD) {
+			err = zstdcomp(file, file->xbuf, xs, &sz);
+		} else {
+			err = lz4comp(file, file->xbuf, xs, &sz);
+		}
+	} else if (file->comp == NOWDB_COMP_ZSTD) {
+		err = zstdcomp(file, buf, size, &sz);
+	} else {
+		err = lz4comp(file, buf, size, &sz);
 	}
+	if (err != NOWDB_OK) return err;
 
 	if (file->ctrl & NOWDB_FILE_TS) deltas(buf, size,
 	                                       file->recordsize,
@@ -485,11 +859,17 @@ static inline nowdb_err_t zstdcomp(nowdb_file_t *file,
 	                                                     NOWDB_OFF_VSTAMP,
 	                                       &from, &to);
 
-	file->hdr->reserved = 0;
+	file->hdr->version = 0;
 	file->hdr->size = (uint32_t)sz;
 	file->hdr->from = from;
 	file->hdr->to = to;
-	memset((char*)(file->hdr)+NOWDB_HDR_BASE_SIZE, 0xff, file->setsize);
+
+	if (file->ctrl & NOWDB_FILE_ZONE) {
+		file->hdr->version = NOWDB_HDR_VERSION_ZONE;
+		zonemaps(file, buf, size);
+	}
+	memset((char*)(file->hdr)+NOWDB_HDR_BASE_SIZE+ZONESIZE(file),
+	                                          0xff, file->setsize);
 
 	x = write(file->fd, file->hdr, file->hdrsize);
 	if (x != file->hdrsize) {
@@ -537,8 +917,9 @@ nowdb_err_t nowdb_file_writeBuf(nowdb_file_t *file,
 	}
 	if (file->comp == NOWDB_COMP_FLAT) {
 		err = flatwrite(file, buf, size);
-	} else if (file->comp == NOWDB_COMP_ZSTD) {
-		err = zstdcomp(file, buf, size);
+	} else if (file->comp == NOWDB_COMP_ZSTD ||
+	           file->comp == NOWDB_COMP_LZ4) {
+		err = compwrite(file, buf, size);
 	} else return nowdb_err_get(nowdb_err_not_supp, FALSE, OBJECT,
 	                                       "unknown compression");
 	if (file->capacity < file->size) file->capacity = file->size;
@@ -577,6 +958,14 @@ nowdb_err_t nowdb_file_open(nowdb_file_t *file) {
 			                  FALSE, OBJECT, NULL);
 		}
 	}
+	if (file->comp != NOWDB_COMP_FLAT &&
+	    (file->ctrl & NOWDB_FILE_ENCODE) && file->xbuf == NULL) {
+		file->xbuf = malloc(XBUFSIZE(file));
+		if (file->xbuf == NULL) {
+			return nowdb_err_get(nowdb_err_no_mem,
+			                  FALSE, OBJECT, NULL);
+		}
+	}
 	file->state = nowdb_file_state_open;
 	return NOWDB_OK;
 }
@@ -788,18 +1177,18 @@ static inline void showtmp(nowdb_file_t *file) {
  * Helper function to decompress a block using ZSTD
  * ------------------------------------------------------------------------
  */
-static inline nowdb_err_t zstddecomp(nowdb_file_t *file) {
+static inline nowdb_err_t zstddecomp(nowdb_file_t *file,
+                                     ZSTD_DCtx    *dctx,
+                                     char *src, uint32_t size,
+                                     char *dst, uint32_t cap,
+                                     uint32_t *dsz) {
 	size_t sz;
 	if (file->ddict != NULL) {
-		sz = ZSTD_decompress_usingDDict(file->dctx,
-		                                file->bptr, file->bufsize,
-		                                file->tmp+file->off,
-		                                file->hdr->size,
+		sz = ZSTD_decompress_usingDDict(dctx, dst, cap,
+		                                src, size,
 		                                file->ddict);
 	} else {
-		sz = ZSTD_decompress(file->bptr, file->bufsize,
-		                     file->tmp+file->off,
-		                     file->hdr->size);
+		sz = ZSTD_decompress(dst, cap, src, size);
 	}
 	/*
 	showtmp(file);
@@ -808,9 +1197,66 @@ static inline nowdb_err_t zstddecomp(nowdb_file_t *file) {
 		return nowdb_err_get(nowdb_err_decomp, FALSE, OBJECT,
 			               (char*)ZSTD_getErrorName(sz));
 	}
+	*dsz = (uint32_t)sz;
 	return NOWDB_OK;
 }
 
+/* ------------------------------------------------------------------------
+ * Helper function to decompress a block using LZ4
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t lz4decomp(char *src, uint32_t size,
+                                    char *dst, uint32_t cap,
+                                    uint32_t *dsz) {
+	int x = LZ4_decompress_safe(src, dst, (int)size, (int)cap);
+	if (x < 0) {
+		return nowdb_err_get(nowdb_err_decomp, FALSE, OBJECT,
+		                              "LZ4: corrupted block");
+	}
+	*dsz = (uint32_t)x;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper function to decompress a block (and to decode it);
+ * uses only buffers passed in and can therefore be used
+ * on behalf of the file in other threads.
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t decompBlock(nowdb_file_t *file,
+                                      ZSTD_DCtx    *dctx,
+                                      char *src, uint32_t size,
+                                      char *page, char *xbuf) {
+	nowdb_err_t err;
+	uint32_t sz=0;
+	char *dst = page;
+	uint32_t cap = file->bufsize;
+
+	if (file->ctrl & NOWDB_FILE_ENCODE) {
+		dst = xbuf; cap = XBUFSIZE(file);
+	}
+	if (file->comp == NOWDB_COMP_ZSTD) {
+		err = zstddecomp(file, dctx, src, size, dst, cap, &sz);
+	} else {
+		err = lz4decomp(src, size, dst, cap, &sz);
+	}
+	if (err != NOWDB_OK) return err;
+	if (file->ctrl & NOWDB_FILE_ENCODE) {
+		return decodeBlock(file, xbuf, sz, page);
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper function to decompress the current block into bptr
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t decompress(nowdb_file_t *file) {
+	return decompBlock(file, file->dctx,
+	                   file->tmp+file->off, file->hdr->size,
+	                   file->bptr, file->xbuf);
+}
+
 /* -----------------------------------------------------------------------
  * Helper: check header - worth decompressing the block?
  * -----------------------------------------------------------------------
@@ -884,33 +1330,67 @@ static inline nowdb_err_t compload(nowdb_file_t *file,
 	return NOWDB_OK;
 }
 
+/* -----------------------------------------------------------------------
+ * Helper: check zone maps - worth decompressing the block?
+ * -----------------------------------------------------------------------
+ */
+static inline char worthZone(nowdb_file_t      *file,
+                             nowdb_zone_check_t check,
+                             void               *arg) {
+	if (check == NULL) return 1;
+	if (!(file->ctrl & NOWDB_FILE_ZONE)) return 1;
+	if (file->hdr->version < NOWDB_HDR_VERSION_ZONE) return 1;
+	return check(arg, ZONES(file), file->zones);
+}
+
 /* ------------------------------------------------------------------------
- * Helper function to move through a compressed file
+ * Helper function to move through a compressed file;
+ * blocks that are not relevant according to period and zone maps
+ * are skipped without being decompressed.
+ * If 'raw' is not NULL, the compressed block is copied there
+ * instead of being decompressed.
  * ------------------------------------------------------------------------
  */
-static inline nowdb_err_t compmove(nowdb_file_t *file,
-                                   nowdb_time_t start,
-                                   nowdb_time_t   end) {
+static inline nowdb_err_t compmove(nowdb_file_t      *file,
+                                   nowdb_time_t      start,
+                                   nowdb_time_t        end,
+                                   nowdb_zone_check_t check,
+                                   void               *arg,
+                                   char               *raw,
+                                   uint32_t           *rsz) {
 	nowdb_err_t err = NOWDB_OK;
+	char worth;
 
-	/* no header loaded */
-	if (file->hdr->size == 0) err = compload(file, TRUE);
-	/* data missing from block for this header */
-	if (file->tmpsize <
-	    file->hdr->size + file->off) err = compload(file, FALSE);
+	if (file->comp != NOWDB_COMP_ZSTD &&
+	    file->comp != NOWDB_COMP_LZ4) {
+		return nowdb_err_get(nowdb_err_not_supp, FALSE, OBJECT,
+		                      "unknown compression algorithm");
+	}
+	for(;;) {
+		/* no header loaded */
+		if (file->hdr->size == 0) err = compload(file, TRUE);
+		/* data missing from block for this header */
+		if (file->tmpsize <
+		    file->hdr->size + file->off) err = compload(file, FALSE);
 
-	/* check for error */
-	if (err != NOWDB_OK) return err;
+		/* check for error */
+		if (err != NOWDB_OK) return err;
 
-	/* no header found: EOF */
-	if (file->hdr->size == 0) return nowdb_err_get(nowdb_err_eof,
-		                          FALSE, OBJECT, file->path);
-	/* decompress using ZSTD */
-	if (file->comp == NOWDB_COMP_ZSTD) {
+		/* no header found: EOF */
+		if (file->hdr->size == 0) return nowdb_err_get(nowdb_err_eof,
+			                          FALSE, OBJECT, file->path);
 
-		/* decompress */
-		err = zstddecomp(file);
-		if (err != NOWDB_OK) return err;
+		worth = worthBlock(file, start, end) &&
+		        worthZone(file, check, arg);
+
+		/* decompress using ZSTD or LZ4 (and decode) */
+		if (worth && raw != NULL) {
+			memcpy(raw, file->tmp+file->off, file->hdr->size);
+			*rsz = file->hdr->size;
+		} else if (worth) {
+			err = decompress(file);
+			if (err != NOWDB_OK) return err;
+		}
 
 		/* move on to next header */
 		file->off += file->hdr->size;
@@ -922,16 +1402,17 @@ static inline nowdb_err_t compmove(nowdb_file_t *file,
 			file->off = 0;
 		}
 		/* that was the last block */
-		if (file->hdr->size == 0) return NOWDB_OK;
+		if (file->hdr->size == 0) {
+			if (worth) return NOWDB_OK;
+			return nowdb_err_get(nowdb_err_eof,
+			         FALSE, OBJECT, file->path);
+		}
 
 		/* load header */
 		memcpy(file->hdr, file->tmp+file->off, file->hdrsize);
 		file->off += file->hdrsize;
-		return err;
+		if (worth) return NOWDB_OK;
 	}
-	/* unknown compression algorithm */
-	return nowdb_err_get(nowdb_err_not_supp, FALSE, OBJECT,
-	                      "unknown compression algorithm");
 }
 
 /* ------------------------------------------------------------------------
@@ -949,9 +1430,15 @@ static inline nowdb_err_t plainmove(nowdb_file_t *file) {
  * Move file one block forward
  * ------------------------------------------------------------------------
  */
-nowdb_err_t filemove(nowdb_file_t *file,
-                     nowdb_time_t start,
-                     nowdb_time_t   end) {
+nowdb_err_t filemove(nowdb_file_t      *file,
+                     nowdb_time_t      start,
+                     nowdb_time_t        end,
+                     nowdb_zone_check_t check,
+                     void               *arg,
+                     char               *raw,
+                     uint32_t           *rsz) {
+	nowdb_err_t err;
+
 	if (file == NULL) {
 		return nowdb_err_get(nowdb_err_invalid, FALSE, OBJECT,
 		                            "file descriptor is NULL");
@@ -961,9 +1448,19 @@ nowdb_err_t filemove(nowdb_file_t *file,
 		return nowdb_err_get(nowdb_err_invalid, FALSE, OBJECT,
 		                 "file descriptor is in wrong state");
 	}
-	if (file->state == nowdb_file_state_mapped) return remap(file);
-	if (file->comp == NOWDB_COMP_FLAT) return plainmove(file);
-	return compmove(file, start, end);
+	if (file->state == nowdb_file_state_mapped ||
+	    file->comp  == NOWDB_COMP_FLAT) {
+		if (file->state == nowdb_file_state_mapped) {
+			err = remap(file);
+		} else {
+			err = plainmove(file);
+		}
+		if (err != NOWDB_OK || raw == NULL) return err;
+		memcpy(raw, file->bptr, file->bufsize);
+		*rsz = file->bufsize;
+		return NOWDB_OK;
+	}
+	return compmove(file, start, end, check, arg, raw, rsz);
 }
 
 /* ------------------------------------------------------------------------
@@ -971,7 +1468,8 @@ nowdb_err_t filemove(nowdb_file_t *file,
  * ------------------------------------------------------------------------
  */
 nowdb_err_t nowdb_file_move(nowdb_file_t *file) {
-	return filemove(file, NOWDB_TIME_DAWN, NOWDB_TIME_DUSK);
+	return filemove(file, NOWDB_TIME_DAWN, NOWDB_TIME_DUSK,
+	                                  NULL, NULL, NULL, NULL);
 }
 
 /* ------------------------------------------------------------------------
@@ -981,7 +1479,81 @@ nowdb_err_t nowdb_file_move(nowdb_file_t *file) {
 nowdb_err_t nowdb_file_movePeriod(nowdb_file_t *file,
                                   nowdb_time_t start,
                                   nowdb_time_t   end) {
-	return filemove(file, start, end);
+	return filemove(file, start, end, NULL, NULL, NULL, NULL);
+}
+
+/* ------------------------------------------------------------------------
+ * Move file to next relevant block according to period and zone maps
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_file_moveZone(nowdb_file_t      *file,
+                                nowdb_time_t      start,
+                                nowdb_time_t        end,
+                                nowdb_zone_check_t check,
+                                void               *arg) {
+	return filemove(file, start, end, check, arg, NULL, NULL);
+}
+
+/* ------------------------------------------------------------------------
+ * Fetch next relevant block without decompressing it
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_file_fetchZone(nowdb_file_t      *file,
+                                 nowdb_time_t      start,
+                                 nowdb_time_t        end,
+                                 nowdb_zone_check_t check,
+                                 void               *arg,
+                                 char               *raw,
+                                 uint32_t          *size) {
+	if (raw == NULL || size == NULL) {
+		return nowdb_err_get(nowdb_err_invalid, FALSE, OBJECT,
+		                                  "no target buffer");
+	}
+	return filemove(file, start, end, check, arg, raw, size);
+}
+
+/* ------------------------------------------------------------------------
+ * Decompress a fetched block
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_file_decompress(nowdb_file_t *file,
+                                  ZSTD_DCtx    *dctx,
+                                  char *raw, uint32_t size,
+                                  char *page, char *xbuf) {
+	if (file == NULL) {
+		return nowdb_err_get(nowdb_err_invalid, FALSE, OBJECT,
+		                            "file descriptor is NULL");
+	}
+	if (file->comp == NOWDB_COMP_FLAT) {
+		memcpy(page, raw, size); return NOWDB_OK;
+	}
+	if ((file->ctrl & NOWDB_FILE_ENCODE) && xbuf == NULL) {
+		return nowdb_err_get(nowdb_err_invalid, FALSE, OBJECT,
+		                             "no buffer for decoding");
+	}
+	return decompBlock(file, dctx, raw, size, page, xbuf);
+}
+
+/* ------------------------------------------------------------------------
+ * Size of the buffer needed to decode blocks of this file
+ * ------------------------------------------------------------------------
+ */
+uint32_t nowdb_file_xbufSize(nowdb_file_t *file) {
+	if (file->comp == NOWDB_COMP_FLAT) return 0;
+	if (!(file->ctrl & NOWDB_FILE_ENCODE)) return 0;
+	return XBUFSIZE(file);
+}
+
+/* ------------------------------------------------------------------------
+ * Get the zone maps of the current header
+ * ------------------------------------------------------------------------
+ */
+nowdb_zone_t *nowdb_file_zones(nowdb_file_t *file) {
+	if (file == NULL || file->hdr == NULL) return NULL;
+	if (!(file->ctrl & NOWDB_FILE_ZONE)) return NULL;
+	if (file->hdr->size == 0) return NULL;
+	if (file->hdr->version < NOWDB_HDR_VERSION_ZONE) return NULL;
+	return ZONES(file);
 }
 
 /* ------------------------------------------------------------------------
@@ -1023,7 +1595,8 @@ nowdb_err_t nowdb_file_loadBlock(nowdb_file_t *file) {
 	}
 	if (file->comp == NOWDB_COMP_FLAT) return plainload(file);
 	memset(file->hdr, 0, file->hdrsize);
-	return compmove(file, NOWDB_TIME_DAWN, NOWDB_TIME_DUSK);
+	return compmove(file, NOWDB_TIME_DAWN, NOWDB_TIME_DUSK, NULL, NULL,
+	                                                   NULL, NULL);
 }
 
 /* ------------------------------------------------------------------------
@@ -18,6 +18,7 @@
 #include <sys/types.h>
 
 #include <zstd.h>
+#include <lz4.h>
 
 typedef uint32_t nowdb_comp_t;
 typedef uint32_t nowdb_encp_t;
@@ -37,6 +38,11 @@ typedef uint32_t nowdb_encp_t;
 #define NOWDB_FILE_READER 4
 #define NOWDB_FILE_SORT   8
 #define NOWDB_FILE_TS    16
+#define NOWDB_FILE_ZONE  32
+#define NOWDB_FILE_ENCODE 64
+#define NOWDB_FILE_ORDER 128
+
+#define NOWDB_HDR_VERSION_ZONE 1
 
 #define NOWDB_FILE_MAPSIZE 8388608
 #define NOWDB_FILE_MAXSIZE 1073741824
@@ -59,9 +65,37 @@ typedef struct {
 	int64_t      from; /* from (period)      */
 	int64_t        to; /* to   (period)      */
 	uint32_t     size; /* compressed size    */
-	uint32_t reserved;
+	uint32_t  version; /* header version     */
 } nowdb_block_hdr_t;
 
+/* ------------------------------------------------------------------------
+ * Zone map
+ * --------
+ * Files with the ZONE flag carry one zone map per attribute
+ * directly after the base header of each block (before the control set).
+ * min and max are the raw 8-byte values compared as signed integers;
+ * it is up to the user to decide whether this order is meaningful
+ * for the type of the attribute.
+ * Only non-null values are considered for min and max.
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	int64_t       min; /* smallest value     */
+	int64_t       max; /* greatest value     */
+	uint32_t    nulls; /* null values        */
+	uint32_t    count; /* non-null values    */
+} nowdb_zone_t;
+
+/* ------------------------------------------------------------------------
+ * Zone check
+ * ----------
+ * Callback to decide whether a block is worth decompressing
+ * according to its zone maps (0: skip the block, 1: load the block).
+ * ------------------------------------------------------------------------
+ */
+typedef char (*nowdb_zone_check_t)(void *arg, nowdb_zone_t *zones,
+                                              uint32_t        n);
+
 /* ------------------------------------------------------------------------
  * NoWDB File Descriptor
  * TODO:
@@ -78,15 +112,18 @@ typedef struct {
 	uint32_t    recordsize; /* size of one record                 */
 	int32_t        hdrsize; /* headersize                         */
 	uint32_t       setsize; /* size of the control set            */
+	uint32_t         zones; /* number of zone maps per header     */
 	nowdb_content_t   cont; /* content type                       */
 	uint32_t         state; /* current state of the descriptor    */
 	uint32_t           pos; /* current position in the file       */
 	nowdb_bool_t     dirty; /* map was written                    */
 	nowdb_bool_t      used; /* reader is in use for writing       */
+	uint32_t          refs; /* handles referring to the reader    */
 	int                 fd; /* os file descriptor                 */
 	char             *mptr; /* pointer for mapping                */
 	char             *bptr; /* pointer for buffered reading       */
 	char              *tmp; /* temporary buffer for decompression */
+	char             *xbuf; /* buffer for encoding blocks         */
 	int                off; /* current position within tmp        */
 	ZSTD_CDict      *cdict; /* compression dictionary             */
 	ZSTD_DDict      *ddict; /* decompression dictionary           */
@@ -258,6 +295,58 @@ nowdb_err_t nowdb_file_movePeriod(nowdb_file_t *file,
                                   nowdb_time_t start,
                                   nowdb_time_t   end);
 
+/* ------------------------------------------------------------------------
+ * Move file to next relevant block according to period and zone maps.
+ * Blocks without zone maps are checked against the period only.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_file_moveZone(nowdb_file_t      *file,
+                                nowdb_time_t      start,
+                                nowdb_time_t        end,
+                                nowdb_zone_check_t check,
+                                void               *arg);
+
+/* ------------------------------------------------------------------------
+ * Fetch next relevant block like moveZone,
+ * but copy the block as it is stored (i.e. compressed) into 'raw'
+ * instead of decompressing it into bptr.
+ * 'raw' must have room for at least bufsize bytes.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_file_fetchZone(nowdb_file_t      *file,
+                                 nowdb_time_t      start,
+                                 nowdb_time_t        end,
+                                 nowdb_zone_check_t check,
+                                 void               *arg,
+                                 char               *raw,
+                                 uint32_t          *size);
+
+/* ------------------------------------------------------------------------
+ * Decompress (and decode) a block obtained by fetchZone into 'page'.
+ * The file state is not changed, so this may run in another thread
+ * than the one fetching blocks. 'dctx' is the calling thread's
+ * ZSTD context; 'xbuf' has room for xbufSize bytes
+ * (it is not used for files that are not encoded).
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_file_decompress(nowdb_file_t *file,
+                                  ZSTD_DCtx    *dctx,
+                                  char *raw, uint32_t size,
+                                  char *page, char *xbuf);
+
+/* ------------------------------------------------------------------------
+ * Size of the buffer needed to decode blocks of this file
+ * (0 if the file is not encoded)
+ * ------------------------------------------------------------------------
+ */
+uint32_t nowdb_file_xbufSize(nowdb_file_t *file);
+
+/* ------------------------------------------------------------------------
+ * Get the zone maps of the current header (NULL if there are none)
+ * ------------------------------------------------------------------------
+ */
+nowdb_zone_t *nowdb_file_zones(nowdb_file_t *file);
+
 /* ------------------------------------------------------------------------
  * Position file freely ("reader")
  * ------------------------------------------------------------------------
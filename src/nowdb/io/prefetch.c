@@ -0,0 +1,424 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Prefetch: asynchronous read-ahead for sequential scans
+ * ========================================================================
+ */
+#include <nowdb/io/prefetch.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+static char *OBJECT = "prefetch";
+
+#define NOMEM(x) \
+	err = nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT, x);
+
+/* ------------------------------------------------------------------------
+ * Slot states
+ * ------------------------------------------------------------------------
+ */
+#define SLOT_FREE    0
+#define SLOT_LOADING 1
+#define SLOT_READY   2
+
+#define SLOT(pf,i) \
+	((pf)->slots+((i)%(pf)->depth))
+
+/* ------------------------------------------------------------------------
+ * Check whether prefetching makes sense for these files
+ * ------------------------------------------------------------------------
+ */
+char nowdb_prefetch_useful(ts_algo_list_t *files) {
+	ts_algo_list_node_t *runner;
+
+	if (files == NULL) return 0;
+	for(runner=files->head; runner!=NULL; runner=runner->nxt) {
+		if (((nowdb_file_t*)runner->cont)->comp !=
+		                          NOWDB_COMP_FLAT) return 1;
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: make current file ready for reading
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t openCurrent(nowdb_prefetch_t *pf) {
+	nowdb_err_t err;
+	nowdb_file_t *file = pf->current->cont;
+
+	if (file->state == nowdb_file_state_closed) {
+		err = nowdb_file_open(file);
+		if (err != NOWDB_OK) return err;
+		pf->closeit = TRUE;
+	} else {
+		pf->closeit = FALSE;
+	}
+	pf->opened = 1;
+	return nowdb_file_rewind(file);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: leave current file
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t closeCurrent(nowdb_prefetch_t *pf) {
+	nowdb_err_t err = NOWDB_OK;
+
+	if (pf->opened && pf->closeit) {
+		err = nowdb_file_close(pf->current->cont);
+	}
+	pf->opened = 0;
+	pf->closeit = FALSE;
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: fetch next relevant block into slot
+ * NOTE: must only be called holding the iolock
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t fetch(nowdb_prefetch_t *pf,
+                         nowdb_prefetch_slot_t *slot) {
+	nowdb_err_t err;
+	nowdb_file_t *file;
+
+	for(;;) {
+		if (pf->current == NULL) return nowdb_err_get(nowdb_err_eof,
+		                                        FALSE, OBJECT, NULL);
+		file = pf->current->cont;
+
+		/* uncompressed files are read by the caller */
+		if (file->comp == NOWDB_COMP_FLAT) {
+			slot->file = file;
+			slot->pass = 1;
+			pf->current = pf->current->nxt;
+			return NOWDB_OK;
+		}
+		if (!pf->opened) {
+			err = openCurrent(pf);
+			if (err != NOWDB_OK) return err;
+		}
+		err = nowdb_file_fetchZone(file, pf->from, pf->to,
+		                                pf->check, pf->arg,
+		                               slot->raw, &slot->size);
+		if (err == NOWDB_OK) {
+			slot->file = file;
+			slot->pass = 0;
+			return NOWDB_OK;
+		}
+		if (err->errcode != nowdb_err_eof) return err;
+		nowdb_err_release(err);
+
+		err = closeCurrent(pf);
+		if (err != NOWDB_OK) return err;
+
+		pf->current = pf->current->nxt;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: publish slot
+ * ------------------------------------------------------------------------
+ */
+static inline void ready(nowdb_prefetch_t      *pf,
+                         nowdb_prefetch_slot_t *slot,
+                         nowdb_err_t             err) {
+	NOWDB_IGNORE(nowdb_lock(&pf->lock));
+	slot->err = err;
+	slot->state = SLOT_READY;
+	if (err != NOWDB_OK) pf->eof = 1;
+	pthread_cond_broadcast(&pf->cond);
+	NOWDB_IGNORE(nowdb_unlock(&pf->lock));
+}
+
+/* ------------------------------------------------------------------------
+ * Background task:
+ * - take turns in reading the next block (holding the iolock)
+ * - decompress the block in parallel to the others
+ * ------------------------------------------------------------------------
+ */
+static void *prefetch(void *p) {
+	nowdb_prefetch_t *pf = p;
+	nowdb_prefetch_slot_t *slot;
+	nowdb_err_t err;
+	ZSTD_DCtx *dctx;
+
+	dctx = ZSTD_createDCtx();
+	for(;;) {
+		NOWDB_IGNORE(nowdb_lock(&pf->iolock));
+		NOWDB_IGNORE(nowdb_lock(&pf->lock));
+
+		/* wait for a free slot */
+		while(!pf->stop && !pf->eof &&
+		      SLOT(pf, pf->tail)->state != SLOT_FREE) {
+			pthread_cond_wait(&pf->cond, &pf->lock);
+		}
+		if (pf->stop || pf->eof) {
+			NOWDB_IGNORE(nowdb_unlock(&pf->lock));
+			NOWDB_IGNORE(nowdb_unlock(&pf->iolock));
+			break;
+		}
+		slot = SLOT(pf, pf->tail); pf->tail++;
+		slot->state = SLOT_LOADING;
+		NOWDB_IGNORE(nowdb_unlock(&pf->lock));
+
+		/* read */
+		err = fetch(pf, slot);
+		NOWDB_IGNORE(nowdb_unlock(&pf->iolock));
+		if (err != NOWDB_OK || slot->pass) {
+			ready(pf, slot, err); continue;
+		}
+
+		/* decompress */
+		if (dctx == NULL && slot->file->comp == NOWDB_COMP_ZSTD) {
+			err = nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT,
+			                             "ZSTD context");
+		} else {
+			err = nowdb_file_decompress(slot->file, dctx,
+			                            slot->raw, slot->size,
+			                            slot->page, slot->xbuf);
+		}
+		ready(pf, slot, err);
+	}
+	if (dctx != NULL) ZSTD_freeDCtx(dctx);
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: allocate the ring
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t allocSlots(nowdb_prefetch_t *pf,
+                              ts_algo_list_t *files) {
+	nowdb_err_t err = NOWDB_OK;
+	ts_algo_list_node_t *runner;
+	nowdb_file_t *file;
+	uint32_t bsz = 0;
+	uint32_t xsz = 0;
+
+	for(runner=files->head; runner!=NULL; runner=runner->nxt) {
+		file = runner->cont;
+		if (file->comp == NOWDB_COMP_FLAT) continue;
+		if (file->bufsize > bsz) bsz = file->bufsize;
+		if (nowdb_file_xbufSize(file) > xsz) {
+			xsz = nowdb_file_xbufSize(file);
+		}
+	}
+
+	pf->slots = calloc(pf->depth, sizeof(nowdb_prefetch_slot_t));
+	if (pf->slots == NULL) {
+		NOMEM("allocating slots");
+		return err;
+	}
+	for(int i=0; i<pf->depth; i++) {
+		pf->slots[i].raw = malloc(bsz);
+		if (pf->slots[i].raw == NULL) {
+			NOMEM("allocating slot");
+			return err;
+		}
+		pf->slots[i].page = malloc(bsz);
+		if (pf->slots[i].page == NULL) {
+			NOMEM("allocating slot");
+			return err;
+		}
+		if (xsz == 0) continue;
+		pf->slots[i].xbuf = malloc(xsz);
+		if (pf->slots[i].xbuf == NULL) {
+			NOMEM("allocating slot");
+			return err;
+		}
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: stop tasks
+ * ------------------------------------------------------------------------
+ */
+static void stopTasks(nowdb_prefetch_t *pf) {
+	NOWDB_IGNORE(nowdb_lock(&pf->lock));
+	pf->stop = 1;
+	pthread_cond_broadcast(&pf->cond);
+	NOWDB_IGNORE(nowdb_unlock(&pf->lock));
+
+	for(int i=0; i<pf->running; i++) {
+		NOWDB_IGNORE(nowdb_task_join(pf->tasks[i]));
+	}
+	pf->running = 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Destroy
+ * ------------------------------------------------------------------------
+ */
+void nowdb_prefetch_destroy(nowdb_prefetch_t *pf) {
+	if (pf == NULL) return;
+
+	stopTasks(pf);
+
+	if (pf->current != NULL) {
+		NOWDB_IGNORE(closeCurrent(pf));
+		pf->current = NULL;
+	}
+	if (pf->slots != NULL) {
+		for(int i=0; i<pf->depth; i++) {
+			if (pf->slots[i].err != NOWDB_OK) {
+				nowdb_err_release(pf->slots[i].err);
+			}
+			if (pf->slots[i].raw != NULL) {
+				free(pf->slots[i].raw);
+			}
+			if (pf->slots[i].page != NULL) {
+				free(pf->slots[i].page);
+			}
+			if (pf->slots[i].xbuf != NULL) {
+				free(pf->slots[i].xbuf);
+			}
+		}
+		free(pf->slots); pf->slots = NULL;
+	}
+	if (pf->tasks != NULL) {
+		free(pf->tasks); pf->tasks = NULL;
+	}
+	pthread_cond_destroy(&pf->cond);
+	nowdb_lock_destroy(&pf->iolock);
+	nowdb_lock_destroy(&pf->lock);
+}
+
+/* ------------------------------------------------------------------------
+ * Allocate and start a prefetcher
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_prefetch_new(nowdb_prefetch_t  **pf,
+                               ts_algo_list_t  *files,
+                               uint32_t         depth,
+                               nowdb_time_t      from,
+                               nowdb_time_t        to,
+                               nowdb_zone_check_t check,
+                               void               *arg) {
+	nowdb_err_t err;
+
+	if (pf == NULL) return nowdb_err_get(nowdb_err_invalid,
+	         FALSE, OBJECT, "pointer to prefetcher is NULL");
+	if (files == NULL) return nowdb_err_get(nowdb_err_invalid,
+	                   FALSE, OBJECT, "files object is NULL");
+	if (depth == 0) return nowdb_err_get(nowdb_err_invalid,
+	                       FALSE, OBJECT, "depth is zero");
+
+	if (depth > NOWDB_PREFETCH_MAXDEPTH) {
+		depth = NOWDB_PREFETCH_MAXDEPTH;
+	}
+
+	*pf = calloc(1, sizeof(nowdb_prefetch_t));
+	if (*pf == NULL) {
+		NOMEM("allocating prefetcher");
+		return err;
+	}
+
+	(*pf)->current = files->head;
+	(*pf)->from = from;
+	(*pf)->to = to;
+	(*pf)->check = check;
+	(*pf)->arg = arg;
+	(*pf)->depth = depth;
+	(*pf)->ntasks = depth < NOWDB_PREFETCH_MAXTASKS?
+	                depth : NOWDB_PREFETCH_MAXTASKS;
+
+	err = nowdb_lock_init(&(*pf)->lock);
+	if (err != NOWDB_OK) {
+		free(*pf); *pf = NULL; return err;
+	}
+	err = nowdb_lock_init(&(*pf)->iolock);
+	if (err != NOWDB_OK) {
+		nowdb_lock_destroy(&(*pf)->lock);
+		free(*pf); *pf = NULL; return err;
+	}
+	if (pthread_cond_init(&(*pf)->cond, NULL) != 0) {
+		nowdb_lock_destroy(&(*pf)->iolock);
+		nowdb_lock_destroy(&(*pf)->lock);
+		free(*pf); *pf = NULL;
+		return nowdb_err_get(nowdb_err_thread, TRUE, OBJECT,
+		                          "initialising condition");
+	}
+
+	err = allocSlots(*pf, files);
+	if (err != NOWDB_OK) goto failure;
+
+	(*pf)->tasks = calloc((*pf)->ntasks, sizeof(nowdb_task_t));
+	if ((*pf)->tasks == NULL) {
+		NOMEM("allocating tasks");
+		goto failure;
+	}
+	for(int i=0; i<(*pf)->ntasks; i++) {
+		err = nowdb_task_create((*pf)->tasks+i, &prefetch, *pf);
+		if (err != NOWDB_OK) goto failure;
+		(*pf)->running++;
+	}
+	return NOWDB_OK;
+
+failure:
+	nowdb_prefetch_destroy(*pf);
+	free(*pf); *pf = NULL;
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Next
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_prefetch_next(nowdb_prefetch_t *pf,
+                                char          **page,
+                                nowdb_file_t  **file) {
+	nowdb_prefetch_slot_t *slot;
+	nowdb_err_t err;
+
+	err = nowdb_lock(&pf->lock);
+	if (err != NOWDB_OK) return err;
+
+	/* release the page we are holding */
+	if (pf->holder) {
+		SLOT(pf, pf->head)->state = SLOT_FREE;
+		pf->head++; pf->holder = 0;
+		pthread_cond_broadcast(&pf->cond);
+	}
+
+	/* wait for the next one */
+	slot = SLOT(pf, pf->head);
+	while(slot->state != SLOT_READY) {
+		pthread_cond_wait(&pf->cond, &pf->lock);
+	}
+
+	/* error or eof: keep on returning eof */
+	if (slot->err != NOWDB_OK) {
+		err = slot->err;
+		slot->err = nowdb_err_get(nowdb_err_eof, FALSE, OBJECT, NULL);
+		NOWDB_IGNORE(nowdb_unlock(&pf->lock));
+		return err;
+	}
+
+	pf->holder = 1;
+	if (slot->pass) {
+		*page = NULL;
+		*file = slot->file;
+	} else {
+		*page = slot->page;
+		*file = slot->file;
+	}
+	return nowdb_unlock(&pf->lock);
+}
+
+/* ------------------------------------------------------------------------
+ * Narrow period
+ * ------------------------------------------------------------------------
+ */
+void nowdb_prefetch_setPeriod(nowdb_prefetch_t *pf,
+                              nowdb_time_t    from,
+                              nowdb_time_t      to) {
+	NOWDB_IGNORE(nowdb_lock(&pf->iolock));
+	pf->from = from;
+	pf->to = to;
+	NOWDB_IGNORE(nowdb_unlock(&pf->iolock));
+}
@@ -0,0 +1,140 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Prefetch: asynchronous read-ahead for sequential scans
+ * ========================================================================
+ * The prefetcher walks through a list of files and
+ * loads the next relevant blocks into a ring of pages
+ * while the caller consumes the current one.
+ * A small number of background tasks take turns in
+ * reading blocks (reading is sequential per file);
+ * decompression runs in parallel.
+ *
+ * Blocks of uncompressed files are not prefetched:
+ * for such a file, the prefetcher delivers a 'pass'
+ * and the caller reads the file itself.
+ * ========================================================================
+ */
+#ifndef nowdb_prefetch_decl
+#define nowdb_prefetch_decl
+
+#include <nowdb/types/types.h>
+#include <nowdb/types/error.h>
+#include <nowdb/types/time.h>
+#include <nowdb/task/lock.h>
+#include <nowdb/task/task.h>
+#include <nowdb/io/file.h>
+
+#include <tsalgo/list.h>
+
+#include <pthread.h>
+
+/* ------------------------------------------------------------------------
+ * Limits
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_PREFETCH_MAXDEPTH 64
+#define NOWDB_PREFETCH_MAXTASKS  4
+
+/* ------------------------------------------------------------------------
+ * Slot in the ring of pages
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	nowdb_file_t  *file; /* file the block belongs to    */
+	char           *raw; /* block as stored on disk      */
+	char          *page; /* decompressed page            */
+	char          *xbuf; /* buffer for decoding          */
+	uint32_t       size; /* size of the raw block        */
+	nowdb_err_t     err; /* error (or eof) of this slot  */
+	char          state; /* free, loading or ready       */
+	char           pass; /* caller shall read file       */
+} nowdb_prefetch_slot_t;
+
+/* ------------------------------------------------------------------------
+ * Prefetcher
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	nowdb_lock_t            lock; /* protects the ring            */
+	nowdb_lock_t          iolock; /* serialises reading           */
+	pthread_cond_t          cond; /* slot state has changed       */
+	ts_algo_list_node_t *current; /* file we are reading          */
+	nowdb_time_t            from; /* start of period              */
+	nowdb_time_t              to; /* end of period                */
+	nowdb_zone_check_t     check; /* zone map check               */
+	void                    *arg; /* argument for the check       */
+	nowdb_prefetch_slot_t *slots; /* the ring                     */
+	nowdb_task_t          *tasks; /* background tasks             */
+	uint32_t               depth; /* number of slots              */
+	uint32_t              ntasks; /* number of tasks              */
+	uint32_t             running; /* number of tasks started      */
+	uint32_t                head; /* next slot to consume         */
+	uint32_t                tail; /* next slot to fill            */
+	char                  opened; /* current file is ready        */
+	char                 closeit; /* close current file after use */
+	char                  holder; /* caller holds a slot          */
+	char                     eof; /* no more blocks to read       */
+	char                    stop; /* terminate tasks              */
+} nowdb_prefetch_t;
+
+/* ------------------------------------------------------------------------
+ * Check whether prefetching makes sense for these files
+ * (i.e. there is at least one compressed file)
+ * ------------------------------------------------------------------------
+ */
+char nowdb_prefetch_useful(ts_algo_list_t *files);
+
+/* ------------------------------------------------------------------------
+ * Allocate and start a prefetcher
+ * -------------------------------
+ * - files: the files to read (starting from the head);
+ *          the files must be closed; the prefetcher opens and
+ *          closes them as needed.
+ * - depth: number of pages to read ahead
+ * - from, to, check, arg: as in nowdb_file_moveZone;
+ *          'check' is called by background tasks
+ *          (but never concurrently).
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_prefetch_new(nowdb_prefetch_t  **pf,
+                               ts_algo_list_t  *files,
+                               uint32_t         depth,
+                               nowdb_time_t      from,
+                               nowdb_time_t        to,
+                               nowdb_zone_check_t check,
+                               void               *arg);
+
+/* ------------------------------------------------------------------------
+ * Stop the background tasks and destroy the prefetcher
+ * ------------------------------------------------------------------------
+ */
+void nowdb_prefetch_destroy(nowdb_prefetch_t *pf);
+
+/* ------------------------------------------------------------------------
+ * Next
+ * ----
+ * Releases the page obtained by the previous call and
+ * waits for the next one.
+ * On success, either 'page' points to the next page or,
+ * if 'page' is NULL, 'file' points to an uncompressed file
+ * the caller shall read itself.
+ * At the end, EOF is returned.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_prefetch_next(nowdb_prefetch_t *pf,
+                                char          **page,
+                                nowdb_file_t  **file);
+
+/* ------------------------------------------------------------------------
+ * Narrow period
+ * -------------
+ * Blocks read from now on must overlap with the new period;
+ * blocks already in the ring are still delivered.
+ * ------------------------------------------------------------------------
+ */
+void nowdb_prefetch_setPeriod(nowdb_prefetch_t *pf,
+                              nowdb_time_t    from,
+                              nowdb_time_t      to);
+
+#endif
@@ -350,6 +350,13 @@ static inline nowdb_err_t fields2keys(nowdb_scope_t  *scope,
 
 	if (fields->len == 0) return NOWDB_OK;
 
+	/* only fields can be index keys */
+	for(runner=fields->head; runner!=NULL; runner=runner->nxt) {
+		if (nowdb_expr_type(runner->cont) != NOWDB_EXPR_FIELD) {
+			return NOWDB_OK;
+		}
+	}
+
 	*keys = calloc(1,sizeof(nowdb_index_keys_t));
 	if (*keys == NULL) {
 		NOMEM("allocating keys");
@@ -479,6 +486,33 @@ static inline nowdb_err_t getIndices(nowdb_scope_t  *scope,
 	return err;
 }
 
+/* ------------------------------------------------------------------------
+ * Helper: the joined target ('edge JOIN vertex'),
+ *         i.e. the sub-target, if it is a vertex type
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_ast_t *joined(nowdb_ast_t *trg) {
+	nowdb_ast_t *j = nowdb_ast_target(trg);
+
+	if (j == NULL || j->ntype != NOWDB_AST_TARGET) return NULL;
+	if (j->stype != NOWDB_AST_TYPE) return NULL;
+	return j;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: name refers to target
+ *         (if the target has an alias, we must use the alias)
+ * ------------------------------------------------------------------------
+ */
+static inline char isTarget(nowdb_ast_t *trg, char *name) {
+	nowdb_ast_t *a;
+
+	if (trg == NULL || name == NULL) return 0;
+	a = nowdb_ast_alias(trg);
+	if (a != NULL) return (strcasecmp(a->value, name) == 0);
+	return (strcasecmp(trg->value, name) == 0);
+}
+
 /* ------------------------------------------------------------------------
  * Add vertex type to filter
  * ------------------------------------------------------------------------
@@ -547,6 +581,12 @@ static inline nowdb_err_t getFilter(nowdb_scope_t *scope,
 		err = nowdb_model_getVertexByName(scope->model,
 		                               trg->value, &v);
 	if (err != NOWDB_OK) return err;
+
+	if (e != NULL && joined(trg) != NULL) {
+		err = nowdb_model_getVertexByName(scope->model,
+		                          joined(trg)->value, &v);
+		if (err != NOWDB_OK) return err;
+	}
 	op = nowdb_ast_field(ast);
 	if (op != NULL) {
 
@@ -769,6 +809,91 @@ static inline nowdb_err_t getEdgeField(nowdb_scope_t  *scope,
 	return NOWDB_OK;
 }
 
+/* ------------------------------------------------------------------------
+ * Get field from edge or vertex in a join
+ * ---------------------------------------
+ * The joined record is the edge followed by the vertex.
+ * Unqualified fields are searched in the edge first.
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t getJoinField(nowdb_scope_t    *scope,
+                                nowdb_expr_t       *exp,
+                                nowdb_model_vertex_t *v,
+                                nowdb_model_edge_t   *e,
+                                nowdb_ast_t        *trg,
+                                nowdb_ast_t      *field) {
+	nowdb_err_t err;
+	nowdb_ast_t *q;
+
+	q = nowdb_ast_alias(field);
+	if (q != NULL) {
+		if (isTarget(trg, q->value)) {
+			return getEdgeField(scope, exp, e, field);
+		}
+		if (!isTarget(joined(trg), q->value)) {
+			INVALIDAST("unknown qualifier");
+		}
+	} else {
+		err = getEdgeField(scope, exp, e, field);
+		if (err == NOWDB_OK) return NOWDB_OK;
+		if (err->errcode != nowdb_err_key_not_found) return err;
+		nowdb_err_release(err);
+	}
+	err = getVertexField(scope, exp, v, field);
+	if (err != NOWDB_OK) return err;
+
+	nowdb_expr_setBase(*exp, e->size);
+	return NOWDB_OK;
+}
+
+/* -----------------------------------------------------------------------
+ * Helper: get the rank of percentile,
+ *         i.e. the constant following the first parameter
+ * -----------------------------------------------------------------------
+ */
+static nowdb_err_t getRank(nowdb_scope_t    *scope,
+                           nowdb_model_vertex_t *v,
+                           nowdb_model_edge_t   *e,
+                           uint32_t         limits,
+                           nowdb_ast_t        *trg,
+                           nowdb_ast_t      *param,
+                           nowdb_value_t     *init) {
+	nowdb_err_t err;
+	nowdb_expr_t rank=NULL;
+	nowdb_type_t t;
+	void *value=NULL;
+	double p;
+	char dummy;
+
+	if (param == NULL) INVALIDAST("PERCENTILE needs a field and a rank");
+	param = nowdb_ast_nextParam(param);
+	if (param == NULL) INVALIDAST("PERCENTILE needs a field and a rank");
+
+	err = getExpr(scope, v, e, limits, trg, param, &rank, &dummy);
+	if (err != NOWDB_OK) return err;
+
+	if (nowdb_expr_type(rank) != NOWDB_EXPR_CONST) {
+		nowdb_expr_destroy(rank); free(rank);
+		INVALIDAST("rank of PERCENTILE must be a constant");
+	}
+	err = nowdb_expr_eval(rank, NULL, NULL, &t, &value);
+	if (err != NOWDB_OK) {
+		nowdb_expr_destroy(rank); free(rank);
+		return err;
+	}
+	switch(t) {
+	case NOWDB_TYP_FLOAT: memcpy(&p, value, 8); break;
+	case NOWDB_TYP_UINT: p = (double)(*(uint64_t*)value); break;
+	case NOWDB_TYP_INT: p = (double)(*(int64_t*)value); break;
+	default:
+		nowdb_expr_destroy(rank); free(rank);
+		INVALIDAST("rank of PERCENTILE must be a number");
+	}
+	nowdb_expr_destroy(rank); free(rank);
+	memcpy(init, &p, 8);
+	return NOWDB_OK;
+}
+
 /* -----------------------------------------------------------------------
  * Make agg function
  * shall be recursive (for future use with expressions)
@@ -787,6 +912,7 @@ static nowdb_err_t makeAgg(nowdb_scope_t    *scope,
 	nowdb_content_t cont;
 	nowdb_fun_t *f;
 	nowdb_expr_t myx=NULL;
+	nowdb_value_t init=0;
 	char dummy;
 
 	cont = trg->stype == NOWDB_AST_CONTEXT?NOWDB_CONT_EDGE:
@@ -796,8 +922,22 @@ static nowdb_err_t makeAgg(nowdb_scope_t    *scope,
 		err = getExpr(scope, v, e, limits, trg, param, &myx, &dummy);
 		if (err != NOWDB_OK) return err;
 	}
-	err = nowdb_fun_new(&f, op, cont, myx, NULL);
-	if (err != NOWDB_OK) return err;
+	if (op == NOWDB_FUN_PERCENTILE) {
+		err = getRank(scope, v, e, limits, trg, param, &init);
+		if (err != NOWDB_OK) {
+			if (myx != NULL) {
+				nowdb_expr_destroy(myx); free(myx);
+			}
+			return err;
+		}
+	}
+	err = nowdb_fun_new(&f, op, cont, myx, &init);
+	if (err != NOWDB_OK) {
+		if (myx != NULL) {
+			nowdb_expr_destroy(myx); free(myx);
+		}
+		return err;
+	}
 
 	err = nowdb_expr_newAgg(expr, NOWDB_FUN_AS_AGG(f));
 	if (err != NOWDB_OK) {
@@ -1101,6 +1241,12 @@ static nowdb_err_t makeFun(nowdb_scope_t    *scope,
 	if (op < 0) {
 		INVALIDAST("unknown operator");
 	}
+	if (field->stype == NOWDB_AST_DISTINCT) {
+		if (op != NOWDB_FUN_COUNT) {
+			INVALIDAST("DISTINCT is only supported with COUNT");
+		}
+		op = NOWDB_FUN_COUNTDISTINCT;
+	}
 	if (x) {
 		if (!(limits & NOWDB_PLAN_OK_AGG)) {
 			INVALIDAST("aggregate not allowed here");
@@ -1165,7 +1311,11 @@ static nowdb_err_t getExpr(nowdb_scope_t    *scope,
 		}
 
 		/* we need to distinguish the target! */
-		if (trg->stype == NOWDB_AST_CONTEXT) {
+		if (e != NULL && v != NULL) {
+			err = getJoinField(scope, expr, v, e, trg, field);
+			if (err != NOWDB_OK) return err;
+
+		} else if (trg->stype == NOWDB_AST_CONTEXT) {
 			err = getEdgeField(scope, expr, e, field);
 			if (err != NOWDB_OK) return err;
 
@@ -1212,6 +1362,43 @@ static inline nowdb_err_t filterAgg(nowdb_expr_t expr,
 	return NOWDB_OK;
 }
 
+/* -----------------------------------------------------------------------
+ * Get all fields of the joined vertex type
+ * -----------------------------------------------------------------------
+ */
+static nowdb_err_t getJoinedFields(nowdb_scope_t    *scope,
+                                   nowdb_ast_t        *trg,
+                                   uint32_t           base,
+                                   ts_algo_list_t   *fields) {
+	nowdb_err_t err = NOWDB_OK;
+	nowdb_model_vertex_t *v;
+	ts_algo_list_t     props;
+	ts_algo_list_node_t *run;
+	nowdb_model_prop_t    *p;
+	nowdb_expr_t         exp;
+
+	err = nowdb_model_getVertexByName(scope->model, trg->value, &v);
+	if (err != NOWDB_OK) return err;
+
+	ts_algo_list_init(&props);
+	err = nowdb_model_getProperties(scope->model, v->roleid, &props);
+	if (err != NOWDB_OK) return err;
+
+	for (run=props.head; run!=NULL; run=run->nxt) {
+		p = run->cont;
+		err = nowdb_expr_newVertexField(&exp, p->name, v->roleid,
+		                                p->off, p->value, v->num);
+		if (err != NOWDB_OK) break;
+		nowdb_expr_setBase(exp, base);
+		if (ts_algo_list_append(fields, exp) != TS_ALGO_OK) {
+			nowdb_expr_destroy(exp); free(exp);
+			NOMEM("list.append"); break;
+		}
+	}
+	ts_algo_list_destroy(&props);
+	return err;
+}
+
 /* -----------------------------------------------------------------------
  * Get all fields for projection (i.e. 'select *')
  * -----------------------------------------------------------------------
@@ -1282,6 +1469,16 @@ static inline nowdb_err_t getAllFields(nowdb_scope_t    *scope,
 		free(*fields); *fields = NULL;
 		return err;
 	}
+
+	// the joined vertex follows the edge
+	if (e != NULL && joined(trg) != NULL) {
+		err = getJoinedFields(scope, joined(trg), e->size, *fields);
+		if (err != NOWDB_OK) {
+			destroyFieldList(*fields);
+			free(*fields); *fields = NULL;
+			return err;
+		}
+	}
 	return NOWDB_OK;
 }
 
@@ -1321,6 +1518,13 @@ static inline nowdb_err_t getFields(nowdb_scope_t    *scope,
 		if (err != NOWDB_OK) return err;
 	}
 
+	// get joined vertex type
+	if (e != NULL && joined(trg) != NULL) {
+		err = nowdb_model_getVertexByName(scope->model,
+		                          joined(trg)->value, &v);
+		if (err != NOWDB_OK) return err;
+	}
+
 	*fields = calloc(1, sizeof(ts_algo_list_t));
 	if (*fields == NULL) {
 		NOMEM("allocating list");
@@ -1405,6 +1609,60 @@ static inline nowdb_err_t compareForGrouping(ts_algo_list_t *grp,
 	return NOWDB_OK;
 }
 
+/* -----------------------------------------------------------------------
+ * ordering with grouping must be on group keys;
+ * prefix tells whether ordering is a prefix of grouping,
+ * i.e. the groups come in the requested order
+ * when they are delivered in the order of the group keys.
+ * -----------------------------------------------------------------------
+ */
+static inline nowdb_err_t orderByGroup(ts_algo_list_t *grp,
+                                       ts_algo_list_t *ord,
+                                       char        *prefix) {
+	ts_algo_list_node_t *grun, *orun;
+	char found;
+
+	*prefix = 1;
+	grun = grp->head;
+	for(orun=ord->head; orun!=NULL; orun=orun->nxt) {
+		if (grun == NULL ||
+		    !nowdb_expr_equal(grun->cont, orun->cont)) *prefix = 0;
+		if (grun != NULL) grun = grun->nxt;
+		found = 0;
+		for(ts_algo_list_node_t *r=grp->head; r!=NULL; r=r->nxt) {
+			if (nowdb_expr_equal(r->cont, orun->cont)) {
+				found = 1; break;
+			}
+		}
+		if (!found) INVALIDAST("ordering not on group keys");
+	}
+	return NOWDB_OK;
+}
+
+/* -----------------------------------------------------------------------
+ * Release indices found for grouping
+ * -----------------------------------------------------------------------
+ */
+static inline nowdb_err_t releaseIndices(ts_algo_list_t *idxes) {
+	nowdb_err_t err=NOWDB_OK, err2;
+	ts_algo_list_node_t *runner;
+	nowdb_plan_idx_t *pidx;
+
+	for(runner=idxes->head; runner!=NULL; runner=runner->nxt) {
+		pidx = runner->cont;
+		if (pidx->idx != NULL) {
+			err2 = nowdb_index_enduse(pidx->idx);
+			if (err2 != NOWDB_OK) {
+				err2->cause = err; err = err2;
+			}
+		}
+		destroyPlanIdx(pidx);
+	}
+	ts_algo_list_destroy(idxes);
+	ts_algo_list_init(idxes);
+	return err;
+}
+
 /* -----------------------------------------------------------------------
  * Adjust target to what it is according to model
  * -----------------------------------------------------------------------
@@ -1429,6 +1687,433 @@ static inline nowdb_err_t adjustTarget(nowdb_scope_t *scope,
 	return NOWDB_OK;
 }
 
+/* ------------------------------------------------------------------------
+ * Helper: add limit node
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t addLimit(ts_algo_list_t     *plan,
+                            nowdb_plan_limit_t  *lim) {
+	nowdb_err_t err;
+	nowdb_plan_t *stp;
+
+	stp = malloc(sizeof(nowdb_plan_t));
+	if (stp == NULL) {
+		NOMEM("allocating plan");
+		nowdb_plan_destroy(plan, FALSE);
+		return err;
+	}
+
+	stp->ntype = NOWDB_PLAN_LIMIT;
+	stp->stype = 0;
+	stp->helper = 0;
+	stp->name = NULL;
+	stp->load = malloc(sizeof(nowdb_plan_limit_t));
+	if (stp->load == NULL) {
+		NOMEM("allocating limit");
+		nowdb_plan_destroy(plan, FALSE);
+		free(stp); return err;
+	}
+	memcpy(stp->load, lim, sizeof(nowdb_plan_limit_t));
+
+	if (ts_algo_list_append(plan, stp) != TS_ALGO_OK) {
+		NOMEM("list.append");
+		nowdb_plan_destroy(plan, FALSE);
+		free(stp->load); free(stp);
+		return err;
+	}
+	return NOWDB_OK;
+}
+
+/* -----------------------------------------------------------------------
+ * Fold the constants in a field list
+ * -----------------------------------------------------------------------
+ */
+static nowdb_err_t foldFields(ts_algo_list_t *fields, nowdb_time_t now) {
+	nowdb_err_t err;
+	ts_algo_list_node_t *runner;
+
+	if (fields == NULL) return NOWDB_OK;
+	for(runner=fields->head; runner!=NULL; runner=runner->nxt) {
+		err = nowdb_expr_fold((nowdb_expr_t*)&runner->cont, now);
+		if (err != NOWDB_OK) return err;
+	}
+	return NOWDB_OK;
+}
+
+/* -----------------------------------------------------------------------
+ * Compile the expressions in a field list
+ * -----------------------------------------------------------------------
+ */
+static nowdb_err_t compileFields(ts_algo_list_t *fields) {
+	nowdb_err_t err;
+	ts_algo_list_node_t *runner;
+
+	if (fields == NULL) return NOWDB_OK;
+	for(runner=fields->head; runner!=NULL; runner=runner->nxt) {
+		err = nowdb_expr_compile(runner->cont);
+		if (err != NOWDB_OK) return err;
+	}
+	return NOWDB_OK;
+}
+
+/* -----------------------------------------------------------------------
+ * Helper: collect the conjuncts of a condition
+ * -----------------------------------------------------------------------
+ */
+static nowdb_err_t conjuncts(nowdb_expr_t expr, ts_algo_list_t *list) {
+	nowdb_err_t err;
+
+	if (nowdb_expr_type(expr) == NOWDB_EXPR_OP &&
+	    OP(expr)->fun == NOWDB_EXPR_OP_AND) {
+		for(int i=0; i<OP(expr)->args; i++) {
+			err = conjuncts(ARG(expr,i), list);
+			if (err != NOWDB_OK) return err;
+		}
+		return NOWDB_OK;
+	}
+	if (ts_algo_list_append(list, expr) != TS_ALGO_OK) {
+		NOMEM("list.append");
+		return err;
+	}
+	return NOWDB_OK;
+}
+
+/* -----------------------------------------------------------------------
+ * Helper: add conjunct to condition
+ *         (the conjunct is destroyed on error)
+ * -----------------------------------------------------------------------
+ */
+static nowdb_err_t addConjunct(nowdb_expr_t *cond, nowdb_expr_t c) {
+	nowdb_err_t err;
+	nowdb_expr_t a;
+
+	if (*cond == NULL) {
+		*cond = c; return NOWDB_OK;
+	}
+	err = nowdb_expr_newOp(&a, NOWDB_EXPR_OP_AND, *cond, c);
+	if (err != NOWDB_OK) {
+		nowdb_expr_destroy(c); free(c);
+		return err;
+	}
+	*cond = a;
+	return NOWDB_OK;
+}
+
+/* -----------------------------------------------------------------------
+ * Helper: conjunct is the join key, i.e.
+ *         edge.origin (or destin) = vertex.pk
+ * -----------------------------------------------------------------------
+ */
+static char joinKey(nowdb_expr_t            c,
+                    nowdb_model_edge_t     *e,
+                    nowdb_model_vertex_t   *v,
+                    uint32_t             *key) {
+	nowdb_field_t *ef=NULL, *vf=NULL;
+
+	if (nowdb_expr_type(c) != NOWDB_EXPR_OP) return 0;
+	if (OP(c)->fun != NOWDB_EXPR_OP_EQ) return 0;
+
+	for(int i=0; i<2; i++) {
+		if (nowdb_expr_type(ARG(c,i)) != NOWDB_EXPR_FIELD) return 0;
+		if (FIELD(ARG(c,i))->content == NOWDB_CONT_EDGE) {
+			ef = FIELD(ARG(c,i));
+		} else {
+			vf = FIELD(ARG(c,i));
+		}
+	}
+	if (ef == NULL || vf == NULL) return 0;
+	if (vf->name == NULL || vf->off != NOWDB_OFF_VERTEX) return 0;
+	if (vf->role != v->roleid) return 0;
+
+	if (ef->off == NOWDB_OFF_ORIGIN && e->origin == v->roleid) {
+		*key = NOWDB_OFF_ORIGIN; return 1;
+	}
+	if (ef->off == NOWDB_OFF_DESTIN && e->destin == v->roleid) {
+		*key = NOWDB_OFF_DESTIN; return 1;
+	}
+	return 0;
+}
+
+/* -----------------------------------------------------------------------
+ * Get join condition
+ * ------------------
+ * Finds the join key in the 'on' condition;
+ * all other conjuncts are added to the filter.
+ * -----------------------------------------------------------------------
+ */
+static nowdb_err_t getJoin(nowdb_scope_t    *scope,
+                           nowdb_ast_t        *trg,
+                           nowdb_ast_t       *join,
+                           nowdb_expr_t    *filter,
+                           uint32_t           *key,
+                           uint32_t         *esize,
+                           uint32_t         *vsize) {
+	nowdb_err_t err;
+	nowdb_model_edge_t   *e;
+	nowdb_model_vertex_t *v;
+	ts_algo_list_t cs;
+	ts_algo_list_node_t *run;
+	nowdb_expr_t on=NULL, c;
+	uint32_t limits;
+	char found=0;
+	char x=0;
+
+	err = nowdb_model_getEdgeByName(scope->model, trg->value, &e);
+	if (err != NOWDB_OK) return err;
+
+	err = nowdb_model_getVertexByName(scope->model,
+	                          joined(trg)->value, &v);
+	if (err != NOWDB_OK) return err;
+
+	if (e->size + v->size > sizeof(nowdb_nullrec)) {
+		return nowdb_err_get(nowdb_err_not_supp, FALSE, OBJECT,
+		                           "joined record is too big");
+	}
+
+	NOWDB_PLAN_OK_ALL(limits);
+	NOWDB_PLAN_OK_REMOVE(limits,NOWDB_PLAN_OK_AGG);
+	NOWDB_PLAN_OK_REMOVE(limits,NOWDB_PLAN_NEED_TEXT);
+	err = getExpr(scope, v, e, limits, trg,
+	              nowdb_ast_on(join), &on, &x);
+	if (err != NOWDB_OK) return err;
+
+	ts_algo_list_init(&cs);
+	err = conjuncts(on, &cs);
+	if (err != NOWDB_OK) {
+		ts_algo_list_destroy(&cs);
+		nowdb_expr_destroy(on); free(on);
+		return err;
+	}
+	for(run=cs.head; run!=NULL; run=run->nxt) {
+		if (!found && joinKey(run->cont, e, v, key)) {
+			found = 1; continue;
+		}
+		err = nowdb_expr_copy(run->cont, &c);
+		if (err != NOWDB_OK) break;
+		err = addConjunct(filter, c);
+		if (err != NOWDB_OK) break;
+	}
+	ts_algo_list_destroy(&cs);
+	nowdb_expr_destroy(on); free(on);
+	if (err != NOWDB_OK) return err;
+
+	if (!found) {
+		return nowdb_err_get(nowdb_err_not_supp, FALSE, OBJECT,
+		        "join must be on edge origin or destin = vertex");
+	}
+	*esize = e->size;
+	*vsize = v->size;
+	return NOWDB_OK;
+}
+
+/* -----------------------------------------------------------------------
+ * Split filter of a join into
+ * - the filter on the edge (remains in filter)
+ * - the filter on the vertex (the fields lose their base)
+ * - the filter on the joined record
+ * -----------------------------------------------------------------------
+ */
+static nowdb_err_t splitFilter(nowdb_expr_t  *filter,
+                               nowdb_expr_t *vfilter,
+                               nowdb_expr_t *jfilter) {
+	nowdb_err_t err=NOWDB_OK;
+	nowdb_expr_t ef=NULL, c;
+	ts_algo_list_t cs, fs;
+	ts_algo_list_node_t *run, *f;
+	char hasE, hasV;
+
+	*vfilter = NULL;
+	*jfilter = NULL;
+
+	if (*filter == NULL) return NOWDB_OK;
+
+	ts_algo_list_init(&cs);
+	err = conjuncts(*filter, &cs);
+	if (err != NOWDB_OK) {
+		ts_algo_list_destroy(&cs);
+		return err;
+	}
+	for(run=cs.head; run!=NULL; run=run->nxt) {
+		ts_algo_list_init(&fs);
+		err = nowdb_expr_filter(run->cont, NOWDB_EXPR_FIELD, &fs);
+		if (err != NOWDB_OK) break;
+
+		hasE = 0; hasV = 0;
+		for(f=fs.head; f!=NULL; f=f->nxt) {
+			if (FIELD(f->cont)->content == NOWDB_CONT_EDGE) hasE=1;
+			else hasV=1;
+		}
+		ts_algo_list_destroy(&fs);
+
+		err = nowdb_expr_copy(run->cont, &c);
+		if (err != NOWDB_OK) break;
+
+		if (hasV && hasE) {
+			err = addConjunct(jfilter, c);
+
+		} else if (hasV) {
+			ts_algo_list_init(&fs);
+			err = nowdb_expr_filter(c, NOWDB_EXPR_FIELD, &fs);
+			if (err != NOWDB_OK) {
+				nowdb_expr_destroy(c); free(c); break;
+			}
+			for(f=fs.head; f!=NULL; f=f->nxt) {
+				nowdb_expr_setBase(f->cont, 0);
+			}
+			ts_algo_list_destroy(&fs);
+			err = addConjunct(vfilter, c);
+
+		} else {
+			err = addConjunct(&ef, c);
+		}
+		if (err != NOWDB_OK) break;
+	}
+	ts_algo_list_destroy(&cs);
+	if (err != NOWDB_OK) {
+		if (ef != NULL) {
+			nowdb_expr_destroy(ef); free(ef);
+		}
+		if (*vfilter != NULL) {
+			nowdb_expr_destroy(*vfilter); free(*vfilter);
+			*vfilter = NULL;
+		}
+		if (*jfilter != NULL) {
+			nowdb_expr_destroy(*jfilter); free(*jfilter);
+			*jfilter = NULL;
+		}
+		return err;
+	}
+	nowdb_expr_destroy(*filter); free(*filter);
+	*filter = ef;
+	return NOWDB_OK;
+}
+
+/* -----------------------------------------------------------------------
+ * Helper: destroy join
+ * -----------------------------------------------------------------------
+ */
+static void destroyJoin(nowdb_plan_join_t *j) {
+	if (j->vfilter != NULL) {
+		nowdb_expr_destroy(j->vfilter);
+		free(j->vfilter); j->vfilter = NULL;
+	}
+	if (j->filter != NULL) {
+		nowdb_expr_destroy(j->filter);
+		free(j->filter); j->filter = NULL;
+	}
+}
+
+/* -----------------------------------------------------------------------
+ * Helper: add join node
+ * (the join is destroyed on error)
+ * -----------------------------------------------------------------------
+ */
+static nowdb_err_t addJoin(ts_algo_list_t       *plan,
+                           nowdb_ast_t           *trg,
+                           uint32_t            method,
+                           uint32_t               key,
+                           nowdb_plan_join_t    *join,
+                           nowdb_time_t          now) {
+	nowdb_err_t err;
+	nowdb_plan_t *stp;
+
+	err = nowdb_expr_fold(&join->vfilter, now);
+	if (err == NOWDB_OK) err = nowdb_expr_fold(&join->filter, now);
+	if (err == NOWDB_OK && join->vfilter != NULL) {
+		err = nowdb_expr_compile(join->vfilter);
+	}
+	if (err == NOWDB_OK && join->filter != NULL) {
+		err = nowdb_expr_compile(join->filter);
+	}
+	if (err != NOWDB_OK) {
+		destroyJoin(join); return err;
+	}
+
+	stp = malloc(sizeof(nowdb_plan_t));
+	if (stp == NULL) {
+		NOMEM("allocating plan");
+		destroyJoin(join); return err;
+	}
+	stp->ntype = NOWDB_PLAN_JOIN;
+	stp->stype = method;
+	stp->helper = (int)key;
+	stp->name = joined(trg)->value;
+	stp->load = malloc(sizeof(nowdb_plan_join_t));
+	if (stp->load == NULL) {
+		NOMEM("allocating join");
+		destroyJoin(join); free(stp);
+		return err;
+	}
+	memcpy(stp->load, join, sizeof(nowdb_plan_join_t));
+
+	if (ts_algo_list_append(plan, stp) != TS_ALGO_OK) {
+		NOMEM("list.append");
+		destroyJoin(stp->load); free(stp->load); free(stp);
+		return err;
+	}
+	return NOWDB_OK;
+}
+
+/* -----------------------------------------------------------------------
+ * Helper: add traverse node
+ * -------------------------
+ * The start vertices are the values below the traverse node;
+ * they must be unsigned integers.
+ * -----------------------------------------------------------------------
+ */
+static nowdb_err_t addTrav(ts_algo_list_t       *plan,
+                           nowdb_ast_t           *trg,
+                           nowdb_ast_t          *trav,
+                           uint32_t             hops) {
+	nowdb_err_t err;
+	nowdb_plan_t *stp;
+	nowdb_plan_trav_t *t;
+	nowdb_ast_t *v;
+	uint64_t n=0;
+
+	for(v=nowdb_ast_value(trav); v!=NULL; v=nowdb_ast_nextParam(v)) n++;
+	if (n == 0) INVALIDAST("no start vertices in traversal");
+
+	t = calloc(1, sizeof(nowdb_plan_trav_t));
+	if (t == NULL) {
+		NOMEM("allocating traversal");
+		return err;
+	}
+	t->vids = calloc(n, sizeof(nowdb_key_t));
+	if (t->vids == NULL) {
+		NOMEM("allocating start vertices");
+		free(t); return err;
+	}
+	for(v=nowdb_ast_value(trav); v!=NULL; v=nowdb_ast_nextParam(v)) {
+		if (v->stype != NOWDB_AST_UINT ||
+		    nowdb_ast_getUInt(v, t->vids+t->n) != 0) {
+			free(t->vids); free(t);
+			return nowdb_err_get(nowdb_err_not_supp, FALSE, OBJECT,
+			      "start vertices must be unsigned integers");
+		}
+		t->n++;
+	}
+
+	stp = malloc(sizeof(nowdb_plan_t));
+	if (stp == NULL) {
+		NOMEM("allocating plan");
+		free(t->vids); free(t); return err;
+	}
+	stp->ntype = NOWDB_PLAN_TRAVERSE;
+	stp->stype = trav->stype == NOWDB_AST_ORIGIN ? NOWDB_PLAN_TRAV_OUT:
+	                                               NOWDB_PLAN_TRAV_IN;
+	stp->helper = (int)hops;
+	stp->name = trg->value;
+	stp->load = t;
+
+	if (ts_algo_list_append(plan, stp) != TS_ALGO_OK) {
+		NOMEM("list.append");
+		free(t->vids); free(t); free(stp);
+		return err;
+	}
+	return NOWDB_OK;
+}
+
 /* -----------------------------------------------------------------------
  * Over-simplistic to get it going:
  * - we assume an ast with a simple target object
@@ -1445,10 +2130,25 @@ nowdb_err_t nowdb_plan_fromAst(nowdb_scope_t  *scope,
 	ts_algo_list_t idxes;
 	nowdb_err_t   err;
 	nowdb_ast_t  *trg, *from, *sel, *group=NULL, *order=NULL;
-	nowdb_ast_t  *field;
+	nowdb_ast_t  *field, *limit, *offset, *join, *trav;
+	nowdb_plan_join_t pjoin;
+	uint32_t jkey=0;
+	uint64_t hops=0;
 	nowdb_plan_t *stp;
+	nowdb_plan_limit_t lim;
+	nowdb_ord_t dir = NOWDB_ORD_ASC;
 	uint32_t limits=0;
+	int ordkind = NOWDB_PLAN_ORDER_NONE;
+	nowdb_time_t now;
 	char hasAgg=0;
+	char hashagg=0;
+	char nested=0;
+
+	/* now() is the same for the whole statement */
+	if (nowdb_time_now(&now) != 0) {
+		return nowdb_err_get(nowdb_err_time, TRUE, OBJECT,
+		                          "getting current time");
+	}
 
 	from = nowdb_ast_from(ast);
 	if (from == NULL) INVALIDAST("no 'from' in DQL");
@@ -1461,13 +2161,58 @@ nowdb_err_t nowdb_plan_fromAst(nowdb_scope_t  *scope,
 	err = adjustTarget(scope, trg);
 	if (err != NOWDB_OK) return err;
 
+	/* edge JOIN vertex */
+	join = nowdb_ast_join(from);
+	if (join != NULL) {
+		if (nowdb_ast_target(trg) == NULL) {
+			INVALIDAST("no target in join");
+		}
+		err = adjustTarget(scope, nowdb_ast_target(trg));
+		if (err != NOWDB_OK) return err;
+		if (trg->stype != NOWDB_AST_CONTEXT ||
+		    joined(trg) == NULL) {
+			return nowdb_err_get(nowdb_err_not_supp, FALSE,
+			    OBJECT, "only edges can be joined with vertices");
+		}
+	}
+	memset(&pjoin, 0, sizeof(nowdb_plan_join_t));
+
+	/* edge TRAVERSE hops FROM origin IN (vertices) */
+	trav = nowdb_ast_traverse(from);
+	if (trav != NULL) {
+		if (trg->stype != NOWDB_AST_CONTEXT) {
+			return nowdb_err_get(nowdb_err_not_supp, FALSE,
+			                OBJECT, "only edges can be traversed");
+		}
+		if (nowdb_ast_getUInt(trav, &hops) != 0 ||
+		    hops > UINT32_MAX) {
+			INVALIDAST("invalid hop limit");
+		}
+	}
+
+	/* get limit and offset */
+	lim.limit = 0;
+	lim.offset = 0;
+	limit = nowdb_ast_limit(ast);
+	if (limit != NULL) {
+		if (nowdb_ast_getUInt(limit, &lim.limit) != 0) {
+			INVALIDAST("invalid limit");
+		}
+		offset = nowdb_ast_offset(limit);
+		if (offset != NULL) {
+			if (nowdb_ast_getUInt(offset, &lim.offset) != 0) {
+				INVALIDAST("invalid offset");
+			}
+		}
+	}
+
 	/* create summary node */
 	stp = malloc(sizeof(nowdb_plan_t));
 	if (stp == NULL) return nowdb_err_get(nowdb_err_no_mem,
 	                      FALSE, OBJECT, "allocating plan");
 	stp->ntype = NOWDB_PLAN_SUMMARY;
 	stp->stype = 0;
-	stp->helper = 1; /* number of targets */
+	stp->helper = join==NULL?1:2; /* number of targets */
 	stp->name = NULL;
 	stp->load = NULL;
 
@@ -1483,6 +2228,33 @@ nowdb_err_t nowdb_plan_fromAst(nowdb_scope_t  *scope,
 		nowdb_plan_destroy(plan, FALSE); return err;
 	}
 
+	/* the join condition goes into the filter,
+	 * which is then split into predicates on the edge,
+	 * on the vertex and on both */
+	if (join != NULL) {
+		err = getJoin(scope, trg, join, &filter, &jkey,
+		              &pjoin.esize, &pjoin.vsize);
+		if (err == NOWDB_OK) {
+			err = splitFilter(&filter, &pjoin.vfilter,
+			                           &pjoin.filter);
+		}
+		if (err != NOWDB_OK) {
+			if (filter != NULL) {
+				nowdb_expr_destroy(filter); free(filter);
+			}
+			nowdb_plan_destroy(plan, FALSE); return err;
+		}
+	}
+
+	err = nowdb_expr_fold(&filter, now);
+	if (err != NOWDB_OK) {
+		if (filter != NULL) {
+			nowdb_expr_destroy(filter); free(filter);
+		}
+		destroyJoin(&pjoin);
+		nowdb_plan_destroy(plan, FALSE); return err;
+	}
+
 	/* init index list */
 	ts_algo_list_init(&idxes);
 
@@ -1522,15 +2294,25 @@ nowdb_err_t nowdb_plan_fromAst(nowdb_scope_t  *scope,
                 NOWDB_PLAN_OK_ALL(limits);
 		NOWDB_PLAN_OK_REMOVE(limits,NOWDB_PLAN_OK_AGG);
 		err = getFields(scope, trg, group, limits, &grp, NULL);
+		if (err == NOWDB_OK) err = foldFields(grp, now);
 		if (err != NOWDB_OK) {
 			if (filter != NULL) {
 				nowdb_expr_destroy(filter); free(filter);
 			}
+			if (grp != NULL) {
+				destroyFieldList(grp); free(grp);
+			}
+			destroyJoin(&pjoin);
 			nowdb_plan_destroy(plan, FALSE); return err;
 		}
-		/* find index for group by */
-		err = getGroupOrderIndex(scope, trg->stype,
-		                  trg->value, grp, &idxes);
+		/* find index for group by
+		 * (group keys of a join may come from the vertex) */
+		if (join == NULL) err = getGroupOrderIndex(scope,
+		                trg->stype, trg->value, grp, &idxes);
+		if (err != NOWDB_OK &&
+		    err->errcode == nowdb_err_key_not_found) {
+			nowdb_err_release(err); err = NOWDB_OK;
+		}
 		if (err != NOWDB_OK) {
 			if (filter != NULL) {
 				nowdb_expr_destroy(filter); free(filter);
@@ -1538,37 +2320,112 @@ nowdb_err_t nowdb_plan_fromAst(nowdb_scope_t  *scope,
 			if (grp != NULL) {
 				destroyFieldList(grp); free(grp);
 			}
+			destroyJoin(&pjoin);
 			nowdb_plan_destroy(plan, FALSE); return err;
 		}
+		/* no index covers the group keys:
+		 * we use hash aggregation and
+		 * the reader is chosen according to the filter */
+		if (idxes.len == 0) hashagg = 1;
 	}
 
-	/* get order by */
+	/* get order by
+	 * with group, the groups are ordered:
+	 * either they come from an index
+	 * on the order keys or they are sorted
+	 * by the hash aggregation */
 	order = nowdb_ast_order(ast);
-	if (order != NULL && idxes.len == 0) {
+	if (order != NULL && group != NULL) {
+		char prefix=0;
+
+		if (order->stype == NOWDB_AST_DESCENDING) {
+			dir = NOWDB_ORD_DESC;
+		}
 		NOWDB_PLAN_OK_ALL(limits);
 		NOWDB_PLAN_OK_REMOVE(limits,NOWDB_PLAN_OK_AGG);
 		err = getFields(scope, trg, order, limits, &ord, NULL);
+		if (err == NOWDB_OK) err = orderByGroup(grp, ord, &prefix);
+
+		/* indices are ascending only */
+		if (err == NOWDB_OK && idxes.len > 0 &&
+		   (!prefix || dir == NOWDB_ORD_DESC)) {
+			err = releaseIndices(&idxes); hashagg = 1;
+		}
 		if (err != NOWDB_OK) {
 			if (filter != NULL) {
 				nowdb_expr_destroy(filter); free(filter);
 			}
+			if (grp != NULL) {
+				destroyFieldList(grp); free(grp);
+			}
+			if (ord != NULL) {
+				destroyFieldList(ord); free(ord);
+			}
+			nowdb_err_release(releaseIndices(&idxes));
 			nowdb_plan_destroy(plan, FALSE); return err;
 		}
-		/* find index for order by */
-		err = getGroupOrderIndex(scope, trg->stype,
-		                  trg->value, ord, &idxes);
+		/* the index delivers the groups in order */
+		if (!hashagg) {
+			destroyFieldList(ord); free(ord); ord = NULL;
+		}
+
+	} else if (order != NULL && idxes.len == 0) {
+		if (order->stype == NOWDB_AST_DESCENDING) {
+			dir = NOWDB_ORD_DESC;
+		}
+		NOWDB_PLAN_OK_ALL(limits);
+		NOWDB_PLAN_OK_REMOVE(limits,NOWDB_PLAN_OK_AGG);
+		err = getFields(scope, trg, order, limits, &ord, NULL);
+		if (err == NOWDB_OK) err = foldFields(ord, now);
 		if (err != NOWDB_OK) {
 			if (filter != NULL) {
 				nowdb_expr_destroy(filter); free(filter);
 			}
-			if (grp != NULL) {
-				destroyFieldList(grp); free(grp);
-			}
 			if (ord != NULL) {
 				destroyFieldList(ord); free(ord);
 			}
+			destroyJoin(&pjoin);
 			nowdb_plan_destroy(plan, FALSE); return err;
 		}
+		/* find index for order by
+		 * (indices are ascending only) */
+		if (dir == NOWDB_ORD_ASC && join == NULL) {
+			err = getGroupOrderIndex(scope, trg->stype,
+			                  trg->value, ord, &idxes);
+			if (err != NOWDB_OK) {
+				if (filter != NULL) {
+					nowdb_expr_destroy(filter);
+					free(filter);
+				}
+				if (grp != NULL) {
+					destroyFieldList(grp); free(grp);
+				}
+				if (ord != NULL) {
+					destroyFieldList(ord); free(ord);
+				}
+				destroyJoin(&pjoin);
+				nowdb_plan_destroy(plan, FALSE); return err;
+			}
+		}
+		/* no index covers the order keys:
+		 * with a limit, we keep the best records in a heap;
+		 * this works for edges without aggregates only */
+		if (idxes.len > 0) {
+			ordkind = NOWDB_PLAN_ORDER_INDEX;
+		} else if (limit != NULL && !hasAgg &&
+		           trg->stype != NOWDB_AST_VERTEX &&
+		           trg->stype != NOWDB_AST_TYPE) {
+			ordkind = NOWDB_PLAN_ORDER_TOPN;
+		} else if (dir == NOWDB_ORD_DESC) {
+			if (filter != NULL) {
+				nowdb_expr_destroy(filter); free(filter);
+			}
+			destroyFieldList(ord); free(ord);
+			destroyJoin(&pjoin);
+			nowdb_plan_destroy(plan, FALSE);
+			return nowdb_err_get(nowdb_err_not_supp, FALSE, OBJECT,
+			        "descending order needs limit (edges only)");
+		}
 	}
 
 	/* find indices for filter */
@@ -1585,6 +2442,7 @@ nowdb_err_t nowdb_plan_fromAst(nowdb_scope_t  *scope,
 			if (ord != NULL) {
 				destroyFieldList(ord); free(ord);
 			}
+			destroyJoin(&pjoin);
 			nowdb_plan_destroy(plan, FALSE); return err;
 		}
 	}
@@ -1604,12 +2462,14 @@ nowdb_err_t nowdb_plan_fromAst(nowdb_scope_t  *scope,
 			destroyFieldList(ord); free(ord);
 		}
 		ts_algo_list_destroy(&idxes);
+		destroyJoin(&pjoin);
 		nowdb_plan_destroy(plan, FALSE); return err;
 	}
 
 	stp->ntype = NOWDB_PLAN_READER;
 	// choose count
-	if (idxes.len == 1 && grp == NULL && ord == NULL) {
+	if (idxes.len == 1 && grp == NULL &&
+	   (ord == NULL || ordkind == NOWDB_PLAN_ORDER_TOPN)) {
 		// fprintf(stderr, "CHOOSING SEARCH\n");
 		stp->stype = NOWDB_PLAN_SEARCH_;
 		stp->helper = trg->stype;
@@ -1620,6 +2480,7 @@ nowdb_err_t nowdb_plan_fromAst(nowdb_scope_t  *scope,
 	} else if (idxes.len == 1 &&
 	           order  == NULL &&
 	           filter == NULL &&
+	           trav   == NULL &&
 	           hasAgg == 0) {
 		// fprintf(stderr, "CHOOSING KRANGE\n");
 		stp->stype = NOWDB_PLAN_KRANGE_;
@@ -1646,6 +2507,9 @@ nowdb_err_t nowdb_plan_fromAst(nowdb_scope_t  *scope,
 	/* we don't need this anymore */
 	ts_algo_list_destroy(&idxes);
 
+	/* few edges: search the vertices in the index */
+	nested = (stp->stype == NOWDB_PLAN_SEARCH_);
+
 	/* add target node */
 	if (ts_algo_list_append(plan, stp) != TS_ALGO_OK) {
 		err = nowdb_err_get(nowdb_err_no_mem,
@@ -1659,11 +2523,24 @@ nowdb_err_t nowdb_plan_fromAst(nowdb_scope_t  *scope,
 		if (ord != NULL) {
 			destroyFieldList(ord); free(ord);
 		}
+		destroyJoin(&pjoin);
 		nowdb_plan_destroy(plan, FALSE); return err;
 	}
 
 	/* add filter */
 	if (filter != NULL) {
+		err = nowdb_expr_compile(filter);
+		if (err != NOWDB_OK) {
+			nowdb_expr_destroy(filter); free(filter);
+			if (grp != NULL) {
+				destroyFieldList(grp); free(grp);
+			}
+			if (ord != NULL) {
+				destroyFieldList(ord); free(ord);
+			}
+			destroyJoin(&pjoin);
+			nowdb_plan_destroy(plan, FALSE); return err;
+		}
 		stp = malloc(sizeof(nowdb_plan_t));
 		if (stp == NULL) {
 			err = nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT,
@@ -1677,6 +2554,7 @@ nowdb_err_t nowdb_plan_fromAst(nowdb_scope_t  *scope,
 			if (ord != NULL) {
 				destroyFieldList(ord); free(ord);
 			}
+			destroyJoin(&pjoin);
 			nowdb_plan_destroy(plan, FALSE); return err;
 		}
 
@@ -1698,10 +2576,43 @@ nowdb_err_t nowdb_plan_fromAst(nowdb_scope_t  *scope,
 			if (ord != NULL) {
 				destroyFieldList(ord); free(ord);
 			}
+			destroyJoin(&pjoin);
 			free(stp); return err;
 		}
 	}
 
+	/* add join
+	 * (nested loop when the edges are read through an index search) */
+	if (join != NULL) {
+		err = addJoin(plan, trg, nested?NOWDB_PLAN_JOIN_NESTED:
+		                                NOWDB_PLAN_JOIN_HASH,
+		                                jkey, &pjoin, now);
+		if (err != NOWDB_OK) {
+			if (grp != NULL) {
+				destroyFieldList(grp); free(grp);
+			}
+			if (ord != NULL) {
+				destroyFieldList(ord); free(ord);
+			}
+			nowdb_plan_destroy(plan, FALSE); return err;
+		}
+	}
+
+	/* add traversal
+	 * (the edges followed pass, whatever the reader) */
+	if (trav != NULL) {
+		err = addTrav(plan, trg, trav, (uint32_t)hops);
+		if (err != NOWDB_OK) {
+			if (grp != NULL) {
+				destroyFieldList(grp); free(grp);
+			}
+			if (ord != NULL) {
+				destroyFieldList(ord); free(ord);
+			}
+			nowdb_plan_destroy(plan, FALSE); return err;
+		}
+	}
+
 	/* add group by */
 	if (group != NULL) {
 		stp = malloc(sizeof(nowdb_plan_t));
@@ -1717,7 +2628,8 @@ nowdb_err_t nowdb_plan_fromAst(nowdb_scope_t  *scope,
 		}
 
 		stp->ntype = NOWDB_PLAN_GROUPING;
-		stp->stype = 0;
+		stp->stype = hashagg?NOWDB_PLAN_GROUP_HASH:
+		                     NOWDB_PLAN_GROUP_SORTED;
 		stp->helper = 0;
 		stp->name = NULL;
 		stp->load = grp; 
@@ -1737,6 +2649,28 @@ nowdb_err_t nowdb_plan_fromAst(nowdb_scope_t  *scope,
 			free(stp); return err;
 		}
 
+		/* the hash aggregation sorts the groups */
+		if (ord != NULL) {
+			stp = malloc(sizeof(nowdb_plan_t));
+			if (stp == NULL) {
+				NOMEM("allocating plan");
+				destroyFieldList(ord); free(ord);
+				nowdb_plan_destroy(plan, FALSE); return err;
+			}
+
+			stp->ntype = NOWDB_PLAN_ORDERING;
+			stp->stype = dir;
+			stp->helper = 0;
+			stp->name = NULL;
+			stp->load = ord; 
+
+			if (ts_algo_list_append(plan, stp) != TS_ALGO_OK) {
+				NOMEM("list.append");
+				destroyFieldList(ord); free(ord);
+				nowdb_plan_destroy(plan, FALSE);
+				free(stp); return err;
+			}
+		}
 
 	/* add order by */
 	} else  if (order != NULL) {
@@ -1750,8 +2684,8 @@ nowdb_err_t nowdb_plan_fromAst(nowdb_scope_t  *scope,
 		}
 
 		stp->ntype = NOWDB_PLAN_ORDERING;
-		stp->stype = 0;
-		stp->helper = 0;
+		stp->stype = dir;
+		stp->helper = ordkind;
 		stp->name = NULL;
 		stp->load = ord; 
 	
@@ -1766,22 +2700,31 @@ nowdb_err_t nowdb_plan_fromAst(nowdb_scope_t  *scope,
 	}
 
 	/* add projection */
-	if (sel == NULL) return NOWDB_OK;
+	if (sel == NULL) {
+		if (limit != NULL) return addLimit(plan, &lim);
+		return NOWDB_OK;
+	}
 	if (sel->stype == NOWDB_AST_STAR) {
 		err = getAllFields(scope, trg, &pj);
 	} else {
 		NOWDB_PLAN_OK_ALL(limits);
 		err = getFields(scope, trg, sel, limits, &pj, &agg);
 	}
+	if (err == NOWDB_OK) err = foldFields(pj, now);
 	if (err != NOWDB_OK) {
 		if (agg != NULL) {
 			destroyFunList(agg); free(agg);
 		}
+		if (pj != NULL) {
+			destroyFieldList(pj); free(pj);
+		}
 		nowdb_plan_destroy(plan, FALSE); return err;
 	}
 	// is it a plain count
 	if (idxes.len  == 0    &&
 	    filter     == NULL &&
+	    join       == NULL &&
+	    trav       == NULL &&
 	    grp        == NULL && 
 	    order      == NULL && 
 	    pj         != NULL &&
@@ -1807,6 +2750,15 @@ nowdb_err_t nowdb_plan_fromAst(nowdb_scope_t  *scope,
 		}
 	}
 
+	err = compileFields(pj);
+	if (err != NOWDB_OK) {
+		if (agg != NULL) {
+			destroyFunList(agg); free(agg);
+		}
+		destroyFieldList(pj); free(pj);
+		nowdb_plan_destroy(plan, FALSE); return err;
+	}
+
 	stp = malloc(sizeof(nowdb_plan_t));
 	if (stp == NULL) {
 		NOMEM("allocating plan");
@@ -1858,6 +2810,9 @@ nowdb_err_t nowdb_plan_fromAst(nowdb_scope_t  *scope,
 			free(stp); return err;
 		}
 	}
+
+	/* add limit */
+	if (limit != NULL) return addLimit(plan, &lim);
 	return NOWDB_OK;
 }
 
@@ -1895,6 +2850,18 @@ void nowdb_plan_destroy(ts_algo_list_t *plan, char cont) {
 				destroyFieldList(node->load);
 				free(node->load);
 			}
+			if (node->ntype == NOWDB_PLAN_LIMIT) {
+				free(node->load);
+			}
+			if (node->ntype == NOWDB_PLAN_JOIN) {
+				destroyJoin(node->load);
+				free(node->load);
+			}
+			if (node->ntype == NOWDB_PLAN_TRAVERSE) {
+				nowdb_plan_trav_t *t = node->load;
+				if (t->vids != NULL) free(t->vids);
+				free(node->load);
+			}
 			if (node->ntype == NOWDB_PLAN_READER) {
 				if (node->stype == NOWDB_PLAN_SEARCH_ ||
 				    node->stype == NOWDB_PLAN_FRANGE_ ||
@@ -1943,12 +2910,39 @@ static void showNode(nowdb_plan_t *node, FILE *stream) {
 			nowdb_expr_show(node->load, stream);
 		}
 	}
+	if (node->ntype == NOWDB_PLAN_JOIN) {
+		nowdb_plan_join_t *j = node->load;
+		fprintf(stream, "JOIN: %s (%s) ON %s", node->name,
+		        node->stype == NOWDB_PLAN_JOIN_NESTED ? "nested" :
+		                                                "hash",
+		        node->helper == NOWDB_OFF_ORIGIN ? "origin" :
+		                                           "destin");
+		if (j != NULL && j->vfilter != NULL) {
+			fprintf(stream, " VERTEX: ");
+			nowdb_expr_show(j->vfilter, stream);
+		}
+		if (j != NULL && j->filter != NULL) {
+			fprintf(stream, " WHERE: ");
+			nowdb_expr_show(j->filter, stream);
+		}
+	}
+	if (node->ntype == NOWDB_PLAN_TRAVERSE && node->load != NULL) {
+		fprintf(stream, "TRAVERSE: %s (%s) %d HOPS FROM %lu VERTICES",
+		        node->name,
+		        node->stype == NOWDB_PLAN_TRAV_OUT ? "out" : "in",
+		        node->helper,
+		        ((nowdb_plan_trav_t*)node->load)->n);
+	}
 	if (node->ntype == NOWDB_PLAN_PROJECTION) {
 		fprintf(stream, "SELECT: ");
 		showExprList(node, stream);
 	}
 	if (node->ntype == NOWDB_PLAN_GROUPING) {
 		fprintf(stream, "GROUP BY: ");
+		if (node->stype == NOWDB_PLAN_GROUP_HASH) {
+			fprintf(stream, "(hash) ");
+		}
+		showExprList(node, stream);
 	}
 	if (node->ntype == NOWDB_PLAN_AGGREGATES) {
 		fprintf(stream, "AGG: ");
@@ -1956,6 +2950,18 @@ static void showNode(nowdb_plan_t *node, FILE *stream) {
 	}
 	if (node->ntype == NOWDB_PLAN_ORDERING) {
 		fprintf(stream, "ORDER BY: ");
+		if (node->helper == NOWDB_PLAN_ORDER_TOPN) {
+			fprintf(stream, "(top-n) ");
+		}
+		showExprList(node, stream);
+		if (node->stype == NOWDB_ORD_DESC) {
+			fprintf(stream, " DESC");
+		}
+	}
+	if (node->ntype == NOWDB_PLAN_LIMIT && node->load != NULL) {
+		fprintf(stream, "LIMIT: %lu OFFSET: %lu",
+		        ((nowdb_plan_limit_t*)node->load)->limit,
+		        ((nowdb_plan_limit_t*)node->load)->offset);
 	}
 	if (node->ntype == NOWDB_PLAN_READER) {
 		switch(node->stype) {
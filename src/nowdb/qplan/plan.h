@@ -15,6 +15,7 @@
 #include <nowdb/reader/reader.h>
 #include <nowdb/sql/ast.h>
 #include <nowdb/scope/scope.h>
+#include <nowdb/fun/expr.h>
 
 #include <tsalgo/list.h>
 
@@ -24,11 +25,14 @@
  */
 #define NOWDB_PLAN_SUMMARY    1
 #define NOWDB_PLAN_READER     2
+#define NOWDB_PLAN_JOIN       3
 #define NOWDB_PLAN_FILTER     4
 #define NOWDB_PLAN_GROUPING   5
 #define NOWDB_PLAN_AGGREGATES 6
 #define NOWDB_PLAN_ORDERING   7
 #define NOWDB_PLAN_PROJECTION 8
+#define NOWDB_PLAN_LIMIT      9
+#define NOWDB_PLAN_TRAVERSE  10
 
 /* ------------------------------------------------------------------------
  * Reader Types:
@@ -55,6 +59,83 @@
 #define NOWDB_PLAN_CRANGE_  61
 #define NOWDB_PLAN_COUNTALL 70
 
+/* ------------------------------------------------------------------------
+ * Grouping Types:
+ * ---------------
+ * - sorted: the reader delivers the records ordered by the group keys
+ * - hash  : no index covers the group keys; hash aggregation
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_PLAN_GROUP_SORTED 0
+#define NOWDB_PLAN_GROUP_HASH   1
+
+/* ------------------------------------------------------------------------
+ * Ordering Types (helper of the ordering node;
+ *                 the subtype is NOWDB_ORD_ASC or NOWDB_ORD_DESC):
+ * ---------------
+ * - index: the reader delivers the records ordered by the keys
+ * - topn : no index covers the keys, but there is a limit;
+ *          the best records are kept in a bounded heap
+ * - none : no index and no limit, the order is ignored
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_PLAN_ORDER_INDEX 0
+#define NOWDB_PLAN_ORDER_TOPN  1
+#define NOWDB_PLAN_ORDER_NONE  2
+
+/* ------------------------------------------------------------------------
+ * Join Types (the helper of the join node is the offset of the key
+ *             in the edge, the name is the vertex type):
+ * ---------------
+ * - hash  : the vertices are kept in a hash table
+ * - nested: the vertices are searched in the vertex index
+ *           (the edges are read through an index search)
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_PLAN_JOIN_HASH   0
+#define NOWDB_PLAN_JOIN_NESTED 1
+
+/* ------------------------------------------------------------------------
+ * Join (load of the join node)
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	nowdb_expr_t vfilter; /* predicates on the vertex only        */
+	nowdb_expr_t  filter; /* predicates on edge and vertex        */
+	uint32_t       esize; /* size of the edge (base of the vertex) */
+	uint32_t       vsize; /* size of the vertex                    */
+} nowdb_plan_join_t;
+
+/* ------------------------------------------------------------------------
+ * Traversal Directions (the subtype of the traverse node,
+ *                       the helper is the hop limit,
+ *                       the name is the edge type):
+ * ---------------
+ * - out: from origin to destination
+ * - in : from destination to origin
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_PLAN_TRAV_OUT 0
+#define NOWDB_PLAN_TRAV_IN  1
+
+/* ------------------------------------------------------------------------
+ * Traversal (load of the traverse node)
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	nowdb_key_t *vids; /* start vertices           */
+	uint64_t        n; /* number of start vertices */
+} nowdb_plan_trav_t;
+
+/* ------------------------------------------------------------------------
+ * Limit (load of the limit node)
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	uint64_t  limit; /* max number of rows  */
+	uint64_t offset; /* rows to skip before */
+} nowdb_plan_limit_t;
+
 /* ------------------------------------------------------------------------
  * Plan node
  * ------------------------------------------------------------------------
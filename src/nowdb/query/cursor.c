@@ -90,6 +90,67 @@ static inline nowdb_err_t getRange(nowdb_expr_t    filter,
 	return NOWDB_OK;
 }
 
+/* ------------------------------------------------------------------------
+ * Helper: get limit and check if top-n orders by stamp first
+ * (both are needed before the reader is created)
+ * ------------------------------------------------------------------------
+ */
+static inline void preview(ts_algo_list_t *plan, nowdb_cursor_t *cur) {
+	ts_algo_list_node_t *runner;
+	nowdb_plan_limit_t *lim;
+	nowdb_plan_t *stp;
+	ts_algo_list_t *keys;
+	nowdb_expr_t k;
+
+	for(runner=plan->head; runner!=NULL; runner=runner->nxt) {
+		stp = runner->cont;
+		if (stp->ntype == NOWDB_PLAN_LIMIT) {
+			lim = stp->load;
+			cur->haslimit = 1;
+			cur->limit = lim->limit;
+			cur->offset = lim->offset;
+
+		} else if (stp->ntype == NOWDB_PLAN_ORDERING &&
+		           stp->helper == NOWDB_PLAN_ORDER_TOPN) {
+			keys = stp->load;
+			if (keys == NULL || keys->len == 0) continue;
+			k = keys->head->cont;
+			if (nowdb_expr_type(k) != NOWDB_EXPR_FIELD) continue;
+			if (NOWDB_EXPR_TOFIELD(k)->content != NOWDB_CONT_EDGE ||
+			    NOWDB_EXPR_TOFIELD(k)->off != NOWDB_OFF_STAMP) continue;
+			cur->bystamp = stp->stype;
+		}
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: order files by time (for top-n by stamp),
+ *         so that the best records are likely to be found first
+ * ------------------------------------------------------------------------
+ */
+static inline void orderFiles(ts_algo_list_t *files, nowdb_ord_t ord) {
+	ts_algo_list_node_t *runner, *best, *tmp;
+	nowdb_file_t *f, *b;
+	void *cont;
+
+	for(runner=files->head; runner!=NULL; runner=runner->nxt) {
+		best = runner;
+		for(tmp=runner->nxt; tmp!=NULL; tmp=tmp->nxt) {
+			f = tmp->cont; b = best->cont;
+			if (ord == NOWDB_ORD_DESC) {
+				if (f->newest > b->newest) best = tmp;
+			} else {
+				if (f->oldest < b->oldest) best = tmp;
+			}
+		}
+		if (best != runner) {
+			cont = runner->cont;
+			runner->cont = best->cont;
+			best->cont = cont;
+		}
+	}
+}
+
 /* ------------------------------------------------------------------------
  * Some local helpers
  * ------------------------------------------------------------------------
@@ -217,7 +278,9 @@ static inline nowdb_err_t createSeq(nowdb_cursor_t    *cur,
  * Create merge reader
  * ------------------------------------------------------------------------
  */
-static inline nowdb_err_t createMerge(nowdb_cursor_t    *cur,
+static inline nowdb_err_t createMerge(nowdb_scope_t   *scope,
+                                      nowdb_store_t   *store,
+                                      nowdb_cursor_t    *cur,
                                       int               type,
                                       nowdb_plan_idx_t *pidx) {
 	nowdb_err_t err;
@@ -246,7 +309,9 @@ static inline nowdb_err_t createMerge(nowdb_cursor_t    *cur,
 		err = nowdb_reader_bufidx(&buf, &cur->stf.pending,
 		                pidx->idx, cur->filter, cur->eval,
 		                                    NOWDB_ORD_ASC,
-		                        cur->fromkey, cur->tokey);
+		                        cur->fromkey, cur->tokey,
+		                        scope->path, store->comp,
+		                            NOWDB_READER_SORTMEM);
 		if (err == NOWDB_OK) buf->maps = pidx->maps;
 		break;
 
@@ -254,7 +319,9 @@ static inline nowdb_err_t createMerge(nowdb_cursor_t    *cur,
 		err = nowdb_reader_bkrange(&buf, &cur->stf.pending,
 		                 pidx->idx, cur->filter, cur->eval,
 		                                     NOWDB_ORD_ASC,
-		                         cur->fromkey, cur->tokey);
+		                         cur->fromkey, cur->tokey,
+		                         scope->path, store->comp,
+		                             NOWDB_READER_SORTMEM);
 		break;
 
 	case NOWDB_PLAN_CRANGE_:
@@ -371,10 +438,12 @@ static inline nowdb_err_t initReader(nowdb_scope_t *scope,
 	          (rplan->stype == NOWDB_PLAN_KRANGE_ && !hasId(pidx))) {
 		if (pidx->maps == NULL) {
 			// fprintf(stderr, "FRANGE\n");
-			err = createMerge(cur, NOWDB_PLAN_FRANGE_, pidx);
+			err = createMerge(scope, store, cur,
+			                  NOWDB_PLAN_FRANGE_, pidx);
 		} else {
 			// fprintf(stderr, "MRANGE\n");
-			err = createMerge(cur, NOWDB_PLAN_MRANGE_, pidx);
+			err = createMerge(scope, store, cur,
+			                  NOWDB_PLAN_MRANGE_, pidx);
 			pidx->maps = NULL;
 		}
 
@@ -382,7 +451,7 @@ static inline nowdb_err_t initReader(nowdb_scope_t *scope,
 	} else if (rplan->stype == NOWDB_PLAN_KRANGE_) {
 		// fprintf(stderr, "KRANGE\n");
 		cur->hasid = hasId(pidx);
-		err = createMerge(cur, rplan->stype, pidx);
+		err = createMerge(scope, store, cur, rplan->stype, pidx);
 
 	} else if (rplan->stype == NOWDB_PLAN_CRANGE_) {
 		// fprintf(stderr, "CRANGE\n");
@@ -394,21 +463,95 @@ static inline nowdb_err_t initReader(nowdb_scope_t *scope,
 	/* create a fullscan reader */
 	} else {
 		// fprintf(stderr, "FULLSCAN\n");
+		if (cur->bystamp) orderFiles(&cur->stf.files, cur->bystamp);
 		err = nowdb_reader_fullscan(&cur->rdr,
 		                &cur->stf.files, NULL);
 	}
 	if (err != NOWDB_OK) {
-		nowdb_store_destroyFiles(store, &cur->stf.files);
+		nowdb_store_releaseFiles(store, &cur->stf.files);
 		return err;
 	}
 
 	nowdb_reader_setPeriod(cur->rdr, start, end);
 
+	/* read-ahead as configured for the storage
+	 * (only applies to fullscans) */
+	if (store->storage != NULL) {
+		nowdb_reader_setReadahead(cur->rdr,
+		             store->storage->readahead);
+	}
+
 	/* remember where the files came from */
 	cur->stf.store = store;
 	return NOWDB_OK;
 }
 
+/* ------------------------------------------------------------------------
+ * Helper: size of the records passed on to grouping and projection;
+ *         with a join, this is the joined record.
+ * ------------------------------------------------------------------------
+ */
+static inline uint32_t rowSize(nowdb_cursor_t *cur, uint32_t recsz) {
+	return cur->hjoin != NULL ? cur->hjoin->size : recsz;
+}
+
+/* ------------------------------------------------------------------------
+ * Init Join
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t initJoin(nowdb_scope_t *scope,
+                                   nowdb_cursor_t  *cur,
+                                   nowdb_plan_t  *jplan) {
+	nowdb_err_t err;
+	nowdb_plan_join_t *j = jplan->load;
+
+	if (j->esize != cur->recsz) INVALIDPLAN("join does not fit edge");
+
+	err = nowdb_hjoin_new(&cur->hjoin, jplan->helper,
+	                      j->esize, j->vsize,
+	                      j->vfilter, j->filter,
+	                      cur->eval, NOWDB_HJOIN_MEM);
+	if (err != NOWDB_OK) return err;
+
+	/* the filters now belong to the join */
+	j->vfilter = NULL; j->filter = NULL;
+
+	return nowdb_hjoin_open(cur->hjoin, scope, jplan->name,
+	                jplan->stype == NOWDB_PLAN_JOIN_NESTED?
+	                NOWDB_HJOIN_NESTED:NOWDB_HJOIN_HASH);
+}
+
+/* ------------------------------------------------------------------------
+ * Init Traversal
+ * --------------
+ * The traversal runs right here; the reader then delivers
+ * the edges as usual and only those followed pass (see fetch).
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t initTrav(nowdb_scope_t *scope,
+                                   nowdb_cursor_t  *cur,
+                                   nowdb_plan_t  *tplan,
+                                   nowdb_time_t   start,
+                                   nowdb_time_t     end) {
+	nowdb_err_t err;
+	nowdb_plan_trav_t *t = tplan->load;
+
+	err = nowdb_trav_new(&cur->trav,
+	                     tplan->stype == NOWDB_PLAN_TRAV_OUT ?
+	                             NOWDB_TRAV_OUT : NOWDB_TRAV_IN,
+	                     (uint32_t)tplan->helper, start, end,
+	                     NOWDB_HSET_MEM);
+	if (err != NOWDB_OK) return err;
+
+	err = nowdb_trav_open(cur->trav, scope, tplan->name);
+	if (err != NOWDB_OK) return err;
+
+	err = nowdb_trav_start(cur->trav, t->vids, t->n);
+	if (err != NOWDB_OK) return err;
+
+	return nowdb_trav_run(cur->trav);
+}
+
 /* ------------------------------------------------------------------------
  * Create new cursor
  * ------------------------------------------------------------------------
@@ -418,7 +561,9 @@ nowdb_err_t nowdb_cursor_new(nowdb_scope_t  *scope,
                              nowdb_cursor_t  **cur) {
 	nowdb_context_t *ctx;
 	ts_algo_list_node_t *runner;
-	nowdb_plan_t *stp=NULL, *rstp=NULL;
+	nowdb_plan_t *stp=NULL, *rstp=NULL, *jstp=NULL, *tstp=NULL;
+	nowdb_group_t *grp=NULL;
+	uint32_t rowsz;
 	nowdb_err_t   err;
 	nowdb_time_t start = NOWDB_TIME_DAWN;
 	nowdb_time_t end = NOWDB_TIME_DUSK;
@@ -458,11 +603,25 @@ nowdb_err_t nowdb_cursor_new(nowdb_scope_t  *scope,
 	(*cur)->row   = NULL;
 	(*cur)->group = NULL;
 	(*cur)->nogrp = NULL;
+	(*cur)->hagg = NULL;
+	(*cur)->tbkt = NULL;
+	(*cur)->topn = NULL;
+	(*cur)->vx = NULL;
+	(*cur)->sel = NULL;
+	(*cur)->hrec = NULL;
+	(*cur)->hjoin = NULL;
+	(*cur)->trav = NULL;
 	(*cur)->eval = NULL;
+	(*cur)->pscan = NULL;
+	(*cur)->pspage = NULL;
+	(*cur)->dop = 1;
 	(*cur)->stf.store = NULL;
 	ts_algo_list_init(&(*cur)->stf.files);
 	ts_algo_list_init(&(*cur)->stf.pending);
 
+	/* limit and top-n by stamp */
+	preview(plan, *cur);
+
 	/* pass on to the filter (in fact, there should/may be
 	 * one filter per subreader */
 	runner = runner->nxt;
@@ -476,6 +635,24 @@ nowdb_err_t nowdb_cursor_new(nowdb_scope_t  *scope,
 		}
 	}
 
+	/* join with a vertex type */
+	if (runner!=NULL) {
+		stp = runner->cont;
+		if (stp->ntype == NOWDB_PLAN_JOIN) {
+			jstp = stp;
+			runner = runner->nxt;
+		}
+	}
+
+	/* traversal over the edge type */
+	if (runner!=NULL) {
+		stp = runner->cont;
+		if (stp->ntype == NOWDB_PLAN_TRAVERSE) {
+			tstp = stp;
+			runner = runner->nxt;
+		}
+	}
+
 	// initialise eval helper
 	(*cur)->eval = calloc(1, sizeof(nowdb_eval_t));
 	if ((*cur)->eval == NULL) {
@@ -519,12 +696,42 @@ nowdb_err_t nowdb_cursor_new(nowdb_scope_t  *scope,
 		*/
 		(*cur)->rdr->filter = (*cur)->filter;
 	}
+	if (jstp != NULL) {
+		err = initJoin(scope, *cur, jstp);
+		if (err != NOWDB_OK) {
+			nowdb_cursor_destroy(*cur);
+			free(*cur); *cur = NULL;
+			return err;
+		}
+	}
+	if (tstp != NULL) {
+		err = initTrav(scope, *cur, tstp, start, end);
+		if (err != NOWDB_OK) {
+			nowdb_cursor_destroy(*cur);
+			free(*cur); *cur = NULL;
+			return err;
+		}
+	}
+	rowsz = rowSize(*cur, (*cur)->recsz);
 
 	/* pass on to projection or order by or group by */
 	if (runner == NULL) return NOWDB_OK;
 	stp = runner->cont;
 
 	if (stp->ntype == NOWDB_PLAN_ORDERING) {
+		/* no index for the order keys: top-n */
+		if (stp->helper == NOWDB_PLAN_ORDER_TOPN) {
+			err = nowdb_topn_new(&(*cur)->topn, stp->load,
+			                     (*cur)->eval, stp->stype,
+			                     rowsz,
+			                     (*cur)->limit+(*cur)->offset);
+			if (err != NOWDB_OK) {
+				nowdb_cursor_destroy(*cur); free(*cur);
+				return err;
+			}
+			ts_algo_list_destroy(stp->load);
+			free(stp->load); stp->load = NULL;
+		}
 		runner = runner->nxt;
 		if (runner == NULL) return NOWDB_OK;
 		stp = runner->cont;
@@ -538,15 +745,66 @@ nowdb_err_t nowdb_cursor_new(nowdb_scope_t  *scope,
 			nowdb_cursor_destroy(*cur); free(*cur);
 			INVALIDPLAN("grouping without projection");
 		}
-		stp = runner->cont;
-		(*cur)->grouping = 1;
-		if ((*cur)->tmp == NULL) {
-			(*cur)->tmp = calloc(1, (*cur)->recsz);
+		/* no index for the group keys: time buckets if we group
+		 * by time bins of a known period, hash aggregation otherwise;
+		 * time buckets cannot sort their overflow */
+		if (stp->stype == NOWDB_PLAN_GROUP_HASH &&
+		    ((nowdb_plan_t*)runner->cont)->ntype !=
+		                     NOWDB_PLAN_ORDERING &&
+		    nowdb_tbucket_applies(stp->load, start, end)) {
+			err = nowdb_tbucket_new(&(*cur)->tbkt, stp->load,
+			                        (*cur)->eval,
+			                        (*cur)->content,
+			                        rowsz,
+			                        start, end,
+			                        NOWDB_HASHAGG_MEM);
+			if (err != NOWDB_OK) {
+				nowdb_cursor_destroy(*cur); free(*cur);
+				return err;
+			}
+			ts_algo_list_destroy(stp->load);
+			free(stp->load); stp->load = NULL;
+
+		} else if (stp->stype == NOWDB_PLAN_GROUP_HASH) {
+			err = nowdb_hashagg_new(&(*cur)->hagg, stp->load,
+			                        (*cur)->eval,
+			                        (*cur)->content,
+			                        rowsz,
+			                        NOWDB_HASHAGG_MEM);
+			if (err != NOWDB_OK) {
+				nowdb_cursor_destroy(*cur); free(*cur);
+				return err;
+			}
+			ts_algo_list_destroy(stp->load);
+			free(stp->load); stp->load = NULL;
+
+			/* the groups shall be delivered in order */
+			stp = runner->cont;
+			if (stp->ntype == NOWDB_PLAN_ORDERING) {
+				err = nowdb_hashagg_setOrder((*cur)->hagg,
+				                     stp->load, stp->stype);
+				if (err != NOWDB_OK) {
+					nowdb_cursor_destroy(*cur); free(*cur);
+					return err;
+				}
+				runner = runner->nxt;
+				if (runner == NULL) {
+					nowdb_cursor_destroy(*cur); free(*cur);
+					INVALIDPLAN("ordering without projection");
+				}
+			}
 		}
-		if ((*cur)->tmp == NULL) {
-			NOMEM("allocating temporary buffer");
-			nowdb_cursor_destroy(*cur); free(*cur);
-			return err;
+		stp = runner->cont;
+		if ((*cur)->hagg == NULL && (*cur)->tbkt == NULL) {
+			(*cur)->grouping = 1;
+			if ((*cur)->tmp == NULL) {
+				(*cur)->tmp = calloc(1, rowsz);
+			}
+			if ((*cur)->tmp == NULL) {
+				NOMEM("allocating temporary buffer");
+				nowdb_cursor_destroy(*cur); free(*cur);
+				return err;
+			}
 		}
 	}
 
@@ -569,17 +827,40 @@ nowdb_err_t nowdb_cursor_new(nowdb_scope_t  *scope,
 	runner = runner->nxt;
 	if (runner != NULL) {
 		stp = runner->cont;
-		if (stp->ntype == NOWDB_PLAN_AGGREGATES) {
+		if (stp->ntype == NOWDB_PLAN_AGGREGATES &&
+		   ((*cur)->hagg != NULL || (*cur)->tbkt != NULL)) {
+			err = nowdb_group_fromList(&grp, stp->load);
+			if (err != NOWDB_OK) {
+				nowdb_cursor_destroy(*cur);
+				free(*cur); return err;
+			}
+			if ((*cur)->row != NULL) {
+				nowdb_group_setEval(grp, &(*cur)->row->eval);
+			}
+			err = (*cur)->hagg != NULL ?
+			      nowdb_hashagg_setGroup((*cur)->hagg, grp):
+			      nowdb_tbucket_setGroup((*cur)->tbkt, grp);
+			if (err != NOWDB_OK) {
+				/* the funs still belong to the plan */
+				free(grp->fun); free(grp);
+				nowdb_cursor_destroy(*cur);
+				free(*cur); return err;
+			}
+			ts_algo_list_destroy(stp->load);
+			free(stp->load);
+			stp->load = NULL;
+
+		} else if (stp->ntype == NOWDB_PLAN_AGGREGATES) {
 
 			/* create temporary variable for groupswitch */
-			(*cur)->tmp2 = calloc(1, (*cur)->recsz);
+			(*cur)->tmp2 = calloc(1, rowsz);
 			if ((*cur)->tmp2 == NULL) {
 				NOMEM("allocating temporary buffer");
 				nowdb_cursor_destroy(*cur); free(*cur);
 				return err;
 			}
 			if ((*cur)->tmp == NULL) {
-				(*cur)->tmp = calloc(1, (*cur)->recsz);
+				(*cur)->tmp = calloc(1, rowsz);
 			}
 			if ((*cur)->tmp == NULL) {
 				NOMEM("allocating temporary buffer");
@@ -623,10 +904,22 @@ nowdb_err_t nowdb_cursor_new(nowdb_scope_t  *scope,
  */
 void nowdb_cursor_destroy(nowdb_cursor_t *cur) {
 	if (cur == NULL) return;
+	if (cur->pscan != NULL) {
+		nowdb_pscan_destroy(cur->pscan);
+		free(cur->pscan); cur->pscan = NULL;
+	}
 	if (cur->rdr != NULL) {
 		nowdb_reader_destroy(cur->rdr);
 		free(cur->rdr); cur->rdr = NULL;
 	}
+	if (cur->hjoin != NULL) {
+		nowdb_hjoin_destroy(cur->hjoin);
+		free(cur->hjoin); cur->hjoin = NULL;
+	}
+	if (cur->trav != NULL) {
+		nowdb_trav_destroy(cur->trav);
+		free(cur->trav); cur->trav = NULL;
+	}
 	if (cur->filter != NULL) {
 		nowdb_expr_destroy(cur->filter);
 		free(cur->filter);
@@ -637,7 +930,7 @@ void nowdb_cursor_destroy(nowdb_cursor_t *cur) {
 		free(cur->eval); cur->eval = NULL;
 	}
 	if (cur->stf.store != NULL) {
-		nowdb_store_destroyFiles(cur->stf.store, &cur->stf.files);
+		nowdb_store_releaseFiles(cur->stf.store, &cur->stf.files);
 		ts_algo_list_destroy(&cur->stf.pending);
 		cur->stf.store = NULL;
 	}
@@ -649,6 +942,25 @@ void nowdb_cursor_destroy(nowdb_cursor_t *cur) {
 		nowdb_group_destroy(cur->nogrp);
 		free(cur->nogrp); cur->nogrp = NULL;
 	}
+	if (cur->hagg != NULL) {
+		nowdb_hashagg_destroy(cur->hagg);
+		free(cur->hagg); cur->hagg = NULL;
+	}
+	if (cur->tbkt != NULL) {
+		nowdb_tbucket_destroy(cur->tbkt);
+		free(cur->tbkt); cur->tbkt = NULL;
+	}
+	if (cur->topn != NULL) {
+		nowdb_topn_destroy(cur->topn);
+		free(cur->topn); cur->topn = NULL;
+	}
+	if (cur->vx != NULL) {
+		nowdb_vexpr_destroy(cur->vx);
+		free(cur->vx); cur->vx = NULL;
+	}
+	if (cur->sel != NULL) {
+		free(cur->sel); cur->sel = NULL;
+	}
 	if (cur->row != NULL) {
 		nowdb_row_destroy(cur->row);
 		free(cur->row); cur->row = NULL;
@@ -667,6 +979,87 @@ void nowdb_cursor_destroy(nowdb_cursor_t *cur) {
 	}
 }
 
+/* ------------------------------------------------------------------------
+ * Set degree of parallelism
+ * ------------------------------------------------------------------------
+ */
+void nowdb_cursor_setParallel(nowdb_cursor_t *cur, uint32_t dop) {
+	cur->dop = dop > NOWDB_PSCAN_MAXDOP ? NOWDB_PSCAN_MAXDOP : dop;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: can we split the scan among workers?
+ * - the reader must be a fullscan over more than one file
+ * - grouping must not rely on the order of the reader
+ *   (hash aggregation and time buckets are fine:
+ *    each worker has its own copy)
+ * - joins and traversals are applied by the cursor, not by the workers
+ * ------------------------------------------------------------------------
+ */
+static inline char parallel(nowdb_cursor_t *cur) {
+	if (cur->dop < 2) return 0;
+	if (cur->rdr == NULL) return 0;
+	if (cur->rdr->type != NOWDB_READER_FULLSCAN) return 0;
+	if (cur->stf.store == NULL) return 0;
+	if (cur->stf.files.len < 2) return 0;
+	if (cur->group != NULL) return 0;
+	if (cur->hjoin != NULL) return 0;
+	if (cur->trav != NULL) return 0;
+	if (cur->hagg == NULL && cur->tbkt == NULL &&
+	    cur->nogrp == NULL && cur->tmp != NULL) return 0;
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: open parallel scan.
+ * Ungrouped aggregates, hash aggregation and time buckets
+ * are computed right away;
+ * the results are then delivered with eof.
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t openParallel(nowdb_cursor_t *cur) {
+	nowdb_err_t err;
+	uint32_t n;
+
+	n = cur->dop;
+	if (n > cur->stf.files.len) n = cur->stf.files.len;
+
+	err = nowdb_pscan_new(&cur->pscan, cur->stf.store, n,
+	                      cur->rdr->from, cur->rdr->to,
+	                      cur->rdr->ahead, cur->filter,
+	                      cur->eval, cur->nogrp, cur->hagg,
+	                      cur->tbkt);
+	if (err != NOWDB_OK) return err;
+
+	/* rows: get the first page */
+	if (cur->nogrp == NULL && cur->hagg == NULL && cur->tbkt == NULL) {
+		return nowdb_pscan_next(cur->pscan, &cur->pspage);
+	}
+
+	/* groups */
+	if (cur->hagg != NULL) {
+		err = nowdb_pscan_mergeGroups(cur->pscan, cur->hagg);
+		if (err != NOWDB_OK) return err;
+
+	} else if (cur->tbkt != NULL) {
+		err = nowdb_pscan_mergeBuckets(cur->pscan, cur->tbkt);
+		if (err != NOWDB_OK) return err;
+
+	/* aggregates */
+	} else {
+		err = nowdb_pscan_merge(cur->pscan, cur->nogrp, cur->tmp);
+		if (err != NOWDB_OK) return err;
+
+		memcpy(cur->tmp2, cur->tmp, cur->recsz);
+	}
+
+	nowdb_pscan_destroy(cur->pscan);
+	free(cur->pscan); cur->pscan = NULL;
+
+	cur->eof = 1;
+	return NOWDB_OK;
+}
+
 /* ------------------------------------------------------------------------
  * Open cursor
  * ------------------------------------------------------------------------
@@ -675,27 +1068,84 @@ nowdb_err_t nowdb_cursor_open(nowdb_cursor_t *cur) {
 
 	// initialise offset
 	cur->off = 0;
+	cur->selok = 0;
+
+	// split among workers
+	if (parallel(cur)) return openParallel(cur);
 
 	// initialise readers
 	return nowdb_reader_move(cur->rdr);
 }
 
 /* ------------------------------------------------------------------------
- * Check whether this position is "in"
- * 1) It will be even more complicated in the future:
- *    we will then need to combine cont with the ctrlblock in the file,
- *    i.e. r->cont[y] & f->hdr->cont[y] & (k<<i)
- * 2) we should encapsulate this somewhere;
+ * Select the records of the current page
+ * --------------------------------------
+ * The selection contains all records that are "in"
+ * (not deleted, see reader->cont) and pass the filter.
+ * The filter is evaluated on the whole page at once.
  * ------------------------------------------------------------------------
  */
-static inline char checkpos(nowdb_reader_t *r, uint32_t pos) {
-	int y,i;
-	uint8_t k = 1;
-	if (r->cont == NULL) return 1;
-	y = pos/8;
-	i = pos%8;
-	if (r->cont[y] & (k<<i)) return 1;
-	return 0;
+static inline nowdb_err_t selectPage(nowdb_cursor_t  *cur,
+                                     char            *src,
+                                     uint32_t          mx,
+                                     uint32_t       recsz,
+                                     nowdb_bitmap8_t *cont,
+                                     nowdb_expr_t  filter) {
+	nowdb_err_t err;
+
+	if (cur->sel == NULL) {
+		cur->sel = calloc(1, sizeof(nowdb_sel_t));
+		if (cur->sel == NULL) {
+			NOMEM("allocating selection");
+			return err;
+		}
+	}
+
+	nowdb_sel_fromPage(cur->sel, src, mx, recsz, cont);
+
+	cur->selx = 0;
+	cur->selok = 1;
+
+	if (filter == NULL) return NOWDB_OK;
+
+	if (cur->vx != NULL && cur->vx->expr != filter) {
+		nowdb_vexpr_destroy(cur->vx);
+		free(cur->vx); cur->vx = NULL;
+	}
+	if (cur->vx == NULL) {
+		err = nowdb_vexpr_new(&cur->vx, filter, cur->eval);
+		if (err != NOWDB_OK) return err;
+	}
+	return nowdb_vexpr_select(cur->vx, src, recsz, cur->sel);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: the selected records are projected as they are
+ *         and need text
+ * ------------------------------------------------------------------------
+ */
+static inline char directRows(nowdb_cursor_t *cur) {
+	if (cur->row == NULL || cur->row->ntext == 0) return 0;
+	if (cur->hjoin != NULL) return 0;
+	if (cur->hagg != NULL || cur->tbkt != NULL) return 0;
+	if (cur->topn != NULL) return 0;
+	if (cur->tmp != NULL) return 0;
+	return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: number of selected records we may still deliver
+ * ------------------------------------------------------------------------
+ */
+static inline uint32_t fetchCount(nowdb_cursor_t *cur) {
+	uint64_t n = cur->sel->count;
+
+	if (cur->haslimit) {
+		uint64_t m = cur->limit - cur->rows;
+		if (cur->skipped < cur->offset) m += cur->offset-cur->skipped;
+		if (m < n) n = m;
+	}
+	return (uint32_t)n;
 }
 
 /* ------------------------------------------------------------------------
@@ -777,6 +1227,106 @@ static inline void finalizeGroup(nowdb_cursor_t *cur, char *src) {
 	nowdb_group_reset(cur->group);
 }
 
+/* ------------------------------------------------------------------------
+ * Helper: skip rows before offset
+ * ------------------------------------------------------------------------
+ */
+static inline char skipRow(nowdb_cursor_t *cur) {
+	if (cur->skipped >= cur->offset) return 0;
+	cur->skipped++; return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: enough rows delivered
+ * ------------------------------------------------------------------------
+ */
+static inline char limitReached(nowdb_cursor_t *cur) {
+	return (cur->haslimit && cur->rows >= cur->limit);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: narrow the period of the reader to what can still
+ *         make it into the top-n (the worst stamp kept so far)
+ * ------------------------------------------------------------------------
+ */
+static inline void narrow(nowdb_cursor_t *cur) {
+	nowdb_time_t t;
+	char *w;
+
+	if (cur->pscan != NULL) return;
+	if (cur->rdr->type != NOWDB_READER_FULLSCAN) return;
+	if (!nowdb_topn_full(cur->topn)) return;
+
+	w = nowdb_topn_worst(cur->topn);
+	if (w == NULL) return;
+
+	memcpy(&t, w+NOWDB_OFF_STAMP, sizeof(nowdb_time_t));
+	if (cur->bystamp == NOWDB_ORD_DESC) {
+		if (t > cur->rdr->from) {
+			nowdb_reader_setPeriod(cur->rdr, t, cur->rdr->to);
+		}
+	} else if (t < cur->rdr->to) {
+		nowdb_reader_setPeriod(cur->rdr, cur->rdr->from, t);
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * The last turn with hash aggregation, time buckets or top-n:
+ * deliver the groups or the best records one by one
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t emitEOF(nowdb_cursor_t *cur,
+                                  nowdb_err_t     old,
+                                  char *buf, uint32_t sz,
+                                           uint32_t *osz,
+                                         uint32_t *count) {
+	nowdb_err_t err;
+	char complete=0, cc=0, full=0;
+
+	for(;;) {
+		if (cur->hrec == NULL) {
+			if (limitReached(cur)) return old;
+			if (cur->hagg != NULL) {
+				err = nowdb_hashagg_next(cur->hagg, &cur->hrec);
+			} else if (cur->tbkt != NULL) {
+				err = nowdb_tbucket_next(cur->tbkt, &cur->hrec);
+			} else {
+				err = nowdb_topn_next(cur->topn, &cur->hrec);
+			}
+			if (err != NOWDB_OK) {
+				cur->hrec = NULL;
+				if (nowdb_err_contains(err, nowdb_err_eof)) {
+					nowdb_err_release(err);
+					return old;
+				}
+				nowdb_err_release(old);
+				return err;
+			}
+			if (skipRow(cur)) {
+				cur->hrec = NULL; continue;
+			}
+		}
+		err = nowdb_row_project(cur->row,
+		                        cur->hrec,
+		                        cur->recsz,
+		                        buf, sz, osz, &full,
+		                        &cc, &complete);
+		if (err != NOWDB_OK) {
+			nowdb_err_release(old);
+			return err;
+		}
+		if (!complete) break;
+
+		(*count)+=cc;
+		cur->rows+=cc;
+		cur->hrec = NULL;
+
+		if (full) break;
+	}
+	nowdb_err_release(old);
+	return NOWDB_OK;
+}
+
 /* ------------------------------------------------------------------------
  * The last turn
  * ------------------------------------------------------------------------
@@ -795,7 +1345,11 @@ static inline nowdb_err_t handleEOF(nowdb_cursor_t *cur,
 
 	cur->eof = 1;
 
+	if (cur->hagg != NULL || cur->tbkt != NULL || cur->topn != NULL) {
+		return emitEOF(cur, old, buf, sz, osz, count);
+	}
 	if (cur->group == NULL && cur->nogrp == NULL) return old;
+	if (limitReached(cur) || skipRow(cur)) return old;
 	if (cur->nogrp != NULL) {
 		if (cur->rdr->type == NOWDB_READER_COUNT) {
 			nowdb_expr_fix(cur->row->fields[0],
@@ -817,7 +1371,7 @@ static inline nowdb_err_t handleEOF(nowdb_cursor_t *cur,
 
 	err = nowdb_row_project(cur->row,
 	                        cur->tmp2,
-	                cur->rdr->recsize,
+	  rowSize(cur, cur->rdr->recsize),
 		      buf, sz, osz, &full,
                           &cc, &complete);
 	if (err != NOWDB_OK) {
@@ -826,19 +1380,22 @@ static inline nowdb_err_t handleEOF(nowdb_cursor_t *cur,
 	}
 	if (complete) {
 		(*count)+=cc;
+		cur->rows+=cc;
 		return old;
 	}
-	memcpy(cur->tmp, nowdb_nullrec, recsz);
+	memcpy(cur->tmp, nowdb_nullrec, rowSize(cur, recsz));
 	nowdb_err_release(old);
 	return NOWDB_OK;
 }
 
 #define AFTERMOVE() \
-	src = nowdb_reader_page(cur->rdr); \
+	src = cur->pscan != NULL ? cur->pspage : \
+	                   nowdb_reader_page(cur->rdr); \
 	cur->recsz = cur->rdr->recsize; \
 	recsz = cur->recsz; \
 	mx = cur->rdr->ko?recsz:(NOWDB_IDX_PAGE/recsz)*recsz; \
-	filter = cur->rdr->filter; \
+	filter = cur->pscan != NULL ? NULL : cur->rdr->filter; \
+	cont = cur->pscan != NULL ? NULL : cur->rdr->cont; \
 	ctype = cur->rdr->content;
 
 #define CHECKEOF() \
@@ -869,7 +1426,9 @@ static inline nowdb_err_t fetch(nowdb_cursor_t *cur,
 	uint32_t recsz;
 	uint32_t realsz;
 	char *realsrc=NULL;
+	char *row;
 	nowdb_expr_t filter;
+	nowdb_bitmap8_t *cont;
 	char *src;
 	nowdb_content_t ctype;
 	char complete=0, cc=0, x=1, full=0;
@@ -878,6 +1437,12 @@ static inline nowdb_err_t fetch(nowdb_cursor_t *cur,
 	// we have already reached eof
 	// CHECKEOF()
 
+	// we have delivered enough rows
+	if (limitReached(cur)) {
+		cur->eof = 1;
+		return nowdb_err_get(nowdb_err_eof, FALSE, OBJECT, NULL);
+	}
+
 	// initialise like after move
 	AFTERMOVE()
 
@@ -885,7 +1450,7 @@ static inline nowdb_err_t fetch(nowdb_cursor_t *cur,
 		// handle leftovers
 		if (cur->leftover != NULL) {
 
-			realsz = cur->recsz;
+			realsz = rowSize(cur, cur->recsz);
 			realsrc = cur->leftover;
 			cur->leftover = NULL;
 
@@ -902,7 +1467,10 @@ static inline nowdb_err_t fetch(nowdb_cursor_t *cur,
 		}
 		// END OF PAGE
 		if (cur->off >= mx) {
-			err = nowdb_reader_move(cur->rdr);
+			if (cur->bystamp) narrow(cur);
+			err = cur->pscan != NULL ?
+			      nowdb_pscan_next(cur->pscan, &cur->pspage):
+			      nowdb_reader_move(cur->rdr);
 			if (err != NOWDB_OK) {
 				if (!nowdb_err_contains(err, nowdb_err_eof))
 					return err;
@@ -912,41 +1480,74 @@ static inline nowdb_err_t fetch(nowdb_cursor_t *cur,
 			}
 
 			cur->off = 0;
+			cur->selok = 0;
 			AFTERMOVE()
 		}
-		// NULLRECORD
-		if (memcmp(src+cur->off, nowdb_nullrec, recsz) == 0) {
+		// SELECTION
+		if (!cur->selok) {
+			err = selectPage(cur, src, mx, recsz, cont, filter);
+			if (err != NOWDB_OK) return err;
+
+			// text of the rows we deliver from this page
+			if (directRows(cur)) {
+				err = nowdb_row_fetchText(cur->row, src, recsz,
+				                          cur->sel->pos,
+				                          fetchCount(cur));
+				if (err != NOWDB_OK) return err;
+			}
+		}
+		// advance to the next selected record
+		while(cur->selx < cur->sel->count &&
+		      cur->sel->pos[cur->selx]*recsz < cur->off) {
+			cur->selx++;
+		}
+		if (cur->selx >= cur->sel->count) {
 			cur->off = mx; continue;
 		}
-		// check content
-		// -------------
-		// here's potential for improvement:
-		// 1) we can immediately advance to the next marked record
-		// 2) if we have read all records, we can leave
-		if (!checkpos(cur->rdr, cur->off/recsz)) {
-			cur->off += recsz; continue;
+		cur->off = cur->sel->pos[cur->selx]*recsz;
+		row = src+cur->off;
+
+		// traversal: only the edges followed pass
+		if (cur->trav != NULL &&
+		   !nowdb_trav_followed(cur->trav, row)) {
+			cur->off += recsz;
+			continue;
 		}
-		// fprintf(stderr, "NOT DELETED\n");
-		// FILTER
-		if (filter != NULL) {
-			// fprintf(stderr, "FILTER???\n");
-			void *v=NULL;
-			nowdb_type_t  t;
-			err = nowdb_expr_eval(filter, cur->eval,
-			                  src+cur->off, &t, &v);
+
+		// join: from here on, we see the joined record
+		if (cur->hjoin != NULL) {
+			err = nowdb_hjoin_probe(cur->hjoin, row, &row);
 			if (err != NOWDB_OK) return err;
-			if (t == NOWDB_TYP_NOTHING) {
-				cur->off += recsz; continue;
-			} else if (t == NOWDB_TYP_TEXT) {
-				if (v == NULL || strlen(v) == 0) {
-					cur->off += recsz; continue;
-				}
-			} else if (!(*(nowdb_value_t*)v)) {
-				cur->off += recsz; continue;
+			if (row == NULL) {
+				cur->off += recsz;
+				continue;
 			}
 		}
-		realsz = recsz;
-		realsrc = src+cur->off;
+
+		// hash aggregation consumes everything before
+		// the first group is delivered (see handleEOF)
+		if (cur->hagg != NULL) {
+			err = nowdb_hashagg_map(cur->hagg, row);
+			if (err != NOWDB_OK) return err;
+			cur->off += recsz;
+			continue;
+		}
+		// so do time buckets
+		if (cur->tbkt != NULL) {
+			err = nowdb_tbucket_map(cur->tbkt, row);
+			if (err != NOWDB_OK) return err;
+			cur->off += recsz;
+			continue;
+		}
+		// so does top-n
+		if (cur->topn != NULL) {
+			err = nowdb_topn_add(cur->topn, row);
+			if (err != NOWDB_OK) return err;
+			cur->off += recsz;
+			continue;
+		}
+		realsz = rowSize(cur, recsz);
+		realsrc = row;
 grouping:
 		// if keys-only, group or no-group aggregates
 		if (cur->tmp != NULL) {
@@ -970,6 +1571,13 @@ grouping:
 			}
 		}
 projection:
+		// rows before the offset are not delivered
+		if (skipRow(cur)) {
+			finalizeGroup(cur, realsrc);
+			FREESRC();
+			cur->off+=recsz;
+			continue;
+		}
 		// fprintf(stderr, "PROJECTING\n");
 		if (cur->group == NULL) {
 			// fprintf(stderr, "NO GROUP\n");
@@ -994,17 +1602,27 @@ projection:
 			FREESRC();
 
 			(*count)+=cc;
+			cur->rows+=cc;
 			cur->off+=recsz;
+
+			// enough: stop here (the reader is not moved again)
+			if (limitReached(cur)) break;
 		} else {
 			// remember if we have to free the leftover!
 			cur->leftover = realsrc;
-			cur->recsz = realsz;
-			recsz = cur->recsz;
+
+			// with a join, we still advance by edges
+			if (cur->hjoin == NULL) {
+				cur->recsz = realsz;
+				recsz = cur->recsz;
+			}
 
 			// this is still ugly
 			if (realsrc != cur->vrtx    &&
 			    realsrc != src+cur->off &&
-			    realsrc != src+cur->off-cur->recsz) cur->freesrc=1;
+			    realsrc != src+cur->off-cur->recsz &&
+			   (cur->hjoin == NULL ||
+			    realsrc != cur->hjoin->rec)) cur->freesrc=1;
 		}
 		if (full) break;
 	}
@@ -11,9 +11,16 @@
 #include <nowdb/types/error.h>
 #include <nowdb/scope/scope.h>
 #include <nowdb/fun/expr.h>
+#include <nowdb/fun/vexpr.h>
 #include <nowdb/reader/reader.h>
 #include <nowdb/qplan/plan.h>
 #include <nowdb/query/row.h>
+#include <nowdb/query/pscan.h>
+#include <nowdb/query/hashagg.h>
+#include <nowdb/query/tbucket.h>
+#include <nowdb/query/topn.h>
+#include <nowdb/query/hjoin.h>
+#include <nowdb/query/trav.h>
 #include <nowdb/fun/group.h>
 
 /* ------------------------------------------------------------------------
@@ -36,11 +43,23 @@ typedef struct {
 	nowdb_storefile_t    stf; /* should be a list of stf!      */
 	nowdb_model_t     *model; /* model                         */
 	nowdb_expr_t      filter; /* main filter                   */
+	nowdb_vexpr_t        *vx; /* filter evaluated per page     */
+	nowdb_sel_t         *sel; /* selected records in page      */
+	uint32_t            selx; /* next record in selection      */
 	nowdb_row_t         *row; /* projection                    */
 	nowdb_group_t     *group; /* grouping                      */
 	nowdb_group_t     *nogrp; /* apply aggs without grouping   */
+	nowdb_hashagg_t    *hagg; /* grouping without index        */
+	nowdb_tbucket_t    *tbkt; /* grouping by time bins         */
+	nowdb_topn_t       *topn; /* ordering without index        */
+	char               *hrec; /* current record of hagg/tbkt/topn */
+	nowdb_hjoin_t     *hjoin; /* join with a vertex type       */
+	nowdb_trav_t       *trav; /* edges followed by a traversal */
 	nowdb_model_vertex_t  *v; /* type if this is not a join!   */
 	nowdb_eval_t       *eval; /* evaluation helper             */
+	nowdb_pscan_t     *pscan; /* parallel scan                 */
+	char             *pspage; /* current page of pscan         */
+	uint32_t             dop; /* degree of parallelism         */
 	char           *leftover; /* leftover from previous round  */
 	uint32_t             off; /* offset in the current reader  */
 	uint32_t           recsz; /* record size                   */
@@ -49,9 +68,16 @@ typedef struct {
 	char            vrtx[32]; /* yet another temporary buffer  */
 	char            *fromkey; /* range: fromkey                */
 	char              *tokey; /* range:   tokey                */
+	uint64_t           limit; /* max rows to deliver           */
+	uint64_t          offset; /* rows to skip                  */
+	uint64_t            rows; /* rows delivered                */
+	uint64_t         skipped; /* rows skipped                  */
+	nowdb_ord_t      bystamp; /* top-n starts with stamp       */
+	char            haslimit; /* there is a limit              */
 	char             freesrc; /* free the source               */
 	char               hasid; /* has id to identify model      */
 	char            grouping; /* has id to identify model      */
+	char               selok; /* page has been selected        */
 	char                 eof; /* end of file was reached       */
 } nowdb_cursor_t;
 
@@ -71,6 +97,18 @@ nowdb_err_t nowdb_cursor_new(nowdb_scope_t  *scope,
  */
 void nowdb_cursor_destroy(nowdb_cursor_t *cur);
 
+/* ------------------------------------------------------------------------
+ * Set degree of parallelism
+ * -------------------------
+ * Must be called before the cursor is opened.
+ * Fullscans with ungrouped aggregates or plain projections
+ * are then split among up to 'dop' workers.
+ * Note that in this case rows are not delivered
+ * in the order in which they are stored.
+ * ------------------------------------------------------------------------
+ */
+void nowdb_cursor_setParallel(nowdb_cursor_t *cur, uint32_t dop);
+
 /* ------------------------------------------------------------------------
  * Open cursor 
  * ------------------------------------------------------------------------
@@ -84,6 +122,9 @@ nowdb_err_t nowdb_cursor_open(nowdb_cursor_t *cur);
  * of size sz (in bytes). The number of bytes written to the buffer is
  * communicated back through osz.
  * When the cursor is exhausted, fetch will return the error 'eof'.
+ * With a limit, the cursor is exhausted after 'limit' rows
+ * (not counting the 'offset' rows skipped before);
+ * the reader is not moved any further.
  * ------------------------------------------------------------------------
  */
 nowdb_err_t nowdb_cursor_fetch(nowdb_cursor_t   *cur,
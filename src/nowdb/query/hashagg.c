@@ -0,0 +1,964 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Hash aggregation: grouping without ordered input
+ * ========================================================================
+ */
+#include <nowdb/query/hashagg.h>
+
+#include <string.h>
+#include <errno.h>
+
+static char *OBJECT = "hashagg";
+
+#define INVALID(s) \
+	return nowdb_err_get(nowdb_err_invalid, FALSE, OBJECT, s);
+
+#define NOMEM(s) \
+	err = nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT, s);
+
+/* ------------------------------------------------------------------------
+ * Initial number of slots
+ * ------------------------------------------------------------------------
+ */
+#define INITCAP 1024
+#define MINCAP    16
+
+/* ------------------------------------------------------------------------
+ * Slot layout:
+ * [hash][key values and types][record][states or box]
+ * an empty slot has hash 0
+ * ------------------------------------------------------------------------
+ */
+#define ALIGN8(x) \
+	(((x)+7)&~7)
+
+#define SLOT(ha,i) \
+	((ha)->tab+(i)*(ha)->esz)
+
+#define HASH(s) \
+	(*(uint64_t*)(s))
+
+#define SKEY(s) \
+	((s)+8)
+
+#define SREC(ha,s) \
+	((s)+8+(ha)->ksz)
+
+#define SAGG(ha,s) \
+	((s)+8+(ha)->ksz+(ha)->rsz)
+
+#define STATES(ha,s) \
+	((nowdb_fun_state_t*)SAGG(ha,s))
+
+#define BOX(ha,s) \
+	(*(nowdb_group_t**)SAGG(ha,s))
+
+/* ------------------------------------------------------------------------
+ * Spilled partition waiting to be processed
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	FILE     *file;
+	uint32_t level;
+} part_t;
+
+/* ------------------------------------------------------------------------
+ * Helper: hash the key (never 0)
+ * ------------------------------------------------------------------------
+ */
+static inline uint64_t hash(char *key, uint32_t sz) {
+	uint64_t h = 0x9e3779b97f4a7c15ULL ^ sz;
+	uint64_t k;
+
+	for(uint32_t i=0; i<sz; i+=8) {
+		memcpy(&k, key+i, 8);
+		k *= 0x87c37b91114253d5ULL;
+		k  = (k << 31) | (k >> 33);
+		k *= 0x4cf5ad432745937fULL;
+		h ^= k;
+		h  = ((h << 27) | (h >> 37))*5 + 0x52dce729;
+	}
+	h ^= h >> 33; h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33; h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h==0?1:h;
+}
+
+/* ------------------------------------------------------------------------
+ * Allocate and initialise
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hashagg_new(nowdb_hashagg_t **ha,
+                              ts_algo_list_t  *keys,
+                              nowdb_eval_t    *eval,
+                              nowdb_content_t ctype,
+                              uint32_t        recsz,
+                              uint64_t       budget) {
+	nowdb_err_t err;
+	ts_algo_list_node_t *runner;
+	int i=0;
+
+	if (ha == NULL) INVALID("hashagg pointer is NULL");
+	if (keys == NULL) INVALID("no keys");
+	if (keys->len == 0) INVALID("no keys");
+
+	*ha = calloc(1, sizeof(nowdb_hashagg_t));
+	if (*ha == NULL) {
+		NOMEM("allocating hashagg");
+		return err;
+	}
+
+	(*ha)->eval = eval;
+	(*ha)->ctype = ctype;
+	(*ha)->recsz = recsz;
+	(*ha)->budget = budget;
+	(*ha)->nkeys = keys->len;
+	(*ha)->ksz = keys->len*8 + ALIGN8(keys->len);
+	(*ha)->rsz = ALIGN8(recsz);
+
+	ts_algo_list_init(&(*ha)->pending);
+	nowdb_hset_initPool(&(*ha)->pool, budget);
+
+	(*ha)->key = calloc(1, (*ha)->ksz);
+	if ((*ha)->key == NULL) {
+		NOMEM("allocating key");
+		nowdb_hashagg_destroy(*ha);
+		free(*ha); *ha = NULL;
+		return err;
+	}
+	(*ha)->rec = calloc(1, recsz);
+	if ((*ha)->rec == NULL) {
+		NOMEM("allocating record");
+		nowdb_hashagg_destroy(*ha);
+		free(*ha); *ha = NULL;
+		return err;
+	}
+	(*ha)->keys = calloc(keys->len, sizeof(nowdb_expr_t));
+	if ((*ha)->keys == NULL) {
+		NOMEM("allocating keys");
+		nowdb_hashagg_destroy(*ha);
+		free(*ha); *ha = NULL;
+		return err;
+	}
+
+	/* we group by the text key, not by the text */
+	for(runner=keys->head; runner!=NULL; runner=runner->nxt) {
+		(*ha)->keys[i] = runner->cont;
+		nowdb_expr_usekey((*ha)->keys[i]); i++;
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Set aggregates
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hashagg_setGroup(nowdb_hashagg_t *ha,
+                                   nowdb_group_t   *group) {
+	nowdb_err_t err;
+
+	if (ha == NULL) INVALID("hashagg is NULL");
+	if (ha->tab != NULL) INVALID("records already mapped");
+	if (ha->group != NULL) INVALID("group already set");
+	if (group == NULL) return NOWDB_OK;
+
+	ha->fresh = calloc(group->lst, sizeof(nowdb_fun_state_t));
+	if (ha->fresh == NULL) {
+		NOMEM("allocating states");
+		return err;
+	}
+	ha->scratch = calloc(group->lst, sizeof(nowdb_fun_state_t));
+	if (ha->scratch == NULL) {
+		NOMEM("allocating states");
+		free(ha->fresh); ha->fresh = NULL;
+		return err;
+	}
+
+	nowdb_group_reset(group);
+	nowdb_group_save(group, ha->fresh);
+
+	ha->boxed = !nowdb_group_inline(group);
+	ha->group = group;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Set order
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hashagg_setOrder(nowdb_hashagg_t *ha,
+                                   ts_algo_list_t  *fields,
+                                   nowdb_ord_t         dir) {
+	nowdb_err_t err;
+	ts_algo_list_node_t *runner;
+	uint32_t i=0, k;
+
+	if (ha == NULL) INVALID("hashagg is NULL");
+	if (ha->emitting) INVALID("groups already delivered");
+	if (ha->ord != NULL) INVALID("order already set");
+	if (fields == NULL || fields->len == 0) return NOWDB_OK;
+
+	ha->ord = calloc(fields->len, sizeof(uint32_t));
+	if (ha->ord == NULL) {
+		NOMEM("allocating order");
+		return err;
+	}
+	for(runner=fields->head; runner!=NULL; runner=runner->nxt) {
+		for(k=0; k<ha->nkeys; k++) {
+			if (nowdb_expr_equal(ha->keys[k], runner->cont)) break;
+		}
+		if (k == ha->nkeys) {
+			free(ha->ord); ha->ord = NULL;
+			INVALID("ordering not on group keys");
+		}
+		/* we group by the text key, which is not the order */
+		if (nowdb_expr_type(ha->keys[k]) == NOWDB_EXPR_FIELD &&
+		    NOWDB_EXPR_TOFIELD(ha->keys[k])->type == NOWDB_TYP_TEXT) {
+			free(ha->ord); ha->ord = NULL;
+			return nowdb_err_get(nowdb_err_not_supp, FALSE, OBJECT,
+			                                "ordering groups by text");
+		}
+		ha->ord[i] = k; i++;
+	}
+	ha->nord = i;
+	ha->dir = dir;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: destroy the boxes and empty the table
+ * ------------------------------------------------------------------------
+ */
+static void clearTable(nowdb_hashagg_t *ha) {
+	nowdb_group_t *g;
+	char *s;
+
+	if (ha->tab == NULL) return;
+	if (ha->boxed) {
+		for(uint64_t i=0; i<ha->cap; i++) {
+			s = SLOT(ha,i);
+			if (HASH(s) == 0) continue;
+			g = BOX(ha,s);
+			if (g != NULL) {
+				nowdb_group_destroy(g); free(g);
+				ha->mem -= ha->boxsz;
+			}
+		}
+		nowdb_hset_resetPool(&ha->pool);
+	}
+	memset(ha->tab, 0, ha->cap*ha->esz);
+	ha->count = 0;
+	ha->spill = 0;
+	ha->pos = 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Destroy
+ * ------------------------------------------------------------------------
+ */
+void nowdb_hashagg_destroy(nowdb_hashagg_t *ha) {
+	ts_algo_list_node_t *runner;
+	part_t *part;
+
+	if (ha == NULL) return;
+	if (ha->tab != NULL) {
+		clearTable(ha);
+		free(ha->tab); ha->tab = NULL;
+	}
+	nowdb_hset_destroyPool(&ha->pool);
+	for(int i=0; i<NOWDB_HASHAGG_PARTS; i++) {
+		if (ha->parts[i] != NULL) {
+			fclose(ha->parts[i]); ha->parts[i] = NULL;
+		}
+	}
+	for(runner=ha->pending.head; runner!=NULL; runner=runner->nxt) {
+		part = runner->cont;
+		fclose(part->file); free(part);
+	}
+	ts_algo_list_destroy(&ha->pending);
+	if (ha->keys != NULL) {
+		for(int i=0; i<ha->nkeys; i++) {
+			if (ha->keys[i] != NULL) {
+				nowdb_expr_destroy(ha->keys[i]);
+				free(ha->keys[i]);
+			}
+		}
+		free(ha->keys); ha->keys = NULL;
+	}
+	if (ha->group != NULL) {
+		nowdb_group_destroy(ha->group);
+		free(ha->group); ha->group = NULL;
+	}
+	if (ha->fresh != NULL) {
+		free(ha->fresh); ha->fresh = NULL;
+	}
+	if (ha->scratch != NULL) {
+		free(ha->scratch); ha->scratch = NULL;
+	}
+	if (ha->ord != NULL) {
+		free(ha->ord); ha->ord = NULL;
+	}
+	if (ha->key != NULL) {
+		free(ha->key); ha->key = NULL;
+	}
+	if (ha->rec != NULL) {
+		free(ha->rec); ha->rec = NULL;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: allocate the table
+ * (we know the aggregates only after setGroup)
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t initTable(nowdb_hashagg_t *ha) {
+	nowdb_err_t err;
+	uint32_t asz = 0;
+
+	if (ha->group != NULL) {
+		if (ha->boxed) {
+			asz = sizeof(nowdb_group_t*);
+			ha->boxsz = sizeof(nowdb_group_t) + ha->group->lst *
+			           (sizeof(nowdb_fun_t)+sizeof(nowdb_fun_t*));
+		} else {
+			asz = ha->group->lst*sizeof(nowdb_fun_state_t);
+		}
+	}
+	ha->esz = 8 + ha->ksz + ha->rsz + ALIGN8(asz);
+
+	ha->cap = INITCAP;
+	while(ha->cap > MINCAP && ha->cap*ha->esz > ha->budget) {
+		ha->cap >>= 1;
+	}
+	ha->tab = calloc(ha->cap, ha->esz);
+	if (ha->tab == NULL) {
+		NOMEM("allocating hash table");
+		return err;
+	}
+	ha->mem = ha->cap*ha->esz;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: we can afford 'more' bytes
+ * (on the last level, we cannot spill anymore;
+ *  the distinct sets of the groups are part of the memory in use)
+ * ------------------------------------------------------------------------
+ */
+static inline char fits(nowdb_hashagg_t *ha, uint64_t more) {
+	if (ha->level+1 >= NOWDB_HASHAGG_MAXLEVEL) return 1;
+	return (ha->mem + ha->pool.mem + more <= ha->budget);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: find slot of the current key or empty slot
+ * ------------------------------------------------------------------------
+ */
+static inline char *find(nowdb_hashagg_t *ha, uint64_t h) {
+	uint64_t m = ha->cap-1;
+	uint64_t i = h&m;
+	char *s;
+
+	for(;;) {
+		s = SLOT(ha,i);
+		if (HASH(s) == 0) return s;
+		if (HASH(s) == h &&
+		    memcmp(SKEY(s), ha->key, ha->ksz) == 0) return s;
+		i = (i+1)&m;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: double the table
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t grow(nowdb_hashagg_t *ha) {
+	nowdb_err_t err;
+	uint64_t cap = ha->cap << 1;
+	uint64_t m = cap-1;
+	uint64_t j;
+	char *tab, *s;
+
+	tab = calloc(cap, ha->esz);
+	if (tab == NULL) {
+		NOMEM("allocating hash table");
+		return err;
+	}
+	for(uint64_t i=0; i<ha->cap; i++) {
+		s = SLOT(ha,i);
+		if (HASH(s) == 0) continue;
+		j = HASH(s)&m;
+		while(HASH(tab+j*ha->esz) != 0) j = (j+1)&m;
+		memcpy(tab+j*ha->esz, s, ha->esz);
+	}
+	free(ha->tab); ha->tab = tab;
+	ha->mem += (cap-ha->cap)*ha->esz;
+	ha->cap = cap;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: compute the key of the record
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t makeKey(nowdb_hashagg_t *ha, char *record) {
+	nowdb_err_t err;
+	nowdb_type_t t;
+	void *v=NULL;
+
+	memset(ha->key, 0, ha->ksz);
+	for(int i=0; i<ha->nkeys; i++) {
+		err = nowdb_expr_eval(ha->keys[i], ha->eval, record, &t, &v);
+		if (err != NOWDB_OK) return err;
+
+		ha->key[ha->nkeys*8+i] = (char)t;
+
+		if (v == NULL) continue;
+		switch(t) {
+		case NOWDB_TYP_NOTHING: break;
+		case NOWDB_TYP_BOOL: memcpy(ha->key+i*8, v, 1); break;
+		case NOWDB_TYP_TEXT:
+		case NOWDB_TYP_LONGTEXT:
+			return nowdb_err_get(nowdb_err_not_supp, FALSE, OBJECT,
+			                         "grouping by computed text");
+		default: memcpy(ha->key+i*8, v, 8);
+		}
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: spill record to partition
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t spill(nowdb_hashagg_t *ha,
+                                uint64_t          h,
+                                char        *record) {
+	int p = (h >> (60-4*ha->level)) & (NOWDB_HASHAGG_PARTS-1);
+
+	if (ha->parts[p] == NULL) {
+		ha->parts[p] = tmpfile();
+		if (ha->parts[p] == NULL) {
+			return nowdb_err_get(nowdb_err_open, TRUE, OBJECT,
+			                               "temporary file");
+		}
+	}
+	if (fwrite(record, ha->recsz, 1, ha->parts[p]) != 1) {
+		return nowdb_err_get(nowdb_err_write, TRUE, OBJECT,
+		                               "temporary file");
+	}
+	ha->spilled++;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: insert new group
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t insert(nowdb_hashagg_t *ha,
+                                 char             *s,
+                                 uint64_t          h,
+                                 char        *record) {
+	nowdb_err_t err;
+	nowdb_group_t *g;
+
+	if (ha->group != NULL) {
+		if (ha->boxed) {
+			err = nowdb_group_copy(ha->group, &g);
+			if (err != NOWDB_OK) return err;
+			err = nowdb_group_setPool(g, &ha->pool);
+			if (err != NOWDB_OK) {
+				nowdb_group_destroy(g); free(g);
+				return err;
+			}
+			nowdb_group_setEval(g, ha->group->hlp);
+			BOX(ha,s) = g;
+			ha->mem += ha->boxsz;
+		} else {
+			memcpy(STATES(ha,s), ha->fresh,
+			       ha->group->lst*sizeof(nowdb_fun_state_t));
+		}
+	}
+	memcpy(SKEY(s), ha->key, ha->ksz);
+	memcpy(SREC(ha,s), record, ha->recsz);
+	HASH(s) = h;
+	ha->count++;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: map record to the aggregates of this slot
+ * (the distinct sets may use what the table does not)
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t mapGroup(nowdb_hashagg_t *ha,
+                                   char             *s,
+                                   char        *record) {
+	nowdb_err_t err;
+
+	if (ha->group == NULL) return NOWDB_OK;
+	if (ha->boxed) {
+		ha->pool.budget = ha->budget > ha->mem ?
+		                  ha->budget - ha->mem : 0;
+		return nowdb_group_map(BOX(ha,s), ha->ctype, record);
+	}
+	nowdb_group_restore(ha->group, STATES(ha,s));
+	err = nowdb_group_map(ha->group, ha->ctype, record);
+	nowdb_group_save(ha->group, STATES(ha,s));
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Map
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hashagg_map(nowdb_hashagg_t *ha, char *record) {
+	nowdb_err_t err;
+	uint64_t h;
+	char *s;
+
+	if (ha->emitting) INVALID("cannot map while delivering groups");
+	if (ha->tab == NULL) {
+		err = initTable(ha);
+		if (err != NOWDB_OK) return err;
+	}
+
+	err = makeKey(ha, record);
+	if (err != NOWDB_OK) return err;
+
+	h = hash(ha->key, ha->ksz);
+	s = find(ha, h);
+
+	/* new group */
+	if (HASH(s) == 0) {
+		if (!ha->spill && (ha->count+1)*4 > ha->cap*3) {
+			if (fits(ha, ha->cap*ha->esz)) {
+				err = grow(ha);
+				if (err != NOWDB_OK) return err;
+				s = find(ha, h);
+			} else {
+				ha->spill = 1;
+			}
+		}
+		if (!ha->spill && ha->boxed && !fits(ha, ha->boxsz)) {
+			ha->spill = 1;
+		}
+		if (ha->spill) return spill(ha, h, record);
+
+		err = insert(ha, s, h, record);
+		if (err != NOWDB_OK) return err;
+	}
+	return mapGroup(ha, s, record);
+}
+
+/* ------------------------------------------------------------------------
+ * Copy
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hashagg_copy(nowdb_hashagg_t  *ha,
+                               nowdb_eval_t   *eval,
+                               uint64_t      budget,
+                               nowdb_hashagg_t **cp) {
+	nowdb_err_t err=NOWDB_OK;
+	ts_algo_list_node_t *runner;
+	ts_algo_list_t keys;
+	nowdb_group_t *g;
+	nowdb_expr_t k;
+
+	if (ha == NULL) INVALID("hashagg is NULL");
+	if (cp == NULL) INVALID("pointer to copy is NULL");
+
+	ts_algo_list_init(&keys);
+	for(int i=0; i<ha->nkeys; i++) {
+		err = nowdb_expr_copy(ha->keys[i], &k);
+		if (err != NOWDB_OK) break;
+		if (ts_algo_list_append(&keys, k) != TS_ALGO_OK) {
+			NOMEM("list.append");
+			nowdb_expr_destroy(k); free(k);
+			break;
+		}
+	}
+	if (err == NOWDB_OK) {
+		err = nowdb_hashagg_new(cp, &keys, eval, ha->ctype,
+		                                ha->recsz, budget);
+	}
+	if (err != NOWDB_OK) {
+		for(runner=keys.head; runner!=NULL; runner=runner->nxt) {
+			nowdb_expr_destroy(runner->cont); free(runner->cont);
+		}
+		ts_algo_list_destroy(&keys);
+		return err;
+	}
+	ts_algo_list_destroy(&keys);
+
+	if (ha->group == NULL) return NOWDB_OK;
+
+	err = nowdb_group_copy(ha->group, &g);
+	if (err != NOWDB_OK) goto failure;
+
+	if (ha->group->hlp != NULL) nowdb_group_setEval(g, eval);
+
+	err = nowdb_hashagg_setGroup(*cp, g);
+	if (err != NOWDB_OK) {
+		nowdb_group_destroy(g); free(g);
+		goto failure;
+	}
+	return NOWDB_OK;
+
+failure:
+	nowdb_hashagg_destroy(*cp);
+	free(*cp); *cp = NULL;
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: merge the aggregates of slot s of src into slot t of ha
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t mergeSlot(nowdb_hashagg_t  *ha,
+                                    char              *t,
+                                    nowdb_hashagg_t *src,
+                                    char              *s) {
+	nowdb_err_t err;
+
+	if (ha->group == NULL) return NOWDB_OK;
+	if (ha->boxed) return nowdb_group_merge(BOX(ha,t), BOX(src,s));
+
+	nowdb_group_restore(ha->group, STATES(ha,t));
+	nowdb_group_restore(src->group, STATES(src,s));
+	err = nowdb_group_merge(ha->group, src->group);
+	nowdb_group_save(ha->group, STATES(ha,t));
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Merge
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hashagg_merge(nowdb_hashagg_t *ha,
+                                nowdb_hashagg_t *src) {
+	nowdb_err_t err;
+	char *s, *t;
+
+	if (ha == NULL) INVALID("hashagg is NULL");
+	if (src == NULL) INVALID("source is NULL");
+	if (ha->emitting) INVALID("cannot merge while delivering groups");
+	if (ha->spill) INVALID("cannot merge into spilled table");
+	if (src->tab == NULL) return NOWDB_OK;
+	if (ha->tab == NULL) {
+		err = initTable(ha);
+		if (err != NOWDB_OK) return err;
+	}
+	if (ha->esz != src->esz) INVALID("tables differ");
+
+	for(uint64_t i=0; i<src->cap; i++) {
+		s = SLOT(src,i);
+		if (HASH(s) == 0) continue;
+
+		memcpy(ha->key, SKEY(s), ha->ksz);
+		t = find(ha, HASH(s));
+		if (HASH(t) == 0) {
+			if ((ha->count+1)*4 > ha->cap*3) {
+				err = grow(ha);
+				if (err != NOWDB_OK) return err;
+				t = find(ha, HASH(s));
+			}
+			err = insert(ha, t, HASH(s), SREC(src,s));
+			if (err != NOWDB_OK) return err;
+		}
+		err = mergeSlot(ha, t, src, s);
+		if (err != NOWDB_OK) return err;
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Merge one group
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hashagg_mergeGroup(nowdb_hashagg_t *ha,
+                                     char        *record,
+                                     nowdb_group_t *group) {
+	nowdb_err_t err;
+	uint64_t h;
+	char *s;
+
+	if (ha == NULL) INVALID("hashagg is NULL");
+	if (ha->emitting) INVALID("cannot merge while delivering groups");
+	if (ha->spill) INVALID("cannot merge into spilled table");
+	if (ha->tab == NULL) {
+		err = initTable(ha);
+		if (err != NOWDB_OK) return err;
+	}
+
+	err = makeKey(ha, record);
+	if (err != NOWDB_OK) return err;
+
+	h = hash(ha->key, ha->ksz);
+	s = find(ha, h);
+	if (HASH(s) == 0) {
+		if ((ha->count+1)*4 > ha->cap*3) {
+			err = grow(ha);
+			if (err != NOWDB_OK) return err;
+			s = find(ha, h);
+		}
+		err = insert(ha, s, h, record);
+		if (err != NOWDB_OK) return err;
+	}
+	if (ha->group == NULL || group == NULL) return NOWDB_OK;
+	if (ha->boxed) return nowdb_group_merge(BOX(ha,s), group);
+
+	nowdb_group_restore(ha->group, STATES(ha,s));
+	err = nowdb_group_merge(ha->group, group);
+	nowdb_group_save(ha->group, STATES(ha,s));
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Partial group
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hashagg_partial(nowdb_hashagg_t *ha,
+                                  uint64_t       *pos,
+                                  char        **record,
+                                  nowdb_group_t **group) {
+	char *s;
+
+	if (ha == NULL) INVALID("hashagg is NULL");
+	if (ha->emitting) INVALID("groups are being delivered");
+
+	for(; ha->tab != NULL && *pos < ha->cap; (*pos)++) {
+		s = SLOT(ha,*pos);
+		if (HASH(s) == 0) continue;
+
+		*record = SREC(ha,s);
+		*group = NULL;
+		if (ha->group != NULL) {
+			if (ha->boxed) {
+				*group = BOX(ha,s);
+			} else {
+				nowdb_group_restore(ha->group, STATES(ha,s));
+				*group = ha->group;
+			}
+		}
+		(*pos)++;
+		return NOWDB_OK;
+	}
+	return nowdb_err_get(nowdb_err_eof, FALSE, OBJECT, NULL);
+}
+
+/* ------------------------------------------------------------------------
+ * Merge spilled records
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hashagg_mergeSpilled(nowdb_hashagg_t *ha,
+                                       nowdb_hashagg_t *src) {
+	nowdb_err_t err;
+
+	if (ha == NULL) INVALID("hashagg is NULL");
+	if (src == NULL) INVALID("source is NULL");
+
+	for(int i=0; i<NOWDB_HASHAGG_PARTS; i++) {
+		if (src->parts[i] == NULL) continue;
+		rewind(src->parts[i]);
+		for(;;) {
+			if (fread(src->rec, src->recsz, 1,
+			          src->parts[i]) != 1) {
+				if (ferror(src->parts[i])) {
+					return nowdb_err_get(nowdb_err_read,
+					   TRUE, OBJECT, "temporary file");
+				}
+				break;
+			}
+			err = nowdb_hashagg_map(ha, src->rec);
+			if (err != NOWDB_OK) return err;
+		}
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: queue the partitions of this pass
+ * (in front of the others: processing depth first,
+ *  we keep at most PARTS files open per level)
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t finishPass(nowdb_hashagg_t *ha) {
+	nowdb_err_t err;
+	part_t *part;
+
+	for(int i=0; i<NOWDB_HASHAGG_PARTS; i++) {
+		if (ha->parts[i] == NULL) continue;
+
+		part = calloc(1, sizeof(part_t));
+		if (part == NULL) {
+			NOMEM("allocating partition");
+			return err;
+		}
+		part->file = ha->parts[i];
+		part->level = ha->level+1;
+
+		if (ts_algo_list_insert(&ha->pending, part) != TS_ALGO_OK) {
+			NOMEM("list.insert");
+			free(part); return err;
+		}
+		ha->parts[i] = NULL;
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: load the next partition into the table
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t nextPart(nowdb_hashagg_t *ha) {
+	nowdb_err_t err = NOWDB_OK;
+	ts_algo_list_node_t *node;
+	part_t *part;
+
+	node = ha->pending.head;
+	part = node->cont;
+	ts_algo_list_remove(&ha->pending, node); free(node);
+
+	clearTable(ha);
+
+	ha->level = part->level;
+	ha->emitting = 0;
+
+	rewind(part->file);
+	for(;;) {
+		if (fread(ha->rec, ha->recsz, 1, part->file) != 1) {
+			if (ferror(part->file)) {
+				err = nowdb_err_get(nowdb_err_read, TRUE,
+				               OBJECT, "temporary file");
+			}
+			break;
+		}
+		err = nowdb_hashagg_map(ha, ha->rec);
+		if (err != NOWDB_OK) break;
+	}
+	fclose(part->file); free(part);
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: load the results of this slot into the aggregates
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t loadResult(nowdb_hashagg_t *ha, char *s) {
+	nowdb_err_t err;
+
+	if (ha->group == NULL) return NOWDB_OK;
+	if (ha->boxed) {
+		err = nowdb_group_reduce(BOX(ha,s), ha->ctype);
+		if (err != NOWDB_OK) return err;
+		nowdb_group_save(BOX(ha,s), ha->scratch);
+		nowdb_group_restore(ha->group, ha->scratch);
+		ha->group->reduced = 1;
+		return NOWDB_OK;
+	}
+	nowdb_group_restore(ha->group, STATES(ha,s));
+	return nowdb_group_reduce(ha->group, ha->ctype);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: compare two slots by the order keys (ascending)
+ * ------------------------------------------------------------------------
+ */
+static nowdb_cmp_t compareAsc(const void *left,
+                              const void *right,
+                              void         *arg) {
+	nowdb_hashagg_t *ha = arg;
+	char *l = SKEY((char*)left);
+	char *r = SKEY((char*)right);
+	nowdb_cmp_t c;
+	uint32_t k;
+	char tl, tr;
+
+	for(uint32_t i=0; i<ha->nord; i++) {
+		k = ha->ord[i];
+		tl = l[ha->nkeys*8+k];
+		tr = r[ha->nkeys*8+k];
+		if (tl < tr) return NOWDB_SORT_LESS;
+		if (tl > tr) return NOWDB_SORT_GREATER;
+		if (tl == NOWDB_TYP_NOTHING) continue;
+		c = nowdb_sort_getCompare(tl)(l+k*8, r+k*8, NULL);
+		if (c != NOWDB_SORT_EQUAL) return c;
+	}
+	return NOWDB_SORT_EQUAL;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: compare two slots by the order keys (descending)
+ * ------------------------------------------------------------------------
+ */
+static nowdb_cmp_t compareDesc(const void *left,
+                               const void *right,
+                               void         *arg) {
+	return compareAsc(right, left, arg);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: move the groups to the front of the table and sort them
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t sortGroups(nowdb_hashagg_t *ha) {
+	uint64_t j=0;
+	char *s;
+
+	if (ha->pending.len > 0) {
+		return nowdb_err_get(nowdb_err_not_supp, FALSE, OBJECT,
+		                "ordering groups beyond the memory budget");
+	}
+	for(uint64_t i=0; i<ha->cap; i++) {
+		s = SLOT(ha,i);
+		if (HASH(s) == 0) continue;
+		if (i != j) {
+			memcpy(SLOT(ha,j), s, ha->esz);
+			memset(s, 0, ha->esz);
+		}
+		j++;
+	}
+	nowdb_mem_sort(ha->tab, j, ha->esz,
+	               ha->dir == NOWDB_ORD_DESC ? &compareDesc:
+	                                           &compareAsc, ha);
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Next
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hashagg_next(nowdb_hashagg_t *ha, char **record) {
+	nowdb_err_t err;
+	char *s;
+
+	for(;;) {
+		if (!ha->emitting) {
+			err = finishPass(ha);
+			if (err != NOWDB_OK) return err;
+			if (ha->ord != NULL && ha->tab != NULL) {
+				err = sortGroups(ha);
+				if (err != NOWDB_OK) return err;
+			}
+			ha->emitting = 1;
+			ha->pos = 0;
+		}
+		while(ha->tab != NULL && ha->pos < ha->cap) {
+			s = SLOT(ha, ha->pos); ha->pos++;
+			if (HASH(s) == 0) continue;
+
+			err = loadResult(ha, s);
+			if (err != NOWDB_OK) return err;
+
+			*record = SREC(ha,s);
+			return NOWDB_OK;
+		}
+		if (ha->pending.len == 0) {
+			return nowdb_err_get(nowdb_err_eof, FALSE, OBJECT, NULL);
+		}
+		err = nextPart(ha);
+		if (err != NOWDB_OK) return err;
+	}
+}
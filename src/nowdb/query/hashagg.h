@@ -0,0 +1,226 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Hash aggregation: grouping without ordered input
+ * ========================================================================
+ * The records are mapped to groups identified by the values
+ * of the group keys. The groups are kept in an open-addressing
+ * hash table (linear probing). Each slot holds the hash,
+ * the key values, the first record of the group (used for projection)
+ * and the state of the aggregates. If all aggregates keep their state
+ * in registers (COUNT, SUM, PROD, MIN, MAX, SPREAD, AVG),
+ * the states are stored inline in the slot; otherwise,
+ * the slot holds a private copy of the aggregates.
+ * The distinct sets of these copies (COUNT DISTINCT) share a pool:
+ * their memory counts against the budget of the hash aggregation
+ * and they spill to the same partitions.
+ *
+ * When the table would exceed the memory budget, records
+ * of groups not yet in the table are spilled to one of a number of
+ * partitions (temporary files) selected by the hash.
+ * Groups in the table are still aggregated in memory.
+ * When all groups in the table are delivered, the partitions
+ * are processed one by one in the same way.
+ *
+ * For parallel scans, each worker aggregates into its own
+ * (empty) copy of the hash aggregation. The tables of the copies
+ * are then merged into the original and their spilled records
+ * are mapped again.
+ *
+ * If an order is requested, the groups are sorted
+ * by their keys before they are delivered. This is done in memory;
+ * ordering groups that were spilled is not supported.
+ * ========================================================================
+ */
+#ifndef nowdb_hashagg_decl
+#define nowdb_hashagg_decl
+
+#include <nowdb/types/types.h>
+#include <nowdb/types/error.h>
+#include <nowdb/fun/expr.h>
+#include <nowdb/fun/fun.h>
+#include <nowdb/fun/group.h>
+#include <nowdb/sort/sort.h>
+
+#include <tsalgo/list.h>
+
+#include <stdio.h>
+
+/* ------------------------------------------------------------------------
+ * Default memory budget for the hash table
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_HASHAGG_MEM 67108864
+
+/* ------------------------------------------------------------------------
+ * Number of partitions per spill level (4 bits of the hash)
+ * and max number of levels
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_HASHAGG_PARTS    16
+#define NOWDB_HASHAGG_MAXLEVEL  8
+
+/* ------------------------------------------------------------------------
+ * Hash aggregation
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	nowdb_expr_t          *keys; /* group key expressions         */
+	nowdb_group_t        *group; /* aggregates (may be NULL)      */
+	nowdb_eval_t          *eval; /* to evaluate the keys          */
+	nowdb_fun_state_t    *fresh; /* initial states                */
+	nowdb_fun_state_t  *scratch; /* temporary states              */
+	uint32_t               *ord; /* keys to order by              */
+	char                   *tab; /* the hash table                */
+	char                   *key; /* key of the current record     */
+	char                   *rec; /* record read from partition    */
+	FILE  *parts[NOWDB_HASHAGG_PARTS]; /* partitions of this pass */
+	ts_algo_list_t      pending; /* partitions to be processed    */
+	nowdb_hset_pool_t      pool; /* distinct sets of the groups   */
+	uint64_t             budget; /* memory budget                 */
+	uint64_t                mem; /* memory in use                 */
+	uint64_t              count; /* groups in table               */
+	uint64_t                cap; /* slots in table                */
+	uint64_t                pos; /* next slot to deliver          */
+	uint64_t            spilled; /* records spilled (total)       */
+	nowdb_content_t       ctype; /* edge or vertex                */
+	uint32_t              nkeys; /* number of keys                */
+	uint32_t               nord; /* number of keys to order by    */
+	nowdb_ord_t             dir; /* ascending or descending       */
+	uint32_t              recsz; /* record size                   */
+	uint32_t                ksz; /* size of the key in a slot     */
+	uint32_t                rsz; /* size of the record in a slot  */
+	uint32_t                esz; /* size of a slot                */
+	uint32_t              boxsz; /* estimated size of a box       */
+	uint32_t              level; /* current spill level           */
+	char                  boxed; /* aggregates are not inline     */
+	char                  spill; /* table is full                 */
+	char               emitting; /* delivering groups             */
+} nowdb_hashagg_t;
+
+/* ------------------------------------------------------------------------
+ * Allocate and initialise a new hash aggregation
+ * ----------------------------------------------
+ * - keys  : list of expressions (the hash aggregation
+ *           takes ownership of the expressions, but not of the list)
+ * - eval  : evaluation helper for the keys
+ * - ctype : edge or vertex
+ * - recsz : record size
+ * - budget: memory budget for the table
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hashagg_new(nowdb_hashagg_t **ha,
+                              ts_algo_list_t  *keys,
+                              nowdb_eval_t    *eval,
+                              nowdb_content_t ctype,
+                              uint32_t        recsz,
+                              uint64_t       budget);
+
+/* ------------------------------------------------------------------------
+ * Set the aggregates (before the first record is mapped);
+ * the hash aggregation takes ownership of the group.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hashagg_setGroup(nowdb_hashagg_t *ha,
+                                   nowdb_group_t   *group);
+
+/* ------------------------------------------------------------------------
+ * Copy hash aggregation
+ * ---------------------
+ * Creates a new and empty hash aggregation with copies
+ * of the keys and aggregates of 'ha' (but not of the order).
+ * The copy uses 'eval' and the memory budget 'budget'.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hashagg_copy(nowdb_hashagg_t  *ha,
+                               nowdb_eval_t   *eval,
+                               uint64_t      budget,
+                               nowdb_hashagg_t **cp);
+
+/* ------------------------------------------------------------------------
+ * Merge the table of a copy
+ * -------------------------
+ * The groups in the table of 'src' are added to the table
+ * of 'ha' and their partial aggregates are merged.
+ * The table of 'ha' grows regardless of the budget;
+ * 'ha' must not have spilled. Merge all copies first
+ * and then their spilled records (see mergeSpilled).
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hashagg_merge(nowdb_hashagg_t *ha,
+                                nowdb_hashagg_t *src);
+
+/* ------------------------------------------------------------------------
+ * Merge one group
+ * ---------------
+ * The group of 'record' is added to the table (if it is new)
+ * and the partial aggregates in 'group' are merged into it.
+ * As with merge, the table grows regardless of the budget
+ * and 'ha' must not have spilled.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hashagg_mergeGroup(nowdb_hashagg_t *ha,
+                                     char        *record,
+                                     nowdb_group_t *group);
+
+/* ------------------------------------------------------------------------
+ * Partial group
+ * -------------
+ * Delivers the first record and the partial aggregates
+ * of the group in slot *pos or later and advances *pos
+ * (start with *pos = 0). The aggregates are not reduced;
+ * they are valid until the next call.
+ * At the end, EOF is returned.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hashagg_partial(nowdb_hashagg_t *ha,
+                                  uint64_t       *pos,
+                                  char        **record,
+                                  nowdb_group_t **group);
+
+/* ------------------------------------------------------------------------
+ * Map the records spilled by a copy
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hashagg_mergeSpilled(nowdb_hashagg_t *ha,
+                                       nowdb_hashagg_t *src);
+
+/* ------------------------------------------------------------------------
+ * Set the order (before the first group is delivered)
+ * ---------------------------------------------------
+ * The fields are expressions equal to group keys;
+ * the hash aggregation does not take ownership of the list.
+ * Groups are sorted by the keys in direction 'dir'
+ * with NOTHING first (ascending) or last (descending);
+ * text is not supported.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hashagg_setOrder(nowdb_hashagg_t *ha,
+                                   ts_algo_list_t  *fields,
+                                   nowdb_ord_t         dir);
+
+/* ------------------------------------------------------------------------
+ * Destroy hash aggregation
+ * ------------------------------------------------------------------------
+ */
+void nowdb_hashagg_destroy(nowdb_hashagg_t *ha);
+
+/* ------------------------------------------------------------------------
+ * Map record to its group
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hashagg_map(nowdb_hashagg_t *ha, char *record);
+
+/* ------------------------------------------------------------------------
+ * Next group
+ * ----------
+ * Delivers the first record of the next group;
+ * the results of the group are loaded into the aggregates
+ * passed in with setGroup (reduced), so they can be projected.
+ * The record is valid until the next call.
+ * At the end, EOF is returned.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hashagg_next(nowdb_hashagg_t *ha, char **record);
+
+#endif
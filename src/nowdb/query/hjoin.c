@@ -0,0 +1,520 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Join of edges with the vertices of their origin or destination
+ * ========================================================================
+ */
+#include <nowdb/query/hjoin.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+static char *OBJECT = "hjoin";
+
+#define INVALID(s) \
+	return nowdb_err_get(nowdb_err_invalid, FALSE, OBJECT, s);
+
+#define NOMEM(s) \
+	err = nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT, s);
+
+/* ------------------------------------------------------------------------
+ * Initial number of slots
+ * ------------------------------------------------------------------------
+ */
+#define INITCAP 64
+#define MINCAP  16
+
+/* ------------------------------------------------------------------------
+ * Helper: hash the key
+ * ------------------------------------------------------------------------
+ */
+static inline uint64_t hash(uint64_t v) {
+	uint64_t h = v ^ 0x9e3779b97f4a7c15ULL;
+
+	h ^= h >> 33; h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33; h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: key of a slot (0: empty)
+ * ------------------------------------------------------------------------
+ */
+static inline uint64_t slotkey(char *slot) {
+	uint64_t k;
+	memcpy(&k, slot+NOWDB_OFF_VERTEX, 8);
+	return k;
+}
+
+/* ------------------------------------------------------------------------
+ * Allocate and initialise
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hjoin_new(nowdb_hjoin_t **hj,
+                            uint32_t       key,
+                            uint32_t     esize,
+                            uint32_t     vsize,
+                            nowdb_expr_t vfilter,
+                            nowdb_expr_t  filter,
+                            nowdb_eval_t   *eval,
+                            uint64_t     budget) {
+	nowdb_err_t err;
+
+	if (hj == NULL) INVALID("hjoin pointer is NULL");
+	if (eval == NULL) INVALID("eval is NULL");
+	if (key != NOWDB_OFF_ORIGIN && key != NOWDB_OFF_DESTIN) {
+		INVALID("join key must be origin or destin");
+	}
+	if (esize < 8 || vsize < 8) INVALID("invalid record size");
+
+	*hj = calloc(1, sizeof(nowdb_hjoin_t));
+	if (*hj == NULL) {
+		NOMEM("allocating hjoin");
+		return err;
+	}
+
+	ts_algo_list_init(&(*hj)->files);
+
+	(*hj)->key = key;
+	(*hj)->esize = esize;
+	(*hj)->vsize = vsize;
+	(*hj)->esz = (vsize+7)&~7;
+	(*hj)->size = esize+vsize;
+	(*hj)->budget = budget;
+	(*hj)->eval = eval;
+
+	/* control bits are read as int: leave some room behind */
+	(*hj)->rec = calloc(1, (*hj)->size+8);
+	if ((*hj)->rec == NULL) {
+		NOMEM("allocating joined record");
+		nowdb_hjoin_destroy(*hj); free(*hj); *hj = NULL;
+		return err;
+	}
+
+	(*hj)->sel = calloc(1, sizeof(nowdb_sel_t));
+	if ((*hj)->sel == NULL) {
+		NOMEM("allocating selection");
+		nowdb_hjoin_destroy(*hj); free(*hj); *hj = NULL;
+		return err;
+	}
+
+	if (vfilter != NULL) {
+		err = nowdb_vexpr_new(&(*hj)->vx, vfilter, eval);
+		if (err != NOWDB_OK) {
+			nowdb_hjoin_destroy(*hj); free(*hj); *hj = NULL;
+			return err;
+		}
+	}
+
+	/* we own the filters only on success */
+	(*hj)->vfilter = vfilter;
+	(*hj)->filter = filter;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Destroy
+ * ------------------------------------------------------------------------
+ */
+void nowdb_hjoin_destroy(nowdb_hjoin_t *hj) {
+	if (hj == NULL) return;
+	if (hj->rdr != NULL) {
+		nowdb_reader_destroy(hj->rdr);
+		free(hj->rdr); hj->rdr = NULL;
+	}
+	if (hj->store != NULL) {
+		nowdb_store_releaseFiles(hj->store, &hj->files);
+		hj->store = NULL;
+	}
+	if (hj->vx != NULL) {
+		nowdb_vexpr_destroy(hj->vx);
+		free(hj->vx); hj->vx = NULL;
+	}
+	if (hj->vfilter != NULL) {
+		nowdb_expr_destroy(hj->vfilter);
+		free(hj->vfilter); hj->vfilter = NULL;
+	}
+	if (hj->filter != NULL) {
+		nowdb_expr_destroy(hj->filter);
+		free(hj->filter); hj->filter = NULL;
+	}
+	if (hj->sel != NULL) {
+		free(hj->sel); hj->sel = NULL;
+	}
+	if (hj->tab != NULL) {
+		free(hj->tab); hj->tab = NULL;
+	}
+	if (hj->zero != NULL) {
+		free(hj->zero); hj->zero = NULL;
+	}
+	if (hj->rec != NULL) {
+		free(hj->rec); hj->rec = NULL;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: find slot of the key or empty slot
+ * ------------------------------------------------------------------------
+ */
+static inline char *find(char *tab, uint64_t cap,
+                         uint32_t esz, uint64_t k) {
+	uint64_t m = cap-1;
+	uint64_t i = hash(k)&m;
+	uint64_t s;
+
+	for(;;) {
+		s = slotkey(tab+i*esz);
+		if (s == 0 || s == k) return tab+i*esz;
+		i = (i+1)&m;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: allocate the table
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t initTable(nowdb_hjoin_t *hj) {
+	nowdb_err_t err;
+
+	hj->cap = INITCAP;
+	while(hj->cap > MINCAP && hj->cap*hj->esz > hj->budget) {
+		hj->cap >>= 1;
+	}
+	hj->tab = calloc(hj->cap, hj->esz);
+	if (hj->tab == NULL) {
+		NOMEM("allocating hash table");
+		return err;
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: double the table
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t grow(nowdb_hjoin_t *hj) {
+	nowdb_err_t err;
+	uint64_t cap = hj->cap << 1;
+	char *tab, *slot;
+
+	tab = calloc(cap, hj->esz);
+	if (tab == NULL) {
+		NOMEM("allocating hash table");
+		return err;
+	}
+	for(uint64_t i=0; i<hj->cap; i++) {
+		slot = hj->tab+i*hj->esz;
+		if (slotkey(slot) == 0) continue;
+		memcpy(find(tab, cap, hj->esz, slotkey(slot)),
+		                               slot, hj->vsize);
+	}
+	free(hj->tab); hj->tab = tab;
+	hj->cap = cap;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: forget all vertices
+ * ------------------------------------------------------------------------
+ */
+static void clearTable(nowdb_hjoin_t *hj) {
+	if (hj->tab != NULL) memset(hj->tab, 0, hj->cap*hj->esz);
+	if (hj->zero != NULL) {
+		free(hj->zero); hj->zero = NULL;
+	}
+	hj->count = 0;
+	hj->full = 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Add
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hjoin_add(nowdb_hjoin_t *hj, char *vertex) {
+	nowdb_err_t err;
+	uint64_t k;
+	char *s;
+
+	if (hj == NULL) INVALID("hjoin is NULL");
+	if (vertex == NULL) INVALID("vertex is NULL");
+	if (hj->full) return NOWDB_OK;
+
+	k = slotkey(vertex);
+
+	/* 0 marks empty slots */
+	if (k == 0) {
+		if (hj->zero == NULL) {
+			hj->zero = malloc(hj->vsize);
+			if (hj->zero == NULL) {
+				NOMEM("allocating vertex");
+				return err;
+			}
+			memcpy(hj->zero, vertex, hj->vsize);
+		}
+		return NOWDB_OK;
+	}
+	if (hj->tab == NULL) {
+		err = initTable(hj);
+		if (err != NOWDB_OK) return err;
+	}
+
+	s = find(hj->tab, hj->cap, hj->esz, k);
+	if (slotkey(s) != 0) return NOWDB_OK;
+
+	if ((hj->count+1)*4 > hj->cap*3) {
+		if (hj->cap*hj->esz*2 > hj->budget) {
+			hj->full = 1; return NOWDB_OK;
+		}
+		err = grow(hj);
+		if (err != NOWDB_OK) return err;
+		s = find(hj->tab, hj->cap, hj->esz, k);
+	}
+	memcpy(s, vertex, hj->vsize); hj->count++;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: lookup in the table
+ * ------------------------------------------------------------------------
+ */
+static inline char *lookup(nowdb_hjoin_t *hj, uint64_t k) {
+	char *s;
+
+	if (k == 0) return hj->zero;
+	if (hj->tab == NULL) return NULL;
+
+	s = find(hj->tab, hj->cap, hj->esz, k);
+	return (slotkey(s) == 0 ? NULL : s);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: select the vertices in the page that pass the vertex filter
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t selectPage(nowdb_hjoin_t   *hj,
+                                     char          *page,
+                                     nowdb_bitmap8_t *cont) {
+	nowdb_sel_fromPage(hj->sel, page, NOWDB_IDX_PAGE, hj->vsize, cont);
+	if (hj->vx == NULL || hj->sel->count == 0) return NOWDB_OK;
+	return nowdb_vexpr_select(hj->vx, page, hj->vsize, hj->sel);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: add all vertices in files to the table
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t build(nowdb_hjoin_t *hj, ts_algo_list_t *files) {
+	nowdb_err_t err;
+	nowdb_reader_t *rdr;
+	char *page;
+
+	if (files->head == NULL) return NOWDB_OK;
+
+	err = nowdb_reader_fullscan(&rdr, files, NULL);
+	if (err != NOWDB_OK) return err;
+
+	while(!hj->full) {
+		err = nowdb_reader_move(rdr);
+		if (err != NOWDB_OK) break;
+
+		page = nowdb_reader_page(rdr);
+		err = selectPage(hj, page, rdr->cont);
+		if (err != NOWDB_OK) break;
+
+		for(uint32_t i=0; i<hj->sel->count; i++) {
+			err = nowdb_hjoin_add(hj,
+			      page+hj->sel->pos[i]*hj->vsize);
+			if (err != NOWDB_OK) break;
+		}
+		if (err != NOWDB_OK) break;
+	}
+	nowdb_reader_destroy(rdr); free(rdr);
+	if (err != NOWDB_OK) {
+		if (err->errcode == nowdb_err_eof) {
+			nowdb_err_release(err);
+			return NOWDB_OK;
+		}
+		return err;
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: get pending files
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t getPending(ts_algo_list_t *files,
+                              ts_algo_list_t *pending) {
+	ts_algo_list_node_t *runner;
+	nowdb_file_t *file;
+
+	for(runner=files->head;runner!=NULL;runner=runner->nxt) {
+		file = runner->cont;
+		if (!(file->ctrl & NOWDB_FILE_SORT)) {
+			if (ts_algo_list_append(pending, file) != TS_ALGO_OK)
+			{
+				return nowdb_err_get(nowdb_err_no_mem,
+				        FALSE, OBJECT, "list.append");
+			}
+		}
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Open
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hjoin_open(nowdb_hjoin_t *hj,
+                             nowdb_scope_t *scope,
+                             char           *name,
+                             char          method) {
+	nowdb_err_t err;
+	nowdb_context_t *ctx;
+	ts_algo_list_t pending;
+
+	if (hj == NULL) INVALID("hjoin is NULL");
+	if (scope == NULL) INVALID("scope is NULL");
+	if (name == NULL) INVALID("name is NULL");
+	if (hj->store != NULL) INVALID("hjoin is already open");
+
+	err = nowdb_scope_getContext(scope, name, &ctx);
+	if (err != NOWDB_OK) return err;
+
+	err = nowdb_store_getFiles(&ctx->store, &hj->files,
+	                           NOWDB_TIME_DAWN, NOWDB_TIME_DUSK);
+	if (err != NOWDB_OK) return err;
+	hj->store = &ctx->store;
+
+	hj->method = method;
+	if (hj->method == NOWDB_HJOIN_HASH) {
+		err = build(hj, &hj->files);
+		if (err != NOWDB_OK) return err;
+		if (!hj->full) return NOWDB_OK;
+
+		/* does not fit: fall back to nested loop */
+		clearTable(hj);
+		hj->method = NOWDB_HJOIN_NESTED;
+	}
+
+	err = nowdb_scope_getVidx(scope, ctx, &hj->idx);
+	if (err != NOWDB_OK) return err;
+
+	/* pending files are not in the index */
+	ts_algo_list_init(&pending);
+	err = getPending(&hj->files, &pending);
+	if (err == NOWDB_OK) err = build(hj, &pending);
+	ts_algo_list_destroy(&pending);
+	if (err != NOWDB_OK) return err;
+
+	if (hj->full) return nowdb_err_get(nowdb_err_no_mem,
+	           FALSE, OBJECT, "pending vertices exceed budget");
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: search the vertex in the index
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t search(nowdb_hjoin_t *hj, uint64_t k, char **v) {
+	nowdb_err_t err;
+	char *page;
+
+	*v = NULL;
+	if (hj->idx == NULL || hj->files.head == NULL) return NOWDB_OK;
+
+	if (hj->rdr == NULL) {
+		err = nowdb_reader_search(&hj->rdr, &hj->files,
+		                          hj->idx, (char*)&k, NULL);
+		if (err != NOWDB_OK) {
+			hj->rdr = NULL; return err;
+		}
+	} else {
+		err = nowdb_reader_research(hj->rdr, hj->idx, (char*)&k);
+		if (err != NOWDB_OK) return err;
+	}
+	if (hj->rdr->nodata) return NOWDB_OK;
+
+	for(;;) {
+		err = nowdb_reader_move(hj->rdr);
+		if (err != NOWDB_OK) break;
+
+		page = nowdb_reader_page(hj->rdr);
+		err = selectPage(hj, page, hj->rdr->cont);
+		if (err != NOWDB_OK) break;
+
+		for(uint32_t i=0; i<hj->sel->count; i++) {
+			char *s = page+hj->sel->pos[i]*hj->vsize;
+			if (slotkey(s) == k) {
+				*v = s; return NOWDB_OK;
+			}
+		}
+	}
+	if (err->errcode == nowdb_err_eof) {
+		nowdb_err_release(err);
+		return NOWDB_OK;
+	}
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: record passes the filter
+ * (same semantics as in the cursor)
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t pass(nowdb_hjoin_t *hj, char *ok) {
+	nowdb_err_t err;
+	nowdb_type_t t;
+	void *v=NULL;
+
+	*ok = 1;
+	if (hj->filter == NULL) return NOWDB_OK;
+
+	err = nowdb_expr_eval(hj->filter, hj->eval, hj->rec, &t, &v);
+	if (err != NOWDB_OK) return err;
+
+	if (t == NOWDB_TYP_NOTHING) {
+		*ok = 0;
+	} else if (t == NOWDB_TYP_TEXT) {
+		if (v == NULL || strlen(v) == 0) *ok = 0;
+	} else if (!(*(nowdb_value_t*)v)) {
+		*ok = 0;
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Probe
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hjoin_probe(nowdb_hjoin_t *hj,
+                              char        *edge,
+                              char         **row) {
+	nowdb_err_t err;
+	uint64_t k;
+	char *v;
+	char ok;
+
+	if (hj == NULL) INVALID("hjoin is NULL");
+	if (edge == NULL) INVALID("edge is NULL");
+
+	*row = NULL;
+
+	memcpy(&k, edge+hj->key, 8);
+
+	v = lookup(hj, k);
+	if (v == NULL && hj->method == NOWDB_HJOIN_NESTED) {
+		err = search(hj, k, &v);
+		if (err != NOWDB_OK) return err;
+	}
+	if (v == NULL) return NOWDB_OK;
+
+	memcpy(hj->rec, edge, hj->esize);
+	memcpy(hj->rec+hj->esize, v, hj->vsize);
+
+	err = pass(hj, &ok);
+	if (err != NOWDB_OK) return err;
+	if (ok) *row = hj->rec;
+	return NOWDB_OK;
+}
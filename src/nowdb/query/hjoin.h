@@ -0,0 +1,147 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Join of edges with the vertices of their origin or destination
+ * ========================================================================
+ * The join is an equi-join on the origin (or destination) of the edge
+ * and the primary key of a vertex type. The vertex type is the
+ * build side: its records (restricted by the predicates on the vertex)
+ * are kept in an open-addressing hash table (linear probing)
+ * on the primary key. The edges are the probe side: each edge
+ * is looked up in the table and, when found, the joined record,
+ * i.e. the edge followed by the vertex, is passed on.
+ * Since the primary key identifies the vertex, each edge
+ * joins with at most one vertex.
+ *
+ * When the probe side is small (e.g. when the edges are read
+ * through an index search) or when the vertex type does not fit
+ * into the memory budget, we fall back to an index nested loop:
+ * each edge is looked up in the vertex index. Vertices not yet
+ * in the index (the pending files) are still kept in the table.
+ *
+ * Vertex fields in expressions on the joined record
+ * carry the size of the edge as base (see nowdb_field_t).
+ * ========================================================================
+ */
+#ifndef nowdb_hjoin_decl
+#define nowdb_hjoin_decl
+
+#include <nowdb/types/types.h>
+#include <nowdb/types/error.h>
+#include <nowdb/scope/scope.h>
+#include <nowdb/reader/reader.h>
+#include <nowdb/index/index.h>
+#include <nowdb/fun/expr.h>
+#include <nowdb/fun/vexpr.h>
+
+#include <tsalgo/list.h>
+
+/* ------------------------------------------------------------------------
+ * Default memory budget for the hash table
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_HJOIN_MEM 67108864
+
+/* ------------------------------------------------------------------------
+ * Join methods
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_HJOIN_HASH   0
+#define NOWDB_HJOIN_NESTED 1
+
+/* ------------------------------------------------------------------------
+ * Join
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	nowdb_store_t       *store; /* vertex store                    */
+	nowdb_index_t         *idx; /* vertex index (nested loop)      */
+	nowdb_reader_t        *rdr; /* index search (nested loop)      */
+	ts_algo_list_t       files; /* vertex files                    */
+	nowdb_expr_t       vfilter; /* predicates on the vertex        */
+	nowdb_expr_t        filter; /* predicates on the joined record */
+	nowdb_eval_t         *eval; /* evaluation helper               */
+	nowdb_vexpr_t          *vx; /* vertex predicates per page      */
+	nowdb_sel_t           *sel; /* selected vertices in page       */
+	char                  *tab; /* the hash table                  */
+	char                 *zero; /* the vertex with key 0           */
+	char                  *rec; /* the joined record               */
+	uint64_t            budget; /* memory budget                   */
+	uint64_t               cap; /* slots in table                  */
+	uint64_t             count; /* vertices in table               */
+	uint32_t             esize; /* edge record size                */
+	uint32_t             vsize; /* vertex record size              */
+	uint32_t               esz; /* size of a slot                  */
+	uint32_t              size; /* size of the joined record       */
+	uint32_t               key; /* offset of the key in the edge   */
+	char                method; /* hash or nested loop             */
+	char                  full; /* table exceeds the budget        */
+} nowdb_hjoin_t;
+
+/* ------------------------------------------------------------------------
+ * Allocate and initialise a new join
+ * ----------------------------------
+ * - key    : NOWDB_OFF_ORIGIN or NOWDB_OFF_DESTIN
+ * - esize  : edge record size
+ * - vsize  : vertex record size
+ * - vfilter: predicates on the vertex (may be NULL)
+ * - filter : predicates on the joined record (may be NULL)
+ * - eval   : evaluation helper
+ * - budget : memory budget for the table
+ * The join takes ownership of the filters.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hjoin_new(nowdb_hjoin_t **hj,
+                            uint32_t       key,
+                            uint32_t     esize,
+                            uint32_t     vsize,
+                            nowdb_expr_t vfilter,
+                            nowdb_expr_t  filter,
+                            nowdb_eval_t   *eval,
+                            uint64_t     budget);
+
+/* ------------------------------------------------------------------------
+ * Destroy join
+ * ------------------------------------------------------------------------
+ */
+void nowdb_hjoin_destroy(nowdb_hjoin_t *hj);
+
+/* ------------------------------------------------------------------------
+ * Open
+ * ----
+ * Builds the hash table from the vertex type 'name'.
+ * With method 'nested' (or when the vertex type does not fit
+ * into the table), only the pending vertices are kept in the table;
+ * all others are searched in the vertex index.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hjoin_open(nowdb_hjoin_t *hj,
+                             nowdb_scope_t *scope,
+                             char           *name,
+                             char          method);
+
+/* ------------------------------------------------------------------------
+ * Add a vertex to the table
+ * -------------------------
+ * The vertex predicates are not applied.
+ * When the table would exceed the budget,
+ * the vertex is not added and 'full' is set.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hjoin_add(nowdb_hjoin_t *hj, char *vertex);
+
+/* ------------------------------------------------------------------------
+ * Probe
+ * -----
+ * Looks up the vertex of the edge;
+ * 'row' points to the joined record or is NULL,
+ * if there is no such vertex or the joined record
+ * does not pass the filter.
+ * The record is valid until the next call.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_hjoin_probe(nowdb_hjoin_t *hj,
+                              char        *edge,
+                              char         **row);
+
+#endif
@@ -0,0 +1,694 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Parallel scan: intra-query parallel fullscan
+ * ========================================================================
+ */
+#include <nowdb/query/pscan.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+static char *OBJECT = "pscan";
+
+#define NOMEM(x) \
+	err = nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT, x);
+
+#define INVALID(x) \
+	return nowdb_err_get(nowdb_err_invalid, FALSE, OBJECT, x);
+
+/* ------------------------------------------------------------------------
+ * Size of the private text cache of a worker
+ * ------------------------------------------------------------------------
+ */
+#define TLRUSIZE 10000
+
+/* ------------------------------------------------------------------------
+ * Slot states
+ * ------------------------------------------------------------------------
+ */
+#define SLOT_FREE    0
+#define SLOT_FILLING 1
+#define SLOT_READY   2
+#define SLOT_HELD    3
+
+/* ------------------------------------------------------------------------
+ * Helper: position is "in" (not deleted)
+ * ------------------------------------------------------------------------
+ */
+static inline char checkpos(nowdb_bitmap8_t *cont, uint32_t pos) {
+	if (cont == NULL) return 1;
+	return ((cont[pos/8] & (1<<(pos%8))) != 0);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: record passes the filter
+ * (same semantics as in the cursor)
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t pass(nowdb_pscan_worker_t *w,
+                               char *rec, char *ok) {
+	nowdb_err_t err;
+	nowdb_type_t t;
+	void *v=NULL;
+
+	*ok = 1;
+	if (w->filter == NULL) return NOWDB_OK;
+
+	err = nowdb_expr_eval(w->filter, &w->eval, rec, &t, &v);
+	if (err != NOWDB_OK) return err;
+
+	if (t == NOWDB_TYP_NOTHING) {
+		*ok = 0;
+	} else if (t == NOWDB_TYP_TEXT) {
+		if (v == NULL || strlen(v) == 0) *ok = 0;
+	} else if (!(*(nowdb_value_t*)v)) {
+		*ok = 0;
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: get a free slot
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_pscan_slot_t *claim(nowdb_pscan_t *ps) {
+	nowdb_pscan_slot_t *slot = NULL;
+
+	NOWDB_IGNORE(nowdb_lock(&ps->lock));
+	while(!ps->stop) {
+		for(int i=0; i<ps->nslots; i++) {
+			if (ps->slots[i].state == SLOT_FREE) {
+				slot = ps->slots+i; break;
+			}
+		}
+		if (slot != NULL) break;
+		pthread_cond_wait(&ps->cond, &ps->lock);
+	}
+	if (slot != NULL) {
+		slot->state = SLOT_FILLING;
+		slot->size = 0;
+	}
+	NOWDB_IGNORE(nowdb_unlock(&ps->lock));
+	return slot;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: hand the slot we are filling over to the caller
+ * ------------------------------------------------------------------------
+ */
+static inline void publish(nowdb_pscan_worker_t *w) {
+	nowdb_pscan_t *ps = w->ps;
+
+	if (w->slot == NULL) return;
+	if (w->slot->size < ps->pagesz) {
+		memset(w->slot->page+w->slot->size, 0,
+		       NOWDB_IDX_PAGE-w->slot->size);
+	}
+	NOWDB_IGNORE(nowdb_lock(&ps->lock));
+	w->slot->state = SLOT_READY;
+	pthread_cond_broadcast(&ps->cond);
+	NOWDB_IGNORE(nowdb_unlock(&ps->lock));
+	w->slot = NULL;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: the caller has left
+ * ------------------------------------------------------------------------
+ */
+static inline char stopped(nowdb_pscan_t *ps) {
+	char x;
+	NOWDB_IGNORE(nowdb_lock(&ps->lock));
+	x = ps->stop;
+	NOWDB_IGNORE(nowdb_unlock(&ps->lock));
+	return x;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: process one page
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t processPage(nowdb_pscan_worker_t *w, char *page) {
+	nowdb_pscan_t *ps = w->ps;
+	nowdb_err_t err;
+	uint32_t recsz = ps->recsize;
+	char ok;
+
+	for(uint32_t off=0; off<ps->pagesz; off+=recsz) {
+		if (memcmp(page+off, nowdb_nullrec, recsz) == 0) break;
+		if (!checkpos(w->rdr->cont, off/recsz)) continue;
+
+		err = pass(w, page+off, &ok);
+		if (err != NOWDB_OK) return err;
+		if (!ok) continue;
+
+		/* groups */
+		if (w->hagg != NULL) {
+			err = nowdb_hashagg_map(w->hagg, page+off);
+			if (err != NOWDB_OK) return err;
+			continue;
+		}
+		if (w->tbkt != NULL) {
+			err = nowdb_tbucket_map(w->tbkt, page+off);
+			if (err != NOWDB_OK) return err;
+			continue;
+		}
+
+		/* aggregates */
+		if (w->group != NULL) {
+			if (!w->found) {
+				memcpy(w->first, page+off, recsz);
+				w->found = 1;
+			}
+			err = nowdb_group_map(w->group, ps->content,
+			                                   page+off);
+			if (err != NOWDB_OK) return err;
+			continue;
+		}
+
+		/* rows */
+		if (w->slot == NULL) {
+			w->slot = claim(ps);
+			if (w->slot == NULL) return nowdb_err_get(
+			            nowdb_err_eof, FALSE, OBJECT, NULL);
+		}
+		memcpy(w->slot->page+w->slot->size, page+off, recsz);
+		w->slot->size += recsz;
+		if (w->slot->size >= ps->pagesz) publish(w);
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: worker has finished
+ * ------------------------------------------------------------------------
+ */
+static inline void finish(nowdb_pscan_worker_t *w, nowdb_err_t err) {
+	nowdb_pscan_t *ps = w->ps;
+
+	if (err != NOWDB_OK && err->errcode == nowdb_err_eof) {
+		nowdb_err_release(err); err = NOWDB_OK;
+	}
+	NOWDB_IGNORE(nowdb_lock(&ps->lock));
+	if (err != NOWDB_OK) {
+		if (ps->err == NOWDB_OK) ps->err = err;
+		else nowdb_err_release(err);
+	}
+	ps->done++;
+	pthread_cond_broadcast(&ps->cond);
+	NOWDB_IGNORE(nowdb_unlock(&ps->lock));
+}
+
+/* ------------------------------------------------------------------------
+ * Worker: scan the partition
+ * ------------------------------------------------------------------------
+ */
+static void *scan(void *p) {
+	nowdb_pscan_worker_t *w = p;
+	nowdb_err_t err = NOWDB_OK;
+
+	for(;;) {
+		if ((w->group != NULL || w->hagg != NULL ||
+		     w->tbkt  != NULL) && stopped(w->ps)) break;
+
+		err = nowdb_reader_move(w->rdr);
+		if (err != NOWDB_OK) break;
+
+		err = processPage(w, nowdb_reader_page(w->rdr));
+		if (err != NOWDB_OK) break;
+	}
+	publish(w);
+	finish(w, err);
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: initialise worker
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t initWorker(nowdb_pscan_t        *ps,
+                              nowdb_pscan_worker_t  *w,
+                              ts_algo_list_t    *files,
+                              nowdb_time_t        from,
+                              nowdb_time_t          to,
+                              uint32_t           ahead,
+                              nowdb_expr_t      filter,
+                              nowdb_eval_t       *eval,
+                              nowdb_group_t     *group,
+                              nowdb_hashagg_t    *hagg,
+                              nowdb_tbucket_t    *tbkt) {
+	nowdb_err_t err;
+
+	w->ps = ps;
+	w->files = files;
+
+	if (filter != NULL) {
+		err = nowdb_expr_copy(filter, &w->filter);
+		if (err != NOWDB_OK) return err;
+	}
+
+	w->eval.model = eval->model;
+	w->eval.text = eval->text;
+	w->eval.tlru = calloc(1, sizeof(nowdb_ptlru_t));
+	if (w->eval.tlru == NULL) {
+		NOMEM("allocating text lru");
+		return err;
+	}
+	err = nowdb_ptlru_init(w->eval.tlru, TLRUSIZE);
+	if (err != NOWDB_OK) {
+		free(w->eval.tlru); w->eval.tlru = NULL;
+		return err;
+	}
+
+	if (group != NULL) {
+		err = nowdb_group_copy(group, &w->group);
+		if (err != NOWDB_OK) return err;
+		if (group->hlp != NULL) {
+			nowdb_group_setEval(w->group, &w->eval);
+		}
+		w->first = calloc(1, ps->recsize);
+		if (w->first == NULL) {
+			NOMEM("allocating record");
+			return err;
+		}
+	}
+
+	if (hagg != NULL) {
+		err = nowdb_hashagg_copy(hagg, &w->eval,
+		       hagg->budget/ps->nworkers, &w->hagg);
+		if (err != NOWDB_OK) return err;
+	}
+
+	if (tbkt != NULL) {
+		err = nowdb_tbucket_copy(tbkt, &w->eval,
+		       tbkt->budget/ps->nworkers, &w->tbkt);
+		if (err != NOWDB_OK) return err;
+	}
+
+	err = nowdb_reader_fullscan(&w->rdr, files, w->filter);
+	if (err != NOWDB_OK) {
+		w->rdr = NULL; return err;
+	}
+	nowdb_reader_setPeriod(w->rdr, from, to);
+	nowdb_reader_setReadahead(w->rdr, ahead);
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: destroy worker
+ * ------------------------------------------------------------------------
+ */
+static void destroyWorker(nowdb_pscan_worker_t *w) {
+	if (w->rdr != NULL) {
+		nowdb_reader_destroy(w->rdr);
+		free(w->rdr); w->rdr = NULL;
+	}
+	if (w->filter != NULL) {
+		nowdb_expr_destroy(w->filter);
+		free(w->filter); w->filter = NULL;
+	}
+	nowdb_eval_destroy(&w->eval);
+	if (w->group != NULL) {
+		nowdb_group_destroy(w->group);
+		free(w->group); w->group = NULL;
+	}
+	if (w->first != NULL) {
+		free(w->first); w->first = NULL;
+	}
+	if (w->hagg != NULL) {
+		nowdb_hashagg_destroy(w->hagg);
+		free(w->hagg); w->hagg = NULL;
+	}
+	if (w->tbkt != NULL) {
+		nowdb_tbucket_destroy(w->tbkt);
+		free(w->tbkt); w->tbkt = NULL;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: stop workers
+ * ------------------------------------------------------------------------
+ */
+static void stopWorkers(nowdb_pscan_t *ps) {
+	NOWDB_IGNORE(nowdb_lock(&ps->lock));
+	ps->stop = 1;
+	pthread_cond_broadcast(&ps->cond);
+	NOWDB_IGNORE(nowdb_unlock(&ps->lock));
+
+	for(int i=0; i<ps->nworkers; i++) {
+		if (ps->workers[i].rdr == NULL) continue;
+		if (ps->running == 0) break;
+		NOWDB_IGNORE(nowdb_task_join(ps->workers[i].task));
+		ps->running--;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Destroy
+ * ------------------------------------------------------------------------
+ */
+void nowdb_pscan_destroy(nowdb_pscan_t *ps) {
+	if (ps == NULL) return;
+
+	if (ps->workers != NULL) {
+		stopWorkers(ps);
+		for(int i=0; i<ps->nworkers; i++) {
+			destroyWorker(ps->workers+i);
+		}
+		free(ps->workers); ps->workers = NULL;
+	}
+	if (ps->lists != NULL) {
+		for(int i=0; i<ps->nworkers; i++) {
+			nowdb_store_releaseFiles(ps->store, ps->lists+i);
+		}
+		free(ps->lists); ps->lists = NULL;
+	}
+	if (ps->slots != NULL) {
+		for(int i=0; i<ps->nslots; i++) {
+			if (ps->slots[i].page != NULL) {
+				free(ps->slots[i].page);
+			}
+		}
+		free(ps->slots); ps->slots = NULL;
+	}
+	if (ps->err != NOWDB_OK) {
+		nowdb_err_release(ps->err); ps->err = NOWDB_OK;
+	}
+	pthread_cond_destroy(&ps->cond);
+	nowdb_lock_destroy(&ps->lock);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: get files and split them into partitions
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t getPartitions(nowdb_pscan_t *ps,
+                                 nowdb_time_t from,
+                                 nowdb_time_t   to) {
+	nowdb_err_t err=NOWDB_OK;
+	nowdb_store_handles_t handles;
+	nowdb_file_t *file;
+
+	ps->lists = calloc(ps->nworkers, sizeof(ts_algo_list_t));
+	if (ps->lists == NULL) {
+		NOMEM("allocating file lists");
+		return err;
+	}
+	for(int i=0; i<ps->nworkers; i++) {
+		ts_algo_list_init(ps->lists+i);
+	}
+
+	/* each worker copies only the files of its partition */
+	err = nowdb_store_getHandles(ps->store, &handles, from, to);
+	if (err != NOWDB_OK) return err;
+
+	for(int i=0; i<ps->nworkers; i++) {
+		err = nowdb_store_fromHandles(ps->store, &handles, i,
+		                              ps->nworkers, ps->lists+i);
+		if (err != NOWDB_OK) break;
+	}
+	nowdb_store_releaseHandles(ps->store, &handles);
+	if (err != NOWDB_OK) return err;
+
+	if (ps->lists[0].head == NULL) return nowdb_err_get(
+	                        nowdb_err_eof, FALSE, OBJECT, NULL);
+
+	file = ps->lists[0].head->cont;
+	ps->recsize = file->recordsize;
+	ps->content = file->cont;
+	ps->pagesz  = (NOWDB_IDX_PAGE/ps->recsize)*ps->recsize;
+
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: allocate slots for rows mode
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t allocSlots(nowdb_pscan_t *ps) {
+	nowdb_err_t err;
+
+	ps->nslots = 2*ps->nworkers;
+	ps->slots = calloc(ps->nslots, sizeof(nowdb_pscan_slot_t));
+	if (ps->slots == NULL) {
+		NOMEM("allocating slots");
+		return err;
+	}
+	for(int i=0; i<ps->nslots; i++) {
+		ps->slots[i].page = malloc(NOWDB_IDX_PAGE);
+		if (ps->slots[i].page == NULL) {
+			NOMEM("allocating slot");
+			return err;
+		}
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Allocate and start a parallel scan
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_pscan_new(nowdb_pscan_t **ps,
+                            nowdb_store_t *store,
+                            uint32_t           n,
+                            nowdb_time_t    from,
+                            nowdb_time_t      to,
+                            uint32_t       ahead,
+                            nowdb_expr_t  filter,
+                            nowdb_eval_t   *eval,
+                            nowdb_group_t *group,
+                            nowdb_hashagg_t *hagg,
+                            nowdb_tbucket_t *tbkt) {
+	nowdb_err_t err;
+
+	if (ps == NULL) INVALID("pointer to parallel scan is NULL");
+	if (store == NULL) INVALID("store is NULL");
+	if (eval == NULL) INVALID("evaluation helper is NULL");
+	if (n == 0) INVALID("no workers");
+
+	if (n > NOWDB_PSCAN_MAXDOP) n = NOWDB_PSCAN_MAXDOP;
+
+	/* the workers share the read-ahead */
+	if (ahead > 0) {
+		ahead = ahead/n;
+		if (ahead == 0) ahead = 1;
+	}
+
+	*ps = calloc(1, sizeof(nowdb_pscan_t));
+	if (*ps == NULL) {
+		NOMEM("allocating parallel scan");
+		return err;
+	}
+	(*ps)->store = store;
+	(*ps)->nworkers = n;
+
+	err = nowdb_lock_init(&(*ps)->lock);
+	if (err != NOWDB_OK) {
+		free(*ps); *ps = NULL; return err;
+	}
+	if (pthread_cond_init(&(*ps)->cond, NULL) != 0) {
+		nowdb_lock_destroy(&(*ps)->lock);
+		free(*ps); *ps = NULL;
+		return nowdb_err_get(nowdb_err_thread, TRUE, OBJECT,
+		                          "initialising condition");
+	}
+
+	err = getPartitions(*ps, from, to);
+	if (err != NOWDB_OK) goto failure;
+
+	if (group == NULL && hagg == NULL && tbkt == NULL) {
+		err = allocSlots(*ps);
+		if (err != NOWDB_OK) goto failure;
+	}
+
+	(*ps)->workers = calloc(n, sizeof(nowdb_pscan_worker_t));
+	if ((*ps)->workers == NULL) {
+		NOMEM("allocating workers");
+		goto failure;
+	}
+	for(int i=0; i<n; i++) {
+		if ((*ps)->lists[i].len == 0) continue;
+		err = initWorker(*ps, (*ps)->workers+i, (*ps)->lists+i,
+		                 from, to, ahead, filter, eval,
+		                 group, hagg, tbkt);
+		if (err != NOWDB_OK) goto failure;
+	}
+	for(int i=0; i<n; i++) {
+		if ((*ps)->workers[i].rdr == NULL) continue;
+		err = nowdb_task_create(&(*ps)->workers[i].task, &scan,
+		                                   (*ps)->workers+i);
+		if (err != NOWDB_OK) goto failure;
+		(*ps)->running++;
+	}
+	return NOWDB_OK;
+
+failure:
+	nowdb_pscan_destroy(*ps);
+	free(*ps); *ps = NULL;
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: hand out the error of a worker (once)
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t takeErr(nowdb_pscan_t *ps) {
+	nowdb_err_t err = ps->err;
+	ps->err = NOWDB_OK;
+	ps->eof = 1;
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Next
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_pscan_next(nowdb_pscan_t *ps, char **page) {
+	nowdb_pscan_slot_t *slot = NULL;
+	nowdb_err_t err;
+
+	if (ps->slots == NULL) INVALID("parallel scan not in rows mode");
+
+	err = nowdb_lock(&ps->lock);
+	if (err != NOWDB_OK) return err;
+
+	/* release the page we are holding */
+	if (ps->held != NULL) {
+		ps->held->state = SLOT_FREE;
+		ps->held = NULL;
+		pthread_cond_broadcast(&ps->cond);
+	}
+	for(;;) {
+		if (ps->eof) break;
+		if (ps->err != NOWDB_OK) {
+			err = takeErr(ps);
+			NOWDB_IGNORE(nowdb_unlock(&ps->lock));
+			return err;
+		}
+		for(int i=0; i<ps->nslots; i++) {
+			if (ps->slots[i].state == SLOT_READY) {
+				slot = ps->slots+i; break;
+			}
+		}
+		if (slot != NULL) break;
+		if (ps->done == ps->running) {
+			ps->eof = 1; break;
+		}
+		pthread_cond_wait(&ps->cond, &ps->lock);
+	}
+	if (slot == NULL) {
+		NOWDB_IGNORE(nowdb_unlock(&ps->lock));
+		return nowdb_err_get(nowdb_err_eof, FALSE, OBJECT, NULL);
+	}
+	slot->state = SLOT_HELD;
+	ps->held = slot;
+	*page = slot->page;
+	return nowdb_unlock(&ps->lock);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: wait for the workers
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t waitWorkers(nowdb_pscan_t *ps) {
+	nowdb_err_t err;
+
+	err = nowdb_lock(&ps->lock);
+	if (err != NOWDB_OK) return err;
+	while(ps->done < ps->running) {
+		pthread_cond_wait(&ps->cond, &ps->lock);
+	}
+	if (ps->err != NOWDB_OK) {
+		err = takeErr(ps);
+		NOWDB_IGNORE(nowdb_unlock(&ps->lock));
+		return err;
+	}
+	return nowdb_unlock(&ps->lock);
+}
+
+/* ------------------------------------------------------------------------
+ * Merge
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_pscan_merge(nowdb_pscan_t *ps,
+                              nowdb_group_t *group,
+                              char          *first) {
+	nowdb_pscan_worker_t *w;
+	nowdb_err_t err;
+	char found = 0;
+
+	if (group == NULL) INVALID("group is NULL");
+
+	err = waitWorkers(ps);
+	if (err != NOWDB_OK) return err;
+
+	/* merge partial aggregates */
+	for(int i=0; i<ps->nworkers; i++) {
+		w = ps->workers+i;
+		if (w->group == NULL || !w->found) continue;
+		err = nowdb_group_merge(group, w->group);
+		if (err != NOWDB_OK) return err;
+		if (first != NULL && !found) {
+			memcpy(first, w->first, ps->recsize);
+			found = 1;
+		}
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Merge groups
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_pscan_mergeGroups(nowdb_pscan_t   *ps,
+                                    nowdb_hashagg_t *hagg) {
+	nowdb_err_t err;
+
+	if (hagg == NULL) INVALID("hashagg is NULL");
+
+	err = waitWorkers(ps);
+	if (err != NOWDB_OK) return err;
+
+	/* first the tables, then what they have spilled:
+	 * a group is either in the table or spilled, never both */
+	for(int i=0; i<ps->nworkers; i++) {
+		if (ps->workers[i].hagg == NULL) continue;
+		err = nowdb_hashagg_merge(hagg, ps->workers[i].hagg);
+		if (err != NOWDB_OK) return err;
+	}
+	for(int i=0; i<ps->nworkers; i++) {
+		if (ps->workers[i].hagg == NULL) continue;
+		err = nowdb_hashagg_mergeSpilled(hagg, ps->workers[i].hagg);
+		if (err != NOWDB_OK) return err;
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Merge time buckets
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_pscan_mergeBuckets(nowdb_pscan_t   *ps,
+                                     nowdb_tbucket_t *tbkt) {
+	nowdb_err_t err;
+
+	if (tbkt == NULL) INVALID("tbucket is NULL");
+
+	err = waitWorkers(ps);
+	if (err != NOWDB_OK) return err;
+
+	/* as with hash aggregation: first the groups,
+	 * then what the overflows have spilled */
+	for(int i=0; i<ps->nworkers; i++) {
+		if (ps->workers[i].tbkt == NULL) continue;
+		err = nowdb_tbucket_merge(tbkt, ps->workers[i].tbkt);
+		if (err != NOWDB_OK) return err;
+	}
+	for(int i=0; i<ps->nworkers; i++) {
+		if (ps->workers[i].tbkt == NULL) continue;
+		err = nowdb_tbucket_mergeSpilled(tbkt, ps->workers[i].tbkt);
+		if (err != NOWDB_OK) return err;
+	}
+	return NOWDB_OK;
+}
@@ -0,0 +1,184 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Parallel scan: intra-query parallel fullscan
+ * ========================================================================
+ * The files of a store are split into n partitions;
+ * each partition is scanned by a worker running its own
+ * fullscan reader with a private copy of the filter.
+ *
+ * The scan runs in one of three modes:
+ * - aggregate: each worker maps the matching records
+ *              to its own copy of the aggregates;
+ *              the partial states are merged at the end
+ *              (before the aggregates are reduced).
+ * - groups   : each worker maps the matching records
+ *              to its own copy of the hash aggregation
+ *              (or of the time buckets);
+ *              the copies are merged at the end.
+ * - rows     : each worker copies the matching records
+ *              into pages that are handed out to the caller
+ *              in no particular order.
+ * ========================================================================
+ */
+#ifndef nowdb_pscan_decl
+#define nowdb_pscan_decl
+
+#include <nowdb/types/types.h>
+#include <nowdb/types/error.h>
+#include <nowdb/types/time.h>
+#include <nowdb/task/lock.h>
+#include <nowdb/task/task.h>
+#include <nowdb/store/store.h>
+#include <nowdb/reader/reader.h>
+#include <nowdb/fun/expr.h>
+#include <nowdb/fun/group.h>
+#include <nowdb/query/hashagg.h>
+#include <nowdb/query/tbucket.h>
+
+#include <tsalgo/list.h>
+
+#include <pthread.h>
+
+/* ------------------------------------------------------------------------
+ * Max degree of parallelism
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_PSCAN_MAXDOP 32
+
+/* ------------------------------------------------------------------------
+ * Page of matching records
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	char          *page; /* matching records             */
+	uint32_t       size; /* bytes used in page           */
+	char          state; /* free, filling, ready or held */
+} nowdb_pscan_slot_t;
+
+struct nowdb_pscan_t;
+
+/* ------------------------------------------------------------------------
+ * Worker
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	struct nowdb_pscan_t   *ps; /* the scan we belong to        */
+	ts_algo_list_t      *files; /* our partition of files       */
+	nowdb_reader_t        *rdr; /* fullscan on that partition   */
+	nowdb_expr_t        filter; /* private copy of the filter   */
+	nowdb_eval_t          eval; /* private evaluation helper    */
+	nowdb_group_t       *group; /* partial aggregates           */
+	nowdb_hashagg_t      *hagg; /* partial groups               */
+	nowdb_tbucket_t      *tbkt; /* partial time buckets         */
+	char                *first; /* first matching record        */
+	nowdb_pscan_slot_t   *slot; /* slot we are filling          */
+	nowdb_task_t          task; /* the thread                   */
+	char                 found; /* we have seen a record        */
+} nowdb_pscan_worker_t;
+
+/* ------------------------------------------------------------------------
+ * Parallel scan
+ * ------------------------------------------------------------------------
+ */
+typedef struct nowdb_pscan_t {
+	nowdb_lock_t             lock; /* protects slots and state     */
+	pthread_cond_t           cond; /* state has changed            */
+	nowdb_store_t          *store; /* where the files come from    */
+	ts_algo_list_t         *lists; /* one list of files per worker */
+	nowdb_pscan_worker_t *workers; /* the workers                  */
+	nowdb_pscan_slot_t     *slots; /* pages (rows mode only)       */
+	nowdb_pscan_slot_t      *held; /* slot held by the caller      */
+	nowdb_err_t               err; /* first error of a worker      */
+	uint32_t             nworkers; /* number of workers            */
+	uint32_t              running; /* number of tasks started      */
+	uint32_t                 done; /* number of tasks finished     */
+	uint32_t               nslots; /* number of slots              */
+	uint32_t              recsize; /* record size                  */
+	uint32_t               pagesz; /* usable bytes per page        */
+	nowdb_content_t       content; /* edge or vertex               */
+	char                     stop; /* terminate workers            */
+	char                      eof; /* eof was delivered            */
+} nowdb_pscan_t;
+
+/* ------------------------------------------------------------------------
+ * Allocate and start a parallel scan
+ * ----------------------------------
+ * - store   : the files are obtained from this store
+ *             using nowdb_store_getNFiles
+ * - n       : number of workers
+ * - from, to: period
+ * - ahead   : read-ahead (shared among the workers)
+ * - filter  : the filter (copied for each worker, may be NULL)
+ * - eval    : template for the workers' evaluation helpers
+ * - group   : aggregates (copied for each worker)
+ * - hagg    : hash aggregation (copied for each worker
+ *             sharing the memory budget of the original);
+ * - tbkt    : time buckets (copied in the same way);
+ *             if group, hagg and tbkt are NULL,
+ *             the scan runs in rows mode.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_pscan_new(nowdb_pscan_t **ps,
+                            nowdb_store_t *store,
+                            uint32_t           n,
+                            nowdb_time_t    from,
+                            nowdb_time_t      to,
+                            uint32_t       ahead,
+                            nowdb_expr_t  filter,
+                            nowdb_eval_t   *eval,
+                            nowdb_group_t *group,
+                            nowdb_hashagg_t *hagg,
+                            nowdb_tbucket_t *tbkt);
+
+/* ------------------------------------------------------------------------
+ * Stop the workers and destroy the parallel scan
+ * ------------------------------------------------------------------------
+ */
+void nowdb_pscan_destroy(nowdb_pscan_t *ps);
+
+/* ------------------------------------------------------------------------
+ * Next (rows mode)
+ * ----------------
+ * Releases the page obtained by the previous call and
+ * waits for the next page of matching records.
+ * The page is terminated by a null record, unless it is full.
+ * At the end, EOF is returned.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_pscan_next(nowdb_pscan_t *ps, char **page);
+
+/* ------------------------------------------------------------------------
+ * Merge (aggregate mode)
+ * ----------------------
+ * Waits for all workers to finish and merges their partial
+ * aggregates into 'group'. If 'first' is not NULL,
+ * the first matching record found by any worker
+ * is copied into 'first'.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_pscan_merge(nowdb_pscan_t *ps,
+                              nowdb_group_t *group,
+                              char          *first);
+
+/* ------------------------------------------------------------------------
+ * Merge groups (groups mode)
+ * --------------------------
+ * Waits for all workers to finish and merges their
+ * hash aggregations into 'hagg'.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_pscan_mergeGroups(nowdb_pscan_t   *ps,
+                                    nowdb_hashagg_t *hagg);
+
+/* ------------------------------------------------------------------------
+ * Merge time buckets (groups mode)
+ * --------------------------------
+ * Waits for all workers to finish and merges their
+ * time buckets into 'tbkt'.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_pscan_mergeBuckets(nowdb_pscan_t   *ps,
+                                     nowdb_tbucket_t *tbkt);
+
+#endif
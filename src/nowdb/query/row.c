@@ -12,10 +12,39 @@ static char *OBJECT = "row";
 #define NOMEM(m) \
 	err = nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT, m);
 
+#define TEXTFIELD(x) \
+	(nowdb_expr_type(x) == NOWDB_EXPR_FIELD && \
+	 NOWDB_EXPR_TOFIELD(x)->type == NOWDB_TYP_TEXT && \
+	!NOWDB_EXPR_TOFIELD(x)->usekey)
+
 #define ROWNULL() \
 	if (row == NULL) return nowdb_err_get(nowdb_err_invalid, \
 	                          FALSE, OBJECT, "row is NULL");
 
+/* ------------------------------------------------------------------------
+ * Helper: text fields are evaluated as keys;
+ *         the text is obtained when the row is written
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t keyText(nowdb_row_t *row) {
+	nowdb_err_t err;
+
+	for(int i=0; i<row->sz; i++) {
+		if (!TEXTFIELD(row->fields[i])) continue;
+		if (row->keyed == NULL) {
+			row->keyed = calloc(row->sz, 1);
+			if (row->keyed == NULL) {
+				NOMEM("allocating keyed fields");
+				return err;
+			}
+		}
+		nowdb_expr_usekey(row->fields[i]);
+		row->keyed[i] = 1;
+		row->ntext++;
+	}
+	return NOWDB_OK;
+}
+
 /* ------------------------------------------------------------------------
  * initialise the row
  * ------------------------------------------------------------------------
@@ -43,6 +72,12 @@ nowdb_err_t nowdb_row_init(nowdb_row_t       *row,
 	row->dirty = 0;
 
 	row->fields = NULL;
+	row->shared = NULL;
+	row->nshared = 0;
+	row->keyed = NULL;
+	row->ntext = 0;
+	row->tkeys = NULL;
+	row->tkcap = 0;
 
 	row->sz = fields->len;
 	if (row->sz == 0) return NOWDB_OK;
@@ -73,6 +108,34 @@ nowdb_err_t nowdb_row_init(nowdb_row_t       *row,
 		nowdb_row_destroy(row); 
 		return err;
 	}
+
+	// evaluate common subexpressions only once per row
+	err = nowdb_expr_share(row->fields, row->sz,
+	                     &row->shared, &row->nshared);
+	if (err != NOWDB_OK) {
+		nowdb_row_destroy(row); 
+		return err;
+	}
+	err = keyText(row);
+	if (err != NOWDB_OK) {
+		nowdb_row_destroy(row); 
+		return err;
+	}
+	if (row->nshared == 0) return NOWDB_OK;
+
+	// the programs refer to the replaced subexpressions
+	for(int i=0; i<row->sz; i++) {
+		err = nowdb_expr_compile(row->fields[i]);
+		if (err != NOWDB_OK) break;
+	}
+	for(int i=0; err == NOWDB_OK && i<row->nshared; i++) {
+		err = nowdb_expr_compile(
+		      NOWDB_EXPR_TOREF(row->shared[i])->ref);
+	}
+	if (err != NOWDB_OK) {
+		nowdb_row_destroy(row); 
+		return err;
+	}
 	return NOWDB_OK;
 }
 
@@ -92,10 +155,45 @@ void nowdb_row_destroy(nowdb_row_t *row) {
 		}
 		free(row->fields); row->fields = NULL;
 	}
+	// after the fields referring to them
+	if (row->shared != NULL) {
+		for(int i=0;i<row->nshared;i++) {
+			nowdb_expr_destroy(row->shared[i]);
+			free(row->shared[i]);
+		}
+		free(row->shared); row->shared = NULL;
+		row->nshared = 0;
+	}
+	if (row->keyed != NULL) {
+		free(row->keyed); row->keyed = NULL;
+	}
+	if (row->tkeys != NULL) {
+		free(row->tkeys); row->tkeys = NULL;
+	}
 	nowdb_eval_destroy(&row->eval);
 	
 }
 
+/* ------------------------------------------------------------------------
+ * Helper: get text for key (from the cache, if possible)
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t getText(nowdb_row_t *row,
+                                  nowdb_key_t  key,
+                                  char       **str) {
+	nowdb_err_t err;
+
+	err = nowdb_ptlru_get(row->eval.tlru, key, str);
+	if (err != NOWDB_OK) return err;
+
+	if (*str != NULL) return NOWDB_OK;
+
+	err = nowdb_text_getText(row->eval.text, key, str);
+	if (err != NOWDB_OK) return err;
+
+	return nowdb_ptlru_add(row->eval.tlru, key, *str);
+}
+
 /* ------------------------------------------------------------------------
  * Compute size necessary to store type
  * ------------------------------------------------------------------------
@@ -167,12 +265,23 @@ nowdb_err_t nowdb_row_project(nowdb_row_t *row,
 		}
 	}
 
+	// a new row: shared subexpressions are evaluated again
+	if (row->cur == 0) nowdb_expr_newRow(row->shared, row->nshared);
+
 	// project the fields
 	for(int i=row->cur; i<row->sz; i++) {
 		err = nowdb_expr_eval(row->fields[i],
 	                             &row->eval,
 		                     src, &typ, &val);
 		if (err != NOWDB_OK) return err;
+
+		// keyed text is resolved only now
+		if (row->keyed != NULL && row->keyed[i] &&
+		    typ == NOWDB_TYP_UINT) {
+			err = getText(row, *(nowdb_key_t*)val, (char**)&val);
+			if (err != NOWDB_OK) return err;
+			typ = NOWDB_TYP_TEXT;
+		}
 		t = (char)typ;
 		s = getSize(&t, val);
 		if (*osz + s + 1 >= sz) {
@@ -206,6 +315,109 @@ nowdb_err_t nowdb_row_project(nowdb_row_t *row,
 	return NOWDB_OK;
 }
 
+/* ------------------------------------------------------------------------
+ * Helper: compare keys
+ * ------------------------------------------------------------------------
+ */
+static int keycompare(const void *one, const void *two) {
+	if (*(nowdb_key_t*)one < *(nowdb_key_t*)two) return -1;
+	if (*(nowdb_key_t*)one > *(nowdb_key_t*)two) return  1;
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: remember key, if it is not yet in the cache
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t addKey(nowdb_row_t *row,
+                                 nowdb_key_t  key,
+                                 uint32_t      *k) {
+	nowdb_err_t err;
+	nowdb_key_t *tmp;
+	char *str;
+
+	err = nowdb_ptlru_get(row->eval.tlru, key, &str);
+	if (err != NOWDB_OK) return err;
+	if (str != NULL) return NOWDB_OK;
+
+	if (*k >= row->tkcap) {
+		uint32_t cap = row->tkcap == 0 ? 64 : 2*row->tkcap;
+
+		tmp = realloc(row->tkeys, cap*sizeof(nowdb_key_t));
+		if (tmp == NULL) {
+			NOMEM("allocating text keys");
+			return err;
+		}
+		row->tkeys = tmp;
+		row->tkcap = cap;
+	}
+	row->tkeys[*k] = key; (*k)++;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * fetch text
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_row_fetchText(nowdb_row_t *row,
+                                char *src, uint32_t recsz,
+                                uint16_t *pos, uint32_t n) {
+	nowdb_err_t err;
+	nowdb_type_t typ;
+	void *val;
+	char **strs;
+	uint32_t k=0, u=0;
+
+	ROWNULL();
+
+	if (row->ntext == 0 || n == 0) return NOWDB_OK;
+
+	// collect the keys we do not know yet
+	for(uint32_t j=0; j<n; j++) {
+		char *rec = src+pos[j]*recsz;
+		for(int i=0; i<row->sz; i++) {
+			if (!row->keyed[i]) continue;
+			err = nowdb_expr_eval(row->fields[i],
+			                      &row->eval,
+			                      rec, &typ, &val);
+			if (err != NOWDB_OK) return err;
+			if (typ != NOWDB_TYP_UINT) continue;
+			err = addKey(row, *(nowdb_key_t*)val, &k);
+			if (err != NOWDB_OK) return err;
+		}
+	}
+	if (k == 0) return NOWDB_OK;
+
+	// visit the text indices in key order
+	qsort(row->tkeys, k, sizeof(nowdb_key_t), &keycompare);
+	for(uint32_t i=1; i<k; i++) {
+		if (row->tkeys[i] == row->tkeys[u]) continue;
+		row->tkeys[++u] = row->tkeys[i];
+	}
+	k = u+1;
+
+	strs = calloc(k, sizeof(char*));
+	if (strs == NULL) {
+		NOMEM("allocating strings");
+		return err;
+	}
+	err = nowdb_text_getTexts(row->eval.text, row->tkeys, k, strs);
+	if (err != NOWDB_OK) {
+		free(strs); return err;
+	}
+
+	// the cache takes ownership of the strings
+	for(uint32_t i=0; i<k; i++) {
+		err = nowdb_ptlru_add(row->eval.tlru, row->tkeys[i], strs[i]);
+		if (err != NOWDB_OK) {
+			for(uint32_t j=i+1; j<k; j++) free(strs[j]);
+			break;
+		}
+	}
+	free(strs);
+	return err;
+}
+
 /* ------------------------------------------------------------------------
  * transform projected buffer to string
  * ------------------------------------------------------------------------
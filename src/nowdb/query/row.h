@@ -32,6 +32,12 @@ typedef struct {
 	uint32_t            fur; /* current function field            */
 	uint32_t          dirty; /* we are in the middle of something */
 	nowdb_expr_t    *fields; /* the projection fields             */
+	nowdb_expr_t    *shared; /* subexpressions shared by fields   */
+	uint32_t        nshared; /* number of shared subexpressions   */
+	char             *keyed; /* text fields carried as keys       */
+	uint32_t          ntext; /* number of keyed text fields       */
+	nowdb_key_t      *tkeys; /* text keys to fetch                */
+	uint32_t          tkcap; /* capacity of tkeys                 */
 	nowdb_eval_t       eval; /* evaluation helper                 */
 } nowdb_row_t;
 
@@ -67,6 +73,20 @@ nowdb_err_t nowdb_row_project(nowdb_row_t *row,
                               char *count,
                               char *complete);
 
+/* ------------------------------------------------------------------------
+ * fetch text
+ * ----------
+ * Text fields are carried as keys and resolved only
+ * when the row is written. This fetches the text for
+ * all keys in the 'n' records at positions 'pos' in src
+ * in one go (sorted by key), so that projecting
+ * these records will find the text in the cache.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_row_fetchText(nowdb_row_t *row,
+                                char *src, uint32_t recsz,
+                                uint16_t *pos, uint32_t n);
+
 /* ------------------------------------------------------------------------
  * transform projected buffer to string
  * ------------------------------------------------------------------------
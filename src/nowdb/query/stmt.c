@@ -604,6 +604,8 @@ static nowdb_err_t applyCreateOptions(nowdb_ast_t *opts,
 	nowdb_ast_t *o;
 	uint64_t cfgopts = 0;
 	uint64_t utmp;
+	char *comp = NULL;
+	char *enc = NULL;
 
 	/* with no options given: use defaults */
 	if (opts == NULL) {
@@ -641,9 +643,27 @@ static nowdb_err_t applyCreateOptions(nowdb_ast_t *opts,
 		cfgopts |= utmp;
 	}
 
-	/* get nocomp */
+	/* get compression ('' means: no compression) */
 	o = nowdb_ast_option(opts, NOWDB_AST_COMP);
-	if (o != NULL) cfgopts |= NOWDB_CONFIG_NOCOMP;
+	if (o != NULL) {
+		comp = nowdb_ast_getString(o);
+		if (comp == NULL || comp[0] == 0) {
+			cfgopts |= NOWDB_CONFIG_NOCOMP;
+		} else if (strcasecmp(comp, "zstd") != 0 &&
+		           strcasecmp(comp, "lz4")  != 0) {
+			INVALIDAST("unknown compression");
+		}
+	}
+
+	/* get encoding ('' means: no encoding) */
+	o = nowdb_ast_option(opts, NOWDB_AST_ENCODING);
+	if (o != NULL) {
+		enc = nowdb_ast_getString(o);
+		if (enc != NULL && enc[0] != 0 &&
+		    strcasecmp(enc, "gorilla") != 0) {
+			INVALIDAST("unknown encoding");
+		}
+	}
 
 	/* get nosort */
 	o = nowdb_ast_option(opts, NOWDB_AST_SORT);
@@ -652,6 +672,19 @@ static nowdb_err_t applyCreateOptions(nowdb_ast_t *opts,
 	/* apply the options */
 	nowdb_storage_config(cfg, cfgopts);
 
+	/* explicit compression overrides the sizing */
+	if (comp != NULL && comp[0] != 0) {
+		cfg->comp = strcasecmp(comp, "lz4") == 0?
+		              NOWDB_COMP_LZ4:NOWDB_COMP_ZSTD;
+	}
+
+	/* encoding applies to compressed readers only */
+	if (enc != NULL && enc[0] != 0) {
+		if (cfg->comp == NOWDB_COMP_FLAT) {
+			INVALIDAST("encoding requires compression");
+		}
+		cfg->encode = 1;
+	}
 	return NOWDB_OK;
 }
 
@@ -685,6 +718,14 @@ static nowdb_err_t applyGenericOptions(nowdb_ast_t *opts,
 			INVALIDAST("invalid ast: invalid large size");
 		cfg->largesize = (uint32_t)utmp;
 	}
+	o = nowdb_ast_option(opts, NOWDB_AST_READAHEAD);
+	if (o != NULL) {
+		if (nowdb_ast_getUInt(o, &utmp) != 0)
+			INVALIDAST("invalid ast: invalid read-ahead");
+		if (utmp > NOWDB_PREFETCH_MAXDEPTH)
+			INVALIDAST("read-ahead too big");
+		cfg->readahead = (uint32_t)utmp;
+	}
 	return NOWDB_OK;
 }
 
@@ -2572,6 +2613,12 @@ static nowdb_err_t handleMisc(nowdb_ast_t *ast,
 		res->result = op;
 		return NOWDB_OK;
 
+	/* session options are handled by the session */
+	case NOWDB_AST_SET:
+		res->resType = NOWDB_QRY_RESULT_OP;
+		res->result = op;
+		return NOWDB_OK;
+
 	case NOWDB_AST_SELECT: 
 		res->resType = NOWDB_QRY_RESULT_NOTHING;
 		res->result = NULL;
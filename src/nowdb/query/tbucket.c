@@ -0,0 +1,765 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Time buckets: grouping by time bins without sorting
+ * ========================================================================
+ */
+#include <nowdb/query/tbucket.h>
+
+#include <string.h>
+
+static char *OBJECT = "tbucket";
+
+#define INVALID(s) \
+	return nowdb_err_get(nowdb_err_invalid, FALSE, OBJECT, s);
+
+#define NOMEM(s) \
+	err = nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT, s);
+
+/* ------------------------------------------------------------------------
+ * Slot layout:
+ * [used][record][states or box]
+ * Dimension layout:
+ * [value][type][padding]
+ * ------------------------------------------------------------------------
+ */
+#define ALIGN8(x) \
+	(((x)+7)&~7)
+
+#define SLOT(tb,c,i) \
+	((tb)->cols[c]+(i)*(tb)->esz)
+
+#define USED(s) \
+	(*(uint64_t*)(s))
+
+#define SREC(s) \
+	((s)+8)
+
+#define SAGG(tb,s) \
+	((s)+8+(tb)->rsz)
+
+#define STATES(tb,s) \
+	((nowdb_fun_state_t*)SAGG(tb,s))
+
+#define BOX(tb,s) \
+	(*(nowdb_group_t**)SAGG(tb,s))
+
+#define DIMSZ 16
+
+#define DIM(tb,d) \
+	((tb)->dims+(d)*DIMSZ)
+
+/* ------------------------------------------------------------------------
+ * Helper: bin number (rounding towards minus infinity)
+ * ------------------------------------------------------------------------
+ */
+static inline int64_t binOf(nowdb_time_t t, int64_t w) {
+	return t/w - (t%w < 0);
+}
+
+/* ------------------------------------------------------------------------
+ * Check whether time buckets can be used
+ * ------------------------------------------------------------------------
+ */
+char nowdb_tbucket_applies(ts_algo_list_t *keys,
+                           nowdb_time_t    from,
+                           nowdb_time_t      to) {
+	uint16_t off;
+	int64_t w;
+
+	if (keys == NULL) return 0;
+	if (keys->len < 1 || keys->len > 2) return 0;
+	if (from == NOWDB_TIME_DAWN || to == NOWDB_TIME_DUSK) return 0;
+	if (from > to) return 0;
+	if (!nowdb_expr_timeBin(keys->head->cont, &off, &w)) return 0;
+	return (binOf(to, w) - binOf(from, w) < NOWDB_TBUCKET_MAXBINS);
+}
+
+/* ------------------------------------------------------------------------
+ * Allocate and initialise
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_tbucket_new(nowdb_tbucket_t **tb,
+                              ts_algo_list_t  *keys,
+                              nowdb_eval_t    *eval,
+                              nowdb_content_t ctype,
+                              uint32_t        recsz,
+                              nowdb_time_t     from,
+                              nowdb_time_t       to,
+                              uint64_t       budget) {
+	nowdb_err_t err;
+	ts_algo_list_node_t *runner;
+	int i=0;
+
+	if (tb == NULL) INVALID("tbucket pointer is NULL");
+	if (!nowdb_tbucket_applies(keys, from, to)) {
+		INVALID("keys or period not suitable for time buckets");
+	}
+
+	*tb = calloc(1, sizeof(nowdb_tbucket_t));
+	if (*tb == NULL) {
+		NOMEM("allocating tbucket");
+		return err;
+	}
+
+	nowdb_expr_timeBin(keys->head->cont, &(*tb)->off, &(*tb)->width);
+
+	(*tb)->eval = eval;
+	(*tb)->ctype = ctype;
+	(*tb)->recsz = recsz;
+	(*tb)->budget = budget;
+	(*tb)->nkeys = keys->len;
+	(*tb)->rsz = ALIGN8(recsz);
+	(*tb)->base = binOf(from, (*tb)->width);
+	(*tb)->nbins = binOf(to, (*tb)->width) - (*tb)->base + 1;
+
+	(*tb)->cols = calloc(NOWDB_TBUCKET_MAXDIM, sizeof(char*));
+	if ((*tb)->cols == NULL) {
+		NOMEM("allocating columns");
+		nowdb_tbucket_destroy(*tb);
+		free(*tb); *tb = NULL;
+		return err;
+	}
+	(*tb)->dims = calloc(NOWDB_TBUCKET_MAXDIM, DIMSZ);
+	if ((*tb)->dims == NULL) {
+		NOMEM("allocating dimension");
+		nowdb_tbucket_destroy(*tb);
+		free(*tb); *tb = NULL;
+		return err;
+	}
+	(*tb)->keys = calloc(keys->len, sizeof(nowdb_expr_t));
+	if ((*tb)->keys == NULL) {
+		NOMEM("allocating keys");
+		nowdb_tbucket_destroy(*tb);
+		free(*tb); *tb = NULL;
+		return err;
+	}
+
+	/* we group by the text key, not by the text */
+	for(runner=keys->head; runner!=NULL; runner=runner->nxt) {
+		(*tb)->keys[i] = runner->cont;
+		nowdb_expr_usekey((*tb)->keys[i]); i++;
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Set aggregates
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_tbucket_setGroup(nowdb_tbucket_t *tb,
+                                   nowdb_group_t   *group) {
+	nowdb_err_t err;
+
+	if (tb == NULL) INVALID("tbucket is NULL");
+	if (tb->esz != 0) INVALID("records already mapped");
+	if (tb->group != NULL) INVALID("group already set");
+	if (group == NULL) return NOWDB_OK;
+
+	tb->fresh = calloc(group->lst, sizeof(nowdb_fun_state_t));
+	if (tb->fresh == NULL) {
+		NOMEM("allocating states");
+		return err;
+	}
+	tb->scratch = calloc(group->lst, sizeof(nowdb_fun_state_t));
+	if (tb->scratch == NULL) {
+		NOMEM("allocating states");
+		free(tb->fresh); tb->fresh = NULL;
+		return err;
+	}
+
+	nowdb_group_reset(group);
+	nowdb_group_save(group, tb->fresh);
+
+	tb->boxed = !nowdb_group_inline(group);
+	tb->group = group;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Destroy
+ * ------------------------------------------------------------------------
+ */
+void nowdb_tbucket_destroy(nowdb_tbucket_t *tb) {
+	nowdb_group_t *g;
+	char *s;
+
+	if (tb == NULL) return;
+	if (tb->cols != NULL) {
+		for(uint32_t c=0; c<tb->ndims; c++) {
+			if (tb->boxed) {
+				for(uint64_t i=0; i<tb->nbins; i++) {
+					s = SLOT(tb,c,i);
+					if (!USED(s)) continue;
+					g = BOX(tb,s);
+					if (g == NULL) continue;
+					nowdb_group_destroy(g); free(g);
+				}
+			}
+			free(tb->cols[c]);
+		}
+		free(tb->cols); tb->cols = NULL;
+	}
+	if (tb->dims != NULL) {
+		free(tb->dims); tb->dims = NULL;
+	}
+	if (tb->overflow != NULL) {
+		nowdb_hashagg_destroy(tb->overflow);
+		free(tb->overflow); tb->overflow = NULL;
+	}
+	if (tb->keys != NULL) {
+		for(int i=0; i<tb->nkeys; i++) {
+			if (tb->keys[i] != NULL) {
+				nowdb_expr_destroy(tb->keys[i]);
+				free(tb->keys[i]);
+			}
+		}
+		free(tb->keys); tb->keys = NULL;
+	}
+	if (tb->group != NULL) {
+		nowdb_group_destroy(tb->group);
+		free(tb->group); tb->group = NULL;
+	}
+	if (tb->fresh != NULL) {
+		free(tb->fresh); tb->fresh = NULL;
+	}
+	if (tb->scratch != NULL) {
+		free(tb->scratch); tb->scratch = NULL;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: compute the slot size
+ * (we know the aggregates only after setGroup)
+ * ------------------------------------------------------------------------
+ */
+static void initSlots(nowdb_tbucket_t *tb) {
+	uint32_t asz = 0;
+
+	if (tb->group != NULL) {
+		if (tb->boxed) {
+			asz = sizeof(nowdb_group_t*);
+			tb->boxsz = sizeof(nowdb_group_t) + tb->group->lst *
+			           (sizeof(nowdb_fun_t)+sizeof(nowdb_fun_t*));
+		} else {
+			asz = tb->group->lst*sizeof(nowdb_fun_state_t);
+		}
+	}
+	tb->esz = 8 + tb->rsz + ALIGN8(asz);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: create the overflow with copies of keys and aggregates
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t initOverflow(nowdb_tbucket_t *tb) {
+	nowdb_err_t err=NOWDB_OK;
+	ts_algo_list_node_t *runner;
+	ts_algo_list_t keys;
+	nowdb_group_t *g;
+	nowdb_expr_t k;
+
+	ts_algo_list_init(&keys);
+	for(int i=0; i<tb->nkeys; i++) {
+		err = nowdb_expr_copy(tb->keys[i], &k);
+		if (err != NOWDB_OK) break;
+		if (ts_algo_list_append(&keys, k) != TS_ALGO_OK) {
+			NOMEM("list.append");
+			nowdb_expr_destroy(k); free(k);
+			break;
+		}
+	}
+	if (err == NOWDB_OK) {
+		err = nowdb_hashagg_new(&tb->overflow, &keys,
+		                        tb->eval, tb->ctype,
+		                        tb->recsz, tb->budget);
+	}
+	if (err != NOWDB_OK) {
+		for(runner=keys.head; runner!=NULL; runner=runner->nxt) {
+			nowdb_expr_destroy(runner->cont); free(runner->cont);
+		}
+		ts_algo_list_destroy(&keys);
+		return err;
+	}
+	ts_algo_list_destroy(&keys);
+
+	if (tb->group == NULL) return NOWDB_OK;
+
+	err = nowdb_group_copy(tb->group, &g);
+	if (err != NOWDB_OK) goto failure;
+
+	nowdb_group_setEval(g, tb->group->hlp);
+
+	err = nowdb_hashagg_setGroup(tb->overflow, g);
+	if (err != NOWDB_OK) {
+		nowdb_group_destroy(g); free(g);
+		goto failure;
+	}
+	return NOWDB_OK;
+
+failure:
+	nowdb_hashagg_destroy(tb->overflow);
+	free(tb->overflow); tb->overflow = NULL;
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: pass record on to the overflow
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t overflow(nowdb_tbucket_t *tb, char *record) {
+	nowdb_err_t err;
+
+	if (tb->overflow == NULL) {
+		err = initOverflow(tb);
+		if (err != NOWDB_OK) return err;
+	}
+	return nowdb_hashagg_map(tb->overflow, record);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: find the column of this value of the second key
+ *         (dim is NULL if there is no second key),
+ *         allocate a new one if the value is new
+ *         (-1: no column for this value)
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t getCol(nowdb_tbucket_t *tb,
+                                 char           *dim,
+                                 int            *col) {
+	nowdb_err_t err;
+	uint64_t sz;
+
+	*col = 0;
+	if (dim == NULL) {
+		if (tb->ndims > 0) return NOWDB_OK;
+	} else {
+		for(*col=0; *col<tb->ndims; (*col)++) {
+			if (memcmp(DIM(tb,*col), dim, DIMSZ) == 0) {
+				return NOWDB_OK;
+			}
+		}
+		if (tb->ndims >= NOWDB_TBUCKET_MAXDIM) {
+			*col = -1; return NOWDB_OK;
+		}
+	}
+
+	sz = tb->nbins*tb->esz;
+	if (tb->mem + sz > tb->budget) {
+		*col = -1; return NOWDB_OK;
+	}
+	tb->cols[tb->ndims] = calloc(tb->nbins, tb->esz);
+	if (tb->cols[tb->ndims] == NULL) {
+		NOMEM("allocating column");
+		return err;
+	}
+	if (dim != NULL) memcpy(DIM(tb,tb->ndims), dim, DIMSZ);
+	tb->mem += sz;
+	*col = tb->ndims; tb->ndims++;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: find the column of the second key of this record
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t findCol(nowdb_tbucket_t *tb,
+                                  char        *record,
+                                  int            *col) {
+	nowdb_err_t err;
+	char dim[DIMSZ];
+	nowdb_type_t t;
+	void *v=NULL;
+
+	if (tb->nkeys < 2) return getCol(tb, NULL, col);
+
+	err = nowdb_expr_eval(tb->keys[1], tb->eval, record, &t, &v);
+	if (err != NOWDB_OK) return err;
+
+	memset(dim, 0, DIMSZ); dim[8] = (char)t;
+	if (v != NULL) switch(t) {
+	case NOWDB_TYP_NOTHING: break;
+	case NOWDB_TYP_BOOL: memcpy(dim, v, 1); break;
+	case NOWDB_TYP_TEXT:
+	case NOWDB_TYP_LONGTEXT:
+		return nowdb_err_get(nowdb_err_not_supp, FALSE, OBJECT,
+		                         "grouping by computed text");
+	default: memcpy(dim, v, 8);
+	}
+	return getCol(tb, dim, col);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: insert new group
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t insert(nowdb_tbucket_t *tb,
+                                 char             *s,
+                                 char        *record) {
+	nowdb_err_t err;
+	nowdb_group_t *g;
+
+	if (tb->group != NULL) {
+		if (tb->boxed) {
+			err = nowdb_group_copy(tb->group, &g);
+			if (err != NOWDB_OK) return err;
+			nowdb_group_setEval(g, tb->group->hlp);
+			BOX(tb,s) = g;
+			tb->mem += tb->boxsz;
+		} else {
+			memcpy(STATES(tb,s), tb->fresh,
+			       tb->group->lst*sizeof(nowdb_fun_state_t));
+		}
+	}
+	memcpy(SREC(s), record, tb->recsz);
+	USED(s) = 1;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: map record to the aggregates of this slot
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t mapGroup(nowdb_tbucket_t *tb,
+                                   char             *s,
+                                   char        *record) {
+	nowdb_err_t err;
+
+	if (tb->group == NULL) return NOWDB_OK;
+	if (tb->boxed) {
+		return nowdb_group_map(BOX(tb,s), tb->ctype, record);
+	}
+	nowdb_group_restore(tb->group, STATES(tb,s));
+	err = nowdb_group_map(tb->group, tb->ctype, record);
+	nowdb_group_save(tb->group, STATES(tb,s));
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: find the slot of the group of this record,
+ *         insert the group if it is new
+ *         (NULL: the group goes to the overflow)
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t findSlot(nowdb_tbucket_t *tb,
+                                   char        *record,
+                                   char            **s) {
+	nowdb_err_t err;
+	nowdb_time_t t;
+	int64_t b;
+	int c=0;
+
+	*s = NULL;
+
+	memcpy(&t, record+tb->off, 8);
+	b = binOf(t, tb->width) - tb->base;
+	if (b < 0 || b >= tb->nbins) return NOWDB_OK;
+
+	err = findCol(tb, record, &c);
+	if (err != NOWDB_OK) return err;
+	if (c < 0) return NOWDB_OK;
+
+	/* new group */
+	if (!USED(SLOT(tb,c,b))) {
+		if (tb->boxed && tb->mem + tb->boxsz > tb->budget) {
+			return NOWDB_OK;
+		}
+		err = insert(tb, SLOT(tb,c,b), record);
+		if (err != NOWDB_OK) return err;
+	}
+	*s = SLOT(tb,c,b);
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Map
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_tbucket_map(nowdb_tbucket_t *tb, char *record) {
+	nowdb_err_t err;
+	char *s;
+
+	if (tb->emitting) INVALID("cannot map while delivering groups");
+	if (tb->esz == 0) initSlots(tb);
+
+	err = findSlot(tb, record, &s);
+	if (err != NOWDB_OK) return err;
+	if (s == NULL) return overflow(tb, record);
+
+	return mapGroup(tb, s, record);
+}
+
+/* ------------------------------------------------------------------------
+ * Copy
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_tbucket_copy(nowdb_tbucket_t  *tb,
+                               nowdb_eval_t   *eval,
+                               uint64_t      budget,
+                               nowdb_tbucket_t **cp) {
+	nowdb_err_t err=NOWDB_OK;
+	ts_algo_list_node_t *runner;
+	ts_algo_list_t keys;
+	nowdb_group_t *g;
+	nowdb_expr_t k;
+
+	if (tb == NULL) INVALID("tbucket is NULL");
+	if (cp == NULL) INVALID("pointer to copy is NULL");
+
+	ts_algo_list_init(&keys);
+	for(int i=0; i<tb->nkeys; i++) {
+		err = nowdb_expr_copy(tb->keys[i], &k);
+		if (err != NOWDB_OK) break;
+		if (ts_algo_list_append(&keys, k) != TS_ALGO_OK) {
+			NOMEM("list.append");
+			nowdb_expr_destroy(k); free(k);
+			break;
+		}
+	}
+	if (err == NOWDB_OK) {
+		err = nowdb_tbucket_new(cp, &keys, eval, tb->ctype, tb->recsz,
+		                        tb->base*tb->width,
+		                       (tb->base+tb->nbins-1)*tb->width,
+		                        budget);
+	}
+	if (err != NOWDB_OK) {
+		for(runner=keys.head; runner!=NULL; runner=runner->nxt) {
+			nowdb_expr_destroy(runner->cont); free(runner->cont);
+		}
+		ts_algo_list_destroy(&keys);
+		return err;
+	}
+	ts_algo_list_destroy(&keys);
+
+	if (tb->group == NULL) return NOWDB_OK;
+
+	err = nowdb_group_copy(tb->group, &g);
+	if (err != NOWDB_OK) goto failure;
+
+	if (tb->group->hlp != NULL) nowdb_group_setEval(g, eval);
+
+	err = nowdb_tbucket_setGroup(*cp, g);
+	if (err != NOWDB_OK) {
+		nowdb_group_destroy(g); free(g);
+		goto failure;
+	}
+	return NOWDB_OK;
+
+failure:
+	nowdb_tbucket_destroy(*cp);
+	free(*cp); *cp = NULL;
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: pass partial aggregates on to the overflow
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t overflowGroup(nowdb_tbucket_t *tb,
+                                        char        *record,
+                                        nowdb_group_t    *g) {
+	nowdb_err_t err;
+
+	if (tb->overflow == NULL) {
+		err = initOverflow(tb);
+		if (err != NOWDB_OK) return err;
+	}
+	return nowdb_hashagg_mergeGroup(tb->overflow, record, g);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: merge partial aggregates into the aggregates of this slot
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t mergeGroup(nowdb_tbucket_t *tb,
+                                     char             *s,
+                                     nowdb_group_t    *g) {
+	nowdb_err_t err;
+
+	if (tb->group == NULL || g == NULL) return NOWDB_OK;
+	if (tb->boxed) return nowdb_group_merge(BOX(tb,s), g);
+
+	nowdb_group_restore(tb->group, STATES(tb,s));
+	err = nowdb_group_merge(tb->group, g);
+	nowdb_group_save(tb->group, STATES(tb,s));
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: partial aggregates in slot s of src
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_group_t *partial(nowdb_tbucket_t *src, char *s) {
+	if (src->group == NULL) return NULL;
+	if (src->boxed) return BOX(src,s);
+	nowdb_group_restore(src->group, STATES(src,s));
+	return src->group;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: merge the group in slot s of src into slot t of tb;
+ *         new groups are taken over (including the box)
+ *         or go to the overflow, just as in map
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t mergeSlot(nowdb_tbucket_t  *tb,
+                                    char              *t,
+                                    nowdb_tbucket_t *src,
+                                    char              *s) {
+	if (USED(t)) return mergeGroup(tb, t, partial(src, s));
+
+	if (tb->boxed && tb->mem + tb->boxsz > tb->budget) {
+		return overflowGroup(tb, SREC(s), partial(src, s));
+	}
+	memcpy(t, s, tb->esz);
+	if (tb->boxed) {
+		BOX(src,s) = NULL; USED(s) = 0;
+		tb->mem += tb->boxsz;
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Merge
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_tbucket_merge(nowdb_tbucket_t *tb,
+                                nowdb_tbucket_t *src) {
+	nowdb_err_t err;
+	nowdb_group_t *g;
+	uint64_t pos=0;
+	char *r, *s;
+	int c;
+
+	if (tb == NULL) INVALID("tbucket is NULL");
+	if (src == NULL) INVALID("source is NULL");
+	if (tb->emitting) INVALID("cannot merge while delivering groups");
+	if (tb->base != src->base || tb->nbins != src->nbins ||
+	    tb->width != src->width) INVALID("bins differ");
+
+	if (tb->esz == 0) initSlots(tb);
+	if (src->esz != 0 && src->esz != tb->esz) INVALID("slots differ");
+
+	/* the bins */
+	for(uint32_t d=0; d<src->ndims; d++) {
+		err = getCol(tb, tb->nkeys < 2 ? NULL : DIM(src,d), &c);
+		if (err != NOWDB_OK) return err;
+
+		for(uint64_t i=0; i<src->nbins; i++) {
+			s = SLOT(src,d,i);
+			if (!USED(s)) continue;
+			err = c < 0 ? overflowGroup(tb, SREC(s), partial(src, s)):
+			              mergeSlot(tb, SLOT(tb,c,i), src, s);
+			if (err != NOWDB_OK) return err;
+		}
+	}
+
+	/* the groups in the overflow may have a bin here */
+	if (src->overflow == NULL) return NOWDB_OK;
+	for(;;) {
+		err = nowdb_hashagg_partial(src->overflow, &pos, &r, &g);
+		if (err != NOWDB_OK) {
+			if (nowdb_err_contains(err, nowdb_err_eof)) {
+				nowdb_err_release(err); break;
+			}
+			return err;
+		}
+		err = findSlot(tb, r, &s);
+		if (err != NOWDB_OK) return err;
+
+		err = s == NULL ? overflowGroup(tb, r, g):
+		                  mergeGroup(tb, s, g);
+		if (err != NOWDB_OK) return err;
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Merge spilled records
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_tbucket_mergeSpilled(nowdb_tbucket_t *tb,
+                                       nowdb_tbucket_t *src) {
+	nowdb_err_t err;
+	nowdb_hashagg_t *ha;
+
+	if (tb == NULL) INVALID("tbucket is NULL");
+	if (src == NULL) INVALID("source is NULL");
+	if (src->overflow == NULL) return NOWDB_OK;
+
+	ha = src->overflow;
+	for(int i=0; i<NOWDB_HASHAGG_PARTS; i++) {
+		if (ha->parts[i] == NULL) continue;
+		rewind(ha->parts[i]);
+		while(fread(ha->rec, ha->recsz, 1, ha->parts[i]) == 1) {
+			err = nowdb_tbucket_map(tb, ha->rec);
+			if (err != NOWDB_OK) return err;
+		}
+		if (ferror(ha->parts[i])) {
+			return nowdb_err_get(nowdb_err_read, TRUE, OBJECT,
+			                                 "temporary file");
+		}
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: load the results of this slot into the aggregates
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t loadResult(nowdb_tbucket_t *tb, char *s) {
+	nowdb_err_t err;
+
+	if (tb->group == NULL) return NOWDB_OK;
+	if (tb->boxed) {
+		err = nowdb_group_reduce(BOX(tb,s), tb->ctype);
+		if (err != NOWDB_OK) return err;
+		nowdb_group_save(BOX(tb,s), tb->scratch);
+		nowdb_group_restore(tb->group, tb->scratch);
+		tb->group->reduced = 1;
+		return NOWDB_OK;
+	}
+	nowdb_group_restore(tb->group, STATES(tb,s));
+	return nowdb_group_reduce(tb->group, tb->ctype);
+}
+
+/* ------------------------------------------------------------------------
+ * Next
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_tbucket_next(nowdb_tbucket_t *tb, char **record) {
+	nowdb_err_t err;
+	char *s;
+
+	if (!tb->emitting) {
+		tb->emitting = 1;
+		tb->pos = 0;
+		tb->col = 0;
+	}
+	while(tb->pos < tb->nbins) {
+		if (tb->col >= tb->ndims) {
+			tb->col = 0; tb->pos++; continue;
+		}
+		s = SLOT(tb, tb->col, tb->pos); tb->col++;
+		if (!USED(s)) continue;
+
+		err = loadResult(tb, s);
+		if (err != NOWDB_OK) return err;
+
+		*record = SREC(s);
+		return NOWDB_OK;
+	}
+	if (tb->overflow == NULL) {
+		return nowdb_err_get(nowdb_err_eof, FALSE, OBJECT, NULL);
+	}
+
+	/* the overflow loads the results into its own copy */
+	err = nowdb_hashagg_next(tb->overflow, record);
+	if (err != NOWDB_OK) return err;
+	if (tb->group == NULL) return NOWDB_OK;
+
+	nowdb_group_save(tb->overflow->group, tb->scratch);
+	nowdb_group_restore(tb->group, tb->scratch);
+	tb->group->reduced = 1;
+	return NOWDB_OK;
+}
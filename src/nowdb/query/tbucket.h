@@ -0,0 +1,189 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Time buckets: grouping by time bins without sorting
+ * ========================================================================
+ * When the first group key is bin(stamp, width) and the period
+ * of the query is known, the groups are the bins of the period.
+ * They are kept in a flat array indexed by (stamp - from)/width,
+ * so the records are mapped in one scan without hashing
+ * and without sorting and the groups are delivered in time order.
+ *
+ * An optional second key adds a small dimension:
+ * there is one array (column) per distinct value of that key
+ * (up to NOWDB_TBUCKET_MAXDIM columns).
+ * Columns are allocated when the value is first seen.
+ *
+ * Each slot holds a flag, the first record of the group
+ * (used for projection) and the state of the aggregates,
+ * inline or boxed as in hash aggregation.
+ *
+ * Records outside the period, records with a value of the second key
+ * that does not fit into the dimension and records that would exceed
+ * the memory budget are passed on to a hash aggregation (overflow).
+ * The groups of the overflow are delivered after the bins.
+ *
+ * For parallel scans, each worker maps into its own copy.
+ * The copies are merged bin by bin into the original;
+ * the groups of their overflows are merged into the bins
+ * where they fit and into the overflow of the original otherwise.
+ * ========================================================================
+ */
+#ifndef nowdb_tbucket_decl
+#define nowdb_tbucket_decl
+
+#include <nowdb/types/types.h>
+#include <nowdb/types/error.h>
+#include <nowdb/types/time.h>
+#include <nowdb/fun/expr.h>
+#include <nowdb/fun/fun.h>
+#include <nowdb/fun/group.h>
+#include <nowdb/query/hashagg.h>
+
+#include <tsalgo/list.h>
+
+/* ------------------------------------------------------------------------
+ * Max number of bins in the period
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_TBUCKET_MAXBINS 65536
+
+/* ------------------------------------------------------------------------
+ * Max number of distinct values of the second key
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_TBUCKET_MAXDIM 16
+
+/* ------------------------------------------------------------------------
+ * Time buckets
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	nowdb_expr_t          *keys; /* group key expressions         */
+	nowdb_group_t        *group; /* aggregates (may be NULL)      */
+	nowdb_eval_t          *eval; /* to evaluate the keys          */
+	nowdb_fun_state_t    *fresh; /* initial states                */
+	nowdb_fun_state_t  *scratch; /* temporary states              */
+	nowdb_hashagg_t   *overflow; /* groups not in the array       */
+	char **cols;                 /* one array per dimension       */
+	char  *dims;                 /* values of the second key      */
+	nowdb_time_t           base; /* first bin                     */
+	int64_t               width; /* bin width in time units       */
+	uint64_t              nbins; /* bins per column               */
+	uint64_t             budget; /* memory budget                 */
+	uint64_t                mem; /* memory in use                 */
+	uint64_t                pos; /* next bin to deliver           */
+	uint32_t                col; /* next column to deliver        */
+	uint32_t              ndims; /* columns in use                */
+	nowdb_content_t       ctype; /* edge or vertex                */
+	uint32_t              nkeys; /* number of keys (1 or 2)       */
+	uint32_t              recsz; /* record size                   */
+	uint32_t                rsz; /* size of the record in a slot  */
+	uint32_t                esz; /* size of a slot                */
+	uint32_t              boxsz; /* estimated size of a box       */
+	uint16_t                off; /* offset of the timestamp       */
+	char                  boxed; /* aggregates are not inline     */
+	char               emitting; /* delivering groups             */
+} nowdb_tbucket_t;
+
+/* ------------------------------------------------------------------------
+ * Check whether time buckets can be used
+ * for these keys in the period [from, to]
+ * ------------------------------------------------------------------------
+ */
+char nowdb_tbucket_applies(ts_algo_list_t *keys,
+                           nowdb_time_t    from,
+                           nowdb_time_t      to);
+
+/* ------------------------------------------------------------------------
+ * Allocate and initialise new time buckets
+ * ----------------------------------------
+ * - keys  : list of expressions, the first is bin(stamp, width),
+ *           the second (if any) is the dimension
+ *           (the time buckets take ownership of the expressions,
+ *            but not of the list)
+ * - eval  : evaluation helper for the keys
+ * - ctype : edge or vertex
+ * - recsz : record size
+ * - from  : start of the period
+ * - to    : end of the period
+ * - budget: memory budget for the bins
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_tbucket_new(nowdb_tbucket_t **tb,
+                              ts_algo_list_t  *keys,
+                              nowdb_eval_t    *eval,
+                              nowdb_content_t ctype,
+                              uint32_t        recsz,
+                              nowdb_time_t     from,
+                              nowdb_time_t       to,
+                              uint64_t       budget);
+
+/* ------------------------------------------------------------------------
+ * Set the aggregates (before the first record is mapped);
+ * the time buckets take ownership of the group.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_tbucket_setGroup(nowdb_tbucket_t *tb,
+                                   nowdb_group_t   *group);
+
+/* ------------------------------------------------------------------------
+ * Destroy time buckets
+ * ------------------------------------------------------------------------
+ */
+void nowdb_tbucket_destroy(nowdb_tbucket_t *tb);
+
+/* ------------------------------------------------------------------------
+ * Map record to its bin
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_tbucket_map(nowdb_tbucket_t *tb, char *record);
+
+/* ------------------------------------------------------------------------
+ * Copy
+ * ----
+ * Creates empty time buckets with the keys, the period
+ * and the aggregates of 'tb' for a worker of a parallel scan;
+ * the aggregates use 'eval' and the copy has its own budget.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_tbucket_copy(nowdb_tbucket_t  *tb,
+                               nowdb_eval_t   *eval,
+                               uint64_t      budget,
+                               nowdb_tbucket_t **cp);
+
+/* ------------------------------------------------------------------------
+ * Merge
+ * -----
+ * The groups of 'src' (a copy) are added to 'tb'
+ * and their partial aggregates are merged.
+ * Merge all copies first and then their spilled records
+ * (see mergeSpilled).
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_tbucket_merge(nowdb_tbucket_t *tb,
+                                nowdb_tbucket_t *src);
+
+/* ------------------------------------------------------------------------
+ * Map the records spilled by the overflow of a copy
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_tbucket_mergeSpilled(nowdb_tbucket_t *tb,
+                                       nowdb_tbucket_t *src);
+
+/* ------------------------------------------------------------------------
+ * Next group
+ * ----------
+ * Delivers the first record of the next non-empty bin
+ * (in time order and, within a bin, in the order
+ *  in which the values of the second key were first seen),
+ * then the groups of the overflow.
+ * The results of the group are loaded into the aggregates
+ * passed in with setGroup (reduced), so they can be projected.
+ * The record is valid until the next call.
+ * At the end, EOF is returned.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_tbucket_next(nowdb_tbucket_t *tb, char **record);
+
+#endif
@@ -0,0 +1,394 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Top-N: ordering with limit without ordered input
+ * ========================================================================
+ */
+#include <nowdb/query/topn.h>
+
+#include <string.h>
+
+static char *OBJECT = "topn";
+
+#define INVALID(s) \
+	return nowdb_err_get(nowdb_err_invalid, FALSE, OBJECT, s);
+
+#define NOMEM(s) \
+	err = nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT, s);
+
+/* ------------------------------------------------------------------------
+ * Initial number of entries
+ * ------------------------------------------------------------------------
+ */
+#define INITCAP 1024
+
+/* ------------------------------------------------------------------------
+ * Entry layout:
+ * [key values][key types][record]
+ * text keys are stored as pointer to a private copy of the string
+ * ------------------------------------------------------------------------
+ */
+#define ALIGN8(x) \
+	(((x)+7)&~7)
+
+#define ENTRY(tn,i) \
+	((tn)->heap+(i)*(tn)->esz)
+
+#define EVAL(e,i) \
+	((e)+(i)*8)
+
+#define ETYPE(tn,e,i) \
+	((e)[(tn)->nkeys*8+(i)])
+
+#define EREC(tn,e) \
+	((e)+(tn)->ksz)
+
+#define TEXT(e,i) \
+	(*(char**)EVAL(e,i))
+
+/* ------------------------------------------------------------------------
+ * Allocate and initialise
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_topn_new(nowdb_topn_t  **tn,
+                           ts_algo_list_t *keys,
+                           nowdb_eval_t   *eval,
+                           nowdb_ord_t      ord,
+                           uint32_t       recsz,
+                           uint64_t           n) {
+	nowdb_err_t err;
+	ts_algo_list_node_t *runner;
+	int i=0;
+
+	if (tn == NULL) INVALID("topn pointer is NULL");
+	if (keys == NULL) INVALID("no keys");
+	if (keys->len == 0) INVALID("no keys");
+
+	*tn = calloc(1, sizeof(nowdb_topn_t));
+	if (*tn == NULL) {
+		NOMEM("allocating topn");
+		return err;
+	}
+
+	(*tn)->eval = eval;
+	(*tn)->ord = ord;
+	(*tn)->max = n;
+	(*tn)->recsz = recsz;
+	(*tn)->nkeys = keys->len;
+	(*tn)->ksz = keys->len*8 + ALIGN8(keys->len);
+	(*tn)->esz = (*tn)->ksz + ALIGN8(recsz);
+
+	(*tn)->key = calloc(1, (*tn)->esz);
+	if ((*tn)->key == NULL) {
+		NOMEM("allocating key");
+		nowdb_topn_destroy(*tn);
+		free(*tn); *tn = NULL;
+		return err;
+	}
+	(*tn)->tmp = calloc(1, (*tn)->esz);
+	if ((*tn)->tmp == NULL) {
+		NOMEM("allocating entry");
+		nowdb_topn_destroy(*tn);
+		free(*tn); *tn = NULL;
+		return err;
+	}
+	(*tn)->keys = calloc(keys->len, sizeof(nowdb_expr_t));
+	if ((*tn)->keys == NULL) {
+		NOMEM("allocating keys");
+		nowdb_topn_destroy(*tn);
+		free(*tn); *tn = NULL;
+		return err;
+	}
+	for(runner=keys->head; runner!=NULL; runner=runner->nxt) {
+		(*tn)->keys[i] = runner->cont; i++;
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: free the strings of an entry
+ * ------------------------------------------------------------------------
+ */
+static inline void freeText(nowdb_topn_t *tn, char *e) {
+	for(int i=0; i<tn->nkeys; i++) {
+		if (ETYPE(tn,e,i) == NOWDB_TYP_TEXT && TEXT(e,i) != NULL) {
+			free(TEXT(e,i)); TEXT(e,i) = NULL;
+		}
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Destroy
+ * ------------------------------------------------------------------------
+ */
+void nowdb_topn_destroy(nowdb_topn_t *tn) {
+	if (tn == NULL) return;
+	if (tn->heap != NULL) {
+		for(uint64_t i=0; i<tn->count; i++) {
+			freeText(tn, ENTRY(tn,i));
+		}
+		free(tn->heap); tn->heap = NULL;
+	}
+	if (tn->keys != NULL) {
+		for(int i=0; i<tn->nkeys; i++) {
+			if (tn->keys[i] != NULL) {
+				nowdb_expr_destroy(tn->keys[i]);
+				free(tn->keys[i]);
+			}
+		}
+		free(tn->keys); tn->keys = NULL;
+	}
+	if (tn->key != NULL) {
+		free(tn->key); tn->key = NULL;
+	}
+	if (tn->tmp != NULL) {
+		free(tn->tmp); tn->tmp = NULL;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: compute the key of the record
+ * (text is not copied yet)
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t makeKey(nowdb_topn_t *tn, char *record) {
+	nowdb_err_t err;
+	nowdb_type_t t;
+	void *v=NULL;
+
+	memset(tn->key, 0, tn->ksz);
+	for(int i=0; i<tn->nkeys; i++) {
+		err = nowdb_expr_eval(tn->keys[i], tn->eval, record, &t, &v);
+		if (err != NOWDB_OK) return err;
+
+		if (v == NULL) t = NOWDB_TYP_NOTHING;
+		ETYPE(tn,tn->key,i) = (char)t;
+
+		switch(t) {
+		case NOWDB_TYP_NOTHING: break;
+		case NOWDB_TYP_BOOL: memcpy(EVAL(tn->key,i), v, 1); break;
+		case NOWDB_TYP_LONGTEXT:
+			ETYPE(tn,tn->key,i) = NOWDB_TYP_TEXT;
+		case NOWDB_TYP_TEXT: TEXT(tn->key,i) = v; break;
+		default: memcpy(EVAL(tn->key,i), v, 8);
+		}
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: compare one key
+ * NOTHING is smaller than anything else
+ * ------------------------------------------------------------------------
+ */
+#define CMPVAL(tp, a, b) \
+	if (*(tp*)(a) < *(tp*)(b)) return -1; \
+	if (*(tp*)(a) > *(tp*)(b)) return  1; \
+	return 0;
+
+static inline int cmpone(char t1, char *v1, char t2, char *v2) {
+	int x;
+
+	if (t1 == NOWDB_TYP_NOTHING) return t2==NOWDB_TYP_NOTHING?0:-1;
+	if (t2 == NOWDB_TYP_NOTHING) return 1;
+	if (t1 != t2) return t1<t2?-1:1;
+
+	switch(t1) {
+	case NOWDB_TYP_TEXT:
+		x = strcmp(*(char**)v1, *(char**)v2);
+		return x<0?-1:x>0?1:0;
+	case NOWDB_TYP_FLOAT: CMPVAL(double, v1, v2);
+	case NOWDB_TYP_UINT: CMPVAL(uint64_t, v1, v2);
+	case NOWDB_TYP_BOOL: CMPVAL(char, v1, v2);
+	default: CMPVAL(int64_t, v1, v2);
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: rank two entries (<0: one is better than two)
+ * ------------------------------------------------------------------------
+ */
+static inline int rank(nowdb_topn_t *tn, char *one, char *two) {
+	int x;
+
+	for(int i=0; i<tn->nkeys; i++) {
+		x = cmpone(ETYPE(tn,one,i), EVAL(one,i),
+		           ETYPE(tn,two,i), EVAL(two,i));
+		if (x != 0) return tn->ord==NOWDB_ORD_DESC?-x:x;
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: swap two entries
+ * ------------------------------------------------------------------------
+ */
+static inline void swap(nowdb_topn_t *tn, char *one, char *two) {
+	memcpy(tn->tmp, one, tn->esz);
+	memcpy(one, two, tn->esz);
+	memcpy(two, tn->tmp, tn->esz);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: move entry up to its place (worst on top)
+ * ------------------------------------------------------------------------
+ */
+static inline void siftUp(nowdb_topn_t *tn, uint64_t i) {
+	uint64_t p;
+
+	while(i>0) {
+		p = (i-1)/2;
+		if (rank(tn, ENTRY(tn,i), ENTRY(tn,p)) <= 0) break;
+		swap(tn, ENTRY(tn,i), ENTRY(tn,p)); i=p;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: move entry down to its place in a heap of n entries
+ * ------------------------------------------------------------------------
+ */
+static inline void siftDown(nowdb_topn_t *tn, uint64_t i, uint64_t n) {
+	uint64_t l, w;
+
+	for(;;) {
+		l = 2*i+1;
+		if (l >= n) break;
+		w = l;
+		if (l+1 < n && rank(tn, ENTRY(tn,l+1), ENTRY(tn,l)) > 0) {
+			w = l+1;
+		}
+		if (rank(tn, ENTRY(tn,w), ENTRY(tn,i)) <= 0) break;
+		swap(tn, ENTRY(tn,i), ENTRY(tn,w)); i=w;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: copy the current key and the record into entry
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t store(nowdb_topn_t *tn, char *e, char *record) {
+	nowdb_err_t err;
+
+	memcpy(e, tn->key, tn->ksz);
+	for(int i=0; i<tn->nkeys; i++) {
+		if (ETYPE(tn,e,i) != NOWDB_TYP_TEXT) continue;
+		TEXT(e,i) = strdup(TEXT(tn->key,i));
+		if (TEXT(e,i) == NULL) {
+			ETYPE(tn,e,i) = NOWDB_TYP_NOTHING;
+			freeText(tn, e);
+			NOMEM("copying text");
+			return err;
+		}
+	}
+	memcpy(EREC(tn,e), record, tn->recsz);
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: grow heap
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t grow(nowdb_topn_t *tn) {
+	nowdb_err_t err;
+	uint64_t cap;
+	char *tmp;
+
+	cap = tn->cap==0?INITCAP:2*tn->cap;
+	if (cap > tn->max) cap = tn->max;
+
+	tmp = realloc(tn->heap, cap*tn->esz);
+	if (tmp == NULL) {
+		NOMEM("allocating heap");
+		return err;
+	}
+	tn->heap = tmp;
+	tn->cap = cap;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Add record
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_topn_add(nowdb_topn_t *tn, char *record) {
+	nowdb_err_t err;
+
+	if (tn->sorted) INVALID("topn is already delivering");
+	if (tn->max == 0) {
+		tn->discarded++; return NOWDB_OK;
+	}
+
+	err = makeKey(tn, record);
+	if (err != NOWDB_OK) return err;
+
+	/* still room: add and move up */
+	if (tn->count < tn->max) {
+		if (tn->count >= tn->cap) {
+			err = grow(tn);
+			if (err != NOWDB_OK) return err;
+		}
+		err = store(tn, ENTRY(tn,tn->count), record);
+		if (err != NOWDB_OK) return err;
+		siftUp(tn, tn->count); tn->count++;
+		return NOWDB_OK;
+	}
+
+	/* not better than the worst: discard */
+	if (rank(tn, tn->key, ENTRY(tn,0)) >= 0) {
+		tn->discarded++; return NOWDB_OK;
+	}
+
+	/* replace the worst and move down */
+	freeText(tn, ENTRY(tn,0));
+	err = store(tn, ENTRY(tn,0), record);
+	if (err != NOWDB_OK) {
+		/* the entry is lost: fill the gap with the last one */
+		tn->count--;
+		if (tn->count > 0) {
+			memcpy(ENTRY(tn,0), ENTRY(tn,tn->count), tn->esz);
+			siftDown(tn, 0, tn->count);
+		}
+		return err;
+	}
+	siftDown(tn, 0, tn->count);
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * N records are kept
+ * ------------------------------------------------------------------------
+ */
+char nowdb_topn_full(nowdb_topn_t *tn) {
+	return (tn->max > 0 && tn->count >= tn->max);
+}
+
+/* ------------------------------------------------------------------------
+ * Worst record kept
+ * ------------------------------------------------------------------------
+ */
+char *nowdb_topn_worst(nowdb_topn_t *tn) {
+	if (tn->count == 0 || tn->sorted) return NULL;
+	return EREC(tn, ENTRY(tn,0));
+}
+
+/* ------------------------------------------------------------------------
+ * Next record
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_topn_next(nowdb_topn_t *tn, char **record) {
+
+	/* heapsort: the worst goes to the end */
+	if (!tn->sorted) {
+		for(uint64_t n=tn->count; n>1; n--) {
+			swap(tn, ENTRY(tn,0), ENTRY(tn,n-1));
+			siftDown(tn, 0, n-1);
+		}
+		tn->sorted = 1;
+		tn->pos = 0;
+	}
+	if (tn->pos >= tn->count) {
+		return nowdb_err_get(nowdb_err_eof, FALSE, OBJECT, NULL);
+	}
+	*record = EREC(tn, ENTRY(tn,tn->pos)); tn->pos++;
+	return NOWDB_OK;
+}
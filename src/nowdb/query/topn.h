@@ -0,0 +1,103 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Top-N: ordering with limit without ordered input
+ * ========================================================================
+ * The records are ranked by the values of the order keys.
+ * The best N records (N = limit + offset) are kept in a binary heap
+ * that has the worst of them on top. A new record replaces the top
+ * if it is better; otherwise, it is discarded right away.
+ * When all records are added, the heap is sorted in place
+ * (heapsort) and the records are delivered best first.
+ *
+ * Each entry holds the key values, their types and a copy
+ * of the record. Text keys are copied as well, so they can be
+ * compared by the string (not by the text key).
+ * ========================================================================
+ */
+#ifndef nowdb_topn_decl
+#define nowdb_topn_decl
+
+#include <nowdb/types/types.h>
+#include <nowdb/types/error.h>
+#include <nowdb/sort/sort.h>
+#include <nowdb/fun/expr.h>
+
+#include <tsalgo/list.h>
+
+/* ------------------------------------------------------------------------
+ * Top-N
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	nowdb_expr_t          *keys; /* order key expressions         */
+	nowdb_eval_t          *eval; /* to evaluate the keys          */
+	char                  *heap; /* the entries                   */
+	char                   *key; /* entry of the current record   */
+	char                   *tmp; /* for swapping entries          */
+	uint64_t                max; /* N                             */
+	uint64_t              count; /* entries in heap               */
+	uint64_t                cap; /* entries allocated             */
+	uint64_t                pos; /* next entry to deliver         */
+	uint64_t          discarded; /* records discarded right away  */
+	uint32_t              nkeys; /* number of keys                */
+	uint32_t              recsz; /* record size                   */
+	uint32_t                ksz; /* size of the key in an entry   */
+	uint32_t                esz; /* size of an entry              */
+	nowdb_ord_t             ord; /* ascending or descending       */
+	char                 sorted; /* delivering records            */
+} nowdb_topn_t;
+
+/* ------------------------------------------------------------------------
+ * Allocate and initialise a new top-n
+ * -----------------------------------
+ * - keys : list of expressions (top-n takes ownership
+ *          of the expressions, but not of the list)
+ * - eval : evaluation helper for the keys
+ * - ord  : NOWDB_ORD_ASC or NOWDB_ORD_DESC
+ * - recsz: record size
+ * - n    : number of records to keep
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_topn_new(nowdb_topn_t  **tn,
+                           ts_algo_list_t *keys,
+                           nowdb_eval_t   *eval,
+                           nowdb_ord_t      ord,
+                           uint32_t       recsz,
+                           uint64_t           n);
+
+/* ------------------------------------------------------------------------
+ * Destroy top-n
+ * ------------------------------------------------------------------------
+ */
+void nowdb_topn_destroy(nowdb_topn_t *tn);
+
+/* ------------------------------------------------------------------------
+ * Add record
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_topn_add(nowdb_topn_t *tn, char *record);
+
+/* ------------------------------------------------------------------------
+ * N records are kept, i.e. new records must beat the worst one
+ * ------------------------------------------------------------------------
+ */
+char nowdb_topn_full(nowdb_topn_t *tn);
+
+/* ------------------------------------------------------------------------
+ * Worst record kept (NULL if there is none)
+ * ------------------------------------------------------------------------
+ */
+char *nowdb_topn_worst(nowdb_topn_t *tn);
+
+/* ------------------------------------------------------------------------
+ * Next record
+ * -----------
+ * The first call sorts the heap; no records can be added afterwards.
+ * Delivers the records best first. The record is valid
+ * until the top-n is destroyed. At the end, EOF is returned.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_topn_next(nowdb_topn_t *tn, char **record);
+
+#endif
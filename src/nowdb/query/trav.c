@@ -0,0 +1,557 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Path traversal: breadth-first search over one edge type
+ * ========================================================================
+ */
+#include <nowdb/query/trav.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+static char *OBJECT = "trav";
+
+#define INVALID(s) \
+	return nowdb_err_get(nowdb_err_invalid, FALSE, OBJECT, s);
+
+#define NOMEM(s) \
+	err = nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT, s);
+
+/* ------------------------------------------------------------------------
+ * Initial capacity of a level
+ * ------------------------------------------------------------------------
+ */
+#define INITCAP 64
+
+/* ------------------------------------------------------------------------
+ * Allocate and initialise
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_trav_new(nowdb_trav_t  **trv,
+                           char            dir,
+                           uint32_t       hops,
+                           nowdb_time_t   from,
+                           nowdb_time_t     to,
+                           uint64_t     budget) {
+	nowdb_err_t err;
+
+	if (trv == NULL) INVALID("traversal pointer is NULL");
+	if (dir != NOWDB_TRAV_OUT && dir != NOWDB_TRAV_IN) {
+		INVALID("unknown direction");
+	}
+
+	*trv = calloc(1, sizeof(nowdb_trav_t));
+	if (*trv == NULL) {
+		NOMEM("allocating traversal");
+		return err;
+	}
+
+	ts_algo_list_init(&(*trv)->files);
+	ts_algo_list_init(&(*trv)->pending);
+
+	(*trv)->near = dir == NOWDB_TRAV_OUT ? NOWDB_OFF_ORIGIN:
+	                                        NOWDB_OFF_DESTIN;
+	(*trv)->far  = dir == NOWDB_TRAV_OUT ? NOWDB_OFF_DESTIN:
+	                                        NOWDB_OFF_ORIGIN;
+	(*trv)->hops = hops;
+	(*trv)->from = from;
+	(*trv)->to   = to;
+
+	err = nowdb_hset_init(&(*trv)->visited, budget);
+	if (err != NOWDB_OK) {
+		free(*trv); *trv = NULL;
+		return err;
+	}
+
+	(*trv)->sel = calloc(1, sizeof(nowdb_sel_t));
+	if ((*trv)->sel == NULL) {
+		NOMEM("allocating selection");
+		nowdb_trav_destroy(*trv); free(*trv); *trv = NULL;
+		return err;
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Destroy
+ * ------------------------------------------------------------------------
+ */
+void nowdb_trav_destroy(nowdb_trav_t *trv) {
+	if (trv == NULL) return;
+	ts_algo_list_destroy(&trv->pending);
+	if (trv->store != NULL) {
+		nowdb_store_releaseFiles(trv->store, &trv->files);
+		trv->store = NULL;
+	}
+	nowdb_hset_destroy(&trv->visited);
+	if (trv->sel != NULL) {
+		free(trv->sel); trv->sel = NULL;
+	}
+	if (trv->frontier != NULL) {
+		free(trv->frontier); trv->frontier = NULL;
+	}
+	if (trv->next != NULL) {
+		free(trv->next); trv->next = NULL;
+	}
+	if (trv->reached != NULL) {
+		free(trv->reached); trv->reached = NULL;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: get files that are not yet in the index
+ *         (all files, if there is no index)
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t getPending(ts_algo_list_t *files,
+                                     ts_algo_list_t *pending,
+                                     char                all) {
+	ts_algo_list_node_t *runner;
+	nowdb_file_t *file;
+
+	for(runner=files->head;runner!=NULL;runner=runner->nxt) {
+		file = runner->cont;
+		if (all || !(file->ctrl & NOWDB_FILE_SORT)) {
+			if (ts_algo_list_append(pending, file) != TS_ALGO_OK)
+			{
+				return nowdb_err_get(nowdb_err_no_mem,
+				        FALSE, OBJECT, "list.append");
+			}
+		}
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Open
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_trav_open(nowdb_trav_t  *trv,
+                            nowdb_scope_t *scope,
+                            char           *edge) {
+	nowdb_err_t err;
+	nowdb_context_t *ctx;
+	uint16_t off[1];
+	nowdb_index_keys_t k = {1, (uint16_t*)&off};
+
+	if (trv == NULL) INVALID("traversal is NULL");
+	if (scope == NULL) INVALID("scope is NULL");
+	if (edge == NULL) INVALID("edge is NULL");
+	if (trv->store != NULL) INVALID("traversal is already open");
+
+	err = nowdb_scope_getContext(scope, edge, &ctx);
+	if (err != NOWDB_OK) return err;
+
+	if (ctx->store.cont != NOWDB_CONT_EDGE) {
+		INVALID("not an edge");
+	}
+
+	/* without index, we fall back to scanning */
+	off[0] = (uint16_t)trv->near;
+	err = nowdb_scope_getIndex(scope, edge, &k, &trv->idx);
+	if (err != NOWDB_OK) {
+		if (!nowdb_err_contains(err, nowdb_err_key_not_found) &&
+		    !nowdb_err_contains(err, nowdb_err_nosuch_index)) {
+			return err;
+		}
+		nowdb_err_release(err);
+		trv->idx = NULL;
+	}
+
+	err = nowdb_store_getFiles(&ctx->store, &trv->files,
+	                                trv->from, trv->to);
+	if (err != NOWDB_OK) return err;
+	trv->store = &ctx->store;
+
+	return getPending(&trv->files, &trv->pending, trv->idx == NULL);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: compare keys
+ * ------------------------------------------------------------------------
+ */
+static int keycompare(const void *one, const void *two) {
+	if (*(nowdb_key_t*)one < *(nowdb_key_t*)two) return -1;
+	if (*(nowdb_key_t*)one > *(nowdb_key_t*)two) return  1;
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: sort and remove duplicates
+ * ------------------------------------------------------------------------
+ */
+static uint64_t sortUnique(nowdb_key_t *keys, uint64_t n) {
+	uint64_t k=0;
+
+	if (n < 2) return n;
+
+	qsort(keys, n, sizeof(nowdb_key_t), &keycompare);
+	for(uint64_t i=1; i<n; i++) {
+		if (keys[i] != keys[k]) keys[++k] = keys[i];
+	}
+	return k+1;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: is the key in the sorted array?
+ * ------------------------------------------------------------------------
+ */
+static inline char inKeys(nowdb_key_t *keys, uint64_t n, nowdb_key_t k) {
+	uint64_t lo=0, hi=n, m;
+
+	while(lo < hi) {
+		m = lo + (hi-lo)/2;
+		if (keys[m] == k) return 1;
+		if (keys[m] < k) lo = m+1; else hi = m;
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: is the key in the frontier?
+ * ------------------------------------------------------------------------
+ */
+static inline char inFrontier(nowdb_trav_t *trv, nowdb_key_t k) {
+	return inKeys(trv->frontier, trv->fsize, k);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: vertices reached are not visited again
+ *         (as long as the visited set is not full)
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t visit(nowdb_trav_t *trv, nowdb_key_t k) {
+	if (trv->visited.spill) return NOWDB_OK;
+	return nowdb_hset_add(&trv->visited, k);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: add one vertex to next
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t addNext(nowdb_trav_t *trv, nowdb_key_t k) {
+	nowdb_err_t err;
+	nowdb_key_t *tmp;
+
+	if (trv->nsize >= trv->ncap) {
+		uint64_t cap = trv->ncap == 0 ? INITCAP : 2*trv->ncap;
+
+		tmp = realloc(trv->next, cap*sizeof(nowdb_key_t));
+		if (tmp == NULL) {
+			NOMEM("allocating level");
+			return err;
+		}
+		trv->next = tmp;
+		trv->ncap = cap;
+	}
+	trv->next[trv->nsize] = k;
+	trv->nsize++;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Start
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_trav_start(nowdb_trav_t *trv,
+                             nowdb_key_t  *vids,
+                             uint64_t        n) {
+	nowdb_err_t err;
+
+	if (trv == NULL) INVALID("traversal is NULL");
+	if (vids == NULL && n > 0) INVALID("no start vertices");
+
+	nowdb_hset_reset(&trv->visited);
+	trv->nsize = 0;
+	trv->fsize = 0;
+	trv->hop = 0;
+
+	for(uint64_t i=0; i<n; i++) {
+		err = addNext(trv, vids[i]);
+		if (err != NOWDB_OK) return err;
+	}
+	return nowdb_trav_advance(trv);
+}
+
+/* ------------------------------------------------------------------------
+ * Collect
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_trav_collect(nowdb_trav_t    *trv,
+                               char            *page,
+                               uint32_t        recsz,
+                               nowdb_bitmap8_t *cont) {
+	nowdb_err_t err;
+	nowdb_time_t stamp;
+	nowdb_key_t k;
+	char *rec;
+
+	if (trv == NULL) INVALID("traversal is NULL");
+	if (page == NULL) INVALID("page is NULL");
+	if (recsz < NOWDB_OFF_STAMP+8) INVALID("not an edge");
+
+	nowdb_sel_fromPage(trv->sel, page, NOWDB_IDX_PAGE, recsz, cont);
+
+	for(uint32_t i=0; i<trv->sel->count; i++) {
+		rec = page+trv->sel->pos[i]*recsz;
+
+		memcpy(&stamp, rec+NOWDB_OFF_STAMP, 8);
+		if (stamp < trv->from || stamp > trv->to) continue;
+
+		memcpy(&k, rec+trv->near, 8);
+		if (!inFrontier(trv, k)) continue;
+
+		memcpy(&k, rec+trv->far, 8);
+		if (nowdb_hset_contains(&trv->visited, k)) continue;
+
+		err = addNext(trv, k);
+		if (err != NOWDB_OK) return err;
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Advance
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_trav_advance(nowdb_trav_t *trv) {
+	nowdb_err_t err;
+	nowdb_key_t *tmp;
+	uint64_t cap;
+
+	if (trv == NULL) INVALID("traversal is NULL");
+
+	trv->nsize = sortUnique(trv->next, trv->nsize);
+	for(uint64_t i=0; i<trv->nsize; i++) {
+		err = visit(trv, trv->next[i]);
+		if (err != NOWDB_OK) return err;
+	}
+
+	/* next becomes the frontier,
+	 * the old frontier is reused for next */
+	tmp = trv->frontier; cap = trv->fcap;
+
+	trv->frontier = trv->next;
+	trv->fsize = trv->nsize;
+	trv->fcap = trv->ncap;
+
+	trv->next = tmp;
+	trv->ncap = cap;
+	trv->nsize = 0;
+
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: collect from all pages of the reader
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t collectAll(nowdb_trav_t *trv, nowdb_reader_t *rdr) {
+	nowdb_err_t err;
+
+	for(;;) {
+		err = nowdb_reader_move(rdr);
+		if (err != NOWDB_OK) break;
+
+		err = nowdb_trav_collect(trv, nowdb_reader_page(rdr),
+		                                rdr->recsize, rdr->cont);
+		if (err != NOWDB_OK) break;
+	}
+	if (err->errcode == nowdb_err_eof) {
+		nowdb_err_release(err); err = NOWDB_OK;
+	}
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: tree callbacks for the frontier as key map;
+ *         the tree does not own the keys
+ * ------------------------------------------------------------------------
+ */
+static ts_algo_cmp_t mapcompare(void *ignore, void *one, void *two) {
+	if (*(nowdb_key_t*)one <
+	    *(nowdb_key_t*)two) return ts_algo_cmp_less;
+	if (*(nowdb_key_t*)one >
+	    *(nowdb_key_t*)two) return ts_algo_cmp_greater;
+	return ts_algo_cmp_equal;
+}
+
+static ts_algo_rc_t mapupdate(void *ignore, void *o, void *n) {
+	return TS_ALGO_OK;
+}
+
+static void nodestroy(void *ignore, void **n) {}
+
+/* ------------------------------------------------------------------------
+ * Helper: probe all keys of the frontier in one index pass
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t probeIndex(nowdb_trav_t *trv) {
+	nowdb_err_t err=NOWDB_OK;
+	nowdb_reader_t *rdr=NULL;
+	ts_algo_tree_t **maps;
+	ts_algo_tree_t *map;
+
+	if (trv->idx == NULL || trv->fsize == 0) return NOWDB_OK;
+	if (trv->files.len == trv->pending.len) return NOWDB_OK;
+
+	map = ts_algo_tree_new(&mapcompare, NULL, &mapupdate,
+	                                &nodestroy, &nodestroy);
+	if (map == NULL) {
+		NOMEM("tree.new");
+		return err;
+	}
+	for(uint64_t i=0; i<trv->fsize; i++) {
+		if (ts_algo_tree_insert(map, trv->frontier+i) != TS_ALGO_OK) {
+			NOMEM("tree.insert");
+			ts_algo_tree_destroy(map); free(map);
+			return err;
+		}
+	}
+
+	/* the reader owns the array, but not the map */
+	maps = calloc(1, sizeof(ts_algo_tree_t*));
+	if (maps == NULL) {
+		NOMEM("allocating maps");
+		ts_algo_tree_destroy(map); free(map);
+		return err;
+	}
+	maps[0] = map;
+
+	/* the frontier is sorted: its first and last key are the range */
+	err = nowdb_reader_mrange(&rdr, &trv->files, trv->idx, NULL, maps,
+	                         trv->frontier, trv->frontier+trv->fsize-1);
+	if (err != NOWDB_OK) {
+		free(maps);
+		ts_algo_tree_destroy(map); free(map);
+		if (err->errcode == nowdb_err_eof) {
+			nowdb_err_release(err); return NOWDB_OK;
+		}
+		return err;
+	}
+
+	err = collectAll(trv, rdr);
+
+	nowdb_reader_destroy(rdr); free(rdr);
+	ts_algo_tree_destroy(map); free(map);
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: scan the edges not yet in the index
+ *         (all edges, if there is no index)
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t scanPending(nowdb_trav_t *trv) {
+	nowdb_err_t err;
+	nowdb_reader_t *rdr;
+
+	if (trv->pending.len == 0 || trv->fsize == 0) return NOWDB_OK;
+
+	err = nowdb_reader_fullscan(&rdr, &trv->pending, NULL);
+	if (err != NOWDB_OK) return err;
+
+	nowdb_reader_setPeriod(rdr, trv->from, trv->to);
+
+	err = collectAll(trv, rdr);
+
+	nowdb_reader_destroy(rdr); free(rdr);
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Step
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_trav_step(nowdb_trav_t *trv) {
+	nowdb_err_t err;
+
+	if (trv == NULL) INVALID("traversal is NULL");
+	if (trv->store == NULL) INVALID("traversal is not open");
+
+	if (trv->hop >= trv->hops || trv->fsize == 0) {
+		return nowdb_err_get(nowdb_err_eof, FALSE, OBJECT, NULL);
+	}
+
+	trv->nsize = 0;
+
+	err = probeIndex(trv);
+	if (err != NOWDB_OK) return err;
+
+	err = scanPending(trv);
+	if (err != NOWDB_OK) return err;
+
+	err = nowdb_trav_advance(trv);
+	if (err != NOWDB_OK) return err;
+
+	trv->hop++;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: the frontier is followed, remember it
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t addReached(nowdb_trav_t *trv) {
+	nowdb_err_t err;
+	nowdb_key_t *tmp;
+
+	if (trv->rsize + trv->fsize > trv->rcap) {
+		uint64_t cap = trv->rcap == 0 ? INITCAP : trv->rcap;
+
+		while(cap < trv->rsize + trv->fsize) cap *= 2;
+
+		tmp = realloc(trv->reached, cap*sizeof(nowdb_key_t));
+		if (tmp == NULL) {
+			NOMEM("allocating reached vertices");
+			return err;
+		}
+		trv->reached = tmp;
+		trv->rcap = cap;
+	}
+	memcpy(trv->reached+trv->rsize, trv->frontier,
+	                 trv->fsize*sizeof(nowdb_key_t));
+	trv->rsize += trv->fsize;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Run
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_trav_run(nowdb_trav_t *trv) {
+	nowdb_err_t err;
+
+	if (trv == NULL) INVALID("traversal is NULL");
+
+	trv->rsize = 0;
+	for(;;) {
+		/* the last level is not followed */
+		if (trv->hop < trv->hops) {
+			err = addReached(trv);
+			if (err != NOWDB_OK) return err;
+		}
+		err = nowdb_trav_step(trv);
+		if (err != NOWDB_OK) {
+			if (!nowdb_err_contains(err, nowdb_err_eof)) return err;
+			nowdb_err_release(err); break;
+		}
+	}
+	trv->rsize = sortUnique(trv->reached, trv->rsize);
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Followed
+ * ------------------------------------------------------------------------
+ */
+char nowdb_trav_followed(nowdb_trav_t *trv, char *edge) {
+	nowdb_time_t stamp;
+	nowdb_key_t k;
+
+	memcpy(&stamp, edge+NOWDB_OFF_STAMP, 8);
+	if (stamp < trv->from || stamp > trv->to) return 0;
+
+	memcpy(&k, edge+trv->near, 8);
+	return inKeys(trv->reached, trv->rsize, k);
+}
@@ -0,0 +1,175 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Path traversal: breadth-first search over one edge type
+ * ========================================================================
+ * Starting from a set of vertices, the traversal follows the edges
+ * of one type (from origin to destination or the other way round)
+ * level by level up to a hop limit. Each level (the frontier)
+ * is sorted and free of duplicates, so all its keys are probed
+ * in one pass over the index on the near end of the edge
+ * (a map range scan, the frontier being the map).
+ * Edges not yet in the index (the pending files) are scanned;
+ * without index on the near end, all edges are scanned.
+ * Only edges within the period are followed.
+ *
+ * Vertices reached are remembered in a hash set, so each vertex
+ * is delivered only once. The set is bounded by a memory budget;
+ * once it is full, vertices reached from then on may be delivered
+ * again on a later level. The hop limit bounds the traversal anyway.
+ *
+ * In SQL, the traversal is part of the from clause:
+ *     select ... from edge traverse 3 from origin in (1, 2)
+ * It runs when the cursor is created; the cursor then
+ * delivers the edges followed, i.e. the edges whose near end
+ * was reached in less than 'hops' hops (see 'run' and 'followed').
+ * ========================================================================
+ */
+#ifndef nowdb_trav_decl
+#define nowdb_trav_decl
+
+#include <nowdb/types/types.h>
+#include <nowdb/types/error.h>
+#include <nowdb/types/time.h>
+#include <nowdb/scope/scope.h>
+#include <nowdb/reader/reader.h>
+#include <nowdb/index/index.h>
+#include <nowdb/fun/vexpr.h>
+#include <nowdb/fun/hset.h>
+
+#include <tsalgo/list.h>
+
+/* ------------------------------------------------------------------------
+ * Directions
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_TRAV_OUT 0 /* from origin to destination */
+#define NOWDB_TRAV_IN  1 /* from destination to origin */
+
+/* ------------------------------------------------------------------------
+ * Path traversal
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	nowdb_store_t       *store; /* edge store                      */
+	nowdb_index_t         *idx; /* index on the near end           */
+	ts_algo_list_t       files; /* edge files in the period        */
+	ts_algo_list_t     pending; /* files to scan (not in index)    */
+	nowdb_hset_t       visited; /* vertices reached so far         */
+	nowdb_sel_t           *sel; /* selected edges in page          */
+	nowdb_key_t      *frontier; /* current level (sorted, unique)  */
+	nowdb_key_t          *next; /* next level (being collected)    */
+	uint64_t             fsize; /* vertices in the frontier        */
+	uint64_t              fcap; /* capacity of the frontier        */
+	uint64_t             nsize; /* vertices in next                */
+	uint64_t              ncap; /* capacity of next                */
+	nowdb_key_t       *reached; /* vertices followed (after run)   */
+	uint64_t             rsize; /* vertices in reached             */
+	uint64_t              rcap; /* capacity of reached             */
+	nowdb_time_t          from; /* period: start                   */
+	nowdb_time_t            to; /* period: end                     */
+	uint32_t              near; /* offset of the key we probe      */
+	uint32_t               far; /* offset of the key we follow     */
+	uint32_t              hops; /* hop limit                       */
+	uint32_t               hop; /* current level                   */
+} nowdb_trav_t;
+
+/* ------------------------------------------------------------------------
+ * Allocate and initialise a new traversal
+ * ---------------------------------------
+ * - dir    : NOWDB_TRAV_OUT or NOWDB_TRAV_IN
+ * - hops   : hop limit
+ * - from/to: period of the edges followed
+ * - budget : memory budget for the visited set
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_trav_new(nowdb_trav_t  **trv,
+                           char            dir,
+                           uint32_t       hops,
+                           nowdb_time_t   from,
+                           nowdb_time_t     to,
+                           uint64_t     budget);
+
+/* ------------------------------------------------------------------------
+ * Destroy traversal
+ * ------------------------------------------------------------------------
+ */
+void nowdb_trav_destroy(nowdb_trav_t *trv);
+
+/* ------------------------------------------------------------------------
+ * Open
+ * ----
+ * Obtains the files and the index of the edge type 'edge'.
+ * If there is no index on the near end, all files are scanned.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_trav_open(nowdb_trav_t  *trv,
+                            nowdb_scope_t *scope,
+                            char           *edge);
+
+/* ------------------------------------------------------------------------
+ * Start
+ * -----
+ * Sets the start vertices as level 0.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_trav_start(nowdb_trav_t *trv,
+                             nowdb_key_t  *vids,
+                             uint64_t        n);
+
+/* ------------------------------------------------------------------------
+ * Step
+ * ----
+ * Computes the next level, i.e. all vertices
+ * reached from the frontier and not seen before.
+ * The new level is found in trv->frontier.
+ * Returns eof when the hop limit is reached
+ * or when there is nothing left to traverse.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_trav_step(nowdb_trav_t *trv);
+
+/* ------------------------------------------------------------------------
+ * Collect
+ * -------
+ * Collects the far ends of the edges in the page
+ * (selected by 'cont', if not NULL) whose near end
+ * is in the frontier for the next level.
+ * This is what 'step' does with each page it reads.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_trav_collect(nowdb_trav_t    *trv,
+                               char            *page,
+                               uint32_t        recsz,
+                               nowdb_bitmap8_t *cont);
+
+/* ------------------------------------------------------------------------
+ * Advance
+ * -------
+ * Makes the collected vertices the new frontier.
+ * This is what 'step' does after all pages have been read.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_trav_advance(nowdb_trav_t *trv);
+
+/* ------------------------------------------------------------------------
+ * Run
+ * ---
+ * Steps from the start vertices up to the hop limit
+ * and remembers all vertices whose edges were followed,
+ * i.e. all levels but the last one.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_trav_run(nowdb_trav_t *trv);
+
+/* ------------------------------------------------------------------------
+ * Followed
+ * --------
+ * Was this edge followed by 'run'?
+ * This is the case if the edge is within the period
+ * and its near end is one of the vertices reached.
+ * ------------------------------------------------------------------------
+ */
+char nowdb_trav_followed(nowdb_trav_t *trv, char *edge);
+
+#endif
@@ -49,11 +49,14 @@ static inline nowdb_err_t initReader(nowdb_reader_t *reader) {
 	reader->ko  = 0;
 	reader->ownfiles = 0;
 	reader->files = NULL;
+	reader->byid = NULL;
+	reader->nbyid = 0;
 	reader->store = NULL;
 	reader->buf = NULL;
 	reader->tmp = NULL;
 	reader->tmp2 = NULL;
 	reader->page2 = NULL;
+	reader->xs = NULL;
 	reader->plru = NULL;
 	reader->bplru = NULL;
 	reader->page = NULL;
@@ -65,6 +68,10 @@ static inline nowdb_err_t initReader(nowdb_reader_t *reader) {
 	reader->state = NULL;
 	reader->current = NULL;
 	reader->file = NULL;
+	reader->pf = NULL;
+	reader->pfile = NULL;
+	reader->zfilter = NULL;
+	reader->ahead = 0;
 	reader->cont = NULL;
 	reader->ikeys = NULL;
 	reader->maps = NULL;
@@ -109,6 +116,27 @@ static inline nowdb_err_t makeBeetError(beet_err_t ber) {
 	return err;
 }
 
+/* ------------------------------------------------------------------------
+ * Helper: stop read-ahead
+ * ------------------------------------------------------------------------
+ */
+static inline void stopReadahead(nowdb_reader_t *reader) {
+	if (reader->pf != NULL) {
+		nowdb_prefetch_destroy(reader->pf);
+		free(reader->pf); reader->pf = NULL;
+	}
+	if (reader->pfile != NULL) {
+		if (reader->closeit) {
+			NOWDB_IGNORE(nowdb_file_close(reader->pfile));
+		}
+		reader->pfile = NULL;
+	}
+	if (reader->zfilter != NULL) {
+		nowdb_expr_destroy(reader->zfilter);
+		free(reader->zfilter); reader->zfilter = NULL;
+	}
+}
+
 /* ------------------------------------------------------------------------
  * Helper: rewind fullscan reader
  * ------------------------------------------------------------------------
@@ -116,6 +144,8 @@ static inline nowdb_err_t makeBeetError(beet_err_t ber) {
 nowdb_err_t rewindFullscan(nowdb_reader_t *reader) {
 	nowdb_err_t err;
 
+	stopReadahead(reader);
+
 	reader->current = reader->files->head;
 	if (reader->current == NULL) return nowdb_err_get(nowdb_err_eof,
 	                                     FALSE, OBJECT, "no files");
@@ -199,6 +229,9 @@ static inline nowdb_err_t rewindBuffer(nowdb_reader_t *reader) {
 	if (reader->page2 != NULL) {
 		memset(reader->page2, 0, NOWDB_IDX_PAGE);
 	}
+	if (reader->xs != NULL) {
+		return nowdb_xsort_rewind(reader->xs);
+	}
 	return NOWDB_OK;
 }
 
@@ -266,6 +299,9 @@ static inline nowdb_err_t rewindMerge(nowdb_reader_t *reader) {
 void nowdb_reader_destroy(nowdb_reader_t *reader) {
 	if (reader == NULL) return;
 
+	/* background tasks may still use the files */
+	stopReadahead(reader);
+
 	if (reader->bplru != NULL) {
 		nowdb_pplru_destroy(reader->bplru);
 		free(reader->bplru);
@@ -275,6 +311,9 @@ void nowdb_reader_destroy(nowdb_reader_t *reader) {
 		NOWDB_IGNORE(nowdb_file_close(reader->file));
 		reader->file = NULL;
 	}
+	if (reader->byid != NULL) {
+		free(reader->byid); reader->byid = NULL;
+	}
 	if (reader->files != NULL && reader->ownfiles) {
 		for(ts_algo_list_node_t *run=
 		          reader->files->head;
@@ -344,6 +383,10 @@ void nowdb_reader_destroy(nowdb_reader_t *reader) {
 		if (reader->page2 != NULL) {
 			free(reader->page2); reader->page2 = NULL;
 		}
+		if (reader->xs != NULL) {
+			nowdb_xsort_destroy(reader->xs);
+			free(reader->xs); reader->xs = NULL;
+		}
 		return;
 
 	case NOWDB_READER_SEQ:
@@ -368,50 +411,141 @@ void nowdb_reader_destroy(nowdb_reader_t *reader) {
 	}
 }
 
+/* ------------------------------------------------------------------------
+ * Helper: check filter against zone maps
+ * ------------------------------------------------------------------------
+ */
+static char zonecheck(void *filter, nowdb_zone_t *zones, uint32_t n) {
+	return nowdb_expr_zone(filter, zones, n);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: move file to next relevant block
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t movefile(nowdb_reader_t *reader) {
+	return nowdb_file_moveZone(reader->current->cont,
+	                           reader->from, reader->to,
+	                           reader->filter==NULL?NULL:&zonecheck,
+	                           reader->filter);
+}
+
 /* ------------------------------------------------------------------------
  * Helper: switch page
+ * Files with no relevant block are passed over.
  * ------------------------------------------------------------------------
  */
 static inline nowdb_err_t nextpage(nowdb_reader_t *reader) {
 	nowdb_err_t err;
 
-	err = nowdb_file_movePeriod(reader->current->cont,
-                                 reader->from, reader->to);
-	if (err == NOWDB_OK) {
-		reader->page = ((nowdb_file_t*)reader->current->cont)->bptr;
-		return NOWDB_OK;
+	for(;;) {
+		err = movefile(reader);
+		if (err == NOWDB_OK) {
+			reader->page =
+			((nowdb_file_t*)reader->current->cont)->bptr;
+			return NOWDB_OK;
+		}
+
+		if (err->errcode != nowdb_err_eof) return err;
+		nowdb_err_release(err);
+
+		if (reader->closeit) {
+			err = nowdb_file_close(reader->current->cont);
+			if (err != NOWDB_OK) return err;
+		}
+
+		reader->current = reader->current->nxt;
+		if (reader->current == NULL) return nowdb_err_get(
+		                   nowdb_err_eof, FALSE, OBJECT, NULL);
+	
+		if (((nowdb_file_t*)reader->current->cont)->state ==
+		      nowdb_file_state_closed) {
+			err = nowdb_file_open(reader->current->cont);
+			if (err != NOWDB_OK) return err;
+			reader->closeit = TRUE;
+		} else {
+			reader->closeit = FALSE;
+		}
+
+		err = nowdb_file_rewind(reader->current->cont);
+		if (err != NOWDB_OK) return err;
 	}
+}
 
-	if (err->errcode != nowdb_err_eof) return err;
-	nowdb_err_release(err);
+/* ------------------------------------------------------------------------
+ * Helper: start read-ahead
+ * The first file has already been opened by rewind;
+ * from now on, the prefetcher is in charge of the files.
+ * The prefetcher checks zone maps in background and,
+ * therefore, gets its own copy of the filter.
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t startReadahead(nowdb_reader_t *reader) {
+	nowdb_err_t err;
 
+	if (!nowdb_prefetch_useful(reader->files)) {
+		reader->ahead = 0; return NOWDB_OK;
+	}
 	if (reader->closeit) {
 		err = nowdb_file_close(reader->current->cont);
 		if (err != NOWDB_OK) return err;
+		reader->closeit = FALSE;
 	}
-
-	reader->current = reader->current->nxt;
-	if (reader->current == NULL) return nowdb_err_get(nowdb_err_eof,
-	                                           FALSE, OBJECT, NULL);
-	
-	if (((nowdb_file_t*)reader->current->cont)->state ==
-	      nowdb_file_state_closed) {
-		err = nowdb_file_open(reader->current->cont);
+	if (reader->filter != NULL) {
+		err = nowdb_expr_copy(reader->filter, &reader->zfilter);
 		if (err != NOWDB_OK) return err;
-		reader->closeit = TRUE;
-	} else {
-		reader->closeit = FALSE;
 	}
+	return nowdb_prefetch_new(&reader->pf, reader->files,
+	                          reader->ahead,
+	                          reader->from, reader->to,
+	                          reader->zfilter==NULL?NULL:&zonecheck,
+	                          reader->zfilter);
+}
 
-	err = nowdb_file_rewind(reader->current->cont);
-	if (err != NOWDB_OK) return err;
+/* ------------------------------------------------------------------------
+ * Helper: switch page with read-ahead
+ * Uncompressed files are passed on to us by the prefetcher
+ * and are read here.
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t aheadpage(nowdb_reader_t *reader) {
+	nowdb_err_t err;
+	nowdb_file_t *file;
 
-	err = nowdb_file_movePeriod(reader->current->cont,
-	                         reader->from, reader->to);
-	if (err != NOWDB_OK) return err;
+	for(;;) {
+		if (reader->pfile != NULL) {
+			err = nowdb_file_movePeriod(reader->pfile,
+			                            reader->from,
+			                            reader->to);
+			if (err == NOWDB_OK) {
+				reader->page = reader->pfile->bptr;
+				return NOWDB_OK;
+			}
+			if (err->errcode != nowdb_err_eof) return err;
+			nowdb_err_release(err);
 
-	reader->page = ((nowdb_file_t*)reader->current->cont)->bptr;
-	return NOWDB_OK;
+			if (reader->closeit) {
+				err = nowdb_file_close(reader->pfile);
+				if (err != NOWDB_OK) return err;
+			}
+			reader->pfile = NULL;
+		}
+		err = nowdb_prefetch_next(reader->pf, &reader->page, &file);
+		if (err != NOWDB_OK) return err;
+		if (reader->page != NULL) return NOWDB_OK;
+
+		if (file->state == nowdb_file_state_closed) {
+			err = nowdb_file_open(file);
+			if (err != NOWDB_OK) return err;
+			reader->closeit = TRUE;
+		} else {
+			reader->closeit = FALSE;
+		}
+		reader->pfile = file;
+
+		err = nowdb_file_rewind(file);
+		if (err != NOWDB_OK) return err;
+	}
 }
 
 /* ------------------------------------------------------------------------
@@ -428,17 +562,52 @@ static inline void getFilePos(nowdb_pageid_t  pge,
 }
 
 /* ------------------------------------------------------------------------
- * Helper: find file in list (not optimal)
+ * Helper: compare files by id
+ * ------------------------------------------------------------------------
+ */
+static int byId(const void *left, const void *right) {
+	nowdb_fileid_t l = (*(nowdb_file_t**)left)->id;
+	nowdb_fileid_t r = (*(nowdb_file_t**)right)->id;
+
+	if (l < r) return -1;
+	if (l > r) return  1;
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: sort files by id for findfile
  * ------------------------------------------------------------------------
  */
-static inline nowdb_file_t *findfile(ts_algo_list_t *list,
-                                     nowdb_fileid_t   fid) {
+static nowdb_err_t sortFiles(nowdb_reader_t *reader) {
+	nowdb_err_t err;
 	ts_algo_list_node_t *runner;
-	nowdb_file_t        *file;
+	uint32_t k=0;
 
-	for(runner=list->head;runner!=NULL;runner=runner->nxt) {
-		file = runner->cont;
-		if (file->id == fid) return file;
+	reader->byid = calloc(reader->files->len, sizeof(nowdb_file_t*));
+	if (reader->byid == NULL) {
+		NOMEM("allocating file array");
+		return err;
+	}
+	for(runner=reader->files->head;runner!=NULL;runner=runner->nxt) {
+		reader->byid[k++] = runner->cont;
+	}
+	qsort(reader->byid, k, sizeof(nowdb_file_t*), &byId);
+	reader->nbyid = k;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: find file by id (binary search)
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_file_t *findfile(nowdb_reader_t *reader,
+                                     nowdb_fileid_t     fid) {
+	uint32_t lo=0, hi=reader->nbyid, m;
+
+	while(lo < hi) {
+		m = lo+(hi-lo)/2;
+		if (reader->byid[m]->id == fid) return reader->byid[m];
+		if (reader->byid[m]->id < fid) lo = m+1; else hi = m;
 	}
 	return NULL;
 }
@@ -469,7 +638,7 @@ static inline nowdb_err_t getpage(nowdb_reader_t *reader, nowdb_pageid_t pge) {
 		}
 	}
 	if (reader->file == NULL) {
-		reader->file = findfile(reader->files, fid);
+		reader->file = findfile(reader, fid);
 		if (reader->file == NULL) {
 			/* this is not an error:
 			 * file is already in the index
@@ -522,8 +691,18 @@ static inline nowdb_err_t moveFullscan(nowdb_reader_t *reader) {
 		return nowdb_err_get(nowdb_err_eof,
 	                      FALSE, OBJECT, NULL);
 	}
+	/* start read-ahead on first move */
+	if (reader->ahead > 0 && reader->pf == NULL &&
+	    reader->page  == NULL) {
+		err = startReadahead(reader);
+		if (err != NOWDB_OK) return err;
+	}
 	/* test getpage for fullscan ! */
-	err = nextpage(reader);
+	if (reader->pf != NULL) {
+		err = aheadpage(reader);
+	} else {
+		err = nextpage(reader);
+	}
 	if (err != NOWDB_OK) {
 		if (err->errcode == nowdb_err_eof) reader->eof = 1;
 	}
@@ -707,6 +886,69 @@ static inline nowdb_err_t moveBuf(nowdb_reader_t *reader) {
 	return NOWDB_OK;
 }
 
+/* ------------------------------------------------------------------------
+ * Helper: move for bufidx with external sort;
+ * the records are delivered by the merge of the sorted runs
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t moveXIdx(nowdb_reader_t *reader) {
+	nowdb_err_t err;
+	nowdb_comprsc_t cmp;
+	uint32_t i;
+	char *rec;
+
+	uint32_t bufsz = (NOWDB_IDX_PAGE/reader->recsize)
+	                                *reader->recsize;
+
+	if (reader->eof) {
+		return nowdb_err_get(nowdb_err_eof, FALSE, OBJECT, NULL);
+	}
+	cmp = reader->content == NOWDB_CONT_EDGE ?
+	                &nowdb_sort_edge_keys_compare :
+	                &nowdb_sort_vertex_keys_compare;
+	for(;;) {
+		rec = nowdb_xsort_top(reader->xs);
+		if (rec == NULL) {
+			reader->eof = 1;
+			return nowdb_err_get(nowdb_err_eof,
+			               FALSE, OBJECT, NULL);
+		}
+		nowdb_index_grabKeys(reader->ikeys, rec, reader->tmp);
+		reader->key = reader->tmp;
+		if (reader->maps != NULL) {
+			if (!hasKey(reader)) {
+				err = nowdb_xsort_pop(reader->xs);
+				if (err != NOWDB_OK) return err;
+				continue;
+			}
+		}
+		break;
+	}
+	memset(reader->page2, 0, NOWDB_IDX_PAGE);
+	memcpy(reader->page2, rec, reader->recsize);
+	i = reader->recsize;
+
+	err = nowdb_xsort_pop(reader->xs);
+	if (err != NOWDB_OK) return err;
+
+	/* collect the records with the same key
+	 * (keys only: skip them) */
+	for(;;) {
+		rec = nowdb_xsort_top(reader->xs);
+		if (rec == NULL) break;
+		if (cmp(reader->page2, rec, reader->ikeys) !=
+		                          NOWDB_SORT_EQUAL) break;
+		if (reader->type == NOWDB_READER_BUFIDX) {
+			if (i >= bufsz) break;
+			memcpy(reader->page2+i, rec, reader->recsize);
+			i+=reader->recsize;
+		}
+		err = nowdb_xsort_pop(reader->xs);
+		if (err != NOWDB_OK) return err;
+	}
+	return NOWDB_OK;
+}
+
 /* ------------------------------------------------------------------------
  * Helper: move for bufidx
  * ------------------------------------------------------------------------
@@ -719,6 +961,8 @@ static inline nowdb_err_t moveBufIdx(nowdb_reader_t *reader) {
 	                                *reader->recsize;
 	uint32_t remsz = NOWDB_IDX_PAGE - bufsz;
 
+	if (reader->xs != NULL) return moveXIdx(reader);
+
 	if (reader->eof) {
 		return nowdb_err_get(nowdb_err_eof, FALSE, OBJECT, NULL);
 	}
@@ -1091,6 +1335,20 @@ void nowdb_reader_setPeriod(nowdb_reader_t *reader,
                             nowdb_time_t       end) {
 	reader->from = start;
 	reader->to   = end;
+	if (reader->pf != NULL) {
+		nowdb_prefetch_setPeriod(reader->pf, start, end);
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Set Read-ahead
+ * ------------------------------------------------------------------------
+ */
+void nowdb_reader_setReadahead(nowdb_reader_t *reader,
+                               uint32_t         depth) {
+	if (reader->type != NOWDB_READER_FULLSCAN) return;
+	if (reader->pf != NULL) return;
+	reader->ahead = depth;
 }
 
 /* ------------------------------------------------------------------------
@@ -1155,6 +1413,12 @@ nowdb_err_t nowdb_reader_search(nowdb_reader_t **reader,
 	(*reader)->content = ((nowdb_file_t*)files->head->cont)->cont;
 	(*reader)->files = files;
 
+	err = sortFiles(*reader);
+	if (err != NOWDB_OK) {
+		nowdb_reader_destroy(*reader); free(*reader);
+		return err;
+	}
+
 	ber = beet_iter_alloc(index->idx, &(*reader)->iter);
 	if (ber != BEET_OK) {
 		nowdb_reader_destroy(*reader); free(*reader);
@@ -1186,6 +1450,46 @@ nowdb_err_t nowdb_reader_search(nowdb_reader_t **reader,
 	return NOWDB_OK;
 }
 
+/* ------------------------------------------------------------------------
+ * Search again with another key
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_reader_research(nowdb_reader_t *reader,
+                                  nowdb_index_t  *index,
+                                  char             *key) {
+	nowdb_err_t err;
+	beet_err_t  ber;
+
+	if (reader == NULL) return nowdb_err_get(nowdb_err_invalid,
+	                        FALSE, OBJECT, "reader is NULL");
+	if (reader->type != NOWDB_READER_SEARCH) return nowdb_err_get(
+	   nowdb_err_invalid, FALSE, OBJECT, "not a search reader");
+
+	/* the file was opened by getpage */
+	if (reader->file != NULL) {
+		err = nowdb_file_close(reader->file);
+		if (err != NOWDB_OK) return err;
+		reader->file = NULL;
+	}
+
+	err = rewindSearch(reader);
+	if (err != NOWDB_OK) return err;
+
+	beet_state_release(reader->state);
+
+	ber = beet_index_getIter(index->idx, reader->state, key,
+	                                             reader->iter);
+	if (ber == BEET_ERR_KEYNOF) {
+		reader->eof = 1;
+		reader->nodata = 1;
+		return NOWDB_OK;
+
+	} else if (ber != BEET_OK) return makeBeetError(ber);
+
+	reader->nodata = 0;
+	return rewindSearch(reader);
+}
+
 /* ------------------------------------------------------------------------
  * Index Range scan
  * ------------------------------------------------------------------------
@@ -1225,6 +1529,12 @@ static inline nowdb_err_t mkRange(nowdb_reader_t **reader,
 	(*reader)->ko  = rtype == NOWDB_READER_KRANGE;
 	(*reader)->maps = NULL;
 
+	err = sortFiles(*reader);
+	if (err != NOWDB_OK) {
+		nowdb_reader_destroy(*reader); free(*reader);
+		return err;
+	}
+
 	if (rtype == NOWDB_READER_FRANGE || rtype == NOWDB_READER_MRANGE) {
 		(*reader)->plru = calloc(1, sizeof(nowdb_pplru_t));
 		if ((*reader)->plru == NULL) {
@@ -1371,6 +1681,7 @@ nowdb_err_t nowdb_reader_count(nowdb_reader_t **reader,
 	(*reader)->type = NOWDB_READER_COUNT;
 	(*reader)->content = store->cont;
 	(*reader)->recsize = sizeof(uint64_t);
+	(*reader)->ko = 1; /* the page is just the count */
 	(*reader)->store = store;
 
 	err = rewindCount(*reader);
@@ -1397,6 +1708,56 @@ static inline uint64_t countBytes(ts_algo_list_t *files) {
 	return total;
 }
 
+/* ------------------------------------------------------------------------
+ * Helper: selection and vectorised filter for buffer and sort
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t newSelection(nowdb_reader_t *reader,
+                                nowdb_sel_t   **sel,
+                                nowdb_vexpr_t  **vx) {
+	nowdb_err_t err;
+
+	*vx = NULL;
+	*sel = calloc(1, sizeof(nowdb_sel_t));
+	if (*sel == NULL) {
+		NOMEM("allocating selection");
+		return err;
+	}
+	if (reader->filter == NULL) return NOWDB_OK;
+
+	err = nowdb_vexpr_new(vx, reader->filter, reader->eval);
+	if (err != NOWDB_OK) {
+		free(*sel); *sel = NULL;
+		return err;
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: destroy selection and vectorised filter
+ * ------------------------------------------------------------------------
+ */
+static void destroySelection(nowdb_sel_t *sel, nowdb_vexpr_t *vx) {
+	if (sel != NULL) free(sel);
+	if (vx != NULL) {
+		nowdb_vexpr_destroy(vx); free(vx);
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: select the records of a page that pass the filter
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t selectPage(nowdb_reader_t *reader,
+                                     nowdb_vexpr_t      *vx,
+                                     nowdb_sel_t       *sel,
+                                     char              *src,
+                                     uint32_t         bufsz) {
+	nowdb_sel_fromPage(sel, src, bufsz, reader->recsize, NULL);
+	if (vx == NULL) return NOWDB_OK;
+	return nowdb_vexpr_select(vx, src, reader->recsize, sel);
+}
+
 /* ------------------------------------------------------------------------
  * Helper: scan all files
  * ------------------------------------------------------------------------
@@ -1404,18 +1765,25 @@ static inline uint64_t countBytes(ts_algo_list_t *files) {
 static nowdb_err_t fillbuf(nowdb_reader_t *reader) {
 	nowdb_err_t err = NOWDB_OK;
 	nowdb_reader_t *full;
+	nowdb_vexpr_t *vx;
+	nowdb_sel_t *sel;
 	char *src;
 	uint32_t x=0;
-	char more = 1;
 	uint32_t bufsz, remsz;
 
 	bufsz = (NOWDB_IDX_PAGE / reader->recsize) * reader->recsize;
 	remsz = NOWDB_IDX_PAGE - bufsz;
 
-	err = nowdb_reader_fullscan(&full, reader->files, reader->filter);
+	err = newSelection(reader, &sel, &vx);
 	if (err != NOWDB_OK) return err;
 
-	while (more) {
+	err = nowdb_reader_fullscan(&full, reader->files, reader->filter);
+	if (err != NOWDB_OK) {
+		destroySelection(sel, vx);
+		return err;
+	}
+
+	for(;;) {
 		err = nowdb_reader_move(full);
 		if (err != NOWDB_OK) {
 			if (err->errcode == nowdb_err_eof) {
@@ -1425,40 +1793,24 @@ static nowdb_err_t fillbuf(nowdb_reader_t *reader) {
 			break;
 		}
 		src = nowdb_reader_page(full);
-		if (src == NULL) return nowdb_err_get(nowdb_err_panic,
-		                 FALSE, OBJECT, "reader has no page");
-		for(int i=0; i<NOWDB_IDX_PAGE; ) {
-
-			if (i%NOWDB_IDX_PAGE >= bufsz) {
-				i+=remsz; continue;
-			}
+		if (src == NULL) {
+			err = nowdb_err_get(nowdb_err_panic, FALSE, OBJECT,
+			                             "reader has no page");
+			break;
+		}
+		err = selectPage(reader, vx, sel, src, bufsz);
+		if (err != NOWDB_OK) break;
 
-			/* we hit the nullrecord */
-			if (memcmp(src+i, nowdb_nullrec,
-			          reader->recsize) == 0)
-				break;
-
-			/* apply filter */
-			if (reader->filter != NULL) {
-				nowdb_type_t t;
-				void        *v;
-				err = nowdb_expr_eval(reader->filter,
-				                      reader->eval,
-                                                      src+i, &t, &v);
-				if (err != NOWDB_OK) break;
-				if (*(nowdb_value_t*)v == 0) {
-					i+=reader->recsize;
-					continue;
-				}
-			}
-			memcpy(reader->buf+x, src+i, reader->recsize);
-			x+=reader->recsize;i+=reader->recsize;
+		for(uint32_t i=0; i<sel->count; i++) {
+			memcpy(reader->buf+x, src+sel->pos[i]*reader->recsize,
+			                                     reader->recsize);
+			x+=reader->recsize;
 			if (x%NOWDB_IDX_PAGE >= bufsz) x+=remsz;
 		}
-		if (err != NOWDB_OK) break;
 	}
 	// reader->size = x;
 	nowdb_reader_destroy(full); free(full);
+	destroySelection(sel, vx);
 	return err;
 }
 
@@ -1525,6 +1877,83 @@ nowdb_err_t nowdb_reader_buffer(nowdb_reader_t  **reader,
 	return nowdb_reader_rewind(*reader);
 }
 
+/* ------------------------------------------------------------------------
+ * Helper: scan all files and feed the external sort
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t fillsort(nowdb_reader_t *reader) {
+	nowdb_err_t err = NOWDB_OK;
+	nowdb_reader_t *full;
+	nowdb_vexpr_t *vx;
+	nowdb_sel_t *sel;
+	char *src;
+	uint32_t bufsz;
+
+	bufsz = (NOWDB_IDX_PAGE / reader->recsize) * reader->recsize;
+
+	err = newSelection(reader, &sel, &vx);
+	if (err != NOWDB_OK) return err;
+
+	err = nowdb_reader_fullscan(&full, reader->files, reader->filter);
+	if (err != NOWDB_OK) {
+		destroySelection(sel, vx);
+		return err;
+	}
+
+	for(;;) {
+		err = nowdb_reader_move(full);
+		if (err != NOWDB_OK) {
+			if (err->errcode == nowdb_err_eof) {
+				nowdb_err_release(err);
+				err = NOWDB_OK;
+			}
+			break;
+		}
+		src = nowdb_reader_page(full);
+		if (src == NULL) {
+			err = nowdb_err_get(nowdb_err_panic, FALSE, OBJECT,
+			                             "reader has no page");
+			break;
+		}
+		err = selectPage(reader, vx, sel, src, bufsz);
+		if (err != NOWDB_OK) break;
+
+		for(uint32_t i=0; i<sel->count; i++) {
+			err = nowdb_xsort_add(reader->xs,
+			      src+sel->pos[i]*reader->recsize);
+			if (err != NOWDB_OK) break;
+		}
+		if (err != NOWDB_OK) break;
+	}
+	nowdb_reader_destroy(full); free(full);
+	destroySelection(sel, vx);
+	if (err != NOWDB_OK) return err;
+	return nowdb_xsort_finish(reader->xs);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: buffer reader without buffer (for external sort)
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t xbuffer(nowdb_reader_t  **reader,
+                           ts_algo_list_t   *files,
+                           nowdb_expr_t      filter,
+                           nowdb_eval_t     *eval) {
+	nowdb_err_t err;
+
+	err = newReader(reader);
+	if (err != NOWDB_OK) return err;
+
+	(*reader)->type = NOWDB_READER_BUF;
+	(*reader)->filter = filter;
+	(*reader)->eval = eval;
+	(*reader)->recsize = ((nowdb_file_t*)files->head->cont)->recordsize;
+	(*reader)->content = ((nowdb_file_t*)files->head->cont)->cont;
+	(*reader)->files = files;
+
+	return NOWDB_OK;
+}
+
 /* ------------------------------------------------------------------------
  * Buffer simulating an index range scan
  * ------------------------------------------------------------------------
@@ -1535,13 +1964,24 @@ nowdb_err_t nowdb_reader_bufidx(nowdb_reader_t  **reader,
                                 nowdb_expr_t      filter,
                                 nowdb_eval_t     *eval,
                                 nowdb_ord_t        ord,
-                                void *start,void  *end) {
+                                void *start,void  *end,
+                                nowdb_path_t    tmpdir,
+                                nowdb_comp_t      comp,
+                                uint64_t         runsz) {
 	nowdb_err_t err;
+	char ext = 0;
 
 	if (index == NULL) return nowdb_err_get(nowdb_err_invalid,
 	                          FALSE, OBJECT, "index is NULL");
 
-	err = nowdb_reader_buffer(reader, files, filter, eval);
+	/* sort externally if the files do not fit into one run */
+	if (runsz > 0 && files != NULL && files->head != NULL &&
+	    files->head->cont != NULL && countBytes(files) > runsz) {
+		ext = 1;
+		err = xbuffer(reader, files, filter, eval);
+	} else {
+		err = nowdb_reader_buffer(reader, files, filter, eval);
+	}
 	if (err != NOWDB_OK) return err;
 
 	(*reader)->type = NOWDB_READER_BUFIDX;
@@ -1570,6 +2010,25 @@ nowdb_err_t nowdb_reader_bufidx(nowdb_reader_t  **reader,
 		NOMEM("allocating key");
 		return err;
 	}
+
+	if (ext) {
+		err = nowdb_xsort_new(&(*reader)->xs, tmpdir, comp,
+		                      (*reader)->recsize, runsz,
+		                      (*reader)->content == NOWDB_CONT_EDGE ?
+		                              &nowdb_sort_edge_keys_compare :
+		                              &nowdb_sort_vertex_keys_compare,
+		                      (*reader)->ikeys);
+		if (err != NOWDB_OK) {
+			nowdb_reader_destroy(*reader); free(*reader);
+			return err;
+		}
+		err = fillsort(*reader);
+		if (err != NOWDB_OK) {
+			nowdb_reader_destroy(*reader); free(*reader);
+			return err;
+		}
+		return nowdb_reader_rewind(*reader);
+	}
 	
 	if (nowdb_mem_merge((*reader)->buf,
 		            (*reader)->size, NOWDB_IDX_PAGE,
@@ -1595,11 +2054,15 @@ nowdb_err_t nowdb_reader_bkrange(nowdb_reader_t  **reader,
                                  nowdb_expr_t     filter,
                                  nowdb_eval_t     *eval,
                                  nowdb_ord_t        ord,
-                                 void *start,void  *end) {
+                                 void *start,void  *end,
+                                 nowdb_path_t   tmpdir,
+                                 nowdb_comp_t     comp,
+                                 uint64_t        runsz) {
 	nowdb_err_t err;
 
 	err = nowdb_reader_bufidx(reader, files, index,
-	                 filter, eval, ord, start, end);
+	                 filter, eval, ord, start, end,
+	                             tmpdir, comp, runsz);
 	if (err != NOWDB_OK) return err;
 
 	(*reader)->type = NOWDB_READER_BKRANGE;
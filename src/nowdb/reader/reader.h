@@ -12,11 +12,14 @@
 #include <nowdb/task/lock.h>
 #include <nowdb/io/dir.h>
 #include <nowdb/io/file.h>
+#include <nowdb/io/prefetch.h>
 #include <nowdb/store/store.h>
 #include <nowdb/fun/expr.h>
+#include <nowdb/fun/vexpr.h>
 #include <nowdb/index/index.h>
 #include <nowdb/mem/pplru.h>
 #include <nowdb/sort/sort.h>
+#include <nowdb/sort/xsort.h>
 
 #include <tsalgo/list.h>
 #include <tsalgo/tree.h>
@@ -47,6 +50,12 @@
  */
 #define NOWDB_READER_MAXSUB 64
 
+/* ------------------------------------------------------------------------
+ * Default memory for one sorted run of buffer readers
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_READER_SORTMEM 67108864
+
 /* ------------------------------------------------------------------------
  * Reader   
  * ------
@@ -71,7 +80,12 @@ typedef struct nowdb_reader_t {
 	nowdb_store_t         *store; /* store instead of files        */
 	ts_algo_list_node_t *current; /* current file (fullscan)       */
 	nowdb_file_t           *file; /* current file (search)         */
-	ts_algo_tree_t       readers; /* files for index-based readers */
+	nowdb_prefetch_t         *pf; /* read-ahead (fullscan)         */
+	nowdb_file_t          *pfile; /* file read without read-ahead  */
+	nowdb_expr_t         zfilter; /* filter used by read-ahead     */
+	uint32_t               ahead; /* read-ahead depth              */
+	nowdb_file_t          **byid; /* files sorted by id (index)    */
+	uint32_t              nbyid; /* number of files in byid       */
 	nowdb_pplru_t          *plru; /* LRU cache for range reader    */
 	nowdb_pplru_t         *bplru; /* black list                    */
 	char                    *buf; /* for buffer-based readers      */
@@ -80,6 +94,7 @@ typedef struct nowdb_reader_t {
 	char                    *tmp; /* buffer for keys in bufreader  */
 	char                   *tmp2; /* buffer for keys in bufreader  */
 	char                  *page2; /* buffer for page in bufreader  */
+	nowdb_xsort_t            *xs; /* external sort (bufidx)        */
 	nowdb_expr_t          filter; /* filter                        */
 	nowdb_eval_t           *eval; /* evaluation helper             */
 	beet_iter_t             iter; /* iterator                      */
@@ -183,12 +198,26 @@ nowdb_err_t nowdb_reader_read(nowdb_reader_t *reader,
 
 /* ------------------------------------------------------------------------
  * Set Period
+ * ----------
+ * May be called while the reader is moving to narrow the period
+ * (e.g. when no more records outside the period are needed).
  * ------------------------------------------------------------------------
  */
 void nowdb_reader_setPeriod(nowdb_reader_t *reader,
                             nowdb_time_t     start,
                             nowdb_time_t       end);
 
+/* ------------------------------------------------------------------------
+ * Set Read-ahead
+ * --------------
+ * Fullscan readers read and decompress up to 'depth' pages
+ * in background while the current one is processed
+ * (0 means: no read-ahead).
+ * ------------------------------------------------------------------------
+ */
+void nowdb_reader_setReadahead(nowdb_reader_t *reader,
+                               uint32_t         depth);
+
 /* ------------------------------------------------------------------------
  * Fullscan
  * --------
@@ -220,6 +249,17 @@ nowdb_err_t nowdb_reader_search(nowdb_reader_t **reader,
                                 char            *key,
                                 nowdb_expr_t filter);
 
+/* ------------------------------------------------------------------------
+ * Search again
+ * ------------
+ * Restarts a search reader with another key of the same index
+ * (the files and the beet state are reused).
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_reader_research(nowdb_reader_t *reader,
+                                  nowdb_index_t  *index,
+                                  char             *key);
+
 /* ------------------------------------------------------------------------
  * Index Full Range scan
  * ---------------------
@@ -319,6 +359,13 @@ nowdb_err_t nowdb_reader_buffer(nowdb_reader_t  **reader,
  * - start/end: range indicator; ignore if ordering is NULL.
  *              with ordering and range, the reader behaves
  *              like a range scanner.
+ * - tmpdir: directory for temporary files
+ * - comp  : codec for temporary files
+ * - runsz : memory used for sorting (0: no limit).
+ *           If the files exceed runsz, the data are sorted
+ *           externally in runs of runsz bytes, which are
+ *           written to a temporary file in 'tmpdir'
+ *           and merged while the reader moves.
  * ------------------------------------------------------------------------
  */
 nowdb_err_t nowdb_reader_bufidx(nowdb_reader_t  **reader,
@@ -327,7 +374,10 @@ nowdb_err_t nowdb_reader_bufidx(nowdb_reader_t  **reader,
                                 nowdb_expr_t     filter,
                                 nowdb_eval_t     *eval, 
                                 nowdb_ord_t        ord,
-                                void *start, void *end);
+                                void *start, void *end,
+                                nowdb_path_t    tmpdir,
+                                nowdb_comp_t      comp,
+                                uint64_t         runsz);
 
 /* ------------------------------------------------------------------------
  * Buffer simulating an index range scan (keys only)
@@ -341,6 +391,7 @@ nowdb_err_t nowdb_reader_bufidx(nowdb_reader_t  **reader,
  * - start/end: range indicator; ignore if ordering is NULL.
  *              with ordering and range, the reader behaves
  *              like a range scanner.
+ * - tmpdir/comp/runsz: external sorting (see bufidx)
  * ------------------------------------------------------------------------
  */
 nowdb_err_t nowdb_reader_bkrange(nowdb_reader_t  **reader,
@@ -349,7 +400,10 @@ nowdb_err_t nowdb_reader_bkrange(nowdb_reader_t  **reader,
                                  nowdb_expr_t     filter,
                                  nowdb_eval_t     *eval, 
                                  nowdb_ord_t        ord,
-                                 void *start,void  *end);
+                                 void *start,void  *end,
+                                 nowdb_path_t   tmpdir,
+                                 nowdb_comp_t     comp,
+                                 uint64_t        runsz);
 
 /* ------------------------------------------------------------------------
  * Sequence reader ('va_list' convention)
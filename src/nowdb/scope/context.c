@@ -56,4 +56,7 @@ nowdb_err_t nowdb_context_insert(nowdb_context_t *ctx,
  */
 nowdb_err_t nowdb_context_insertBulk(nowdb_context_t *ctx,
                                      void           *data,
-                                     uint32_t      count);
+                                     uint32_t      count) {
+	return nowdb_context_err(ctx, nowdb_store_insertBulk(&ctx->store,
+	                                                 data, count));
+}
@@ -270,13 +270,8 @@ static inline void insertBuf(nowdb_loader_t *ldr) {
 
 	if (ldr->err != NOWDB_OK) return;
 
-	/* consider insertBulk! */
-	for(int i=0; i<ldr->csv->pos; i+=ldr->csv->recsize) {
-		/* fprintf(stderr, "inserting %d\n", i/64); */
-		ldr->err = nowdb_store_insert(&ldr->ctx->store,
-		                               ldr->csv->buf+i);
-		if (ldr->err != NOWDB_OK) return;
-	}
+	ldr->err = nowdb_store_insertBulk(&ldr->ctx->store, ldr->csv->buf,
+	                                  ldr->csv->pos/ldr->csv->recsize);
 }
 
 /* ------------------------------------------------------------------------
@@ -508,7 +508,9 @@ static inline uint32_t computeStorageSize(nowdb_scope_t *scope) {
 	 * alloc size        4 
 	 * large size        4 
 	 * nm sorters        4 
-	 * compression       4 
+	 * compression       4 (algorithm: low 16 bits,
+	 *                      encoding : bits 16-23,
+	 *                      read-ahead: bits 24-31)
 	 * encryption        4 
 	 * storage name    255
 	 */
@@ -549,11 +551,13 @@ static inline void writeStorageLine(nowdb_storage_t *strg,
                                  char *buf, uint32_t *off) {
 
 	uint32_t s = strlen(strg->name)+1;
+	uint32_t comp = strg->comp | ((uint32_t)strg->encode << 16) |
+	                            (strg->readahead << 24);
 
 	memcpy(buf+*off, &strg->filesize, 4); *off += 4;
 	memcpy(buf+*off, &strg->largesize, 4); *off += 4;
 	memcpy(buf+*off, &strg->tasknum, 4); *off += 4;
-	memcpy(buf+*off, &strg->comp, 4); *off += 4;
+	memcpy(buf+*off, &comp, 4); *off += 4;
 	memcpy(buf+*off, &strg->encp, 4); *off += 4;
 	memcpy(buf+*off, strg->name, s); *off += s;
 }
@@ -712,6 +716,7 @@ static inline nowdb_err_t initContext(nowdb_scope_t    *scope,
 	nowdb_model_vertex_t *v=NULL;
 	nowdb_content_t    cont;
 	nowdb_storage_t *strg, pattern;
+	uint32_t ekeys[2] = {NOWDB_OFF_ORIGIN, NOWDB_OFF_DESTIN};
 	char *strgnm;
 	nowdb_err_t err;
 	uint32_t s;
@@ -792,12 +797,28 @@ static inline nowdb_err_t initContext(nowdb_scope_t    *scope,
 		free((*ctx)->name); free(*ctx);
 		return err;
 	}
+	// the same order, but on the keys directly
+	if ((*ctx)->store.recsize >= 2*sizeof(nowdb_key_t)) {
+		err = nowdb_store_configRadix(&(*ctx)->store, ekeys, 2,
+		                                    NOWDB_RADIX_TASKS);
+		if (err != NOWDB_OK) {
+			nowdb_store_destroy(&(*ctx)->store);
+			free((*ctx)->name); free(*ctx); *ctx = NULL;
+			return err;
+		}
+	}
 	err = nowdb_store_configCompression(&(*ctx)->store, strg->comp);
 	if (err != NOWDB_OK) {
 		nowdb_store_destroy(&(*ctx)->store);
 		free((*ctx)->name); free(*ctx); *ctx = NULL;
 		return err;
 	}
+	err = nowdb_store_configEncoding(&(*ctx)->store, strg->encode);
+	if (err != NOWDB_OK) {
+		nowdb_store_destroy(&(*ctx)->store);
+		free((*ctx)->name); free(*ctx); *ctx = NULL;
+		return err;
+	}
 	err = nowdb_store_configIndexing(&(*ctx)->store, scope->iman, *ctx);
 	if (err != NOWDB_OK) {
 		nowdb_store_destroy(&(*ctx)->store);
@@ -990,6 +1011,10 @@ static inline nowdb_err_t readStorageLine(nowdb_scope_t *scope,
 	memcpy(&cfg.sorters, buf+*off, 4); *off += 4;
 	memcpy(&cfg.comp, buf+*off, 4); *off += 4; *off += 4;
 
+	cfg.encode = (char)((cfg.comp >> 16) & 0xff);
+	cfg.readahead = cfg.comp >> 24;
+	cfg.comp &= 0xffff;
+
 	for(i=0;i<=255;i++) {
 		if (buf[*off+i] == 0) break;
 	}
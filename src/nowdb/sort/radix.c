@@ -0,0 +1,301 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Radix sort: sorting buffers of records on fixed 8-byte keys
+ * ========================================================================
+ */
+#include <nowdb/sort/radix.h>
+#include <nowdb/types/error.h>
+#include <nowdb/task/task.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+extern char nowdb_nullrec[1024];
+
+/* ------------------------------------------------------------------------
+ * Sort entry: the keys and where the record is
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	uint64_t key[NOWDB_RADIX_MAXKEYS]; /* the keys               */
+	uint32_t                      pos; /* offset of the record   */
+} entry_t;
+
+/* ------------------------------------------------------------------------
+ * Job: what one task does
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	char        *buf; /* the buffer to sort                    */
+	char        *trg; /* the sorted buffer                     */
+	uint32_t bufsize; /* page size                             */
+	uint32_t recsize; /* record size                           */
+	uint32_t  nitems; /* records per page                      */
+	uint32_t   *offs; /* key offsets                           */
+	uint32_t   nkeys; /* number of keys                        */
+	uint32_t  *live; /* live records per page                  */
+	uint32_t   fpage; /* first page of this job                */
+	uint32_t   tpage; /* first page of the next job            */
+	entry_t    *ents; /* entries (sorted)                      */
+	entry_t     *tmp; /* scratch                               */
+	uint32_t   first; /* first entry of this job               */
+	uint32_t   count; /* number of entries of this job         */
+} job_t;
+
+/* ------------------------------------------------------------------------
+ * Helper: number of records before the first null record.
+ * Pages are filled from the start, null records are found
+ * only at the end.
+ * ------------------------------------------------------------------------
+ */
+static inline uint32_t liveRecords(char    *page,
+                                   uint32_t    n,
+                                   uint32_t recsz) {
+	uint32_t lo=0, hi, m;
+
+	if (n == 0) return 0;
+	if (memcmp(page+(n-1)*recsz, nowdb_nullrec, recsz) != 0) return n;
+
+	hi = n-1;
+	while(lo < hi) {
+		m = lo+(hi-lo)/2;
+		if (memcmp(page+m*recsz, nowdb_nullrec, recsz) == 0) hi = m;
+		else lo = m+1;
+	}
+	return lo;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: get byte b of key k
+ * ------------------------------------------------------------------------
+ */
+#define DIGIT(e,k,b) \
+	(((e).key[k] >> ((b)*8)) & 0xff)
+
+/* ------------------------------------------------------------------------
+ * Helper: left < right
+ * ------------------------------------------------------------------------
+ */
+static inline char less(entry_t *left, entry_t *right, uint32_t nkeys) {
+	for(uint32_t k=0; k<nkeys; k++) {
+		if (left->key[k] < right->key[k]) return 1;
+		if (left->key[k] > right->key[k]) return 0;
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Phase 1: extract keys from the pages of the job and sort them
+ * ------------------------------------------------------------------------
+ */
+static void *sortRun(void *p) {
+	job_t *job = p;
+	uint32_t hist[NOWDB_RADIX_MAXKEYS*8][256];
+	uint32_t off[256];
+	entry_t *src = job->ents+job->first;
+	entry_t *dst = job->tmp+job->first;
+	entry_t *x;
+	uint32_t n=0, s, h;
+
+	// extract
+	for(uint32_t g=job->fpage; g<job->tpage; g++) {
+		char *page = job->buf+g*job->bufsize;
+		for(uint32_t i=0; i<job->live[g]; i++) {
+			char *rec = page+i*job->recsize;
+			for(uint32_t k=0; k<job->nkeys; k++) {
+				memcpy(src[n].key+k, rec+job->offs[k], 8);
+			}
+			src[n].pos = g*job->bufsize+i*job->recsize;
+			n++;
+		}
+	}
+	if (n < 2) return NULL;
+
+	// histograms of all bytes in one go
+	memset(hist, 0, sizeof(hist));
+	for(uint32_t i=0; i<n; i++) {
+		for(uint32_t k=0; k<job->nkeys; k++) {
+			for(uint32_t b=0; b<8; b++) {
+				hist[k*8+b][DIGIT(src[i],k,b)]++;
+			}
+		}
+	}
+
+	// least significant byte of the least significant key first;
+	// a byte that is the same in all keys does not change the order
+	for(int k=job->nkeys-1; k>=0; k--) {
+		for(uint32_t b=0; b<8; b++) {
+			uint32_t *c = hist[k*8+b];
+
+			if (c[DIGIT(src[0],k,b)] == n) continue;
+
+			s = 0;
+			for(int d=0; d<256; d++) {
+				off[d] = s; s += c[d];
+			}
+			for(uint32_t i=0; i<n; i++) {
+				h = DIGIT(src[i],k,b);
+				dst[off[h]] = src[i]; off[h]++;
+			}
+			x = src; src = dst; dst = x;
+		}
+	}
+	if (src != job->ents+job->first) {
+		memcpy(job->ents+job->first, src, n*sizeof(entry_t));
+	}
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------
+ * Phase 2: merge the sorted runs into 'trg'
+ *          (on equal keys the earlier run wins: the sort is stable)
+ * ------------------------------------------------------------------------
+ */
+static void mergeRuns(job_t *jobs, uint32_t n, entry_t *trg) {
+	uint32_t cur[NOWDB_RADIX_MAXTASKS];
+	uint32_t end[NOWDB_RADIX_MAXTASKS];
+	entry_t *ents = jobs[0].ents;
+	uint32_t k=0;
+	int m;
+
+	for(uint32_t i=0; i<n; i++) {
+		cur[i] = jobs[i].first;
+		end[i] = jobs[i].first+jobs[i].count;
+	}
+	for(;;) {
+		m = -1;
+		for(uint32_t i=0; i<n; i++) {
+			if (cur[i] >= end[i]) continue;
+			if (m < 0 || less(ents+cur[i], ents+cur[m],
+			                         jobs[0].nkeys)) m = i;
+		}
+		if (m < 0) break;
+		trg[k] = ents[cur[m]]; k++; cur[m]++;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Phase 3: copy the records of the job to their new position
+ * ------------------------------------------------------------------------
+ */
+static void *scatter(void *p) {
+	job_t *job = p;
+	uint32_t e = job->first+job->count;
+
+	for(uint32_t i=job->first; i<e; i++) {
+		memcpy(job->trg+(i/job->nitems)*job->bufsize+
+		                (i%job->nitems)*job->recsize,
+		       job->buf+job->ents[i].pos, job->recsize);
+	}
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: run jobs in parallel;
+ *         if a task cannot be started, its job runs in this task
+ * ------------------------------------------------------------------------
+ */
+static void runJobs(job_t *jobs, uint32_t n, nowdb_task_entry_t entry) {
+	nowdb_task_t tasks[NOWDB_RADIX_MAXTASKS];
+	char started[NOWDB_RADIX_MAXTASKS];
+	nowdb_err_t err;
+
+	for(uint32_t i=1; i<n; i++) {
+		err = nowdb_task_create(tasks+i, entry, jobs+i);
+		started[i] = (err == NOWDB_OK);
+		if (err != NOWDB_OK) nowdb_err_release(err);
+	}
+	entry(jobs);
+	for(uint32_t i=1; i<n; i++) {
+		if (started[i]) {
+			NOWDB_IGNORE(nowdb_task_join(tasks[i]));
+		} else {
+			entry(jobs+i);
+		}
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Sort buffer on keys
+ * ------------------------------------------------------------------------
+ */
+int nowdb_radix_sort(char *buf, uint32_t size, uint32_t bufsize,
+                                               uint32_t recsize,
+                     uint32_t *offs, uint32_t nkeys,
+                                     uint32_t tasks) {
+	job_t jobs[NOWDB_RADIX_MAXTASKS];
+	uint32_t *live;
+	entry_t *ents, *tmp;
+	char *trg;
+	uint32_t nitems, npages;
+	uint32_t total=0;
+	uint32_t g=0;
+
+	if (nkeys == 0 || nkeys > NOWDB_RADIX_MAXKEYS) return -3;
+	for(uint32_t k=0; k<nkeys; k++) {
+		if (offs[k]+8 > recsize) return -3;
+	}
+
+	nitems = bufsize/recsize;
+	if (nitems == 0 || size%bufsize != 0) return -2;
+
+	npages = size/bufsize;
+	if (npages == 0) return 0;
+
+	if (tasks == 0) tasks = 1;
+	if (tasks > NOWDB_RADIX_MAXTASKS) tasks = NOWDB_RADIX_MAXTASKS;
+	if (tasks > npages) tasks = npages;
+
+	live = malloc(npages*sizeof(uint32_t));
+	if (live == NULL) return -1;
+
+	for(uint32_t i=0; i<npages; i++) {
+		live[i] = liveRecords(buf+i*bufsize, nitems, recsize);
+		total += live[i];
+	}
+	if (total == 0) {
+		free(live); return 0;
+	}
+
+	ents = malloc(total*sizeof(entry_t));
+	tmp  = malloc(total*sizeof(entry_t));
+	trg  = calloc(1, size);
+	if (ents == NULL || tmp == NULL || trg == NULL) {
+		free(live); free(ents); free(tmp); free(trg);
+		return -1;
+	}
+
+	// each job gets a contiguous range of pages
+	for(uint32_t i=0; i<tasks; i++) {
+		jobs[i].buf = buf;
+		jobs[i].trg = trg;
+		jobs[i].bufsize = bufsize;
+		jobs[i].recsize = recsize;
+		jobs[i].nitems = nitems;
+		jobs[i].offs = offs;
+		jobs[i].nkeys = nkeys;
+		jobs[i].live = live;
+		jobs[i].ents = ents;
+		jobs[i].tmp = tmp;
+		jobs[i].fpage = g;
+		jobs[i].tpage = (uint32_t)(((uint64_t)npages*(i+1))/tasks);
+		jobs[i].first = i == 0 ? 0 : jobs[i-1].first+jobs[i-1].count;
+		jobs[i].count = 0;
+		for(; g<jobs[i].tpage; g++) jobs[i].count += live[g];
+	}
+
+	runJobs(jobs, tasks, &sortRun);
+
+	if (tasks > 1) {
+		mergeRuns(jobs, tasks, tmp);
+		for(uint32_t i=0; i<tasks; i++) jobs[i].ents = tmp;
+	}
+
+	runJobs(jobs, tasks, &scatter);
+
+	memcpy(buf, trg, size);
+
+	free(live); free(ents); free(tmp); free(trg);
+	return 0;
+}
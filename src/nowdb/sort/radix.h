@@ -0,0 +1,67 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Radix sort: sorting buffers of records on fixed 8-byte keys
+ * ========================================================================
+ * The buffer is organised in pages like the buffers
+ * passed to nowdb_mem_merge, i.e. each page holds
+ * bufsize/recsize records followed by the remainder
+ * and may end with null records.
+ *
+ * The sort runs in three phases:
+ * - the pages are distributed over n tasks; each task
+ *   extracts the keys (and the position of the record)
+ *   from its pages and sorts them with an LSD radix sort,
+ *   one byte per pass. Passes in which all keys have
+ *   the same byte are skipped, so small keys
+ *   (e.g. vertex ids) need only a few passes.
+ * - the sorted runs are merged (comparing the keys
+ *   directly, not through a callback).
+ * - the tasks copy the records to their new position.
+ *
+ * The keys are compared as unsigned integers,
+ * the first key is the most significant one.
+ * The sort is stable.
+ * ========================================================================
+ */
+#ifndef nowdb_radix_decl
+#define nowdb_radix_decl
+
+#include <nowdb/types/types.h>
+
+#include <stdint.h>
+
+/* ------------------------------------------------------------------------
+ * Max number of keys
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_RADIX_MAXKEYS 3
+
+/* ------------------------------------------------------------------------
+ * Default and max number of tasks
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_RADIX_TASKS    4
+#define NOWDB_RADIX_MAXTASKS 16
+
+/* ------------------------------------------------------------------------
+ * Sort buffer on keys
+ * -------------------
+ * - size must be a multiple of bufsize (the page)
+ * - offs are the offsets of the keys in the record
+ *   (most significant first, at most NOWDB_RADIX_MAXKEYS)
+ * - tasks is the number of tasks used for sorting
+ *   (1 sorts in the calling task only)
+ *
+ * - returns 0 on success and a negative value on error, namely
+ *   -1:  not enough memory
+ *   -2:  size is not a multiple of page
+ *   -3:  invalid keys
+ * ------------------------------------------------------------------------
+ */
+int nowdb_radix_sort(char *buf, uint32_t size, uint32_t bufsize,
+                                               uint32_t recsize,
+                     uint32_t *offs, uint32_t nkeys,
+                                     uint32_t tasks);
+
+#endif
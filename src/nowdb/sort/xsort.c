@@ -0,0 +1,569 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * External sort: sorting datasets that do not fit into memory
+ * ========================================================================
+ */
+#include <nowdb/sort/xsort.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zstd.h>
+#include <lz4.h>
+
+static char *OBJECT = "xsort";
+
+#define NOMEM(x) \
+	err = nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT, x);
+
+#define INVALID(x) \
+	return nowdb_err_get(nowdb_err_invalid, FALSE, OBJECT, x);
+
+/* ------------------------------------------------------------------------
+ * Block header: compressed and uncompressed size;
+ * if both are equal, the block is stored uncompressed.
+ * ------------------------------------------------------------------------
+ */
+#define HDRSIZE 8
+
+/* ------------------------------------------------------------------------
+ * Name of the temporary file
+ * ------------------------------------------------------------------------
+ */
+#define TMPNAME ".nowsortXXXXXX"
+
+/* ------------------------------------------------------------------------
+ * Helper: open the temporary file and unlink it immediately
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t openTmp(nowdb_xsort_t *xs) {
+	nowdb_err_t err;
+	nowdb_path_t p;
+	int fd;
+
+	if (xs->path == NULL) {
+		xs->tmp = tmpfile();
+		if (xs->tmp == NULL) return nowdb_err_get(nowdb_err_open,
+		                       TRUE, OBJECT, "temporary file");
+		return NOWDB_OK;
+	}
+	p = nowdb_path_append(xs->path, TMPNAME);
+	if (p == NULL) {
+		NOMEM("allocating path");
+		return err;
+	}
+	fd = mkstemp(p);
+	if (fd < 0) {
+		err = nowdb_err_get(nowdb_err_open, TRUE, OBJECT, p);
+		free(p); return err;
+	}
+	if (unlink(p) != 0) {
+		err = nowdb_err_get(nowdb_err_remove, TRUE, OBJECT, p);
+		close(fd); free(p); return err;
+	}
+	free(p);
+	xs->tmp = fdopen(fd, "w+");
+	if (xs->tmp == NULL) {
+		close(fd);
+		return nowdb_err_get(nowdb_err_open, TRUE, OBJECT,
+		                                 "temporary file");
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: compress block into zbuf and return its size
+ * (0 if the block does not compress)
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t compress(nowdb_xsort_t *xs, char *src,
+                            uint32_t size, uint32_t *csz) {
+	size_t sz;
+	int    x;
+
+	*csz = 0;
+	switch(xs->comp) {
+	case NOWDB_COMP_ZSTD:
+		sz = ZSTD_compress(xs->zbuf, xs->zsz, src, size,
+		                                NOWDB_ZSTD_LEVEL);
+		if (ZSTD_isError(sz)) {
+			return nowdb_err_get(nowdb_err_comp, FALSE, OBJECT,
+			                 (char*)ZSTD_getErrorName(sz));
+		}
+		if (sz < size) *csz = (uint32_t)sz;
+		return NOWDB_OK;
+
+	case NOWDB_COMP_LZ4:
+		x = LZ4_compress_default(src, xs->zbuf, (int)size,
+		                                      (int)xs->zsz);
+		if (x > 0 && x < size) *csz = (uint32_t)x;
+		return NOWDB_OK;
+
+	default: return NOWDB_OK;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: decompress zbuf into block
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t decompress(nowdb_xsort_t *xs, char *dst,
+                              uint32_t csz, uint32_t size) {
+	size_t sz;
+	int    x;
+
+	switch(xs->comp) {
+	case NOWDB_COMP_ZSTD:
+		sz = ZSTD_decompress(dst, xs->blksz, xs->zbuf, csz);
+		if (ZSTD_isError(sz)) {
+			return nowdb_err_get(nowdb_err_decomp, FALSE, OBJECT,
+			                   (char*)ZSTD_getErrorName(sz));
+		}
+		if (sz != size) break;
+		return NOWDB_OK;
+
+	case NOWDB_COMP_LZ4:
+		x = LZ4_decompress_safe(xs->zbuf, dst, (int)csz,
+		                                 (int)xs->blksz);
+		if (x != size) break;
+		return NOWDB_OK;
+
+	default: break;
+	}
+	return nowdb_err_get(nowdb_err_decomp, FALSE, OBJECT,
+	                                    "corrupted block");
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: write n bytes at position pos
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t writeAt(nowdb_xsort_t *xs, char *src,
+                                  uint32_t n, uint64_t pos) {
+	if (pwrite(fileno(xs->tmp), src, n, (off_t)pos) != n) {
+		return nowdb_err_get(nowdb_err_write, TRUE, OBJECT,
+		                                "temporary file");
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: read n bytes from position pos
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t readAt(nowdb_xsort_t *xs, char *dst,
+                                 uint32_t n, uint64_t pos) {
+	if (pread(fileno(xs->tmp), dst, n, (off_t)pos) != n) {
+		return nowdb_err_get(nowdb_err_read, TRUE, OBJECT,
+		                               "temporary file");
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: get a new run
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t newRun(nowdb_xsort_t *xs, nowdb_xsort_run_t **run) {
+	nowdb_err_t err;
+	nowdb_xsort_run_t *tmp;
+	uint32_t n;
+
+	if (xs->nruns >= xs->maxruns) {
+		n = xs->maxruns == 0 ? 8 : 2*xs->maxruns;
+		tmp = realloc(xs->runs, n*sizeof(nowdb_xsort_run_t));
+		if (tmp == NULL) {
+			NOMEM("allocating runs");
+			return err;
+		}
+		xs->runs = tmp;
+		xs->maxruns = n;
+	}
+	*run = xs->runs+xs->nruns;
+	memset(*run, 0, sizeof(nowdb_xsort_run_t));
+	xs->nruns++;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: sort current run
+ * ------------------------------------------------------------------------
+ */
+static inline void sortRun(nowdb_xsort_t *xs) {
+	if (xs->size == 0) return;
+	nowdb_mem_sort(xs->buf, (uint32_t)(xs->size/xs->recsize),
+	                      xs->recsize, xs->compare, xs->args);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: sort current run and write it to the temporary file
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t spill(nowdb_xsort_t *xs) {
+	nowdb_err_t err;
+	nowdb_xsort_run_t *run=NULL;
+	uint32_t hdr[2];
+	uint32_t n, csz;
+
+	if (xs->tmp == NULL) {
+		err = openTmp(xs);
+		if (err != NOWDB_OK) return err;
+	}
+
+	sortRun(xs);
+
+	err = newRun(xs, &run);
+	if (err != NOWDB_OK) return err;
+
+	run->start = xs->fsize;
+	for(uint64_t off=0; off<xs->size; off+=n) {
+		n = xs->size - off < xs->blksz ? xs->size - off : xs->blksz;
+
+		err = compress(xs, xs->buf+off, n, &csz);
+		if (err != NOWDB_OK) return err;
+
+		hdr[0] = csz == 0 ? n : csz;
+		hdr[1] = n;
+
+		err = writeAt(xs, (char*)hdr, HDRSIZE, xs->fsize);
+		if (err != NOWDB_OK) return err;
+		xs->fsize += HDRSIZE;
+
+		err = writeAt(xs, csz == 0 ? xs->buf+off : xs->zbuf,
+		                                 hdr[0], xs->fsize);
+		if (err != NOWDB_OK) return err;
+		xs->fsize += hdr[0];
+	}
+	run->end = xs->fsize;
+	xs->size = 0;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: load next block of a run
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t loadBlock(nowdb_xsort_t *xs, nowdb_xsort_run_t *run) {
+	nowdb_err_t err;
+	uint32_t hdr[2];
+
+	run->off = 0;
+	run->size = 0;
+	if (run->mem || run->pos >= run->end) {
+		run->done = 1; return NOWDB_OK;
+	}
+	err = readAt(xs, (char*)hdr, HDRSIZE, run->pos);
+	if (err != NOWDB_OK) return err;
+	run->pos += HDRSIZE;
+
+	if (hdr[1] > xs->blksz || hdr[0] > xs->zsz || hdr[1] == 0) {
+		return nowdb_err_get(nowdb_err_bad_block, FALSE, OBJECT,
+		                                 "invalid block header");
+	}
+	if (hdr[0] == hdr[1]) {
+		err = readAt(xs, run->blk, hdr[1], run->pos);
+	} else {
+		err = readAt(xs, xs->zbuf, hdr[0], run->pos);
+		if (err == NOWDB_OK) {
+			err = decompress(xs, run->blk, hdr[0], hdr[1]);
+		}
+	}
+	if (err != NOWDB_OK) return err;
+	run->pos += hdr[0];
+	run->size = hdr[1];
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: run a wins against run b
+ * (exhausted runs always lose; ties go to the older run)
+ * ------------------------------------------------------------------------
+ */
+static inline char wins(nowdb_xsort_t *xs, uint32_t a, uint32_t b) {
+	nowdb_xsort_run_t *ra = xs->runs+a;
+	nowdb_xsort_run_t *rb = xs->runs+b;
+	nowdb_cmp_t x;
+
+	if (ra->done) return 0;
+	if (rb->done) return 1;
+	x = xs->compare(ra->blk+ra->off, rb->blk+rb->off, xs->args);
+	if (x == NOWDB_SORT_LESS) return 1;
+	if (x == NOWDB_SORT_GREATER) return 0;
+	return (a < b);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: build the loser tree
+ * ------------------------------------------------------------------------
+ * Leaf i is node nruns+i, the inner nodes are 1..nruns-1
+ * and the parent of node t is t/2. tree[t] holds the loser
+ * of the match at t, tree[0] holds the overall winner.
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t buildTree(nowdb_xsort_t *xs) {
+	nowdb_err_t err;
+	uint32_t *win;
+	uint32_t k = xs->nruns;
+	uint32_t a, b;
+
+	if (k == 1) {
+		xs->tree[0] = 0; return NOWDB_OK;
+	}
+	win = calloc(2*k, sizeof(uint32_t));
+	if (win == NULL) {
+		NOMEM("allocating winners");
+		return err;
+	}
+	for(uint32_t t=2*k-1; t>=k; t--) win[t] = t-k;
+	for(uint32_t t=k-1; t>0; t--) {
+		a = win[2*t]; b = win[2*t+1];
+		if (wins(xs, a, b)) {
+			win[t] = a; xs->tree[t] = b;
+		} else {
+			win[t] = b; xs->tree[t] = a;
+		}
+	}
+	xs->tree[0] = win[1];
+	free(win);
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: replay the matches from leaf i to the root
+ * ------------------------------------------------------------------------
+ */
+static inline void replay(nowdb_xsort_t *xs, uint32_t i) {
+	uint32_t w = i;
+	uint32_t x;
+
+	for(uint32_t t=(xs->nruns+i)/2; t>0; t/=2) {
+		if (wins(xs, xs->tree[t], w)) {
+			x = xs->tree[t]; xs->tree[t] = w; w = x;
+		}
+	}
+	xs->tree[0] = w;
+}
+
+/* ------------------------------------------------------------------------
+ * Destroy
+ * ------------------------------------------------------------------------
+ */
+void nowdb_xsort_destroy(nowdb_xsort_t *xs) {
+	if (xs == NULL) return;
+	if (xs->tmp != NULL) {
+		fclose(xs->tmp); xs->tmp = NULL;
+	}
+	if (xs->runs != NULL) {
+		for(uint32_t i=0; i<xs->nruns; i++) {
+			if (!xs->runs[i].mem && xs->runs[i].blk != NULL) {
+				free(xs->runs[i].blk);
+			}
+		}
+		free(xs->runs); xs->runs = NULL;
+	}
+	if (xs->tree != NULL) {
+		free(xs->tree); xs->tree = NULL;
+	}
+	if (xs->buf != NULL) {
+		free(xs->buf); xs->buf = NULL;
+	}
+	if (xs->zbuf != NULL) {
+		free(xs->zbuf); xs->zbuf = NULL;
+	}
+	if (xs->path != NULL) {
+		free(xs->path); xs->path = NULL;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Allocate and initialise a new external sort
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_xsort_new(nowdb_xsort_t   **xs,
+                            nowdb_path_t    path,
+                            nowdb_comp_t    comp,
+                            uint32_t     recsize,
+                            uint64_t       runsz,
+                            nowdb_comprsc_t compare,
+                            void           *args) {
+	nowdb_err_t err;
+	size_t zsz;
+
+	if (xs == NULL) INVALID("pointer to external sort is NULL");
+	if (compare == NULL) INVALID("no compare function");
+	if (recsize == 0 || recsize > NOWDB_XSORT_BLOCK) {
+		INVALID("invalid record size");
+	}
+	if (comp != NOWDB_COMP_FLAT &&
+	    comp != NOWDB_COMP_ZSTD &&
+	    comp != NOWDB_COMP_LZ4) INVALID("unknown codec");
+
+	/* runs must fit into one call to nowdb_mem_sort */
+	if (runsz > NOWDB_GIGA) runsz = NOWDB_GIGA;
+	runsz = (runsz/recsize)*recsize;
+	if (runsz == 0) runsz = recsize;
+
+	*xs = calloc(1, sizeof(nowdb_xsort_t));
+	if (*xs == NULL) {
+		NOMEM("allocating external sort");
+		return err;
+	}
+	(*xs)->compare = compare;
+	(*xs)->args = args;
+	(*xs)->comp = comp;
+	(*xs)->recsize = recsize;
+	(*xs)->runsz = runsz;
+	(*xs)->blksz = (NOWDB_XSORT_BLOCK/recsize)*recsize;
+
+	if (path != NULL) {
+		(*xs)->path = strdup(path);
+		if ((*xs)->path == NULL) {
+			NOMEM("allocating path");
+			goto failure;
+		}
+	}
+
+	zsz = ZSTD_compressBound((*xs)->blksz);
+	if (LZ4_compressBound((*xs)->blksz) > zsz) {
+		zsz = LZ4_compressBound((*xs)->blksz);
+	}
+	(*xs)->zsz = (uint32_t)zsz;
+	(*xs)->zbuf = malloc(zsz);
+	if ((*xs)->zbuf == NULL) {
+		NOMEM("allocating compression buffer");
+		goto failure;
+	}
+	(*xs)->buf = malloc(runsz);
+	if ((*xs)->buf == NULL) {
+		NOMEM("allocating run");
+		goto failure;
+	}
+	return NOWDB_OK;
+
+failure:
+	nowdb_xsort_destroy(*xs);
+	free(*xs); *xs = NULL;
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Add a record
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_xsort_add(nowdb_xsort_t *xs, char *record) {
+	nowdb_err_t err;
+
+	if (xs->finished) INVALID("external sort is finished");
+
+	if (xs->size + xs->recsize > xs->runsz) {
+		err = spill(xs);
+		if (err != NOWDB_OK) return err;
+	}
+	memcpy(xs->buf+xs->size, record, xs->recsize);
+	xs->size += xs->recsize;
+	xs->total++;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Finish
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_xsort_finish(nowdb_xsort_t *xs) {
+	nowdb_err_t err;
+	nowdb_xsort_run_t *run=NULL;
+
+	if (xs->finished) INVALID("external sort is finished");
+
+	/* the last run is kept in memory */
+	if (xs->size > 0 || xs->nruns == 0) {
+		sortRun(xs);
+		err = newRun(xs, &run);
+		if (err != NOWDB_OK) return err;
+		run->mem = 1;
+		run->blk = xs->buf;
+	} else {
+		free(xs->buf); xs->buf = NULL;
+	}
+	xs->finished = 1;
+
+	for(uint32_t i=0; i<xs->nruns; i++) {
+		if (xs->runs[i].mem) continue;
+		xs->runs[i].blk = malloc(xs->blksz);
+		if (xs->runs[i].blk == NULL) {
+			NOMEM("allocating block");
+			return err;
+		}
+	}
+	xs->tree = calloc(xs->nruns, sizeof(uint32_t));
+	if (xs->tree == NULL) {
+		NOMEM("allocating loser tree");
+		return err;
+	}
+	return nowdb_xsort_rewind(xs);
+}
+
+/* ------------------------------------------------------------------------
+ * Rewind
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_xsort_rewind(nowdb_xsort_t *xs) {
+	nowdb_err_t err;
+	nowdb_xsort_run_t *run;
+
+	if (!xs->finished) INVALID("external sort is not finished");
+
+	for(uint32_t i=0; i<xs->nruns; i++) {
+		run = xs->runs+i;
+		if (run->mem) {
+			run->off = 0;
+			run->size = (uint32_t)xs->size;
+			run->done = (xs->size == 0);
+			continue;
+		}
+		run->pos = run->start;
+		run->done = 0;
+		err = loadBlock(xs, run);
+		if (err != NOWDB_OK) return err;
+	}
+	return buildTree(xs);
+}
+
+/* ------------------------------------------------------------------------
+ * Top
+ * ------------------------------------------------------------------------
+ */
+char *nowdb_xsort_top(nowdb_xsort_t *xs) {
+	nowdb_xsort_run_t *run;
+
+	if (!xs->finished || xs->nruns == 0) return NULL;
+	run = xs->runs+xs->tree[0];
+	if (run->done) return NULL;
+	return run->blk+run->off;
+}
+
+/* ------------------------------------------------------------------------
+ * Pop
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_xsort_pop(nowdb_xsort_t *xs) {
+	nowdb_err_t err;
+	nowdb_xsort_run_t *run;
+	uint32_t w;
+
+	if (!xs->finished) INVALID("external sort is not finished");
+	if (xs->nruns == 0) return NOWDB_OK;
+
+	w = xs->tree[0];
+	run = xs->runs+w;
+	if (run->done) return NOWDB_OK;
+
+	run->off += xs->recsize;
+	if (run->off >= run->size) {
+		err = loadBlock(xs, run);
+		if (err != NOWDB_OK) return err;
+	}
+	replay(xs, w);
+	return NOWDB_OK;
+}
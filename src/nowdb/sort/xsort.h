@@ -0,0 +1,148 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * External sort: sorting datasets that do not fit into memory
+ * ========================================================================
+ * Records are collected in a buffer of limited size (a 'run').
+ * When the buffer is full, it is sorted (nowdb_mem_sort) and
+ * written to a temporary file in blocks, which are compressed
+ * with the codec passed in (zstd, lz4 or none).
+ * When all records are added, the last run is sorted,
+ * but kept in memory. The runs are then merged using
+ * a loser tree (tournament tree) that holds the losers
+ * of the last round in its inner nodes; after the winner
+ * is consumed, only the path from its leaf to the root
+ * is replayed (log2(runs) comparisons per record).
+ *
+ * All runs share one temporary file which is unlinked
+ * right after creation, so nothing is left behind
+ * when the process dies.
+ * ========================================================================
+ */
+#ifndef nowdb_xsort_decl
+#define nowdb_xsort_decl
+
+#include <nowdb/types/types.h>
+#include <nowdb/types/error.h>
+#include <nowdb/io/dir.h>
+#include <nowdb/io/file.h>
+#include <nowdb/sort/sort.h>
+
+#include <stdio.h>
+
+/* ------------------------------------------------------------------------
+ * Block size in the temporary file (uncompressed)
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_XSORT_BLOCK 65536
+
+/* ------------------------------------------------------------------------
+ * Sorted run
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	uint64_t    start; /* first byte of the run in the file */
+	uint64_t      end; /* end of the run in the file        */
+	uint64_t      pos; /* next block to read                */
+	char         *blk; /* current block                     */
+	uint32_t     size; /* bytes in current block            */
+	uint32_t      off; /* current record in block           */
+	char          mem; /* run is kept in memory             */
+	char         done; /* run is exhausted                  */
+} nowdb_xsort_run_t;
+
+/* ------------------------------------------------------------------------
+ * External sort
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	nowdb_comprsc_t   compare; /* compare records                */
+	void                *args; /* arguments for compare          */
+	nowdb_path_t         path; /* directory for temporary file   */
+	FILE                 *tmp; /* temporary file                 */
+	char                 *buf; /* current run                    */
+	char                *zbuf; /* compressed block               */
+	nowdb_xsort_run_t   *runs; /* sorted runs                    */
+	uint32_t            *tree; /* loser tree                     */
+	uint64_t            runsz; /* max bytes per run              */
+	uint64_t             size; /* bytes in current run           */
+	uint64_t            fsize; /* bytes written to temporary file */
+	uint64_t            total; /* records added                  */
+	uint32_t            nruns; /* number of runs                 */
+	uint32_t          maxruns; /* runs allocated                 */
+	uint32_t          recsize; /* record size                    */
+	uint32_t            blksz; /* bytes per block                */
+	uint32_t              zsz; /* size of compression buffer     */
+	nowdb_comp_t         comp; /* codec for temporary file       */
+	char             finished; /* no more records will be added  */
+} nowdb_xsort_t;
+
+/* ------------------------------------------------------------------------
+ * Allocate and initialise a new external sort
+ * -------------------------------------------
+ * - path   : directory for the temporary file
+ *            (if NULL, the system's temporary directory is used)
+ * - comp   : codec for the temporary file
+ *            (NOWDB_COMP_FLAT, NOWDB_COMP_ZSTD or NOWDB_COMP_LZ4)
+ * - recsize: record size
+ * - runsz  : max memory (in bytes) used for one run
+ * - compare: compare function (as for nowdb_mem_sort)
+ * - args   : arguments passed to compare
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_xsort_new(nowdb_xsort_t   **xs,
+                            nowdb_path_t    path,
+                            nowdb_comp_t    comp,
+                            uint32_t     recsize,
+                            uint64_t       runsz,
+                            nowdb_comprsc_t compare,
+                            void           *args);
+
+/* ------------------------------------------------------------------------
+ * Destroy external sort (closes the temporary file)
+ * ------------------------------------------------------------------------
+ */
+void nowdb_xsort_destroy(nowdb_xsort_t *xs);
+
+/* ------------------------------------------------------------------------
+ * Add a record
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_xsort_add(nowdb_xsort_t *xs, char *record);
+
+/* ------------------------------------------------------------------------
+ * Finish
+ * ------
+ * Sorts the last run and positions the merge on the first record.
+ * No records can be added afterwards.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_xsort_finish(nowdb_xsort_t *xs);
+
+/* ------------------------------------------------------------------------
+ * Top
+ * ---
+ * Returns the current (smallest remaining) record
+ * or NULL if all records have been consumed.
+ * The record is valid until the next call to pop or rewind.
+ * ------------------------------------------------------------------------
+ */
+char *nowdb_xsort_top(nowdb_xsort_t *xs);
+
+/* ------------------------------------------------------------------------
+ * Pop
+ * ---
+ * Consumes the current record.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_xsort_pop(nowdb_xsort_t *xs);
+
+/* ------------------------------------------------------------------------
+ * Rewind
+ * ------
+ * Restarts the merge from the first record.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_xsort_rewind(nowdb_xsort_t *xs);
+
+#endif
@@ -73,7 +73,7 @@ int nowdb_ast_init(nowdb_ast_t *n, int ntype, int stype) {
 	case NOWDB_AST_DDL:
 	case NOWDB_AST_DLL:
 	case NOWDB_AST_DML: ASTCALLOC(1);
-	case NOWDB_AST_DQL: ASTCALLOC(5); 
+	case NOWDB_AST_DQL: ASTCALLOC(6); 
 	case NOWDB_AST_MISC: ASTCALLOC(1); 
 
 	case NOWDB_AST_CREATE: ASTCALLOC(5);
@@ -88,7 +88,7 @@ int nowdb_ast_init(nowdb_ast_t *n, int ntype, int stype) {
 	case NOWDB_AST_DELETE: ASTCALLOC(2);
 	case NOWDB_AST_UPDATE: UNDEFINED(ntype);
 
-	case NOWDB_AST_FROM:
+	case NOWDB_AST_FROM: ASTCALLOC(3);
 	case NOWDB_AST_SELECT: ASTCALLOC(2);
 	case NOWDB_AST_WHERE: ASTCALLOC(1);
 	case NOWDB_AST_AND:
@@ -97,11 +97,14 @@ int nowdb_ast_init(nowdb_ast_t *n, int ntype, int stype) {
 	case NOWDB_AST_JUST: ASTCALLOC(1);
 	case NOWDB_AST_GROUP:  
 	case NOWDB_AST_ORDER: ASTCALLOC(1); 
-	case NOWDB_AST_JOIN: UNDEFINED(ntype); 
+	case NOWDB_AST_LIMIT: ASTCALLOC(1);
+	case NOWDB_AST_OFFSET: ASTCALLOC(0);
+	case NOWDB_AST_JOIN: ASTCALLOC(1);
+	case NOWDB_AST_TRAVERSE: ASTCALLOC(1);
 
 	case NOWDB_AST_COMPARE: ASTCALLOC(2);
 
-	case NOWDB_AST_FIELD: ASTCALLOC(1);
+	case NOWDB_AST_FIELD: ASTCALLOC(2);
 	case NOWDB_AST_VALUE: ASTCALLOC(1);
 	case NOWDB_AST_DECL: ASTCALLOC(3);
 	case NOWDB_AST_DESTIN: ASTCALLOC(1);
@@ -115,6 +118,7 @@ int nowdb_ast_init(nowdb_ast_t *n, int ntype, int stype) {
 	case NOWDB_AST_EXEC: ASTCALLOC(1);
 	case NOWDB_AST_LOCK: ASTCALLOC(2);
 	case NOWDB_AST_UNLOCK: ASTCALLOC(2);
+	case NOWDB_AST_SET: ASTCALLOC(0);
 
 	case NOWDB_AST_TARGET: ASTCALLOC(2);
 	case NOWDB_AST_ALIAS: ASTCALLOC(0);
@@ -167,8 +171,15 @@ static inline char *tellType(int ntype, int stype) {
 	case NOWDB_AST_NOT: return "not";
 	case NOWDB_AST_JUST: return "just";
 	case NOWDB_AST_GROUP:  return "group";
-	case NOWDB_AST_ORDER:  return "order";
+	case NOWDB_AST_ORDER:
+		switch(stype) {
+		case NOWDB_AST_DESCENDING: return "order (desc)";
+		default: return "order";
+		}
+	case NOWDB_AST_LIMIT:  return "limit";
+	case NOWDB_AST_OFFSET: return "offset";
 	case NOWDB_AST_JOIN: return "join";
+	case NOWDB_AST_TRAVERSE: return "traverse";
 
 	case NOWDB_AST_FIELD: 
 		if (stype == NOWDB_AST_PARAM) {
@@ -177,7 +188,12 @@ static inline char *tellType(int ntype, int stype) {
 			return "field"; 
 		}
 
-	case NOWDB_AST_FUN: return "function"; 
+	case NOWDB_AST_FUN:
+		if (stype == NOWDB_AST_DISTINCT) {
+			return "function (distinct)";
+		} else {
+			return "function";
+		}
 	case NOWDB_AST_OP: return "operator"; 
 
 	case NOWDB_AST_VALUE:
@@ -212,6 +228,11 @@ static inline char *tellType(int ntype, int stype) {
 	case NOWDB_AST_EXEC: return "execute";
 	case NOWDB_AST_LOCK: return "lock";
 	case NOWDB_AST_UNLOCK: return "unlock";
+	case NOWDB_AST_SET:
+		switch(stype) {
+		case NOWDB_AST_PARALLEL: return "set parallel";
+		default: return "set unknown option";
+		}
 
 	case NOWDB_AST_TARGET:
 		switch(stype) {
@@ -249,6 +270,8 @@ static inline char *tellType(int ntype, int stype) {
 		case NOWDB_AST_SORT: return "option sort";
 		case NOWDB_AST_COMP: return "option comp";
 		case NOWDB_AST_ENCP: return "option encp";
+		case NOWDB_AST_ENCODING: return "option encoding";
+		case NOWDB_AST_READAHEAD: return "option read-ahead";
 		case NOWDB_AST_STRESS: return "option stress";
 		case NOWDB_AST_DISK: return "option disk";
 		case NOWDB_AST_IFEXISTS: return "if (not) exists";
@@ -423,6 +446,7 @@ static inline int ad3ql(nowdb_ast_t *n,
 	case NOWDB_AST_OR: ADDKID(2);
 	case NOWDB_AST_GROUP: ADDKID(3);
 	case NOWDB_AST_ORDER: ADDKID(4);
+	case NOWDB_AST_LIMIT: ADDKID(5);
 	default: return -1;
 	}
 }
@@ -440,6 +464,7 @@ static inline int addmisc(nowdb_ast_t *n,
 	case NOWDB_AST_EXEC: ADDKID(0);
 	case NOWDB_AST_LOCK: ADDKID(0);
 	case NOWDB_AST_UNLOCK: ADDKID(0);
+	case NOWDB_AST_SET: ADDKID(0);
 	case NOWDB_AST_SELECT: ADDKID(0);
 	default: return -1;
 	}
@@ -574,6 +599,8 @@ static inline int addgroup(nowdb_ast_t *n,
                            nowdb_ast_t *k) {
 	switch(k->ntype) {
 	case NOWDB_AST_FIELD: ADDKID(0);
+	case NOWDB_AST_FUN: ADDKID(0);
+	case NOWDB_AST_OP: ADDKID(0);
 	default: return -1;
 	}
 }
@@ -590,6 +617,18 @@ static inline int addorder(nowdb_ast_t *n,
 	}
 }
 
+/* -----------------------------------------------------------------------
+ * Add kid to a limit node
+ * -----------------------------------------------------------------------
+ */
+static inline int addlimit(nowdb_ast_t *n,
+                           nowdb_ast_t *k) {
+	switch(k->ntype) {
+	case NOWDB_AST_OFFSET: ADDKID(0);
+	default: return -1;
+	}
+}
+
 /* -----------------------------------------------------------------------
  * Add kid to a from node
  * -----------------------------------------------------------------------
@@ -598,6 +637,35 @@ static inline int addfrom(nowdb_ast_t *n,
                           nowdb_ast_t *k) {
 	switch(k->ntype) {
 	case NOWDB_AST_TARGET: ADDKID(0);
+	case NOWDB_AST_JOIN: ADDKID(1);
+	case NOWDB_AST_TRAVERSE: ADDKID(2);
+	default: return -1;
+	}
+}
+
+/* -----------------------------------------------------------------------
+ * Add kid to a join node
+ * -----------------------------------------------------------------------
+ */
+static inline int addjoin(nowdb_ast_t *n,
+                          nowdb_ast_t *k) {
+	switch(k->ntype) {
+	case NOWDB_AST_FIELD:
+	case NOWDB_AST_FUN:
+	case NOWDB_AST_OP:
+	case NOWDB_AST_VALUE: ADDKID(0);
+	default: return -1;
+	}
+}
+
+/* -----------------------------------------------------------------------
+ * Add kid to a traverse node
+ * -----------------------------------------------------------------------
+ */
+static inline int addtrav(nowdb_ast_t *n,
+                          nowdb_ast_t *k) {
+	switch(k->ntype) {
+	case NOWDB_AST_VALUE: ADDKID(0);
 	default: return -1;
 	}
 }
@@ -698,6 +766,7 @@ static inline int addfield(nowdb_ast_t *n,
 	case NOWDB_AST_FUN: ADDKID(0);
 	case NOWDB_AST_OP: ADDKID(0);
 	case NOWDB_AST_VALUE: ADDKID(0);
+	case NOWDB_AST_ALIAS: ADDKID(1);
 	default: return -1;
 	}
 }
@@ -850,7 +919,9 @@ int nowdb_ast_add(nowdb_ast_t *n, nowdb_ast_t *k) {
 	case NOWDB_AST_JUST: return addnot(n,k);
 	case NOWDB_AST_GROUP: return addgroup(n,k);
 	case NOWDB_AST_ORDER: return addorder(n,k);
-	case NOWDB_AST_JOIN:  return -1;
+	case NOWDB_AST_LIMIT: return addlimit(n,k);
+	case NOWDB_AST_JOIN:  return addjoin(n,k);
+	case NOWDB_AST_TRAVERSE: return addtrav(n,k);
 
 	case NOWDB_AST_COMPARE: return addcompare(n,k);
 
@@ -999,6 +1070,75 @@ nowdb_ast_t *nowdb_ast_target(nowdb_ast_t *ast) {
 	}
 }
 
+/* -----------------------------------------------------------------------
+ * Get join
+ * -----------------------------------------------------------------------
+ */
+nowdb_ast_t *nowdb_ast_join(nowdb_ast_t *ast) {
+	if (ast == NULL) return NULL;
+	switch(ast->ntype) {
+	case NOWDB_AST_DQL: return nowdb_ast_join(
+	                           nowdb_ast_from(ast));
+	case NOWDB_AST_FROM: return ast->kids[1];
+	default: return NULL;
+	}
+}
+
+/* -----------------------------------------------------------------------
+ * Get traversal
+ * -----------------------------------------------------------------------
+ */
+nowdb_ast_t *nowdb_ast_traverse(nowdb_ast_t *ast) {
+	if (ast == NULL) return NULL;
+	switch(ast->ntype) {
+	case NOWDB_AST_DQL: return nowdb_ast_traverse(
+	                           nowdb_ast_from(ast));
+	case NOWDB_AST_FROM: return ast->kids[2];
+	default: return NULL;
+	}
+}
+
+/* -----------------------------------------------------------------------
+ * Get alias
+ * -----------------------------------------------------------------------
+ */
+nowdb_ast_t *nowdb_ast_alias(nowdb_ast_t *ast) {
+	if (ast == NULL) return NULL;
+	switch(ast->ntype) {
+	case NOWDB_AST_TARGET:
+	case NOWDB_AST_FIELD: return ast->kids[1];
+	default: return NULL;
+	}
+}
+
+/* -----------------------------------------------------------------------
+ * Make the sub-target an alias
+ * -----------------------------------------------------------------------
+ */
+int nowdb_ast_subToAlias(nowdb_ast_t *ast) {
+	nowdb_ast_t *sub, *a;
+
+	if (ast == NULL) return -1;
+	if (ast->ntype != NOWDB_AST_TARGET) return -1;
+
+	sub = ast->kids[0];
+	if (sub == NULL) return 0;
+	if (ast->kids[1] != NULL) return -1;
+	if (sub->kids[0] != NULL || sub->kids[1] != NULL) return -1;
+
+	a = nowdb_ast_create(NOWDB_AST_ALIAS, 0);
+	if (a == NULL) return -1;
+
+	a->vtype = sub->vtype;
+	a->isstr = sub->isstr;
+	a->value = sub->value; sub->value = NULL;
+
+	nowdb_ast_destroyAndFree(sub);
+	ast->kids[0] = NULL;
+	ast->kids[1] = a;
+	return 0;
+}
+
 /* -----------------------------------------------------------------------
  * Get 'on'
  * -----------------------------------------------------------------------
@@ -1010,6 +1150,7 @@ nowdb_ast_t *nowdb_ast_on(nowdb_ast_t *ast) {
 	                           nowdb_ast_operation(ast));
 
 	case NOWDB_AST_CREATE: return ast->kids[2];
+	case NOWDB_AST_JOIN: return ast->kids[0];
 
 	default: return NULL;
 	}
@@ -1048,6 +1189,7 @@ nowdb_ast_t *nowdb_ast_value(nowdb_ast_t *ast) {
 	switch(ast->ntype) {
 	case NOWDB_AST_INSERT: return ast->kids[1];
 	case NOWDB_AST_VALUE: return ast->kids[0];
+	case NOWDB_AST_TRAVERSE: return ast->kids[0];
 	default: return NULL;
 	}
 }
@@ -1111,6 +1253,24 @@ nowdb_ast_t *nowdb_ast_order(nowdb_ast_t *ast) {
 	return ast->kids[4];
 }
 
+/* -----------------------------------------------------------------------
+ * Get limit
+ * -----------------------------------------------------------------------
+ */
+nowdb_ast_t *nowdb_ast_limit(nowdb_ast_t *ast) {
+	if (ast->ntype != NOWDB_AST_DQL) return NULL;
+	return ast->kids[5];
+}
+
+/* -----------------------------------------------------------------------
+ * Get offset
+ * -----------------------------------------------------------------------
+ */
+nowdb_ast_t *nowdb_ast_offset(nowdb_ast_t *ast) {
+	if (ast->ntype != NOWDB_AST_LIMIT) return NULL;
+	return ast->kids[0];
+}
+
 /* -----------------------------------------------------------------------
  * Get from
  * -----------------------------------------------------------------------
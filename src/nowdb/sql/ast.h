@@ -121,6 +121,34 @@
 #define NOWDB_AST_JOIN   4010
 #define NOWDB_AST_STAR   4011
 
+/* -----------------------------------------------------------------------
+ * DQL Limit and Order:
+ * - limit (value: number of rows)
+ * - offset (kid of limit, value: rows to skip)
+ * - ascending/descending (stype of order)
+ * -----------------------------------------------------------------------
+ */
+#define NOWDB_AST_LIMIT       4012
+#define NOWDB_AST_OFFSET      4013
+#define NOWDB_AST_ASCENDING   4014
+#define NOWDB_AST_DESCENDING  4015
+
+/* -----------------------------------------------------------------------
+ * DQL Functions:
+ * - distinct (stype of fun, e.g. count(distinct x))
+ * -----------------------------------------------------------------------
+ */
+#define NOWDB_AST_DISTINCT    4016
+
+/* -----------------------------------------------------------------------
+ * DQL From:
+ * - traverse (value: hop limit,
+ *             stype: origin or destin, the end of the start vertices;
+ *             the start vertices are the values below)
+ * -----------------------------------------------------------------------
+ */
+#define NOWDB_AST_TRAVERSE    4017
+
 /* -----------------------------------------------------------------------
  * Micellaneous
  * ------------
@@ -134,6 +162,7 @@
 #define NOWDB_AST_EXEC   5004
 #define NOWDB_AST_LOCK   5005
 #define NOWDB_AST_UNLOCK 5006
+#define NOWDB_AST_SET    5007
 
 /* -----------------------------------------------------------------------
  * Generic targets
@@ -181,10 +210,13 @@
 #define NOWDB_AST_DESTIN   10213
 #define NOWDB_AST_STAMP    10214
 #define NOWDB_AST_INC      10215
+#define NOWDB_AST_ENCODING 10216
+#define NOWDB_AST_READAHEAD 10217
 #define NOWDB_AST_LANG     10220
 #define NOWDB_AST_ERRORS   10221
 #define NOWDB_AST_MODE     10222
 #define NOWDB_AST_TIMEOUT  10223
+#define NOWDB_AST_PARALLEL 10224
 
 /* -----------------------------------------------------------------------
  * IFEXISTS is a special option for create and drop:
@@ -367,6 +399,32 @@ nowdb_ast_t *nowdb_ast_target(nowdb_ast_t *node);
  */
 nowdb_ast_t *nowdb_ast_on(nowdb_ast_t *node);
 
+/* -----------------------------------------------------------------------
+ * Get join (the joined target is the sub-target of the target;
+ *           the join holds the 'on' condition)
+ * -----------------------------------------------------------------------
+ */
+nowdb_ast_t *nowdb_ast_join(nowdb_ast_t *node);
+
+/* -----------------------------------------------------------------------
+ * Get traversal (the start vertices are the values below)
+ * -----------------------------------------------------------------------
+ */
+nowdb_ast_t *nowdb_ast_traverse(nowdb_ast_t *node);
+
+/* -----------------------------------------------------------------------
+ * Get alias of a target or qualifier of a field
+ * -----------------------------------------------------------------------
+ */
+nowdb_ast_t *nowdb_ast_alias(nowdb_ast_t *node);
+
+/* -----------------------------------------------------------------------
+ * Make the sub-target of a target its alias ('edge e');
+ * returns 0 if there is no sub-target.
+ * -----------------------------------------------------------------------
+ */
+int nowdb_ast_subToAlias(nowdb_ast_t *node);
+
 /* -----------------------------------------------------------------------
  * Get an option from the current AST node
  * if option is 0, the first option found is returned,
@@ -411,6 +469,18 @@ nowdb_ast_t *nowdb_ast_group(nowdb_ast_t *node);
  */
 nowdb_ast_t *nowdb_ast_order(nowdb_ast_t *node);
 
+/* -----------------------------------------------------------------------
+ * Get the limit clause from the current AST node (DQL only)
+ * -----------------------------------------------------------------------
+ */
+nowdb_ast_t *nowdb_ast_limit(nowdb_ast_t *node);
+
+/* -----------------------------------------------------------------------
+ * Get the offset from the current AST node (limit only)
+ * -----------------------------------------------------------------------
+ */
+nowdb_ast_t *nowdb_ast_offset(nowdb_ast_t *node);
+
 /* -----------------------------------------------------------------------
  * Get field list from the current AST node
  * -----------------------------------------------------------------------
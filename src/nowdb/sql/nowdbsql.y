@@ -135,6 +135,9 @@
 %type order_clause {nowdb_ast_t*}
 %destructor order_clause {nowdb_ast_destroyAndFree($$);}
 
+%type limit_clause {nowdb_ast_t*}
+%destructor limit_clause {nowdb_ast_destroyAndFree($$);}
+
 %type stress_spec {nowdb_ast_t*}
 %destructor stress_spec {nowdb_ast_destroyAndFree($$);}
 
@@ -165,6 +168,9 @@
 %type table_spec {nowdb_ast_t*}
 %destructor table_spec {nowdb_ast_destroyAndFree($$);}
 
+%type qualified {char*}
+%destructor qualified {free($$);}
+
 %type dml_target {nowdb_ast_t*}
 %destructor dml_target {nowdb_ast_destroyAndFree($$);}
 
@@ -205,7 +211,8 @@
 }
 
 %fallback IDENTIFIER
-          ORIGIN DESTINATION TIMESTAMP .
+          ORIGIN DESTINATION TIMESTAMP ENCODING READAHEAD PARALLEL
+          LIMIT OFFSET ASC DESCENDING DISTINCT .
 
 /* ------------------------------------------------------------------------
  * An SQL statement is either
@@ -317,36 +324,36 @@ dml ::= INSERT INTO dml_target(T) VALUES LPAR expr_list(V) RPAR. {
  * DQL
  * ------------------------------------------------------------------------
  */
-dql ::= projection_clause(P) from_clause(F). {
-	NOWDB_SQL_MAKE_DQL(P,F,NULL,NULL,NULL);
+dql ::= projection_clause(P) from_clause(F) limit_clause(L). {
+	NOWDB_SQL_MAKE_DQL(P,F,NULL,NULL,NULL,L);
 }
 
-dql ::= projection_clause(P) from_clause(F) where_clause(W). {
-	NOWDB_SQL_MAKE_DQL(P,F,W,NULL,NULL);
+dql ::= projection_clause(P) from_clause(F) where_clause(W) limit_clause(L). {
+	NOWDB_SQL_MAKE_DQL(P,F,W,NULL,NULL,L);
 }
 
-dql ::= projection_clause(P) from_clause(F) where_clause(W) group_clause(G). {
-	NOWDB_SQL_MAKE_DQL(P,F,W,G,NULL);
+dql ::= projection_clause(P) from_clause(F) where_clause(W) group_clause(G) limit_clause(L). {
+	NOWDB_SQL_MAKE_DQL(P,F,W,G,NULL,L);
 }
 
-dql ::= projection_clause(P) from_clause(F) where_clause(W) order_clause(O). {
-	NOWDB_SQL_MAKE_DQL(P,F,W,NULL,O);
+dql ::= projection_clause(P) from_clause(F) where_clause(W) order_clause(O) limit_clause(L). {
+	NOWDB_SQL_MAKE_DQL(P,F,W,NULL,O,L);
 }
 
-dql ::= projection_clause(P) from_clause(F) where_clause(W) group_clause(G) order_clause(O). {
-	NOWDB_SQL_MAKE_DQL(P,F,W,G,O);
+dql ::= projection_clause(P) from_clause(F) where_clause(W) group_clause(G) order_clause(O) limit_clause(L). {
+	NOWDB_SQL_MAKE_DQL(P,F,W,G,O,L);
 }
 
-dql ::= projection_clause(P) from_clause(F) group_clause(G). {
-	NOWDB_SQL_MAKE_DQL(P,F,NULL,G,NULL);
+dql ::= projection_clause(P) from_clause(F) group_clause(G) limit_clause(L). {
+	NOWDB_SQL_MAKE_DQL(P,F,NULL,G,NULL,L);
 }
 
-dql ::= projection_clause(P) from_clause(F) order_clause(O). {
-	NOWDB_SQL_MAKE_DQL(P,F,NULL,NULL,O);
+dql ::= projection_clause(P) from_clause(F) order_clause(O) limit_clause(L). {
+	NOWDB_SQL_MAKE_DQL(P,F,NULL,NULL,O,L);
 }
 
-dql ::= projection_clause(P) from_clause(F) group_clause(G) order_clause(O). {
-	NOWDB_SQL_MAKE_DQL(P,F,NULL,G,O);
+dql ::= projection_clause(P) from_clause(F) group_clause(G) order_clause(O) limit_clause(L). {
+	NOWDB_SQL_MAKE_DQL(P,F,NULL,G,O,L);
 }
 
 /* ------------------------------------------------------------------------
@@ -362,6 +369,9 @@ misc ::= FETCH UINTEGER(I). {
 misc ::= CLOSE UINTEGER(I). {
 	NOWDB_SQL_MAKE_CLOSE(I);	
 }
+misc ::= SET PARALLEL EQ UINTEGER(I). {
+	NOWDB_SQL_MAKE_SET(NOWDB_AST_PARALLEL, I);
+}
 misc ::= projection_clause(P). {
 	NOWDB_SQL_MAKE_SELECT(P);
 }
@@ -649,6 +659,16 @@ storage_option(O) ::= ENCRYPTION EQ STRING(I). {
 	NOWDB_SQL_CREATEAST(&O, NOWDB_AST_OPTION, NOWDB_AST_ENCP);
 	nowdb_ast_setValue(O, NOWDB_AST_V_STRING, I);
 }
+storage_option(O) ::= ENCODING EQ STRING(I). {
+	NOWDB_SQL_CHECKSTATE();
+	NOWDB_SQL_CREATEAST(&O, NOWDB_AST_OPTION, NOWDB_AST_ENCODING);
+	nowdb_ast_setValue(O, NOWDB_AST_V_STRING, I);
+}
+storage_option(O) ::= READAHEAD EQ UINTEGER(I). {
+	NOWDB_SQL_CHECKSTATE();
+	NOWDB_SQL_CREATEAST(&O, NOWDB_AST_OPTION, NOWDB_AST_READAHEAD);
+	nowdb_ast_setValue(O, NOWDB_AST_V_STRING, I);
+}
 
 storage_option(O) ::= STRESS EQ stress_spec(S). {
 	NOWDB_SQL_CHECKSTATE();
@@ -818,11 +838,94 @@ from_clause(F) ::= FROM table_list(T). {
 	NOWDB_SQL_ADDKID(F, T);
 }
 
+/* ------------------------------------------------------------------------
+ * join: edge JOIN vertex ON condition
+ * note that 'edge e' is read as table list;
+ * the second table becomes the alias of the first.
+ * The joined table is the sub-target of the first one;
+ * the join node holds the condition.
+ * ------------------------------------------------------------------------
+ */
+from_clause(F) ::= FROM table_list(T) JOIN table_spec(V) ON expr(C). {
+	NOWDB_SQL_CHECKSTATE();
+	nowdb_ast_t *j;
+	if (nowdb_ast_subToAlias(T) != 0) {
+		nowdbres->errcode = NOWDB_SQL_ERR_SYNTAX;
+		nowdbsql_errmsg(nowdbres, "only one table may be joined",
+		                                              (char*)T->value);
+		nowdb_ast_destroyAndFree(T);
+		nowdb_ast_destroyAndFree(V);
+		nowdb_ast_destroyAndFree(C);
+		return;
+	}
+	NOWDB_SQL_CREATEAST(&F, NOWDB_AST_FROM, 0);
+	NOWDB_SQL_ADDKID(T, V);
+	NOWDB_SQL_ADDKID(F, T);
+	NOWDB_SQL_CREATEAST(&j, NOWDB_AST_JOIN, 0);
+	NOWDB_SQL_ADDKID(j, C);
+	NOWDB_SQL_ADDKID(F, j);
+}
+
+from_clause(F) ::= FROM table_list(T) JOIN IDENTIFIER(I) IDENTIFIER(A) ON expr(C). {
+	NOWDB_SQL_CHECKSTATE();
+	nowdb_ast_t *j, *v, *a;
+	if (nowdb_ast_subToAlias(T) != 0) {
+		nowdbres->errcode = NOWDB_SQL_ERR_SYNTAX;
+		nowdbsql_errmsg(nowdbres, "only one table may be joined",
+		                                              (char*)T->value);
+		nowdb_ast_destroyAndFree(T);
+		nowdb_ast_destroyAndFree(C);
+		free(I); free(A);
+		return;
+	}
+	NOWDB_SQL_CREATEAST(&F, NOWDB_AST_FROM, 0);
+	NOWDB_SQL_CREATEAST(&v, NOWDB_AST_TARGET, NOWDB_AST_CONTEXT);
+	nowdb_ast_setValue(v, NOWDB_AST_V_STRING, I);
+	NOWDB_SQL_CREATEAST(&a, NOWDB_AST_ALIAS, 0);
+	nowdb_ast_setValue(a, NOWDB_AST_V_STRING, A);
+	NOWDB_SQL_ADDKID(v, a);
+	NOWDB_SQL_ADDKID(T, v);
+	NOWDB_SQL_ADDKID(F, T);
+	NOWDB_SQL_CREATEAST(&j, NOWDB_AST_JOIN, 0);
+	NOWDB_SQL_ADDKID(j, C);
+	NOWDB_SQL_ADDKID(F, j);
+}
+
+/* ------------------------------------------------------------------------
+ * traversal: edge TRAVERSE hops FROM ORIGIN|DESTINATION IN (vertices)
+ * The start vertices are origins (the edges are followed
+ * from origin to destination) or destinations (the edges
+ * are followed the other way round). The hop limit is the value
+ * of the traverse node, the start vertices are its kids.
+ * ------------------------------------------------------------------------
+ */
+from_clause(F) ::= FROM table_spec(T) TRAVERSE UINTEGER(H) FROM ORIGIN IN LPAR val_list(V) RPAR. {
+	NOWDB_SQL_CHECKSTATE();
+	nowdb_ast_t *t;
+	NOWDB_SQL_CREATEAST(&F, NOWDB_AST_FROM, 0);
+	NOWDB_SQL_ADDKID(F, T);
+	NOWDB_SQL_CREATEAST(&t, NOWDB_AST_TRAVERSE, NOWDB_AST_ORIGIN);
+	nowdb_ast_setValue(t, NOWDB_AST_V_STRING, H);
+	NOWDB_SQL_ADDKID(t, V);
+	NOWDB_SQL_ADDKID(F, t);
+}
+
+from_clause(F) ::= FROM table_spec(T) TRAVERSE UINTEGER(H) FROM DESTINATION IN LPAR val_list(V) RPAR. {
+	NOWDB_SQL_CHECKSTATE();
+	nowdb_ast_t *t;
+	NOWDB_SQL_CREATEAST(&F, NOWDB_AST_FROM, 0);
+	NOWDB_SQL_ADDKID(F, T);
+	NOWDB_SQL_CREATEAST(&t, NOWDB_AST_TRAVERSE, NOWDB_AST_DESTIN);
+	nowdb_ast_setValue(t, NOWDB_AST_V_STRING, H);
+	NOWDB_SQL_ADDKID(t, V);
+	NOWDB_SQL_ADDKID(F, t);
+}
+
 /* ------------------------------------------------------------------------
  * group clause
  * ------------------------------------------------------------------------
  */
-group_clause(G) ::= GROUP BY field_list(F). {
+group_clause(G) ::= GROUP BY expr_list(F). {
 	NOWDB_SQL_CREATEAST(&G, NOWDB_AST_GROUP, 0);
 	NOWDB_SQL_ADDKID(G,F);
 }
@@ -835,6 +938,36 @@ order_clause(O) ::= ORDER BY field_list(F). {
 	NOWDB_SQL_CREATEAST(&O, NOWDB_AST_ORDER, 0);
 	NOWDB_SQL_ADDKID(O,F);
 }
+order_clause(O) ::= ORDER BY field_list(F) ASC. {
+	NOWDB_SQL_CREATEAST(&O, NOWDB_AST_ORDER, NOWDB_AST_ASCENDING);
+	NOWDB_SQL_ADDKID(O,F);
+}
+order_clause(O) ::= ORDER BY field_list(F) DESCENDING. {
+	NOWDB_SQL_CREATEAST(&O, NOWDB_AST_ORDER, NOWDB_AST_DESCENDING);
+	NOWDB_SQL_ADDKID(O,F);
+}
+
+/* ------------------------------------------------------------------------
+ * limit clause (optional)
+ * ------------------------------------------------------------------------
+ */
+limit_clause(L) ::= . {
+	L = NULL;
+}
+limit_clause(L) ::= LIMIT UINTEGER(I). {
+	NOWDB_SQL_CHECKSTATE();
+	NOWDB_SQL_CREATEAST(&L, NOWDB_AST_LIMIT, 0);
+	nowdb_ast_setValue(L, NOWDB_AST_V_STRING, I);
+}
+limit_clause(L) ::= LIMIT UINTEGER(I) OFFSET UINTEGER(N). {
+	nowdb_ast_t *o;
+	NOWDB_SQL_CHECKSTATE();
+	NOWDB_SQL_CREATEAST(&L, NOWDB_AST_LIMIT, 0);
+	nowdb_ast_setValue(L, NOWDB_AST_V_STRING, I);
+	NOWDB_SQL_CREATEAST(&o, NOWDB_AST_OFFSET, 0);
+	nowdb_ast_setValue(o, NOWDB_AST_V_STRING, N);
+	NOWDB_SQL_ADDKID(L,o);
+}
 
 /* ------------------------------------------------------------------------
  * expression
@@ -1035,6 +1168,12 @@ fun(F) ::= IDENTIFIER(I) LPAR expr_list(L) RPAR. {
 	NOWDB_SQL_ADDPARAM(F,L);
 }
 
+fun(F) ::= IDENTIFIER(I) LPAR DISTINCT expr(E) RPAR. {
+	NOWDB_SQL_CREATEAST(&F, NOWDB_AST_FUN, NOWDB_AST_DISTINCT);
+	nowdb_ast_setValue(F, NOWDB_AST_V_STRING, I);
+	NOWDB_SQL_ADDPARAM(F,E);
+}
+
 fun(F) ::= IDENTIFIER(I) LPAR RPAR. {
 	NOWDB_SQL_CREATEAST(&F, NOWDB_AST_FUN, 0);
 	nowdb_ast_setValue(F, NOWDB_AST_V_STRING, I);
@@ -1134,6 +1273,27 @@ field(F) ::= TIMESTAMP(I). {
 	NOWDB_SQL_CREATEAST(&F, NOWDB_AST_FIELD, 0);
 	nowdb_ast_setValue(F, NOWDB_AST_V_STRING, I);
 }
+field(F) ::= IDENTIFIER(Q) DOT qualified(I). {
+	NOWDB_SQL_CHECKSTATE();
+	nowdb_ast_t *a;
+	NOWDB_SQL_CREATEAST(&F, NOWDB_AST_FIELD, 0);
+	nowdb_ast_setValue(F, NOWDB_AST_V_STRING, I);
+	NOWDB_SQL_CREATEAST(&a, NOWDB_AST_ALIAS, 0);
+	nowdb_ast_setValue(a, NOWDB_AST_V_STRING, Q);
+	NOWDB_SQL_ADDKID(F, a);
+}
+qualified(Q) ::= IDENTIFIER(I). {
+	Q=I;
+}
+qualified(Q) ::= ORIGIN(I). {
+	Q=I;
+}
+qualified(Q) ::= DESTINATION(I). {
+	Q=I;
+}
+qualified(Q) ::= TIMESTAMP(I). {
+	Q=I;
+}
 value(V) ::= STRING(S). {
 	NOWDB_SQL_CHECKSTATE();
 	NOWDB_SQL_CREATEAST(&V, NOWDB_AST_VALUE, NOWDB_AST_TEXT);
@@ -202,9 +202,10 @@ typedef struct {
  * - W: ast representing WHERE
  * - G: ast representing GROUP BY
  * - O: ast representing ORDER BY
+ * - L: ast representing LIMIT
  * ------------------------------------------------------------------------
  */
-#define NOWDB_SQL_MAKE_DQL(P,F,W,G,O) \
+#define NOWDB_SQL_MAKE_DQL(P,F,W,G,O,L) \
 	NOWDB_SQL_CHECKSTATE(); \
 	nowdb_ast_t *d; \
 	NOWDB_SQL_CREATEAST(&d, NOWDB_AST_DQL, 0); \
@@ -219,6 +220,9 @@ typedef struct {
 	if (O != NULL) { \
 		NOWDB_SQL_ADDKID(d, O); \
 	} \
+	if (L != NULL) { \
+		NOWDB_SQL_ADDKID(d, L); \
+	} \
 	nowdbsql_state_pushAst(nowdbres, d);
 
 /* ------------------------------------------------------------------------
@@ -269,6 +273,23 @@ typedef struct {
 	NOWDB_SQL_ADDKID(m, c); \
 	nowdbsql_state_pushAst(nowdbres, m);
 
+/* ------------------------------------------------------------------------
+ * Make a MISC statement representing 'SET' (session option)
+ * Parameters:
+ * - o: the option
+ * - u: the value
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_SQL_MAKE_SET(o,u) \
+	NOWDB_SQL_CHECKSTATE(); \
+	nowdb_ast_t *s; \
+	nowdb_ast_t *m; \
+	NOWDB_SQL_CREATEAST(&s, NOWDB_AST_SET, o); \
+	nowdb_ast_setValue(s, NOWDB_AST_V_STRING, u); \
+	NOWDB_SQL_CREATEAST(&m, NOWDB_AST_MISC, 0); \
+	NOWDB_SQL_ADDKID(m, s); \
+	nowdbsql_state_pushAst(nowdbres, m);
+
 /* ------------------------------------------------------------------------
  * Make a MISC statement representing an isolated 'SELECT'
  * Parameters:
@@ -0,0 +1,470 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Interval tree over files: finding the files of a period
+ * ========================================================================
+ */
+#include <nowdb/store/itree.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+static char *OBJECT = "itree";
+
+#define INITSIZE 64
+
+typedef nowdb_itree_node_t node_t;
+
+/* ------------------------------------------------------------------------
+ * Initialise an already allocated interval tree
+ * ------------------------------------------------------------------------
+ */
+void nowdb_itree_init(nowdb_itree_t *tree) {
+	tree->root = NULL;
+	tree->free = NULL;
+	tree->next = NULL;
+	tree->avail = 0;
+	tree->blocks = NULL;
+	tree->nblocks = 0;
+	tree->count = 0;
+	tree->size = 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Destroy interval tree
+ * ------------------------------------------------------------------------
+ */
+void nowdb_itree_destroy(nowdb_itree_t *tree) {
+	if (tree == NULL) return;
+	if (tree->blocks != NULL) {
+		for(uint32_t i=0; i<tree->nblocks; i++) {
+			free(tree->blocks[i]);
+		}
+		free(tree->blocks); tree->blocks = NULL;
+	}
+	tree->root = NULL;
+	tree->free = NULL;
+	tree->next = NULL;
+	tree->avail = 0;
+	tree->nblocks = 0;
+	tree->count = 0;
+	tree->size = 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Make room for n files
+ * The nodes are allocated in blocks and handed out in order;
+ * what is left of the previous block goes to the free list.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_itree_reserve(nowdb_itree_t *tree, uint32_t n) {
+	node_t **blocks;
+	node_t  *block;
+	uint32_t sz;
+
+	if (tree == NULL) return nowdb_err_get(nowdb_err_invalid,
+	                    FALSE, OBJECT, "tree object is NULL");
+	if (n <= tree->size) return NOWDB_OK;
+
+	sz = tree->size == 0 ? INITSIZE : tree->size;
+	while(sz < n) sz *= 2;
+	sz -= tree->size;
+
+	blocks = realloc(tree->blocks, (tree->nblocks+1)*sizeof(node_t*));
+	if (blocks == NULL) return nowdb_err_get(nowdb_err_no_mem,
+	                        FALSE, OBJECT, "allocating blocks");
+	tree->blocks = blocks;
+
+	block = malloc(sz*sizeof(node_t));
+	if (block == NULL) return nowdb_err_get(nowdb_err_no_mem,
+	                         FALSE, OBJECT, "allocating nodes");
+	tree->blocks[tree->nblocks] = block;
+	tree->nblocks++;
+
+	for(; tree->avail>0; tree->avail--) {
+		tree->next->right = tree->free;
+		tree->free = tree->next; tree->next++;
+	}
+	tree->next = block;
+	tree->avail = sz;
+	tree->size += sz;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: take a node from the free list or the current block
+ * ------------------------------------------------------------------------
+ */
+static inline node_t *takeNode(nowdb_itree_t *tree, nowdb_file_t *file) {
+	node_t *n;
+
+	if (tree->free != NULL) {
+		n = tree->free; tree->free = n->right;
+	} else {
+		n = tree->next; tree->next++; tree->avail--;
+	}
+
+	n->left = NULL;
+	n->right = NULL;
+	n->file = file;
+	n->fid = file->id;
+	n->oldest = file->oldest;
+	n->newest = file->newest;
+	n->maxnw = file->newest;
+	n->height = 1;
+
+	return n;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: give a node back to the free list
+ * ------------------------------------------------------------------------
+ */
+static inline void giveNode(nowdb_itree_t *tree, node_t *n) {
+	n->file = NULL;
+	n->left = NULL;
+	n->right = tree->free;
+	tree->free = n;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: (oldest, fid) is before node
+ * ------------------------------------------------------------------------
+ */
+static inline char before(nowdb_time_t oldest,
+                          nowdb_fileid_t  fid,
+                          node_t           *n) {
+	if (oldest < n->oldest) return 1;
+	if (oldest > n->oldest) return 0;
+	return (fid < n->fid);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: height and max newest of a subtree
+ * ------------------------------------------------------------------------
+ */
+#define HEIGHT(n) ((n)==NULL?0:(n)->height)
+#define MAXNW(n) ((n)==NULL?NOWDB_TIME_DAWN:(n)->maxnw)
+
+/* ------------------------------------------------------------------------
+ * Helper: recompute height and max newest from the children
+ * ------------------------------------------------------------------------
+ */
+static inline void update(node_t *n) {
+	int32_t l = HEIGHT(n->left);
+	int32_t r = HEIGHT(n->right);
+
+	n->height = 1 + (l > r ? l : r);
+	n->maxnw = n->newest;
+	if (MAXNW(n->left) > n->maxnw) n->maxnw = MAXNW(n->left);
+	if (MAXNW(n->right) > n->maxnw) n->maxnw = MAXNW(n->right);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: rotations
+ * ------------------------------------------------------------------------
+ */
+static inline node_t *rotateRight(node_t *n) {
+	node_t *l = n->left;
+
+	n->left = l->right;
+	l->right = n;
+	update(n); update(l);
+	return l;
+}
+
+static inline node_t *rotateLeft(node_t *n) {
+	node_t *r = n->right;
+
+	n->right = r->left;
+	r->left = n;
+	update(n); update(r);
+	return r;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: restore the balance of a node whose children are balanced
+ * ------------------------------------------------------------------------
+ */
+static inline node_t *balance(node_t *n) {
+	int32_t bf;
+
+	update(n);
+	bf = HEIGHT(n->left) - HEIGHT(n->right);
+	if (bf > 1) {
+		if (HEIGHT(n->left->left) < HEIGHT(n->left->right)) {
+			n->left = rotateLeft(n->left);
+		}
+		return rotateRight(n);
+	}
+	if (bf < -1) {
+		if (HEIGHT(n->right->right) < HEIGHT(n->right->left)) {
+			n->right = rotateRight(n->right);
+		}
+		return rotateLeft(n);
+	}
+	return n;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: insert node into subtree
+ * ------------------------------------------------------------------------
+ */
+static node_t *insertNode(node_t *root, node_t *n) {
+	if (root == NULL) return n;
+	if (before(n->oldest, n->fid, root)) {
+		root->left = insertNode(root->left, n);
+	} else {
+		root->right = insertNode(root->right, n);
+	}
+	return balance(root);
+}
+
+/* ------------------------------------------------------------------------
+ * Insert file
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_itree_insert(nowdb_itree_t *tree, nowdb_file_t *file) {
+	nowdb_err_t err;
+
+	if (tree == NULL) return nowdb_err_get(nowdb_err_invalid,
+	                    FALSE, OBJECT, "tree object is NULL");
+	if (file == NULL) return nowdb_err_get(nowdb_err_invalid,
+	                    FALSE, OBJECT, "file object is NULL");
+
+	err = nowdb_itree_reserve(tree, tree->count+1);
+	if (err != NOWDB_OK) return err;
+
+	tree->root = insertNode(tree->root, takeNode(tree, file));
+	tree->count++;
+
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: sort key of a file
+ * (we sort the keys, not the files, which are all over the heap)
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	nowdb_time_t  oldest;
+	nowdb_fileid_t   fid;
+	nowdb_file_t   *file;
+} sortkey_t;
+
+/* ------------------------------------------------------------------------
+ * Helper: compare keys for qsort
+ * ------------------------------------------------------------------------
+ */
+static int byOldest(const void *left, const void *right) {
+	const sortkey_t *one = left;
+	const sortkey_t *two = right;
+
+	if (one->oldest < two->oldest) return -1;
+	if (one->oldest > two->oldest) return  1;
+	if (one->fid < two->fid) return -1;
+	if (one->fid > two->fid) return  1;
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: build a balanced tree from sorted keys
+ * ------------------------------------------------------------------------
+ */
+static node_t *build(nowdb_itree_t *tree,
+                     sortkey_t *keys,
+                     uint32_t lo, uint32_t hi) {
+	node_t  *n;
+	uint32_t m;
+
+	if (lo >= hi) return NULL;
+	m = lo+(hi-lo)/2;
+
+	n = takeNode(tree, keys[m].file);
+	n->left = build(tree, keys, lo, m);
+	n->right = build(tree, keys, m+1, hi);
+	update(n);
+
+	return n;
+}
+
+/* ------------------------------------------------------------------------
+ * Insert all files in the list
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_itree_insertAll(nowdb_itree_t  *tree,
+                                  ts_algo_list_t *files) {
+	ts_algo_list_node_t *runner;
+	nowdb_file_t *file;
+	nowdb_err_t err;
+	sortkey_t *keys;
+	uint32_t i=0;
+
+	if (tree == NULL) return nowdb_err_get(nowdb_err_invalid,
+	                    FALSE, OBJECT, "tree object is NULL");
+	if (files == NULL) return nowdb_err_get(nowdb_err_invalid,
+	                    FALSE, OBJECT, "list object is NULL");
+	if (files->len == 0) return NOWDB_OK;
+
+	err = nowdb_itree_reserve(tree, tree->count+files->len);
+	if (err != NOWDB_OK) return err;
+
+	if (tree->root != NULL) {
+		for(runner=files->head; runner!=NULL; runner=runner->nxt) {
+			tree->root = insertNode(tree->root,
+			             takeNode(tree, runner->cont));
+			tree->count++;
+		}
+		return NOWDB_OK;
+	}
+
+	keys = malloc(files->len*sizeof(sortkey_t));
+	if (keys == NULL) return nowdb_err_get(nowdb_err_no_mem,
+	                           FALSE, OBJECT, "allocating keys");
+
+	for(runner=files->head; runner!=NULL; runner=runner->nxt) {
+		file = runner->cont;
+		keys[i].oldest = file->oldest;
+		keys[i].fid = file->id;
+		keys[i].file = file; i++;
+	}
+	qsort(keys, i, sizeof(sortkey_t), &byOldest);
+
+	tree->root = build(tree, keys, 0, i);
+	tree->count = i;
+
+	free(keys);
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: remove the leftmost node of a subtree
+ * ------------------------------------------------------------------------
+ */
+static node_t *removeMin(node_t *root, node_t **min) {
+	if (root->left == NULL) {
+		*min = root; return root->right;
+	}
+	root->left = removeMin(root->left, min);
+	return balance(root);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: remove the node of file from subtree
+ * ------------------------------------------------------------------------
+ */
+static node_t *removeNode(node_t *root, nowdb_file_t *file,
+                          nowdb_time_t oldest, nowdb_fileid_t fid,
+                          node_t **found) {
+	node_t *min;
+
+	if (root == NULL) return NULL;
+	if (root->file == file) {
+		*found = root;
+		if (root->left == NULL) return root->right;
+		if (root->right == NULL) return root->left;
+		min = NULL;
+		root->right = removeMin(root->right, &min);
+		min->left = root->left;
+		min->right = root->right;
+		return balance(min);
+	}
+	if (before(oldest, fid, root)) {
+		root->left = removeNode(root->left, file, oldest, fid, found);
+
+	/* another file with the same key: ours may be on either side */
+	} else if (oldest == root->oldest && fid == root->fid) {
+		root->left = removeNode(root->left, file, oldest, fid, found);
+		if (*found == NULL) root->right = removeNode(root->right,
+		                                file, oldest, fid, found);
+	} else {
+		root->right = removeNode(root->right, file, oldest, fid, found);
+	}
+	return balance(root);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: find the node of file anywhere in the subtree
+ * ------------------------------------------------------------------------
+ */
+static node_t *findNode(node_t *root, nowdb_file_t *file) {
+	node_t *n;
+
+	if (root == NULL) return NULL;
+	if (root->file == file) return root;
+	n = findNode(root->left, file);
+	if (n != NULL) return n;
+	return findNode(root->right, file);
+}
+
+/* ------------------------------------------------------------------------
+ * Remove file
+ * The file is searched where it should be;
+ * if its times were changed nevertheless,
+ * we search everywhere and remove it with the times it had.
+ * ------------------------------------------------------------------------
+ */
+void nowdb_itree_remove(nowdb_itree_t *tree, nowdb_file_t *file) {
+	node_t *found = NULL;
+	node_t *n;
+
+	if (tree == NULL || file == NULL || tree->count == 0) return;
+
+	tree->root = removeNode(tree->root, file, file->oldest,
+	                                    file->id, &found);
+	if (found == NULL) {
+		n = findNode(tree->root, file);
+		if (n == NULL) return;
+		tree->root = removeNode(tree->root, file, n->oldest,
+		                                    n->fid, &found);
+		if (found == NULL) return;
+	}
+	giveNode(tree, found);
+	tree->count--;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: collect the files of the subtree (in order)
+ *         with oldest <= end and newest >= start
+ * ------------------------------------------------------------------------
+ */
+static ts_algo_rc_t collect(node_t *n,
+                            nowdb_time_t start,
+                            nowdb_time_t   end,
+                            ts_algo_list_t *list) {
+	ts_algo_rc_t rc;
+
+	if (n == NULL || n->maxnw < start) return TS_ALGO_OK;
+
+	rc = collect(n->left, start, end, list);
+	if (rc != TS_ALGO_OK) return rc;
+
+	/* this one and all on the right start too late */
+	if (n->oldest > end) return TS_ALGO_OK;
+
+	if (n->newest >= start) {
+		rc = ts_algo_list_append(list, n->file);
+		if (rc != TS_ALGO_OK) return rc;
+	}
+	return collect(n->right, start, end, list);
+}
+
+/* ------------------------------------------------------------------------
+ * Find all files that overlap with the period start - end
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_itree_search(nowdb_itree_t   *tree,
+                               nowdb_time_t    start,
+                               nowdb_time_t      end,
+                               ts_algo_list_t  *list) {
+	if (tree == NULL) return nowdb_err_get(nowdb_err_invalid,
+	                    FALSE, OBJECT, "tree object is NULL");
+	if (list == NULL) return nowdb_err_get(nowdb_err_invalid,
+	                    FALSE, OBJECT, "list object is NULL");
+
+	if (collect(tree->root, start, end, list) != TS_ALGO_OK) {
+		return nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT,
+		                                        "list append");
+	}
+	return NOWDB_OK;
+}
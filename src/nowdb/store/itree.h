@@ -0,0 +1,115 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Interval tree over files: finding the files of a period
+ * ========================================================================
+ * The files are kept in a balanced (AVL) tree ordered by 'oldest'.
+ * Each node holds the max 'newest' of its subtree.
+ * A file overlaps the period start - end if
+ *   oldest <= end and newest >= start.
+ * The search descends only into subtrees whose max 'newest'
+ * is >= start and stops where 'oldest' passes end.
+ * Finding m files among n costs O(log n + m log n);
+ * insert and remove cost O(log n).
+ * The nodes keep the times the file had on insert;
+ * the times of a file must not change while it is in the tree.
+ * ========================================================================
+ */
+#ifndef nowdb_itree_decl
+#define nowdb_itree_decl
+
+#include <nowdb/types/types.h>
+#include <nowdb/types/error.h>
+#include <nowdb/types/time.h>
+#include <nowdb/io/file.h>
+
+#include <tsalgo/list.h>
+
+#include <stdint.h>
+
+/* ------------------------------------------------------------------------
+ * Node
+ * ------------------------------------------------------------------------
+ */
+typedef struct nowdb_itree_node_t {
+	struct nowdb_itree_node_t  *left; /* older files                */
+	struct nowdb_itree_node_t *right; /* newer files, or free list  */
+	nowdb_file_t               *file; /* the file                   */
+	nowdb_time_t              oldest; /* its oldest on insert       */
+	nowdb_time_t              newest; /* its newest on insert       */
+	nowdb_time_t               maxnw; /* max newest of the subtree  */
+	nowdb_fileid_t               fid; /* its id                     */
+	int32_t                   height; /* height of the subtree      */
+} nowdb_itree_node_t;
+
+/* ------------------------------------------------------------------------
+ * Interval tree
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	nowdb_itree_node_t    *root; /* root of the tree                */
+	nowdb_itree_node_t    *free; /* nodes given back                */
+	nowdb_itree_node_t    *next; /* next unused node in last block  */
+	uint32_t              avail; /* unused nodes in last block      */
+	nowdb_itree_node_t **blocks; /* allocated blocks of nodes       */
+	uint32_t            nblocks; /* number of blocks                */
+	uint32_t              count; /* number of files                 */
+	uint32_t               size; /* allocated nodes                 */
+} nowdb_itree_t;
+
+/* ------------------------------------------------------------------------
+ * Initialise an already allocated interval tree
+ * ------------------------------------------------------------------------
+ */
+void nowdb_itree_init(nowdb_itree_t *tree);
+
+/* ------------------------------------------------------------------------
+ * Destroy interval tree (the files are not destroyed)
+ * ------------------------------------------------------------------------
+ */
+void nowdb_itree_destroy(nowdb_itree_t *tree);
+
+/* ------------------------------------------------------------------------
+ * Make room for n files
+ * -----------------
+ * After reserving, inserting up to n files does not fail.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_itree_reserve(nowdb_itree_t *tree, uint32_t n);
+
+/* ------------------------------------------------------------------------
+ * Insert file
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_itree_insert(nowdb_itree_t *tree, nowdb_file_t *file);
+
+/* ------------------------------------------------------------------------
+ * Insert all files in the list
+ * ----------------------------
+ * If the tree is empty, the files are sorted
+ * and the tree is built at once, i.e. in O(n log n);
+ * otherwise they are inserted one by one.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_itree_insertAll(nowdb_itree_t  *tree,
+                                  ts_algo_list_t *files);
+
+/* ------------------------------------------------------------------------
+ * Remove file (the very same descriptor, not just the same id)
+ * ------------------------------------------------------------------------
+ */
+void nowdb_itree_remove(nowdb_itree_t *tree, nowdb_file_t *file);
+
+/* ------------------------------------------------------------------------
+ * Find all files that overlap with the period start - end
+ * -------------------------------------------------------
+ * The files are appended to the list (ordered by oldest);
+ * the list contains pointers to the files in the tree.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_itree_search(nowdb_itree_t   *tree,
+                               nowdb_time_t    start,
+                               nowdb_time_t      end,
+                               ts_algo_list_t  *list);
+
+#endif
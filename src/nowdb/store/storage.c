@@ -9,6 +9,7 @@
 #include <nowdb/io/file.h>
 #include <nowdb/task/lock.h>
 #include <nowdb/task/worker.h>
+#include <nowdb/task/task.h>
 #include <nowdb/store/storage.h>
 #include <nowdb/store/storewrk.h>
 #include <nowdb/store/store.h>
@@ -29,6 +30,12 @@ static char *OBJECT = "storage";
 #define INVALID(x) \
 	return nowdb_err_get(nowdb_err_invalid, FALSE, OBJECT, x);
 
+/* ------------------------------------------------------------------------
+ * Delay while waiting for the compactor to unpin a store (1ms)
+ * ------------------------------------------------------------------------
+ */
+#define UNPINDELAY 1000000
+
 /* ------------------------------------------------------------------------
  * Allocate new storage object
  * ------------------------------------------------------------------------
@@ -81,6 +88,10 @@ nowdb_err_t nowdb_storage_init(nowdb_storage_t *strg,
 	strg->sort = cfg->sort;
 	strg->comp = cfg->comp;
 	strg->encp = cfg->encp;
+	strg->encode = cfg->comp != NOWDB_COMP_FLAT?cfg->encode:0;
+	strg->readahead = cfg->readahead;
+	strg->compacting = NULL;
+	strg->cancel = 0;
 	strg->started = 0;
 
 	return NOWDB_OK;
@@ -126,7 +137,9 @@ nowdb_err_t nowdb_storage_addStore(nowdb_storage_t *strg,
 }
 
 /* -----------------------------------------------------------------------
- * Remove a store from the storage
+ * Remove a store from the storage;
+ * if the compactor is working on the store,
+ * the compaction is cancelled and we wait until the store is unpinned.
  * -----------------------------------------------------------------------
  */
 nowdb_err_t nowdb_storage_removeStore(nowdb_storage_t *strg,
@@ -141,6 +154,16 @@ nowdb_err_t nowdb_storage_removeStore(nowdb_storage_t *strg,
 	err = nowdb_lock(&strg->lock);
 	if (err != NOWDB_OK) return err;
 
+	while(strg->compacting == store) {
+		strg->cancel = 1;
+		err = nowdb_unlock(&strg->lock);
+		if (err != NOWDB_OK) return err;
+		err = nowdb_task_sleep(UNPINDELAY);
+		if (err != NOWDB_OK) return err;
+		err = nowdb_lock(&strg->lock);
+		if (err != NOWDB_OK) return err;
+	}
+
 	for(runner=strg->stores.head; runner!=NULL; runner=runner->nxt) {
 		if (runner->cont == store) {
 			ts_algo_list_remove(&strg->stores, runner);
@@ -170,6 +193,13 @@ static inline nowdb_err_t startWorkers(nowdb_storage_t *strg) {
 		NOWDB_IGNORE(nowdb_store_stopSync(&strg->syncwrk));
 		return err;
 	}
+
+	err = nowdb_store_startCompactor(&strg->compwrk, strg, NULL);
+	if (err != NOWDB_OK) {
+		NOWDB_IGNORE(nowdb_store_stopSorter(&strg->sortwrk));
+		NOWDB_IGNORE(nowdb_store_stopSync(&strg->syncwrk));
+		return err;
+	}
 	return NOWDB_OK;
 }
 
@@ -180,6 +210,9 @@ static inline nowdb_err_t startWorkers(nowdb_storage_t *strg) {
 static inline nowdb_err_t stopWorkers(nowdb_storage_t *strg) {
 	nowdb_err_t err = NOWDB_OK;
 
+	err = nowdb_store_stopCompactor(&strg->compwrk);
+	if (err != NOWDB_OK) return err;
+
 	err = nowdb_store_stopSorter(&strg->sortwrk);
 	if (err != NOWDB_OK) return err;
 
@@ -257,6 +290,8 @@ void nowdb_storage_config(nowdb_storage_config_t *cfg,
 
 	cfg->sort = 1;
 	cfg->encp = NOWDB_ENCP_NONE;
+	cfg->encode = 0;
+	cfg->readahead = 0;
 
 	if (options & NOWDB_CONFIG_SIZE_TINY) {
 
@@ -25,10 +25,15 @@ typedef struct {
 	char                  sort; // sort files
 	nowdb_comp_t          comp; // compression
 	nowdb_encp_t          encp; // encryption
+	char                encode; // encode blocks before compression
+	uint32_t         readahead; // read-ahead depth for fullscans
 	uint32_t           tasknum; // number of sorter tasks
 	nowdb_worker_t     syncwrk; // background sync
 	nowdb_worker_t     sortwrk; // background sorter
+	nowdb_worker_t     compwrk; // background compaction
 	ts_algo_list_t      stores; // managed by this storage
+	void           *compacting; // store pinned by the compactor
+	char                cancel; // compaction of that store is cancelled
 	char               started; // storage was started
 } nowdb_storage_t;
 
@@ -43,6 +48,8 @@ typedef struct {
 	nowdb_bool_t  sort;
 	nowdb_comp_t  comp;
 	nowdb_encp_t  encp;
+	char        encode;
+	uint32_t readahead;
 } nowdb_storage_config_t;
 
 /* -----------------------------------------------------------------------
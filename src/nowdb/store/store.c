@@ -10,6 +10,9 @@
 #include <nowdb/store/storewrk.h>
 #include <tsalgo/types.h>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 static char *OBJECT = "store";
 
 extern char nowdb_nullrec[1024];
@@ -43,6 +46,16 @@ extern char nowdb_nullrec[1024];
  */
 static nowdb_wrk_message_t sortmsg = {11,NULL,NULL};
 
+/* ------------------------------------------------------------------------
+ * Journal events (see catalog below)
+ * ------------------------------------------------------------------------
+ */
+static void logFile(nowdb_store_t *store, nowdb_file_t *file);
+static void logDrop(nowdb_store_t *store, nowdb_fileid_t fid);
+static void logNext(nowdb_store_t *store);
+static void logRetire(nowdb_store_t *store, nowdb_file_t *file);
+static inline void tryCheckpoint(nowdb_store_t *store);
+
 /* ------------------------------------------------------------------------
  * Allocate and initialise new store object
  * ------------------------------------------------------------------------
@@ -198,11 +211,35 @@ static inline void destroyWaiting(nowdb_store_t *store) {
 	destroyFiles(&store->waiting);
 }
 
+/* ------------------------------------------------------------------------
+ * Helper: destroy retired readers
+ * ------------------------------------------------------------------------
+ */
+static inline void destroyRetired(nowdb_store_t *store) {
+	destroyFiles(&store->retired);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: remove retired readers from disk (they may be gone already)
+ *         and forget them
+ * ------------------------------------------------------------------------
+ */
+static inline void dropRetired(nowdb_store_t *store) {
+	ts_algo_list_node_t *runner;
+
+	for(runner=store->retired.head; runner!=NULL; runner=runner->nxt) {
+		NOWDB_IGNORE(nowdb_file_remove(runner->cont));
+	}
+	destroyRetired(store);
+	store->purged = 0;
+}
+
 /* ------------------------------------------------------------------------
  * Helper: destroy readers
  * ------------------------------------------------------------------------
  */
 static inline void destroyReaders(nowdb_store_t *store) {
+	nowdb_itree_destroy(&store->period);
 	ts_algo_tree_destroy(&store->readers);
 }
 
@@ -231,6 +268,7 @@ static inline void destroyAllFiles(nowdb_store_t *store) {
 	destroyWaiting(store);
 	destroyWriter(store);
 	destroyReaders(store);
+	destroyRetired(store);
 }
 
 /* ------------------------------------------------------------------------
@@ -242,6 +280,7 @@ static inline nowdb_err_t initreaders(nowdb_store_t *store) {
 	                                    &compare, NULL,
 	                                    &update, &delete,
 	                                    &destroy);
+	nowdb_itree_init(&store->period);
 	if (rc != 0) {
 		return nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT,
 		                       "cannot initialise AVL tree");
@@ -257,6 +296,8 @@ static inline nowdb_err_t initreaders(nowdb_store_t *store) {
 static inline nowdb_err_t initAllFiles(nowdb_store_t *store) {
 	ts_algo_list_init(&store->spares);
 	ts_algo_list_init(&store->waiting);
+	ts_algo_list_init(&store->retired);
+	store->purged = 0;
 	return initreaders(store);
 }
 
@@ -335,14 +376,21 @@ nowdb_err_t nowdb_store_init(nowdb_store_t  *store,
 	store->state = NOWDB_STORE_CLOSED;
 	store->path = NULL;
 	store->catalog = NULL;
+	store->journal = NULL;
+	store->jcount = 0;
+	store->jvalid = FALSE;
 	store->writer = NULL;
 	store->compare = NULL;
+	store->nrkeys = 0;
+	store->rtasks = 1;
 	store->iman = NULL;
 	store->lru  = lru;
 	store->context = NULL;
 	store->comp = NOWDB_COMP_FLAT;
 	store->ctx  = NULL;
+	store->encode = 0;
 	store->nextid = 1;
+	store->holders = 0;
 	store->ts = ts;
 	store->cont = cont;
 	store->storage = strg;
@@ -396,6 +444,26 @@ nowdb_err_t nowdb_store_init(nowdb_store_t  *store,
 		return nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT,
 		                    "allocating store catalog path");
 	}
+
+	/* journal */
+	store->journal = nowdb_path_append(store->path, "journal");
+	if (store->journal == NULL) {
+		nowdb_rwlock_destroy(&store->lock);
+		free(store->catalog); store->catalog = NULL;
+		free(store->path); store->path = NULL;
+		return nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT,
+		                    "allocating store journal path");
+	}
+
+	/* holders */
+	err = nowdb_lock_init(&store->hlock);
+	if (err != NOWDB_OK) {
+		nowdb_rwlock_destroy(&store->lock);
+		free(store->path); store->path = NULL;
+		free(store->catalog); store->catalog = NULL;
+		free(store->journal); store->journal = NULL;
+		return err;
+	}
 	return NOWDB_OK;
 }
 
@@ -410,6 +478,28 @@ nowdb_err_t nowdb_store_configSort(nowdb_store_t     *store,
 	return NOWDB_OK;
 }
 
+/* ------------------------------------------------------------------------
+ * Configure radix sort
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_store_configRadix(nowdb_store_t *store,
+                                    uint32_t       *offs,
+                                    uint32_t       nkeys,
+                                    uint32_t       tasks) {
+	STORENULL();
+
+	if (nkeys > NOWDB_RADIX_MAXKEYS) return nowdb_err_get(
+	             nowdb_err_invalid, FALSE, OBJECT, "too many keys");
+	for(uint32_t i=0; i<nkeys; i++) {
+		if (offs[i]+8 > store->recsize) return nowdb_err_get(
+		      nowdb_err_invalid, FALSE, OBJECT, "key out of record");
+		store->rkeys[i] = offs[i];
+	}
+	store->nrkeys = nkeys;
+	store->rtasks = tasks;
+	return NOWDB_OK;
+}
+
 /* ------------------------------------------------------------------------
  * Configure worker
  * ------------------------------------------------------------------------
@@ -450,7 +540,9 @@ nowdb_err_t nowdb_store_configCompression(nowdb_store_t *store,
 	STORENULL();
 
 	store->comp = comp;
-	if (comp == NOWDB_COMP_FLAT) return NOWDB_OK;
+
+	/* only ZSTD needs contexts and dictionaries */
+	if (comp != NOWDB_COMP_ZSTD) return NOWDB_OK;
 	
 	err = nowdb_compctx_new(&store->ctx, 32, 128);
 	if (err != NOWDB_OK) return err;
@@ -458,6 +550,18 @@ nowdb_err_t nowdb_store_configCompression(nowdb_store_t *store,
 	return NOWDB_OK;
 }
 
+/* ------------------------------------------------------------------------
+ * Configure block encoding
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_store_configEncoding(nowdb_store_t *store,
+                                       char          encode) {
+	STORENULL();
+
+	store->encode = store->comp != NOWDB_COMP_FLAT?encode:0;
+	return NOWDB_OK;
+}
+
 /* ------------------------------------------------------------------------
  * Destroy store
  * ------------------------------------------------------------------------
@@ -470,12 +574,16 @@ void nowdb_store_destroy(nowdb_store_t *store) {
 	if (store->catalog != NULL) {
 		free(store->catalog); store->catalog = NULL;
 	}
+	if (store->journal != NULL) {
+		free(store->journal); store->journal = NULL;
+	}
 	if (store->ctx != NULL) {
 		nowdb_compctx_destroy(store->ctx);
 		free(store->ctx); store->ctx = NULL;
 	}
 	destroyAllFiles(store);
 	nowdb_rwlock_destroy(&store->lock);
+	nowdb_lock_destroy(&store->hlock);
 }
 
 /* ------------------------------------------------------------------------
@@ -516,16 +624,17 @@ static inline nowdb_err_t makeFileName(nowdb_store_t *store, char *name) {
 }
 
 /* ------------------------------------------------------------------------
- * Helper: make file 
+ * Helper: make file (with additional control flags)
  * ------------------------------------------------------------------------
  */
 static inline nowdb_err_t makeFile(nowdb_store_t *store,
                                    nowdb_file_t  **file,
                                    char           *name,
-                                   nowdb_fileid_t   fid) {
+                                   nowdb_fileid_t   fid,
+                                   nowdb_bitmap8_t flgs) {
 	nowdb_path_t  p;
 	nowdb_err_t err;
-	nowdb_bitmap8_t ctrl = NOWDB_FILE_WRITER | NOWDB_FILE_SPARE;
+	nowdb_bitmap8_t ctrl = NOWDB_FILE_WRITER | NOWDB_FILE_SPARE | flgs;
 
 	if (store->ts) ctrl |= NOWDB_FILE_TS;
 
@@ -540,6 +649,16 @@ static inline nowdb_err_t makeFile(nowdb_store_t *store,
 	free(p); return err;
 }
 
+/* ------------------------------------------------------------------------
+ * Helper: layout flags of new readers
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_bitmap8_t readerFlags(nowdb_store_t *store) {
+	if (store->comp == NOWDB_COMP_FLAT) return 0;
+	if (store->encode) return NOWDB_FILE_ZONE | NOWDB_FILE_ENCODE;
+	return NOWDB_FILE_ZONE;
+}
+
 /* ------------------------------------------------------------------------
  * create reader
  * ------------------------------------------------------------------------
@@ -562,7 +681,12 @@ nowdb_err_t nowdb_store_createReader(nowdb_store_t *store,
 	
 	fid = getFileId(store);
 
-	err = makeFile(store, file, fname, fid);
+	/* the id is indexed before the reader is journaled */
+	logNext(store);
+	tryCheckpoint(store);
+
+	/* compressed readers carry zone maps in their block headers */
+	err = makeFile(store, file, fname, fid, readerFlags(store));
 	if (err != NOWDB_OK) goto unlock;
 
 	err = nowdb_file_makeReader(*file);
@@ -595,7 +719,7 @@ static inline nowdb_err_t createFile(nowdb_store_t *store, nowdb_fileid_t reuse)
 
 	fid = reuse>0?reuse:getFileId(store);
 
-	err = makeFile(store, &file, fname, fid);
+	err = makeFile(store, &file, fname, fid, 0);
 	if (err != NOWDB_OK) return err;
 
 	err = nowdb_file_create(file);
@@ -608,6 +732,7 @@ static inline nowdb_err_t createFile(nowdb_store_t *store, nowdb_fileid_t reuse)
 		return nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT, 
 		                                    "spares append");
 	}
+	logFile(store, file);
 	return err;
 }
 
@@ -638,6 +763,7 @@ static inline nowdb_err_t getWriter(nowdb_store_t *store) {
 	ts_algo_list_remove(&store->spares, node);
 	store->writer = node->cont; free(node);
 	NOWDB_IGNORE(nowdb_file_makeWriter(store->writer));
+	logFile(store, store->writer);
 	return NOWDB_OK;
 }
 
@@ -647,7 +773,10 @@ static inline nowdb_err_t getWriter(nowdb_store_t *store) {
  */
 static inline nowdb_err_t makeSpare(nowdb_store_t *store,
                                     nowdb_file_t  *file) {
+	nowdb_err_t err;
+
 	if (store->spares.len > MAX_SPARES) {
+		logDrop(store, file->id);
 		NOWDB_IGNORE(nowdb_file_close(file));
 		NOWDB_IGNORE(nowdb_file_remove(file));
 		nowdb_file_destroy(file); free(file);
@@ -657,7 +786,11 @@ static inline nowdb_err_t makeSpare(nowdb_store_t *store,
 		return nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT,
 		                                   "readers toList");
 	}
-	return nowdb_file_makeSpare(file);
+	err = nowdb_file_makeSpare(file);
+	if (err != NOWDB_OK) return err;
+
+	logFile(store, file);
+	return NOWDB_OK;
 }
 
 /* ------------------------------------------------------------------------
@@ -668,6 +801,7 @@ static inline nowdb_err_t newSpare(nowdb_store_t *store,
                                    nowdb_file_t  *file) {
 	nowdb_fileid_t fid = file->id;
 
+	logDrop(store, fid);
 	NOWDB_IGNORE(nowdb_file_close(file));
 	NOWDB_IGNORE(nowdb_file_remove(file));
 	nowdb_file_destroy(file); free(file);
@@ -692,6 +826,8 @@ static inline nowdb_err_t makeWaiting(nowdb_store_t *store,
 	err = nowdb_file_makeReader(store->writer);
 	if (err != NOWDB_OK) return err;
 
+	logFile(store, store->writer);
+
 	if (store->starting) return NOWDB_OK;
 	return nowdb_store_sortNow(store->storage, store);
 }
@@ -865,7 +1001,8 @@ static inline nowdb_err_t readCatalogLine(nowdb_store_t *store,
                                           nowdb_version_t ver) {
 	nowdb_err_t  err;
 	nowdb_file_t tmp, *file;
-	nowdb_path_t p;
+	char p[NOWDB_MAX_PATH];
+	size_t s;
 	int i;
 
 	memcpy(&tmp.id, buf+*off, 4); *off += 4;
@@ -890,9 +1027,13 @@ static inline nowdb_err_t readCatalogLine(nowdb_store_t *store,
 	if (buf[*off+i] != 0) return nowdb_err_get(nowdb_err_catalog,
 		                      FALSE, OBJECT, store->catalog);
 
-	p = nowdb_path_append(store->path, buf+(*off)); *off+=i+1;
-	if (p == NULL) return nowdb_err_get(nowdb_err_no_mem,
-		       FALSE, OBJECT, "allocating store path");
+	/* file_new copies the path */
+	s = strlen(store->path);
+	if (s+1+i >= NOWDB_MAX_PATH) return nowdb_err_get(nowdb_err_catalog,
+		                                FALSE, OBJECT, store->catalog);
+	memcpy(p, store->path, s); p[s] = '/';
+	memcpy(p+s+1, buf+(*off), i+1); *off+=i+1;
+
 	err = nowdb_file_new(&file, tmp.id, p,
 	                            tmp.capacity,
 	                            tmp.size,
@@ -905,7 +1046,6 @@ static inline nowdb_err_t readCatalogLine(nowdb_store_t *store,
 	                            tmp.grain,
 	                            tmp.oldest,
 	                            tmp.newest);
-	free(p);
 	if (err != NOWDB_OK) return err;
 	file->size = tmp.size;
 	if (ts_algo_list_append(files, file) != TS_ALGO_OK) {
@@ -916,212 +1056,738 @@ static inline nowdb_err_t readCatalogLine(nowdb_store_t *store,
 }
 
 /* ------------------------------------------------------------------------
- * Helper: read catalog and create files
+ * Catalog journal
+ * ---------------
+ * The journal starts with
+ *   MAGIC + version (4+4)
+ *   size and hash of the catalog it belongs to (4+8)
+ *   next free file id (4)
+ * followed by events:
+ *   size of event (4)
+ *   type of event (1)
+ *   file: catalog line
+ *   drop: file id (4)
+ *   next: next free file id (4)
+ *   retire: catalog line
+ * A file event replaces the file with the same id (or adds it),
+ * a drop event removes the file with that id.
+ * A retire event removes the file, too, but the file was replaced
+ * by compaction and is still on disk. Such files are removed
+ * from disk when the store is opened; a checkpoint journals
+ * them again as long as they are not removed.
+ * File ids are never reused: the index keeps the entries
+ * of compacted readers (see swapReaders), which must not
+ * point into other files. The next free id therefore survives
+ * in the journal, even if the files with the highest ids are gone.
  * ------------------------------------------------------------------------
  */
-static inline nowdb_err_t openstore(nowdb_store_t *store, char *buf, int size) {
-	nowdb_err_t err = NOWDB_OK;
-	nowdb_version_t ver;
-	uint32_t magic;
-	ts_algo_list_t files;
-	ts_algo_list_node_t *runner;
-	nowdb_file_t *file;
-	int off = 0;
+#define JRN_HEAD 24
+#define JRN_EVENT 5
+#define JRN_LINE 62
 
-	memcpy(&magic, buf, 4); off+=4;
-	if (magic != NOWDB_MAGIC) return nowdb_err_get(nowdb_err_magic,
-	                                FALSE, OBJECT, store->catalog);
-	memcpy(&ver, buf+off, 4); off+=4;
+#define JRN_FILE 1
+#define JRN_DROP 2
+#define JRN_NEXT 3
+#define JRN_RETIRE 4
 
-	readCatalogHeader(store, buf, &off);
+/* ------------------------------------------------------------------------
+ * Helper: hash catalog (FNV-1a on 8-byte words,
+ *         the catalog is hashed on every open)
+ * ------------------------------------------------------------------------
+ */
+static inline uint64_t hashCatalog(char *buf, uint32_t size) {
+	uint64_t h = 14695981039346656037ull;
+	uint64_t w;
+	uint32_t i;
 
-	ts_algo_list_init(&files);
-	while(off < size) {
-		err = readCatalogLine(store, &files, buf, &off, size, ver);
-		if (err != NOWDB_OK) {
-			destroyFiles(&files); return err;
-		}
+	for(i=0; i+8<=size; i+=8) {
+		memcpy(&w, buf+i, 8);
+		h ^= w;
+		h *= 1099511628211ull;
+		h ^= h >> 32;
 	}
-	runner = files.head;
-	while (runner!=NULL) {
-		file = runner->cont;
-		if (store->nextid <= file->id) {
-			store->nextid = file->id + 1;
-		}	
-		/*
-		fprintf(stderr, "%u: %s -- %u\n",
-		        file->id, file->path, (uint32_t)file->ctrl);
-		*/
-		if (file->ctrl & NOWDB_FILE_SPARE) {
-			if (ts_algo_list_append(
-			    &store->spares, file) != TS_ALGO_OK)
-			{
-				err = nowdb_err_get(nowdb_err_no_mem,
-				      FALSE, OBJECT, "spares append");
-				break;
-			}
-
-		} else if (file->ctrl & NOWDB_FILE_WRITER) {
-			if (store->writer != NULL) {
-				fprintf(stderr, "too many writers\n");
-				err = nowdb_err_get(nowdb_err_catalog,
-				       FALSE, OBJECT, store->catalog);
-				break;
-			}
-			store->writer = file;
-
-		} else if ((file->ctrl & NOWDB_FILE_READER) &&
-		           (file->ctrl & NOWDB_FILE_SORT)) {
-
-			if (ts_algo_tree_insert(
-			    &store->readers, file) != TS_ALGO_OK) 
-			{
-				err = nowdb_err_get(nowdb_err_no_mem,
-				      FALSE, OBJECT, "readers insert");
-				break;
-			}
-
-		} else if (file->ctrl & NOWDB_FILE_READER) {
-			if (ts_algo_list_append(
-			    &store->waiting, file) != TS_ALGO_OK)
-			{
-				err = nowdb_err_get(nowdb_err_no_mem,
-				      FALSE, OBJECT, "pending append");
-				break;
-			}
-
-		} else {
-			fprintf(stderr,
-			"don't know what to do with %s\n", file->path); 
-			nowdb_file_destroy(file); free(file);
-		}
-		ts_algo_list_node_t *tmp = runner->nxt;
-		ts_algo_list_remove(&files, runner);
-		free(runner); runner = tmp;
+	for(; i<size; i++) {
+		h ^= (uint8_t)buf[i];
+		h *= 1099511628211ull;
 	}
-	destroyFiles(&files);
+	return h;
+}
 
-	/* check for errors */
-	if (err != NOWDB_OK) {
-		destroyAllFiles(store); return err;
-	}
-	
-	/* if no spares, create */
-	err = createSpares(store);
-	if (err != NOWDB_OK) {
-		destroyAllFiles(store); return err;
+/* ------------------------------------------------------------------------
+ * Helper: write to journal and sync
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t writeJournal(nowdb_store_t *store,
+                                       char *buf, int size,
+                                       int flags) {
+	ssize_t x;
+	int fd;
+
+	fd = open(store->journal, O_WRONLY | O_CREAT | flags,
+	                                     NOWDB_FILE_MODE);
+	if (fd < 0) return nowdb_err_get(nowdb_err_open, TRUE, OBJECT,
+	                                                 store->journal);
+	x = write(fd, buf, size);
+	if (x != size) {
+		close(fd);
+		return nowdb_err_get(nowdb_err_write, TRUE, OBJECT,
+		                                    store->journal);
 	}
-	
-	/* if no writer, get a spare */
-	if (store->writer == NULL) err = getWriter(store);
-	if (err != NOWDB_OK) {
-		destroyAllFiles(store); return err;
+	if (fdatasync(fd) != 0) {
+		close(fd);
+		return nowdb_err_get(nowdb_err_write, TRUE, OBJECT,
+		                                    store->journal);
 	}
+	if (close(fd) != 0) return nowdb_err_get(nowdb_err_close, TRUE,
+	                                         OBJECT, store->journal);
 	return NOWDB_OK;
 }
 
 /* ------------------------------------------------------------------------
- * Helper: read catalog into buffer
+ * Helper: start a new journal for the catalog in buf
  * ------------------------------------------------------------------------
  */
-static inline nowdb_err_t readCatalogFile(nowdb_store_t *store,
-                                           char *buf, int size) {
-	return nowdb_readFile(store->catalog, buf, size);
+static inline nowdb_err_t resetJournal(nowdb_store_t *store,
+                                       char *buf, uint32_t size) {
+	nowdb_err_t err;
+	uint32_t magic = NOWDB_MAGIC;
+	uint64_t h = hashCatalog(buf, size);
+	ts_algo_list_node_t *runner;
+	char head[JRN_HEAD];
+
+	memcpy(head, &magic, 4);
+	memcpy(head+4, &store->version, 4);
+	memcpy(head+8, &size, 4);
+	memcpy(head+12, &h, 8);
+	memcpy(head+20, &store->nextid, 4);
+
+	store->jvalid = FALSE;
+	store->jcount = 0;
+
+	err = writeJournal(store, head, JRN_HEAD, O_TRUNC);
+	if (err != NOWDB_OK) return err;
+
+	store->jvalid = TRUE;
+
+	/* retired readers are still on disk */
+	for(runner=store->retired.head; runner!=NULL; runner=runner->nxt) {
+		logRetire(store, runner->cont);
+	}
+	store->jcount = 0;
+	return NOWDB_OK;
 }
 
 /* ------------------------------------------------------------------------
- * Helper: read catalog, get files, prepare writer
+ * Helper: append event to journal
+ * If that fails, we checkpoint as soon as possible.
  * ------------------------------------------------------------------------
  */
-static inline nowdb_err_t readCatalog(nowdb_store_t *store) {
+static void logEvent(nowdb_store_t *store, char type,
+                     nowdb_file_t  *file, nowdb_fileid_t fid) {
+	char buf[JRN_EVENT+JRN_LINE+NOWDB_MAX_NAME];
 	nowdb_err_t err;
-	char *buf;
-	uint32_t sz = measureCatalogSize(store);
-	if (sz == 0) return nowdb_err_get(nowdb_err_catalog, FALSE, OBJECT,
-	                                                   store->catalog);
-	buf = malloc(sz);
-	if (buf == NULL) return nowdb_err_get(nowdb_err_no_mem,
-	                   FALSE, OBJECT, "allocating buffer");
-	err = readCatalogFile(store, buf, sz);
-	if (err != NULL) {
-		free(buf); return err;
-	}
-	err = openstore(store, buf, sz);
-	if (err != NULL) {
-		free(buf); return err;
+	uint32_t sz;
+	int off = JRN_EVENT;
+
+	if (!store->jvalid) return;
+
+	buf[4] = type;
+	if (type == JRN_FILE || type == JRN_RETIRE) {
+		err = writeCatalogLine(buf, &off, file);
+		if (err != NOWDB_OK) goto failure;
+	} else {
+		memcpy(buf+off, &fid, 4); off+=4;
 	}
-	free(buf);
+	sz = off - JRN_EVENT;
+	memcpy(buf, &sz, 4);
 
-	err = prepareWriter(store);
-	if (err != NOWDB_OK) return err;
-	return NOWDB_OK;
+	err = writeJournal(store, buf, off, O_APPEND);
+	if (err != NOWDB_OK) goto failure;
+
+	store->jcount++;
+	return;
+
+failure:
+	nowdb_err_print(err); nowdb_err_release(err);
+	store->jvalid = FALSE;
 }
 
 /* ------------------------------------------------------------------------
- * Helper: compute catalog size
+ * Journal: file was added or changed
  * ------------------------------------------------------------------------
  */
-static inline uint32_t computeCatalogSize(nowdb_store_t *store) {
-	/* once:
-	 * MAGIC + version
-         * count + max + min (8+8+8)
-	 *
-	 * per line:
-	 * ---------
-	 * id                4
-	 * order,            4
-	 * capactiy,         4 
-	 * size,             4
-	 * recsize,          4
-	 * blocksize,        4
-	 * cont,             1
-	 * ctrl,             1
-	 * compression,      4 
-	 * encryption,       4
-	 * grain,            8
-	 * oldest,           8
-	 * newest,           8
-	 * file name        32
-	 */
-	uint32_t once = 32;
-	uint32_t perline = 93;
-	uint32_t nfiles = 1;
-
-	nfiles += store->spares.len;
-	nfiles += store->waiting.len;
-	nfiles += store->readers.count;
+static void logFile(nowdb_store_t *store, nowdb_file_t *file) {
+	logEvent(store, JRN_FILE, file, file->id);
+}
 
-	return once + nfiles * perline + 1;
+/* ------------------------------------------------------------------------
+ * Journal: file was removed
+ * ------------------------------------------------------------------------
+ */
+static void logDrop(nowdb_store_t *store, nowdb_fileid_t fid) {
+	logEvent(store, JRN_DROP, NULL, fid);
 }
 
 /* ------------------------------------------------------------------------
- * Helper: write buffer to catalog
+ * Journal: reader was replaced by compaction
  * ------------------------------------------------------------------------
  */
-static inline nowdb_err_t writeCatalogFile(nowdb_store_t *store,
-                                            char *buf, int size) {
-	return nowdb_writeFileWithBkp(store->path, store->catalog, buf, size);
+static void logRetire(nowdb_store_t *store, nowdb_file_t *file) {
+	logEvent(store, JRN_RETIRE, file, file->id);
 }
 
 /* ------------------------------------------------------------------------
- * Helper: compute catalog size and alloc buf
- *         write files to buffer and write buffers to disk
+ * Journal: file id was taken
  * ------------------------------------------------------------------------
  */
-static inline nowdb_err_t storeCatalog(nowdb_store_t *store) {
-	nowdb_err_t err;
-	uint32_t magic = NOWDB_MAGIC;
-	char *buf = NULL;
-	ts_algo_list_node_t *runner;
-	ts_algo_list_t *readers;
-	uint32_t sz;
+static void logNext(nowdb_store_t *store) {
+	logEvent(store, JRN_NEXT, NULL, store->nextid);
+}
 
-	sz = computeCatalogSize(store);
-	buf = malloc(sz);
-	if (buf == NULL) return nowdb_err_get(nowdb_err_no_mem,
-	                   FALSE, OBJECT, "allocating buffer");
+/* ------------------------------------------------------------------------
+ * Helper: id is taken
+ * ------------------------------------------------------------------------
+ */
+static inline void takeId(nowdb_store_t *store, nowdb_fileid_t fid) {
+	if (store->nextid <= fid) store->nextid = fid + 1;
+}
 
-	int off=8;
+/* ------------------------------------------------------------------------
+ * Helper: next free id from journal head
+ * (even if the journal does not belong to the catalog,
+ *  the ids it has seen are taken)
+ * ------------------------------------------------------------------------
+ */
+static inline void journalNextId(nowdb_store_t *store,
+                                 char *jrn, uint32_t jsize) {
+	nowdb_fileid_t fid;
+	uint32_t magic;
+
+	if (jsize < JRN_HEAD) return;
+
+	memcpy(&magic, jrn, 4);
+	if (magic != NOWDB_MAGIC) return;
+
+	memcpy(&fid, jrn+20, 4);
+	if (fid > 0) takeId(store, fid-1);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: journal belongs to the catalog in buf
+ * ------------------------------------------------------------------------
+ */
+static inline char journalBelongs(char *jrn, uint32_t jsize,
+                                  char *buf, uint32_t size) {
+	uint32_t magic, sz;
+	uint64_t h;
+
+	if (jsize < JRN_HEAD) return 0;
+
+	memcpy(&magic, jrn, 4);
+	if (magic != NOWDB_MAGIC) return 0;
+
+	memcpy(&sz, jrn+8, 4);
+	if (sz != size) return 0;
+
+	memcpy(&h, jrn+12, 8);
+	return (h == hashCatalog(buf, size));
+}
+
+/* ------------------------------------------------------------------------
+ * Tree callbacks for replay (list nodes by file id): compare
+ * ------------------------------------------------------------------------
+ */
+static ts_algo_cmp_t compareNodes(void *ignore, void *left, void *right) {
+	return compare(ignore, ((ts_algo_list_node_t*)left)->cont,
+	                       ((ts_algo_list_node_t*)right)->cont);
+}
+
+/* ------------------------------------------------------------------------
+ * Tree callbacks for replay: update (the first node wins)
+ * ------------------------------------------------------------------------
+ */
+static ts_algo_rc_t keepNode(void *ignore, void *o, void *n) {
+	return TS_ALGO_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: index list nodes by file id
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t indexById(ts_algo_tree_t *byid,
+                                    ts_algo_list_t *files) {
+	ts_algo_list_node_t *runner;
+
+	if (ts_algo_tree_init(byid, &compareNodes, NULL,
+	                      &keepNode, &delete, &delete) != TS_ALGO_OK) {
+		return nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT,
+		                       "cannot initialise AVL tree");
+	}
+	for(runner=files->head; runner!=NULL; runner=runner->nxt) {
+		if (ts_algo_tree_insert(byid, runner) != TS_ALGO_OK) {
+			ts_algo_tree_destroy(byid);
+			return nowdb_err_get(nowdb_err_no_mem,
+			         FALSE, OBJECT, "tree insert");
+		}
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: find list node by file id
+ * ------------------------------------------------------------------------
+ */
+static inline ts_algo_list_node_t *findById(ts_algo_tree_t *byid,
+                                            nowdb_fileid_t  fid) {
+	ts_algo_list_node_t key;
+	nowdb_file_t file;
+
+	file.id = fid; key.cont = &file;
+	return ts_algo_tree_find(byid, &key);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: append file to list and index
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t appendById(ts_algo_tree_t *byid,
+                                     ts_algo_list_t *files,
+                                     nowdb_file_t    *file) {
+	if (ts_algo_list_append(files, file) != TS_ALGO_OK) {
+		nowdb_file_destroy(file); free(file);
+		return nowdb_err_get(nowdb_err_no_mem,
+		         FALSE, OBJECT, "list append");
+	}
+	if (ts_algo_tree_insert(byid, files->last) != TS_ALGO_OK) {
+		return nowdb_err_get(nowdb_err_no_mem,
+		         FALSE, OBJECT, "tree insert");
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: remove file from list and index
+ * ------------------------------------------------------------------------
+ */
+static inline void dropById(ts_algo_tree_t *byid,
+                            ts_algo_list_t *files,
+                            nowdb_fileid_t  fid) {
+	ts_algo_list_node_t *node;
+
+	node = findById(byid, fid);
+	if (node == NULL) return;
+
+	ts_algo_tree_delete(byid, node);
+	ts_algo_list_remove(files, node);
+	nowdb_file_destroy(node->cont);
+	free(node->cont); free(node);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: replay retire event;
+ *         the file is removed from disk after replay
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t replayRetire(nowdb_store_t  *store,
+                                       ts_algo_tree_t *byid,
+                                       ts_algo_tree_t *gone,
+                                       ts_algo_list_t *files,
+                                       nowdb_file_t    *file) {
+	takeId(store, file->id);
+	dropById(byid, files, file->id);
+
+	if (findById(gone, file->id) != NULL) {
+		nowdb_file_destroy(file); free(file);
+		return NOWDB_OK;
+	}
+	return appendById(gone, &store->retired, file);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: replay journal events;
+ *         byid indexes the files, gone the retired files
+ * An incomplete event at the end (crash while writing) is ignored;
+ * since new events cannot follow it, we then checkpoint on open.
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t replayEvents(nowdb_store_t  *store,
+                                       ts_algo_tree_t *byid,
+                                       ts_algo_tree_t *gone,
+                                       ts_algo_list_t *files,
+                                       char *buf, int size,
+                                       nowdb_version_t ver) {
+	nowdb_err_t err;
+	ts_algo_list_t tmp;
+	ts_algo_list_node_t *node;
+	nowdb_file_t *file;
+	nowdb_fileid_t fid;
+	uint32_t sz;
+	int off = JRN_HEAD;
+	int end;
+	char type;
+
+	while(off < size) {
+		if (size - off < JRN_EVENT) break;
+		memcpy(&sz, buf+off, 4);
+		if (sz > (uint32_t)(size - off - JRN_EVENT)) break;
+
+		end = off+JRN_EVENT+sz;
+		type = buf[off+4];
+		switch(type) {
+		case JRN_FILE:
+		case JRN_RETIRE:
+			if (sz < JRN_LINE) return nowdb_err_get(
+			                    nowdb_err_catalog, FALSE,
+			                    OBJECT, store->journal);
+			off += JRN_EVENT;
+			ts_algo_list_init(&tmp);
+			err = readCatalogLine(store, &tmp, buf, &off, end, ver);
+			if (err != NOWDB_OK) {
+				destroyFiles(&tmp); return err;
+			}
+			if (off != end) {
+				destroyFiles(&tmp);
+				return nowdb_err_get(nowdb_err_catalog,
+				        FALSE, OBJECT, store->journal);
+			}
+			file = tmp.head->cont;
+			ts_algo_list_destroy(&tmp);
+
+			if (type == JRN_RETIRE) {
+				err = replayRetire(store, byid, gone,
+				                          files, file);
+				if (err != NOWDB_OK) return err;
+				break;
+			}
+			node = findById(byid, file->id);
+			if (node == NULL) {
+				err = appendById(byid, files, file);
+				if (err != NOWDB_OK) return err;
+			} else {
+				nowdb_file_destroy(node->cont);
+				free(node->cont); node->cont = file;
+			}
+			break;
+
+		case JRN_DROP:
+			if (sz != 4) return nowdb_err_get(nowdb_err_catalog,
+			                        FALSE, OBJECT, store->journal);
+			memcpy(&fid, buf+off+JRN_EVENT, 4);
+			takeId(store, fid);
+			dropById(byid, files, fid);
+			break;
+
+		case JRN_NEXT:
+			if (sz != 4) return nowdb_err_get(nowdb_err_catalog,
+			                        FALSE, OBJECT, store->journal);
+			memcpy(&fid, buf+off+JRN_EVENT, 4);
+			if (fid > 0) takeId(store, fid-1);
+			break;
+
+		default:
+			return nowdb_err_get(nowdb_err_catalog, FALSE, OBJECT,
+			                                      store->journal);
+		}
+		off = end;
+		store->jcount++;
+	}
+	if (off < size) store->jvalid = FALSE;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: replay journal on files read from catalog
+ * Events find their files by id in an index,
+ * so a long tail does not scan the file list once per event.
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t replayJournal(nowdb_store_t  *store,
+                                        ts_algo_list_t *files,
+                                        char *buf, int size,
+                                        nowdb_version_t ver) {
+	nowdb_err_t err;
+	ts_algo_tree_t byid;
+	ts_algo_tree_t gone;
+
+	if (size <= JRN_HEAD) return NOWDB_OK;
+
+	err = indexById(&byid, files);
+	if (err != NOWDB_OK) return err;
+
+	err = indexById(&gone, &store->retired);
+	if (err != NOWDB_OK) {
+		ts_algo_tree_destroy(&byid); return err;
+	}
+
+	err = replayEvents(store, &byid, &gone, files, buf, size, ver);
+
+	ts_algo_tree_destroy(&gone);
+	ts_algo_tree_destroy(&byid);
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: read catalog and journal and create files
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t openstore(nowdb_store_t *store,
+                                    char *buf, int size,
+                                    char *jrn, int jsize) {
+	nowdb_err_t err = NOWDB_OK;
+	nowdb_version_t ver;
+	uint32_t magic;
+	ts_algo_list_t files;
+	ts_algo_list_t sorted;
+	ts_algo_list_node_t *runner;
+	nowdb_file_t *file;
+	int off = 0;
+
+	memcpy(&magic, buf, 4); off+=4;
+	if (magic != NOWDB_MAGIC) return nowdb_err_get(nowdb_err_magic,
+	                                FALSE, OBJECT, store->catalog);
+	memcpy(&ver, buf+off, 4); off+=4;
+
+	readCatalogHeader(store, buf, &off);
+
+	ts_algo_list_init(&files);
+	while(off < size) {
+		err = readCatalogLine(store, &files, buf, &off, size, ver);
+		if (err != NOWDB_OK) {
+			destroyFiles(&files); return err;
+		}
+	}
+	if (jrn != NULL) {
+		err = replayJournal(store, &files, jrn, jsize, ver);
+		if (err != NOWDB_OK) {
+			destroyFiles(&files); return err;
+		}
+	}
+
+	/* sorted readers go into the period index in one go */
+	ts_algo_list_init(&sorted);
+
+	runner = files.head;
+	while (runner!=NULL) {
+		file = runner->cont;
+		takeId(store, file->id);
+		/*
+		fprintf(stderr, "%u: %s -- %u\n",
+		        file->id, file->path, (uint32_t)file->ctrl);
+		*/
+		if (file->ctrl & NOWDB_FILE_SPARE) {
+			if (ts_algo_list_append(
+			    &store->spares, file) != TS_ALGO_OK)
+			{
+				err = nowdb_err_get(nowdb_err_no_mem,
+				      FALSE, OBJECT, "spares append");
+				break;
+			}
+
+		} else if (file->ctrl & NOWDB_FILE_WRITER) {
+			if (store->writer != NULL) {
+				fprintf(stderr, "too many writers\n");
+				err = nowdb_err_get(nowdb_err_catalog,
+				       FALSE, OBJECT, store->catalog);
+				break;
+			}
+			store->writer = file;
+
+		} else if ((file->ctrl & NOWDB_FILE_READER) &&
+		           (file->ctrl & NOWDB_FILE_SORT)) {
+
+			if (ts_algo_tree_insert(
+			    &store->readers, file) != TS_ALGO_OK) 
+			{
+				err = nowdb_err_get(nowdb_err_no_mem,
+				      FALSE, OBJECT, "readers insert");
+				break;
+			}
+			if (ts_algo_list_append(&sorted, file) != TS_ALGO_OK) {
+				err = nowdb_err_get(nowdb_err_no_mem,
+				       FALSE, OBJECT, "list append");
+				break;
+			}
+
+		} else if (file->ctrl & NOWDB_FILE_READER) {
+			if (ts_algo_list_append(
+			    &store->waiting, file) != TS_ALGO_OK)
+			{
+				err = nowdb_err_get(nowdb_err_no_mem,
+				      FALSE, OBJECT, "pending append");
+				break;
+			}
+
+		} else {
+			fprintf(stderr,
+			"don't know what to do with %s\n", file->path); 
+			nowdb_file_destroy(file); free(file);
+		}
+		ts_algo_list_node_t *tmp = runner->nxt;
+		ts_algo_list_remove(&files, runner);
+		free(runner); runner = tmp;
+	}
+	destroyFiles(&files);
+
+	if (err == NOWDB_OK) {
+		err = nowdb_itree_insertAll(&store->period, &sorted);
+	}
+	ts_algo_list_destroy(&sorted);
+
+	/* check for errors */
+	if (err != NOWDB_OK) {
+		destroyAllFiles(store); return err;
+	}
+	
+	/* if no spares, create */
+	err = createSpares(store);
+	if (err != NOWDB_OK) {
+		destroyAllFiles(store); return err;
+	}
+	
+	/* if no writer, get a spare */
+	if (store->writer == NULL) err = getWriter(store);
+	if (err != NOWDB_OK) {
+		destroyAllFiles(store); return err;
+	}
+
+	/* retired readers of the last session (which did not
+	 * close the store) are not read by anybody anymore;
+	 * the checkpoint on open forgets them */
+	if (store->retired.len > 0) {
+		dropRetired(store);
+		store->jvalid = FALSE;
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: read catalog into buffer
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t readCatalogFile(nowdb_store_t *store,
+                                           char *buf, int size) {
+	return nowdb_readFile(store->catalog, buf, size);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: read catalog, get files, prepare writer
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t readCatalog(nowdb_store_t *store) {
+	nowdb_err_t err;
+	char *buf, *jrn=NULL;
+	uint32_t jsz;
+	uint32_t sz = measureCatalogSize(store);
+	if (sz == 0) return nowdb_err_get(nowdb_err_catalog, FALSE, OBJECT,
+	                                                   store->catalog);
+	buf = malloc(sz);
+	if (buf == NULL) return nowdb_err_get(nowdb_err_no_mem,
+	                   FALSE, OBJECT, "allocating buffer");
+	err = readCatalogFile(store, buf, sz);
+	if (err != NULL) {
+		free(buf); return err;
+	}
+
+	/* journal (if any and if it belongs to this catalog) */
+	store->jvalid = FALSE;
+	store->jcount = 0;
+
+	jsz = nowdb_path_filesize(store->journal);
+	if (jsz >= JRN_HEAD) {
+		jrn = malloc(jsz);
+		if (jrn == NULL) {
+			free(buf);
+			return nowdb_err_get(nowdb_err_no_mem,
+			   FALSE, OBJECT, "allocating buffer");
+		}
+		err = nowdb_readFile(store->journal, jrn, jsz);
+		if (err != NOWDB_OK) {
+			free(jrn); free(buf); return err;
+		}
+		journalNextId(store, jrn, jsz);
+		if (journalBelongs(jrn, jsz, buf, sz)) {
+			store->jvalid = TRUE;
+		} else {
+			free(jrn); jrn = NULL;
+		}
+	}
+	err = openstore(store, buf, sz, jrn, jsz);
+	if (jrn != NULL) free(jrn);
+	if (err != NULL) {
+		free(buf); return err;
+	}
+	free(buf);
+
+	err = prepareWriter(store);
+	if (err != NOWDB_OK) return err;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: compute catalog size
+ * ------------------------------------------------------------------------
+ */
+static inline uint32_t computeCatalogSize(nowdb_store_t *store) {
+	/* once:
+	 * MAGIC + version
+         * count + max + min (8+8+8)
+	 *
+	 * per line:
+	 * ---------
+	 * id                4
+	 * order,            4
+	 * capactiy,         4 
+	 * size,             4
+	 * recsize,          4
+	 * blocksize,        4
+	 * cont,             1
+	 * ctrl,             1
+	 * compression,      4 
+	 * encryption,       4
+	 * grain,            8
+	 * oldest,           8
+	 * newest,           8
+	 * file name        32
+	 */
+	uint32_t once = 32;
+	uint32_t perline = 93;
+	uint32_t nfiles = 1;
+
+	nfiles += store->spares.len;
+	nfiles += store->waiting.len;
+	nfiles += store->readers.count;
+
+	return once + nfiles * perline + 1;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: write buffer to catalog
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t writeCatalogFile(nowdb_store_t *store,
+                                            char *buf, int size) {
+	return nowdb_writeFileWithBkp(store->path, store->catalog, buf, size);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: compute catalog size and alloc buf
+ *         write files to buffer and write buffers to disk
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t storeCatalog(nowdb_store_t *store) {
+	nowdb_err_t err;
+	uint32_t magic = NOWDB_MAGIC;
+	char *buf = NULL;
+	ts_algo_list_node_t *runner;
+	ts_algo_list_t *readers;
+	uint32_t sz;
+
+	sz = computeCatalogSize(store);
+	buf = malloc(sz);
+	if (buf == NULL) return nowdb_err_get(nowdb_err_no_mem,
+	                   FALSE, OBJECT, "allocating buffer");
+
+	int off=8;
 	memcpy(buf, &magic, 4);
 	memcpy(buf+4, &store->version, 4);
 
@@ -1165,9 +1831,38 @@ static inline nowdb_err_t storeCatalog(nowdb_store_t *store) {
 		ts_algo_list_destroy(readers); free(readers);
 	}
 	err = writeCatalogFile(store, buf, off);
+	if (err != NOWDB_OK) {
+		free(buf); return err;
+	}
+	err = resetJournal(store, buf, off);
 	free(buf); return err;
 }
 
+/* ------------------------------------------------------------------------
+ * Helper: checkpoint journal into catalog if it is long
+ *         (or if it has failed)
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t checkpoint(nowdb_store_t *store) {
+	if (store->jvalid &&
+	    store->jcount < NOWDB_STORE_JOURNALMAX) return NOWDB_OK;
+	return storeCatalog(store);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: checkpoint after changes,
+ *         the changes themselves have already succeeded
+ * ------------------------------------------------------------------------
+ */
+static inline void tryCheckpoint(nowdb_store_t *store) {
+	nowdb_err_t err;
+
+	err = checkpoint(store);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err); nowdb_err_release(err);
+	}
+}
+
 /* ------------------------------------------------------------------------
  * Open store
  * ------------------------------------------------------------------------
@@ -1194,12 +1889,14 @@ nowdb_err_t nowdb_store_open(nowdb_store_t *store) {
 	/* read catalog */
 	err = readCatalog(store);
 	if (err != NOWDB_OK) {
+		store->jvalid = FALSE;
 		destroyAllFiles(store); goto unlock;
 	}
 
-	/* store catalog */
-	err = storeCatalog(store);
+	/* checkpoint only if the journal is long (or not usable) */
+	err = checkpoint(store);
 	if (err != NOWDB_OK) {
+		store->jvalid = FALSE;
 		destroyAllFiles(store); goto unlock;
 	}
 
@@ -1214,6 +1911,29 @@ unlock:
 	return err;
 }
 
+/* ------------------------------------------------------------------------
+ * Helper: any reader referenced by handles?
+ * (retired readers are not in the readers tree)
+ * ------------------------------------------------------------------------
+ */
+static ts_algo_rc_t countRefs(void *ignore, void *refs, const void *file) {
+	*(uint32_t*)refs += ((nowdb_file_t*)file)->refs;
+	return TS_ALGO_OK;
+}
+
+static inline char referenced(nowdb_store_t *store) {
+	ts_algo_list_node_t *runner;
+	uint32_t refs = 0;
+
+	ts_algo_tree_reduce(&store->readers, &refs, &countRefs);
+	if (refs > 0) return 1;
+
+	for(runner=store->retired.head; runner!=NULL; runner=runner->nxt) {
+		if (((nowdb_file_t*)runner->cont)->refs > 0) return 1;
+	}
+	return 0;
+}
+
 /* ------------------------------------------------------------------------
  * Close store
  * ------------------------------------------------------------------------
@@ -1237,10 +1957,24 @@ nowdb_err_t nowdb_store_close(nowdb_store_t *store) {
 	err = nowdb_lock_write(&store->lock);
 	if (err != NOWDB_OK) return err;
 
+	/* handles still refer to readers */
+	if (referenced(store)) {
+		err = nowdb_err_get(nowdb_err_busy, FALSE, OBJECT,
+		                            "readers are referenced");
+		goto unlock;
+	}
+
+	/* nobody reads them anymore;
+	 * if writing the catalog fails, the journal still has them */
+	dropRetired(store);
+
 	/* write catalog */
 	err = storeCatalog(store);
 	if (err != NOWDB_OK) goto unlock;
 
+	/* the journal is empty now */
+	store->jvalid = FALSE;
+
 	destroyAllFiles(store);
 
 	err = initAllFiles(store);
@@ -1303,6 +2037,7 @@ nowdb_err_t nowdb_store_create(nowdb_store_t *store) {
 
 	err = storeCatalog(store);
 unlock:
+	store->jvalid = FALSE;
 	destroySpares(store);
 	destroyWriter(store);
 	err2 = nowdb_unlock_write(&store->lock);
@@ -1391,6 +2126,7 @@ nowdb_err_t nowdb_store_insert(nowdb_store_t *store,
 			fprintf(stderr, "remap error!\n");
 			goto unlock;
 		}
+		tryCheckpoint(store);
 	}
 
 unlock:
@@ -1407,7 +2143,70 @@ unlock:
  */
 nowdb_err_t nowdb_store_insertBulk(nowdb_store_t *store,
                                    void           *data,
-                                   uint32_t       count);
+                                   uint32_t       count) {
+	nowdb_err_t err  = NOWDB_OK;
+	nowdb_err_t err2 = NOWDB_OK;
+	char *src = data;
+	uint32_t realsz;
+	uint32_t pos, room, n, sz;
+	uint32_t i=0;
+
+	STORENULL();
+	if (count == 0) return NOWDB_OK;
+	if (data == NULL) return nowdb_err_get(nowdb_err_invalid,
+	                                FALSE, OBJECT, "data is NULL");
+	if (store->writer == NULL) {
+		return nowdb_err_get(nowdb_err_invalid, FALSE, OBJECT,
+		                                 "store is not open");
+	}
+
+	/* usable bytes per page (the rest is the page remainder) */
+	realsz = (NOWDB_IDX_PAGE/store->recsize)*store->recsize;
+
+	err = nowdb_lock_write(&store->lock);
+	if (err != NOWDB_OK) return err;
+
+	while(i<count) {
+		/* the writer may have changed on remap */
+		pos = store->writer->pos%store->writer->bufsize;
+		if (!store->writer->dirty) store->writer->dirty = TRUE;
+
+		/* copy as many records as fit into the current page */
+		room = (realsz - pos%NOWDB_IDX_PAGE)/store->recsize;
+		n = count - i < room ? count - i : room;
+		sz = n*store->recsize;
+
+		memcpy(store->writer->mptr+pos, src, sz);
+
+		src+=sz; i+=n; pos+=sz;
+		store->writer->size += sz;
+		store->writer->pos  += sz;
+
+		if (REMAINDER < store->recsize) {
+			uint32_t d = REMAINDER;
+			pos+=d;
+			store->writer->size += d;
+			store->writer->pos += d;
+		}
+		if (pos >= store->writer->bufsize) {
+			err = remapWriter(store);
+			if (err != NOWDB_OK) {
+				fprintf(stderr, "remap error!\n");
+				break;
+			}
+		}
+	}
+	store->count += i;
+
+	/* the writer may have been swapped */
+	if (err == NOWDB_OK) tryCheckpoint(store);
+
+	err2 = nowdb_unlock_write(&store->lock);
+	if (err2 != NOWDB_OK) {
+		err2->cause = err; return err2;
+	}
+	return err;
+}
 
 /* ------------------------------------------------------------------------
  * Helper: set decompression settings to all files in list
@@ -1421,7 +2220,7 @@ static inline nowdb_err_t setDecomp(nowdb_store_t *store,
 	ZSTD_DDict    *dict;
 	ZSTD_DCtx     *ctx;
 
-	if (store->comp == NOWDB_COMP_FLAT) return NOWDB_OK;
+	if (store->comp != NOWDB_COMP_ZSTD) return NOWDB_OK;
 	if (list->len == 0) return NOWDB_OK;
 
 	err = nowdb_compctx_getDCtx(store->ctx, &ctx);
@@ -1440,19 +2239,6 @@ static inline nowdb_err_t setDecomp(nowdb_store_t *store,
 	return NOWDB_OK;
 }
 
-/* ------------------------------------------------------------------------
- * To be with the period means
- * ------------------------------------------------------------------------
- */
-static nowdb_bool_t inPeriod(void *rsc,
-                       const void *pattern,
-                       const void *node) {
-	return (((nowdb_file_t*)node)->oldest <=
-	        ((nowdb_file_t*)pattern)->newest &&
-	        ((nowdb_file_t*)node)->newest >=
-	        ((nowdb_file_t*)pattern)->oldest);
-}
-
 /* ------------------------------------------------------------------------
  * Helper: get all readers for period start - end
  * ------------------------------------------------------------------------
@@ -1463,19 +2249,12 @@ static inline nowdb_err_t getReaders(nowdb_store_t *store,
                                      nowdb_time_t     end) {
 	nowdb_err_t err = NOWDB_OK;
 	ts_algo_list_t tmp;
-	nowdb_file_t   pattern;
 
 	if (store->readers.count == 0) return NOWDB_OK;
 
-	pattern.oldest = start;
-	pattern.newest = end;
-
 	ts_algo_list_init(&tmp);
-	if (ts_algo_tree_filter(&store->readers,
-	              &tmp, &pattern, &inPeriod) != TS_ALGO_OK)
-	{
-		err = nowdb_err_get(nowdb_err_no_mem,
-		     FALSE, OBJECT, "readers toList");
+	err = nowdb_itree_search(&store->period, start, end, &tmp);
+	if (err != NOWDB_OK) {
 		ts_algo_list_destroy(&tmp);
 		return err;
 	}
@@ -1560,70 +2339,333 @@ static inline nowdb_err_t getFiles(nowdb_store_t *store,
 	err = setDecomp(store, list);
 	if (err != NOWDB_OK) return err;
 
-	/* pending and writer */
-	err = getAllWaiting(store, list);
+	/* pending and writer */
+	err = getAllWaiting(store, list);
+	if (err != NOWDB_OK) return err;
+
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: n more file lists are held by queries;
+ *         called with the store lock held (read or write),
+ *         so that no readers are swapped meanwhile
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t hold(nowdb_store_t *store, uint32_t n) {
+	nowdb_err_t err;
+
+	err = nowdb_lock(&store->hlock);
+	if (err != NOWDB_OK) return err;
+	store->holders += n;
+	return nowdb_unlock(&store->hlock);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: n file lists are released
+ * ------------------------------------------------------------------------
+ */
+static inline void unhold(nowdb_store_t *store, uint32_t n) {
+	nowdb_err_t err;
+
+	err = nowdb_lock(&store->hlock);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err); nowdb_err_release(err); return;
+	}
+	store->holders = store->holders < n ? 0 : store->holders - n;
+	err = nowdb_unlock(&store->hlock);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err); nowdb_err_release(err);
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Get all files for period start - end
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_store_getFiles(nowdb_store_t *store,
+                                 ts_algo_list_t *list,
+                                 nowdb_time_t   start,
+                                 nowdb_time_t    end) {
+	nowdb_err_t  err=NOWDB_OK;
+	nowdb_err_t err2=NOWDB_OK;
+
+	STORENULL();
+	LISTNULL();
+
+	err = nowdb_lock_read(&store->lock);
+	if (err != NOWDB_OK) return err;
+
+	err = getFiles(store, list, start, end);
+	if (err == NOWDB_OK) err = hold(store, 1);
+
+	err2 = nowdb_unlock_read(&store->lock);
+	if (err2 != NOWDB_OK) {
+		if (err == NOWDB_OK) unhold(store, 1);
+		err2->cause = err; err = err2;
+	}
+	if (err != NOWDB_OK) nowdb_store_destroyFiles(store, list);
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Get n copies of all files for period start - end
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_store_getNFiles(nowdb_store_t  *store,
+                                  uint32_t       copies,
+                                  ts_algo_list_t *lists,
+                                  nowdb_time_t    start,
+                                  nowdb_time_t      end) {
+	nowdb_err_t  err=NOWDB_OK;
+	nowdb_err_t err2=NOWDB_OK;
+
+	STORENULL();
+	if (lists == NULL) return nowdb_err_get(nowdb_err_invalid,
+	                   FALSE, OBJECT, "list pointer is NULL");
+
+	err = nowdb_lock_read(&store->lock);
+	if (err != NOWDB_OK) return err;
+
+	for(uint32_t i=0;i<copies;i++) {
+		err = getFiles(store, lists+i, start, end);
+		if (err != NOWDB_OK) break;
+	}
+	if (err == NOWDB_OK) err = hold(store, copies);
+
+	err2 = nowdb_unlock_read(&store->lock);
+	if (err2 != NOWDB_OK) {
+		if (err == NOWDB_OK) unhold(store, copies);
+		err2->cause = err; err = err2;
+	}
+	if (err != NOWDB_OK) {
+		for(uint32_t i=0;i<copies;i++) {
+			nowdb_store_destroyFiles(store, lists+i);
+		}
+	}
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: copy pending files (waiting and writer) without opening them
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t copyPending(nowdb_store_t *store,
+                                      ts_algo_list_t *list) {
+	nowdb_file_t *file;
+	nowdb_err_t    err;
+
+	if (store->waiting.len > 0) {
+		err = copyFileList(&store->waiting, list, FALSE,
+		                                NOWDB_TIME_DAWN,
+		                                NOWDB_TIME_DUSK);
+		if (err != NOWDB_OK) return err;
+	}
+	if (store->writer == NULL) return NOWDB_OK;
+
+	err = copyFile(store->writer, &file);
+	if (err != NOWDB_OK) return err;
+
+	err = nowdb_file_makeReader(file);
+	if (err != NOWDB_OK) {
+		nowdb_file_destroy(file); free(file); return err;
+	}
+	if (ts_algo_list_append(list, file) != TS_ALGO_OK) {
+		nowdb_file_destroy(file); free(file);
+		return nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT,
+		                                      "list append");
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: get handles
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t getHandles(nowdb_store_t         *store,
+                                     nowdb_store_handles_t *handles,
+                                     nowdb_time_t            start,
+                                     nowdb_time_t             end) {
+	ts_algo_list_node_t *runner;
+	nowdb_file_t *file;
+	ts_algo_list_t tmp;
+	nowdb_err_t err;
+	uint32_t i=0;
+
+	ts_algo_list_init(&tmp);
+	err = nowdb_itree_search(&store->period, start, end, &tmp);
+	if (err != NOWDB_OK) {
+		ts_algo_list_destroy(&tmp); return err;
+	}
+	if (tmp.len > 0) {
+		handles->readers = calloc(tmp.len,
+		              sizeof(nowdb_file_handle_t));
+		if (handles->readers == NULL) {
+			ts_algo_list_destroy(&tmp);
+			return nowdb_err_get(nowdb_err_no_mem, FALSE,
+			                   OBJECT, "allocating handles");
+		}
+	}
+	for(runner=tmp.head; runner!=NULL; runner=runner->nxt) {
+		file = runner->cont;
+		handles->readers[i].file = file;
+		handles->readers[i].size = file->size;
+		file->refs++; i++;
+	}
+	handles->count = i;
+	ts_algo_list_destroy(&tmp);
+
+	return copyPending(store, &handles->pending);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: forget handles
+ * ------------------------------------------------------------------------
+ */
+static inline void unrefHandles(nowdb_store_handles_t *handles) {
+	for(uint32_t i=0; i<handles->count; i++) {
+		handles->readers[i].file->refs--;
+	}
+	handles->count = 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Get handles of all files for period start - end
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_store_getHandles(nowdb_store_t         *store,
+                                   nowdb_store_handles_t *handles,
+                                   nowdb_time_t            start,
+                                   nowdb_time_t             end) {
+	nowdb_err_t  err=NOWDB_OK;
+	nowdb_err_t err2=NOWDB_OK;
+
+	STORENULL();
+	if (handles == NULL) return nowdb_err_get(nowdb_err_invalid,
+	                      FALSE, OBJECT, "handles object is NULL");
+
+	handles->readers = NULL;
+	handles->count = 0;
+	ts_algo_list_init(&handles->pending);
+
+	/* write lock: we count references */
+	err = nowdb_lock_write(&store->lock);
+	if (err != NOWDB_OK) return err;
+
+	err = getHandles(store, handles, start, end);
+	if (err == NOWDB_OK) err = hold(store, 1);
+	if (err != NOWDB_OK) unrefHandles(handles);
+
+	err2 = nowdb_unlock_write(&store->lock);
+	if (err2 != NOWDB_OK) {
+		if (err == NOWDB_OK) {
+			unrefHandles(handles); unhold(store, 1);
+		}
+		err2->cause = err; err = err2;
+	}
+	if (err != NOWDB_OK) {
+		if (handles->readers != NULL) {
+			free(handles->readers); handles->readers = NULL;
+		}
+		destroyFiles(&handles->pending);
+	}
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: append copy of file to list
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t appendCopy(nowdb_file_t   *file,
+                                     ts_algo_list_t *list,
+                                     uint32_t *size) {
+	nowdb_file_t *copy;
+	nowdb_err_t    err;
+
+	err = copyFile(file, &copy);
 	if (err != NOWDB_OK) return err;
-
+	if (size != NULL) copy->size = *size;
+	if (ts_algo_list_append(list, copy) != TS_ALGO_OK) {
+		nowdb_file_destroy(copy); free(copy);
+		return nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT,
+		                                      "list append");
+	}
 	return NOWDB_OK;
 }
 
 /* ------------------------------------------------------------------------
- * Get all files for period start - end
+ * Copy files from handles
  * ------------------------------------------------------------------------
  */
-nowdb_err_t nowdb_store_getFiles(nowdb_store_t *store,
-                                 ts_algo_list_t *list,
-                                 nowdb_time_t   start,
-                                 nowdb_time_t    end) {
+nowdb_err_t nowdb_store_fromHandles(nowdb_store_t         *store,
+                                    nowdb_store_handles_t *handles,
+                                    uint32_t k, uint32_t n,
+                                    ts_algo_list_t         *list) {
 	nowdb_err_t  err=NOWDB_OK;
 	nowdb_err_t err2=NOWDB_OK;
+	ts_algo_list_node_t *runner;
+	uint32_t i;
 
 	STORENULL();
 	LISTNULL();
+	if (handles == NULL) return nowdb_err_get(nowdb_err_invalid,
+	                      FALSE, OBJECT, "handles object is NULL");
+	if (n == 0 || k >= n) return nowdb_err_get(nowdb_err_invalid,
+	                           FALSE, OBJECT, "invalid partition");
 
+	/* the descriptors may be updated concurrently */
 	err = nowdb_lock_read(&store->lock);
 	if (err != NOWDB_OK) return err;
 
-	err = getFiles(store, list, start, end);
+	for(i=k; i<handles->count; i+=n) {
+		err = appendCopy(handles->readers[i].file, list,
+		                &handles->readers[i].size);
+		if (err != NOWDB_OK) break;
+	}
 
 	err2 = nowdb_unlock_read(&store->lock);
 	if (err2 != NOWDB_OK) {
-		err2->cause = err; return err2;
+		err2->cause = err; err = err2;
 	}
+	if (err == NOWDB_OK) err = setDecomp(store, list);
+
+	/* pending files belong to the handles */
+	i = handles->count;
+	for(runner=handles->pending.head; runner!=NULL &&
+	                  err == NOWDB_OK; runner=runner->nxt) {
+		if (i%n == k) err = appendCopy(runner->cont, list, NULL);
+		i++;
+	}
+
+	/* the handles hold the files meanwhile */
+	if (err == NOWDB_OK && list->len > 0) err = hold(store, 1);
+	if (err != NOWDB_OK) nowdb_store_destroyFiles(store, list);
 	return err;
 }
 
 /* ------------------------------------------------------------------------
- * Get n copies of all files for period start - end
+ * Release handles
  * ------------------------------------------------------------------------
  */
-nowdb_err_t nowdb_store_getNFiles(nowdb_store_t  *store,
-                                  uint32_t       copies,
-                                  ts_algo_list_t *lists,
-                                  nowdb_time_t    start,
-                                  nowdb_time_t      end) {
-	nowdb_err_t  err=NOWDB_OK;
-	nowdb_err_t err2=NOWDB_OK;
-
-	STORENULL();
-	if (lists == NULL) return nowdb_err_get(nowdb_err_invalid,
-	                   FALSE, OBJECT, "list pointer is NULL");
+void nowdb_store_releaseHandles(nowdb_store_t         *store,
+                                nowdb_store_handles_t *handles) {
+	nowdb_err_t err;
 
-	err = nowdb_lock_read(&store->lock);
-	if (err != NOWDB_OK) return err;
+	if (store == NULL || handles == NULL) return;
 
-	for(uint32_t i=0;i<copies;i++) {
-		err = getFiles(store, lists+i, start, end);
-		if (err != NOWDB_OK) break;
+	err = nowdb_lock_write(&store->lock);
+	if (err == NOWDB_OK) {
+		unrefHandles(handles);
+		NOWDB_IGNORE(nowdb_unlock_write(&store->lock));
+	} else {
+		nowdb_err_print(err); nowdb_err_release(err);
 	}
-	if (err != NOWDB_OK) goto unlock;
-
-unlock:
-	err2 = nowdb_unlock_read(&store->lock);
-	if (err2 != NOWDB_OK) {
-		err2->cause = err; return err2;
+	unhold(store, 1);
+	if (handles->readers != NULL) {
+		free(handles->readers); handles->readers = NULL;
 	}
-	return err;
+	handles->count = 0;
+	destroyFiles(&handles->pending);
 }
 
 /* ------------------------------------------------------------------------
@@ -1740,12 +2782,14 @@ nowdb_err_t nowdb_store_findReader(nowdb_store_t *store,
 
 /* ------------------------------------------------------------------------
  * A reader is free if ...
+ * (appending to a compacted reader would break its order)
  * ------------------------------------------------------------------------
  */
 static ts_algo_bool_t isFree(void *rsc,
                        const void *pattern,
                        const void *file) {
 	return (!((nowdb_file_t*)file)->used &&
+	       !(((nowdb_file_t*)file)->ctrl & NOWDB_FILE_ORDER) &&
 	         ((nowdb_file_t*)file)->size < NOWDB_FILE_MAXSIZE);
 }
 
@@ -1908,6 +2952,7 @@ nowdb_err_t nowdb_store_promote(nowdb_store_t  *store,
 	nowdb_err_t err = NOWDB_OK;
 	nowdb_err_t err2;
 	ts_algo_list_node_t *tmp;
+	nowdb_file_t *old;
 
 	STORENULL();
 	if (waiting == NULL) return nowdb_err_get(nowdb_err_invalid, FALSE,
@@ -1924,13 +2969,287 @@ nowdb_err_t nowdb_store_promote(nowdb_store_t  *store,
 	                                              "waiting not found");
 		goto unlock;
 	}
+
+	/* the period of an existing reader changes with the update,
+	 * so it leaves the period index before and comes back after */
+	old = ts_algo_tree_find(&store->readers, reader);
+	if (old == NULL) {
+		err = nowdb_itree_insert(&store->period, reader);
+		if (err != NOWDB_OK) goto unlock;
+	} else {
+		nowdb_itree_remove(&store->period, old);
+	}
 	if (ts_algo_tree_insert(&store->readers,reader) != TS_ALGO_OK) {
 		err = nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT,
 	                                          "readers insert");
+		if (old == NULL) nowdb_itree_remove(&store->period, reader);
+		else NOWDB_IGNORE(nowdb_itree_insert(&store->period, old));
 		goto unlock;
 	}
+	/* there was room for it before */
+	if (old != NULL) {
+		NOWDB_IGNORE(nowdb_itree_insert(&store->period, old));
+	}
+
+	/* on update, 'reader' has gone into 'old' */
+	logFile(store, old != NULL ? old : reader);
+	logDrop(store, waiting->id);
+
 	ts_algo_list_remove(&store->waiting, tmp);
 	nowdb_file_destroy(tmp->cont); free(tmp->cont); free(tmp);
+
+	tryCheckpoint(store);
+unlock:
+	err2 = nowdb_unlock_write(&store->lock);
+	if (err2 != NOWDB_OK) {
+		err2->cause = err; return err2;
+	}
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * A reader can be compacted if ...
+ * ------------------------------------------------------------------------
+ */
+static ts_algo_bool_t isCompactable(void *rsc,
+                              const void *pattern,
+                              const void *file) {
+	return (!((nowdb_file_t*)file)->used &&
+	         ((nowdb_file_t*)file)->size > 0 &&
+	         (((nowdb_file_t*)file)->ctrl & NOWDB_FILE_SORT) &&
+	        !(((nowdb_file_t*)file)->ctrl & NOWDB_FILE_ORDER));
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: order readers by oldest timestamp
+ * ------------------------------------------------------------------------
+ */
+static int byOldest(const void *left, const void *right) {
+	nowdb_file_t *l = *(nowdb_file_t**)left;
+	nowdb_file_t *r = *(nowdb_file_t**)right;
+
+	if (l->oldest < r->oldest) return -1;
+	if (l->oldest > r->oldest) return  1;
+	if (l->id < r->id) return -1;
+	if (l->id > r->id) return  1;
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: find the first group of readers (ordered by oldest)
+ *         that overlap in time; the group has at least two
+ *         and at most max members. Returns the size of the group.
+ * ------------------------------------------------------------------------
+ */
+static inline uint32_t findGroup(nowdb_file_t **files, uint32_t n,
+                                 uint32_t max, uint32_t *first) {
+	nowdb_time_t newest;
+	uint32_t s=0, k;
+
+	while(s < n) {
+		newest = files[s]->newest;
+		for(k=s+1; k<n && k-s<max; k++) {
+			if (files[k]->oldest > newest) break;
+			if (files[k]->newest > newest) newest = files[k]->newest;
+		}
+		if (k-s > 1) {
+			*first = s; return k-s;
+		}
+		s = k;
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: get readers to compact
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t getCompactable(nowdb_store_t  *store,
+                                         ts_algo_list_t  *list,
+                                         uint32_t          max) {
+	nowdb_err_t err = NOWDB_OK;
+	ts_algo_list_node_t *runner;
+	ts_algo_list_t tmp;
+	nowdb_file_t **files=NULL;
+	nowdb_file_t  *file;
+	uint32_t i, n, first=0;
+
+	ts_algo_list_init(&tmp);
+	if (ts_algo_tree_filter(&store->readers, &tmp, NULL,
+	                         &isCompactable) != TS_ALGO_OK)
+	{
+		err = nowdb_err_get(nowdb_err_no_mem,
+		     FALSE, OBJECT, "readers toList");
+		goto cleanup;
+	}
+	if (tmp.len < 2) goto cleanup;
+
+	files = malloc(tmp.len*sizeof(nowdb_file_t*));
+	if (files == NULL) {
+		err = nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT,
+		                                "allocating readers");
+		goto cleanup;
+	}
+	i = 0;
+	for(runner=tmp.head; runner!=NULL; runner=runner->nxt) {
+		files[i] = runner->cont; i++;
+	}
+	qsort(files, tmp.len, sizeof(nowdb_file_t*), &byOldest);
+
+	n = findGroup(files, tmp.len, max, &first);
+	for(i=first; i<first+n; i++) {
+		err = copyFile(files[i], &file);
+		if (err != NOWDB_OK) break;
+		if (ts_algo_list_append(list, file) != TS_ALGO_OK) {
+			nowdb_file_destroy(file); free(file);
+			err = nowdb_err_get(nowdb_err_no_mem,
+			          FALSE, OBJECT, "list append");
+			break;
+		}
+	}
+	if (err != NOWDB_OK) {
+		destroyFiles(list); goto cleanup;
+	}
+	for(i=first; i<first+n; i++) files[i]->used = TRUE;
+
+cleanup:
+	if (files != NULL) free(files);
+	ts_algo_list_destroy(&tmp);
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Get readers to compact
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_store_getCompactable(nowdb_store_t  *store,
+                                       ts_algo_list_t  *list,
+                                       uint32_t          max) {
+	nowdb_err_t err = NOWDB_OK;
+	nowdb_err_t err2;
+
+	STORENULL();
+	LISTNULL();
+
+	if (max < 2) return NOWDB_OK;
+
+	err = nowdb_lock_write(&store->lock);
+	if (err != NOWDB_OK) return err;
+
+	if (store->state == NOWDB_STORE_OPEN &&
+	    store->readers.count > 1) {
+		err = getCompactable(store, list, max);
+	}
+
+	err2 = nowdb_unlock_write(&store->lock);
+	if (err2 != NOWDB_OK) {
+		err2->cause = err; return err2;
+	}
+	if (err != NOWDB_OK) return err;
+	return setDecomp(store, list);
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: forget the last n retired readers
+ * ------------------------------------------------------------------------
+ */
+static inline void unretire(nowdb_store_t *store, uint32_t n) {
+	ts_algo_list_node_t *tmp;
+
+	for(uint32_t i=0; i<n; i++) {
+		tmp = store->retired.last;
+		ts_algo_list_remove(&store->retired, tmp); free(tmp);
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Swap readers
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_store_swapReaders(nowdb_store_t   *store,
+                                    ts_algo_list_t    *old,
+                                    ts_algo_list_t *readers) {
+	nowdb_err_t err = NOWDB_OK;
+	nowdb_err_t err2;
+	ts_algo_list_node_t *runner;
+	nowdb_file_t *file;
+	uint32_t n=0;
+
+	STORENULL();
+	if (old == NULL || readers == NULL) {
+		return nowdb_err_get(nowdb_err_invalid, FALSE, OBJECT,
+		                                    "list object is NULL");
+	}
+
+	err = nowdb_lock_write(&store->lock);
+	if (err != NOWDB_OK) return err;
+
+	/* find the old readers and keep them as retired */
+	for(runner=old->head; runner!=NULL; runner=runner->nxt) {
+		file = ts_algo_tree_find(&store->readers, runner->cont);
+		if (file == NULL) {
+			err = nowdb_err_get(nowdb_err_key_not_found,
+			         FALSE, OBJECT, "reader not found");
+			break;
+		}
+		if (ts_algo_list_append(&store->retired, file) != TS_ALGO_OK) {
+			err = nowdb_err_get(nowdb_err_no_mem,
+			          FALSE, OBJECT, "list append");
+			break;
+		}
+		n++;
+	}
+	if (err != NOWDB_OK) {
+		unretire(store, n); goto unlock;
+	}
+
+	/* from here on, the period index does not fail */
+	err = nowdb_itree_reserve(&store->period,
+	          store->period.count+readers->len);
+	if (err != NOWDB_OK) {
+		unretire(store, n); goto unlock;
+	}
+
+	/* insert the new ones */
+	for(runner=readers->head; runner!=NULL; runner=runner->nxt) {
+		if (ts_algo_tree_insert(&store->readers,
+		                runner->cont) != TS_ALGO_OK) {
+			err = nowdb_err_get(nowdb_err_no_mem, FALSE, OBJECT,
+			                                  "readers insert");
+			break;
+		}
+	}
+	if (err != NOWDB_OK) {
+		for(ts_algo_list_node_t *tmp=readers->head;
+		                   tmp!=runner; tmp=tmp->nxt) {
+			ts_algo_tree_delete(&store->readers, tmp->cont);
+		}
+		unretire(store, n); goto unlock;
+	}
+
+	for(runner=readers->head; runner!=NULL; runner=runner->nxt) {
+		NOWDB_IGNORE(nowdb_itree_insert(&store->period, runner->cont));
+	}
+
+	/* remove the old ones (the descriptors survive in retired) */
+	runner = store->retired.last;
+	for(uint32_t i=0; i<n; i++) {
+		nowdb_itree_remove(&store->period, runner->cont);
+		ts_algo_tree_delete(&store->readers, runner->cont);
+		runner = runner->prv;
+	}
+
+	/* journal */
+	for(runner=readers->head; runner!=NULL; runner=runner->nxt) {
+		logFile(store, runner->cont);
+	}
+	runner = store->retired.last;
+	for(uint32_t i=0; i<n; i++) {
+		logRetire(store, runner->cont);
+		runner = runner->prv;
+	}
+	tryCheckpoint(store);
+
 unlock:
 	err2 = nowdb_unlock_write(&store->lock);
 	if (err2 != NOWDB_OK) {
@@ -1939,6 +3258,119 @@ unlock:
 	return err;
 }
 
+/* ------------------------------------------------------------------------
+ * Helper: compare file ids
+ * ------------------------------------------------------------------------
+ */
+static int byFileId(const void *left, const void *right) {
+	if (*(nowdb_fileid_t*)left < *(nowdb_fileid_t*)right) return -1;
+	if (*(nowdb_fileid_t*)left > *(nowdb_fileid_t*)right) return  1;
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: ids of the retired readers not yet purged
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t getPurgeable(nowdb_store_t   *store,
+                                       nowdb_fileid_t **fids,
+                                       uint32_t           *n) {
+	ts_algo_list_node_t *runner;
+	uint32_t i=0, k=0;
+
+	if (store->holders > 0) return NOWDB_OK;
+	if (store->retired.len <= store->purged) return NOWDB_OK;
+
+	*fids = calloc(store->retired.len - store->purged,
+	                         sizeof(nowdb_fileid_t));
+	if (*fids == NULL) return nowdb_err_get(nowdb_err_no_mem,
+	                    FALSE, OBJECT, "allocating file ids");
+
+	for(runner=store->retired.head; runner!=NULL; runner=runner->nxt) {
+		if (i >= store->purged) {
+			(*fids)[k] = ((nowdb_file_t*)runner->cont)->id; k++;
+		}
+		i++;
+	}
+	qsort(*fids, k, sizeof(nowdb_fileid_t), &byFileId);
+	*n = k;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Get retired readers to purge from the index
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_store_getPurgeable(nowdb_store_t   *store,
+                                     nowdb_fileid_t **fids,
+                                     uint32_t           *n) {
+	nowdb_err_t err = NOWDB_OK;
+	nowdb_err_t err2;
+
+	STORENULL();
+
+	*fids = NULL; *n = 0;
+
+	err = nowdb_lock_write(&store->lock);
+	if (err != NOWDB_OK) return err;
+
+	err = nowdb_lock(&store->hlock);
+	if (err != NOWDB_OK) goto unlock;
+
+	err = getPurgeable(store, fids, n);
+
+	err2 = nowdb_unlock(&store->hlock);
+	if (err2 != NOWDB_OK) {
+		err2->cause = err; err = err2;
+	}
+unlock:
+	err2 = nowdb_unlock_write(&store->lock);
+	if (err2 != NOWDB_OK) {
+		err2->cause = err; err = err2;
+	}
+	if (err != NOWDB_OK && *fids != NULL) {
+		free(*fids); *fids = NULL; *n = 0;
+	}
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * The next n retired readers were purged
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_store_setPurged(nowdb_store_t *store, uint32_t n) {
+	nowdb_err_t err;
+
+	STORENULL();
+
+	err = nowdb_lock_write(&store->lock);
+	if (err != NOWDB_OK) return err;
+
+	store->purged += n;
+	if (store->purged > store->retired.len) {
+		store->purged = store->retired.len;
+	}
+	return nowdb_unlock_write(&store->lock);
+}
+
+/* ------------------------------------------------------------------------
+ * Count waiting files
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_store_countWaiting(nowdb_store_t *store,
+                                     uint32_t      *count) {
+	nowdb_err_t err;
+
+	STORENULL();
+
+	err = nowdb_lock_read(&store->lock);
+	if (err != NOWDB_OK) return err;
+
+	*count = store->waiting.len;
+
+	return nowdb_unlock_read(&store->lock);
+}
+
 /* ------------------------------------------------------------------------
  * Donate empty file to spares
  * ------------------------------------------------------------------------
@@ -1955,6 +3387,7 @@ nowdb_err_t nowdb_store_donate(nowdb_store_t *store, nowdb_file_t *file) {
 
 	file->used = FALSE;
 	err = makeSpare(store, file);
+	if (err == NOWDB_OK) tryCheckpoint(store);
 
 	err2 = nowdb_unlock_write(&store->lock);
 	if (err2 != NOWDB_OK) {
@@ -1980,6 +3413,7 @@ nowdb_err_t nowdb_store_releasePending(nowdb_store_t *store,
 
 	file->used = FALSE;
 	err = newSpare(store, file);
+	if (err == NOWDB_OK) tryCheckpoint(store);
 
 	err2 = nowdb_unlock_write(&store->lock);
 	if (err2 != NOWDB_OK) {
@@ -2027,6 +3461,18 @@ void nowdb_store_destroyFiles(nowdb_store_t  *store,
 	destroyFiles(files);
 }
 
+/* ------------------------------------------------------------------------
+ * Release files obtained by getFiles, getNFiles or fromHandles;
+ * only lists that are not empty are held,
+ * so releasing the same list twice is harmless.
+ * ------------------------------------------------------------------------
+ */
+void nowdb_store_releaseFiles(nowdb_store_t  *store,
+                              ts_algo_list_t *files) {
+	if (files->len > 0) unhold(store, 1);
+	nowdb_store_destroyFiles(store, files);
+}
+
 /* ------------------------------------------------------------------------
  * Add a file
  * ------------------------------------------------------------------------
@@ -2114,9 +3560,14 @@ nowdb_err_t nowdb_store_showCatalog(nowdb_store_t *store) {
 			fprintf(stdout, "Compressed : NO\n");
 		} else if (file->comp == NOWDB_COMP_ZSTD) {
 			fprintf(stdout, "Compressed : ZSTD\n");
+		} else if (file->comp == NOWDB_COMP_LZ4) {
+			fprintf(stdout, "Compressed : LZ4\n");
 		} else {
 			fprintf(stdout, "Compressed : ?\n");
 		}
+		if (file->ctrl & NOWDB_FILE_ENCODE) {
+			fprintf(stdout, "Encoded    : YES\n");
+		}
 		fprintf(stdout, "Encryption : %u\n", file->encp);
 		fprintf(stdout, "Grain      : %ld\n", file->grain);
 		fprintf(stdout, "Oldest     : %ld\n", file->oldest);
@@ -14,8 +14,10 @@
 #include <nowdb/task/lock.h>
 #include <nowdb/task/worker.h>
 #include <nowdb/sort/sort.h>
+#include <nowdb/sort/radix.h>
 #include <nowdb/store/comp.h>
 #include <nowdb/store/storage.h>
+#include <nowdb/store/itree.h>
 #include <nowdb/mem/plru8r.h>
 
 #include <tsalgo/list.h>
@@ -23,6 +25,19 @@
 
 #include <zstd.h>
 
+/* ------------------------------------------------------------------------
+ * Catalog journal
+ * ---------------
+ * Changes of files (new spares and writers, waiting files,
+ * promoted and compacted readers, dropped files) are appended
+ * to the journal when they happen. Opening the store loads
+ * the catalog and replays the journal on top of it.
+ * After NOWDB_STORE_JOURNALMAX events, the journal is
+ * checkpointed into the catalog and starts again.
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_STORE_JOURNALMAX 128
+
 /* ------------------------------------------------------------------------
  * Store
  * ------------------------------------------------------------------------
@@ -40,14 +55,26 @@ typedef struct {
 	nowdb_key_t            min; /* min pk                      */
 	nowdb_path_t          path; /* base path                   */
 	nowdb_path_t       catalog; /* path to catalog             */
+	nowdb_path_t       journal; /* path to catalog journal     */
+	uint32_t            jcount; /* events since checkpoint     */
+	char                jvalid; /* journal belongs to catalog  */
 	nowdb_file_t       *writer; /* where we currently write to */
 	ts_algo_list_t      spares; /* available spares            */
 	ts_algo_list_t     waiting; /* unprepard readers           */
 	ts_algo_tree_t     readers; /* collection of readers       */
+	nowdb_itree_t       period; /* readers by period           */
+	ts_algo_list_t     retired; /* readers replaced by compact */
+	uint32_t            purged; /* retired readers purged      */
+	nowdb_lock_t         hlock; /* protects holders            */
+	uint32_t           holders; /* file lists held by queries  */
 	nowdb_fileid_t      nextid; /* next free fileid            */
 	nowdb_comp_t          comp; /* compression                 */
 	nowdb_compctx_t       *ctx; /* compression context         */
 	nowdb_comprsc_t    compare; /* comparison                  */
+	uint32_t rkeys[NOWDB_RADIX_MAXKEYS]; /* radix sort keys    */
+	uint32_t            nrkeys; /* # of radix keys (0: merge)  */
+	uint32_t            rtasks; /* tasks per radix sort        */
+	char                encode; /* encode blocks of readers    */
 	void                 *iman; /* index manager               */
 	void              *context; /* context for indexing        */
 	nowdb_plru8r_t        *lru; /* lru for vertices            */
@@ -58,6 +85,32 @@ typedef struct {
 	char                    ts; /* stores a timeseries         */
 } nowdb_store_t;
 
+/* ------------------------------------------------------------------------
+ * Handle: reference to a reader
+ * -----------------------------
+ * The descriptor is owned by the store and must not be changed.
+ * 'size' is the size of the reader when the handle was taken
+ * (the reader may grow afterwards).
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	nowdb_file_t *file; /* the reader                          */
+	uint32_t      size; /* its size when the handle was taken  */
+} nowdb_file_handle_t;
+
+/* ------------------------------------------------------------------------
+ * Handles of all files for a period
+ * ---------------------------------
+ * The readers are referenced, the pending files
+ * (waiting and writer) are copied.
+ * ------------------------------------------------------------------------
+ */
+typedef struct {
+	nowdb_file_handle_t *readers; /* handles to readers        */
+	uint32_t               count; /* number of handles         */
+	ts_algo_list_t       pending; /* copies of pending files   */
+} nowdb_store_handles_t;
+
 /* ------------------------------------------------------------------------
  * Store state
  * ------------------------------------------------------------------------
@@ -98,6 +151,20 @@ nowdb_err_t nowdb_store_init(nowdb_store_t  *store,
 nowdb_err_t nowdb_store_configSort(nowdb_store_t     *store,
                                    nowdb_comprsc_t compare);
 
+/* ------------------------------------------------------------------------
+ * Configure radix sort
+ * --------------------
+ * Waiting files are sorted on the keys at 'offs'
+ * (see nowdb_radix_sort) with 'tasks' tasks instead of
+ * merge sort with 'compare'. The keys must define
+ * the same order as 'compare'.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_store_configRadix(nowdb_store_t *store,
+                                    uint32_t       *offs,
+                                    uint32_t       nkeys,
+                                    uint32_t       tasks);
+
 /* ------------------------------------------------------------------------
  * Configure compression
  * ------------------------------------------------------------------------
@@ -105,6 +172,13 @@ nowdb_err_t nowdb_store_configSort(nowdb_store_t     *store,
 nowdb_err_t nowdb_store_configCompression(nowdb_store_t *store,
                                           nowdb_comp_t   comp);
 
+/* ------------------------------------------------------------------------
+ * Configure block encoding (applies only to compressed readers)
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_store_configEncoding(nowdb_store_t *store,
+                                       char          encode);
+
 /* ------------------------------------------------------------------------
  * Configure worker
  * ------------------------------------------------------------------------
@@ -167,6 +241,10 @@ nowdb_err_t nowdb_store_insertBulk(nowdb_store_t *store,
 
 /* ------------------------------------------------------------------------
  * Get all files for period start - end
+ * ------------------------------------
+ * The list holds the files until it is released
+ * (see nowdb_store_releaseFiles);
+ * on error, the list is empty.
  * ------------------------------------------------------------------------
  */
 nowdb_err_t nowdb_store_getFiles(nowdb_store_t  *store,
@@ -180,6 +258,8 @@ nowdb_err_t nowdb_store_getFiles(nowdb_store_t  *store,
  * As 'lists' parameter an array of lists of files is expected
  * (which should be allocated by the caller)
  * and which will be filled with n copies of files.
+ * Like getFiles, each list holds the files
+ * until it is released.
  * ------------------------------------------------------------------------
  */
 nowdb_err_t nowdb_store_getNFiles(nowdb_store_t   *store,
@@ -197,6 +277,42 @@ nowdb_err_t nowdb_store_getReaders(nowdb_store_t  *store,
                                    nowdb_time_t    start,
                                    nowdb_time_t     end);
 
+/* ------------------------------------------------------------------------
+ * Get handles of all files for period start - end
+ * -----------------------------------------------
+ * The cost depends on the number of files in the period,
+ * not on the number of files in the store.
+ * The handles hold the files until they are released
+ * and must be released before the store is closed.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_store_getHandles(nowdb_store_t         *store,
+                                   nowdb_store_handles_t *handles,
+                                   nowdb_time_t            start,
+                                   nowdb_time_t             end);
+
+/* ------------------------------------------------------------------------
+ * Copy files from handles
+ * -----------------------
+ * Appends copies of every n-th file starting with the k-th file
+ * (readers first, then pending files) to the list.
+ * The readers get decompression settings.
+ * A list that is not empty holds the files until it is released
+ * (see nowdb_store_releaseFiles); on error, the list is empty.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_store_fromHandles(nowdb_store_t         *store,
+                                    nowdb_store_handles_t *handles,
+                                    uint32_t k, uint32_t n,
+                                    ts_algo_list_t         *list);
+
+/* ------------------------------------------------------------------------
+ * Release handles
+ * ------------------------------------------------------------------------
+ */
+void nowdb_store_releaseHandles(nowdb_store_t         *store,
+                                nowdb_store_handles_t *handles);
+
 /* ------------------------------------------------------------------------
  * Get all pending (pending only)
  * ------------------------------------------------------------------------
@@ -211,6 +327,17 @@ nowdb_err_t nowdb_store_getAllWaiting(nowdb_store_t  *store,
 void nowdb_store_destroyFiles(nowdb_store_t  *store,
                               ts_algo_list_t *files);
 
+/* ------------------------------------------------------------------------
+ * Release files obtained by getFiles, getNFiles or fromHandles
+ * ------------------------------------------------------------
+ * Destroys the files and the list.
+ * Index entries of retired readers are kept
+ * as long as one of these lists is held.
+ * ------------------------------------------------------------------------
+ */
+void nowdb_store_releaseFiles(nowdb_store_t  *store,
+                              ts_algo_list_t *files);
+
 /* ------------------------------------------------------------------------
  * Find file in waiting
  * ------------------------------------------------------------------------
@@ -292,6 +419,68 @@ nowdb_err_t nowdb_store_promote(nowdb_store_t  *store,
                                  nowdb_file_t *waiting,
                                  nowdb_file_t  *reader);
 
+/* ------------------------------------------------------------------------
+ * Max number of readers compacted in one go
+ * ------------------------------------------------------------------------
+ */
+#define NOWDB_STORE_COMPACTMAX 8
+
+/* ------------------------------------------------------------------------
+ * Get readers to compact
+ * ----------------------
+ * Finds a group of at least two (and at most max) sorted readers
+ * that overlap in time and are not yet fully ordered.
+ * Copies of the readers (with decompression settings)
+ * are appended to the list, the readers are marked as used.
+ * The list remains empty if there is no such group.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_store_getCompactable(nowdb_store_t  *store,
+                                       ts_algo_list_t  *list,
+                                       uint32_t          max);
+
+/* ------------------------------------------------------------------------
+ * Swap readers
+ * ------------
+ * Replaces the readers in 'old' by those in 'readers' in one step.
+ * The store takes ownership of the new file descriptors.
+ * The old files remain on disk (queries may still read them)
+ * until the store is closed; they are journaled as retired,
+ * so, after a crash, they are removed when the store is opened.
+ * Their index entries are purged when no query holds files
+ * anymore (see getPurgeable).
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_store_swapReaders(nowdb_store_t   *store,
+                                    ts_algo_list_t    *old,
+                                    ts_algo_list_t *readers);
+
+/* ------------------------------------------------------------------------
+ * Get retired readers to purge from the index
+ * -------------------------------------------
+ * If no query holds files, the ids of the retired readers
+ * that are still indexed are returned in 'fids' (sorted);
+ * 'fids' is allocated by the store and must be freed by the caller.
+ * Otherwise (or if there is nothing to purge), n is 0.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_store_getPurgeable(nowdb_store_t   *store,
+                                     nowdb_fileid_t **fids,
+                                     uint32_t           *n);
+
+/* ------------------------------------------------------------------------
+ * The next n retired readers were purged from the index
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_store_setPurged(nowdb_store_t *store, uint32_t n);
+
+/* ------------------------------------------------------------------------
+ * Count waiting files
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_store_countWaiting(nowdb_store_t *store,
+                                     uint32_t      *count);
+
 /* ------------------------------------------------------------------------
  * Add a file
  * ------------------------------------------------------------------------
@@ -11,6 +11,8 @@
 #include <nowdb/store/comp.h>
 #include <nowdb/store/indexer.h>
 #include <nowdb/index/man.h>
+#include <nowdb/sort/xsort.h>
+#include <nowdb/task/task.h>
 
 #include <stdint.h>
 #include <stdlib.h>
@@ -36,6 +38,27 @@
 #define SORTPERIOD    5000000000l
 #define SORTTIMEOUT 300000000000l
 
+/* ------------------------------------------------------------------------
+ * Compactor Period and Timeout
+ * ------------------------------------------------------------------------
+ */
+#define COMPACTPERIOD   60000000000l
+#define COMPACTTIMEOUT 600000000000l
+
+/* ------------------------------------------------------------------------
+ * Compactor throttling:
+ * - stores with more than COMPACTBACKLOG waiting files are left alone;
+ * - the compactor writes COMPACTCHUNK pages at a time and,
+ *   while the backlog is too high, pauses COMPACTPAUSE
+ *   nanoseconds after each chunk.
+ * COMPACTRUN is the memory used per run of the external sort.
+ * ------------------------------------------------------------------------
+ */
+#define COMPACTBACKLOG 1
+#define COMPACTCHUNK 256
+#define COMPACTPAUSE 100000000l
+#define COMPACTRUN   (32*NOWDB_MEGA)
+
 #define NOMEM(x) \
 	err = nowdb_err_get(nowdb_err_no_mem, FALSE, "store", x);
 
@@ -55,12 +78,26 @@ static nowdb_err_t sortjob(nowdb_worker_t      *wrk,
                            uint32_t              id,
                            nowdb_wrk_message_t *msg);
 
+/* ------------------------------------------------------------------------
+ * Compactor predeclaration
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t compactjob(nowdb_worker_t      *wrk,
+                              uint32_t              id,
+                              nowdb_wrk_message_t *msg);
+
 /* ------------------------------------------------------------------------
  * All messages are static, no drain required for queues
  * ------------------------------------------------------------------------
  */
 static void nodrain(void **ignore) {}
 
+/* ------------------------------------------------------------------------
+ * Compactor message
+ * ------------------------------------------------------------------------
+ */
+static nowdb_wrk_message_t compactmsg = {12,NULL,NULL};
+
 /* ------------------------------------------------------------------------
  * Start Sync Worker
  * ------------------------------------------------------------------------
@@ -112,6 +149,29 @@ nowdb_err_t nowdb_store_stopSorter(nowdb_worker_t *wrk) {
 	return nowdb_worker_stop(wrk, SORTTIMEOUT);
 }
 
+/* ------------------------------------------------------------------------
+ * Start Compactor
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_store_startCompactor(nowdb_worker_t *wrk,
+                                       void          *strg,
+                                       nowdb_queue_t *errq) {
+	if (wrk == NULL) return nowdb_err_get(nowdb_err_invalid, FALSE,
+	                             "store", "worker object is NULL");
+	if (strg == NULL) return nowdb_err_get(nowdb_err_invalid, FALSE,
+	                              "store", "storage object is NULL");
+	return nowdb_worker_init(wrk, "compact", 1, COMPACTPERIOD,
+	                         &compactjob, errq, &nodrain, strg);
+}
+
+/* ------------------------------------------------------------------------
+ * Stop Compactor
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_store_stopCompactor(nowdb_worker_t *wrk) {
+	return nowdb_worker_stop(wrk, COMPACTTIMEOUT);
+}
+
 /* ------------------------------------------------------------------------
  * Do your job, sorter!
  * ------------------------------------------------------------------------
@@ -122,6 +182,15 @@ nowdb_err_t nowdb_store_sortNow(nowdb_storage_t *strg, void *store) {
 	     &((nowdb_store_t*)store)->srtmsg);
 }
 
+/* ------------------------------------------------------------------------
+ * Do your job, compactor!
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_store_compactNow(nowdb_storage_t *strg) {
+	if (!strg->started) return NOWDB_OK;
+	return nowdb_worker_do(&strg->compwrk, &compactmsg);
+}
+
 /* ------------------------------------------------------------------------
  * Syncjob
  * ------------------------------------------------------------------------
@@ -274,6 +343,8 @@ static inline nowdb_err_t configReader(nowdb_store_t *store, nowdb_file_t *file)
 		if (err != NOWDB_OK) return err;
 		err = nowdb_compctx_getCCtx(store->ctx, &file->cctx);
 		if (err != NOWDB_OK) return err;
+	} else if (store->comp == NOWDB_COMP_LZ4) {
+		file->comp = NOWDB_COMP_LZ4;
 	}
 	return NOWDB_OK;
 }
@@ -519,8 +590,21 @@ static inline nowdb_err_t compsort(nowdb_worker_t  *wrk,
 		}
 	}
 
+	/* sort buf -- radix sort on the keys, if we have them */
+	if (store->nrkeys > 0) {
+		if (nowdb_radix_sort(buf, src->size, NOWDB_IDX_PAGE,
+		                     store->recsize,
+		                     store->rkeys, store->nrkeys,
+		                     store->rtasks) != 0)
+		{
+			NOMEM("radixsort");
+			nowdb_store_releaseWaiting(store, src);
+			nowdb_file_destroy(src); free(src);
+			free(buf); return err;
+		}
+
 	/* sort buf -- if compare is not NULL! */
-	if (store->compare != NULL) {
+	} else if (store->compare != NULL) {
 		if (nowdb_mem_merge(buf, src->size, NOWDB_IDX_PAGE,
 		                    store->recsize,
 		                    store->compare, NULL) != 0)
@@ -622,3 +706,502 @@ static nowdb_err_t sortjob(nowdb_worker_t      *wrk,
 	if (msg == NULL) return NOWDB_OK;
 	return compsort(wrk, id, msg->stcont);
 }
+
+/* ------------------------------------------------------------------------
+ * Compactor: are we stopping?
+ * ------------------------------------------------------------------------
+ */
+static inline char stopping(nowdb_worker_t *wrk) {
+	char x;
+
+	if (nowdb_lock(&wrk->lock) != NOWDB_OK) return 1;
+	x = wrk->stop;
+	if (nowdb_unlock(&wrk->lock) != NOWDB_OK) return 1;
+	return x;
+}
+
+/* ------------------------------------------------------------------------
+ * Compactor: are we stopping or is the store being removed?
+ * ------------------------------------------------------------------------
+ */
+static inline char cancelled(nowdb_worker_t *wrk) {
+	nowdb_storage_t *strg = wrk->rsc;
+	char x;
+
+	if (stopping(wrk)) return 1;
+	if (nowdb_lock(&strg->lock) != NOWDB_OK) return 1;
+	x = strg->cancel;
+	if (nowdb_unlock(&strg->lock) != NOWDB_OK) return 1;
+	return x;
+}
+
+/* ------------------------------------------------------------------------
+ * Compactor: the sorter lags behind
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t backlog(nowdb_store_t *store, char *busy) {
+	nowdb_err_t err;
+	uint32_t n;
+
+	err = nowdb_store_countWaiting(store, &n);
+	if (err != NOWDB_OK) return err;
+	*busy = n > COMPACTBACKLOG;
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Compactor: give way to ingest
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t throttle(nowdb_worker_t *wrk,
+                                   nowdb_store_t *store) {
+	nowdb_err_t err;
+	char busy;
+
+	for(;;) {
+		err = backlog(store, &busy);
+		if (err != NOWDB_OK) return err;
+		if (!busy || cancelled(wrk)) break;
+		err = nowdb_task_sleep(COMPACTPAUSE);
+		if (err != NOWDB_OK) return err;
+	}
+	return NOWDB_OK;
+}
+
+/* ------------------------------------------------------------------------
+ * Compactor: find min/max of a chunk
+ * (the last page of a chunk may end with null records)
+ * ------------------------------------------------------------------------
+ */
+static inline void chunkMinMax(nowdb_store_t *store,
+                               char *buf, uint32_t size,
+                               nowdb_file_t *file) {
+	nowdb_file_t tmp;
+	uint32_t n = NOWDB_IDX_PAGE/store->recsize;
+	uint32_t off = store->cont==NOWDB_CONT_EDGE?
+	                             NOWDB_OFF_STAMP:
+	                             NOWDB_OFF_VSTAMP;
+	nowdb_time_t t;
+	char *rec;
+
+	tmp.oldest = NOWDB_TIME_DUSK;
+	tmp.newest = NOWDB_TIME_DAWN;
+
+	for(uint32_t i=0; i<size; i+=NOWDB_IDX_PAGE) {
+		for(uint32_t j=0; j<n; j++) {
+			rec = buf+i+j*store->recsize;
+			if (memcmp(rec, nowdb_nullrec,
+			           store->recsize) == 0) break;
+			memcpy(&t, rec+off, sizeof(nowdb_time_t));
+			if (t < tmp.oldest) tmp.oldest = t;
+			if (t > tmp.newest) tmp.newest = t;
+		}
+	}
+	setMinMax(&tmp, file);
+}
+
+/* ------------------------------------------------------------------------
+ * Compactor: feed all records of a reader into the external sort
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t feedSort(nowdb_store_t *store,
+                                   nowdb_file_t   *file,
+                                   nowdb_xsort_t    *xs) {
+	nowdb_err_t err, err2;
+	uint32_t n = NOWDB_IDX_PAGE/store->recsize;
+	char *rec;
+
+	err = nowdb_file_open(file);
+	if (err != NOWDB_OK) return err;
+
+	err = nowdb_file_rewind(file);
+	if (err != NOWDB_OK) goto close;
+
+	for(;;) {
+		err = nowdb_file_move(file);
+		if (err != NOWDB_OK) {
+			if (err->errcode == nowdb_err_eof) {
+				nowdb_err_release(err);
+				err = NOWDB_OK;
+			}
+			break;
+		}
+		for(uint32_t j=0; j<n; j++) {
+			rec = file->bptr+j*store->recsize;
+			if (memcmp(rec, nowdb_nullrec,
+			           store->recsize) == 0) break;
+			err = nowdb_xsort_add(xs, rec);
+			if (err != NOWDB_OK) break;
+		}
+		if (err != NOWDB_OK) break;
+	}
+close:
+	err2 = nowdb_file_close(file);
+	if (err2 != NOWDB_OK) {
+		err2->cause = err; return err2;
+	}
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Compactor: release compression context of a new reader
+ * ------------------------------------------------------------------------
+ */
+static inline void releaseCCtx(nowdb_store_t *store, nowdb_file_t *file) {
+	nowdb_err_t err;
+
+	if (file->cctx == NULL) return;
+	err = nowdb_compctx_releaseCCtx(store->ctx, file->cctx);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err); nowdb_err_release(err);
+	}
+	file->cctx = NULL;
+}
+
+/* ------------------------------------------------------------------------
+ * Compactor: create a new (ordered) reader
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t newOrdered(nowdb_store_t *store,
+                                     char *buf, uint32_t size,
+                                     ts_algo_list_t   *readers,
+                                     nowdb_file_t       **file) {
+	nowdb_err_t err;
+
+	if (store->comp == NOWDB_COMP_ZSTD) {
+		err = getZSTDResources(store, buf, size);
+		if (err != NOWDB_OK) return err;
+	}
+	err = nowdb_store_createReader(store, file);
+	if (err != NOWDB_OK) return err;
+
+	(*file)->capacity = store->largesize;
+	(*file)->ctrl |= NOWDB_FILE_SORT | NOWDB_FILE_ORDER;
+
+	if (ts_algo_list_append(readers, *file) != TS_ALGO_OK) {
+		nowdb_file_destroy(*file); free(*file); *file = NULL;
+		return nowdb_err_get(nowdb_err_no_mem, FALSE, "store",
+		                                        "list append");
+	}
+	err = configReader(store, *file);
+	if (err != NOWDB_OK) return err;
+
+	return nowdb_file_create(*file);
+}
+
+/* ------------------------------------------------------------------------
+ * Compactor: write one chunk;
+ *            a new reader is started when the current one is full
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t putChunk(nowdb_store_t *store,
+                                   char *buf, uint32_t size,
+                                   ts_algo_list_t   *readers,
+                                   nowdb_file_t       **file) {
+	nowdb_err_t err;
+
+	if (*file != NULL && (*file)->size >= store->largesize) {
+		releaseCCtx(store, *file); *file = NULL;
+	}
+	if (*file == NULL) {
+		err = newOrdered(store, buf, size, readers, file);
+		if (err != NOWDB_OK) return err;
+	}
+	if (store->ts) chunkMinMax(store, buf, size, *file);
+	return putContent(store, buf, size, *file);
+}
+
+/* ------------------------------------------------------------------------
+ * Compactor: stream the sorted records into new readers
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t writeOrdered(nowdb_worker_t   *wrk,
+                                       nowdb_store_t  *store,
+                                       nowdb_xsort_t     *xs,
+                                       ts_algo_list_t *readers) {
+	nowdb_err_t err = NOWDB_OK;
+	nowdb_file_t *file = NULL;
+	uint32_t n = NOWDB_IDX_PAGE/store->recsize;
+	uint32_t max = n*COMPACTCHUNK;
+	uint32_t k = 0;
+	char *buf, *rec;
+
+	buf = calloc(COMPACTCHUNK, NOWDB_IDX_PAGE);
+	if (buf == NULL) return nowdb_err_get(nowdb_err_no_mem, FALSE,
+	                                 wrk->name, "allocating chunk");
+
+	for(rec=nowdb_xsort_top(xs); rec!=NULL; rec=nowdb_xsort_top(xs)) {
+		memcpy(buf+(k/n)*NOWDB_IDX_PAGE+(k%n)*store->recsize,
+		                                   rec, store->recsize);
+		k++;
+		err = nowdb_xsort_pop(xs);
+		if (err != NOWDB_OK) break;
+		if (k < max) continue;
+
+		err = putChunk(store, buf, COMPACTCHUNK*NOWDB_IDX_PAGE,
+		                                  readers, &file);
+		if (err != NOWDB_OK) break;
+		memset(buf, 0, COMPACTCHUNK*NOWDB_IDX_PAGE); k = 0;
+
+		err = throttle(wrk, store);
+		if (err != NOWDB_OK) break;
+		if (cancelled(wrk)) {
+			err = nowdb_err_get(nowdb_err_busy, FALSE, wrk->name,
+			                           "stopped while compacting");
+			break;
+		}
+	}
+	if (err == NOWDB_OK && k > 0) {
+		err = putChunk(store, buf, (k+n-1)/n*NOWDB_IDX_PAGE,
+		                                      readers, &file);
+	}
+	if (file != NULL) releaseCCtx(store, file);
+	free(buf);
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Compactor: give up
+ * ------------------------------------------------------------------------
+ */
+static inline void dropOrdered(nowdb_store_t  *store,
+                               ts_algo_list_t *readers) {
+	ts_algo_list_node_t *runner;
+	nowdb_file_t *file;
+
+	for(runner=readers->head; runner!=NULL; runner=runner->nxt) {
+		file = runner->cont;
+		releaseCCtx(store, file);
+		if (file->state == nowdb_file_state_open) {
+			NOWDB_IGNORE(nowdb_file_close(file));
+		}
+		NOWDB_IGNORE(nowdb_file_remove(file));
+		nowdb_file_destroy(file); free(file);
+	}
+	ts_algo_list_destroy(readers);
+}
+
+/* ------------------------------------------------------------------------
+ * Compactor: release the old readers
+ * ------------------------------------------------------------------------
+ */
+static inline void releaseOld(nowdb_store_t *store,
+                              ts_algo_list_t  *old) {
+	ts_algo_list_node_t *runner;
+
+	for(runner=old->head; runner!=NULL; runner=runner->nxt) {
+		NOWDB_IGNORE(nowdb_store_releaseReader(store, runner->cont));
+	}
+	nowdb_store_destroyFiles(store, old);
+}
+
+/* ------------------------------------------------------------------------
+ * Compactor: drop the pages of retired readers from all indices;
+ *            this is done only when no query holds files,
+ *            since a query that started before compaction
+ *            still finds the old pages through the index.
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t purge(nowdb_store_t *store) {
+	nowdb_err_t err = NOWDB_OK;
+	nowdb_err_t err2;
+	ts_algo_list_t idxes;
+	ts_algo_list_node_t *runner;
+	nowdb_index_desc_t *desc;
+	nowdb_fileid_t *fids;
+	uint32_t n;
+
+	err = nowdb_store_getPurgeable(store, &fids, &n);
+	if (err != NOWDB_OK) return err;
+	if (n == 0) return NOWDB_OK;
+
+	if (store->iman != NULL) {
+		ts_algo_list_init(&idxes);
+		err = nowdb_index_man_getAllOf(store->iman,
+		                   store->context, &idxes);
+		if (err != NOWDB_OK) {
+			free(fids); return err;
+		}
+		for(runner=idxes.head; runner!=NULL; runner=runner->nxt) {
+			desc = runner->cont;
+			if (desc->idx == NULL) continue;
+			err = nowdb_index_use(desc->idx);
+			if (err != NOWDB_OK) break;
+			err = nowdb_index_dropFiles(desc->idx, fids, n);
+			err2 = nowdb_index_enduse(desc->idx);
+			if (err2 != NOWDB_OK) {
+				err2->cause = err; err = err2;
+			}
+			if (err != NOWDB_OK) break;
+		}
+		ts_algo_list_destroy(&idxes);
+	}
+	free(fids);
+	if (err != NOWDB_OK) return err;
+	return nowdb_store_setPurged(store, n);
+}
+
+/* ------------------------------------------------------------------------
+ * Compactor: merge one group of overlapping readers
+ * ------------------------------------------------------------------------
+ * The readers in the group are sorted locally, block by block.
+ * They are merged by the external sort and written
+ * to new readers that are ordered as a whole.
+ * The new readers replace the old ones in one step.
+ * Their pages are indexed when they are written;
+ * the index entries of the old pages are purged
+ * once no query holds files anymore (see purge).
+ * Until then, queries that started later ignore them,
+ * since they do not find the old files.
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t compact(nowdb_worker_t *wrk,
+                                  nowdb_store_t *store) {
+	nowdb_err_t err;
+	ts_algo_list_node_t *runner;
+	ts_algo_list_t old, readers;
+	nowdb_xsort_t *xs = NULL;
+	char busy;
+
+	/* sorting comes first */
+	err = backlog(store, &busy);
+	if (err != NOWDB_OK) return err;
+	if (busy) return NOWDB_OK;
+
+	/* entries of earlier compactions */
+	err = purge(store);
+	if (err != NOWDB_OK) return err;
+
+	ts_algo_list_init(&old);
+	ts_algo_list_init(&readers);
+
+	err = nowdb_store_getCompactable(store, &old,
+	                      NOWDB_STORE_COMPACTMAX);
+	if (err != NOWDB_OK) {
+		releaseOld(store, &old); return err;
+	}
+	if (old.len == 0) return NOWDB_OK;
+
+	err = nowdb_xsort_new(&xs, store->path, NOWDB_COMP_LZ4,
+	                      store->recsize, COMPACTRUN,
+	                      store->compare, NULL);
+	if (err != NOWDB_OK) {
+		releaseOld(store, &old); return err;
+	}
+
+	for(runner=old.head; runner!=NULL; runner=runner->nxt) {
+		if (cancelled(wrk)) {
+			err = nowdb_err_get(nowdb_err_busy, FALSE, wrk->name,
+			                           "stopped while compacting");
+			goto failure;
+		}
+		err = feedSort(store, runner->cont, xs);
+		if (err != NOWDB_OK) goto failure;
+	}
+	err = nowdb_xsort_finish(xs);
+	if (err != NOWDB_OK) goto failure;
+
+	err = writeOrdered(wrk, store, xs, &readers);
+	if (err != NOWDB_OK) goto failure;
+
+	nowdb_xsort_destroy(xs); free(xs); xs = NULL;
+
+	err = nowdb_store_swapReaders(store, &old, &readers);
+	if (err != NOWDB_OK) goto failure;
+
+	/* the new readers belong to the store now */
+	ts_algo_list_destroy(&readers);
+	nowdb_store_destroyFiles(store, &old);
+	return purge(store);
+
+failure:
+	if (xs != NULL) {
+		nowdb_xsort_destroy(xs); free(xs);
+	}
+	dropOrdered(store, &readers);
+	releaseOld(store, &old);
+	if (err->errcode == nowdb_err_busy) {
+		nowdb_err_release(err); return NOWDB_OK;
+	}
+	return err;
+}
+
+/* ------------------------------------------------------------------------
+ * Compactor: pin the ith store of the storage;
+ *            a pinned store is not removed from the storage
+ *            (see nowdb_storage_removeStore).
+ *            If there is no ith store, store is NULL.
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t pin(nowdb_storage_t *strg,
+                              uint32_t            i,
+                              nowdb_store_t **store) {
+	nowdb_err_t err;
+	ts_algo_list_node_t *runner;
+	uint32_t k=0;
+
+	*store = NULL;
+
+	err = nowdb_lock(&strg->lock);
+	if (err != NOWDB_OK) return err;
+
+	for(runner=strg->stores.head; runner!=NULL; runner=runner->nxt) {
+		if (k == i) {
+			*store = runner->cont; break;
+		}
+		k++;
+	}
+	strg->compacting = *store;
+	strg->cancel = 0;
+
+	return nowdb_unlock(&strg->lock);
+}
+
+/* ------------------------------------------------------------------------
+ * Compactor: unpin the store
+ * ------------------------------------------------------------------------
+ */
+static inline nowdb_err_t unpin(nowdb_storage_t *strg) {
+	nowdb_err_t err;
+
+	err = nowdb_lock(&strg->lock);
+	if (err != NOWDB_OK) return err;
+
+	strg->compacting = NULL;
+	strg->cancel = 0;
+
+	return nowdb_unlock(&strg->lock);
+}
+
+/* ------------------------------------------------------------------------
+ * Compactor: one group per store and period;
+ *            the storage lock is held only to pin the next store,
+ *            so syncjob, addStore and removeStore are not blocked
+ *            while we compact. Stores added or removed meanwhile
+ *            may be skipped or visited twice in this period,
+ *            which is harmless.
+ * ------------------------------------------------------------------------
+ */
+static nowdb_err_t compactjob(nowdb_worker_t      *wrk,
+                              uint32_t              id,
+                              nowdb_wrk_message_t *msg) {
+	nowdb_err_t err = NOWDB_OK;
+	nowdb_err_t err2;
+	nowdb_storage_t *strg = wrk->rsc;
+	nowdb_store_t *store;
+
+	for(uint32_t i=0; !stopping(wrk); i++) {
+		err = pin(strg, i, &store);
+		if (err != NOWDB_OK) break;
+		if (store == NULL) break;
+
+		err = compact(wrk, store);
+
+		err2 = unpin(strg);
+		if (err2 != NOWDB_OK) {
+			err2->cause = err; return err2;
+		}
+		if (err != NOWDB_OK) break;
+	}
+	return err;
+}
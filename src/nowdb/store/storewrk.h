@@ -40,11 +40,34 @@ nowdb_err_t nowdb_store_startSorter(nowdb_worker_t *wrk,
  */
 nowdb_err_t nowdb_store_stopSorter(nowdb_worker_t *wrk);
 
+/* ------------------------------------------------------------------------
+ * Start Compactor
+ * ---------------
+ * The compactor periodically merges sorted readers
+ * that overlap in time into fully ordered readers.
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_store_startCompactor(nowdb_worker_t *wrk,
+                                       void       *storage,
+                                       nowdb_queue_t *errq);
+
+/* ------------------------------------------------------------------------
+ * Stop Compactor
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_store_stopCompactor(nowdb_worker_t *wrk);
+
 /* ------------------------------------------------------------------------
  * Sorter, sort now!
  * ------------------------------------------------------------------------
  */
 nowdb_err_t nowdb_store_sortNow(nowdb_storage_t *strg, void *store);
 
+/* ------------------------------------------------------------------------
+ * Compactor, compact now!
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_store_compactNow(nowdb_storage_t *strg);
+
 #endif
 
@@ -912,3 +912,55 @@ nowdb_err_t nowdb_text_reserve64(nowdb_text_t *txt,
                                  uint32_t      n,
                                  nowdb_key_t  *lo,
                                  nowdb_key_t  *hi);
+
+/* ------------------------------------------------------------------------
+ * Get text for many keys
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_text_getTexts(nowdb_text_t *txt,
+                                nowdb_key_t  *keys,
+                                uint32_t         n,
+                                char         **strs) {
+	nowdb_err_t err2, err=NOWDB_OK;
+	uint32_t i;
+
+	TEXTNULL();
+
+	if (keys == NULL) return nowdb_err_get(nowdb_err_invalid,
+	                            FALSE, OBJECT, "keys is NULL");
+	if (strs == NULL) return nowdb_err_get(nowdb_err_invalid,
+	                         FALSE, OBJECT, "strings is NULL");
+	if (n == 0) return NOWDB_OK;
+
+	err = nowdb_lock_write(&txt->lock);
+	if (err != NOWDB_OK) return err;
+
+	for(i=0; i<n; i++) {
+		if (keys[i] == NULLKEY) {
+			strs[i] = calloc(1,1);
+			if (strs[i] == NULL) {
+				NOMEM("allocating null text");
+				break;
+			}
+			continue;
+		}
+		err = getString(txt, keys[i], strs+i, TRUE);
+		if (err != NOWDB_OK) break;
+		if (strs[i] == NULL) {
+			err = nowdb_err_get(nowdb_err_key_not_found,
+			                FALSE, OBJECT, "searching text");
+			break;
+		}
+	}
+	err2 = nowdb_unlock_write(&txt->lock);
+	if (err2 != NOWDB_OK) {
+		err2->cause = err;
+		err = err2;
+	}
+	if (err != NOWDB_OK) {
+		for(uint32_t j=0; j<i; j++) {
+			free(strs[j]); strs[j] = NULL;
+		}
+	}
+	return err;
+}
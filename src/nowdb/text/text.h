@@ -112,4 +112,17 @@ nowdb_err_t nowdb_text_getKey(nowdb_text_t *txt,
 nowdb_err_t nowdb_text_getText(nowdb_text_t *txt,
                                nowdb_key_t   key,
                                char        **str);
+
+/* ------------------------------------------------------------------------
+ * Get text for many keys
+ * ----------------------
+ * The keys should be sorted, so the indices are visited in order;
+ * the lock is obtained only once for all of them.
+ * On success, strs[i] is the text for keys[i] (to be freed by the caller).
+ * ------------------------------------------------------------------------
+ */
+nowdb_err_t nowdb_text_getTexts(nowdb_text_t *txt,
+                                nowdb_key_t  *keys,
+                                uint32_t         n,
+                                char         **strs);
 #endif
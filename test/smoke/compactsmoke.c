@@ -0,0 +1,943 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Simple tests for compaction
+ * ========================================================================
+ */
+#include <nowdb/types/types.h>
+#include <nowdb/scope/scope.h>
+#include <nowdb/store/store.h>
+#include <nowdb/store/storewrk.h>
+#include <nowdb/reader/reader.h>
+#include <nowdb/task/task.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#define NSTORED 500000
+#define PRIME     7919
+#define STEP       997
+#define NBATCH       4
+
+#define DELAY 10000000
+#define WAIT      6000
+
+#define VRTX_SIZE   17
+#define RECPAGE (NOWDB_IDX_PAGE/VRTX_SIZE)
+
+typedef struct {
+	uint64_t id;
+	uint64_t value;
+	char     byte; // control byte
+} __attribute__((packed)) myvrtx_t;
+
+/* ------------------------------------------------------------------------
+ * Vertices found in readers (the rest is still in the writer)
+ * ------------------------------------------------------------------------
+ */
+static char *indexed = NULL;
+
+/* ------------------------------------------------------------------------
+ * Vertex 'id' (the value is derived from the id)
+ * ------------------------------------------------------------------------
+ */
+static void mkVertex(myvrtx_t *v, uint64_t id) {
+	v->id = id;
+	v->value = id*10;
+	v->byte = 3;
+}
+
+/* ------------------------------------------------------------------------
+ * Add property
+ * ------------------------------------------------------------------------
+ */
+static int addProp(ts_algo_list_t *props, char *name, uint32_t pos) {
+	nowdb_model_prop_t *p;
+
+	p = calloc(1, sizeof(nowdb_model_prop_t));
+	if (p == NULL) return -1;
+
+	p->name = strdup(name);
+	if (p->name == NULL) {
+		free(p); return -1;
+	}
+	p->pk = pos == 0;
+	p->pos = pos;
+	p->value = NOWDB_TYP_UINT;
+
+	if (ts_algo_list_append(props, p) != TS_ALGO_OK) {
+		free(p->name); free(p); return -1;
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Destroy properties not taken by the model
+ * ------------------------------------------------------------------------
+ */
+static void destroyProps(ts_algo_list_t *props) {
+	ts_algo_list_node_t *runner;
+	nowdb_model_prop_t *p;
+
+	for(runner=props->head; runner!=NULL; runner=runner->nxt) {
+		p = runner->cont;
+		free(p->name); free(p);
+	}
+	ts_algo_list_destroy(props);
+}
+
+/* ------------------------------------------------------------------------
+ * Create scope with vertex type 'vrtx' (id, value)
+ * ------------------------------------------------------------------------
+ */
+static nowdb_scope_t *mkScope(nowdb_path_t path) {
+	nowdb_err_t err;
+	nowdb_scope_t *scope;
+	nowdb_storage_config_t cfg;
+	ts_algo_list_t props;
+
+	err = nowdb_scope_new(&scope, path, 1);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return NULL;
+	}
+	/* drop the scope of a previous run */
+	err = nowdb_scope_drop(scope);
+	if (err != NOWDB_OK) nowdb_err_release(err);
+
+	err = nowdb_scope_create(scope);
+	if (err != NOWDB_OK) goto failure;
+
+	err = nowdb_scope_open(scope);
+	if (err != NOWDB_OK) goto failure;
+
+	cfg.filesize  = NOWDB_MEGA;
+	cfg.largesize = NOWDB_MEGA;
+	cfg.sorters   = 1;
+	cfg.sort      = 1;
+	cfg.comp      = NOWDB_COMP_ZSTD;
+	cfg.encp      = NOWDB_ENCP_NONE;
+
+	err = nowdb_scope_createStorage(scope, "test", &cfg);
+	if (err != NOWDB_OK) goto failure;
+
+	ts_algo_list_init(&props);
+	if (addProp(&props, "id", 0) != 0 ||
+	    addProp(&props, "value", 1) != 0) {
+		destroyProps(&props);
+		fprintf(stderr, "out-of-mem\n");
+		NOWDB_IGNORE(nowdb_scope_close(scope));
+		nowdb_scope_destroy(scope); free(scope);
+		return NULL;
+	}
+	err = nowdb_scope_createType(scope, "vrtx", &props);
+	destroyProps(&props);
+	if (err != NOWDB_OK) goto failure;
+
+	err = nowdb_scope_createContext(scope, "vrtx", "test");
+	if (err != NOWDB_OK) goto failure;
+
+	return scope;
+
+failure:
+	nowdb_err_print(err);
+	nowdb_err_release(err);
+	NOWDB_IGNORE(nowdb_scope_close(scope));
+	nowdb_scope_destroy(scope); free(scope);
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------
+ * Get context 'vrtx'
+ * ------------------------------------------------------------------------
+ */
+static nowdb_context_t *getContext(nowdb_scope_t *scope) {
+	nowdb_err_t err;
+	nowdb_context_t *ctx;
+
+	err = nowdb_scope_getContext(scope, "vrtx", &ctx);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return NULL;
+	}
+	return ctx;
+}
+
+/* ------------------------------------------------------------------------
+ * Wait until the sorter has moved all full files into readers
+ * ------------------------------------------------------------------------
+ */
+static int waitSorted(nowdb_store_t *store) {
+	nowdb_err_t err;
+	int len;
+
+	for(int i=0; i<WAIT; i++) {
+		err = nowdb_lock_read(&store->lock);
+		if (err != NOWDB_OK) goto failure;
+		len = store->waiting.len;
+		err = nowdb_unlock_read(&store->lock);
+		if (err != NOWDB_OK) goto failure;
+		if (len == 0) return 0;
+		err = nowdb_task_sleep(DELAY);
+		if (err != NOWDB_OK) goto failure;
+	}
+	fprintf(stderr, "waited for too long\n");
+	return -1;
+
+failure:
+	nowdb_err_print(err);
+	nowdb_err_release(err);
+	return -1;
+}
+
+/* ------------------------------------------------------------------------
+ * Insert vertices 0..n-1 in scattered order and in NBATCH batches.
+ * After each batch, the reader the sorter is filling is taken
+ * (as a concurrent sorter would do), so that the next batch
+ * goes to a new reader and the readers overlap.
+ * ------------------------------------------------------------------------
+ */
+static int storeVertices(nowdb_store_t *store, uint64_t n) {
+	nowdb_err_t err = NOWDB_OK;
+	ts_algo_list_t taken;
+	ts_algo_list_node_t *runner;
+	nowdb_file_t *file;
+	myvrtx_t v;
+	int rc = 0;
+
+	ts_algo_list_init(&taken);
+	for(uint64_t i=0; i<n; i++) {
+		mkVertex(&v, (i*PRIME)%n);
+		err = nowdb_store_insert(store, &v);
+		if (err != NOWDB_OK) break;
+
+		if ((i+1)%(n/NBATCH) != 0 || i+1 == n) continue;
+		if (waitSorted(store) != 0) {
+			rc = -1; break;
+		}
+		err = nowdb_store_getFreeReader(store, &file);
+		if (err != NOWDB_OK) break;
+		if (file == NULL) continue;
+		if (ts_algo_list_append(&taken, file) != TS_ALGO_OK) {
+			fprintf(stderr, "out-of-mem\n");
+			NOWDB_IGNORE(nowdb_store_releaseReader(store, file));
+			nowdb_file_destroy(file); free(file);
+			rc = -1; break;
+		}
+	}
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		rc = -1;
+	}
+	if (rc == 0) rc = waitSorted(store);
+	for(runner=taken.head; runner!=NULL; runner=runner->nxt) {
+		err = nowdb_store_releaseReader(store, runner->cont);
+		if (err != NOWDB_OK) {
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			rc = -1;
+		}
+	}
+	nowdb_store_destroyFiles(store, &taken);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * Count readers and ordered readers
+ * ------------------------------------------------------------------------
+ */
+static int countReaders(nowdb_store_t *store,
+                        uint32_t      *total,
+                        uint32_t    *ordered) {
+	nowdb_err_t err;
+	ts_algo_list_t files;
+	ts_algo_list_node_t *runner;
+	nowdb_file_t *file;
+
+	*total = 0; *ordered = 0;
+
+	ts_algo_list_init(&files);
+	err = nowdb_store_getReaders(store, &files, NOWDB_TIME_DAWN,
+	                                            NOWDB_TIME_DUSK);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_store_destroyFiles(store, &files);
+		return -1;
+	}
+	for(runner=files.head; runner!=NULL; runner=runner->nxt) {
+		file = runner->cont;
+		if (file->ctrl & NOWDB_FILE_ORDER) (*ordered)++;
+		(*total)++;
+	}
+	nowdb_store_destroyFiles(store, &files);
+	fprintf(stderr, "readers: %u (ordered: %u)\n", *total, *ordered);
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Scan files (in list order);
+ * count the records, mark them in 'seen' (if not NULL)
+ * and check that the ids increase (if 'order')
+ * ------------------------------------------------------------------------
+ */
+static int scan(ts_algo_list_t *files, char *seen,
+                char order, uint64_t *count) {
+	nowdb_err_t err;
+	nowdb_reader_t *reader;
+	myvrtx_t *v;
+	uint64_t last = 0;
+	char *page;
+
+	err = nowdb_reader_fullscan(&reader, files, NULL);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return -1;
+	}
+	for(;;) {
+		err = nowdb_reader_move(reader);
+		if (err != NOWDB_OK) break;
+
+		page = nowdb_reader_page(reader);
+		for(uint32_t i=0; i<RECPAGE; i++) {
+			v = (myvrtx_t*)(page+i*VRTX_SIZE);
+			if (memcmp(v, nowdb_nullrec, VRTX_SIZE) == 0) continue;
+			if (v->id >= NSTORED || v->value != v->id*10) {
+				fprintf(stderr, "wrong vertex: %lu/%lu\n",
+				                          v->id, v->value);
+				nowdb_reader_destroy(reader); free(reader);
+				return -1;
+			}
+			if (order && *count > 0 && v->id <= last) {
+				fprintf(stderr, "not in order: %lu after %lu\n",
+				                                  v->id, last);
+				nowdb_reader_destroy(reader); free(reader);
+				return -1;
+			}
+			if (seen != NULL) {
+				if (seen[v->id]) {
+					fprintf(stderr, "twice: %lu\n", v->id);
+					nowdb_reader_destroy(reader);
+					free(reader);
+					return -1;
+				}
+				seen[v->id] = 1;
+			}
+			last = v->id;
+			(*count)++;
+		}
+	}
+	nowdb_reader_destroy(reader); free(reader);
+	if (err->errcode != nowdb_err_eof) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return -1;
+	}
+	nowdb_err_release(err);
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Records in readers are exactly those marked in 'indexed'
+ * (on first call, 'indexed' is set);
+ * all records together are exactly 0..NSTORED-1
+ * ------------------------------------------------------------------------
+ */
+static int checkRecords(nowdb_store_t *store) {
+	nowdb_err_t err;
+	ts_algo_list_t files;
+	uint64_t count = 0;
+	char *seen;
+	char first = 0;
+
+	seen = calloc(NSTORED, 1);
+	if (seen == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		return -1;
+	}
+	if (indexed == NULL) {
+		indexed = calloc(NSTORED, 1);
+		if (indexed == NULL) {
+			fprintf(stderr, "out-of-mem\n");
+			free(seen); return -1;
+		}
+		first = 1;
+	}
+
+	/* readers */
+	ts_algo_list_init(&files);
+	err = nowdb_store_getReaders(store, &files, NOWDB_TIME_DAWN,
+	                                            NOWDB_TIME_DUSK);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_store_destroyFiles(store, &files);
+		free(seen); return -1;
+	}
+	if (scan(&files, seen, 0, &count) != 0) {
+		nowdb_store_destroyFiles(store, &files);
+		free(seen); return -1;
+	}
+	nowdb_store_destroyFiles(store, &files);
+
+	if (first) memcpy(indexed, seen, NSTORED);
+	if (memcmp(indexed, seen, NSTORED) != 0) {
+		fprintf(stderr, "readers changed\n");
+		free(seen); return -1;
+	}
+
+	/* pending */
+	ts_algo_list_init(&files);
+	err = nowdb_store_getAllWaiting(store, &files);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_store_destroyFiles(store, &files);
+		free(seen); return -1;
+	}
+	if (scan(&files, seen, 0, &count) != 0) {
+		nowdb_store_destroyFiles(store, &files);
+		free(seen); return -1;
+	}
+	nowdb_store_destroyFiles(store, &files);
+	free(seen);
+
+	if (count != NSTORED) {
+		fprintf(stderr, "wrong count: %lu\n", count);
+		return -1;
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Every ordered reader is ordered as a whole
+ * ------------------------------------------------------------------------
+ */
+static int checkOrder(nowdb_store_t *store) {
+	nowdb_err_t err;
+	ts_algo_list_t files, one;
+	ts_algo_list_node_t *runner;
+	nowdb_file_t *file;
+	uint64_t count;
+	int rc = 0;
+
+	ts_algo_list_init(&files);
+	err = nowdb_store_getReaders(store, &files, NOWDB_TIME_DAWN,
+	                                            NOWDB_TIME_DUSK);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_store_destroyFiles(store, &files);
+		return -1;
+	}
+	for(runner=files.head; runner!=NULL; runner=runner->nxt) {
+		file = runner->cont;
+		if (!(file->ctrl & NOWDB_FILE_ORDER)) continue;
+
+		ts_algo_list_init(&one);
+		if (ts_algo_list_append(&one, file) != TS_ALGO_OK) {
+			fprintf(stderr, "out-of-mem\n");
+			rc = -1; break;
+		}
+		count = 0;
+		rc = scan(&one, NULL, 1, &count);
+		ts_algo_list_destroy(&one);
+		if (rc != 0) break;
+		if (count == 0) {
+			fprintf(stderr, "empty ordered reader\n");
+			rc = -1; break;
+		}
+	}
+	nowdb_store_destroyFiles(store, &files);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * Search every STEP-th vertex through the index;
+ * vertices in readers are found exactly once, the others not at all.
+ * If 'files' is NULL, the current files of the store are used.
+ * If 'gone' is set, the index must not lead to any of the files.
+ * ------------------------------------------------------------------------
+ */
+static int checkLookups(nowdb_scope_t   *scope,
+                        nowdb_context_t   *ctx,
+                        ts_algo_list_t  *files,
+                        char              gone) {
+	nowdb_err_t err;
+	nowdb_index_t *idx;
+	nowdb_reader_t *reader = NULL;
+	ts_algo_list_t mine;
+	ts_algo_list_t *fs = files;
+	myvrtx_t *v;
+	uint32_t found;
+	char *page;
+	int rc = 0;
+
+	err = nowdb_scope_getVidx(scope, ctx, &idx);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return -1;
+	}
+	if (fs == NULL) {
+		ts_algo_list_init(&mine);
+		err = nowdb_store_getFiles(&ctx->store, &mine,
+		                           NOWDB_TIME_DAWN,
+		                           NOWDB_TIME_DUSK);
+		if (err != NOWDB_OK) {
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			return -1;
+		}
+		fs = &mine;
+	}
+	for(uint64_t k=0; k<NSTORED; k+=STEP) {
+		if (reader == NULL) {
+			err = nowdb_reader_search(&reader, fs, idx,
+			                          (char*)&k, NULL);
+			if (err != NOWDB_OK) reader = NULL;
+		} else {
+			err = nowdb_reader_research(reader, idx, (char*)&k);
+		}
+		if (err != NOWDB_OK) break;
+
+		found = 0;
+		while(!reader->nodata) {
+			err = nowdb_reader_move(reader);
+			if (err != NOWDB_OK) break;
+
+			page = nowdb_reader_page(reader);
+			for(uint32_t i=0; i<RECPAGE; i++) {
+				v = (myvrtx_t*)(page+i*VRTX_SIZE);
+				if (v->id != k || v->byte == 0) continue;
+				if (v->value != k*10) {
+					fprintf(stderr, "wrong value: %lu/%lu\n",
+					                         k, v->value);
+					rc = -1;
+				}
+				found++;
+			}
+		}
+		if (err != NOWDB_OK) {
+			if (err->errcode != nowdb_err_eof) break;
+			nowdb_err_release(err); err = NOWDB_OK;
+		}
+		if (found != (gone?0:(uint32_t)indexed[k])) {
+			fprintf(stderr, "vertex %lu found %u times\n", k, found);
+			rc = -1;
+		}
+		if (rc != 0) break;
+	}
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		rc = -1;
+	}
+	if (reader != NULL) {
+		nowdb_reader_destroy(reader); free(reader);
+	}
+	if (fs == &mine) nowdb_store_releaseFiles(&ctx->store, &mine);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * Get retired readers
+ * ------------------------------------------------------------------------
+ */
+static int countRetired(nowdb_store_t *store, uint32_t *n) {
+	nowdb_err_t err;
+
+	err = nowdb_lock_read(&store->lock);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return -1;
+	}
+	*n = store->retired.len;
+	err = nowdb_unlock_read(&store->lock);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return -1;
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Compact until there is nothing left to compact
+ * ------------------------------------------------------------------------
+ */
+static int compactAll(nowdb_store_t *store) {
+	nowdb_err_t err;
+	ts_algo_list_t old;
+	ts_algo_list_node_t *runner;
+	uint32_t before, after;
+	int i;
+
+	for(;;) {
+		/* is there a group? */
+		ts_algo_list_init(&old);
+		err = nowdb_store_getCompactable(store, &old,
+		                       NOWDB_STORE_COMPACTMAX);
+		if (err != NOWDB_OK) goto failure;
+		if (old.len == 0) break;
+
+		fprintf(stderr, "compacting %u readers\n", old.len);
+		for(runner=old.head; runner!=NULL; runner=runner->nxt) {
+			err = nowdb_store_releaseReader(store, runner->cont);
+			if (err != NOWDB_OK) break;
+		}
+		nowdb_store_destroyFiles(store, &old);
+		if (err != NOWDB_OK) goto failure;
+
+		if (countRetired(store, &before) != 0) return -1;
+
+		err = nowdb_store_compactNow(store->storage);
+		if (err != NOWDB_OK) goto failure;
+
+		for(i=0; i<WAIT; i++) {
+			if (countRetired(store, &after) != 0) return -1;
+			if (after > before) break;
+			err = nowdb_task_sleep(DELAY);
+			if (err != NOWDB_OK) goto failure;
+		}
+		if (i == WAIT) {
+			fprintf(stderr, "waited for too long\n");
+			return -1;
+		}
+	}
+	return 0;
+
+failure:
+	nowdb_err_print(err);
+	nowdb_err_release(err);
+	return -1;
+}
+
+/* ------------------------------------------------------------------------
+ * Wake the compactor until all retired readers are purged from the index
+ * ------------------------------------------------------------------------
+ */
+static int waitPurged(nowdb_store_t *store) {
+	nowdb_err_t err;
+	uint32_t purged, retired;
+
+	for(int i=0; i<WAIT; i++) {
+		err = nowdb_lock_read(&store->lock);
+		if (err != NOWDB_OK) goto failure;
+		purged = store->purged;
+		retired = store->retired.len;
+		err = nowdb_unlock_read(&store->lock);
+		if (err != NOWDB_OK) goto failure;
+		if (purged == retired) {
+			fprintf(stderr, "purged: %u\n", purged);
+			return 0;
+		}
+		if (i%100 == 0) {
+			err = nowdb_store_compactNow(store->storage);
+			if (err != NOWDB_OK) goto failure;
+		}
+		err = nowdb_task_sleep(DELAY);
+		if (err != NOWDB_OK) goto failure;
+	}
+	fprintf(stderr, "waited for too long\n");
+	return -1;
+
+failure:
+	nowdb_err_print(err);
+	nowdb_err_release(err);
+	return -1;
+}
+
+/* ------------------------------------------------------------------------
+ * New data do not go to ordered readers
+ * ------------------------------------------------------------------------
+ */
+static int checkFree(nowdb_store_t *store) {
+	nowdb_err_t err;
+	nowdb_file_t *file = NULL;
+	int rc = 0;
+
+	err = nowdb_store_getFreeReader(store, &file);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return -1;
+	}
+	if (file == NULL) return 0;
+
+	if (file->ctrl & NOWDB_FILE_ORDER) {
+		fprintf(stderr, "ordered reader is free\n");
+		rc = -1;
+	}
+	err = nowdb_store_releaseReader(store, file);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		rc = -1;
+	}
+	nowdb_file_destroy(file); free(file);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * Paths of readers that were compacted away
+ * ------------------------------------------------------------------------
+ */
+static int getRetired(nowdb_store_t  *store,
+                      ts_algo_list_t *stale,
+                      ts_algo_list_t *paths) {
+	nowdb_err_t err;
+	ts_algo_list_node_t *runner;
+	nowdb_file_t *file;
+	nowdb_bool_t found;
+	char *path;
+
+	for(runner=stale->head; runner!=NULL; runner=runner->nxt) {
+		file = runner->cont;
+		if (!(file->ctrl & NOWDB_FILE_SORT)) continue;
+
+		err = nowdb_store_findReader(store, file, &found);
+		if (err != NOWDB_OK) {
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			return -1;
+		}
+		if (found) continue;
+
+		path = strdup(file->path);
+		if (path == NULL) {
+			fprintf(stderr, "out-of-mem\n");
+			return -1;
+		}
+		if (ts_algo_list_append(paths, path) != TS_ALGO_OK) {
+			fprintf(stderr, "out-of-mem\n");
+			free(path); return -1;
+		}
+	}
+	if (paths->len == 0) {
+		fprintf(stderr, "no reader was retired\n");
+		return -1;
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Destroy paths
+ * ------------------------------------------------------------------------
+ */
+static void destroyPaths(ts_algo_list_t *paths) {
+	ts_algo_list_node_t *runner;
+
+	for(runner=paths->head; runner!=NULL; runner=runner->nxt) {
+		free(runner->cont);
+	}
+	ts_algo_list_destroy(paths);
+}
+
+/* ------------------------------------------------------------------------
+ * Readers that were compacted away are removed from disk
+ * ------------------------------------------------------------------------
+ */
+static int checkRemoved(ts_algo_list_t *paths) {
+	ts_algo_list_node_t *runner;
+
+	for(runner=paths->head; runner!=NULL; runner=runner->nxt) {
+		if (nowdb_path_exists(runner->cont, NOWDB_DIR_TYPE_ANY)) {
+			fprintf(stderr, "retired reader still there: %s\n",
+			                           (char*)runner->cont);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Records, order and lookups before and after compaction
+ * and after reopening the scope; retired readers are gone
+ * ------------------------------------------------------------------------
+ */
+static int testCompact() {
+	nowdb_err_t err;
+	nowdb_scope_t *scope;
+	nowdb_context_t *ctx = NULL;
+	ts_algo_list_t old, stale, paths;
+	uint32_t total, ordered;
+	uint32_t total2, ordered2;
+	int rc = 0;
+
+	ts_algo_list_init(&old);
+	ts_algo_list_init(&stale);
+	ts_algo_list_init(&paths);
+
+	scope = mkScope("rsc/compact10");
+	if (scope == NULL) return -1;
+
+	ctx = getContext(scope);
+	if (ctx == NULL) {
+		rc = -1; goto cleanup;
+	}
+	if (storeVertices(&ctx->store, NSTORED) != 0) {
+		rc = -1; goto cleanup;
+	}
+	if (countReaders(&ctx->store, &total, &ordered) != 0) {
+		rc = -1; goto cleanup;
+	}
+	if (total < 2) {
+		fprintf(stderr, "too few readers: %u\n", total);
+		rc = -1; goto cleanup;
+	}
+	if (checkRecords(&ctx->store) != 0) {
+		fprintf(stderr, "checkRecords failed before compaction\n");
+		rc = -1; goto cleanup;
+	}
+	if (checkLookups(scope, ctx, NULL, 0) != 0) {
+		fprintf(stderr, "checkLookups failed before compaction\n");
+		rc = -1; goto cleanup;
+	}
+
+	/* the readers as they are now (without holding them) */
+	err = nowdb_store_getReaders(&ctx->store, &stale, NOWDB_TIME_DAWN,
+	                                                  NOWDB_TIME_DUSK);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		rc = -1; goto cleanup;
+	}
+
+	/* a search that started before compaction */
+	err = nowdb_store_getFiles(&ctx->store, &old, NOWDB_TIME_DAWN,
+	                                              NOWDB_TIME_DUSK);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		rc = -1; goto cleanup;
+	}
+
+	if (compactAll(&ctx->store) != 0) {
+		fprintf(stderr, "compactAll failed\n");
+		rc = -1; goto cleanup;
+	}
+	if (countReaders(&ctx->store, &total2, &ordered2) != 0) {
+		rc = -1; goto cleanup;
+	}
+	if (ordered2 == 0 || total2 >= total) {
+		fprintf(stderr, "nothing was compacted\n");
+		rc = -1; goto cleanup;
+	}
+	if (checkFree(&ctx->store) != 0) {
+		fprintf(stderr, "checkFree failed\n");
+		rc = -1; goto cleanup;
+	}
+	if (checkOrder(&ctx->store) != 0) {
+		fprintf(stderr, "checkOrder failed\n");
+		rc = -1; goto cleanup;
+	}
+	if (checkRecords(&ctx->store) != 0) {
+		fprintf(stderr, "checkRecords failed after compaction\n");
+		rc = -1; goto cleanup;
+	}
+	if (checkLookups(scope, ctx, NULL, 0) != 0) {
+		fprintf(stderr, "checkLookups failed after compaction\n");
+		rc = -1; goto cleanup;
+	}
+	if (checkLookups(scope, ctx, &old, 0) != 0) {
+		fprintf(stderr, "checkLookups failed on old readers\n");
+		rc = -1; goto cleanup;
+	}
+	nowdb_store_releaseFiles(&ctx->store, &old);
+
+	/* nobody holds the old readers anymore */
+	if (waitPurged(&ctx->store) != 0) {
+		rc = -1; goto cleanup;
+	}
+	if (checkLookups(scope, ctx, &stale, 1) != 0) {
+		fprintf(stderr, "checkLookups found purged readers\n");
+		rc = -1; goto cleanup;
+	}
+	if (checkLookups(scope, ctx, NULL, 0) != 0) {
+		fprintf(stderr, "checkLookups failed after purging\n");
+		rc = -1; goto cleanup;
+	}
+	if (getRetired(&ctx->store, &stale, &paths) != 0) {
+		rc = -1; goto cleanup;
+	}
+	nowdb_store_destroyFiles(&ctx->store, &stale);
+
+	/* catalog */
+	err = nowdb_scope_close(scope);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		rc = -1; goto cleanup;
+	}
+	err = nowdb_scope_open(scope);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		rc = -1; goto cleanup;
+	}
+	ctx = getContext(scope);
+	if (ctx == NULL) {
+		rc = -1; goto cleanup;
+	}
+	if (countReaders(&ctx->store, &total, &ordered) != 0) {
+		rc = -1; goto cleanup;
+	}
+	if (total != total2 || ordered != ordered2) {
+		fprintf(stderr, "readers changed on reopen\n");
+		rc = -1; goto cleanup;
+	}
+	if (checkRecords(&ctx->store) != 0) {
+		fprintf(stderr, "checkRecords failed after reopen\n");
+		rc = -1; goto cleanup;
+	}
+	if (checkLookups(scope, ctx, NULL, 0) != 0) {
+		fprintf(stderr, "checkLookups failed after reopen\n");
+		rc = -1; goto cleanup;
+	}
+	if (checkRemoved(&paths) != 0) {
+		fprintf(stderr, "checkRemoved failed\n");
+		rc = -1; goto cleanup;
+	}
+
+cleanup:
+	if (ctx != NULL) {
+		nowdb_store_releaseFiles(&ctx->store, &old);
+		nowdb_store_destroyFiles(&ctx->store, &stale);
+	}
+	destroyPaths(&paths);
+	NOWDB_IGNORE(nowdb_scope_close(scope));
+	nowdb_scope_destroy(scope); free(scope);
+	return rc;
+}
+
+int main() {
+	int rc = EXIT_SUCCESS;
+
+	if (!nowdb_init()) {
+		fprintf(stderr, "cannot init environment\n");
+		return EXIT_FAILURE;
+	}
+	if (testCompact() != 0) {
+		fprintf(stderr, "testCompact failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+
+cleanup:
+	if (indexed != NULL) free(indexed);
+	nowdb_close();
+	if (rc == EXIT_SUCCESS) {
+		fprintf(stderr, "PASSED\n");
+	} else {
+		fprintf(stderr, "FAILED\n");
+	}
+	return rc;
+}
@@ -0,0 +1,447 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Simple tests for constant folding and common subexpressions:
+ * - constant operators are replaced by constants, now() included;
+ * - lists of random expressions sharing subexpressions
+ *   must yield the same results as the unshared expressions;
+ * - shared subexpressions are evaluated once per row.
+ * ========================================================================
+ */
+#include <nowdb/types/types.h>
+#include <nowdb/types/time.h>
+#include <nowdb/fun/expr.h>
+#include <common/rndexpr.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <math.h>
+
+/* ------------------------------------------------------------------------
+ * Edge with origin, destin, stamp and NCOLS properties;
+ * the type of property k is types[k%4].
+ * ------------------------------------------------------------------------
+ */
+#define NCOLS 16
+#define NATTS (NCOLS+3)
+
+#define RECSZ (NATTS*8+16)
+
+#define NLISTS  300
+#define NFIELDS   6
+#define NPOOL     4
+#define NROWS    20
+#define DEPTH     3
+
+static nowdb_type_t types[] = {NOWDB_TYP_UINT, NOWDB_TYP_INT,
+                               NOWDB_TYP_FLOAT, NOWDB_TYP_TIME};
+
+/* ------------------------------------------------------------------------
+ * Random edge, props are NULL with a probability of 10%
+ * ------------------------------------------------------------------------
+ */
+static void mkEdge(char *rec) {
+	uint64_t u; int64_t l; double d;
+	uint8_t bit; uint16_t byte;
+
+	memset(rec, 0, RECSZ);
+
+	u = rand()%1000+1; memcpy(rec, &u, 8);
+	u = rand()%1000+1; memcpy(rec+8, &u, 8);
+	l = (int64_t)(rand()%1000000)*1000000000l; memcpy(rec+16, &l, 8);
+
+	for(int k=0; k<NCOLS; k++) {
+		char *v = rec+24+8*k;
+
+		switch(types[k%4]) {
+		case NOWDB_TYP_UINT:
+			u = rand()%100; memcpy(v, &u, 8); break;
+		case NOWDB_TYP_INT:
+			l = rand()%200-100; memcpy(v, &l, 8); break;
+		case NOWDB_TYP_FLOAT:
+			d = (double)(rand()%2000-1000)/10.0;
+			memcpy(v, &d, 8); break;
+		default:
+			l = (int64_t)(rand()%1000000)*1000000000l;
+			memcpy(v, &l, 8);
+		}
+	}
+	for(int j=0; j<NATTS; j++) {
+		if (j > 2 && rand()%10 == 0) continue;
+		nowdb_getCtrl(8*j, &bit, &byte);
+		rec[nowdb_ctrlStart(NATTS)+byte] |= 1 << bit;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Expression helpers
+ * ------------------------------------------------------------------------
+ */
+static void destroyList(nowdb_expr_t *list, uint32_t n) {
+	if (list == NULL) return;
+	for(uint32_t i=0; i<n; i++) destroyExpr(list[i]);
+}
+
+static nowdb_expr_t copy(nowdb_expr_t e) {
+	nowdb_err_t err;
+	nowdb_expr_t c;
+
+	if (e == NULL) return NULL;
+	err = nowdb_expr_copy(e, &c);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return NULL;
+	}
+	return c;
+}
+
+static nowdb_expr_t stamp() {
+	return field(NULL, NOWDB_OFF_STAMP, NOWDB_TYP_TIME);
+}
+
+static nowdb_expr_t prop(int k) {
+	char name[16];
+
+	sprintf(name, "p%d", k);
+	return field(name, 24+8*k, types[k%4]);
+}
+
+/* ------------------------------------------------------------------------
+ * Random fields;
+ * they are, with some probability, copies of expressions
+ * from the pool, so that the expressions in a list
+ * have subexpressions in common.
+ * ------------------------------------------------------------------------
+ */
+static nowdb_expr_t pool[NPOOL];
+static int npool;
+
+static nowdb_expr_t rndField() {
+	switch(rand()%5) {
+	case 0: case 1:
+		if (npool > 0) return copy(pool[rand()%npool]);
+	case 2: return stamp();
+	default: return prop(rand()%NCOLS);
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Copy and compile a list (and share its subexpressions)
+ * ------------------------------------------------------------------------
+ */
+static int mkList(nowdb_expr_t *src, nowdb_expr_t *trg,
+                  nowdb_expr_t **shared, uint32_t *nshared) {
+	nowdb_err_t err=NOWDB_OK;
+
+	for(int i=0; i<NFIELDS; i++) {
+		trg[i] = copy(src[i]);
+		if (trg[i] == NULL) {
+			destroyList(trg, i); return -1;
+		}
+	}
+	if (shared != NULL) {
+		err = nowdb_expr_share(trg, NFIELDS, shared, nshared);
+		for(int i=0; err == NOWDB_OK && i<*nshared; i++) {
+			err = nowdb_expr_compile(
+			      NOWDB_EXPR_TOREF((*shared)[i])->ref);
+		}
+	}
+	for(int i=0; err == NOWDB_OK && i<NFIELDS; i++) {
+		err = nowdb_expr_compile(trg[i]);
+	}
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return -1;
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Evaluate a list of expressions on some edges
+ * without and with shared subexpressions.
+ * ------------------------------------------------------------------------
+ */
+static int testList(nowdb_expr_t *list) {
+	nowdb_err_t err1, err2;
+	nowdb_expr_t plain[NFIELDS], cse[NFIELDS];
+	nowdb_expr_t *shared=NULL;
+	uint32_t nshared=0;
+	nowdb_type_t t1, t2;
+	char rec[RECSZ];
+	void *v1, *v2;
+	int rc = 0;
+
+	for(int i=0; i<NROWS && rc == 0; i++) {
+		mkEdge(rec);
+
+		if (mkList(list, plain, NULL, NULL) != 0) return -1;
+		if (mkList(list, cse, &shared, &nshared) != 0) {
+			destroyList(plain, NFIELDS);
+			return -1;
+		}
+		nowdb_expr_newRow(shared, nshared);
+		for(int k=0; k<NFIELDS; k++) {
+			err1 = nowdb_expr_eval(plain[k], NULL, rec, &t1, &v1);
+			err2 = nowdb_expr_eval(cse[k], NULL, rec, &t2, &v2);
+
+			if ((err1 == NOWDB_OK) != (err2 == NOWDB_OK)) {
+				fprintf(stderr, "only one failed: %d / %d\n",
+				         err1 == NOWDB_OK, err2 == NOWDB_OK);
+				rc = -1;
+			} else if (err1 == NOWDB_OK &&
+			           !sameResult(t1, v1, t2, v2)) {
+				fprintf(stderr, "results differ: %u / %u\n",
+				                                   t1, t2);
+				rc = -1;
+			}
+			nowdb_err_release(err1);
+			nowdb_err_release(err2);
+			if (rc != 0) {
+				nowdb_expr_show(list[k], stderr);
+				fprintf(stderr, "\n");
+				break;
+			}
+		}
+		destroyList(plain, NFIELDS);
+		destroyList(cse, NFIELDS);
+		destroyList(shared, nshared);
+		free(shared); shared = NULL;
+	}
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * Random lists
+ * ------------------------------------------------------------------------
+ */
+int testRandom() {
+	nowdb_expr_t list[NFIELDS];
+	int rc = 0;
+
+	for(int i=0; i<NLISTS && rc == 0; i++) {
+		for(npool=0; npool<NPOOL; npool++) {
+			pool[npool] = rndNum(2);
+			if (pool[npool] == NULL) {
+				destroyList(pool, npool); return -1;
+			}
+		}
+		for(int k=0; k<NFIELDS; k++) {
+			list[k] = rand()%4?rndNum(DEPTH):rndBool(DEPTH);
+			if (list[k] == NULL) {
+				destroyList(list, k);
+				destroyList(pool, NPOOL);
+				return -1;
+			}
+		}
+		rc = testList(list);
+		destroyList(list, NFIELDS);
+		destroyList(pool, NPOOL);
+	}
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * hour(stamp)+1, hour(stamp)*2, hour(stamp)+1, p0:
+ * - hour(stamp)+1 and hour(stamp) are shared;
+ * - the shared expressions are evaluated once per row.
+ * ------------------------------------------------------------------------
+ */
+int testOnce() {
+	nowdb_err_t err;
+	nowdb_expr_t list[4];
+	nowdb_expr_t *shared=NULL;
+	uint32_t nshared=0;
+	nowdb_type_t t;
+	nowdb_time_t h1, h2;
+	char r1[RECSZ], r2[RECSZ];
+	void *v;
+	int rc = 0;
+
+	list[0] = op2(NOWDB_EXPR_OP_ADD,
+	              op1(NOWDB_EXPR_OP_HOUR, stamp()), uconst(1));
+	list[1] = op2(NOWDB_EXPR_OP_MUL,
+	              op1(NOWDB_EXPR_OP_HOUR, stamp()), fconst(2.0));
+	list[2] = op2(NOWDB_EXPR_OP_ADD,
+	              op1(NOWDB_EXPR_OP_HOUR, stamp()), uconst(1));
+	list[3] = prop(0);
+
+	for(int i=0; i<4; i++) {
+		if (list[i] == NULL) {
+			destroyList(list, 4); return -1;
+		}
+	}
+	err = nowdb_expr_share(list, 4, &shared, &nshared);
+	if (err != NOWDB_OK) goto cleanup;
+
+	if (nshared != 2) {
+		fprintf(stderr, "expected 2 shared expressions, have %u\n",
+		                                                  nshared);
+		rc = -1; goto cleanup;
+	}
+	if (nowdb_expr_type(list[0]) != NOWDB_EXPR_REF ||
+	    nowdb_expr_type(list[2]) != NOWDB_EXPR_REF ||
+	    nowdb_expr_type(list[3]) != NOWDB_EXPR_FIELD) {
+		fprintf(stderr, "wrong expressions replaced\n");
+		rc = -1; goto cleanup;
+	}
+
+	// two different hours
+	mkEdge(r1); mkEdge(r2);
+	h1 = 3600000000000l; memcpy(r1+16, &h1, 8);
+	h2 = 7200000000000l; memcpy(r2+16, &h2, 8);
+
+	for(int k=0; k<2; k++) {
+		nowdb_expr_newRow(shared, nshared);
+
+		err = nowdb_expr_eval(list[0], NULL, r1, &t, &v);
+		if (err != NOWDB_OK) goto cleanup;
+		if (t != NOWDB_TYP_UINT || *(uint64_t*)v != 2) {
+			fprintf(stderr, "wrong result (%d): %u\n", k, t);
+			rc = -1; goto cleanup;
+		}
+		err = nowdb_expr_eval(list[1], NULL, r1, &t, &v);
+		if (err != NOWDB_OK) goto cleanup;
+		if (t != NOWDB_TYP_FLOAT || *(double*)v != 2.0) {
+			fprintf(stderr, "wrong result (%d): %u\n", k, t);
+			rc = -1; goto cleanup;
+		}
+
+		// same row: the cached results are used
+		// (even if we pass another record)
+		err = nowdb_expr_eval(list[2], NULL, r2, &t, &v);
+		if (err != NOWDB_OK) goto cleanup;
+		if (t != NOWDB_TYP_UINT || *(uint64_t*)v != 2) {
+			fprintf(stderr, "evaluated twice (%d)\n", k);
+			rc = -1; goto cleanup;
+		}
+
+		// new row
+		nowdb_expr_newRow(shared, nshared);
+		err = nowdb_expr_eval(list[2], NULL, r2, &t, &v);
+		if (err != NOWDB_OK) goto cleanup;
+		if (t != NOWDB_TYP_UINT || *(uint64_t*)v != 3) {
+			fprintf(stderr, "not evaluated again (%d)\n", k);
+			rc = -1; goto cleanup;
+		}
+
+		// and the same with programs
+		for(int i=0; i<4 && err == NOWDB_OK; i++) {
+			err = nowdb_expr_compile(list[i]);
+		}
+		for(int i=0; i<nshared && err == NOWDB_OK; i++) {
+			err = nowdb_expr_compile(
+			      NOWDB_EXPR_TOREF(shared[i])->ref);
+		}
+		if (err != NOWDB_OK) goto cleanup;
+	}
+
+cleanup:
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		rc = -1;
+	}
+	destroyList(list, 4);
+	destroyList(shared, nshared);
+	if (shared != NULL) free(shared);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * Constants are folded; now() is folded to the time passed in
+ * ------------------------------------------------------------------------
+ */
+int testFold() {
+	nowdb_err_t err;
+	nowdb_expr_t expr;
+	nowdb_const_t *c;
+	nowdb_time_t now = 1000000000000l;
+	int rc = 0;
+
+	// (2 + 3) * pi() > 15.0
+	expr = op2(NOWDB_EXPR_OP_GT,
+	           op2(NOWDB_EXPR_OP_MUL,
+	               op2(NOWDB_EXPR_OP_ADD, uconst(2), iconst(3)),
+	               op0(NOWDB_EXPR_OP_PI)),
+	           fconst(15.0));
+	if (expr == NULL) return -1;
+
+	err = nowdb_expr_fold(&expr, now);
+	if (err != NOWDB_OK) goto cleanup;
+
+	c = NOWDB_EXPR_TOCONST(expr);
+	if (nowdb_expr_type(expr) != NOWDB_EXPR_CONST ||
+	    c->type != NOWDB_TYP_BOOL || *(nowdb_value_t*)c->value != 1) {
+		fprintf(stderr, "constant not folded\n");
+		rc = -1; goto cleanup;
+	}
+	destroyExpr(expr);
+
+	// stamp > now() - 3600
+	expr = op2(NOWDB_EXPR_OP_GT, stamp(),
+	           op2(NOWDB_EXPR_OP_SUB, op0(NOWDB_EXPR_OP_NOW),
+	                                  iconst(3600)));
+	if (expr == NULL) return -1;
+
+	err = nowdb_expr_fold(&expr, now);
+	if (err != NOWDB_OK) goto cleanup;
+
+	if (nowdb_expr_type(expr) != NOWDB_EXPR_OP) {
+		fprintf(stderr, "field folded\n");
+		rc = -1; goto cleanup;
+	}
+	c = NOWDB_EXPR_TOCONST(NOWDB_EXPR_TOOP(expr)->argv[1]);
+	if (c->etype != NOWDB_EXPR_CONST ||
+	    c->type != NOWDB_TYP_TIME ||
+	    *(nowdb_time_t*)c->value != now-3600) {
+		fprintf(stderr, "now() not folded\n");
+		rc = -1; goto cleanup;
+	}
+
+cleanup:
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		rc = -1;
+	}
+	destroyExpr(expr);
+	return rc;
+}
+
+int main() {
+	int rc = EXIT_SUCCESS;
+
+	srand(time(NULL) ^ (uint64_t)&printf);
+	initRndExpr(NATTS, &rndField);
+
+	if (!nowdb_err_init()) {
+		fprintf(stderr, "cannot init error manager\n");
+		return EXIT_FAILURE;
+	}
+	if (testFold() != 0) {
+		fprintf(stderr, "testFold failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testOnce() != 0) {
+		fprintf(stderr, "testOnce failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testRandom() != 0) {
+		fprintf(stderr, "testRandom failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+
+cleanup:
+	nowdb_err_destroy();
+	if (rc == EXIT_SUCCESS) {
+		fprintf(stderr, "PASSED\n");
+	} else {
+		fprintf(stderr, "FAILED\n");
+	}
+	return rc;
+}
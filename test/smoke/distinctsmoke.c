@@ -0,0 +1,564 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Simple tests for distinct counting (hash set and hyperloglog)
+ * ========================================================================
+ */
+#include <nowdb/types/types.h>
+#include <nowdb/fun/fun.h>
+#include <nowdb/fun/hset.h>
+#include <nowdb/fun/hll.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#define NVALUES 200000
+#define NPARTS       4
+#define NSETS      200
+
+#define WEIGHT_OFF 40
+
+typedef struct {
+	uint64_t origin;
+	uint64_t destin;
+	int64_t  timestamp;
+	char     byte; // control byte
+	char     pad[7];
+	uint64_t edge;
+	uint64_t weight;
+	uint64_t weight2;
+} myedge_t;
+
+uint64_t MYEDGE = 101;
+
+nowdb_eval_t _hlp;
+
+/* ------------------------------------------------------------------------
+ * Random values with 'ndist' distinct values (including 0)
+ * ------------------------------------------------------------------------
+ */
+static uint64_t rnd64() {
+	uint64_t r = (uint64_t)rand();
+	r <<= 31; r |= (uint64_t)rand();
+	r <<= 31; r |= (uint64_t)rand();
+	return r;
+}
+
+static uint64_t getValue(uint64_t *universe, uint64_t ndist) {
+	return universe[rnd64()%ndist];
+}
+
+static uint64_t *mkUniverse(uint64_t ndist) {
+	uint64_t *u;
+
+	u = calloc(ndist, 8);
+	if (u == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		return NULL;
+	}
+	// values are unique: i in the upper bits
+	for(uint64_t i=1; i<ndist; i++) {
+		u[i] = (i << 32) | (rnd64() & 0xffffffff);
+	}
+	return u;
+}
+
+/* ------------------------------------------------------------------------
+ * Exact count of all values seen at least once
+ * ------------------------------------------------------------------------
+ */
+static uint64_t countSeen(char *seen, uint64_t ndist) {
+	uint64_t c = 0;
+	for(uint64_t i=0; i<ndist; i++) c += seen[i];
+	return c;
+}
+
+/* ------------------------------------------------------------------------
+ * Hash set: with and without spilling, merged
+ * ------------------------------------------------------------------------
+ */
+int testHset(uint64_t ndist, uint64_t budget) {
+	nowdb_err_t err = NOWDB_OK;
+	nowdb_hset_t *all=NULL, *parts[NPARTS], *merged=NULL;
+	uint64_t *u, c, x, e;
+	char *seen;
+	int rc = 0;
+
+	fprintf(stderr, "hset %lu distinct, budget %lu\n", ndist, budget);
+
+	memset(parts, 0, sizeof(parts));
+
+	u = mkUniverse(ndist);
+	if (u == NULL) return -1;
+	seen = calloc(ndist, 1);
+	if (seen == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		free(u); return -1;
+	}
+	err = nowdb_hset_new(&all, budget);
+	if (err != NOWDB_OK) goto cleanup;
+	err = nowdb_hset_new(&merged, budget);
+	if (err != NOWDB_OK) goto cleanup;
+	for(int i=0; i<NPARTS; i++) {
+		err = nowdb_hset_new(parts+i, budget);
+		if (err != NOWDB_OK) goto cleanup;
+	}
+	for(int i=0; i<NVALUES; i++) {
+		c = rnd64()%ndist; x = u[c]; seen[c] = 1;
+		err = nowdb_hset_add(all, x);
+		if (err != NOWDB_OK) goto cleanup;
+		err = nowdb_hset_add(parts[rand()%NPARTS], x);
+		if (err != NOWDB_OK) goto cleanup;
+	}
+	for(int i=0; i<NPARTS; i++) {
+		err = nowdb_hset_merge(merged, parts[i]);
+		if (err != NOWDB_OK) goto cleanup;
+	}
+	e = countSeen(seen, ndist);
+
+	err = nowdb_hset_count(all, &c);
+	if (err != NOWDB_OK) goto cleanup;
+	if (c != e) {
+		fprintf(stderr, "wrong count: %lu / %lu\n", c, e);
+		rc = -1; goto cleanup;
+	}
+	// counting twice gives the same result
+	err = nowdb_hset_count(all, &c);
+	if (err != NOWDB_OK) goto cleanup;
+	if (c != e) {
+		fprintf(stderr, "wrong count (2nd): %lu / %lu\n", c, e);
+		rc = -1; goto cleanup;
+	}
+	err = nowdb_hset_count(merged, &c);
+	if (err != NOWDB_OK) goto cleanup;
+	if (c != e) {
+		fprintf(stderr, "wrong merged count: %lu / %lu\n", c, e);
+		rc = -1; goto cleanup;
+	}
+	if (budget < ndist*8 && all->spilled == 0) {
+		fprintf(stderr, "no values spilled\n");
+		rc = -1; goto cleanup;
+	}
+	if (all->cap*8 > budget && all->cap > 64) {
+		fprintf(stderr, "budget exceeded: %lu\n", all->cap*8);
+		rc = -1; goto cleanup;
+	}
+	nowdb_hset_reset(all);
+	err = nowdb_hset_count(all, &c);
+	if (err != NOWDB_OK) goto cleanup;
+	if (c != 0) {
+		fprintf(stderr, "count after reset: %lu\n", c);
+		rc = -1; goto cleanup;
+	}
+
+cleanup:
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		rc = -1;
+	}
+	if (all != NULL) {
+		nowdb_hset_destroy(all); free(all);
+	}
+	if (merged != NULL) {
+		nowdb_hset_destroy(merged); free(merged);
+	}
+	for(int i=0; i<NPARTS; i++) {
+		if (parts[i] == NULL) continue;
+		nowdb_hset_destroy(parts[i]); free(parts[i]);
+	}
+	free(seen); free(u);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * Hash sets sharing a pool:
+ * each set counts its own values, the memory is accounted in the pool
+ * and the spilled values of all sets go to the partitions of the pool
+ * ------------------------------------------------------------------------
+ */
+int testPool(uint64_t ndist, uint64_t budget) {
+	nowdb_err_t err = NOWDB_OK;
+	nowdb_hset_pool_t pool;
+	nowdb_hset_t *sets[NSETS];
+	uint64_t *u, c, e, spilled=0;
+	char *seen;
+	int s, rc = 0;
+
+	fprintf(stderr, "pool %d sets, %lu distinct, budget %lu\n",
+	                                     NSETS, ndist, budget);
+
+	memset(sets, 0, sizeof(sets));
+	nowdb_hset_initPool(&pool, budget);
+
+	u = mkUniverse(ndist);
+	if (u == NULL) return -1;
+	seen = calloc(NSETS*ndist, 1);
+	if (seen == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		free(u); return -1;
+	}
+	for(int i=0; i<NSETS; i++) {
+		err = nowdb_hset_new(sets+i, NOWDB_HSET_MEM);
+		if (err != NOWDB_OK) goto cleanup;
+		err = nowdb_hset_setPool(sets[i], &pool);
+		if (err != NOWDB_OK) goto cleanup;
+	}
+	for(int i=0; i<NVALUES; i++) {
+		s = rand()%NSETS;
+		c = rnd64()%ndist; seen[s*ndist+c] = 1;
+		err = nowdb_hset_add(sets[s], u[c]);
+		if (err != NOWDB_OK) goto cleanup;
+	}
+	// a set never allocates more than the minimal table
+	// beyond the budget of the pool
+	if (pool.mem > budget + NSETS*(sizeof(nowdb_hset_t)+128)) {
+		fprintf(stderr, "budget exceeded: %lu\n", pool.mem);
+		rc = -1; goto cleanup;
+	}
+	for(int i=0; i<NSETS; i++) {
+		for(int k=0; k<NOWDB_HSET_PARTS; k++) {
+			if (sets[i]->parts[k] != NULL) {
+				fprintf(stderr, "set %d has own partition\n", i);
+				rc = -1; goto cleanup;
+			}
+		}
+		spilled += sets[i]->spilled;
+	}
+	if (budget < NSETS*ndist && spilled == 0) {
+		fprintf(stderr, "no values spilled\n");
+		rc = -1; goto cleanup;
+	}
+	for(int i=0; i<NSETS; i++) {
+		e = countSeen(seen+i*ndist, ndist);
+		err = nowdb_hset_count(sets[i], &c);
+		if (err != NOWDB_OK) goto cleanup;
+		if (c != e) {
+			fprintf(stderr, "wrong count in set %d: %lu / %lu\n",
+			                                          i, c, e);
+			rc = -1; goto cleanup;
+		}
+	}
+	// merge within the pool: the target appends
+	// to the partitions the source is read from
+	err = nowdb_hset_merge(sets[0], sets[1]);
+	if (err != NOWDB_OK) goto cleanup;
+	for(uint64_t i=0; i<ndist; i++) seen[i] |= seen[ndist+i];
+	e = countSeen(seen, ndist);
+	err = nowdb_hset_count(sets[0], &c);
+	if (err != NOWDB_OK) goto cleanup;
+	if (c != e) {
+		fprintf(stderr, "wrong merged count: %lu / %lu\n", c, e);
+		rc = -1; goto cleanup;
+	}
+	e = countSeen(seen+ndist, ndist);
+	err = nowdb_hset_count(sets[1], &c);
+	if (err != NOWDB_OK) goto cleanup;
+	if (c != e) {
+		fprintf(stderr, "merge changed source: %lu / %lu\n", c, e);
+		rc = -1; goto cleanup;
+	}
+	// values spilled before the reset are not seen anymore
+	nowdb_hset_reset(sets[2]);
+	err = nowdb_hset_add(sets[2], u[1]);
+	if (err != NOWDB_OK) goto cleanup;
+	err = nowdb_hset_count(sets[2], &c);
+	if (err != NOWDB_OK) goto cleanup;
+	if (c != 1) {
+		fprintf(stderr, "count after reset: %lu\n", c);
+		rc = -1; goto cleanup;
+	}
+
+cleanup:
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		rc = -1;
+	}
+	for(int i=0; i<NSETS; i++) {
+		if (sets[i] == NULL) continue;
+		nowdb_hset_destroy(sets[i]); free(sets[i]);
+	}
+	if (rc == 0 && pool.mem != 0) {
+		fprintf(stderr, "memory left in pool: %lu\n", pool.mem);
+		rc = -1;
+	}
+	nowdb_hset_destroyPool(&pool);
+	free(seen); free(u);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * HyperLogLog: exact while sparse,
+ * otherwise within 4 standard errors
+ * ------------------------------------------------------------------------
+ */
+int testHll(uint64_t ndist) {
+	nowdb_err_t err = NOWDB_OK;
+	nowdb_hll_t *all=NULL, *parts[NPARTS], *merged=NULL;
+	uint64_t *u, c, x, e, n;
+	double tol;
+	char *seen;
+	int rc = 0;
+
+	fprintf(stderr, "hll %lu distinct\n", ndist);
+
+	memset(parts, 0, sizeof(parts));
+
+	u = mkUniverse(ndist);
+	if (u == NULL) return -1;
+	seen = calloc(ndist, 1);
+	if (seen == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		free(u); return -1;
+	}
+	err = nowdb_hll_new(&all, NOWDB_HLL_PRECISION);
+	if (err != NOWDB_OK) goto cleanup;
+	err = nowdb_hll_new(&merged, NOWDB_HLL_PRECISION);
+	if (err != NOWDB_OK) goto cleanup;
+	for(int i=0; i<NPARTS; i++) {
+		err = nowdb_hll_new(parts+i, NOWDB_HLL_PRECISION);
+		if (err != NOWDB_OK) goto cleanup;
+	}
+
+	// all values at least once plus random repetitions
+	n = ndist + NVALUES;
+	for(uint64_t i=0; i<n; i++) {
+		c = i<ndist?i:rnd64()%ndist; x = u[c]; seen[c] = 1;
+		err = nowdb_hll_add(all, x);
+		if (err != NOWDB_OK) goto cleanup;
+		// one part gets only few values (stays sparse)
+		err = nowdb_hll_add(parts[c%64==0?0:1+rand()%(NPARTS-1)], x);
+		if (err != NOWDB_OK) goto cleanup;
+	}
+	for(int i=0; i<NPARTS; i++) {
+		err = nowdb_hll_merge(merged, parts[i]);
+		if (err != NOWDB_OK) goto cleanup;
+	}
+	e = countSeen(seen, ndist);
+	tol = all->regs == NULL ? 0 : 4*1.04/sqrt(all->m)*e;
+
+	c = nowdb_hll_estimate(all);
+	if (fabs((double)c-(double)e) > tol) {
+		fprintf(stderr, "estimate is off: %lu / %lu\n", c, e);
+		rc = -1; goto cleanup;
+	}
+	x = nowdb_hll_estimate(merged);
+	if (fabs((double)x-(double)e) > tol) {
+		fprintf(stderr, "merged estimate is off: %lu / %lu\n", x, e);
+		rc = -1; goto cleanup;
+	}
+	// merging does not lose anything
+	if (all->regs != NULL && merged->regs != NULL &&
+	    memcmp(all->regs, merged->regs, all->m) != 0) {
+		fprintf(stderr, "merged registers differ\n");
+		rc = -1; goto cleanup;
+	}
+	nowdb_hll_reset(all);
+	if (nowdb_hll_estimate(all) != 0) {
+		fprintf(stderr, "estimate after reset not 0\n");
+		rc = -1; goto cleanup;
+	}
+	err = nowdb_hll_add(all, 42);
+	if (err != NOWDB_OK) goto cleanup;
+	err = nowdb_hll_add(all, 42);
+	if (err != NOWDB_OK) goto cleanup;
+	if (nowdb_hll_estimate(all) != 1) {
+		fprintf(stderr, "single value not exact\n");
+		rc = -1; goto cleanup;
+	}
+
+cleanup:
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		rc = -1;
+	}
+	if (all != NULL) {
+		nowdb_hll_destroy(all); free(all);
+	}
+	if (merged != NULL) {
+		nowdb_hll_destroy(merged); free(merged);
+	}
+	for(int i=0; i<NPARTS; i++) {
+		if (parts[i] == NULL) continue;
+		nowdb_hll_destroy(parts[i]); free(parts[i]);
+	}
+	free(seen); free(u);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * Create aggregate on the weight
+ * ------------------------------------------------------------------------
+ */
+nowdb_fun_t *mkFun(uint32_t ftype, nowdb_type_t t) {
+	nowdb_err_t err;
+	nowdb_expr_t expr;
+	nowdb_fun_t *fun;
+
+	err = nowdb_expr_newEdgeField(&expr, "weight", WEIGHT_OFF, t, 4);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return NULL;
+	}
+	err = nowdb_fun_new(&fun, ftype, NOWDB_CONT_EDGE, expr, NULL);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_expr_destroy(expr); free(expr);
+		return NULL;
+	}
+	return fun;
+}
+
+/* ------------------------------------------------------------------------
+ * COUNT(DISTINCT) and APPROX_COUNT_DISTINCT as aggregates
+ * on a text field (the keys are counted, we have no text manager);
+ * partial aggregates are merged
+ * ------------------------------------------------------------------------
+ */
+int testFun(uint64_t ndist) {
+	nowdb_err_t err=NOWDB_OK;
+	nowdb_fun_t *cnt=NULL, *apx=NULL, *part=NULL;
+	myedge_t edge;
+	uint64_t *u, c, e;
+	char *seen;
+	int rc = 0;
+
+	fprintf(stderr, "fun %lu distinct\n", ndist);
+
+	u = mkUniverse(ndist);
+	if (u == NULL) return -1;
+	seen = calloc(ndist, 1);
+	if (seen == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		free(u); return -1;
+	}
+	cnt = mkFun(NOWDB_FUN_COUNTDISTINCT, NOWDB_TYP_TEXT);
+	apx = mkFun(NOWDB_FUN_APPROXDISTINCT, NOWDB_TYP_TEXT);
+	if (cnt == NULL || apx == NULL) {
+		rc = -1; goto cleanup;
+	}
+	err = nowdb_fun_copy(cnt, &part);
+	if (err != NOWDB_OK) goto cleanup;
+
+	if (nowdb_fun_inline(cnt) || nowdb_fun_inline(apx)) {
+		fprintf(stderr, "distinct is inline\n");
+		rc = -1; goto cleanup;
+	}
+
+	memset(&edge, 0, sizeof(myedge_t));
+	edge.edge = MYEDGE;
+	edge.byte = 0xff;
+	for(int i=0; i<NVALUES; i++) {
+		c = getValue(u, ndist);
+		edge.weight = c; seen[c>>32] = 1;
+
+		err = nowdb_fun_map(apx, &_hlp, &edge);
+		if (err != NOWDB_OK) goto cleanup;
+
+		err = nowdb_fun_map(i%2?part:cnt, &_hlp, &edge);
+		if (err != NOWDB_OK) goto cleanup;
+	}
+	err = nowdb_fun_merge(cnt, part);
+	if (err != NOWDB_OK) goto cleanup;
+
+	err = nowdb_fun_reduce(cnt);
+	if (err != NOWDB_OK) goto cleanup;
+	err = nowdb_fun_reduce(apx);
+	if (err != NOWDB_OK) goto cleanup;
+
+	if (cnt->otype != NOWDB_TYP_UINT || apx->otype != NOWDB_TYP_UINT) {
+		fprintf(stderr, "wrong output type\n");
+		rc = -1; goto cleanup;
+	}
+	e = countSeen(seen, ndist);
+	if (cnt->r1 != e) {
+		fprintf(stderr, "count distinct is off: %lu / %lu\n",
+		                                         cnt->r1, e);
+		rc = -1; goto cleanup;
+	}
+	if (fabs((double)apx->r1 - (double)e) > 0.04*e) {
+		fprintf(stderr, "approx count distinct is off: %lu / %lu\n",
+		                                                apx->r1, e);
+		rc = -1; goto cleanup;
+	}
+
+	nowdb_fun_reset(cnt);
+	err = nowdb_fun_reduce(cnt);
+	if (err != NOWDB_OK) goto cleanup;
+	if (cnt->r1 != 0) {
+		fprintf(stderr, "count after reset: %lu\n", cnt->r1);
+		rc = -1; goto cleanup;
+	}
+
+cleanup:
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		rc = -1;
+	}
+	if (cnt != NULL) {
+		nowdb_fun_destroy(cnt); free(cnt);
+	}
+	if (apx != NULL) {
+		nowdb_fun_destroy(apx); free(apx);
+	}
+	if (part != NULL) {
+		nowdb_fun_destroy(part); free(part);
+	}
+	free(seen); free(u);
+	return rc;
+}
+
+int main() {
+	int rc = EXIT_SUCCESS;
+
+	srand(time(NULL) ^ (uint64_t)&printf);
+
+	if (!nowdb_err_init()) {
+		fprintf(stderr, "cannot init error manager\n");
+		return EXIT_FAILURE;
+	}
+	if (testHset(100, NOWDB_HSET_MEM) != 0 ||
+	    testHset(100000, NOWDB_HSET_MEM) != 0 ||
+	    testHset(100000, 4096) != 0 ||
+	    testHset(150000, 128) != 0) {
+		fprintf(stderr, "testHset failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testPool(10000, 4*NOWDB_HSET_MEM) != 0 ||
+	    testPool(10000, 65536) != 0 ||
+	    testPool(100000, 4096) != 0) {
+		fprintf(stderr, "testPool failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testHll(10) != 0 ||
+	    testHll(500) != 0 ||
+	    testHll(5000) != 0 ||
+	    testHll(50000) != 0 ||
+	    testHll(1000000) != 0) {
+		fprintf(stderr, "testHll failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testFun(1000) != 0 ||
+	    testFun(100000) != 0) {
+		fprintf(stderr, "testFun failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+
+cleanup:
+	nowdb_err_destroy();
+	if (rc == EXIT_SUCCESS) {
+		fprintf(stderr, "PASSED\n");
+	} else {
+		fprintf(stderr, "FAILED\n");
+	}
+	return rc;
+}
@@ -419,7 +419,7 @@ nowdb_bool_t testReadRewind() {
 	return rc;
 }
 
-nowdb_bool_t testCompressSimple(uint32_t *sz) {
+nowdb_bool_t testCompressSimple(uint32_t *sz, nowdb_comp_t comp) {
 	nowdb_file_t *file;
 	nowdb_file_t *cfile;
 	nowdb_err_t    err;
@@ -441,7 +441,7 @@ nowdb_bool_t testCompressSimple(uint32_t *sz) {
 	cfile = testMakeFile("rsc/test.dbz");
 	if (cfile == NULL) return FALSE;
 
-	cfile->comp = NOWDB_COMP_ZSTD;
+	cfile->comp = comp;
 
 	err = nowdb_file_open(file);
 	if (err != NOWDB_OK) {
@@ -496,7 +496,7 @@ nowdb_bool_t testCompressSimple(uint32_t *sz) {
 	return rc;
 }
 
-nowdb_bool_t testReadCompressed(uint32_t sz) {
+nowdb_bool_t testReadCompressed(uint32_t sz, nowdb_comp_t comp) {
 	nowdb_file_t *file;
 	nowdb_err_t    err;
 	nowdb_bool_t rc = TRUE;
@@ -507,7 +507,7 @@ nowdb_bool_t testReadCompressed(uint32_t sz) {
 	if (file == NULL) return FALSE;
 
 	file->size = sz;
-	file->comp = NOWDB_COMP_ZSTD;
+	file->comp = comp;
 
 	err = nowdb_file_makeReader(file);
 	if (err != NOWDB_OK) {
@@ -650,6 +650,251 @@ nowdb_bool_t testReadCompRewind(uint32_t sz) {
 	return rc;
 }
 
+nowdb_file_t *testMakeZoneFile(nowdb_path_t path) {
+	nowdb_file_t *file;
+	nowdb_err_t   err;
+
+	err = nowdb_file_new(&file, 0, path, NOWDB_MEGA, 0, PAGESIZE, sizeof(myedge_t),
+	                      NOWDB_CONT_EDGE,
+	                      NOWDB_FILE_READER | NOWDB_FILE_ZONE,
+	                      NOWDB_COMP_ZSTD,
+	                      NOWDB_ENCP_NONE, 1, 0, 0);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return NULL;
+	}
+	return file;
+}
+
+/* origin is the page number */
+nowdb_bool_t testCompressZone(uint32_t *sz) {
+	nowdb_file_t *file;
+	nowdb_err_t    err;
+	nowdb_bool_t rc = TRUE;
+	char buf[PAGESIZE];
+	myedge_t e;
+
+	file = testMakeZoneFile("rsc/test.dbzm");
+	if (file == NULL) return FALSE;
+
+	err = nowdb_file_open(file);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_file_destroy(file); free(file);
+		return FALSE;
+	}
+	e.destin = 1;
+	e.value = 0.1;
+	e.amount = 1;
+	for(int i=0; i<FILESIZE/PAGESIZE; i++) {
+		memset(buf, 0, PAGESIZE);
+		e.origin = i+1;
+		for(int k=0; k<PAGESIZE;) {
+			JUMP(k);
+			e.stamp = k;
+			memcpy(buf+k, &e, RECSIZE);
+			MOVE(k);
+		}
+		err = nowdb_file_writeBuf(file, buf, PAGESIZE);
+		if (err != NOWDB_OK) {
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			rc = FALSE; break;
+		}
+	}
+	err = nowdb_file_close(file);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_file_destroy(file); free(file);
+		return FALSE;
+	}
+	*sz = file->size;
+	nowdb_file_destroy(file); free(file);
+	return rc;
+}
+
+/* accept only blocks that may contain origin *arg */
+char checkOrigin(void *arg, nowdb_zone_t *zones, uint32_t n) {
+	int64_t o = *(int64_t*)arg;
+	if (n < 5) return 1;
+	return (zones[0].min <= o && zones[0].max >= o);
+}
+
+nowdb_bool_t testReadZone(nowdb_path_t path,
+                          uint32_t sz, nowdb_bitmap8_t ctrl,
+                          int64_t origin, int expected) {
+	nowdb_file_t *file;
+	nowdb_err_t    err;
+	nowdb_bool_t rc = TRUE;
+	myedge_t *e;
+	int b = 0;
+
+	err = nowdb_file_new(&file, 0, path, NOWDB_MEGA, sz, PAGESIZE,
+	                      sizeof(myedge_t), NOWDB_CONT_EDGE,
+	                      NOWDB_FILE_READER | ctrl, NOWDB_COMP_ZSTD,
+	                      NOWDB_ENCP_NONE, 1, 0, 0);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return FALSE;
+	}
+	err = nowdb_file_open(file);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_file_destroy(file); free(file);
+		return FALSE;
+	}
+	for(;;) {
+		err = nowdb_file_moveZone(file, NOWDB_TIME_DAWN,
+		                                NOWDB_TIME_DUSK,
+		                                &checkOrigin, &origin);
+		if (err != NOWDB_OK) {
+			if (err->errcode != nowdb_err_eof) {
+				nowdb_err_print(err);
+				rc = FALSE;
+			}
+			nowdb_err_release(err);
+			break;
+		}
+		b++;
+		if (!(ctrl & NOWDB_FILE_ZONE)) continue;
+		for(int k=0; k<file->bufsize;) {
+			JUMP(k);
+			e = (myedge_t*)(file->bptr+k);
+			if (e->origin != origin) {
+				fprintf(stderr, "wrong origin in block: %lu\n",
+				                                  e->origin);
+				rc = FALSE; break;
+			}
+			MOVE(k);
+		}
+	}
+	if (b != expected) {
+		fprintf(stderr, "blocks loaded: %d (expected: %d)\n",
+		                                          b, expected);
+		rc = FALSE;
+	}
+	err = nowdb_file_close(file);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_file_destroy(file); free(file);
+		return FALSE;
+	}
+	nowdb_file_destroy(file); free(file);
+	return rc;
+}
+
+/* deterministic content of page i */
+void makeEncodedPage(char *buf, int i) {
+	myedge_t e;
+
+	memset(buf, 0, PAGESIZE);
+	e.origin = i/4+1;
+	e.destin = 0;
+	e.amount = 0;
+	for(int k=0; k<PAGESIZE;) {
+		JUMP(k);
+		e.destin += (k*7)%13;
+		e.stamp = 1000000000ll*(i*PAGESIZE+k) + (k%3);
+		e.value = 20.0 + (double)(k%17)/4;
+		e.amount = (k%5==0)?UINT64_MAX-k:e.amount+1;
+		memcpy(buf+k, &e, RECSIZE);
+		MOVE(k);
+	}
+}
+
+nowdb_bool_t testEncode(nowdb_comp_t comp) {
+	nowdb_file_t *file;
+	nowdb_err_t    err;
+	nowdb_bool_t rc = TRUE;
+	nowdb_bitmap8_t ctrl = NOWDB_FILE_READER |
+	                       NOWDB_FILE_ZONE   |
+	                       NOWDB_FILE_ENCODE;
+	char buf[PAGESIZE];
+	uint32_t sz;
+	int i;
+
+	err = nowdb_file_new(&file, 0, "rsc/test.dbze", NOWDB_MEGA, 0,
+	                      PAGESIZE, sizeof(myedge_t), NOWDB_CONT_EDGE,
+	                      ctrl, comp, NOWDB_ENCP_NONE, 1, 0, 0);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return FALSE;
+	}
+	err = nowdb_file_create(file);
+	if (err != NOWDB_OK) goto failure;
+	err = nowdb_file_open(file);
+	if (err != NOWDB_OK) goto failure;
+	for(i=0; i<FILESIZE/PAGESIZE; i++) {
+		makeEncodedPage(buf, i);
+		err = nowdb_file_writeBuf(file, buf, PAGESIZE);
+		if (err != NOWDB_OK) goto failure;
+	}
+	err = nowdb_file_close(file);
+	if (err != NOWDB_OK) goto failure;
+	sz = file->size;
+	nowdb_file_destroy(file); free(file);
+
+	fprintf(stderr, "encoded file size: %u\n", sz);
+
+	err = nowdb_file_new(&file, 0, "rsc/test.dbze", NOWDB_MEGA, sz,
+	                      PAGESIZE, sizeof(myedge_t), NOWDB_CONT_EDGE,
+	                      ctrl, comp, NOWDB_ENCP_NONE, 1, 0, 0);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return FALSE;
+	}
+	err = nowdb_file_open(file);
+	if (err != NOWDB_OK) goto failure;
+	for(i=0;;i++) {
+		err = nowdb_file_move(file);
+		if (err != NOWDB_OK) {
+			if (err->errcode == nowdb_err_eof) {
+				nowdb_err_release(err); break;
+			}
+			goto failure;
+		}
+		makeEncodedPage(buf, i);
+		if (memcmp(buf, file->bptr, PAGESIZE) != 0) {
+			fprintf(stderr, "block %d differs\n", i);
+			rc = FALSE; break;
+		}
+	}
+	if (rc && i != FILESIZE/PAGESIZE) {
+		fprintf(stderr, "blocks read: %d\n", i);
+		rc = FALSE;
+	}
+	err = nowdb_file_close(file);
+	if (err != NOWDB_OK) goto failure;
+	NOWDB_IGNORE(nowdb_file_remove(file));
+	nowdb_file_destroy(file); free(file);
+	return rc;
+
+failure:
+	nowdb_err_print(err);
+	nowdb_err_release(err);
+	NOWDB_IGNORE(nowdb_file_close(file));
+	NOWDB_IGNORE(nowdb_file_remove(file));
+	nowdb_file_destroy(file); free(file);
+	return FALSE;
+}
+
+void removeZoneFile() {
+	nowdb_file_t *file;
+
+	file = testMakeZoneFile("rsc/test.dbzm");
+	if (file == NULL) return;
+	NOWDB_IGNORE(nowdb_file_remove(file));
+	nowdb_file_destroy(file); free(file);
+}
+
 int main() {
 	uint32_t sz;
 	int rc = EXIT_SUCCESS;
@@ -736,12 +981,27 @@ int main() {
 		rc = EXIT_FAILURE;
 		goto cleanup;
 	}
-	if (!testCompressSimple(&sz)) {
+	if (!testCompressSimple(&sz, NOWDB_COMP_LZ4)) {
+		fprintf(stderr, "compress file (lz4) failed\n");
+		rc = EXIT_FAILURE;
+		goto cleanup;
+	}
+	if (!testReadCompressed(sz, NOWDB_COMP_LZ4)) {
+		fprintf(stderr, "read compressed file (lz4) failed\n");
+		rc = EXIT_FAILURE;
+		goto cleanup;
+	}
+	if (!createFile("rsc/test.dbz")) {
+		fprintf(stderr, "create failed\n");
+		rc = EXIT_FAILURE;
+		goto cleanup;
+	}
+	if (!testCompressSimple(&sz, NOWDB_COMP_ZSTD)) {
 		fprintf(stderr, "compress file failed\n");
 		rc = EXIT_FAILURE;
 		goto cleanup;
 	}
-	if (!testReadCompressed(sz)) {
+	if (!testReadCompressed(sz, NOWDB_COMP_ZSTD)) {
 		fprintf(stderr, "read compressed file failed\n");
 		rc = EXIT_FAILURE;
 		goto cleanup;
@@ -751,8 +1011,51 @@ int main() {
 		rc = EXIT_FAILURE;
 		goto cleanup;
 	}
+	/* files without zone maps ignore the zone check */
+	if (!testReadZone("rsc/test.dbz", sz, 0, 5, FILESIZE/PAGESIZE)) {
+		fprintf(stderr, "read compressed file with zone check failed\n");
+		rc = EXIT_FAILURE;
+		goto cleanup;
+	}
+	if (!createFile("rsc/test.dbzm")) {
+		fprintf(stderr, "create failed\n");
+		rc = EXIT_FAILURE;
+		goto cleanup;
+	}
+	if (!testCompressZone(&sz)) {
+		fprintf(stderr, "compress file with zone maps failed\n");
+		rc = EXIT_FAILURE;
+		goto cleanup;
+	}
+	if (!testReadZone("rsc/test.dbzm", sz, NOWDB_FILE_ZONE, 5, 1)) {
+		fprintf(stderr, "read zone (5) failed\n");
+		rc = EXIT_FAILURE;
+		goto cleanup;
+	}
+	if (!testReadZone("rsc/test.dbzm", sz, NOWDB_FILE_ZONE,
+	                              FILESIZE/PAGESIZE, 1)) {
+		fprintf(stderr, "read zone (last) failed\n");
+		rc = EXIT_FAILURE;
+		goto cleanup;
+	}
+	if (!testReadZone("rsc/test.dbzm", sz, NOWDB_FILE_ZONE, 0, 0)) {
+		fprintf(stderr, "read zone (none) failed\n");
+		rc = EXIT_FAILURE;
+		goto cleanup;
+	}
+	if (!testEncode(NOWDB_COMP_ZSTD)) {
+		fprintf(stderr, "encode (zstd) failed\n");
+		rc = EXIT_FAILURE;
+		goto cleanup;
+	}
+	if (!testEncode(NOWDB_COMP_LZ4)) {
+		fprintf(stderr, "encode (lz4) failed\n");
+		rc = EXIT_FAILURE;
+		goto cleanup;
+	}
 cleanup:
 	removeFile();
+	removeZoneFile();
 	nowdb_err_destroy();
 	if (rc == EXIT_FAILURE) {
 		fprintf(stderr, "FAILED\n");
@@ -398,6 +398,92 @@ cleanup:
 	
 }
 
+/* ------------------------------------------------------------------------
+ * Map two halves of the edges to two copies of the function,
+ * merge the partial states and compare with the serial result
+ * ------------------------------------------------------------------------
+ */
+int testMerge(uint32_t ftype,
+          nowdb_type_t dtype,
+                uint16_t off,
+                  void *init) 
+{
+	int rc = 0;
+	nowdb_fun_t *fun;
+	nowdb_fun_t *cpy=NULL;
+	nowdb_err_t  err;
+	nowdb_expr_t expr;
+	int mx;
+
+	err = nowdb_expr_newEdgeField(&expr, "field", off, dtype, 4);
+	if (err != NOWDB_OK) {
+		fprintf(stderr, "cannot create edge field\n");
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return -1;
+	}
+	err = nowdb_fun_new(&fun, ftype,
+	                NOWDB_CONT_EDGE,
+	                    expr, init);
+	if (err != NOWDB_OK) {
+		fprintf(stderr, "cannot init fun\n");
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_expr_destroy(expr); free(expr);
+		return -1;
+	}
+	err = nowdb_fun_copy(fun, &cpy);
+	if (err != NOWDB_OK) {
+		fprintf(stderr, "cannot copy fun\n");
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_fun_destroy(fun); free(fun);
+		return -1;
+	}
+	mx = prepare(dtype, ftype == NOWDB_FUN_PROD);
+	if (mx < 0) {
+		fprintf(stderr, "cannot prepare\n");
+		nowdb_fun_destroy(fun); free(fun);
+		nowdb_fun_destroy(cpy); free(cpy);
+		return -1;
+	}
+	fprintf(stderr, "merging %d edges\n", mx);
+	for(int i=0; i<mx; i++) {
+		err = nowdb_fun_map(i<mx/2?fun:cpy, &_hlp, edges+i);
+		if (err != NOWDB_OK) break;
+	}
+	if (err != NOWDB_OK) {
+		fprintf(stderr, "error in map phase\n");
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		rc = -1; goto cleanup;
+	}
+	err = nowdb_fun_merge(fun, cpy);
+	if (err != NOWDB_OK) {
+		fprintf(stderr, "error in merge phase\n");
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		rc = -1; goto cleanup;
+	}
+	err = nowdb_fun_reduce(fun);
+	if (err != NOWDB_OK) {
+		fprintf(stderr, "error in reduce phase\n");
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		rc = -1; goto cleanup;
+	}
+	if (checkResult(ftype, dtype, off,
+	    &fun->r1, &fun->init, mx) != 0) {
+		fprintf(stderr, "results differ\n");
+		rc = -1; goto cleanup;
+	}
+
+cleanup:
+	nowdb_fun_destroy(fun); free(fun);
+	nowdb_fun_destroy(cpy); free(cpy);
+	free(edges); return rc;
+}
+
 int initEval() {
 	_edge.edgeid = MYEDGE;
 	_edge.origin = MYORI;
@@ -578,6 +664,28 @@ int main() {
 			rc = EXIT_FAILURE; goto cleanup;
 		}
 	}
+	fprintf(stderr, "TESTING MERGE\n");
+	for(int i=0; i<ITER; i++) {
+		if (testMerge(NOWDB_FUN_COUNT, NOWDB_TYP_UINT,
+		              WEIGHT_OFF, &uzero) != 0 ||
+		    testMerge(NOWDB_FUN_SUM, NOWDB_TYP_UINT,
+		              WEIGHT_OFF, &uzero) != 0 ||
+		    testMerge(NOWDB_FUN_MIN, NOWDB_TYP_FLOAT,
+		              WEIGHT_OFF, &fzero) != 0 ||
+		    testMerge(NOWDB_FUN_MAX, NOWDB_TYP_UINT,
+		              WEIGHT_OFF, &uzero) != 0 ||
+		    testMerge(NOWDB_FUN_SPREAD, NOWDB_TYP_TIME,
+		              NOWDB_OFF_STAMP, &uzero) != 0 ||
+		    testMerge(NOWDB_FUN_AVG, NOWDB_TYP_FLOAT,
+		              WEIGHT_OFF, &fzero) != 0 ||
+		    testMerge(NOWDB_FUN_STDDEV, NOWDB_TYP_FLOAT,
+		              WEIGHT_OFF, &fzero) != 0 ||
+		    testMerge(NOWDB_FUN_MEDIAN, NOWDB_TYP_FLOAT,
+		              WEIGHT_OFF, &fzero) != 0) {
+			fprintf(stderr, "testMerge failed\n");
+			rc = EXIT_FAILURE; goto cleanup;
+		}
+	}
 
 cleanup:
 	if (rc == EXIT_SUCCESS) {
@@ -0,0 +1,471 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Simple tests for hash aggregation
+ * ========================================================================
+ */
+#include <nowdb/types/types.h>
+#include <nowdb/fun/fun.h>
+#include <nowdb/fun/group.h>
+#include <nowdb/query/hashagg.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#define NEDGES 100000
+#define NVALUES  1000
+
+#define ORIGIN_OFF  0
+#define WEIGHT_OFF 40
+
+typedef struct {
+	uint64_t origin;
+	uint64_t destin;
+	int64_t  timestamp;
+	char     byte; // control byte
+	char     pad[7];
+	uint64_t edge;
+	uint64_t weight;
+	uint64_t weight2;
+} myedge_t;
+
+uint64_t MYEDGE = 101;
+
+uint64_t uzero = 0;
+
+/* expected results per group */
+typedef struct {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint64_t distinct;
+	char    seen;
+} expected_t;
+
+nowdb_eval_t _hlp;
+
+/* ------------------------------------------------------------------------
+ * Add a function on the weight to the group
+ * ------------------------------------------------------------------------
+ */
+int addFun(nowdb_group_t *group, uint32_t ftype) {
+	nowdb_err_t err;
+	nowdb_expr_t expr=NULL;
+	nowdb_fun_t  *fun;
+
+	if (ftype != NOWDB_FUN_COUNT) {
+		err = nowdb_expr_newEdgeField(&expr, "weight", WEIGHT_OFF,
+		                                      NOWDB_TYP_UINT, 4);
+		if (err != NOWDB_OK) {
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			return -1;
+		}
+	}
+	err = nowdb_fun_new(&fun, ftype, NOWDB_CONT_EDGE, expr, &uzero);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		if (expr != NULL) {
+			nowdb_expr_destroy(expr); free(expr);
+		}
+		return -1;
+	}
+	err = nowdb_group_add(group, fun);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_fun_destroy(fun); free(fun);
+		return -1;
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Create hash aggregation grouping by origin
+ * ------------------------------------------------------------------------
+ */
+nowdb_hashagg_t *mkHashagg(uint64_t budget, char boxed) {
+	nowdb_err_t err;
+	nowdb_hashagg_t *ha;
+	nowdb_group_t *group;
+	nowdb_expr_t key;
+	ts_algo_list_t keys;
+
+	err = nowdb_expr_newEdgeField(&key, "origin", ORIGIN_OFF,
+	                                      NOWDB_TYP_UINT, 4);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return NULL;
+	}
+	ts_algo_list_init(&keys);
+	if (ts_algo_list_append(&keys, key) != TS_ALGO_OK) {
+		fprintf(stderr, "out-of-mem\n");
+		nowdb_expr_destroy(key); free(key);
+		return NULL;
+	}
+	err = nowdb_hashagg_new(&ha, &keys, &_hlp, NOWDB_CONT_EDGE,
+	                             sizeof(myedge_t), budget);
+	ts_algo_list_destroy(&keys);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_expr_destroy(key); free(key);
+		return NULL;
+	}
+	err = nowdb_group_new(&group, boxed?6:5);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_hashagg_destroy(ha); free(ha);
+		return NULL;
+	}
+	if (addFun(group, NOWDB_FUN_COUNT) != 0 ||
+	    addFun(group, NOWDB_FUN_SUM)   != 0 ||
+	    addFun(group, NOWDB_FUN_MIN)   != 0 ||
+	    addFun(group, NOWDB_FUN_MAX)   != 0 ||
+	    addFun(group, boxed?NOWDB_FUN_MEDIAN:
+	                        NOWDB_FUN_AVG) != 0 ||
+	    (boxed && addFun(group, NOWDB_FUN_COUNTDISTINCT) != 0)) {
+		nowdb_group_destroy(group); free(group);
+		nowdb_hashagg_destroy(ha); free(ha);
+		return NULL;
+	}
+	nowdb_group_setEval(group, &_hlp);
+	err = nowdb_hashagg_setGroup(ha, group);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_group_destroy(group); free(group);
+		nowdb_hashagg_destroy(ha); free(ha);
+		return NULL;
+	}
+	return ha;
+}
+
+/* ------------------------------------------------------------------------
+ * Order groups by origin in direction 'dir'
+ * ------------------------------------------------------------------------
+ */
+int orderHashagg(nowdb_hashagg_t *ha, nowdb_ord_t dir) {
+	nowdb_err_t err;
+	nowdb_expr_t key;
+	ts_algo_list_t ord;
+
+	err = nowdb_expr_newEdgeField(&key, "origin", ORIGIN_OFF,
+	                                      NOWDB_TYP_UINT, 4);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return -1;
+	}
+	ts_algo_list_init(&ord);
+	if (ts_algo_list_append(&ord, key) != TS_ALGO_OK) {
+		fprintf(stderr, "out-of-mem\n");
+		nowdb_expr_destroy(key); free(key);
+		return -1;
+	}
+	err = nowdb_hashagg_setOrder(ha, &ord, dir);
+	ts_algo_list_destroy(&ord);
+	nowdb_expr_destroy(key); free(key);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return -1;
+	}
+	return 0;
+}
+
+int testMerge(int ngroups, uint64_t budget,
+              char boxed, char ordered, int ncps);
+
+/* ------------------------------------------------------------------------
+ * Map random edges with 'ngroups' distinct origins
+ * and compare the groups with the expected results;
+ * if 'ordered' (NOWDB_ORD_ASC or NOWDB_ORD_DESC),
+ * the groups must come in that order of the origin.
+ * ------------------------------------------------------------------------
+ */
+int testHashagg(int ngroups, uint64_t budget, char boxed, char ordered) {
+	return testMerge(ngroups, budget, boxed, ordered, 0);
+}
+
+/* ------------------------------------------------------------------------
+ * As testHashagg, but the edges are mapped round-robin
+ * to 'ncps' copies (as the workers of a parallel scan do)
+ * which are then merged into the original
+ * ------------------------------------------------------------------------
+ */
+int testMerge(int ngroups, uint64_t budget,
+              char boxed, char ordered, int ncps) {
+	int rc = 0;
+	nowdb_err_t err;
+	nowdb_hashagg_t *ha;
+	nowdb_hashagg_t *cps[4];
+	nowdb_hashagg_t *tg;
+	expected_t *exp;
+	myedge_t edge;
+	char *rec, *dist;
+	nowdb_fun_t **fun;
+	int found=0, nexp=0;
+	uint64_t last=0;
+
+	fprintf(stderr, "%d groups, budget %lu, %s%s, %d copies\n",
+	                ngroups, budget, boxed?"boxed":"inline",
+	                ordered==NOWDB_ORD_ASC?", ascending":
+	                ordered==NOWDB_ORD_DESC?", descending":"", ncps);
+
+	memset(cps, 0, 4*sizeof(nowdb_hashagg_t*));
+
+	exp = calloc(ngroups, sizeof(expected_t));
+	if (exp == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		return -1;
+	}
+	dist = calloc(ngroups, NVALUES);
+	if (dist == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		free(exp); return -1;
+	}
+	ha = mkHashagg(budget, boxed);
+	if (ha == NULL) {
+		free(dist); free(exp); return -1;
+	}
+	if (ordered && orderHashagg(ha, ordered) != 0) {
+		nowdb_hashagg_destroy(ha); free(ha);
+		free(dist); free(exp); return -1;
+	}
+	for(int i=0; i<ncps; i++) {
+		err = nowdb_hashagg_copy(ha, &_hlp, budget/ncps, cps+i);
+		if (err != NOWDB_OK) {
+			fprintf(stderr, "cannot copy\n");
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			rc = -1; goto cleanup;
+		}
+	}
+	fun = ha->group->fun;
+
+	memset(&edge, 0, sizeof(myedge_t));
+	edge.edge = MYEDGE;
+	edge.byte = 0xff;
+
+	for(int i=0; i<NEDGES; i++) {
+		edge.origin = rand()%ngroups;
+		edge.weight = rand()%NVALUES;
+
+		if (!exp[edge.origin].seen) {
+			exp[edge.origin].seen = 1;
+			exp[edge.origin].min = edge.weight;
+			exp[edge.origin].max = edge.weight;
+			nexp++;
+		}
+		exp[edge.origin].count++;
+		exp[edge.origin].sum += edge.weight;
+		if (edge.weight < exp[edge.origin].min) {
+			exp[edge.origin].min = edge.weight;
+		}
+		if (edge.weight > exp[edge.origin].max) {
+			exp[edge.origin].max = edge.weight;
+		}
+		if (!dist[edge.origin*NVALUES+edge.weight]) {
+			dist[edge.origin*NVALUES+edge.weight] = 1;
+			exp[edge.origin].distinct++;
+		}
+		tg = ncps>0?cps[i%ncps]:ha;
+		err = nowdb_hashagg_map(tg, (char*)&edge);
+		if (err != NOWDB_OK) {
+			fprintf(stderr, "cannot map\n");
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			rc = -1; goto cleanup;
+		}
+		// we may exceed the budget by one small set
+		if (tg->level+1 < NOWDB_HASHAGG_MAXLEVEL &&
+		    tg->cap > 16 &&
+		    tg->mem + tg->pool.mem > tg->budget + 1024) {
+			fprintf(stderr, "budget exceeded: %lu + %lu\n",
+			                      tg->mem, tg->pool.mem);
+			rc = -1; goto cleanup;
+		}
+	}
+	for(int i=0; i<ncps; i++) {
+		err = nowdb_hashagg_merge(ha, cps[i]);
+		if (err != NOWDB_OK) {
+			fprintf(stderr, "cannot merge\n");
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			rc = -1; goto cleanup;
+		}
+	}
+	for(int i=0; i<ncps; i++) {
+		err = nowdb_hashagg_mergeSpilled(ha, cps[i]);
+		if (err != NOWDB_OK) {
+			fprintf(stderr, "cannot merge spilled records\n");
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			rc = -1; goto cleanup;
+		}
+	}
+	for(;;) {
+		err = nowdb_hashagg_next(ha, &rec);
+		if (err != NOWDB_OK) {
+			if (nowdb_err_contains(err, nowdb_err_eof)) {
+				nowdb_err_release(err); break;
+			}
+			/* we cannot sort what is spilled */
+			if (ordered && ha->spilled > 0 &&
+			    nowdb_err_contains(err, nowdb_err_not_supp)) {
+				fprintf(stderr, "ordering spilled groups "
+				                "is not supported\n");
+				nowdb_err_release(err); goto cleanup;
+			}
+			fprintf(stderr, "cannot get next group\n");
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			rc = -1; goto cleanup;
+		}
+		memcpy(&edge, rec, sizeof(myedge_t));
+		if (exp[edge.origin].seen != 1) {
+			fprintf(stderr, "unexpected group %lu\n", edge.origin);
+			rc = -1; goto cleanup;
+		}
+		exp[edge.origin].seen = 2; found++;
+
+		if (found > 1 &&
+		   ((ordered == NOWDB_ORD_ASC  && edge.origin <= last) ||
+		    (ordered == NOWDB_ORD_DESC && edge.origin >= last))) {
+			fprintf(stderr, "group %lu after %lu\n",
+			                 edge.origin, last);
+			rc = -1; goto cleanup;
+		}
+		last = edge.origin;
+
+		if (fun[0]->r1 != exp[edge.origin].count ||
+		    fun[1]->r1 != exp[edge.origin].sum   ||
+		    fun[2]->r1 != exp[edge.origin].min   ||
+		    fun[3]->r1 != exp[edge.origin].max) {
+			fprintf(stderr, "results differ in group %lu\n",
+			                                   edge.origin);
+			rc = -1; goto cleanup;
+		}
+		if (boxed && fun[5]->r1 != exp[edge.origin].distinct) {
+			fprintf(stderr, "distinct differs in group %lu\n",
+			                                    edge.origin);
+			rc = -1; goto cleanup;
+		}
+	}
+	if (found != nexp) {
+		fprintf(stderr, "groups missing: %d of %d\n", found, nexp);
+		rc = -1; goto cleanup;
+	}
+	fprintf(stderr, "%d groups, %lu records spilled\n", found,
+	                                              ha->spilled);
+cleanup:
+	for(int i=0; i<ncps; i++) {
+		if (cps[i] == NULL) continue;
+		nowdb_hashagg_destroy(cps[i]); free(cps[i]);
+	}
+	nowdb_hashagg_destroy(ha); free(ha);
+	free(dist); free(exp);
+	return rc;
+}
+
+int main() {
+	int rc = EXIT_SUCCESS;
+
+	srand(time(NULL) ^ (uint64_t)&printf);
+
+	if (!nowdb_err_init()) {
+		fprintf(stderr, "cannot init error manager\n");
+		return EXIT_FAILURE;
+	}
+
+	/* fits into memory */
+	if (testHashagg(10, NOWDB_HASHAGG_MEM, 0, 0) != 0) {
+		fprintf(stderr, "testHashagg failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testHashagg(20000, NOWDB_HASHAGG_MEM, 0, 0) != 0) {
+		fprintf(stderr, "testHashagg failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	/* spills */
+	if (testHashagg(20000, 65536, 0, 0) != 0) {
+		fprintf(stderr, "testHashagg failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testHashagg(20000, 1, 0, 0) != 0) {
+		fprintf(stderr, "testHashagg failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	/* aggregates that are not inline */
+	if (testHashagg(1000, NOWDB_HASHAGG_MEM, 1, 0) != 0) {
+		fprintf(stderr, "testHashagg failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testHashagg(1000, 65536, 1, 0) != 0) {
+		fprintf(stderr, "testHashagg failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testHashagg(10000, 65536, 1, 0) != 0) {
+		fprintf(stderr, "testHashagg failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	/* ordered groups */
+	if (testHashagg(20000, NOWDB_HASHAGG_MEM, 0, 1) != 0) {
+		fprintf(stderr, "testHashagg failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testHashagg(1000, NOWDB_HASHAGG_MEM, 1, 1) != 0) {
+		fprintf(stderr, "testHashagg failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testHashagg(20000, 65536, 0, 1) != 0) {
+		fprintf(stderr, "testHashagg failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testHashagg(20000, NOWDB_HASHAGG_MEM, 0, NOWDB_ORD_DESC) != 0) {
+		fprintf(stderr, "testHashagg failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testHashagg(1000, NOWDB_HASHAGG_MEM, 1, NOWDB_ORD_DESC) != 0) {
+		fprintf(stderr, "testHashagg failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	/* merging copies */
+	if (testMerge(20000, NOWDB_HASHAGG_MEM, 0, 1, 4) != 0) {
+		fprintf(stderr, "testMerge failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testMerge(1000, NOWDB_HASHAGG_MEM, 1, 0, 4) != 0) {
+		fprintf(stderr, "testMerge failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testMerge(20000, 262144, 0, 0, 4) != 0) {
+		fprintf(stderr, "testMerge failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testMerge(1000, 65536, 1, 0, 3) != 0) {
+		fprintf(stderr, "testMerge failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testMerge(20000, NOWDB_HASHAGG_MEM, 0, NOWDB_ORD_DESC, 4) != 0) {
+		fprintf(stderr, "testMerge failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+
+cleanup:
+	nowdb_err_destroy();
+	if (rc == EXIT_SUCCESS) {
+		fprintf(stderr, "PASSED\n");
+	} else {
+		fprintf(stderr, "FAILED\n");
+	}
+	return rc;
+}
@@ -0,0 +1,582 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Simple tests for the join of edges with vertices
+ * ========================================================================
+ */
+#include <nowdb/types/types.h>
+#include <nowdb/fun/expr.h>
+#include <nowdb/scope/scope.h>
+#include <nowdb/task/task.h>
+#include <nowdb/query/hjoin.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#define NVERTICES 50000
+#define NSTORED  200000
+
+#define DELAY 10000000
+
+#define EDGE_SIZE   33
+#define VRTX_SIZE   17
+
+#define WEIGHT_OFF  24
+#define VALUE_OFF    8
+
+typedef struct {
+	uint64_t origin;
+	uint64_t destin;
+	int64_t  timestamp;
+	uint64_t weight;
+	char     byte; // control byte
+} __attribute__((packed)) myedge_t;
+
+typedef struct {
+	uint64_t id;
+	uint64_t value;
+	char     byte; // control byte
+} __attribute__((packed)) myvrtx_t;
+
+nowdb_eval_t _hlp;
+
+/* ------------------------------------------------------------------------
+ * Vertex 'id' (the value is derived from the id)
+ * ------------------------------------------------------------------------
+ */
+static void mkVertex(myvrtx_t *v, uint64_t id) {
+	v->id = id;
+	v->value = id*10;
+	v->byte = 3;
+}
+
+/* ------------------------------------------------------------------------
+ * Edge pointing with 'key' to vertex 'id'
+ * ------------------------------------------------------------------------
+ */
+static void mkEdge(myedge_t *e, uint32_t key, uint64_t id, uint64_t w) {
+	e->origin = key == NOWDB_OFF_ORIGIN ? id : id+NVERTICES;
+	e->destin = key == NOWDB_OFF_DESTIN ? id : id+NVERTICES;
+	e->timestamp = 0;
+	e->weight = w;
+	e->byte = 15;
+}
+
+/* ------------------------------------------------------------------------
+ * Add vertices 0..n-1
+ * ------------------------------------------------------------------------
+ */
+static int addVertices(nowdb_hjoin_t *hj, uint64_t n) {
+	nowdb_err_t err;
+	myvrtx_t v;
+
+	for(uint64_t i=0; i<n; i++) {
+		mkVertex(&v, i);
+		err = nowdb_hjoin_add(hj, (char*)&v);
+		if (err != NOWDB_OK) {
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Filter: vertex.value > edge.weight
+ * ------------------------------------------------------------------------
+ */
+static nowdb_expr_t mkFilter() {
+	nowdb_err_t err;
+	nowdb_expr_t v, w, o;
+
+	err = nowdb_expr_newVertexField(&v, "value", 1, VALUE_OFF,
+	                                        NOWDB_TYP_UINT, 2);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return NULL;
+	}
+	nowdb_expr_setBase(v, EDGE_SIZE);
+
+	err = nowdb_expr_newEdgeField(&w, "weight", WEIGHT_OFF,
+	                                     NOWDB_TYP_UINT, 4);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_expr_destroy(v); free(v);
+		return NULL;
+	}
+	err = nowdb_expr_newOp(&o, NOWDB_EXPR_OP_GT, v, w);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_expr_destroy(v); free(v);
+		nowdb_expr_destroy(w); free(w);
+		return NULL;
+	}
+	return o;
+}
+
+/* ------------------------------------------------------------------------
+ * Probe edges with and without vertex, with and without filter
+ * ------------------------------------------------------------------------
+ */
+static int testJoin(uint32_t key, char withFilter) {
+	nowdb_err_t err;
+	nowdb_hjoin_t *hj;
+	nowdb_expr_t filter = NULL;
+	myedge_t e;
+	myvrtx_t v;
+	uint64_t w;
+	uint64_t hits=0;
+	char *row;
+	int rc = 0;
+
+	fprintf(stderr, "testJoin(%s, %d)\n",
+	        key == NOWDB_OFF_ORIGIN ? "origin" : "destin",
+	        withFilter);
+
+	if (withFilter) {
+		filter = mkFilter();
+		if (filter == NULL) return -1;
+	}
+	err = nowdb_hjoin_new(&hj, key, EDGE_SIZE, VRTX_SIZE,
+	                      NULL, filter, &_hlp, NOWDB_HJOIN_MEM);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		if (filter != NULL) {
+			nowdb_expr_destroy(filter); free(filter);
+		}
+		return -1;
+	}
+	if (hj->size != EDGE_SIZE+VRTX_SIZE) {
+		fprintf(stderr, "wrong size: %u\n", hj->size);
+		rc = -1; goto cleanup;
+	}
+	if (addVertices(hj, NVERTICES) != 0) {
+		rc = -1; goto cleanup;
+	}
+	if (hj->full) {
+		fprintf(stderr, "table is full\n");
+		rc = -1; goto cleanup;
+	}
+
+	/* every other edge points to a vertex that does not exist */
+	for(uint64_t i=0; i<2*NVERTICES; i++) {
+		w = (uint64_t)rand()%(NVERTICES*10);
+		mkEdge(&e, key, i, w);
+
+		err = nowdb_hjoin_probe(hj, (char*)&e, &row);
+		if (err != NOWDB_OK) {
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			rc = -1; goto cleanup;
+		}
+		if (i >= NVERTICES || (withFilter && i*10 <= w)) {
+			if (row != NULL) {
+				fprintf(stderr, "unexpected hit: %lu\n", i);
+				rc = -1; goto cleanup;
+			}
+			continue;
+		}
+		if (row == NULL) {
+			fprintf(stderr, "vertex not found: %lu\n", i);
+			rc = -1; goto cleanup;
+		}
+		mkVertex(&v, i);
+		if (memcmp(row, &e, EDGE_SIZE) != 0) {
+			fprintf(stderr, "wrong edge: %lu\n", i);
+			rc = -1; goto cleanup;
+		}
+		if (memcmp(row+EDGE_SIZE, &v, VRTX_SIZE) != 0) {
+			fprintf(stderr, "wrong vertex: %lu\n", i);
+			rc = -1; goto cleanup;
+		}
+		hits++;
+	}
+	if (hits == 0) {
+		fprintf(stderr, "no hits at all\n");
+		rc = -1; goto cleanup;
+	}
+	fprintf(stderr, "hits: %lu\n", hits);
+
+cleanup:
+	nowdb_hjoin_destroy(hj); free(hj);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * The table does not exceed the budget
+ * ------------------------------------------------------------------------
+ */
+static int testBudget() {
+	nowdb_err_t err;
+	nowdb_hjoin_t *hj;
+	myedge_t e;
+	uint64_t found=0;
+	char *row;
+	int rc = 0;
+
+	fprintf(stderr, "testBudget\n");
+
+	err = nowdb_hjoin_new(&hj, NOWDB_OFF_ORIGIN, EDGE_SIZE, VRTX_SIZE,
+	                      NULL, NULL, &_hlp, 65536);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return -1;
+	}
+	if (addVertices(hj, NVERTICES) != 0) {
+		rc = -1; goto cleanup;
+	}
+	if (!hj->full) {
+		fprintf(stderr, "table not full\n");
+		rc = -1; goto cleanup;
+	}
+	if (hj->cap*hj->esz > 65536) {
+		fprintf(stderr, "table exceeds budget: %lu\n",
+		                               hj->cap*hj->esz);
+		rc = -1; goto cleanup;
+	}
+	/* what is in the table is still found */
+	for(uint64_t i=0; i<NVERTICES; i++) {
+		mkEdge(&e, NOWDB_OFF_ORIGIN, i, 0);
+		err = nowdb_hjoin_probe(hj, (char*)&e, &row);
+		if (err != NOWDB_OK) {
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			rc = -1; goto cleanup;
+		}
+		if (row != NULL) found++;
+	}
+	if (found != hj->count+1) {
+		fprintf(stderr, "found %lu, but have %lu (+1)\n",
+		                               found, hj->count);
+		rc = -1; goto cleanup;
+	}
+
+cleanup:
+	nowdb_hjoin_destroy(hj); free(hj);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * Add property (the model takes ownership)
+ * ------------------------------------------------------------------------
+ */
+static int addProp(ts_algo_list_t *props, char *name, uint32_t pos) {
+	nowdb_model_prop_t *p;
+
+	p = calloc(1, sizeof(nowdb_model_prop_t));
+	if (p == NULL) return -1;
+
+	p->name = strdup(name);
+	if (p->name == NULL) {
+		free(p); return -1;
+	}
+	p->pk = pos == 0;
+	p->pos = pos;
+	p->value = NOWDB_TYP_UINT;
+
+	if (ts_algo_list_append(props, p) != TS_ALGO_OK) {
+		free(p->name); free(p); return -1;
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Destroy properties not taken by the model
+ * ------------------------------------------------------------------------
+ */
+static void destroyProps(ts_algo_list_t *props) {
+	ts_algo_list_node_t *runner;
+	nowdb_model_prop_t *p;
+
+	for(runner=props->head; runner!=NULL; runner=runner->nxt) {
+		p = runner->cont;
+		free(p->name); free(p);
+	}
+	ts_algo_list_destroy(props);
+}
+
+/* ------------------------------------------------------------------------
+ * Create scope with vertex type 'vrtx' (id, value)
+ * ------------------------------------------------------------------------
+ */
+static nowdb_scope_t *mkScope(nowdb_path_t path) {
+	nowdb_err_t err;
+	nowdb_scope_t *scope;
+	nowdb_storage_config_t cfg;
+	ts_algo_list_t props;
+
+	err = nowdb_scope_new(&scope, path, 1);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return NULL;
+	}
+	/* drop the scope of a previous run */
+	err = nowdb_scope_drop(scope);
+	if (err != NOWDB_OK) nowdb_err_release(err);
+
+	err = nowdb_scope_create(scope);
+	if (err != NOWDB_OK) goto failure;
+
+	err = nowdb_scope_open(scope);
+	if (err != NOWDB_OK) goto failure;
+
+	cfg.filesize  = NOWDB_MEGA;
+	cfg.largesize = NOWDB_MEGA;
+	cfg.sorters   = 1;
+	cfg.sort      = 1;
+	cfg.comp      = NOWDB_COMP_ZSTD;
+	cfg.encp      = NOWDB_ENCP_NONE;
+
+	err = nowdb_scope_createStorage(scope, "test", &cfg);
+	if (err != NOWDB_OK) goto failure;
+
+	ts_algo_list_init(&props);
+	if (addProp(&props, "id", 0) != 0 ||
+	    addProp(&props, "value", 1) != 0) {
+		destroyProps(&props);
+		fprintf(stderr, "out-of-mem\n");
+		NOWDB_IGNORE(nowdb_scope_close(scope));
+		nowdb_scope_destroy(scope); free(scope);
+		return NULL;
+	}
+	err = nowdb_scope_createType(scope, "vrtx", &props);
+	destroyProps(&props);
+	if (err != NOWDB_OK) goto failure;
+
+	err = nowdb_scope_createContext(scope, "vrtx", "test");
+	if (err != NOWDB_OK) goto failure;
+
+	return scope;
+
+failure:
+	nowdb_err_print(err);
+	nowdb_err_release(err);
+	NOWDB_IGNORE(nowdb_scope_close(scope));
+	nowdb_scope_destroy(scope); free(scope);
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------
+ * Insert vertices 0..n-1 and wait until the sorter
+ * has moved all full files into the index
+ * ------------------------------------------------------------------------
+ */
+static int storeVertices(nowdb_store_t *store, uint64_t n) {
+	nowdb_err_t err;
+	myvrtx_t v;
+	int len;
+
+	for(uint64_t i=0; i<n; i++) {
+		mkVertex(&v, i);
+		err = nowdb_store_insert(store, &v);
+		if (err != NOWDB_OK) goto failure;
+	}
+	for(int i=0; i<1000; i++) {
+		err = nowdb_lock_read(&store->lock);
+		if (err != NOWDB_OK) goto failure;
+		len = store->waiting.len;
+		err = nowdb_unlock_read(&store->lock);
+		if (err != NOWDB_OK) goto failure;
+		if (len == 0) return 0;
+		err = nowdb_task_sleep(DELAY);
+		if (err != NOWDB_OK) goto failure;
+	}
+	fprintf(stderr, "waited for too long\n");
+	return -1;
+
+failure:
+	nowdb_err_print(err);
+	nowdb_err_release(err);
+	return -1;
+}
+
+/* ------------------------------------------------------------------------
+ * Open join on the vertex type 'vrtx'
+ * ------------------------------------------------------------------------
+ */
+static nowdb_hjoin_t *openJoin(nowdb_scope_t *scope,
+                               uint64_t      budget,
+                               char          method) {
+	nowdb_err_t err;
+	nowdb_hjoin_t *hj;
+
+	err = nowdb_hjoin_new(&hj, NOWDB_OFF_ORIGIN, EDGE_SIZE, VRTX_SIZE,
+	                      NULL, NULL, &_hlp, budget);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return NULL;
+	}
+	err = nowdb_hjoin_open(hj, scope, "vrtx", method);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_hjoin_destroy(hj); free(hj);
+		return NULL;
+	}
+	return hj;
+}
+
+/* ------------------------------------------------------------------------
+ * Nested loop: with method 'nested' and with a budget
+ * that is too small for the vertex type, the join falls back
+ * to the index; the rows are the same as those of the hash join
+ * ------------------------------------------------------------------------
+ */
+static int testNested() {
+	nowdb_err_t err;
+	nowdb_scope_t *scope;
+	nowdb_context_t *ctx;
+	nowdb_hjoin_t *hj=NULL, *nj[2] = {NULL, NULL};
+	uint64_t budget, hits=0;
+	char *row, *nrow;
+	myedge_t e;
+	int rc = 0;
+
+	fprintf(stderr, "testNested\n");
+
+	scope = mkScope("rsc/hjoin10");
+	if (scope == NULL) return -1;
+
+	err = nowdb_scope_getContext(scope, "vrtx", &ctx);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		rc = -1; goto cleanup;
+	}
+	if (ctx->store.recsize != VRTX_SIZE) {
+		fprintf(stderr, "unexpected vertex size: %u\n",
+		                             ctx->store.recsize);
+		rc = -1; goto cleanup;
+	}
+	if (storeVertices(&ctx->store, NSTORED) != 0) {
+		rc = -1; goto cleanup;
+	}
+
+	hj = openJoin(scope, NOWDB_HJOIN_MEM, NOWDB_HJOIN_HASH);
+	if (hj == NULL) {
+		rc = -1; goto cleanup;
+	}
+	if (hj->method != NOWDB_HJOIN_HASH || hj->count+1 != NSTORED) {
+		fprintf(stderr, "hash join has %lu vertices\n", hj->count);
+		rc = -1; goto cleanup;
+	}
+
+	/* explicitly nested */
+	nj[0] = openJoin(scope, NOWDB_HJOIN_MEM, NOWDB_HJOIN_NESTED);
+	if (nj[0] == NULL) {
+		rc = -1; goto cleanup;
+	}
+
+	/* half of what the vertex type needs;
+	 * the unsorted vertices (at most one file) still fit */
+	budget = hj->cap*hj->esz/2;
+	nj[1] = openJoin(scope, budget, NOWDB_HJOIN_HASH);
+	if (nj[1] == NULL) {
+		rc = -1; goto cleanup;
+	}
+	for(int k=0; k<2; k++) {
+		if (nj[k]->method != NOWDB_HJOIN_NESTED) {
+			fprintf(stderr, "join %d is not nested\n", k);
+			rc = -1; goto cleanup;
+		}
+		if (nj[k]->count >= hj->count) {
+			fprintf(stderr, "join %d: all vertices in table\n", k);
+			rc = -1; goto cleanup;
+		}
+	}
+
+	/* every other edge points to a vertex that does not exist */
+	for(uint64_t i=0; i<2*NSTORED; i+=7) {
+		mkEdge(&e, NOWDB_OFF_ORIGIN, i, 0);
+
+		err = nowdb_hjoin_probe(hj, (char*)&e, &row);
+		if (err != NOWDB_OK) break;
+		if (row != NULL) hits++;
+
+		for(int k=0; k<2; k++) {
+			err = nowdb_hjoin_probe(nj[k], (char*)&e, &nrow);
+			if (err != NOWDB_OK) break;
+			if ((row == NULL) != (nrow == NULL) ||
+			    (row != NULL && memcmp(row, nrow, hj->size) != 0)) {
+				fprintf(stderr, "join %d differs in %lu\n",
+				                                      k, i);
+				rc = -1; goto cleanup;
+			}
+		}
+		if (err != NOWDB_OK) break;
+	}
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		rc = -1; goto cleanup;
+	}
+	if (hits != (NSTORED+6)/7) {
+		fprintf(stderr, "hits: %lu\n", hits);
+		rc = -1; goto cleanup;
+	}
+	fprintf(stderr, "hits: %lu (nested: %lu and %lu in table)\n",
+	                           hits, nj[0]->count, nj[1]->count);
+
+cleanup:
+	if (hj != NULL) {
+		nowdb_hjoin_destroy(hj); free(hj);
+	}
+	for(int k=0; k<2; k++) {
+		if (nj[k] == NULL) continue;
+		nowdb_hjoin_destroy(nj[k]); free(nj[k]);
+	}
+	NOWDB_IGNORE(nowdb_scope_close(scope));
+	nowdb_scope_destroy(scope); free(scope);
+	return rc;
+}
+
+int main() {
+	int rc = EXIT_SUCCESS;
+
+	srand(time(NULL) ^ (uint64_t)&printf);
+
+	if (!nowdb_init()) {
+		fprintf(stderr, "cannot init environment\n");
+		return EXIT_FAILURE;
+	}
+	if (testJoin(NOWDB_OFF_ORIGIN, 0) != 0) {
+		fprintf(stderr, "testJoin failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testJoin(NOWDB_OFF_DESTIN, 0) != 0) {
+		fprintf(stderr, "testJoin failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testJoin(NOWDB_OFF_ORIGIN, 1) != 0) {
+		fprintf(stderr, "testJoin failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testBudget() != 0) {
+		fprintf(stderr, "testBudget failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testNested() != 0) {
+		fprintf(stderr, "testNested failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+
+cleanup:
+	nowdb_close();
+	if (rc == EXIT_SUCCESS) {
+		fprintf(stderr, "PASSED\n");
+	} else {
+		fprintf(stderr, "FAILED\n");
+	}
+	return rc;
+}
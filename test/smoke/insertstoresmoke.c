@@ -45,7 +45,7 @@ void makeEdgePattern(char *e) {
 	setValue(e, EDGE_OFF, 0xc);
 	setValue(e, LABEL_OFF, 0xd);
 	setValue(e, WEIGHT_OFF, 0);
-	setValue(e, WEIGHT_OFF+8, 63);
+	e[WEIGHT_OFF+8] = 63; /* one control byte for 6 attributes */
 }
 
 #define RECPAGE (NOWDB_IDX_PAGE/recsz)
@@ -83,6 +83,39 @@ nowdb_bool_t insertEdges(nowdb_store_t *store, uint32_t count, uint64_t start) {
 	return TRUE;
 }
 
+nowdb_bool_t insertEdgesBulk(nowdb_store_t *store, uint32_t count,
+                             uint64_t start, uint32_t batch) {
+	nowdb_err_t err;
+	char *buf;
+	uint64_t max = start + count;
+	uint32_t recsz = nowdb_recSize(6);
+	uint32_t k=0;
+
+	buf = calloc(batch, recsz);
+	if (buf == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		return FALSE;
+	}
+	for(uint32_t i=0; i<batch; i++) makeEdgePattern(buf+i*recsz);
+
+	for(uint64_t i=start; i<max; i++) {
+		setValue(buf+k*recsz, WEIGHT_OFF, i); k++;
+		if (k < batch && i+1 < max) continue;
+		err = nowdb_store_insertBulk(store, buf, k);
+		if (err != NOWDB_OK) {
+			fprintf(stderr, "insert error\n");
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			free(buf); return FALSE;
+		}
+		k=0;
+	}
+	fprintf(stderr, "inserted %u from %lu to %lu in batches of %u\n",
+	                                        count, start, max, batch);
+	free(buf);
+	return TRUE;
+}
+
 nowdb_bool_t checkInitial(nowdb_store_t *store) {
 	if (store->writer == NULL) {
 		fprintf(stderr, "store without writer\n");
@@ -323,6 +356,67 @@ nowdb_bool_t checkFiles(nowdb_store_t *store) {
 	return TRUE;
 }
 
+/* as main, but the second half goes in batches of an odd size
+   crossing pages and the file boundary */
+nowdb_bool_t testBulk(uint32_t recsz) {
+	nowdb_bool_t rc = FALSE;
+	nowdb_store_t *store;
+
+	store = bootstrap("rsc/store11", NOWDB_CONT_EDGE, recsz);
+	if (store == NULL) {
+		fprintf(stderr, "cannot create store\n");
+		return FALSE;
+	}
+	if (!checkInitial(store)) {
+		fprintf(stderr, "checkInitial failed\n");
+		goto cleanup;
+	}
+	if (!insertEdges(store, HALF, 0)) {
+		fprintf(stderr, "insertEdges failed\n");
+		goto cleanup;
+	}
+	if (!checkHalf(store)) {
+		fprintf(stderr, "checkHalf failed\n");
+		goto cleanup;
+	}
+	if (!insertEdgesBulk(store, FULL, HALF, 1000)) {
+		fprintf(stderr, "insertEdgesBulk failed\n");
+		goto cleanup;
+	}
+	if (!checkFull(store)) {
+		fprintf(stderr, "checkFull failed\n");
+		goto cleanup;
+	}
+	if (!checkFiles(store)) {
+		fprintf(stderr, "checkFiles failed\n");
+		goto cleanup;
+	}
+	if (!closeStore(store)) {
+		fprintf(stderr, "closeStore failed\n");
+		goto cleanup;
+	}
+	if (!openStore(store)) {
+		fprintf(stderr, "openStore failed\n");
+		goto cleanup;
+	}
+	if (!checkFull(store)) {
+		fprintf(stderr, "checkFull (2) failed\n");
+		goto cleanup;
+	}
+	if (!checkFiles(store)) {
+		fprintf(stderr, "checkFiles (2) failed\n");
+		goto cleanup;
+	}
+	rc = TRUE;
+
+cleanup:
+	if (closeStore(store)) {
+		destroyStore(store);
+		free(store);
+	}
+	return rc;
+}
+
 int main() {
 	struct timespec t1, t2;
 	int rc = EXIT_SUCCESS;
@@ -377,6 +471,10 @@ int main() {
 		fprintf(stderr, "checkFile (2) failed\n");
 		rc = EXIT_FAILURE; goto cleanup;
 	}
+	if (!testBulk(recsz)) {
+		fprintf(stderr, "testBulk failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
 	
 cleanup:
 	if (store != NULL) {
@@ -0,0 +1,338 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Simple tests for the interval tree over files
+ * ========================================================================
+ */
+#include <nowdb/types/types.h>
+#include <nowdb/types/error.h>
+#include <nowdb/store/itree.h>
+
+#include <tsalgo/list.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#define NFILES  1000
+#define RANGE  10000
+#define NQUERY   200
+
+nowdb_file_t files[NFILES];
+char intree[NFILES];
+
+/* ------------------------------------------------------------------------
+ * Random period
+ * ------------------------------------------------------------------------
+ */
+static void randomPeriod(nowdb_time_t *from, nowdb_time_t *to) {
+	*from = rand()%RANGE;
+	*to = *from + rand()%(RANGE/10);
+}
+
+/* ------------------------------------------------------------------------
+ * Check the tree below n: ordered, balanced, max newest correct
+ * ------------------------------------------------------------------------
+ */
+static int checkNode(nowdb_itree_node_t *n, nowdb_itree_node_t **prev,
+                     int32_t *height, nowdb_time_t *maxnw) {
+	int32_t lh=0, rh=0;
+	nowdb_time_t lm=NOWDB_TIME_DAWN, rm=NOWDB_TIME_DAWN;
+
+	*height = 0; *maxnw = NOWDB_TIME_DAWN;
+	if (n == NULL) return 0;
+
+	if (checkNode(n->left, prev, &lh, &lm) != 0) return -1;
+	if (*prev != NULL && ((*prev)->oldest > n->oldest ||
+	   ((*prev)->oldest == n->oldest && (*prev)->fid > n->fid))) {
+		fprintf(stderr, "tree not ordered\n");
+		return -1;
+	}
+	*prev = n;
+	if (checkNode(n->right, prev, &rh, &rm) != 0) return -1;
+
+	if (lh-rh > 1 || rh-lh > 1) {
+		fprintf(stderr, "tree not balanced: %d / %d\n", lh, rh);
+		return -1;
+	}
+	*height = 1 + (lh > rh ? lh : rh);
+	*maxnw = n->newest;
+	if (lm > *maxnw) *maxnw = lm;
+	if (rm > *maxnw) *maxnw = rm;
+	if (n->height != *height || n->maxnw != *maxnw) {
+		fprintf(stderr, "wrong node: %d / %d\n", n->height, *height);
+		return -1;
+	}
+	return 0;
+}
+
+static int checkTree(nowdb_itree_t *tree) {
+	nowdb_itree_node_t *prev = NULL;
+	nowdb_time_t maxnw;
+	int32_t height;
+
+	return checkNode(tree->root, &prev, &height, &maxnw);
+}
+
+/* ------------------------------------------------------------------------
+ * Search and compare with the naive way
+ * ------------------------------------------------------------------------
+ */
+static int checkSearch(nowdb_itree_t *tree,
+                       nowdb_time_t from, nowdb_time_t to) {
+	ts_algo_list_t list;
+	ts_algo_list_node_t *runner;
+	nowdb_file_t *file, *prev=NULL;
+	nowdb_err_t err;
+	char found[NFILES];
+	int n=0, rc=0;
+
+	if (checkTree(tree) != 0) return -1;
+
+	memset(found, 0, NFILES);
+	ts_algo_list_init(&list);
+
+	err = nowdb_itree_search(tree, from, to, &list);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return -1;
+	}
+	for(runner=list.head; runner!=NULL; runner=runner->nxt) {
+		file = runner->cont;
+		if (prev != NULL && prev->oldest > file->oldest) {
+			fprintf(stderr, "not ordered\n");
+			rc = -1; goto cleanup;
+		}
+		if (file->oldest > to || file->newest < from) {
+			fprintf(stderr, "not in period: %ld-%ld (%ld-%ld)\n",
+			        file->oldest, file->newest, from, to);
+			rc = -1; goto cleanup;
+		}
+		if (!intree[file->id] || found[file->id]) {
+			fprintf(stderr, "unexpected file %u\n", file->id);
+			rc = -1; goto cleanup;
+		}
+		found[file->id] = 1; prev = file;
+	}
+	for(int i=0; i<NFILES; i++) {
+		if (!intree[i]) continue;
+		if (files[i].oldest > to || files[i].newest < from) continue;
+		if (!found[i]) {
+			fprintf(stderr, "file %d not found\n", i);
+			rc = -1; goto cleanup;
+		}
+		n++;
+	}
+	if (n != list.len) {
+		fprintf(stderr, "expected %d, found %d\n", n, list.len);
+		rc = -1; goto cleanup;
+	}
+cleanup:
+	ts_algo_list_destroy(&list);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * Insert, remove and search at random
+ * ------------------------------------------------------------------------
+ */
+static int testRandom() {
+	nowdb_itree_t tree;
+	nowdb_err_t err;
+	nowdb_time_t from, to;
+	int rc = 0;
+
+	fprintf(stderr, "testRandom\n");
+
+	nowdb_itree_init(&tree);
+	memset(intree, 0, NFILES);
+
+	for(int i=0; i<NFILES; i++) {
+		files[i].id = i;
+		files[i].oldest = rand()%RANGE;
+		files[i].newest = files[i].oldest + rand()%(RANGE/20);
+	}
+	for(int r=0; r<4*NFILES; r++) {
+		int i = rand()%NFILES;
+		if (intree[i]) {
+			nowdb_itree_remove(&tree, files+i);
+			intree[i] = 0;
+		} else {
+			err = nowdb_itree_insert(&tree, files+i);
+			if (err != NOWDB_OK) {
+				nowdb_err_print(err);
+				nowdb_err_release(err);
+				rc = -1; goto cleanup;
+			}
+			intree[i] = 1;
+		}
+		if (r%(4*NFILES/NQUERY) != 0) continue;
+		randomPeriod(&from, &to);
+		if (checkSearch(&tree, from, to) != 0) {
+			rc = -1; goto cleanup;
+		}
+	}
+	if (checkSearch(&tree, NOWDB_TIME_DAWN, NOWDB_TIME_DUSK) != 0) {
+		rc = -1; goto cleanup;
+	}
+	/* empty periods */
+	if (checkSearch(&tree, RANGE*2, RANGE*3) != 0 ||
+	    checkSearch(&tree, -RANGE, -1) != 0) {
+		rc = -1; goto cleanup;
+	}
+cleanup:
+	nowdb_itree_destroy(&tree);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * Files without timestamps cover everything;
+ * remove finds files even if their times have changed
+ * ------------------------------------------------------------------------
+ */
+static int testNoTime() {
+	nowdb_itree_t tree;
+	nowdb_err_t err;
+	int rc = 0;
+
+	fprintf(stderr, "testNoTime\n");
+
+	nowdb_itree_init(&tree);
+	memset(intree, 0, NFILES);
+
+	for(int i=0; i<100; i++) {
+		files[i].id = i;
+		files[i].oldest = NOWDB_TIME_DAWN;
+		files[i].newest = NOWDB_TIME_DUSK;
+		err = nowdb_itree_insert(&tree, files+i);
+		if (err != NOWDB_OK) {
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			rc = -1; goto cleanup;
+		}
+		intree[i] = 1;
+	}
+	if (checkSearch(&tree, 17, 42) != 0) {
+		rc = -1; goto cleanup;
+	}
+	files[50].oldest = 1000;
+	nowdb_itree_remove(&tree, files+50); intree[50] = 0;
+	if (tree.count != 99) {
+		fprintf(stderr, "file not removed\n");
+		rc = -1; goto cleanup;
+	}
+	if (checkSearch(&tree, NOWDB_TIME_DAWN, NOWDB_TIME_DUSK) != 0) {
+		rc = -1; goto cleanup;
+	}
+cleanup:
+	nowdb_itree_destroy(&tree);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * Loading many files at once is the same as inserting them one by one
+ * ------------------------------------------------------------------------
+ */
+static int testInsertAll() {
+	nowdb_itree_t tree;
+	ts_algo_list_t list;
+	nowdb_err_t err;
+	nowdb_time_t from, to;
+	int rc = 0;
+
+	fprintf(stderr, "testInsertAll\n");
+
+	nowdb_itree_init(&tree);
+	ts_algo_list_init(&list);
+	memset(intree, 0, NFILES);
+
+	for(int i=0; i<NFILES; i++) {
+		files[i].id = i;
+		files[i].oldest = rand()%RANGE;
+		files[i].newest = files[i].oldest + rand()%(RANGE/20);
+	}
+	/* some inserted before */
+	for(int i=0; i<NFILES/10; i++) {
+		err = nowdb_itree_insert(&tree, files+i);
+		if (err != NOWDB_OK) {
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			rc = -1; goto cleanup;
+		}
+		intree[i] = 1;
+	}
+	for(int i=NFILES/10; i<NFILES; i++) {
+		if (ts_algo_list_append(&list, files+i) != TS_ALGO_OK) {
+			fprintf(stderr, "list append failed\n");
+			rc = -1; goto cleanup;
+		}
+		intree[i] = 1;
+	}
+	err = nowdb_itree_insertAll(&tree, &list);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		rc = -1; goto cleanup;
+	}
+	if (tree.count != NFILES) {
+		fprintf(stderr, "expected %d files, have %u\n",
+		                                NFILES, tree.count);
+		rc = -1; goto cleanup;
+	}
+	for(int r=0; r<NQUERY; r++) {
+		randomPeriod(&from, &to);
+		if (checkSearch(&tree, from, to) != 0) {
+			rc = -1; goto cleanup;
+		}
+	}
+	/* the order is the one remove expects */
+	for(int i=0; i<NFILES; i+=2) {
+		nowdb_itree_remove(&tree, files+i); intree[i] = 0;
+	}
+	if (tree.count != NFILES/2) {
+		fprintf(stderr, "files not removed\n");
+		rc = -1; goto cleanup;
+	}
+	if (checkSearch(&tree, NOWDB_TIME_DAWN, NOWDB_TIME_DUSK) != 0) {
+		rc = -1; goto cleanup;
+	}
+cleanup:
+	ts_algo_list_destroy(&list);
+	nowdb_itree_destroy(&tree);
+	return rc;
+}
+
+int main() {
+	int rc = EXIT_SUCCESS;
+
+	srand(time(NULL) ^ (uint64_t)&printf);
+
+	if (!nowdb_err_init()) {
+		fprintf(stderr, "cannot init error manager\n");
+		return EXIT_FAILURE;
+	}
+	if (testRandom() != 0) {
+		fprintf(stderr, "testRandom failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testNoTime() != 0) {
+		fprintf(stderr, "testNoTime failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testInsertAll() != 0) {
+		fprintf(stderr, "testInsertAll failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+
+cleanup:
+	nowdb_err_destroy();
+	if (rc == EXIT_SUCCESS) {
+		fprintf(stderr, "PASSED\n");
+	} else {
+		fprintf(stderr, "FAILED\n");
+	}
+	return rc;
+}
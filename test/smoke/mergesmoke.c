@@ -117,7 +117,8 @@ int testBuffer(nowdb_scope_t *scope, int h) {
 	
 	// create buffer
 	err = nowdb_reader_bufidx(&reader, &files, idx, NULL,
-	                  &_eval, NOWDB_ORD_ASC, NULL, NULL);
+	                  &_eval, NOWDB_ORD_ASC, NULL, NULL,
+	                            NULL, NOWDB_COMP_FLAT, 0);
 	if (err != NOWDB_OK) {
 		fprintf(stderr, "cannot create buffer\n");
 		nowdb_store_destroyFiles(&ctx->store, &files);
@@ -254,7 +255,8 @@ int testBKRange(nowdb_scope_t *scope, int h) {
 	
 	// create buffer
 	err = nowdb_reader_bkrange(&reader, &files, idx, NULL,
-	                    &_eval, NOWDB_ORD_ASC, NULL, NULL);
+	                    &_eval, NOWDB_ORD_ASC, NULL, NULL,
+	                              NULL, NOWDB_COMP_FLAT, 0);
 	if (err != NOWDB_OK) {
 		fprintf(stderr, "cannot create kbuffer\n");
 		nowdb_store_destroyFiles(&ctx->store, &files);
@@ -585,7 +587,7 @@ cleanup:
 
 int uniqueKey = 0;
 
-int testMerge(nowdb_scope_t *scope, char type, int h) {
+int testMerge(nowdb_scope_t *scope, char type, int h, uint64_t runsz) {
 	int rc = 0;
 	int c = 0;
 	int c0 = 0, c1 = 0;
@@ -661,11 +663,13 @@ int testMerge(nowdb_scope_t *scope, char type, int h) {
 	switch(type) {
 	case 'k':
 		err = nowdb_reader_bkrange(&buffer, &pfiles, idx, NULL,
-		                    &_eval, NOWDB_ORD_ASC, NULL, NULL);
+		                    &_eval, NOWDB_ORD_ASC, NULL, NULL,
+		                      scope->path, NOWDB_COMP_LZ4, runsz);
 		break;
 	default:
 		err = nowdb_reader_bufidx(&buffer, &pfiles, idx, NULL,
-		                    &_eval, NOWDB_ORD_ASC, NULL, NULL);
+		                    &_eval, NOWDB_ORD_ASC, NULL, NULL,
+		                     scope->path, NOWDB_COMP_LZ4, runsz);
 	}
 	if (err != NOWDB_OK) {
 		fprintf(stderr, "cannot create buffer\n");
@@ -886,7 +890,14 @@ int main() {
 
 	// test mergereader
 	fprintf(stderr, "MERGE\n");
-	if (testMerge(scope, 'r', NEDGES) != 0) {
+	if (testMerge(scope, 'r', NEDGES, 0) != 0) {
+		fprintf(stderr, "testMerge failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+
+	// test mergereader with external sort
+	fprintf(stderr, "MERGE (external sort)\n");
+	if (testMerge(scope, 'r', NEDGES, 65536) != 0) {
 		fprintf(stderr, "testMerge failed\n");
 		rc = EXIT_FAILURE; goto cleanup;
 	}
@@ -907,7 +918,14 @@ int main() {
 
 	// test kmerge
 	fprintf(stderr, "KMERGE\n");
-	if (testMerge(scope, 'k', NEDGES) != 0) {
+	if (testMerge(scope, 'k', NEDGES, 0) != 0) {
+		fprintf(stderr, "testKMerge failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+
+	// test kmerge with external sort
+	fprintf(stderr, "KMERGE (external sort)\n");
+	if (testMerge(scope, 'k', NEDGES, 65536) != 0) {
 		fprintf(stderr, "testKMerge failed\n");
 		rc = EXIT_FAILURE; goto cleanup;
 	}
@@ -0,0 +1,311 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Simple tests for compiled expressions:
+ * random expressions on random edges must yield the same result
+ * when evaluated as tree and as program.
+ * ========================================================================
+ */
+#include <nowdb/types/types.h>
+#include <nowdb/types/time.h>
+#include <nowdb/fun/expr.h>
+#include <common/rndexpr.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+/* ------------------------------------------------------------------------
+ * Edge with origin, destin, stamp and NCOLS properties;
+ * the type of property k is types[k%4].
+ * ------------------------------------------------------------------------
+ */
+#define NCOLS 64
+#define NATTS (NCOLS+3)
+
+#define RECSZ (NATTS*8+16)
+
+#define NEXPR 1000
+#define NROWS 50
+#define DEPTH 5
+
+static nowdb_type_t types[] = {NOWDB_TYP_UINT, NOWDB_TYP_INT,
+                               NOWDB_TYP_FLOAT, NOWDB_TYP_TIME};
+
+/* ------------------------------------------------------------------------
+ * The tree converts operands in place, even in the row;
+ * so, every field is used only once per expression
+ * (otherwise the tree would see the converted value).
+ * ------------------------------------------------------------------------
+ */
+static int ncols, ecols;
+static char stampUsed, originUsed;
+
+static void resetFields() {
+	ncols = rand()%4;
+	ecols = ncols+NCOLS-4;
+	stampUsed = 0;
+	originUsed = 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Random edge, props are NULL with a probability of 10%
+ * ------------------------------------------------------------------------
+ */
+static void mkEdge(char *rec) {
+	uint64_t u; int64_t l; double d;
+	uint8_t bit; uint16_t byte;
+
+	memset(rec, 0, RECSZ);
+
+	u = rand()%1000+1; memcpy(rec, &u, 8);
+	u = rand()%1000+1; memcpy(rec+8, &u, 8);
+	l = (int64_t)(rand()%1000000)*1000000000l; memcpy(rec+16, &l, 8);
+
+	for(int k=0; k<NCOLS; k++) {
+		char *v = rec+24+8*k;
+
+		switch(types[k%4]) {
+		case NOWDB_TYP_UINT:
+			u = rand()%100; memcpy(v, &u, 8); break;
+		case NOWDB_TYP_INT:
+			l = rand()%200-100; memcpy(v, &l, 8); break;
+		case NOWDB_TYP_FLOAT:
+			d = (double)(rand()%2000-1000)/10.0;
+			memcpy(v, &d, 8); break;
+		default:
+			l = (int64_t)(rand()%1000000)*1000000000l;
+			memcpy(v, &l, 8);
+		}
+	}
+	for(int j=0; j<NATTS; j++) {
+		if (j > 2 && rand()%10 == 0) continue;
+		nowdb_getCtrl(8*j, &bit, &byte);
+		rec[nowdb_ctrlStart(NATTS)+byte] |= 1 << bit;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Random field
+ * ------------------------------------------------------------------------
+ */
+static nowdb_expr_t rndField() {
+	char name[16];
+	int k;
+
+	if (!stampUsed && rand()%8 == 0) {
+		stampUsed = 1;
+		return field(NULL, NOWDB_OFF_STAMP, NOWDB_TYP_TIME);
+	}
+	if (!originUsed && rand()%8 == 0) {
+		originUsed = 1;
+		return field(NULL, NOWDB_OFF_ORIGIN, NOWDB_TYP_UINT);
+	}
+	if (ncols >= ecols) return uconst(rand()%100);
+
+	k = ncols++;
+	sprintf(name, "p%d", k);
+	return field(name, 24+8*k, types[k%4]);
+}
+
+/* ------------------------------------------------------------------------
+ * Evaluate one expression on some edges as tree and as program.
+ * Tree and program remember the last result of each operation
+ * and the tree converts operands in place (even constants);
+ * each edge therefore gets a fresh tree, a fresh program
+ * and fresh copies of the edge.
+ * ------------------------------------------------------------------------
+ */
+static int testExpr(nowdb_expr_t expr) {
+	nowdb_err_t err1, err2;
+	nowdb_expr_t tree, prog;
+	nowdb_type_t t1, t2;
+	char rec[RECSZ], r1[RECSZ], r2[RECSZ];
+	void *v1, *v2;
+	int rc = 0;
+
+	for(int i=0; i<NROWS; i++) {
+		mkEdge(rec);
+		memcpy(r1, rec, RECSZ);
+		memcpy(r2, rec, RECSZ);
+
+		if (nowdb_expr_copy(expr, &tree) != NOWDB_OK) {
+			fprintf(stderr, "cannot copy expression\n");
+			return -1;
+		}
+		if (nowdb_expr_copy(expr, &prog) != NOWDB_OK) {
+			fprintf(stderr, "cannot copy expression\n");
+			destroyExpr(tree); return -1;
+		}
+		err1 = nowdb_expr_compile(prog);
+		if (err1 != NOWDB_OK) {
+			nowdb_err_print(err1);
+			nowdb_err_release(err1);
+			destroyExpr(tree); destroyExpr(prog);
+			return -1;
+		}
+		err1 = nowdb_expr_eval(tree, NULL, r1, &t1, &v1);
+		err2 = nowdb_expr_eval(prog, NULL, r2, &t2, &v2);
+
+		if ((err1 == NOWDB_OK) != (err2 == NOWDB_OK)) {
+			fprintf(stderr, "only one failed: %d / %d\n",
+			                err1 == NOWDB_OK, err2 == NOWDB_OK);
+			rc = -1;
+		} else if (err1 == NOWDB_OK &&
+		           !sameResult(t1, v1, t2, v2)) {
+			fprintf(stderr, "results differ: %u / %u\n", t1, t2);
+			rc = -1;
+		}
+		nowdb_err_release(err1);
+		nowdb_err_release(err2);
+
+		if (rc != 0) {
+			nowdb_expr_show(expr, stderr); fprintf(stderr, "\n");
+		}
+		destroyExpr(tree); destroyExpr(prog);
+		if (rc != 0) break;
+	}
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * Random expressions
+ * ------------------------------------------------------------------------
+ */
+int testRandom() {
+	nowdb_expr_t expr;
+
+	for(int i=0; i<NEXPR; i++) {
+		resetFields();
+		expr = rand()%2?rndBool(DEPTH):rndNum(DEPTH);
+		if (expr == NULL) {
+			fprintf(stderr, "cannot create expression\n");
+			return -1;
+		}
+		if (testExpr(expr) != 0) {
+			destroyExpr(expr); return -1;
+		}
+		destroyExpr(expr);
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Constants are folded; now() is not
+ * ------------------------------------------------------------------------
+ */
+int testFold() {
+	nowdb_err_t err;
+	nowdb_expr_t expr, cpy;
+	nowdb_type_t t;
+	nowdb_time_t t1, t2;
+	double d;
+	void *v;
+	int rc = 0;
+
+	// (2 + 3) * pi() > 15.0
+	expr = op2(NOWDB_EXPR_OP_GT,
+	           op2(NOWDB_EXPR_OP_MUL,
+	               op2(NOWDB_EXPR_OP_ADD, uconst(2), iconst(3)),
+	               op0(NOWDB_EXPR_OP_PI)),
+	           fconst(15.0));
+	if (expr == NULL) return -1;
+
+	err = nowdb_expr_compile(expr);
+	if (err != NOWDB_OK) goto cleanup;
+
+	// copies are compiled as well
+	err = nowdb_expr_copy(expr, &cpy);
+	if (err != NOWDB_OK) goto cleanup;
+
+	// the result must not depend on the constants anymore
+	d = 100.0;
+	memcpy(NOWDB_EXPR_TOCONST(NOWDB_EXPR_TOOP(expr)->argv[1])->value,
+	       &d, 8);
+
+	err = nowdb_expr_eval(expr, NULL, NULL, &t, &v);
+	if (err != NOWDB_OK) {
+		destroyExpr(cpy); goto cleanup;
+	}
+	if (t != NOWDB_TYP_BOOL || *(nowdb_value_t*)v != 1) {
+		fprintf(stderr, "constant not folded: %u, %lu\n",
+		                         t, *(nowdb_value_t*)v);
+		destroyExpr(cpy); rc = -1; goto cleanup;
+	}
+
+	err = nowdb_expr_eval(cpy, NULL, NULL, &t, &v);
+	if (err != NOWDB_OK) {
+		destroyExpr(cpy); goto cleanup;
+	}
+	if (t != NOWDB_TYP_BOOL || *(nowdb_value_t*)v != 1) {
+		fprintf(stderr, "copy differs: %u, %lu\n",
+		                 t, *(nowdb_value_t*)v);
+		destroyExpr(cpy); rc = -1; goto cleanup;
+	}
+	destroyExpr(cpy);
+	destroyExpr(expr);
+
+	// now() + 0
+	expr = op2(NOWDB_EXPR_OP_ADD, op0(NOWDB_EXPR_OP_NOW), iconst(0));
+	if (expr == NULL) return -1;
+
+	err = nowdb_expr_compile(expr);
+	if (err != NOWDB_OK) goto cleanup;
+
+	err = nowdb_expr_eval(expr, NULL, NULL, &t, &v);
+	if (err != NOWDB_OK) goto cleanup;
+	memcpy(&t1, v, 8);
+
+	usleep(1000);
+
+	err = nowdb_expr_eval(expr, NULL, NULL, &t, &v);
+	if (err != NOWDB_OK) goto cleanup;
+	memcpy(&t2, v, 8);
+
+	if (t != NOWDB_TYP_TIME || t1 >= t2) {
+		fprintf(stderr, "now() folded: %u, %ld, %ld\n", t, t1, t2);
+		rc = -1; goto cleanup;
+	}
+
+cleanup:
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		rc = -1;
+	}
+	destroyExpr(expr);
+	return rc;
+}
+
+int main() {
+	int rc = EXIT_SUCCESS;
+
+	srand(time(NULL) ^ (uint64_t)&printf);
+	initRndExpr(NATTS, &rndField);
+
+	if (!nowdb_err_init()) {
+		fprintf(stderr, "cannot init error manager\n");
+		return EXIT_FAILURE;
+	}
+	if (testFold() != 0) {
+		fprintf(stderr, "testFold failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testRandom() != 0) {
+		fprintf(stderr, "testRandom failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+
+cleanup:
+	nowdb_err_destroy();
+	if (rc == EXIT_SUCCESS) {
+		fprintf(stderr, "PASSED\n");
+	} else {
+		fprintf(stderr, "FAILED\n");
+	}
+	return rc;
+}
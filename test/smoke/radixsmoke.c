@@ -0,0 +1,237 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Simple tests for radix sort
+ * ========================================================================
+ */
+#include <nowdb/types/types.h>
+#include <nowdb/types/error.h>
+#include <nowdb/sort/radix.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#define NATTS    5
+#define SEQ_OFF 24
+
+uint32_t recsz;
+
+/* ------------------------------------------------------------------------
+ * Random pages of edges;
+ * every 7th page is only partially filled.
+ * The field 'seq' holds the position in the input.
+ * ------------------------------------------------------------------------
+ */
+static char *mkPages(uint32_t npages, uint64_t range, uint64_t *count) {
+	uint32_t perpage = NOWDB_IDX_PAGE/recsz;
+	uint32_t n;
+	uint64_t k=0;
+	char *pages;
+
+	pages = calloc(npages, NOWDB_IDX_PAGE);
+	if (pages == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		return NULL;
+	}
+	for(uint32_t i=0; i<npages; i++) {
+		char *page = pages+i*NOWDB_IDX_PAGE;
+		n = i%7 == 6 ? rand()%perpage : perpage;
+		for(uint32_t j=0; j<n; j++,k++) {
+			char *rec = page+j*recsz;
+			uint64_t u;
+
+			u = range == 0 ? ((uint64_t)rand() << 33 | rand()) :
+			                  (uint64_t)rand()%range+1;
+			memcpy(rec+NOWDB_OFF_ORIGIN, &u, 8);
+			u = range == 0 ? ((uint64_t)rand() << 33 | rand()) :
+			                  (uint64_t)rand()%range+1;
+			memcpy(rec+NOWDB_OFF_DESTIN, &u, 8);
+			u = rand()%10;
+			memcpy(rec+NOWDB_OFF_STAMP, &u, 8);
+			memcpy(rec+SEQ_OFF, &k, 8);
+			rec[nowdb_ctrlStart(NATTS)] = 0x1f;
+		}
+	}
+	*count = k;
+	return pages;
+}
+
+/* ------------------------------------------------------------------------
+ * Helper: compare keys of two records
+ * ------------------------------------------------------------------------
+ */
+static int cmpKeys(char *one, char *two, uint32_t *keys, uint32_t nkeys) {
+	uint64_t a, b;
+
+	for(uint32_t k=0; k<nkeys; k++) {
+		memcpy(&a, one+keys[k], 8);
+		memcpy(&b, two+keys[k], 8);
+		if (a < b) return -1;
+		if (a > b) return 1;
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Check that the pages are sorted, stable, packed and complete
+ * ------------------------------------------------------------------------
+ */
+static int checkSorted(char *pages, uint32_t npages, uint64_t count,
+                       uint32_t *keys, uint32_t nkeys) {
+	uint32_t perpage = NOWDB_IDX_PAGE/recsz;
+	uint64_t k=0, s1, s2, sum=0;
+	char *prev=NULL, *rec;
+	int x;
+
+	for(uint32_t i=0; i<npages; i++) {
+		char *page = pages+i*NOWDB_IDX_PAGE;
+		for(uint32_t j=0; j<perpage; j++) {
+			rec = page+j*recsz;
+			if (k == count) {
+				if (memcmp(rec, nowdb_nullrec, recsz) != 0) {
+					fprintf(stderr, "not packed: %u.%u\n",
+					                                i, j);
+					return -1;
+				}
+				continue;
+			}
+			if (prev != NULL) {
+				x = cmpKeys(prev, rec, keys, nkeys);
+				if (x > 0) {
+					fprintf(stderr, "not sorted: %lu\n", k);
+					return -1;
+				}
+				memcpy(&s1, prev+SEQ_OFF, 8);
+				memcpy(&s2, rec+SEQ_OFF, 8);
+				if (x == 0 && s1 > s2) {
+					fprintf(stderr, "not stable: %lu\n", k);
+					return -1;
+				}
+			}
+			memcpy(&s1, rec+SEQ_OFF, 8);
+			sum += s1;
+			prev = rec; k++;
+		}
+	}
+	if (k != count) {
+		fprintf(stderr, "records lost: %lu of %lu\n", k, count);
+		return -1;
+	}
+	if (sum != count*(count-1)/2) {
+		fprintf(stderr, "records changed\n");
+		return -1;
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Sort and check
+ * ------------------------------------------------------------------------
+ */
+static int testSort(uint32_t npages, uint64_t range,
+                    uint32_t nkeys, uint32_t tasks) {
+	uint32_t keys[3] = {NOWDB_OFF_ORIGIN, NOWDB_OFF_DESTIN,
+	                                      NOWDB_OFF_STAMP};
+	uint64_t count;
+	char *pages;
+	int rc = 0;
+
+	fprintf(stderr, "testSort(%u, %lu, %u, %u)\n",
+	                npages, range, nkeys, tasks);
+
+	pages = mkPages(npages, range, &count);
+	if (pages == NULL) return -1;
+
+	rc = nowdb_radix_sort(pages, npages*NOWDB_IDX_PAGE,
+	                      NOWDB_IDX_PAGE, recsz,
+	                      keys, nkeys, tasks);
+	if (rc != 0) {
+		fprintf(stderr, "radix sort failed: %d\n", rc);
+		free(pages); return -1;
+	}
+	rc = checkSorted(pages, npages, count, keys, nkeys);
+	free(pages);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * Invalid parameters are refused
+ * ------------------------------------------------------------------------
+ */
+static int testInvalid() {
+	uint32_t keys[4] = {0, 8, 16, 24};
+	uint32_t out = NOWDB_IDX_PAGE;
+	char *pages;
+	int rc = 0;
+
+	fprintf(stderr, "testInvalid\n");
+
+	pages = calloc(2, NOWDB_IDX_PAGE);
+	if (pages == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		return -1;
+	}
+	if (nowdb_radix_sort(pages, 2*NOWDB_IDX_PAGE, NOWDB_IDX_PAGE,
+	                                  recsz, keys, 4, 1) != -3) {
+		fprintf(stderr, "too many keys accepted\n");
+		rc = -1; goto cleanup;
+	}
+	if (nowdb_radix_sort(pages, 2*NOWDB_IDX_PAGE, NOWDB_IDX_PAGE,
+	                                  recsz, &out, 1, 1) != -3) {
+		fprintf(stderr, "key out of record accepted\n");
+		rc = -1; goto cleanup;
+	}
+	if (nowdb_radix_sort(pages, NOWDB_IDX_PAGE+1, NOWDB_IDX_PAGE,
+	                                  recsz, keys, 1, 1) != -2) {
+		fprintf(stderr, "odd size accepted\n");
+		rc = -1; goto cleanup;
+	}
+	if (nowdb_radix_sort(pages, 2*NOWDB_IDX_PAGE, NOWDB_IDX_PAGE,
+	                                  recsz, keys, 2, 4) != 0) {
+		fprintf(stderr, "empty buffer not accepted\n");
+		rc = -1; goto cleanup;
+	}
+
+cleanup:
+	free(pages);
+	return rc;
+}
+
+int main() {
+	int rc = EXIT_SUCCESS;
+
+	srand(time(NULL) ^ (uint64_t)&printf);
+
+	recsz = nowdb_recSize(NATTS);
+
+	if (!nowdb_err_init()) {
+		fprintf(stderr, "cannot init error manager\n");
+		return EXIT_FAILURE;
+	}
+	// small keys, large keys, many duplicates
+	if (testSort(100, 1000, 2, 1) != 0 ||
+	    testSort(100, 1000, 2, 4) != 0 ||
+	    testSort(100, 0, 2, 3) != 0 ||
+	    testSort(100, 10, 3, 4) != 0 ||
+	    testSort(3, 100, 2, 16) != 0 ||
+	    testSort(1, 1000, 1, 1) != 0) {
+		fprintf(stderr, "testSort failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testInvalid() != 0) {
+		fprintf(stderr, "testInvalid failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+
+cleanup:
+	nowdb_err_destroy();
+	if (rc == EXIT_SUCCESS) {
+		fprintf(stderr, "PASSED\n");
+	} else {
+		fprintf(stderr, "FAILED\n");
+	}
+	return rc;
+}
@@ -141,7 +141,7 @@ nowdb_bool_t waitSorted(nowdb_store_t *store) {
 	return ok;
 }
 
-nowdb_bool_t testFullscan(nowdb_store_t *store) {
+nowdb_bool_t testFullscan(nowdb_store_t *store, uint32_t ahead) {
 	nowdb_err_t err;
 	nowdb_reader_t *reader;
 	ts_algo_list_t files;
@@ -167,6 +167,7 @@ nowdb_bool_t testFullscan(nowdb_store_t *store) {
 		nowdb_store_destroyFiles(store, &files);
 		return FALSE;
 	}
+	nowdb_reader_setReadahead(reader, ahead);
 	for(;;) {
 		err = nowdb_reader_move(reader);
 		if (err != NOWDB_OK) {
@@ -194,7 +195,6 @@ nowdb_bool_t testFullscan(nowdb_store_t *store) {
 }
 
 int main() {
-	nowdb_err_t err;
 	struct timespec t1, t2;
 	int rc = EXIT_SUCCESS;
 	nowdb_store_t *store1=NULL, *store2=NULL;
@@ -221,7 +221,7 @@ int main() {
 	}
 	fprintf(stderr, "starting to read\n");
 	timestamp(&t1);
-	if (!testFullscan(store1)) {
+	if (!testFullscan(store1, 0)) {
 		fprintf(stderr, "cannot perform fullscan\n");
 		rc = EXIT_FAILURE; goto cleanup;
 	}
@@ -229,15 +229,12 @@ int main() {
 	fprintf(stderr, "Fullscan (uncompressed): %ldus\n",
 	                             minus(&t2, &t1)/1000);
 
-	err = nowdb_store_close(store1);
-	if (err != NOWDB_OK) {
-		nowdb_err_print(err);
-		nowdb_err_release(err);
-		nowdb_store_destroy(store1);
+	if (!closeStore(store1)) {
+		destroyStore(store1);
 		free(store1); store1 = NULL;
 		rc = EXIT_FAILURE; goto cleanup;
 	}
-	nowdb_store_destroy(store1); free(store1); store1=NULL;
+	destroyStore(store1); free(store1); store1=NULL;
 
 	store2 = xBootstrap("rsc/store50", NOWDB_CONT_EDGE, &nowdb_sort_edge_compare,
 	          NOWDB_COMP_ZSTD, 2, recsz, NOWDB_MEGA, NOWDB_MEGA);
@@ -255,7 +252,7 @@ int main() {
 	}
 	fprintf(stderr, "starting to read\n");
 	timestamp(&t1);
-	if (!testFullscan(store2)) {
+	if (!testFullscan(store2, 0)) {
 		fprintf(stderr, "cannot perform fullscan\n");
 		rc = EXIT_FAILURE; goto cleanup;
 	}
@@ -263,14 +260,23 @@ int main() {
 	fprintf(stderr, "Fullscan (compressed)  : %ldus\n",
 	                             minus(&t2, &t1)/1000);
 
+	timestamp(&t1);
+	if (!testFullscan(store2, 4)) {
+		fprintf(stderr, "cannot perform fullscan with read-ahead\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	timestamp(&t2);
+	fprintf(stderr, "Fullscan (read-ahead)  : %ldus\n",
+	                             minus(&t2, &t1)/1000);
+
 cleanup:
 	if (store1 != NULL) {
-		NOWDB_IGNORE(nowdb_store_close(store1));
-		nowdb_store_destroy(store1); free(store1);
+		closeStore(store1);
+		destroyStore(store1); free(store1);
 	}
 	if (store2 != NULL) {
-		NOWDB_IGNORE(nowdb_store_close(store2));
-		nowdb_store_destroy(store2); free(store2);
+		closeStore(store2);
+		destroyStore(store2); free(store2);
 	}
 	nowdb_err_destroy();
 	if (rc == EXIT_SUCCESS) {
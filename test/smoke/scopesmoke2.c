@@ -18,6 +18,7 @@
 #define EDGES "rsc/edge100.csv"
 #define PRODS "rsc/products100.csv"
 #define CLIENTS "rsc/clients100.csv"
+#define KNOWS "rsc/knows100.csv"
 
 #define HALFEDGE  8192
 #define FULLEDGE 16384
@@ -28,6 +29,10 @@
 #define PRODUCT 1
 #define CLIENT  2
 
+// clients who know each other (for traversals)
+#define KNOWERS 1000
+#define NKNOWS  4000
+
 typedef struct {
 	int       id;
 	char str[64];
@@ -43,6 +48,12 @@ typedef struct {
 
 edge_t *edges = NULL;
 
+// degree of parallelism for readResult
+uint32_t dop = 1;
+
+// readResult checks descending order
+char desc = 0;
+
 #define EDGET(x) \
 	((edge_t*)x)
 
@@ -67,6 +78,7 @@ int edgecount(int h) {
 
 vrtx_t *products = NULL;
 vrtx_t *clients = NULL;
+edge_t *knows = NULL;
 
 int writeEdges(nowdb_path_t path, int halves, int hprods, int hclients) {
 	int rc;
@@ -137,6 +149,82 @@ int writeEdges(nowdb_path_t path, int halves, int hprods, int hclients) {
 	return 0;
 }
 
+/* ------------------------------------------------------------------------
+ * Clients know each other (origin and destin are clients)
+ * ------------------------------------------------------------------------
+ */
+int writeKnows(nowdb_path_t path) {
+	int rc;
+	nowdb_time_t base;
+	FILE *f;
+	int h, m, s;
+	char *loadstr = "%d;%d;2018-08-28T%02d:%02d:%02d.000\n";
+
+	knows = calloc(NKNOWS, sizeof(edge_t));
+	if (knows == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		return -1;
+	}
+	f = fopen(path, "w");
+	if (f == NULL) {
+		perror("cannot open knows file");
+		return -1;
+	}
+	rc = nowdb_time_fromString("2018-08-28T00:00:00",
+	                       NOWDB_TIME_FORMAT, &base);
+	if (rc != 0) {
+		fprintf(stderr, "cannot get time base: %d\n", rc);
+		fclose(f);
+		return -1;
+	}
+	fprintf(f, "origin;destin;stamp\n");
+	for(int i=0; i<NKNOWS; i++) {
+		h = rand()%24;
+		m = rand()%60;
+		s = rand()%60;
+
+		knows[i].origin = clients[rand()%KNOWERS].id;
+		knows[i].destin = clients[rand()%KNOWERS].id;
+		knows[i].stamp  = base + 1000000000l * (int64_t)s +
+		                  1000000000l * 60l * (int64_t)m +
+		                  1000000000l * 60l * 60l * (int64_t)h;
+
+		fprintf(f, loadstr, knows[i].origin,
+		                    knows[i].destin, h, m, s);
+	}
+	fclose(f);
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Reference: edges followed from 'start' within 'hops' hops
+ *            (only edges after 'from')
+ * ------------------------------------------------------------------------
+ */
+int64_t travCount(int start, char out, int hops, nowdb_time_t from) {
+	int dist[KNOWERS];
+	int near, far;
+	int64_t total=0;
+
+	for(int i=0; i<KNOWERS; i++) dist[i] = -1;
+	dist[start-clients[0].id] = 0;
+
+	for(int l=0; l<hops; l++) {
+		for(int i=0; i<NKNOWS; i++) {
+			if (knows[i].stamp < from) continue;
+			near = (out?knows[i].origin:knows[i].destin)-clients[0].id;
+			far  = (out?knows[i].destin:knows[i].origin)-clients[0].id;
+			if (dist[near] == l && dist[far] < 0) dist[far] = l+1;
+		}
+	}
+	for(int i=0; i<NKNOWS; i++) {
+		if (knows[i].stamp < from) continue;
+		near = (out?knows[i].origin:knows[i].destin)-clients[0].id;
+		if (dist[near] >= 0 && dist[near] < hops) total++;
+	}
+	return total;
+}
+
 void randomString(char *str, int max) {
 	int x;
 
@@ -275,7 +363,8 @@ int64_t countResult(nowdb_scope_t *scope,
 
 int64_t readResult(nowdb_scope_t *scope,
                    char          *stmt,
-                   uint32_t      field) {
+                   uint32_t      field,
+                   int             ord) {
 	struct timespec t1, t2;
 	nowdb_err_t err = NOWDB_OK;
 	nowdb_cursor_t *cur;
@@ -284,11 +373,13 @@ int64_t readResult(nowdb_scope_t *scope,
 	uint32_t osz = 0;
 	uint32_t cnt = 0;
 	char more = 1;
+	char first = 1;
+	int64_t last = 0;
 
-	fprintf(stderr, "executing '%s'\n", stmt);
+	fprintf(stderr, "executing '%s' (dop: %u)\n", stmt, dop);
 
 	timestamp(&t1);
-	cur = openCursor(scope, stmt);
+	cur = openParallelCursor(scope, stmt, dop);
 	if (cur == NULL) {
 		fprintf(stderr, "cannot open cursor: \n");
 		return -1;
@@ -329,6 +420,24 @@ int64_t readResult(nowdb_scope_t *scope,
 				break;
 			}
 			res += (int64_t)*(uint64_t*)(buf+i+f);
+
+			// field 'ord' shall be ascending (or descending)
+			if (ord < 0) continue;
+			err = nowdb_row_extractField(buf+i, osz-i, ord, &f);
+			if (err != NOWDB_OK) {
+				fprintf(stderr, "error extracting field %d\n", ord);
+				nowdb_err_print(err); nowdb_err_release(err);
+				more=0;
+				break;
+			}
+			if (!first && (desc ? *(int64_t*)(buf+i+f) >= last:
+			                      *(int64_t*)(buf+i+f) <= last)) {
+				fprintf(stderr, "not in order: %ld after %ld\n",
+				                  *(int64_t*)(buf+i+f), last);
+				free(buf); closeCursor(cur);
+				return -1;
+			}
+			last = *(int64_t*)(buf+i+f); first = 0;
 		}
 		// nowdb_row_write(buf, osz, stderr);
 	}
@@ -411,7 +520,7 @@ char *getRandom(int       halves,
 	fprintf(stderr, "result: %ld\n", res);
 
 #define READRESULT(stmt, f) \
-	res = readResult(scope, stmt, f); \
+	res = readResult(scope, stmt, f, -1); \
 	if (res < 0) { \
 		fprintf(stderr, "cannot read result %s\n", stmt); \
 		rc = EXIT_FAILURE; goto cleanup; \
@@ -421,6 +530,14 @@ char *getRandom(int       halves,
 	} \
 	fprintf(stderr, "result: %ld\n", res);
 
+#define READORDERED(stmt, f, o) \
+	res = readResult(scope, stmt, f, o); \
+	if (res < 0) { \
+		fprintf(stderr, "cannot read result %s\n", stmt); \
+		rc = EXIT_FAILURE; goto cleanup; \
+	} \
+	fprintf(stderr, "result: %ld\n", res);
+
 #define CHECKRESULT(h,o,d,t) \
 	if (checkResult(h, o, d, t, res) != 0) { \
 		rc = EXIT_FAILURE; goto cleanup; \
@@ -469,6 +586,49 @@ select origin from buys \
 #define SQLCOUNT "\
 select origin, count(*) from buys \
  group by origin"
+
+#define SQLHASH "\
+select stamp, count(*) from buys \
+ group by stamp"
+
+#define SQLHORD "\
+select stamp, count(*) from buys \
+ group by stamp \
+ order by stamp"
+
+#define SQLHDESC "\
+select stamp, count(*) from buys \
+ group by stamp \
+ order by stamp desc"
+
+#define SQLCDESC "\
+select origin, count(*) from buys \
+ group by origin \
+ order by origin desc"
+
+#define SQLPHASH "\
+select stamp, count(*) from sells \
+ group by stamp"
+
+#define SQLBIN "\
+select bin(stamp, 3600), count(*) from %s \
+ where stamp >= '2018-08-28T00:00:00' \
+   and stamp <  '2018-08-29T00:00:00' \
+ group by bin(stamp, 3600)"
+
+#define SQLPHORD "\
+select stamp, count(*) from sells \
+ group by stamp \
+ order by stamp"
+
+#define SQLTRAV "\
+select count(*) from knows \
+ traverse %d from %s in (%d)"
+
+#define SQLPTRAV "\
+select origin, destin, stamp from knows \
+ traverse %d from %s in (%d) \
+ where stamp >= '2018-08-28T12:00:00'"
 	
 int main() {
 	int64_t res=0;
@@ -524,6 +684,16 @@ int main() {
 		            price float, \
 		            quantity float)");
 
+		// the same edges in small files for parallel scans
+		EXECSTMT("create tiny storage tinystore");
+
+		EXECSTMT("create edge sells (\
+		            origin client  origin, \
+		            destin product destin, \
+		            stamp  time     stamp, \
+		            price float, \
+		            quantity float) storage = tinystore");
+
 		if (writeVrtx(PRODS, PRODUCT, 1) != 0) {
 			fprintf(stderr, "cannot write products\n");
 			rc = EXIT_FAILURE; goto cleanup;
@@ -553,6 +723,34 @@ int main() {
 			fprintf(stderr, "cannot wait for scope\n");
 			rc = EXIT_FAILURE; goto cleanup;
 		}
+
+		fprintf(stderr, "loading edges into tiny storage\n");
+		EXECSTMT("load 'rsc/edge100.csv' into sells use header \
+		           set errors='rsc/edge100.err'");
+
+		if (waitscope(scope, "sells") != 0) {
+			fprintf(stderr, "cannot wait for scope\n");
+			rc = EXIT_FAILURE; goto cleanup;
+		}
+
+		EXECSTMT("create edge knows (\
+		            origin client origin, \
+		            destin client destin, \
+		            stamp  time   stamp)");
+
+		if (writeKnows(KNOWS) != 0) {
+			fprintf(stderr, "cannot write knows\n");
+			rc = EXIT_FAILURE; goto cleanup;
+		}
+
+		fprintf(stderr, "loading knows\n");
+		EXECSTMT("load 'rsc/knows100.csv' into knows use header \
+		           set errors='rsc/knows100.err'");
+
+		if (waitscope(scope, "knows") != 0) {
+			fprintf(stderr, "cannot wait for scope\n");
+			rc = EXIT_FAILURE; goto cleanup;
+		}
 	}
 	// test fullscan
 	/* select * does not work right now!
@@ -602,6 +800,48 @@ int main() {
 		CHECKRESULT(5, 0, 0, 0);
 	}
 
+	// test count with group without index
+	fprintf(stderr, "COUNT with HASH GROUP\n");
+	READRESULT(SQLHASH, 1);
+	CHECKRESULT(5, 0, 0, 0);
+
+	// test count with ordered group without index
+	fprintf(stderr, "COUNT with ORDERED HASH GROUP\n");
+	READORDERED(SQLHORD, 1, 0);
+	CHECKRESULT(5, 0, 0, 0);
+
+	// descending: the group index cannot be used
+	fprintf(stderr, "COUNT with DESCENDING HASH GROUP\n");
+	desc = 1;
+	READORDERED(SQLHDESC, 1, 0);
+	CHECKRESULT(5, 0, 0, 0);
+	READORDERED(SQLCDESC, 1, 0);
+	CHECKRESULT(5, 0, 0, 0);
+	desc = 0;
+
+	// the same in parallel
+	fprintf(stderr, "COUNT with PARALLEL HASH GROUP\n");
+	dop = 4;
+	READRESULT(SQLPHASH, 1);
+	CHECKRESULT(5, 0, 0, 0);
+	READORDERED(SQLPHORD, 1, 0);
+	CHECKRESULT(5, 0, 0, 0);
+
+	// time buckets, sequential and in parallel
+	fprintf(stderr, "COUNT with (PARALLEL) TIME BUCKETS\n");
+	sql = malloc(strlen(SQLBIN)+8);
+	if (sql == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	sprintf(sql, SQLBIN, "sells");
+	READORDERED(sql, 1, 0);
+	CHECKRESULT(5, 0, 0, 0);
+	dop = 1;
+	READORDERED(sql, 1, 0);
+	CHECKRESULT(5, 0, 0, 0);
+	free(sql); sql = NULL;
+
 	// test count without group
 	fprintf(stderr, "COUNT W/O GROUP\n");
 	for(int i=0; i<ITER; i++) {
@@ -615,6 +855,45 @@ int main() {
 	COUNTRESULT(SQLGRP);
 	COUNTDISTINCT(5);
 
+	// traversals in both directions, with and without period
+	fprintf(stderr, "TRAVERSE\n");
+	sql = malloc(strlen(SQLPTRAV)+32);
+	if (sql == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (nowdb_time_fromString("2018-08-28T12:00:00",
+	                      NOWDB_TIME_FORMAT, &tp) != 0) {
+		fprintf(stderr, "cannot get time\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	for(int i=0; i<10; i++) {
+		int64_t x;
+		char out = i%2;
+		int hops = i%4+1;
+
+		o = knows[rand()%NKNOWS].origin;
+
+		sprintf(sql, SQLTRAV, hops, out?"origin":"destin", o);
+		res = readResult(scope, sql, 0, -1);
+		x = travCount(o, out, hops, NOWDB_TIME_DAWN);
+		if (res != x) {
+			fprintf(stderr, "%s: %ld, expected: %ld\n", sql, res, x);
+			rc = EXIT_FAILURE; goto cleanup;
+		}
+		fprintf(stderr, "result: %ld\n", res);
+
+		sprintf(sql, SQLPTRAV, hops, out?"origin":"destin", o);
+		res = countResult(scope, sql);
+		x = travCount(o, out, hops, tp);
+		if (res != x) {
+			fprintf(stderr, "%s: %ld, expected: %ld\n", sql, res, x);
+			rc = EXIT_FAILURE; goto cleanup;
+		}
+		fprintf(stderr, "result: %ld\n", res);
+	}
+	free(sql); sql = NULL;
+
 cleanup:
 	if (sql != NULL) free(sql);
 	if (scope != NULL) {
@@ -624,6 +903,7 @@ cleanup:
 	if (clients != NULL) free(clients);
 	if (products != NULL) free(products);
 	if (edges != NULL) free(edges);
+	if (knows != NULL) free(knows);
 
 	closeScopes();
 	nowdb_close();
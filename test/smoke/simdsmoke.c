@@ -0,0 +1,274 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Simple tests for SIMD kernels
+ * ========================================================================
+ */
+#include <nowdb/types/types.h>
+#include <nowdb/fun/expr.h>
+#include <nowdb/fun/simd.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#define MAXREC (NOWDB_IDX_PAGE/8)
+#define WORDS  (MAXREC/64)
+
+static const uint32_t funs[] = {NOWDB_EXPR_OP_EQ, NOWDB_EXPR_OP_NE,
+                                NOWDB_EXPR_OP_LT, NOWDB_EXPR_OP_GT,
+                                NOWDB_EXPR_OP_LE, NOWDB_EXPR_OP_GE};
+
+static const uint32_t types[] = {NOWDB_TYP_UINT, NOWDB_TYP_INT,
+                                 NOWDB_TYP_FLOAT};
+
+static const char *levels[] = {"scalar", "sse4.2", "avx2"};
+
+/* ------------------------------------------------------------------------
+ * Random value: small values (to have matches), big values
+ * (to check the sign), negative values and, for floats, NaN
+ * ------------------------------------------------------------------------
+ */
+static nowdb_value_t rndValue(uint32_t type) {
+	nowdb_value_t v;
+	double d;
+
+	if (type == NOWDB_TYP_FLOAT) {
+		switch(rand()%10) {
+		case 0: d = NAN; break;
+		case 1: d = -(double)(rand()%20); break;
+		default: d = (double)(rand()%20)/2.0;
+		}
+		memcpy(&v, &d, 8);
+		return v;
+	}
+	switch(rand()%10) {
+	case 0: return 0xffffffffffffff00ull + rand()%256;
+	case 1: return 0x7fffffffffffff00ull + rand()%256;
+	case 2: return (nowdb_value_t)(-(int64_t)(rand()%20));
+	default: return rand()%20;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Reference comparison
+ * ------------------------------------------------------------------------
+ */
+static int cmp(uint32_t type, uint32_t fun, nowdb_value_t x,
+                                            nowdb_value_t c) {
+	uint64_t u=x, uc=c;
+	int64_t  i, ic;
+	double   d, dc;
+
+	memcpy(&i, &x, 8); memcpy(&ic, &c, 8);
+	memcpy(&d, &x, 8); memcpy(&dc, &c, 8);
+
+	switch(fun) {
+	case NOWDB_EXPR_OP_EQ:
+		if (type == NOWDB_TYP_FLOAT) return d == dc;
+		return u == uc;
+	case NOWDB_EXPR_OP_NE:
+		if (type == NOWDB_TYP_FLOAT) return d != dc;
+		return u != uc;
+	case NOWDB_EXPR_OP_LT:
+		if (type == NOWDB_TYP_FLOAT) return d < dc;
+		if (type == NOWDB_TYP_INT) return i < ic;
+		return u < uc;
+	case NOWDB_EXPR_OP_GT:
+		if (type == NOWDB_TYP_FLOAT) return d > dc;
+		if (type == NOWDB_TYP_INT) return i > ic;
+		return u > uc;
+	case NOWDB_EXPR_OP_LE:
+		if (type == NOWDB_TYP_FLOAT) return d <= dc;
+		if (type == NOWDB_TYP_INT) return i <= ic;
+		return u <= uc;
+	case NOWDB_EXPR_OP_GE:
+		if (type == NOWDB_TYP_FLOAT) return d >= dc;
+		if (type == NOWDB_TYP_INT) return i >= ic;
+		return u >= uc;
+	default: return 0;
+	}
+}
+
+static int ref(nowdb_simd_pred_t *pred, nowdb_value_t x) {
+	int r=0;
+	switch(pred->fun) {
+	case NOWDB_SIMD_BETWEEN:
+		return cmp(pred->type, pred->lofun, x, pred->vals[0]) &&
+		       cmp(pred->type, pred->hifun, x, pred->vals[1]);
+	case NOWDB_SIMD_IN:
+		for(uint32_t k=0; k<pred->nvals; k++) {
+			r |= cmp(pred->type, NOWDB_EXPR_OP_EQ, x, pred->vals[k]);
+		}
+		return pred->inv?!r:r;
+	default:
+		return cmp(pred->type, pred->fun, x, pred->vals[0]);
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Random predicate
+ * ------------------------------------------------------------------------
+ */
+static void rndPred(nowdb_simd_pred_t *pred, uint32_t type,
+                                             uint32_t natts) {
+	memset(pred, 0, sizeof(nowdb_simd_pred_t));
+
+	pred->type = type;
+	pred->off = 8*(rand()%natts);
+
+	switch(rand()%4) {
+	case 0:
+		pred->fun = NOWDB_SIMD_BETWEEN;
+		pred->lofun = rand()%2?NOWDB_EXPR_OP_GT:NOWDB_EXPR_OP_GE;
+		pred->hifun = rand()%2?NOWDB_EXPR_OP_LT:NOWDB_EXPR_OP_LE;
+		break;
+	case 1:
+		pred->fun = NOWDB_SIMD_IN;
+		pred->nvals = rand()%(NOWDB_SIMD_MAXIN+1);
+		pred->inv = rand()%2;
+		break;
+	default:
+		pred->fun = funs[rand()%6];
+	}
+	for(int k=0; k<NOWDB_SIMD_MAXIN; k++) {
+		pred->vals[k] = rndValue(type);
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Random page with n records of natts attributes
+ * ------------------------------------------------------------------------
+ */
+static void mkPage(char *page, uint32_t type, uint32_t natts, uint32_t n) {
+	uint32_t recsz = natts*8;
+
+	memset(page, 0, NOWDB_IDX_PAGE);
+	for(uint32_t p=0; p<n; p++) {
+		for(uint32_t a=0; a<natts; a++) {
+			nowdb_value_t v = rndValue(type);
+			memcpy(page+p*recsz+a*8, &v, 8);
+		}
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Run one predicate on all levels and compare with reference
+ * ------------------------------------------------------------------------
+ */
+int testPred(char *page, nowdb_simd_pred_t *pred, uint32_t natts,
+                                                  uint32_t n) {
+	uint64_t map[WORDS], ex[WORDS];
+	uint16_t pos[MAXREC];
+	uint32_t recsz = natts*8;
+	nowdb_value_t x;
+
+	memset(ex, 0, sizeof(ex));
+	for(uint32_t p=0; p<n; p++) {
+		memcpy(&x, page+p*recsz+pred->off, 8);
+		if (ref(pred, x)) ex[p>>6] |= 1ull << (p&63);
+	}
+	for(int l=NOWDB_SIMD_SCALAR; l<=nowdb_simd_supported(); l++) {
+		nowdb_simd_setLevel(l);
+		memset(map, 0, sizeof(map));
+		nowdb_simd_match(pred, page, recsz, n, map);
+		if (memcmp(map, ex, sizeof(map)) != 0) {
+			fprintf(stderr, "%s: fun %u, type %u, n %u differs\n",
+			        levels[l], pred->fun, pred->type, n);
+			return -1;
+		}
+	}
+
+	// every other record
+	memset(ex, 0, sizeof(ex));
+	for(uint32_t p=0; p<n; p+=2) {
+		pos[p/2] = p;
+		memcpy(&x, page+p*recsz+pred->off, 8);
+		if (ref(pred, x)) ex[p>>6] |= 1ull << (p&63);
+	}
+	memset(map, 0, sizeof(map));
+	nowdb_simd_matchAt(pred, page, recsz, pos, (n+1)/2, map);
+	if (memcmp(map, ex, sizeof(map)) != 0) {
+		fprintf(stderr, "matchAt: fun %u, type %u, n %u differs\n",
+		                pred->fun, pred->type, n);
+		return -1;
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Random pages and predicates
+ * ------------------------------------------------------------------------
+ */
+int testKernels(uint32_t natts) {
+	nowdb_simd_pred_t pred;
+	char *page;
+	uint32_t n;
+	int rc = 0;
+
+	fprintf(stderr, "records with %u attributes\n", natts);
+
+	page = calloc(1, NOWDB_IDX_PAGE);
+	if (page == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		return -1;
+	}
+	for(int i=0; i<1000; i++) {
+		uint32_t type = types[rand()%3];
+
+		// full pages, partial pages and odd tails
+		n = NOWDB_IDX_PAGE/(natts*8);
+		if (i%2) n = rand()%(n+1);
+
+		mkPage(page, type, natts, n);
+		rndPred(&pred, type, natts);
+
+		if (testPred(page, &pred, natts, n) != 0) {
+			rc = -1; break;
+		}
+	}
+	free(page);
+	return rc;
+}
+
+int main() {
+	int rc = EXIT_SUCCESS;
+
+	srand(time(NULL) ^ (uint64_t)&printf);
+
+	if (!nowdb_err_init()) {
+		fprintf(stderr, "cannot init error manager\n");
+		return EXIT_FAILURE;
+	}
+
+	fprintf(stderr, "CPU supports %s\n", levels[nowdb_simd_supported()]);
+
+	if (nowdb_simd_level() != nowdb_simd_supported()) {
+		fprintf(stderr, "not using the best implementation\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testKernels(1) != 0) {
+		fprintf(stderr, "testKernels failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testKernels(3) != 0) {
+		fprintf(stderr, "testKernels failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testKernels(7) != 0) {
+		fprintf(stderr, "testKernels failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+
+cleanup:
+	nowdb_err_destroy();
+	if (rc == EXIT_SUCCESS) {
+		fprintf(stderr, "PASSED\n");
+	} else {
+		fprintf(stderr, "FAILED\n");
+	}
+	return rc;
+}
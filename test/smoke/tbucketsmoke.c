@@ -0,0 +1,547 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Simple tests for time buckets
+ * ========================================================================
+ */
+#include <nowdb/types/types.h>
+#include <nowdb/types/time.h>
+#include <nowdb/fun/fun.h>
+#include <nowdb/fun/group.h>
+#include <nowdb/query/tbucket.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#define NEDGES 100000
+#define NBINS     100
+#define WIDTH      60
+
+#define ORIGIN_OFF  0
+#define STAMP_OFF  16
+#define WEIGHT_OFF 40
+
+typedef struct {
+	uint64_t origin;
+	uint64_t destin;
+	int64_t  timestamp;
+	char     byte; // control byte
+	char     pad[7];
+	uint64_t edge;
+	uint64_t weight;
+	uint64_t weight2;
+} myedge_t;
+
+uint64_t MYEDGE = 101;
+
+uint64_t uzero = 0;
+
+/* expected results per group */
+typedef struct {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	char    seen;
+} expected_t;
+
+nowdb_eval_t _hlp;
+
+/* ------------------------------------------------------------------------
+ * Bin number (rounding towards minus infinity)
+ * ------------------------------------------------------------------------
+ */
+static int64_t binOf(int64_t t, int64_t w) {
+	return t/w - (t%w < 0);
+}
+
+/* ------------------------------------------------------------------------
+ * Random number big enough for time spans
+ * ------------------------------------------------------------------------
+ */
+static int64_t rnd64(int64_t m) {
+	uint64_t r = ((uint64_t)rand() << 31) ^ (uint64_t)rand();
+	return (int64_t)(r%(uint64_t)m);
+}
+
+/* ------------------------------------------------------------------------
+ * Add a function on the weight to the group
+ * ------------------------------------------------------------------------
+ */
+int addFun(nowdb_group_t *group, uint32_t ftype) {
+	nowdb_err_t err;
+	nowdb_expr_t expr=NULL;
+	nowdb_fun_t  *fun;
+
+	if (ftype != NOWDB_FUN_COUNT) {
+		err = nowdb_expr_newEdgeField(&expr, "weight", WEIGHT_OFF,
+		                                      NOWDB_TYP_UINT, 4);
+		if (err != NOWDB_OK) {
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			return -1;
+		}
+	}
+	err = nowdb_fun_new(&fun, ftype, NOWDB_CONT_EDGE, expr, &uzero);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		if (expr != NULL) {
+			nowdb_expr_destroy(expr); free(expr);
+		}
+		return -1;
+	}
+	err = nowdb_group_add(group, fun);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_fun_destroy(fun); free(fun);
+		return -1;
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Create bin(timestamp, WIDTH)
+ * ------------------------------------------------------------------------
+ */
+nowdb_expr_t mkBin() {
+	nowdb_err_t err;
+	nowdb_expr_t ops[2];
+	nowdb_expr_t bin;
+	uint64_t w = WIDTH;
+
+	err = nowdb_expr_newEdgeField(&ops[0], "timestamp", STAMP_OFF,
+	                                          NOWDB_TYP_TIME, 4);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return NULL;
+	}
+	err = nowdb_expr_newConstant(&ops[1], &w, NOWDB_TYP_UINT);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_expr_destroy(ops[0]); free(ops[0]);
+		return NULL;
+	}
+	err = nowdb_expr_newOpV(&bin, NOWDB_EXPR_OP_BIN, 2, ops);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_expr_destroy(ops[0]); free(ops[0]);
+		nowdb_expr_destroy(ops[1]); free(ops[1]);
+		return NULL;
+	}
+	return bin;
+}
+
+/* ------------------------------------------------------------------------
+ * Create time buckets grouping by bin(timestamp) (and origin)
+ * ------------------------------------------------------------------------
+ */
+nowdb_tbucket_t *mkTbucket(nowdb_time_t from, nowdb_time_t to,
+                           char dim, uint64_t budget, char boxed) {
+	nowdb_err_t err;
+	nowdb_tbucket_t *tb;
+	nowdb_group_t *group;
+	nowdb_expr_t key[2];
+	ts_algo_list_t keys;
+	int n = dim?2:1;
+
+	key[0] = mkBin();
+	if (key[0] == NULL) return NULL;
+	if (dim) {
+		err = nowdb_expr_newEdgeField(&key[1], "origin", ORIGIN_OFF,
+		                                         NOWDB_TYP_UINT, 4);
+		if (err != NOWDB_OK) {
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			nowdb_expr_destroy(key[0]); free(key[0]);
+			return NULL;
+		}
+	}
+	ts_algo_list_init(&keys);
+	for(int i=0; i<n; i++) {
+		if (ts_algo_list_append(&keys, key[i]) != TS_ALGO_OK) {
+			fprintf(stderr, "out-of-mem\n");
+			ts_algo_list_destroy(&keys);
+			for(int k=0; k<n; k++) {
+				nowdb_expr_destroy(key[k]); free(key[k]);
+			}
+			return NULL;
+		}
+	}
+	if (!nowdb_tbucket_applies(&keys, from, to)) {
+		fprintf(stderr, "time buckets do not apply\n");
+		ts_algo_list_destroy(&keys);
+		for(int k=0; k<n; k++) {
+			nowdb_expr_destroy(key[k]); free(key[k]);
+		}
+		return NULL;
+	}
+	err = nowdb_tbucket_new(&tb, &keys, &_hlp, NOWDB_CONT_EDGE,
+	                        sizeof(myedge_t), from, to, budget);
+	ts_algo_list_destroy(&keys);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		for(int k=0; k<n; k++) {
+			nowdb_expr_destroy(key[k]); free(key[k]);
+		}
+		return NULL;
+	}
+	err = nowdb_group_new(&group, 5);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_tbucket_destroy(tb); free(tb);
+		return NULL;
+	}
+	if (addFun(group, NOWDB_FUN_COUNT) != 0 ||
+	    addFun(group, NOWDB_FUN_SUM)   != 0 ||
+	    addFun(group, NOWDB_FUN_MIN)   != 0 ||
+	    addFun(group, NOWDB_FUN_MAX)   != 0 ||
+	    addFun(group, boxed?NOWDB_FUN_MEDIAN:
+	                        NOWDB_FUN_AVG) != 0) {
+		nowdb_group_destroy(group); free(group);
+		nowdb_tbucket_destroy(tb); free(tb);
+		return NULL;
+	}
+	nowdb_group_setEval(group, &_hlp);
+	err = nowdb_tbucket_setGroup(tb, group);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_group_destroy(group); free(group);
+		nowdb_tbucket_destroy(tb); free(tb);
+		return NULL;
+	}
+	return tb;
+}
+
+int testMerge(int ngroups, int outside, uint64_t budget,
+              char boxed, int ncps);
+
+/* ------------------------------------------------------------------------
+ * Map random edges with 'ngroups' distinct origins;
+ * 'outside' of 10 records are outside the period.
+ * Compare the groups with the expected results and check
+ * that the bins are delivered in order.
+ * ------------------------------------------------------------------------
+ */
+int testTbucket(int ngroups, int outside, uint64_t budget, char boxed) {
+	return testMerge(ngroups, outside, budget, boxed, 0);
+}
+
+/* ------------------------------------------------------------------------
+ * As testTbucket, but the edges are mapped round-robin
+ * to 'ncps' copies (as the workers of a parallel scan do)
+ * which are then merged into the original
+ * ------------------------------------------------------------------------
+ */
+int testMerge(int ngroups, int outside, uint64_t budget,
+              char boxed, int ncps) {
+	int rc = 0;
+	nowdb_err_t err;
+	nowdb_tbucket_t *tb;
+	nowdb_tbucket_t *cps[4];
+	nowdb_expr_t bin;
+	nowdb_type_t t;
+	expected_t *exp, *e;
+	myedge_t edge;
+	char *rec;
+	void *v;
+	nowdb_fun_t **fun;
+	int found=0, nexp=0;
+	int64_t w, ext, from, to, first, b, last;
+	int64_t nb;
+	char dim = ngroups > 1;
+
+	fprintf(stderr, "%d groups, %d/10 outside, budget %lu, %s, "
+	                "%d copies\n", ngroups, outside, budget,
+	                boxed?"boxed":"inline", ncps);
+
+	memset(cps, 0, 4*sizeof(nowdb_tbucket_t*));
+
+	// start before the epoch to see negative stamps
+	w = WIDTH*nowdb_time_getPerSec();
+	from = -10*w + rnd64(w);
+	to = from + NBINS*w - 1;
+	ext = outside?10*w:0;
+	first = binOf(from-ext, w);
+	nb = binOf(to+ext, w) - first + 1;
+
+	exp = calloc(nb*ngroups, sizeof(expected_t));
+	if (exp == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		return -1;
+	}
+	tb = mkTbucket(from, to, dim, budget, boxed);
+	if (tb == NULL) {
+		free(exp); return -1;
+	}
+	fun = tb->group->fun;
+	bin = tb->keys[0];
+
+	for(int i=0; i<ncps; i++) {
+		err = nowdb_tbucket_copy(tb, &_hlp, budget/ncps, cps+i);
+		if (err != NOWDB_OK) {
+			fprintf(stderr, "cannot copy\n");
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			rc = -1; goto cleanup;
+		}
+	}
+
+	memset(&edge, 0, sizeof(myedge_t));
+	edge.edge = MYEDGE;
+	edge.byte = 0xff;
+
+	for(int i=0; i<NEDGES; i++) {
+		edge.origin = rand()%ngroups;
+		edge.weight = rand()%1000;
+		if (outside && rand()%10 < outside) {
+			edge.timestamp = rand()%2?from-1-rnd64(ext):
+			                          to+1+rnd64(ext);
+		} else {
+			edge.timestamp = from + rnd64(to-from+1);
+		}
+
+		b = binOf(edge.timestamp, w) - first;
+		e = exp+b*ngroups+edge.origin;
+		if (!e->seen) {
+			e->seen = 1;
+			e->min = edge.weight;
+			e->max = edge.weight;
+			nexp++;
+		}
+		e->count++;
+		e->sum += edge.weight;
+		if (edge.weight < e->min) e->min = edge.weight;
+		if (edge.weight > e->max) e->max = edge.weight;
+
+		err = nowdb_tbucket_map(ncps>0?cps[i%ncps]:tb, (char*)&edge);
+		if (err != NOWDB_OK) {
+			fprintf(stderr, "cannot map\n");
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			rc = -1; goto cleanup;
+		}
+	}
+	for(int i=0; i<ncps; i++) {
+		err = nowdb_tbucket_merge(tb, cps[i]);
+		if (err != NOWDB_OK) {
+			fprintf(stderr, "cannot merge\n");
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			rc = -1; goto cleanup;
+		}
+	}
+	for(int i=0; i<ncps; i++) {
+		err = nowdb_tbucket_mergeSpilled(tb, cps[i]);
+		if (err != NOWDB_OK) {
+			fprintf(stderr, "cannot merge spilled records\n");
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			rc = -1; goto cleanup;
+		}
+	}
+	last = first-1;
+	for(;;) {
+		err = nowdb_tbucket_next(tb, &rec);
+		if (err != NOWDB_OK) {
+			if (nowdb_err_contains(err, nowdb_err_eof)) {
+				nowdb_err_release(err); break;
+			}
+			fprintf(stderr, "cannot get next group\n");
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			rc = -1; goto cleanup;
+		}
+		memcpy(&edge, rec, sizeof(myedge_t));
+
+		// the key must be the start of the bin
+		err = nowdb_expr_eval(bin, &_hlp, rec, &t, &v);
+		if (err != NOWDB_OK) {
+			fprintf(stderr, "cannot evaluate bin\n");
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			rc = -1; goto cleanup;
+		}
+		b = binOf(edge.timestamp, w);
+		if (t != NOWDB_TYP_TIME || *(int64_t*)v != b*w) {
+			fprintf(stderr, "wrong bin: %ld (%d)\n",
+			                *(int64_t*)v, t);
+			rc = -1; goto cleanup;
+		}
+
+		// bins in the array come first and in order
+		if (tb->pos < tb->nbins) {
+			if (b < last) {
+				fprintf(stderr, "bins out of order\n");
+				rc = -1; goto cleanup;
+			}
+			last = b;
+		}
+
+		e = exp+(b-first)*ngroups+edge.origin;
+		if (e->seen != 1) {
+			fprintf(stderr, "unexpected group %ld.%lu\n",
+			                             b, edge.origin);
+			rc = -1; goto cleanup;
+		}
+		e->seen = 2; found++;
+
+		if (fun[0]->r1 != e->count ||
+		    fun[1]->r1 != e->sum   ||
+		    fun[2]->r1 != e->min   ||
+		    fun[3]->r1 != e->max) {
+			fprintf(stderr, "results differ in group %ld.%lu\n",
+			                                     b, edge.origin);
+			rc = -1; goto cleanup;
+		}
+	}
+	if (found != nexp) {
+		fprintf(stderr, "groups missing: %d of %d\n", found, nexp);
+		rc = -1; goto cleanup;
+	}
+	if (!outside && ngroups <= NOWDB_TBUCKET_MAXDIM &&
+	    budget == NOWDB_HASHAGG_MEM && tb->overflow != NULL) {
+		fprintf(stderr, "unexpected overflow\n");
+		rc = -1; goto cleanup;
+	}
+	fprintf(stderr, "%d groups, %u columns, %s\n", found, tb->ndims,
+	                tb->overflow != NULL?"overflow":"no overflow");
+cleanup:
+	for(int i=0; i<ncps; i++) {
+		if (cps[i] == NULL) continue;
+		nowdb_tbucket_destroy(cps[i]); free(cps[i]);
+	}
+	nowdb_tbucket_destroy(tb); free(tb);
+	free(exp);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * Check when time buckets apply
+ * ------------------------------------------------------------------------
+ */
+int testApplies() {
+	ts_algo_list_t keys;
+	nowdb_expr_t bin;
+	int64_t w = WIDTH*nowdb_time_getPerSec();
+	int rc = 0;
+
+	bin = mkBin();
+	if (bin == NULL) return -1;
+
+	ts_algo_list_init(&keys);
+	if (ts_algo_list_append(&keys, bin) != TS_ALGO_OK) {
+		fprintf(stderr, "out-of-mem\n");
+		nowdb_expr_destroy(bin); free(bin);
+		return -1;
+	}
+	if (!nowdb_tbucket_applies(&keys, 0, NBINS*w-1)) {
+		fprintf(stderr, "does not apply on bounded period\n");
+		rc = -1; goto cleanup;
+	}
+	if (nowdb_tbucket_applies(&keys, NOWDB_TIME_DAWN, NBINS*w)) {
+		fprintf(stderr, "applies on unbounded period\n");
+		rc = -1; goto cleanup;
+	}
+	if (nowdb_tbucket_applies(&keys, 0, NOWDB_TIME_DUSK)) {
+		fprintf(stderr, "applies on unbounded period\n");
+		rc = -1; goto cleanup;
+	}
+	if (nowdb_tbucket_applies(&keys, 0,
+	                          (NOWDB_TBUCKET_MAXBINS+1)*w)) {
+		fprintf(stderr, "applies on too many bins\n");
+		rc = -1; goto cleanup;
+	}
+	if (nowdb_tbucket_applies(&keys, NBINS*w, 0)) {
+		fprintf(stderr, "applies on empty period\n");
+		rc = -1; goto cleanup;
+	}
+cleanup:
+	ts_algo_list_destroy(&keys);
+	nowdb_expr_destroy(bin); free(bin);
+	return rc;
+}
+
+int main() {
+	int rc = EXIT_SUCCESS;
+
+	srand(time(NULL) ^ (uint64_t)&printf);
+
+	if (!nowdb_err_init()) {
+		fprintf(stderr, "cannot init error manager\n");
+		return EXIT_FAILURE;
+	}
+	if (testApplies() != 0) {
+		fprintf(stderr, "testApplies failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	/* bins only */
+	if (testTbucket(1, 0, NOWDB_HASHAGG_MEM, 0) != 0) {
+		fprintf(stderr, "testTbucket failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	/* bins and a small dimension */
+	if (testTbucket(8, 0, NOWDB_HASHAGG_MEM, 0) != 0) {
+		fprintf(stderr, "testTbucket failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	/* overflow: records outside the period */
+	if (testTbucket(8, 2, NOWDB_HASHAGG_MEM, 0) != 0) {
+		fprintf(stderr, "testTbucket failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	/* overflow: dimension too big */
+	if (testTbucket(40, 0, NOWDB_HASHAGG_MEM, 0) != 0) {
+		fprintf(stderr, "testTbucket failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	/* overflow: budget */
+	if (testTbucket(8, 1, 1, 0) != 0) {
+		fprintf(stderr, "testTbucket failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	/* aggregates that are not inline */
+	if (testTbucket(8, 1, NOWDB_HASHAGG_MEM, 1) != 0) {
+		fprintf(stderr, "testTbucket failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testTbucket(40, 1, 65536, 1) != 0) {
+		fprintf(stderr, "testTbucket failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	/* merging copies */
+	if (testMerge(8, 0, NOWDB_HASHAGG_MEM, 0, 4) != 0) {
+		fprintf(stderr, "testMerge failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testMerge(40, 2, NOWDB_HASHAGG_MEM, 0, 3) != 0) {
+		fprintf(stderr, "testMerge failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testMerge(40, 1, 65536, 1, 4) != 0) {
+		fprintf(stderr, "testMerge failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testMerge(8, 1, 4, 0, 2) != 0) {
+		fprintf(stderr, "testMerge failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+cleanup:
+	nowdb_err_destroy();
+	if (rc == EXIT_SUCCESS) {
+		fprintf(stderr, "PASSED\n");
+	} else {
+		fprintf(stderr, "FAILED\n");
+	}
+	return rc;
+}
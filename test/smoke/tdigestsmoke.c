@@ -0,0 +1,409 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Simple tests for t-digest and approximate quantiles
+ * ========================================================================
+ */
+#include <nowdb/types/types.h>
+#include <nowdb/fun/fun.h>
+#include <nowdb/fun/tdigest.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#define NVALUES 200000
+#define NPARTS       8
+
+#define WEIGHT_OFF 40
+
+typedef struct {
+	uint64_t origin;
+	uint64_t destin;
+	int64_t  timestamp;
+	char     byte; // control byte
+	char     pad[7];
+	uint64_t edge;
+	uint64_t weight;
+	uint64_t weight2;
+} myedge_t;
+
+uint64_t MYEDGE = 101;
+
+nowdb_eval_t _hlp;
+
+static double qs[] = {0.001, 0.01, 0.1, 0.25, 0.5, 0.75, 0.9,
+                      0.95, 0.99, 0.999};
+#define NQS 10
+
+/* ------------------------------------------------------------------------
+ * Distributions
+ * ------------------------------------------------------------------------
+ */
+static double rnd() {
+	return ((double)rand()+0.5)/((double)RAND_MAX+1);
+}
+
+static double getValue(int dist) {
+	switch(dist) {
+	case 0: return rnd()*1000;
+	case 1: return -log(rnd())*50; // exponential (latencies)
+	case 2: return sqrt(-2*log(rnd()))*cos(2*M_PI*rnd()); // normal
+	default: return (double)(rand()%10); // few distinct values
+	}
+}
+
+static int dcompare(const void *one, const void *two) {
+	double d1 = *(double*)one;
+	double d2 = *(double*)two;
+	if (d1 < d2) return -1;
+	if (d1 > d2) return 1;
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Rank error: the fraction of values below the estimate
+ * should be close to q; for repeated values, any q
+ * between the first and the last occurrence is fine.
+ * ------------------------------------------------------------------------
+ */
+static double rankError(double *sorted, int n, double q, double x) {
+	int lo=0, hi=n, m;
+	double r1, r2;
+
+	while(lo < hi) {
+		m = (lo+hi)/2;
+		if (sorted[m] < x) lo = m+1; else hi = m;
+	}
+	r1 = (double)lo/n;
+	hi = n;
+	while(lo < hi) {
+		m = (lo+hi)/2;
+		if (sorted[m] <= x) lo = m+1; else hi = m;
+	}
+	r2 = (double)lo/n;
+	if (q < r1) return r1-q;
+	if (q > r2) return q-r2;
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Tolerance: half the size of a centroid at q
+ * (tails are more accurate than the middle)
+ * ------------------------------------------------------------------------
+ */
+static double tolerance(double q) {
+	return M_PI*sqrt(q*(1-q))/NOWDB_TDIGEST_COMPRESSION + 0.0002;
+}
+
+static int checkDigest(nowdb_tdigest_t *td, double *sorted,
+                       int n, int discrete) {
+	double x, err;
+
+	if (nowdb_tdigest_count(td) != n) {
+		fprintf(stderr, "wrong count: %lu / %d\n",
+		        nowdb_tdigest_count(td), n);
+		return -1;
+	}
+	for(int i=0; i<NQS; i++) {
+		x = nowdb_tdigest_quantile(td, qs[i]);
+
+		// interpolation does not know that values are integers
+		if (discrete) x = round(x);
+
+		err = rankError(sorted, n, qs[i], x);
+		if (err > tolerance(qs[i])) {
+			fprintf(stderr, "q %.3f: %.4f, rank error %.5f\n",
+			                qs[i], x, err);
+			return -1;
+		}
+	}
+	if (nowdb_tdigest_quantile(td, 0) != sorted[0] ||
+	    nowdb_tdigest_quantile(td, 1) != sorted[n-1]) {
+		fprintf(stderr, "min or max differ\n");
+		return -1;
+	}
+	if (td->n > td->compression+2) {
+		fprintf(stderr, "too many centroids: %u\n", td->n);
+		return -1;
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * One digest and the merge of partial digests
+ * ------------------------------------------------------------------------
+ */
+int testDigest(int dist) {
+	nowdb_err_t err;
+	nowdb_tdigest_t *all=NULL, *parts[NPARTS], *merged=NULL;
+	double *vals;
+	int rc = 0;
+
+	fprintf(stderr, "distribution %d\n", dist);
+
+	memset(parts, 0, sizeof(parts));
+
+	vals = calloc(NVALUES, sizeof(double));
+	if (vals == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		return -1;
+	}
+	err = nowdb_tdigest_new(&all, NOWDB_TDIGEST_COMPRESSION);
+	if (err != NOWDB_OK) goto cleanup;
+	err = nowdb_tdigest_new(&merged, NOWDB_TDIGEST_COMPRESSION);
+	if (err != NOWDB_OK) goto cleanup;
+	for(int i=0; i<NPARTS; i++) {
+		err = nowdb_tdigest_new(parts+i, NOWDB_TDIGEST_COMPRESSION);
+		if (err != NOWDB_OK) goto cleanup;
+	}
+	for(int i=0; i<NVALUES; i++) {
+		vals[i] = getValue(dist);
+		nowdb_tdigest_add(all, vals[i]);
+		nowdb_tdigest_add(parts[rand()%NPARTS], vals[i]);
+	}
+	nowdb_tdigest_add(all, NAN);
+	for(int i=0; i<NPARTS; i++) {
+		nowdb_tdigest_merge(merged, parts[i]);
+	}
+	qsort(vals, NVALUES, sizeof(double), &dcompare);
+
+	if (checkDigest(all, vals, NVALUES, dist==3) != 0) {
+		fprintf(stderr, "digest failed\n");
+		rc = -1; goto cleanup;
+	}
+	if (checkDigest(merged, vals, NVALUES, dist==3) != 0) {
+		fprintf(stderr, "merged digest failed\n");
+		rc = -1; goto cleanup;
+	}
+
+	// reset and small digests are exact
+	nowdb_tdigest_reset(all);
+	if (nowdb_tdigest_quantile(all, 0.5) != 0) {
+		fprintf(stderr, "empty digest is not 0\n");
+		rc = -1; goto cleanup;
+	}
+	nowdb_tdigest_add(all, 7);
+	if (nowdb_tdigest_quantile(all, 0.99) != 7) {
+		fprintf(stderr, "single value not exact\n");
+		rc = -1; goto cleanup;
+	}
+
+cleanup:
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		rc = -1;
+	}
+	if (all != NULL) {
+		nowdb_tdigest_destroy(all); free(all);
+	}
+	if (merged != NULL) {
+		nowdb_tdigest_destroy(merged); free(merged);
+	}
+	for(int i=0; i<NPARTS; i++) {
+		if (parts[i] == NULL) continue;
+		nowdb_tdigest_destroy(parts[i]); free(parts[i]);
+	}
+	free(vals);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * Create aggregate on the weight
+ * ------------------------------------------------------------------------
+ */
+nowdb_fun_t *mkFun(uint32_t ftype, double p) {
+	nowdb_err_t err;
+	nowdb_expr_t expr;
+	nowdb_fun_t *fun;
+	nowdb_value_t init;
+
+	err = nowdb_expr_newEdgeField(&expr, "weight", WEIGHT_OFF,
+	                                     NOWDB_TYP_UINT, 4);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return NULL;
+	}
+	memcpy(&init, &p, 8);
+	err = nowdb_fun_new(&fun, ftype, NOWDB_CONT_EDGE, expr, &init);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_expr_destroy(expr); free(expr);
+		return NULL;
+	}
+	return fun;
+}
+
+/* ------------------------------------------------------------------------
+ * PERCENTILE and APPROX_MEDIAN as aggregates,
+ * partial aggregates are merged
+ * ------------------------------------------------------------------------
+ */
+int testFun() {
+	nowdb_err_t err=NOWDB_OK;
+	nowdb_fun_t *p99=NULL, *med=NULL, *part=NULL;
+	myedge_t edge;
+	double *vals, x;
+	int rc = 0;
+
+	vals = calloc(NVALUES, sizeof(double));
+	if (vals == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		return -1;
+	}
+	p99 = mkFun(NOWDB_FUN_PERCENTILE, 99);
+	med = mkFun(NOWDB_FUN_APPROXMEDIAN, 0);
+	if (p99 == NULL || med == NULL) {
+		rc = -1; goto cleanup;
+	}
+	err = nowdb_fun_copy(p99, &part);
+	if (err != NOWDB_OK) goto cleanup;
+
+	if (nowdb_fun_inline(p99)) {
+		fprintf(stderr, "sketch is inline\n");
+		rc = -1; goto cleanup;
+	}
+
+	memset(&edge, 0, sizeof(myedge_t));
+	edge.edge = MYEDGE;
+	edge.byte = 0xff;
+	for(int i=0; i<NVALUES; i++) {
+		edge.weight = rand()%100000;
+		vals[i] = (double)edge.weight;
+
+		err = nowdb_fun_map(med, &_hlp, &edge);
+		if (err != NOWDB_OK) goto cleanup;
+
+		err = nowdb_fun_map(i%2?part:p99, &_hlp, &edge);
+		if (err != NOWDB_OK) goto cleanup;
+	}
+	err = nowdb_fun_merge(p99, part);
+	if (err != NOWDB_OK) goto cleanup;
+
+	err = nowdb_fun_reduce(p99);
+	if (err != NOWDB_OK) goto cleanup;
+	err = nowdb_fun_reduce(med);
+	if (err != NOWDB_OK) goto cleanup;
+
+	if (p99->otype != NOWDB_TYP_FLOAT || med->otype != NOWDB_TYP_FLOAT) {
+		fprintf(stderr, "wrong output type\n");
+		rc = -1; goto cleanup;
+	}
+
+	qsort(vals, NVALUES, sizeof(double), &dcompare);
+
+	memcpy(&x, &p99->r1, 8);
+	if (rankError(vals, NVALUES, 0.99, x) > tolerance(0.99)) {
+		fprintf(stderr, "p99 is off: %.4f\n", x);
+		rc = -1; goto cleanup;
+	}
+	memcpy(&x, &med->r1, 8);
+	if (rankError(vals, NVALUES, 0.5, x) > tolerance(0.5)) {
+		fprintf(stderr, "median is off: %.4f\n", x);
+		rc = -1; goto cleanup;
+	}
+
+	// after reset, the rank is still there
+	nowdb_fun_reset(p99);
+	edge.weight = 42;
+	err = nowdb_fun_map(p99, &_hlp, &edge);
+	if (err != NOWDB_OK) goto cleanup;
+	err = nowdb_fun_reduce(p99);
+	if (err != NOWDB_OK) goto cleanup;
+	memcpy(&x, &p99->r1, 8);
+	if (x != 42) {
+		fprintf(stderr, "reset failed: %.4f\n", x);
+		rc = -1; goto cleanup;
+	}
+	memcpy(&x, &p99->init, 8);
+	if (x != 99) {
+		fprintf(stderr, "rank lost: %.4f\n", x);
+		rc = -1; goto cleanup;
+	}
+
+cleanup:
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		rc = -1;
+	}
+	if (p99 != NULL) {
+		nowdb_fun_destroy(p99); free(p99);
+	}
+	if (med != NULL) {
+		nowdb_fun_destroy(med); free(med);
+	}
+	if (part != NULL) {
+		nowdb_fun_destroy(part); free(part);
+	}
+	free(vals);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * Invalid rank
+ * ------------------------------------------------------------------------
+ */
+int testRank() {
+	nowdb_err_t err;
+	nowdb_fun_t *fun;
+	double p = 101;
+	nowdb_value_t init;
+
+	memcpy(&init, &p, 8);
+	err = nowdb_fun_new(&fun, NOWDB_FUN_PERCENTILE, NOWDB_CONT_EDGE,
+	                                                  NULL, &init);
+	if (err == NOWDB_OK) {
+		fprintf(stderr, "percentile without field accepted\n");
+		nowdb_fun_destroy(fun); free(fun);
+		return -1;
+	}
+	nowdb_err_release(err);
+	fun = mkFun(NOWDB_FUN_PERCENTILE, p);
+	if (fun != NULL) {
+		fprintf(stderr, "rank 101 accepted\n");
+		nowdb_fun_destroy(fun); free(fun);
+		return -1;
+	}
+	return 0;
+}
+
+int main() {
+	int rc = EXIT_SUCCESS;
+
+	srand(time(NULL) ^ (uint64_t)&printf);
+
+	if (!nowdb_err_init()) {
+		fprintf(stderr, "cannot init error manager\n");
+		return EXIT_FAILURE;
+	}
+	for(int d=0; d<4; d++) {
+		if (testDigest(d) != 0) {
+			fprintf(stderr, "testDigest failed\n");
+			rc = EXIT_FAILURE; goto cleanup;
+		}
+	}
+	if (testFun() != 0) {
+		fprintf(stderr, "testFun failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testRank() != 0) {
+		fprintf(stderr, "testRank failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+
+cleanup:
+	nowdb_err_destroy();
+	if (rc == EXIT_SUCCESS) {
+		fprintf(stderr, "PASSED\n");
+	} else {
+		fprintf(stderr, "FAILED\n");
+	}
+	return rc;
+}
@@ -0,0 +1,235 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Simple tests for top-n
+ * ========================================================================
+ */
+#include <nowdb/types/types.h>
+#include <nowdb/sort/sort.h>
+#include <nowdb/query/topn.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#define NEDGES 100000
+
+#define STAMP_OFF  16
+#define WEIGHT_OFF 40
+
+typedef struct {
+	uint64_t origin;
+	uint64_t destin;
+	int64_t  timestamp;
+	char     byte; // control byte
+	char     pad[7];
+	uint64_t edge;
+	uint64_t weight;
+	uint64_t weight2;
+} myedge_t;
+
+uint64_t MYEDGE = 101;
+
+nowdb_eval_t _hlp;
+
+/* ------------------------------------------------------------------------
+ * Reference order: weight, timestamp (asc)
+ * ------------------------------------------------------------------------
+ */
+static int weightThenStamp(const void *one, const void *two) {
+	const myedge_t *a = one, *b = two;
+	if (a->weight < b->weight) return -1;
+	if (a->weight > b->weight) return  1;
+	if (a->timestamp < b->timestamp) return -1;
+	if (a->timestamp > b->timestamp) return  1;
+	return 0;
+}
+
+static int stampDesc(const void *one, const void *two) {
+	const myedge_t *a = one, *b = two;
+	if (a->timestamp > b->timestamp) return -1;
+	if (a->timestamp < b->timestamp) return  1;
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Create top-n ordered by stamp (and weight)
+ * ------------------------------------------------------------------------
+ */
+nowdb_topn_t *mkTopn(uint64_t n, char weight, nowdb_ord_t ord) {
+	nowdb_err_t err;
+	nowdb_topn_t *tn;
+	nowdb_expr_t key;
+	ts_algo_list_t keys;
+
+	ts_algo_list_init(&keys);
+	if (weight) {
+		err = nowdb_expr_newEdgeField(&key, "weight", WEIGHT_OFF,
+		                                      NOWDB_TYP_UINT, 4);
+		if (err != NOWDB_OK) {
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			return NULL;
+		}
+		if (ts_algo_list_append(&keys, key) != TS_ALGO_OK) {
+			fprintf(stderr, "out-of-mem\n");
+			nowdb_expr_destroy(key); free(key);
+			return NULL;
+		}
+	}
+	err = nowdb_expr_newEdgeField(&key, "stamp", STAMP_OFF,
+	                                     NOWDB_TYP_TIME, 4);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return NULL;
+	}
+	if (ts_algo_list_append(&keys, key) != TS_ALGO_OK) {
+		fprintf(stderr, "out-of-mem\n");
+		nowdb_expr_destroy(key); free(key);
+		return NULL;
+	}
+	err = nowdb_topn_new(&tn, &keys, &_hlp, ord, sizeof(myedge_t), n);
+	ts_algo_list_destroy(&keys);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return NULL;
+	}
+	return tn;
+}
+
+/* ------------------------------------------------------------------------
+ * Add random edges and compare the best 'n' with the sorted edges
+ * - weight: order by weight, stamp asc
+ * - otherwise: order by stamp desc
+ * ------------------------------------------------------------------------
+ */
+int testTopn(uint64_t n, char weight) {
+	int rc = 0;
+	nowdb_err_t err;
+	nowdb_topn_t *tn;
+	myedge_t *edges;
+	myedge_t edge;
+	char *rec;
+	uint64_t i, m;
+
+	fprintf(stderr, "top %lu by %s\n", n, weight?"weight, stamp":
+	                                              "stamp");
+
+	edges = calloc(NEDGES, sizeof(myedge_t));
+	if (edges == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		return -1;
+	}
+	tn = mkTopn(n, weight, weight?NOWDB_ORD_ASC:NOWDB_ORD_DESC);
+	if (tn == NULL) {
+		free(edges); return -1;
+	}
+	for(i=0; i<NEDGES; i++) {
+		edges[i].origin = i;
+		edges[i].edge = MYEDGE;
+		edges[i].byte = 0xff;
+		edges[i].weight = rand()%100;
+		edges[i].timestamp = rand()%1000000;
+		err = nowdb_topn_add(tn, (char*)(edges+i));
+		if (err != NOWDB_OK) {
+			fprintf(stderr, "cannot add\n");
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			rc = -1; goto cleanup;
+		}
+	}
+	if (weight) {
+		qsort(edges, NEDGES, sizeof(myedge_t), &weightThenStamp);
+	} else {
+		qsort(edges, NEDGES, sizeof(myedge_t), &stampDesc);
+	}
+	m = n > NEDGES ? NEDGES : n;
+	for(i=0;;i++) {
+		err = nowdb_topn_next(tn, &rec);
+		if (err != NOWDB_OK) {
+			if (nowdb_err_contains(err, nowdb_err_eof)) {
+				nowdb_err_release(err); break;
+			}
+			fprintf(stderr, "cannot get next record\n");
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			rc = -1; goto cleanup;
+		}
+		if (i >= m) {
+			fprintf(stderr, "too many records: %lu\n", i);
+			rc = -1; goto cleanup;
+		}
+		memcpy(&edge, rec, sizeof(myedge_t));
+		if (weight) {
+			if (weightThenStamp(&edge, edges+i) != 0) {
+				fprintf(stderr, "wrong record %lu: "
+				                "%lu/%ld != %lu/%ld\n", i,
+				        edge.weight, edge.timestamp,
+				        edges[i].weight, edges[i].timestamp);
+				rc = -1; goto cleanup;
+			}
+		} else if (edge.timestamp != edges[i].timestamp) {
+			fprintf(stderr, "wrong record %lu: %ld != %ld\n",
+			        i, edge.timestamp, edges[i].timestamp);
+			rc = -1; goto cleanup;
+		}
+	}
+	if (i != m) {
+		fprintf(stderr, "records missing: %lu of %lu\n", i, m);
+		rc = -1; goto cleanup;
+	}
+	if ((n == 0 && tn->discarded != NEDGES) ||
+	    (n >= NEDGES && tn->discarded != 0)) {
+		fprintf(stderr, "discarded: %lu\n", tn->discarded);
+		rc = -1; goto cleanup;
+	}
+cleanup:
+	nowdb_topn_destroy(tn); free(tn);
+	free(edges);
+	return rc;
+}
+
+int main() {
+	int rc = EXIT_SUCCESS;
+
+	srand(time(NULL) ^ (uint64_t)&printf);
+
+	if (!nowdb_err_init()) {
+		fprintf(stderr, "cannot init error manager\n");
+		return EXIT_FAILURE;
+	}
+	if (testTopn(0, 0) != 0) {
+		fprintf(stderr, "testTopn failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testTopn(1, 0) != 0) {
+		fprintf(stderr, "testTopn failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testTopn(100, 0) != 0) {
+		fprintf(stderr, "testTopn failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testTopn(5000, 1) != 0) {
+		fprintf(stderr, "testTopn failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	/* more than we have */
+	if (testTopn(2*NEDGES, 1) != 0) {
+		fprintf(stderr, "testTopn failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+
+cleanup:
+	nowdb_err_destroy();
+	if (rc == EXIT_SUCCESS) {
+		fprintf(stderr, "PASSED\n");
+	} else {
+		fprintf(stderr, "FAILED\n");
+	}
+	return rc;
+}
@@ -0,0 +1,289 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Simple tests for path traversal (level by level on pages of edges)
+ * ========================================================================
+ */
+#include <nowdb/types/types.h>
+#include <nowdb/query/trav.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#define NVERTICES 2000
+#define NEDGES   10000
+#define NSTARTS      3
+#define HOPS         4
+
+#define EDGE_SIZE   25
+
+typedef struct {
+	uint64_t origin;
+	uint64_t destin;
+	int64_t  timestamp;
+	char     byte; // control byte
+} __attribute__((packed)) myedge_t;
+
+/* ------------------------------------------------------------------------
+ * Random graph in pages
+ * ------------------------------------------------------------------------
+ */
+#define PERPAGE (NOWDB_IDX_PAGE/EDGE_SIZE)
+#define NPAGES  ((NEDGES+PERPAGE-1)/PERPAGE)
+
+static char *mkGraph() {
+	char *pages;
+	myedge_t e;
+
+	pages = calloc(NPAGES, NOWDB_IDX_PAGE);
+	if (pages == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		return NULL;
+	}
+	for(int i=0; i<NEDGES; i++) {
+		e.origin = rand()%NVERTICES;
+		e.destin = rand()%NVERTICES;
+		e.timestamp = rand()%100;
+		e.byte = 7;
+		memcpy(pages+(i/PERPAGE)*NOWDB_IDX_PAGE+(i%PERPAGE)*EDGE_SIZE,
+		       &e, EDGE_SIZE);
+	}
+	return pages;
+}
+
+static myedge_t *getEdge(char *pages, int i) {
+	return (myedge_t*)(pages+(i/PERPAGE)*NOWDB_IDX_PAGE+
+	                         (i%PERPAGE)*EDGE_SIZE);
+}
+
+/* ------------------------------------------------------------------------
+ * Reference: next level the naive way
+ * ------------------------------------------------------------------------
+ */
+static uint64_t nextLevel(char *pages, char dir,
+                          nowdb_time_t from, nowdb_time_t to,
+                          char *level, char *seen, char *next) {
+	uint64_t n=0;
+	myedge_t *e;
+	uint64_t near, far;
+
+	memset(next, 0, NVERTICES);
+	for(int i=0; i<NEDGES; i++) {
+		e = getEdge(pages, i);
+		if (e->timestamp < from || e->timestamp > to) continue;
+		near = dir == NOWDB_TRAV_OUT ? e->origin : e->destin;
+		far  = dir == NOWDB_TRAV_OUT ? e->destin : e->origin;
+		if (!level[near] || seen[far] || next[far]) continue;
+		next[far] = 1; n++;
+	}
+	for(int i=0; i<NVERTICES; i++) {
+		if (next[i]) seen[i] = 1;
+	}
+	return n;
+}
+
+/* ------------------------------------------------------------------------
+ * Traverse level by level and compare with the reference
+ * ------------------------------------------------------------------------
+ */
+static int testTrav(char dir, nowdb_time_t from, nowdb_time_t to) {
+	nowdb_err_t err;
+	nowdb_trav_t *trv;
+	char *pages;
+	char level[NVERTICES];
+	char seen[NVERTICES];
+	char next[NVERTICES];
+	nowdb_key_t starts[NSTARTS*2];
+	uint64_t n;
+	int rc = 0;
+
+	fprintf(stderr, "testTrav(%s, %ld, %ld)\n",
+	        dir == NOWDB_TRAV_OUT ? "out" : "in", from, to);
+
+	pages = mkGraph();
+	if (pages == NULL) return -1;
+
+	err = nowdb_trav_new(&trv, dir, HOPS, from, to, NOWDB_HSET_MEM);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		free(pages);
+		return -1;
+	}
+
+	/* start vertices with duplicates */
+	memset(level, 0, NVERTICES);
+	for(int i=0; i<NSTARTS; i++) {
+		starts[i] = rand()%NVERTICES;
+		starts[NSTARTS+i] = starts[i];
+		level[starts[i]] = 1;
+	}
+	memcpy(seen, level, NVERTICES);
+
+	err = nowdb_trav_start(trv, starts, NSTARTS*2);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		rc = -1; goto cleanup;
+	}
+
+	for(int h=0; h<=HOPS; h++) {
+
+		/* the frontier is sorted, unique and what we expect */
+		n = 0;
+		for(int i=0; i<NVERTICES; i++) n+=level[i];
+		if (trv->fsize != n) {
+			fprintf(stderr, "level %d: expected %lu, have %lu\n",
+			                                h, n, trv->fsize);
+			rc = -1; goto cleanup;
+		}
+		for(uint64_t i=0; i<trv->fsize; i++) {
+			if (i > 0 && trv->frontier[i-1] >= trv->frontier[i]) {
+				fprintf(stderr, "level %d not sorted\n", h);
+				rc = -1; goto cleanup;
+			}
+			if (!level[trv->frontier[i]]) {
+				fprintf(stderr, "level %d: unexpected %lu\n",
+				                      h, trv->frontier[i]);
+				rc = -1; goto cleanup;
+			}
+		}
+		fprintf(stderr, "level %d: %lu\n", h, n);
+		if (h == HOPS) break;
+
+		/* next level */
+		for(int p=0; p<NPAGES; p++) {
+			err = nowdb_trav_collect(trv,
+			          pages+p*NOWDB_IDX_PAGE,
+			                 EDGE_SIZE, NULL);
+			if (err != NOWDB_OK) {
+				nowdb_err_print(err);
+				nowdb_err_release(err);
+				rc = -1; goto cleanup;
+			}
+		}
+		err = nowdb_trav_advance(trv);
+		if (err != NOWDB_OK) {
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			rc = -1; goto cleanup;
+		}
+		nextLevel(pages, dir, from, to, level, seen, next);
+		memcpy(level, next, NVERTICES);
+	}
+
+cleanup:
+	nowdb_trav_destroy(trv); free(trv);
+	free(pages);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * With a tiny budget, the traversal still terminates
+ * and each level is still free of duplicates
+ * ------------------------------------------------------------------------
+ */
+static int testBudget() {
+	nowdb_err_t err;
+	nowdb_trav_t *trv;
+	char *pages;
+	nowdb_key_t start = 1;
+	uint64_t total=0;
+	int rc = 0;
+
+	fprintf(stderr, "testBudget\n");
+
+	pages = mkGraph();
+	if (pages == NULL) return -1;
+
+	err = nowdb_trav_new(&trv, NOWDB_TRAV_OUT, HOPS,
+	                     NOWDB_TIME_DAWN, NOWDB_TIME_DUSK, 128);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		free(pages);
+		return -1;
+	}
+	err = nowdb_trav_start(trv, &start, 1);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		rc = -1; goto cleanup;
+	}
+	for(int h=0; h<HOPS; h++) {
+		for(int p=0; p<NPAGES; p++) {
+			err = nowdb_trav_collect(trv,
+			          pages+p*NOWDB_IDX_PAGE,
+			                 EDGE_SIZE, NULL);
+			if (err != NOWDB_OK) {
+				nowdb_err_print(err);
+				nowdb_err_release(err);
+				rc = -1; goto cleanup;
+			}
+		}
+		err = nowdb_trav_advance(trv);
+		if (err != NOWDB_OK) {
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			rc = -1; goto cleanup;
+		}
+		if (trv->fsize > NVERTICES) {
+			fprintf(stderr, "level %d too big: %lu\n",
+			                           h, trv->fsize);
+			rc = -1; goto cleanup;
+		}
+		total += trv->fsize;
+	}
+	if (!trv->visited.spill) {
+		fprintf(stderr, "visited set not full\n");
+		rc = -1; goto cleanup;
+	}
+	fprintf(stderr, "reached: %lu\n", total);
+
+cleanup:
+	nowdb_trav_destroy(trv); free(trv);
+	free(pages);
+	return rc;
+}
+
+int main() {
+	int rc = EXIT_SUCCESS;
+
+	srand(time(NULL) ^ (uint64_t)&printf);
+
+	if (!nowdb_err_init()) {
+		fprintf(stderr, "cannot init error manager\n");
+		return EXIT_FAILURE;
+	}
+	if (testTrav(NOWDB_TRAV_OUT, NOWDB_TIME_DAWN,
+	                             NOWDB_TIME_DUSK) != 0) {
+		fprintf(stderr, "testTrav failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testTrav(NOWDB_TRAV_IN, NOWDB_TIME_DAWN,
+	                            NOWDB_TIME_DUSK) != 0) {
+		fprintf(stderr, "testTrav failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	/* only edges within the period */
+	if (testTrav(NOWDB_TRAV_OUT, 20, 60) != 0) {
+		fprintf(stderr, "testTrav failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testBudget() != 0) {
+		fprintf(stderr, "testBudget failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+
+cleanup:
+	nowdb_err_destroy();
+	if (rc == EXIT_SUCCESS) {
+		fprintf(stderr, "PASSED\n");
+	} else {
+		fprintf(stderr, "FAILED\n");
+	}
+	return rc;
+}
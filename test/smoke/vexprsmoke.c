@@ -0,0 +1,607 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Simple tests for vectorised expressions
+ * ========================================================================
+ */
+#include <nowdb/types/types.h>
+#include <nowdb/fun/expr.h>
+#include <nowdb/fun/vexpr.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+
+/* ------------------------------------------------------------------------
+ * Edge with three properties:
+ * origin, destin, stamp, weight (uint), value (int), ratio (float)
+ * ------------------------------------------------------------------------
+ */
+#define NATTS 6
+
+#define WEIGHT_OFF 24
+#define VALUE_OFF  32
+#define RATIO_OFF  40
+
+#define UNKNOWN -1
+
+nowdb_eval_t _hlp;
+
+uint32_t recsz;
+
+/* ------------------------------------------------------------------------
+ * Record access
+ * ------------------------------------------------------------------------
+ */
+static uint64_t getU(char *rec, uint32_t off) {
+	uint64_t u;
+	memcpy(&u, rec+off, 8);
+	return u;
+}
+
+static int64_t getI(char *rec, uint32_t off) {
+	int64_t i;
+	memcpy(&i, rec+off, 8);
+	return i;
+}
+
+static double getF(char *rec, uint32_t off) {
+	double d;
+	memcpy(&d, rec+off, 8);
+	return d;
+}
+
+static int isnull(char *rec, uint32_t off) {
+	uint8_t bit; uint16_t byte;
+	nowdb_getCtrl(off, &bit, &byte);
+	return !(rec[nowdb_ctrlStart(NATTS)+byte] & (1 << bit));
+}
+
+/* ------------------------------------------------------------------------
+ * Three-valued logic
+ * ------------------------------------------------------------------------
+ */
+static int and3(int a, int b) {
+	if (a == 0 || b == 0) return 0;
+	if (a == UNKNOWN || b == UNKNOWN) return UNKNOWN;
+	return 1;
+}
+
+static int or3(int a, int b) {
+	if (a == 1 || b == 1) return 1;
+	if (a == UNKNOWN || b == UNKNOWN) return UNKNOWN;
+	return 0;
+}
+
+static int not3(int a) {
+	if (a == UNKNOWN) return UNKNOWN;
+	return !a;
+}
+
+/* ------------------------------------------------------------------------
+ * Random page
+ * - props are NULL with a probability of 10%
+ * - some records are deleted (cont)
+ * - the page may end with the null record
+ * ------------------------------------------------------------------------
+ */
+static void mkPage(char *page, nowdb_bitmap8_t *cont, uint32_t n) {
+	uint32_t k = NOWDB_IDX_PAGE/recsz;
+
+	memset(page, 0, NOWDB_IDX_PAGE);
+	memset(cont, 0, NOWDB_SEL_MAX/8);
+
+	for(uint32_t i=0; i<n && i<k; i++) {
+		char *rec = page+i*recsz;
+		uint64_t u; int64_t l; double d;
+
+		u = rand()%1000+1; memcpy(rec, &u, 8);
+		u = rand()%1000+1; memcpy(rec+8, &u, 8);
+		l = rand()%100000; memcpy(rec+16, &l, 8);
+		u = rand()%100; memcpy(rec+WEIGHT_OFF, &u, 8);
+		l = rand()%200-100; memcpy(rec+VALUE_OFF, &l, 8);
+		d = (double)(rand()%1000)/10.0; memcpy(rec+RATIO_OFF, &d, 8);
+
+		rec[nowdb_ctrlStart(NATTS)] = 7;
+		for(int j=3; j<NATTS; j++) {
+			if (rand()%10 != 0) rec[nowdb_ctrlStart(NATTS)] |= 1 << j;
+		}
+		if (rand()%20 != 0) cont[i/8] |= 1 << (i%8);
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Expression helpers
+ * ------------------------------------------------------------------------
+ */
+static nowdb_expr_t field(char *name, uint32_t off, nowdb_type_t t) {
+	nowdb_err_t err;
+	nowdb_expr_t f;
+
+	err = nowdb_expr_newEdgeField(&f, name, off, t, NATTS);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return NULL;
+	}
+	return f;
+}
+
+static nowdb_expr_t constant(void *v, nowdb_type_t t) {
+	nowdb_err_t err;
+	nowdb_expr_t c;
+
+	err = nowdb_expr_newConstant(&c, v, t);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return NULL;
+	}
+	return c;
+}
+
+static nowdb_expr_t op1(uint32_t fun, nowdb_expr_t a) {
+	nowdb_err_t err;
+	nowdb_expr_t o;
+
+	if (a == NULL) return NULL;
+	err = nowdb_expr_newOp(&o, fun, a);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_expr_destroy(a); free(a);
+		return NULL;
+	}
+	return o;
+}
+
+static nowdb_expr_t op2(uint32_t fun, nowdb_expr_t a, nowdb_expr_t b) {
+	nowdb_err_t err;
+	nowdb_expr_t o;
+
+	if (a == NULL || b == NULL) {
+		if (a != NULL) { nowdb_expr_destroy(a); free(a); }
+		if (b != NULL) { nowdb_expr_destroy(b); free(b); }
+		return NULL;
+	}
+	err = nowdb_expr_newOp(&o, fun, a, b);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_expr_destroy(a); free(a);
+		nowdb_expr_destroy(b); free(b);
+		return NULL;
+	}
+	return o;
+}
+
+static nowdb_expr_t weight() {
+	return field("weight", WEIGHT_OFF, NOWDB_TYP_UINT);
+}
+
+static nowdb_expr_t value() {
+	return field("value", VALUE_OFF, NOWDB_TYP_INT);
+}
+
+static nowdb_expr_t ratio() {
+	return field("ratio", RATIO_OFF, NOWDB_TYP_FLOAT);
+}
+
+static nowdb_expr_t stamp() {
+	return field(NULL, NOWDB_OFF_STAMP, NOWDB_TYP_TIME);
+}
+
+static nowdb_expr_t uconst(uint64_t u) {
+	return constant(&u, NOWDB_TYP_UINT);
+}
+
+static nowdb_expr_t iconst(int64_t i) {
+	return constant(&i, NOWDB_TYP_INT);
+}
+
+static nowdb_expr_t fconst(double d) {
+	return constant(&d, NOWDB_TYP_FLOAT);
+}
+
+/* ------------------------------------------------------------------------
+ * 'in' list with n values of type t
+ * ------------------------------------------------------------------------
+ */
+static nowdb_expr_t inconst(nowdb_type_t t, int n, ...) {
+	nowdb_err_t err;
+	nowdb_expr_t c;
+	ts_algo_list_t vals;
+	ts_algo_list_node_t *run;
+	va_list args;
+	void *v;
+
+	ts_algo_list_init(&vals);
+	va_start(args, n);
+	for(int i=0; i<n; i++) {
+		v = malloc(8);
+		if (v == NULL) break;
+		if (t == NOWDB_TYP_FLOAT) {
+			*(double*)v = va_arg(args, double);
+		} else {
+			*(int64_t*)v = va_arg(args, int64_t);
+		}
+		if (ts_algo_list_append(&vals, v) != TS_ALGO_OK) {
+			free(v); break;
+		}
+	}
+	va_end(args);
+	if (vals.len != n) {
+		fprintf(stderr, "out-of-mem\n");
+		ts_algo_list_destroyAll(&vals);
+		return NULL;
+	}
+	err = nowdb_expr_constFromList(&c, &vals, t);
+	if (err != NOWDB_OK) {
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		for(run=vals.head; run!=NULL; run=run->nxt) free(run->cont);
+		ts_algo_list_destroy(&vals);
+		return NULL;
+	}
+	ts_algo_list_destroy(&vals);
+	return c;
+}
+
+/* ------------------------------------------------------------------------
+ * Reference predicates
+ * ------------------------------------------------------------------------
+ */
+static int wGT(char *r, uint64_t c) {
+	if (isnull(r, WEIGHT_OFF)) return UNKNOWN;
+	return getU(r, WEIGHT_OFF) > c;
+}
+
+static int wEQ(char *r, uint64_t c) {
+	if (isnull(r, WEIGHT_OFF)) return UNKNOWN;
+	return getU(r, WEIGHT_OFF) == c;
+}
+
+static int vLE(char *r, int64_t c) {
+	if (isnull(r, VALUE_OFF)) return UNKNOWN;
+	return getI(r, VALUE_OFF) <= c;
+}
+
+static int rLT(char *r, double c) {
+	if (isnull(r, RATIO_OFF)) return UNKNOWN;
+	return getF(r, RATIO_OFF) < c;
+}
+
+static int rGT(char *r, double c) {
+	if (isnull(r, RATIO_OFF)) return UNKNOWN;
+	return getF(r, RATIO_OFF) > c;
+}
+
+static int wIN(char *r, int n, const uint64_t *c) {
+	if (isnull(r, WEIGHT_OFF)) return UNKNOWN;
+	for(int i=0; i<n; i++) {
+		if (getU(r, WEIGHT_OFF) == c[i]) return 1;
+	}
+	return 0;
+}
+
+static int vIN(char *r, int n, const int64_t *c) {
+	if (isnull(r, VALUE_OFF)) return UNKNOWN;
+	for(int i=0; i<n; i++) {
+		if (getI(r, VALUE_OFF) == c[i]) return 1;
+	}
+	return 0;
+}
+
+static const int64_t  vals4[] = {-5, 0, 5, 10};
+static const uint64_t wgts3[] = {1, 2, 3};
+static const uint64_t wgts9[] = {1, 3, 5, 7, 11, 13, 17, 19, 23};
+
+/* ------------------------------------------------------------------------
+ * Test cases
+ * ------------------------------------------------------------------------
+ */
+#define NCASES 20
+
+static nowdb_expr_t mkCase(int i) {
+	switch(i) {
+	case 0: return op2(NOWDB_EXPR_OP_GT, weight(), uconst(50));
+	case 1: return op2(NOWDB_EXPR_OP_LE, value(), iconst(-10));
+	case 2: return op2(NOWDB_EXPR_OP_LT, ratio(), fconst(33.3));
+	case 3: return op2(NOWDB_EXPR_OP_GE, stamp(), iconst(50000));
+	case 4: return op2(NOWDB_EXPR_OP_LT, uconst(50), weight());
+	case 5: return op1(NOWDB_EXPR_OP_NOT,
+	               op2(NOWDB_EXPR_OP_EQ, weight(), uconst(7)));
+	case 6: return op2(NOWDB_EXPR_OP_AND,
+	               op2(NOWDB_EXPR_OP_GT, weight(), uconst(50)),
+	               op2(NOWDB_EXPR_OP_LE, value(), iconst(-10)));
+	case 7: return op2(NOWDB_EXPR_OP_OR,
+	               op2(NOWDB_EXPR_OP_GT, weight(), uconst(90)),
+	               op2(NOWDB_EXPR_OP_LT, ratio(), fconst(10.0)));
+	case 8: return op1(NOWDB_EXPR_OP_NOT,
+	               op2(NOWDB_EXPR_OP_AND,
+	               op2(NOWDB_EXPR_OP_GT, weight(), uconst(50)),
+	               op2(NOWDB_EXPR_OP_LE, value(), iconst(-10))));
+	case 9: return op1(NOWDB_EXPR_OP_IS, weight());
+	case 10: return op1(NOWDB_EXPR_OP_NOT,
+	                op1(NOWDB_EXPR_OP_IS, value()));
+	// row fallback
+	case 11: return op2(NOWDB_EXPR_OP_GT,
+	                op2(NOWDB_EXPR_OP_ADD, weight(), uconst(10)),
+	                uconst(60));
+	// fallback within vector
+	case 12: return op2(NOWDB_EXPR_OP_AND,
+	                op2(NOWDB_EXPR_OP_LE, value(), iconst(-10)),
+	                op1(NOWDB_EXPR_OP_NOT,
+	                op2(NOWDB_EXPR_OP_GT,
+	                op2(NOWDB_EXPR_OP_ADD, weight(), uconst(10)),
+	                uconst(60))));
+	// mixed types: int field, uint constant
+	case 13: return op2(NOWDB_EXPR_OP_GT, value(), uconst(10));
+	// between (fused)
+	case 14: return op2(NOWDB_EXPR_OP_AND,
+	                op2(NOWDB_EXPR_OP_GE, weight(), uconst(20)),
+	                op2(NOWDB_EXPR_OP_LT, weight(), uconst(60)));
+	// nested 'and' with between on ratio
+	case 15: return op2(NOWDB_EXPR_OP_AND,
+	                op2(NOWDB_EXPR_OP_GT, ratio(), fconst(10.0)),
+	                op2(NOWDB_EXPR_OP_AND,
+	                op2(NOWDB_EXPR_OP_LE, value(), iconst(50)),
+	                op2(NOWDB_EXPR_OP_LT, ratio(), fconst(50.0))));
+	// in
+	case 16: return op2(NOWDB_EXPR_OP_IN, value(),
+	                inconst(NOWDB_TYP_INT, 4, (int64_t)-5, (int64_t)0,
+	                                          (int64_t)5, (int64_t)10));
+	case 17: return op1(NOWDB_EXPR_OP_NOT,
+	                op2(NOWDB_EXPR_OP_IN, weight(),
+	                inconst(NOWDB_TYP_UINT, 3, (int64_t)1, (int64_t)2,
+	                                                       (int64_t)3)));
+	// not (a or b) with between and 'in'
+	case 18: return op1(NOWDB_EXPR_OP_NOT,
+	                op2(NOWDB_EXPR_OP_OR,
+	                op2(NOWDB_EXPR_OP_LT, weight(), uconst(10)),
+	                op2(NOWDB_EXPR_OP_OR,
+	                op2(NOWDB_EXPR_OP_IN, value(),
+	                inconst(NOWDB_TYP_INT, 4, (int64_t)-5, (int64_t)0,
+	                                          (int64_t)5, (int64_t)10)),
+	                op2(NOWDB_EXPR_OP_GE, weight(), uconst(90)))));
+	// large 'in': row fallback
+	case 19: return op2(NOWDB_EXPR_OP_IN, weight(),
+	                inconst(NOWDB_TYP_UINT, 9, (int64_t)1, (int64_t)3,
+	                        (int64_t)5, (int64_t)7, (int64_t)11,
+	                        (int64_t)13, (int64_t)17, (int64_t)19,
+	                        (int64_t)23));
+	default: return NULL;
+	}
+}
+
+static int refCase(int i, char *r) {
+	switch(i) {
+	case 0: return wGT(r, 50);
+	case 1: return vLE(r, -10);
+	case 2: return rLT(r, 33.3);
+	case 3: return getI(r, NOWDB_OFF_STAMP) >= 50000;
+	case 4: return wGT(r, 50);
+	case 5: return not3(wEQ(r, 7));
+	case 6: return and3(wGT(r, 50), vLE(r, -10));
+	case 7: return or3(wGT(r, 90), rLT(r, 10.0));
+	case 8: return not3(and3(wGT(r, 50), vLE(r, -10)));
+	case 9: return isnull(r, WEIGHT_OFF);
+	case 10: return !isnull(r, VALUE_OFF);
+	case 11: return wGT(r, 50);
+	case 12: return and3(vLE(r, -10), not3(wGT(r, 50)));
+	case 13: return not3(vLE(r, 10));
+	case 14: return and3(wGT(r, 19), not3(wGT(r, 59)));
+	case 15: return and3(rGT(r, 10.0), and3(vLE(r, 50), rLT(r, 50.0)));
+	case 16: return vIN(r, 4, vals4);
+	case 17: return not3(wIN(r, 3, wgts3));
+	case 18: return not3(or3(not3(wGT(r, 9)),
+	                     or3(vIN(r, 4, vals4), wGT(r, 89))));
+	case 19: return wIN(r, 9, wgts9);
+	default: return 0;
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Compare vectorised selection with reference
+ * ------------------------------------------------------------------------
+ */
+int testCase(int i, char *page, nowdb_bitmap8_t *cont, uint32_t n) {
+	nowdb_err_t err;
+	nowdb_vexpr_t *vx;
+	nowdb_expr_t expr;
+	nowdb_sel_t sel;
+	uint32_t k=0;
+	int rc = 0;
+
+	expr = mkCase(i);
+	if (expr == NULL) {
+		fprintf(stderr, "cannot create case %d\n", i);
+		return -1;
+	}
+	err = nowdb_vexpr_new(&vx, expr, &_hlp);
+	if (err != NOWDB_OK) {
+		fprintf(stderr, "cannot compile case %d\n", i);
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		nowdb_expr_destroy(expr); free(expr);
+		return -1;
+	}
+	if ((i == 11 && vx->fallbacks != 1) ||
+	    (i == 12 && vx->fallbacks != 1) ||
+	    (i == 19 && vx->fallbacks != 1) ||
+	    (i  < 11 && vx->fallbacks != 0) ||
+	    (i  > 12 && i < 19 && vx->fallbacks != 0)) {
+		fprintf(stderr, "case %d: wrong number of fallbacks: %u\n",
+		                                         i, vx->fallbacks);
+		rc = -1; goto cleanup;
+	}
+	// bounds fused into between, nested 'and'/'or' flattened
+	if ((i == 14 && vx->root->args != 1) ||
+	    (i == 15 && vx->root->args != 2) ||
+	    (i == 18 && vx->root->args != 2)) {
+		fprintf(stderr, "case %d: wrong number of operands: %u\n",
+		                                        i, vx->root->args);
+		rc = -1; goto cleanup;
+	}
+
+	nowdb_sel_fromPage(&sel, page, NOWDB_IDX_PAGE, recsz, cont);
+
+	err = nowdb_vexpr_select(vx, page, recsz, &sel);
+	if (err != NOWDB_OK) {
+		fprintf(stderr, "cannot select case %d\n", i);
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		rc = -1; goto cleanup;
+	}
+	for(uint32_t p=0; p<n && p<NOWDB_IDX_PAGE/recsz; p++) {
+		if (!(cont[p/8] & (1 << (p%8)))) continue;
+		if (refCase(i, page+p*recsz) != 1) continue;
+		if (k >= sel.count || sel.pos[k] != p) {
+			fprintf(stderr, "case %d: record %u not selected\n",
+			                                            i, p);
+			rc = -1; goto cleanup;
+		}
+		k++;
+	}
+	if (k != sel.count) {
+		fprintf(stderr, "case %d: selected %u, expected %u\n",
+		                                    i, sel.count, k);
+		rc = -1; goto cleanup;
+	}
+
+cleanup:
+	nowdb_vexpr_destroy(vx); free(vx);
+	nowdb_expr_destroy(expr); free(expr);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * Run all cases on a full page and on a partial page
+ * ------------------------------------------------------------------------
+ */
+int testPage(uint32_t n) {
+	nowdb_bitmap8_t cont[NOWDB_SEL_MAX/8];
+	char *page;
+	int rc = 0;
+
+	fprintf(stderr, "page with %u records\n", n);
+
+	page = calloc(1, NOWDB_IDX_PAGE);
+	if (page == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		return -1;
+	}
+	mkPage(page, cont, n);
+	for(int i=0; i<NCASES; i++) {
+		if (testCase(i, page, cont, n) != 0) {
+			rc = -1; break;
+		}
+	}
+	free(page);
+	return rc;
+}
+
+/* ------------------------------------------------------------------------
+ * Selection from page with sparse bitmap and without bitmap
+ * ------------------------------------------------------------------------
+ */
+int testFromPage(uint32_t n, int every) {
+	nowdb_bitmap8_t cont[NOWDB_SEL_MAX/8];
+	nowdb_sel_t sel;
+	uint32_t k=0;
+	char *page;
+	int rc = 0;
+
+	fprintf(stderr, "selection from page with %u records (%d)\n",
+	                                                    n, every);
+
+	page = calloc(1, NOWDB_IDX_PAGE);
+	if (page == NULL) {
+		fprintf(stderr, "out-of-mem\n");
+		return -1;
+	}
+	mkPage(page, cont, n);
+
+	// only every nth record is in
+	memset(cont, 0, NOWDB_SEL_MAX/8);
+	for(uint32_t p=0; p<NOWDB_SEL_MAX; p+=every) {
+		cont[p/8] |= 1 << (p%8);
+	}
+	if (n > NOWDB_IDX_PAGE/recsz) n = NOWDB_IDX_PAGE/recsz;
+
+	nowdb_sel_fromPage(&sel, page, NOWDB_IDX_PAGE, recsz, cont);
+	for(uint32_t p=0; p<n; p+=every) {
+		if (k >= sel.count || sel.pos[k] != p) {
+			fprintf(stderr, "record %u not selected\n", p);
+			rc = -1; goto cleanup;
+		}
+		k++;
+	}
+	if (k != sel.count) {
+		fprintf(stderr, "selected %u, expected %u\n", sel.count, k);
+		rc = -1; goto cleanup;
+	}
+
+	// without bitmap, all records up to the null record are in
+	nowdb_sel_fromPage(&sel, page, NOWDB_IDX_PAGE, recsz, NULL);
+	if (sel.count != n) {
+		fprintf(stderr, "selected %u, expected %u\n", sel.count, n);
+		rc = -1; goto cleanup;
+	}
+	for(uint32_t p=0; p<n; p++) {
+		if (sel.pos[p] != p) {
+			fprintf(stderr, "record %u not selected\n", p);
+			rc = -1; goto cleanup;
+		}
+	}
+
+cleanup:
+	free(page);
+	return rc;
+}
+
+int main() {
+	int rc = EXIT_SUCCESS;
+
+	srand(time(NULL) ^ (uint64_t)&printf);
+
+	recsz = nowdb_recSize(NATTS);
+
+	if (!nowdb_err_init()) {
+		fprintf(stderr, "cannot init error manager\n");
+		return EXIT_FAILURE;
+	}
+	for(int i=0; i<10; i++) {
+		if (testPage(NOWDB_IDX_PAGE/recsz) != 0) {
+			fprintf(stderr, "testPage failed\n");
+			rc = EXIT_FAILURE; goto cleanup;
+		}
+	}
+	if (testPage(17) != 0) {
+		fprintf(stderr, "testPage failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testPage(0) != 0) {
+		fprintf(stderr, "testPage failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testFromPage(NOWDB_IDX_PAGE/recsz, 37) != 0 ||
+	    testFromPage(NOWDB_IDX_PAGE/recsz, 1)  != 0 ||
+	    testFromPage(65, 3) != 0 ||
+	    testFromPage(0, 5)  != 0) {
+		fprintf(stderr, "testFromPage failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+
+cleanup:
+	nowdb_err_destroy();
+	if (rc == EXIT_SUCCESS) {
+		fprintf(stderr, "PASSED\n");
+	} else {
+		fprintf(stderr, "FAILED\n");
+	}
+	return rc;
+}
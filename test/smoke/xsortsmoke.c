@@ -0,0 +1,191 @@
+/* ========================================================================
+ * (c) Tobias Schoofs, 2018 -- 2019
+ * ========================================================================
+ * Simple tests for external sorting
+ * ========================================================================
+ */
+#include <nowdb/types/types.h>
+#include <nowdb/types/error.h>
+#include <nowdb/io/file.h>
+#include <nowdb/sort/sort.h>
+#include <nowdb/sort/xsort.h>
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define NRECS 100000
+
+typedef struct {
+	uint64_t key;
+	uint64_t seq;
+	char     pad[24];
+} myrec_t;
+
+nowdb_cmp_t reccmp(const void *one, const void *two, void *ignore) {
+	if (((myrec_t*)one)->key < ((myrec_t*)two)->key)
+		return NOWDB_SORT_LESS;
+	if (((myrec_t*)one)->key > ((myrec_t*)two)->key)
+		return NOWDB_SORT_GREATER;
+	return NOWDB_SORT_EQUAL;
+}
+
+/* ------------------------------------------------------------------------
+ * Consume all records and check order and checksum
+ * ------------------------------------------------------------------------
+ */
+int checkOrder(nowdb_xsort_t *xs, int n, uint64_t sum) {
+	nowdb_err_t err;
+	myrec_t last, *rec;
+	uint64_t s=0;
+	int c=0;
+
+	for(;;) {
+		rec = (myrec_t*)nowdb_xsort_top(xs);
+		if (rec == NULL) break;
+		if (c > 0 && reccmp(&last, rec, NULL) == NOWDB_SORT_GREATER) {
+			fprintf(stderr, "not sorted at %d: %lu > %lu\n",
+			                        c, last.key, rec->key);
+			return -1;
+		}
+		memcpy(&last, rec, sizeof(myrec_t));
+		s += rec->seq; c++;
+		err = nowdb_xsort_pop(xs);
+		if (err != NOWDB_OK) {
+			fprintf(stderr, "cannot pop\n");
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			return -1;
+		}
+	}
+	if (c != n) {
+		fprintf(stderr, "counted %d, expected %d\n", c, n);
+		return -1;
+	}
+	if (s != sum) {
+		fprintf(stderr, "checksum differs: %lu / %lu\n", s, sum);
+		return -1;
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Sort n random records with runs of size runsz
+ * ------------------------------------------------------------------------
+ */
+int testXSort(int n, uint64_t runsz, nowdb_comp_t comp) {
+	int rc = 0;
+	nowdb_err_t err;
+	nowdb_xsort_t *xs;
+	myrec_t rec;
+	uint64_t sum=0;
+
+	fprintf(stderr, "%d records, runs of %lu bytes, codec %u\n",
+	                                           n, runsz, comp);
+
+	err = nowdb_xsort_new(&xs, "/tmp", comp, sizeof(myrec_t),
+	                                     runsz, &reccmp, NULL);
+	if (err != NOWDB_OK) {
+		fprintf(stderr, "cannot create external sort\n");
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		return -1;
+	}
+	memset(&rec, 0, sizeof(myrec_t));
+	for(int i=0; i<n; i++) {
+		rec.key = rand()%(n/10+1);
+		rec.seq = i;
+		sum += i;
+		err = nowdb_xsort_add(xs, (char*)&rec);
+		if (err != NOWDB_OK) {
+			fprintf(stderr, "cannot add\n");
+			nowdb_err_print(err);
+			nowdb_err_release(err);
+			rc = -1; goto cleanup;
+		}
+	}
+	err = nowdb_xsort_finish(xs);
+	if (err != NOWDB_OK) {
+		fprintf(stderr, "cannot finish\n");
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		rc = -1; goto cleanup;
+	}
+	fprintf(stderr, "%u runs, %lu bytes in file\n", xs->nruns, xs->fsize);
+
+	if (checkOrder(xs, n, sum) != 0) {
+		rc = -1; goto cleanup;
+	}
+
+	/* once again */
+	err = nowdb_xsort_rewind(xs);
+	if (err != NOWDB_OK) {
+		fprintf(stderr, "cannot rewind\n");
+		nowdb_err_print(err);
+		nowdb_err_release(err);
+		rc = -1; goto cleanup;
+	}
+	if (checkOrder(xs, n, sum) != 0) {
+		rc = -1; goto cleanup;
+	}
+
+cleanup:
+	nowdb_xsort_destroy(xs); free(xs);
+	return rc;
+}
+
+int main() {
+	int rc = EXIT_SUCCESS;
+
+	srand(time(NULL) ^ (uint64_t)&printf);
+
+	if (!nowdb_err_init()) {
+		fprintf(stderr, "cannot init error manager\n");
+		return EXIT_FAILURE;
+	}
+
+	/* nothing */
+	if (testXSort(0, 65536, NOWDB_COMP_FLAT) != 0) {
+		fprintf(stderr, "testXSort failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	/* fits into memory */
+	if (testXSort(NRECS, NOWDB_GIGA, NOWDB_COMP_FLAT) != 0) {
+		fprintf(stderr, "testXSort failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	/* spills */
+	if (testXSort(NRECS, 100000, NOWDB_COMP_FLAT) != 0) {
+		fprintf(stderr, "testXSort failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testXSort(NRECS, 100000, NOWDB_COMP_ZSTD) != 0) {
+		fprintf(stderr, "testXSort failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	if (testXSort(NRECS, 100000, NOWDB_COMP_LZ4) != 0) {
+		fprintf(stderr, "testXSort failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	/* many small runs */
+	if (testXSort(NRECS, 4096, NOWDB_COMP_LZ4) != 0) {
+		fprintf(stderr, "testXSort failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+	/* records fill the runs exactly */
+	if (testXSort(1000, 48*100, NOWDB_COMP_ZSTD) != 0) {
+		fprintf(stderr, "testXSort failed\n");
+		rc = EXIT_FAILURE; goto cleanup;
+	}
+
+cleanup:
+	nowdb_err_destroy();
+	if (rc == EXIT_SUCCESS) {
+		fprintf(stderr, "PASSED\n");
+	} else {
+		fprintf(stderr, "FAILED\n");
+	}
+	return rc;
+}